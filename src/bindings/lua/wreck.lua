@@ -32,11 +32,14 @@ local lwj_options = {
 --    ['ntasks'] =                "Set total number of tasks to execute",
     ['commit-on-task-exit'] =   "Call kvs_commit for each task exit",
     ['stdio-delay-commit'] =    "Don't call kvs_commit for each line of output",
+    ['stdio-batch-bytes'] =     "Flush task output after N bytes (=N)",
+    ['stdio-batch-ms'] =        "Flush task output after N milliseconds (=N)",
     ['stdio-commit-on-open'] =  "Commit to kvs on stdio open in each task",
     ['stdio-commit-on-close'] = "Commit to kvs on stdio close in each task",
     ['stop-children-in-exec'] = "Start tasks in STOPPED state for debugger",
     ['no-pmi-server'] =         "Do not start simple-pmi server",
     ['trace-pmi-server'] =      "Log simple-pmi server protocol exchange",
+    ['pmi-exchange'] =          "PMI key exchange: allgather or kvs (=METHOD)",
 }
 
 local default_opts = {
@@ -220,7 +223,7 @@ function wreck:parse_cmdline (arg)
 
     if self.opts.o then
         for opt in self.opts.o:gmatch ("[^,]+") do
-            if not lwj_options [opt] then
+            if not lwj_options [opt:match ("^[^=]+")] then
                 return nil, string.format ("Unknown LWJ option '%s'\n", opt)
             end
         end
@@ -314,7 +317,12 @@ function wreck:jobreq ()
     }
     if self.opts.o then
         for opt in self.opts.o:gmatch ('[^,]+') do
-            jobreq['options.'..opt] = 1
+            local k,v = opt:match ("^([^=]+)=(.*)$")
+            if k then
+                jobreq['options.'..k] = tonumber (v) or v
+            else
+                jobreq['options.'..opt] = 1
+            end
         end
     end
     if self.opts.O or self.opts.E then
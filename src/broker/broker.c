@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 #include <getopt.h>
 #include <libgen.h>
 #include <sys/types.h>
@@ -44,6 +45,7 @@
 #include <argz.h>
 #include <flux/core.h>
 #include <czmq.h>
+#include <jansson.h>
 #if HAVE_CALIPER
 #include <caliper/cali.h>
 #include <sys/syscall.h>
@@ -80,6 +82,8 @@
 #include "exec.h"
 #include "ping.h"
 #include "rusage.h"
+#include "recvstats.h"
+#include "treerpc.h"
 
 /* Generally accepted max, although some go higher (IE is 2083) */
 #define ENDPOINT_MAX 2048
@@ -125,6 +129,7 @@ typedef struct {
     zlist_t *subscriptions;     /* subscripts for internal services */
     content_cache_t *cache;
     int tbon_k;
+    int recv_budget;            /* messages handled per socket wakeup */
     /* Bootstrap
      */
     hello_t *hello;
@@ -172,6 +177,9 @@ static void runlevel_cb (runlevel_t *r, int level, int rc, double elapsed,
 static void runlevel_io_cb (runlevel_t *r, const char *name,
                             const char *msg, void *arg);
 
+static int recv_budget_get_cb (const char *name, const char **val, void *arg);
+static int recv_budget_set_cb (const char *name, const char *val, void *arg);
+
 static int create_persistdir (attr_t *attrs, uint32_t rank);
 static int create_rundir (attr_t *attrs);
 static int create_dummyattrs (flux_t *h, uint32_t rank, uint32_t size);
@@ -325,6 +333,7 @@ int main (int argc, char *argv[])
     ctx.overlay = overlay_create ();
     ctx.hello = hello_create ();
     ctx.tbon_k = 2; /* binary TBON is default */
+    ctx.recv_budget = RECV_BUDGET_DEFAULT;
     ctx.heartbeat = heartbeat_create ();
     ctx.shutdown = shutdown_create ();
     ctx.attrs = attr_create ();
@@ -475,6 +484,9 @@ int main (int argc, char *argv[])
      */
     if (overlay_register_attrs(ctx.overlay, ctx.attrs) < 0)
         log_err_exit ("registering overlay attributes");
+    if (attr_add_active (ctx.attrs, "broker.recv-budget", 0,
+                         recv_budget_get_cb, recv_budget_set_cb, &ctx) < 0)
+        log_err_exit ("configuring broker.recv-budget attribute");
     if (hello_register_attrs (ctx.hello, ctx.attrs) < 0)
         log_err_exit ("configuring attributes");
 
@@ -580,6 +592,8 @@ int main (int argc, char *argv[])
         log_err_exit ("ping_initialize");
     if (rusage_initialize (ctx.h, "cmb") < 0)
         log_err_exit ("rusage_initialize");
+    if (treerpc_initialize (ctx.h, "cmb", ctx.tbon_k) < 0)
+        log_err_exit ("treerpc_initialize");
 
     handlers = broker_add_services (&ctx);
 
@@ -855,6 +869,43 @@ static void runlevel_cb (runlevel_t *r, int level, int rc, double elapsed,
     }
 }
 
+/* broker.recv-budget limits the messages handled each time an overlay
+ * socket or module becomes ready, so that one busy peer can't starve the
+ * others.
+ */
+static int recv_budget_get_cb (const char *name, const char **val, void *arg)
+{
+    broker_ctx_t *ctx = arg;
+    static char s[32];
+
+    snprintf (s, sizeof (s), "%d", ctx->recv_budget);
+    *val = s;
+    return 0;
+}
+
+static int recv_budget_set_cb (const char *name, const char *val, void *arg)
+{
+    broker_ctx_t *ctx = arg;
+    char *endptr;
+    long budget;
+
+    if (!val) {
+        errno = EINVAL;
+        return -1;
+    }
+    errno = 0;
+    budget = strtol (val, &endptr, 10);
+    if (errno != 0 || *endptr != '\0' || endptr == val
+                   || budget < 1 || budget > INT_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    ctx->recv_budget = budget;
+    overlay_set_recv_budget (ctx->overlay, budget);
+    modhash_set_recv_budget (ctx->modhash, budget);
+    return 0;
+}
+
 static int create_dummyattrs (flux_t *h, uint32_t rank, uint32_t size)
 {
     char *s;
@@ -1690,6 +1741,48 @@ error:
     free (uuid);
 }
 
+static void cmb_stats_get_cb (flux_t *h, flux_msg_handler_t *mh,
+                              const flux_msg_t *msg, void *arg)
+{
+    broker_ctx_t *ctx = arg;
+    json_t *overlay_o = NULL;
+    json_t *modules_o = NULL;
+
+    if (flux_request_decode (msg, NULL, NULL) < 0)
+        goto error;
+    if (!(overlay_o = overlay_recvstats_encode (ctx->overlay))
+            || !(modules_o = modhash_recvstats_encode (ctx->modhash)))
+        goto error;
+    if (flux_respond_pack (h, msg, "{s:i s:o s:o}",
+                           "recv-budget", ctx->recv_budget,
+                           "overlay", overlay_o,
+                           "modules", modules_o) < 0)
+        flux_log_error (h, "%s: flux_respond_pack", __FUNCTION__);
+    return;
+error:
+    if (flux_respond (h, msg, errno, NULL) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+    json_decref (overlay_o);
+    json_decref (modules_o);
+}
+
+static void cmb_stats_clear_cb (flux_t *h, flux_msg_handler_t *mh,
+                                const flux_msg_t *msg, void *arg)
+{
+    broker_ctx_t *ctx = arg;
+
+    if (flux_request_decode (msg, NULL, NULL) < 0)
+        goto error;
+    overlay_recvstats_clear (ctx->overlay);
+    modhash_recvstats_clear (ctx->modhash);
+    if (flux_respond (h, msg, 0, NULL) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+    return;
+error:
+    if (flux_respond (h, msg, errno, NULL) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+}
+
 static int route_to_handle (const flux_msg_t *msg, void *arg)
 {
     broker_ctx_t *ctx = arg;
@@ -1708,6 +1801,8 @@ static const struct flux_msg_handler_spec htab[] = {
     { FLUX_MSGTYPE_REQUEST, "cmb.disconnect", cmb_disconnect_cb, 0 },
     { FLUX_MSGTYPE_REQUEST, "cmb.sub",        cmb_sub_cb, 0 },
     { FLUX_MSGTYPE_REQUEST, "cmb.unsub",      cmb_unsub_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "cmb.stats.get",  cmb_stats_get_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "cmb.stats.clear", cmb_stats_clear_cb, 0 },
     FLUX_MSGHANDLER_TABLE_END,
 };
 
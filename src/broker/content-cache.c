@@ -28,12 +28,13 @@
 #include "config.h"
 #endif
 #include <inttypes.h>
+#include <stdbool.h>
 #include <czmq.h>
 #include <flux/core.h>
 #include "src/common/libutil/xzmalloc.h"
 #include "src/common/libutil/blobref.h"
-#include "src/common/libutil/iterators.h"
 #include "src/common/libutil/log.h"
+#include "src/common/libutil/blobvec.h"
 
 #include "attr.h"
 #include "content-cache.h"
@@ -52,8 +53,14 @@ static const uint32_t default_cache_purge_large_entry = 256;
 static const uint32_t default_blob_size_limit = 1048576*1024;
 
 static const uint32_t default_flush_batch_limit = 256;
+static const uint32_t default_flush_inflight_limit = 2;
 
 
+struct cache_list {
+    struct cache_entry *head;
+    struct cache_entry *tail;
+};
+
 struct cache_entry {
     void *data;
     int len;
@@ -65,7 +72,11 @@ struct cache_entry {
     uint8_t store_pending:1;
     zlist_t *load_requests;
     zlist_t *store_requests;
+    zlist_t *store_batches;         /* store-batch requests awaiting entry */
     int lastused;
+    struct cache_list *list;        /* cache->lru, lru_large, dirty, NULL */
+    struct cache_entry *prev;
+    struct cache_entry *next;
 };
 
 struct content_cache {
@@ -74,6 +85,9 @@ struct content_cache {
     flux_msg_handler_t **handlers;
     uint32_t rank;
     zhash_t *entries;
+    struct cache_list lru;          /* valid, clean entries (MRU at head) */
+    struct cache_list lru_large;    /* same, of at least purge_large_entry */
+    struct cache_list dirty;        /* dirty entries without store pending */
     uint8_t backing:1;              /* 'content.backing' service available */
     char *backing_name;
     char hash_name[BLOBREF_MAX_STRING_SIZE];
@@ -83,6 +97,8 @@ struct content_cache {
     uint32_t blob_size_limit;
     uint32_t flush_batch_limit;
     uint32_t flush_batch_count;
+    uint32_t flush_inflight_limit;
+    uint32_t flush_inflight;        /* flush batches awaiting response */
 
     uint32_t purge_target_entries;
     uint32_t purge_target_size;
@@ -155,6 +171,84 @@ error:
     return -1;
 }
 
+/* Intrusive lists of cache entries.
+ * An entry is on at most one list at a time, as determined by its state:
+ * valid and clean entries are on cache->lru, or cache->lru_large if they
+ * were at least 'purge_large_entry' bytes when last used, ordered by
+ * 'lastused' with the most recently used at the head;  dirty entries with
+ * no store in flight
+ * are on cache->dirty in the order they were dirtied.  Invalid entries and
+ * entries with a store pending are on no list.  This lets purge and flush
+ * visit only the entries they can act on, rather than the whole hash.
+ */
+
+static void list_unlink (struct cache_entry *e)
+{
+    struct cache_list *l = e->list;
+
+    if (l) {
+        if (e->prev)
+            e->prev->next = e->next;
+        else
+            l->head = e->next;
+        if (e->next)
+            e->next->prev = e->prev;
+        else
+            l->tail = e->prev;
+        e->prev = e->next = NULL;
+        e->list = NULL;
+    }
+}
+
+static void list_push_head (struct cache_list *l, struct cache_entry *e)
+{
+    e->prev = NULL;
+    e->next = l->head;
+    if (l->head)
+        l->head->prev = e;
+    else
+        l->tail = e;
+    l->head = e;
+    e->list = l;
+}
+
+static void list_push_tail (struct cache_list *l, struct cache_entry *e)
+{
+    e->next = NULL;
+    e->prev = l->tail;
+    if (l->tail)
+        l->tail->next = e;
+    else
+        l->head = e;
+    l->tail = e;
+    e->list = l;
+}
+
+/* Mark entry as used in the current epoch and move it to the list
+ * that matches its state.  Since 'epoch' never decreases, pushing
+ * touched entries onto the head of the LRU list keeps it sorted.
+ * Dirty entries already queued for flush keep their place.
+ */
+static void cache_entry_touch (content_cache_t *cache, struct cache_entry *e)
+{
+    e->lastused = cache->epoch;
+    if (e->valid && !e->dirty) {
+        list_unlink (e);
+        if (e->len >= cache->purge_large_entry)
+            list_push_head (&cache->lru_large, e);
+        else
+            list_push_head (&cache->lru, e);
+    }
+    else if (e->dirty && !e->store_pending) {
+        if (e->list != &cache->dirty) {
+            list_unlink (e);
+            list_push_tail (&cache->dirty, e);
+        }
+    }
+    else
+        list_unlink (e);
+}
+
 /* Destroy a cache entry
  */
 static void cache_entry_destroy (void *arg)
@@ -169,6 +263,8 @@ static void cache_entry_destroy (void *arg)
         assert (!e->store_requests || zlist_size (e->store_requests) == 0);
         message_list_destroy (&e->load_requests);
         message_list_destroy (&e->store_requests);
+        assert (!e->store_batches || zlist_size (e->store_batches) == 0);
+        zlist_destroy (&e->store_batches);
         free (e);
     }
 }
@@ -227,6 +323,7 @@ static int insert_entry (content_cache_t *cache, struct cache_entry *e)
         return -1;
     }
     zhash_freefn (cache->entries, e->blobref, cache_entry_destroy);
+    cache_entry_touch (cache, e);
     if (e->valid) {
         cache->acct_size += e->len;
         cache->acct_valid++;
@@ -256,6 +353,7 @@ static void remove_entry (content_cache_t *cache, struct cache_entry *e)
     }
     if (e->dirty)
         cache->acct_dirty--;
+    list_unlink (e);
     zhash_delete (cache->entries, e->blobref);
 }
 
@@ -298,7 +396,7 @@ static void cache_load_continuation (flux_future_t *f, void *arg)
         cache->acct_valid++;
         cache->acct_size += len;
     }
-    e->lastused = cache->epoch;
+    cache_entry_touch (cache, e);
     rc = 0;
 done:
     if (respond_requests_raw (&e->load_requests, cache->h,
@@ -306,7 +404,7 @@ done:
                                                     e->data, e->len) < 0)
         flux_log_error (cache->h, "%s: error responding to load requests",
                         __FUNCTION__);
-    if (rc < 0)
+    if (rc < 0 && !e->valid)
         remove_entry (cache, e);
     flux_future_destroy (f);
 }
@@ -393,7 +491,7 @@ void content_load_request (flux_t *h, flux_msg_handler_t *mh,
         }
         return; /* RPC continuation will respond to msg */
     }
-    e->lastused = cache->epoch;
+    cache_entry_touch (cache, e);
     data = e->data;
     len = e->len;
     rc = 0;
@@ -404,6 +502,230 @@ done:
         flux_log_error (h, "content load");
 }
 
+/* Load a batch of blobs.
+ * Blobs that are valid in the cache are returned directly.  Any misses
+ * are fetched from the next level of TBON, or on rank 0 from the
+ * content.backing service, in a single batch request.  A blob that cannot
+ * be found is returned as an absent item rather than failing the request.
+ */
+
+struct load_batch {
+    int count;
+    blobref_t *blobrefs;            /* blobrefs in request order */
+    int nmissing;
+    int *missing;                   /* indices of blobrefs fetched upstream */
+    flux_msg_t *request;
+};
+
+static void load_batch_destroy (struct load_batch *lb)
+{
+    if (lb) {
+        int saved_errno = errno;
+        free (lb->blobrefs);
+        free (lb->missing);
+        flux_msg_destroy (lb->request);
+        free (lb);
+        errno = saved_errno;
+    }
+}
+
+static struct load_batch *load_batch_create (int count)
+{
+    struct load_batch *lb;
+
+    if (!(lb = calloc (1, sizeof (*lb))))
+        goto nomem;
+    if (count > 0) {
+        if (!(lb->blobrefs = calloc (count, sizeof (blobref_t))))
+            goto nomem;
+        if (!(lb->missing = calloc (count, sizeof (int))))
+            goto nomem;
+    }
+    lb->count = count;
+    return lb;
+nomem:
+    load_batch_destroy (lb);
+    errno = ENOMEM;
+    return NULL;
+}
+
+static void load_batch_respond (content_cache_t *cache, struct load_batch *lb,
+                                const flux_msg_t *msg, int errnum)
+{
+    blobvec_t *bv = NULL;
+    struct cache_entry *e;
+    int i;
+
+    if (errnum == 0) {
+        if (!(bv = blobvec_create ()))
+            goto error;
+        for (i = 0; i < lb->count; i++) {
+            if ((e = lookup_entry (cache, lb->blobrefs[i])) && e->valid) {
+                cache_entry_touch (cache, e);
+                if (blobvec_append (bv, e->data, e->len) < 0)
+                    goto error;
+            }
+            else if (blobvec_append (bv, NULL, -1) < 0)
+                goto error;
+        }
+    }
+    goto done;
+error:
+    errnum = errno;
+done:
+    if (flux_respond_raw (cache->h, msg, errnum,
+                          errnum == 0 ? blobvec_data (bv) : NULL,
+                          errnum == 0 ? blobvec_size (bv) : 0) < 0)
+        flux_log_error (cache->h, "content load-batch");
+    blobvec_destroy (bv);
+}
+
+static void cache_load_batch_continuation (flux_future_t *f, void *arg)
+{
+    content_cache_t *cache = arg;
+    struct load_batch *lb = flux_future_aux_get (f, "batch");
+    struct cache_entry *e;
+    const char *blobref;
+    const void *data;
+    int len;
+    int errnum = 0;
+    int i;
+
+    if (flux_future_get (f, NULL) < 0) {
+        errnum = errno;
+        flux_log_error (cache->h, "content load-batch");
+        goto done;
+    }
+    for (i = 0; i < lb->nmissing; i++) {
+        blobref = lb->blobrefs[lb->missing[i]];
+        if (flux_content_load_batch_get (f, i, &data, &len) < 0) {
+            if (errno != ENOENT)
+                flux_log_error (cache->h, "content load-batch");
+            continue;
+        }
+        if (!(e = lookup_entry (cache, blobref))) {
+            if (!(e = cache_entry_create (blobref))
+                                            || insert_entry (cache, e) < 0) {
+                flux_log_error (cache->h, "content load-batch");
+                continue; /* insert destroys 'e' on failure */
+            }
+        }
+        if (!e->valid) {
+            if (cache_entry_fill (e, data, len) < 0) {
+                flux_log_error (cache->h, "content load-batch");
+                continue;
+            }
+            e->valid = 1;
+            cache->acct_valid++;
+            cache->acct_size += len;
+            if (respond_requests_raw (&e->load_requests, cache->h, 0,
+                                                        e->data, e->len) < 0)
+                flux_log_error (cache->h,
+                                "%s: error responding to load requests",
+                                __FUNCTION__);
+        }
+        cache_entry_touch (cache, e);
+    }
+done:
+    load_batch_respond (cache, lb, lb->request, errnum);
+    flux_future_destroy (f);
+}
+
+/* Fetch lb->missing blobs in one request.  The future takes ownership of
+ * 'lb', which is destroyed on failure.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int cache_load_batch (content_cache_t *cache, struct load_batch *lb)
+{
+    flux_future_t *f = NULL;
+    const char **blobrefs;
+    int flags = CONTENT_FLAG_UPSTREAM;
+    int i;
+
+    if (cache->rank == 0)
+        flags = CONTENT_FLAG_CACHE_BYPASS;
+    if (!(blobrefs = calloc (lb->nmissing, sizeof (blobrefs[0])))) {
+        errno = ENOMEM;
+        goto error;
+    }
+    for (i = 0; i < lb->nmissing; i++)
+        blobrefs[i] = lb->blobrefs[lb->missing[i]];
+    f = flux_content_load_batch (cache->h, blobrefs, lb->nmissing, flags);
+    free (blobrefs);
+    if (!f) {
+        flux_log_error (cache->h, "content load-batch");
+        goto error;
+    }
+    if (flux_future_aux_set (f, "batch", lb,
+                             (flux_free_f)load_batch_destroy) < 0) {
+        flux_log_error (cache->h, "content load-batch: flux_future_aux_set");
+        goto error;
+    }
+    lb = NULL; // future owns it now
+    if (flux_future_then (f, -1., cache_load_batch_continuation, cache) < 0) {
+        flux_log_error (cache->h, "content load-batch");
+        goto error;
+    }
+    return 0;
+error:
+    load_batch_destroy (lb);
+    flux_future_destroy (f);
+    return -1;
+}
+
+static void content_load_batch_request (flux_t *h, flux_msg_handler_t *mh,
+                                        const flux_msg_t *msg, void *arg)
+{
+    content_cache_t *cache = arg;
+    struct load_batch *lb = NULL;
+    struct cache_entry *e;
+    const void *buf;
+    int size;
+    const char *blobref;
+    int len;
+    int offset = 0;
+    int count;
+    int i;
+    int rc = -1;
+
+    if (flux_request_decode_raw (msg, NULL, &buf, &size) < 0)
+        goto done;
+    if ((count = blobvec_count_encoded (buf, size)) < 0)
+        goto done;
+    if (!(lb = load_batch_create (count)))
+        goto done;
+    for (i = 0; i < count; i++) {
+        if (blobvec_next (buf, size, &offset, (const void **)&blobref,
+                          &len) < 1
+                || len < 1 || blobref[len - 1] != '\0'
+                || blobref_validate (blobref) < 0) {
+            errno = EPROTO;
+            goto done;
+        }
+        strcpy (lb->blobrefs[i], blobref);
+        if (!(e = lookup_entry (cache, blobref)) || !e->valid) {
+            if (cache->rank > 0 || cache->backing)
+                lb->missing[lb->nmissing++] = i;
+        }
+    }
+    if (lb->nmissing > 0) {
+        if (!(lb->request = flux_msg_copy (msg, false)))
+            goto done;
+        if (cache_load_batch (cache, lb) < 0) {
+            lb = NULL; /* cache_load_batch destroys 'lb' on failure */
+            goto done;
+        }
+        return; /* RPC continuation will respond to msg */
+    }
+    rc = 0;
+done:
+    if (rc == 0)
+        load_batch_respond (cache, lb, msg, 0);
+    else if (flux_respond (h, msg, errno, NULL) < 0)
+        flux_log_error (h, "content load-batch");
+    load_batch_destroy (lb);
+}
+
 /* Store operation
  *
  * If a cache entry is already valid and not dirty, response is immediate.
@@ -411,9 +733,9 @@ done:
  * load requests), and then dirty.
  *
  * Dirty cache is write-through for ranks > 0;  that is, a request is queued
- * and a single store request per cache entry is sent to the next level
- * of TBON.  Once present in the rank 0 cache, requests are unwound and
- * responded to at each level.
+ * on the cache entry and the entry is stored to the next level of TBON.
+ * Once present in the rank 0 cache, requests are unwound and responded to
+ * at each level.
  *
  * Dirty cache is write-back for rank 0, that is;  the response is immediate
  * even though the entry may be dirty with respect to a 'content.backing'
@@ -421,98 +743,293 @@ done:
  * while holding the invariant that after a store RPC returns, the entry may
  * be loaded from any rank.  The optional content.backing service can
  * offload rank 0 hash entries at a slower pace.
+ *
+ * Dirty entries are stored in batches of up to flush_batch_limit blobs per
+ * content.store-batch RPC (or content-backing.store-batch on rank 0), with
+ * at most flush_inflight_limit batches outstanding.  While batches are in
+ * flight, newly dirtied entries accumulate on the dirty list and go out
+ * together in the next batch.  A content.store-batch request received on
+ * rank > 0 is forwarded upstream as one batch, less any entries that
+ * already have a store in flight, and is answered once all of its dirty
+ * entries have been stored.
+ */
+
+struct store_batch {
+    int count;
+    blobref_t *blobrefs;            /* entries in the batch */
+    bool flush;                     /* batch counts against flush limits */
+    flux_msg_t *request;            /* store-batch request awaiting entries */
+    int waiting;                    /*   count of entries still pending */
+    int errnum;                     /*   first error, if any */
+};
+
+static void store_batch_destroy (struct store_batch *sb)
+{
+    if (sb) {
+        int saved_errno = errno;
+        free (sb->blobrefs);
+        flux_msg_destroy (sb->request);
+        free (sb);
+        errno = saved_errno;
+    }
+}
+
+static struct store_batch *store_batch_create (int count)
+{
+    struct store_batch *sb;
+
+    if (!(sb = calloc (1, sizeof (*sb))))
+        goto nomem;
+    if (count > 0 && !(sb->blobrefs = calloc (count, sizeof (blobref_t))))
+        goto nomem;
+    return sb;
+nomem:
+    store_batch_destroy (sb);
+    errno = ENOMEM;
+    return NULL;
+}
+
+/* Build a blobvec of blobrefs for the response to a store-batch request.
  */
+static blobvec_t *store_batch_encode (struct store_batch *sb)
+{
+    blobvec_t *bv;
+    int i;
+
+    if (!(bv = blobvec_create ()))
+        return NULL;
+    for (i = 0; i < sb->count; i++) {
+        if (blobvec_append (bv, sb->blobrefs[i],
+                            strlen (sb->blobrefs[i]) + 1) < 0) {
+            blobvec_destroy (bv);
+            return NULL;
+        }
+    }
+    return bv;
+}
+
+static void store_batch_respond (content_cache_t *cache,
+                                 struct store_batch *sb,
+                                 const flux_msg_t *msg, int errnum)
+{
+    blobvec_t *bv = NULL;
+
+    if (errnum == 0 && !(bv = store_batch_encode (sb)))
+        errnum = errno;
+    if (flux_respond_raw (cache->h, msg, errnum,
+                          blobvec_data (bv), blobvec_size (bv)) < 0)
+        flux_log_error (cache->h, "content store-batch");
+    blobvec_destroy (bv);
+}
+
+/* Make store-batch request 'sb' wait for entry 'e' to be stored.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int store_batch_wait (struct store_batch *sb, struct cache_entry *e)
+{
+    if (!e->store_batches && !(e->store_batches = zlist_new ()))
+        goto nomem;
+    if (zlist_append (e->store_batches, sb) < 0)
+        goto nomem;
+    sb->waiting++;
+    return 0;
+nomem:
+    errno = ENOMEM;
+    return -1;
+}
+
+/* Entry is no longer pending:  answer any store-batch requests that
+ * were waiting only for it.
+ */
+static void store_batch_notify (content_cache_t *cache, zlist_t *l, int errnum)
+{
+    struct store_batch *sb;
+
+    if (!l)
+        return;
+    while ((sb = zlist_pop (l))) {
+        if (errnum != 0 && sb->errnum == 0)
+            sb->errnum = errnum;
+        if (--sb->waiting == 0) {
+            store_batch_respond (cache, sb, sb->request, sb->errnum);
+            store_batch_destroy (sb);
+        }
+    }
+}
 
 static void cache_store_continuation (flux_future_t *f, void *arg)
 {
     content_cache_t *cache = arg;
-    struct cache_entry *e = flux_future_aux_get (f, "entry");
+    struct store_batch *sb = flux_future_aux_get (f, "batch");
+    struct cache_entry *e;
     const char *blobref;
-    int saved_errno = 0;
-    int rc = -1;
+    int errnum = 0;
+    int batch_errnum = 0;
+    int i;
 
-    e->store_pending = 0;
-    assert (cache->flush_batch_count > 0);
-    cache->flush_batch_count--;
-    if (flux_content_store_get (f, &blobref) < 0) {
-        saved_errno = errno;
+    if (sb->flush) {
+        assert (cache->flush_batch_count >= sb->count);
+        cache->flush_batch_count -= sb->count;
+        cache->flush_inflight--;
+    }
+    if (flux_future_get (f, NULL) < 0) {
+        batch_errnum = errno;
         if (cache->rank == 0 && errno == ENOSYS)
             flux_log (cache->h, LOG_DEBUG, "content store: %s",
                       "backing store service unavailable");
         else
             flux_log_error (cache->h, "content store");
-        goto done;
-    }
-    if (strcmp (blobref, e->blobref)) {
-        saved_errno = errno = EIO;
-        flux_log (cache->h, LOG_ERR, "content store: wrong blobref");
-        goto done;
     }
-    if (e->dirty) {
-        cache->acct_dirty--;
-        e->dirty = 0;
+    for (i = 0; i < sb->count; i++) {
+        errnum = batch_errnum;
+        if (errnum == 0) {
+            if (flux_content_store_batch_get (f, i, &blobref) < 0) {
+                errnum = errno;
+                flux_log_error (cache->h, "content store");
+            }
+            else if (strcmp (blobref, sb->blobrefs[i]) != 0) {
+                errnum = EIO;
+                flux_log (cache->h, LOG_ERR, "content store: wrong blobref");
+            }
+        }
+        if (errnum != 0 && batch_errnum == 0)
+            batch_errnum = errnum;
+        /* Entry may have been purged if it was made clean by another
+         * batch in the meantime.
+         */
+        if (!(e = lookup_entry (cache, sb->blobrefs[i])))
+            continue;
+        e->store_pending = 0;
+        if (errnum == 0 && e->dirty) {
+            cache->acct_dirty--;
+            e->dirty = 0;
+        }
+        /* On success the entry joins the LRU list;  on failure it is still
+         * dirty and goes back on the dirty list to be retried by cache_flush().
+         */
+        cache_entry_touch (cache, e);
+        if (respond_requests_raw (&e->store_requests, cache->h, errnum,
+                                  e->blobref, strlen (e->blobref) + 1) < 0)
+            flux_log_error (cache->h, "%s: error responding to store requests",
+                            __FUNCTION__);
+        store_batch_notify (cache, e->store_batches, errnum);
     }
-    rc = 0;
-done:
-    if (respond_requests_raw (&e->store_requests, cache->h,
-                                        rc < 0 ? saved_errno : 0,
-                                        e->blobref, strlen (e->blobref) + 1) < 0)
-        flux_log_error (cache->h, "%s: error responding to store requests",
-                        __FUNCTION__);
     flux_future_destroy (f);
 
     /* If cache has been flushed, respond to flush requests, if any.
-     * If there are still dirty entries and the number of outstanding
-     * store requests would not exceed the limit, flush more entries.
-     * Optimization: since scanning for dirty entries is a linear search,
-     * only do it when the number of outstanding store requests falls to
-     * a low water mark, here hardwired to be half of the limit.
+     * If there are still dirty entries, flush more of them.
      */
     if (cache->acct_dirty == 0 || (cache->rank == 0 && !cache->backing))
         flush_respond (cache);
-    else if (cache->acct_dirty - cache->flush_batch_count > 0
-            && cache->flush_batch_count <= cache->flush_batch_limit / 2)
+    else
         (void)cache_flush (cache); /* resume flushing */
 }
 
-static int cache_store (content_cache_t *cache, struct cache_entry *e)
+/* Send a batch containing entries 'entries[0...count-1]', which are then
+ * marked store pending.  If 'flush' is true, the batch counts against the
+ * flush limits.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int cache_store (content_cache_t *cache, struct cache_entry **entries,
+                        int count, bool flush)
 {
-    flux_future_t *f;
-    int saved_errno = 0;
+    struct store_batch *sb = NULL;
+    const void **bufs = NULL;
+    int *lens = NULL;
+    flux_future_t *f = NULL;
     int flags = CONTENT_FLAG_UPSTREAM;
-    int rc = -1;
-
-    assert (e->valid);
+    int i;
 
-    if (e->store_pending)
-        return 0;
-    if (cache->rank == 0) {
-        if (cache->flush_batch_count >= cache->flush_batch_limit)
-            return 0;
+    if (cache->rank == 0)
         flags = CONTENT_FLAG_CACHE_BYPASS;
+    if (!(sb = store_batch_create (count))
+            || !(bufs = calloc (count, sizeof (bufs[0])))
+            || !(lens = calloc (count, sizeof (lens[0]))))
+        goto nomem;
+    sb->flush = flush;
+    for (i = 0; i < count; i++) {
+        assert (entries[i]->valid);
+        bufs[i] = entries[i]->data;
+        lens[i] = entries[i]->len;
+        strcpy (sb->blobrefs[i], entries[i]->blobref);
     }
-    if (!(f = flux_content_store (cache->h, e->data, e->len, flags))) {
-        saved_errno = errno;
+    sb->count = count;
+    if (!(f = flux_content_store_batch (cache->h, bufs, lens, count, flags))) {
         flux_log_error (cache->h, "content store");
-        goto done;
+        goto error;
     }
-    if (flux_future_aux_set (f, "entry", e, NULL) < 0) {
+    if (flux_future_aux_set (f, "batch", sb,
+                             (flux_free_f)store_batch_destroy) < 0) {
         flux_log_error (cache->h, "content store: flux_future_aux_set");
-        goto done;
+        goto error;
     }
+    sb = NULL; // future owns it now
     if (flux_future_then (f, -1., cache_store_continuation, cache) < 0) {
-        saved_errno = errno;
         flux_log_error (cache->h, "content store");
-        flux_future_destroy (f);
-        goto done;
+        goto error;
     }
-    e->store_pending = 1;
-    cache->flush_batch_count++;
-    rc = 0;
-done:
-    if (rc < 0)
-        errno = saved_errno;
-    return rc;
+    for (i = 0; i < count; i++) {
+        entries[i]->store_pending = 1;
+        cache_entry_touch (cache, entries[i]); /* off the dirty list */
+    }
+    if (flush) {
+        cache->flush_batch_count += count;
+        cache->flush_inflight++;
+    }
+    free (bufs);
+    free (lens);
+    return 0;
+nomem:
+    errno = ENOMEM;
+error:
+    flux_future_destroy (f);
+    store_batch_destroy (sb);
+    free (bufs);
+    free (lens);
+    return -1;
+}
+
+/* Add blob to the cache, or refresh an existing entry.
+ * A newly valid entry becomes dirty, and any queued loads are answered.
+ * Returns entry on success, NULL on failure with errno set.
+ */
+static struct cache_entry *cache_store_entry (content_cache_t *cache,
+                                              const char *blobref,
+                                              const void *data, int len)
+{
+    struct cache_entry *e;
+
+    if (!(e = lookup_entry (cache, blobref))) {
+        if (!(e = cache_entry_create (blobref)))
+            return NULL;
+        if (insert_entry (cache, e) < 0)
+            return NULL; /* insert destroys 'e' on failure */
+    }
+    if (!e->valid) {
+        if (cache_entry_fill (e, data, len) < 0)
+            return NULL;
+        e->valid = 1;
+        cache->acct_valid++;
+        cache->acct_size += len;
+        if (respond_requests_raw (&e->load_requests, cache->h, 0,
+                                                        e->data, e->len) < 0)
+            flux_log_error (cache->h, "%s: error responding to load requests",
+                            __FUNCTION__);
+        if (!e->dirty) {
+            e->dirty = 1;
+            cache->acct_dirty++;
+        }
+    }
+    /* When a backing store module is unloaded, it will clear
+     * cache->backing then attempt to store all its blobs.  Any of
+     * those still in cache need to be marked dirty.
+     */
+    else if (!e->dirty && cache->rank == 0 && !cache->backing) {
+        e->dirty = 1;
+        cache->acct_dirty++;
+    }
+    cache_entry_touch (cache, e);
+    return e;
 }
 
 static void content_store_request (flux_t *h, flux_msg_handler_t *mh,
@@ -533,57 +1050,125 @@ static void content_store_request (flux_t *h, flux_msg_handler_t *mh,
     }
     if (blobref_hash (cache->hash_name, (uint8_t *)data, len, blobref) < 0)
         goto done;
-
-    if (!(e = lookup_entry (cache, blobref))) {
-        if (!(e = cache_entry_create (blobref)))
+    if (!(e = cache_store_entry (cache, blobref, data, len)))
+        goto done;
+    if (e->dirty) {
+        if (cache->rank > 0) {  /* write-through */
+            if (defer_request (&e->store_requests, msg) < 0)
+                goto done;
+            if (cache_flush (cache) < 0) {
+                if (respond_requests_raw (&e->store_requests, h, errno,
+                                          blobref, strlen (blobref) + 1) < 0)
+                    flux_log_error (h, "content store");
+            }
+            return;
+        }
+        if (cache->backing && cache_flush (cache) < 0)
             goto done;
-        if (insert_entry (cache, e) < 0)
-            goto done; /* insert destroys 'e' on failure */
     }
-    if (!e->valid) {
-        if (cache_entry_fill (e, data, len) < 0)
+    rc = 0;
+done:
+    assert (rc == 0 || errno != 0);
+    if (flux_respond_raw (h, msg, rc < 0 ? errno : 0,
+                                            blobref, strlen (blobref) + 1) < 0)
+        flux_log_error (h, "content store");
+}
+
+/* Store a batch of blobs.  On rank 0 the response is immediate, as above.
+ * On rank > 0, dirty entries without a store in flight are forwarded
+ * upstream in one batch, and the response is deferred until every dirty
+ * entry in the request, forwarded now or earlier, has been stored.
+ */
+static void content_store_batch_request (flux_t *h, flux_msg_handler_t *mh,
+                                         const flux_msg_t *msg, void *arg)
+{
+    content_cache_t *cache = arg;
+    struct store_batch *sb = NULL;
+    struct cache_entry **forward = NULL;
+    struct cache_entry **pending = NULL;
+    int nforward = 0;
+    int npending = 0;
+    const void *buf;
+    int size;
+    const void *data;
+    int len;
+    int offset = 0;
+    int count;
+    int i;
+    int rc = -1;
+
+    if (flux_request_decode_raw (msg, NULL, &buf, &size) < 0)
+        goto done;
+    if ((count = blobvec_count_encoded (buf, size)) < 0)
+        goto done;
+    if (!(sb = store_batch_create (count)))
+        goto done;
+    if (count > 0 && (!(forward = calloc (count, sizeof (forward[0])))
+                || !(pending = calloc (count, sizeof (pending[0]))))) {
+        errno = ENOMEM;
+        goto done;
+    }
+    for (i = 0; i < count; i++) {
+        struct cache_entry *e;
+        if (blobvec_next (buf, size, &offset, &data, &len) < 1) {
+            errno = EPROTO;
             goto done;
-        if (!e->valid) {
-            e->valid = 1;
-            cache->acct_valid++;
-            cache->acct_size += len;
         }
-        if (respond_requests_raw (&e->load_requests, cache->h, 0,
-                                                        e->data, e->len) < 0)
-            flux_log_error (cache->h, "%s: error responding to load requests",
-                            __FUNCTION__);
-        if (!e->dirty) {
-            e->dirty = 1;
-            cache->acct_dirty++;
+        if (len < 0) {
+            errno = EPROTO;
+            goto done;
+        }
+        if (len > cache->blob_size_limit) {
+            errno = EFBIG;
+            goto done;
+        }
+        if (blobref_hash (cache->hash_name, (uint8_t *)data, len,
+                          sb->blobrefs[i]) < 0)
+            goto done;
+        sb->count++;
+        if (!(e = cache_store_entry (cache, sb->blobrefs[i], data, len)))
+            goto done;
+        if (e->dirty) {
+            if (!e->store_pending)
+                forward[nforward++] = e;
+            pending[npending++] = e;
         }
     }
-    e->lastused = cache->epoch;
-    if (e->dirty) {
-        if (cache->rank > 0 || cache->backing) {
-            if (cache_store (cache, e) < 0)
-                goto done;
-            if (cache->rank > 0) {  /* write-through */
-                if (defer_request (&e->store_requests, msg) < 0)
-                    goto done;
-                return;
+    if (cache->rank > 0 && npending > 0) {  /* write-through */
+        if (!(sb->request = flux_msg_copy (msg, false)))
+            goto done;
+        if (nforward > 0 && cache_store (cache, forward, nforward, false) < 0)
+            goto done;
+        /* From here on 'sb' is answered by store_batch_notify().
+         * If it cannot wait on every entry, it fails once the entries
+         * it does wait on are stored.
+         */
+        for (i = 0; i < npending; i++) {
+            if (store_batch_wait (sb, pending[i]) < 0) {
+                sb->errnum = errno;
+                flux_log_error (h, "content store-batch");
+                break;
             }
         }
-    } else {
-        /* When a backing store module is unloaded, it will clear
-         * cache->backing then attempt to store all its blobs.  Any of
-         * those still in cache need to be marked dirty.
-         */
-        if (cache->rank == 0 && !cache->backing) {
-            e->dirty = 1;
-            cache->acct_dirty++;
+        if (sb->waiting == 0) {
+            errno = sb->errnum;
+            goto done;
         }
+        free (forward);
+        free (pending);
+        return;
     }
+    if (cache->rank == 0 && cache->backing && cache_flush (cache) < 0)
+        goto done;
     rc = 0;
 done:
-    assert (rc == 0 || errno != 0);
-    if (flux_respond_raw (h, msg, rc < 0 ? errno : 0,
-                                            blobref, strlen (blobref) + 1) < 0)
-        flux_log_error (h, "content store");
+    if (sb)
+        store_batch_respond (cache, sb, msg, rc < 0 ? errno : 0);
+    else if (flux_respond (h, msg, errno, NULL) < 0)
+        flux_log_error (h, "content store-batch");
+    free (forward);
+    free (pending);
+    store_batch_destroy (sb);
 }
 
 /* Backing store is enabled/disabled by modules that provide the
@@ -602,34 +1187,40 @@ done:
  * the cache.
  */
 
+/* Send dirty entries, oldest first, in batches of up to flush_batch_limit,
+ * while the flush limits allow.  Entries are taken off the dirty list as
+ * they are sent, so this may be called whenever an entry is dirtied.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
 static int cache_flush (content_cache_t *cache)
 {
+    struct cache_entry **batch = NULL;
     struct cache_entry *e;
-    const char *key;
-    int saved_errno = 0;
-    int count = 0;
-    int rc = 0;
-
-    if (cache->acct_dirty - cache->flush_batch_count == 0
-            || cache->flush_batch_count >= cache->flush_batch_limit)
-        return 0;
+    int count;
+    int rc = -1;
 
-    flux_log (cache->h, LOG_DEBUG, "content flush begin");
-    FOREACH_ZHASH (cache->entries, key, e) {
-        if (!e->dirty || e->store_pending)
-            continue;
-        if (cache_store (cache, e) < 0) {
-            saved_errno = errno;
-            rc = -1;
+    while (cache->dirty.head
+            && cache->flush_batch_count < cache->flush_batch_limit
+            && (cache->flush_inflight == 0
+                || cache->flush_inflight < cache->flush_inflight_limit)) {
+        if (!batch && !(batch = calloc (cache->flush_batch_limit,
+                                        sizeof (batch[0])))) {
+            errno = ENOMEM;
+            goto done;
         }
-        count++;
-        if (cache->flush_batch_count >= cache->flush_batch_limit)
-            break;
+        count = 0;
+        e = cache->dirty.head;
+        while (e && cache->flush_batch_count + count
+                                            < cache->flush_batch_limit) {
+            batch[count++] = e;
+            e = e->next;
+        }
+        if (cache_store (cache, batch, count, true) < 0)
+            goto done;
     }
-    flux_log (cache->h, LOG_DEBUG, "content flush +%d (dirty=%d pending=%d)",
-              count, cache->acct_dirty, cache->flush_batch_count);
-    if (rc < 0)
-        errno = saved_errno;
+    rc = 0;
+done:
+    free (batch);
     return rc;
 }
 
@@ -670,15 +1261,13 @@ done:
 
 /* Forcibly drop all entries from the cache that can be dropped
  * without data loss.
- * N.B. this walks the entire cache in one go.
+ * N.B. this walks the entire LRU list in one go.
  */
 
 static void content_dropcache_request (flux_t *h, flux_msg_handler_t *mh,
                                        const flux_msg_t *msg, void *arg)
 {
     content_cache_t *cache = arg;
-    zlist_t *keys = NULL;
-    char *key;
     struct cache_entry *e;
     int orig_size;
     int saved_errno;
@@ -687,16 +1276,9 @@ static void content_dropcache_request (flux_t *h, flux_msg_handler_t *mh,
     if (flux_request_decode (msg, NULL, NULL) < 0)
         goto done;
     orig_size = zhash_size (cache->entries);
-    if (!(keys = zhash_keys (cache->entries))) {
-        errno = ENOMEM;
-        goto done;
-    }
-    while ((key = zlist_pop (keys))) {
-        e = zhash_lookup (cache->entries, key);
-        assert (e != NULL);
-        if (e->valid && !e->dirty)
-            remove_entry (cache, e);
-        free (key);
+    while ((e = cache->lru.tail) || (e = cache->lru_large.tail)) {
+        assert (e->valid && !e->dirty);
+        remove_entry (cache, e);
     }
     rc = 0;
 done:
@@ -710,7 +1292,6 @@ done:
     errno = saved_errno;
     if (flux_respond (h, msg, rc < 0 ? errno : 0, NULL) < 0)
         flux_log_error (h, "content dropcache");
-    zlist_destroy (&keys);
 }
 
 /* Return stats about the cache.
@@ -797,49 +1378,48 @@ done:
 }
 
 /* Heartbeat drives periodic cache purge
+ * Only valid, clean entries are eligible, and those are found on the LRU
+ * lists, oldest at the tail.  Over the entry target, the oldest entry of
+ * either list is purged;  over just the size target, only large entries
+ * are, so only cache->lru_large is walked.  The walk stops at the first
+ * entry that is too young to purge, so its cost is proportional to the
+ * number of entries purged rather than the size of the cache.
  */
 
+static struct cache_entry *purge_candidate (content_cache_t *cache,
+                                            bool small_ok)
+{
+    struct cache_entry *small = cache->lru.tail;
+    struct cache_entry *large = cache->lru_large.tail;
+
+    if (!small_ok || !small)
+        return large;
+    if (!large || small->lastused < large->lastused)
+        return small;
+    return large;
+}
+
 static int cache_purge (content_cache_t *cache)
 {
     int after_entries = zhash_size (cache->entries);
     int after_size = cache->acct_size;
     struct cache_entry *e;
-    zlist_t *purge = NULL;
-    int rc = -1;
-    const char *key;
-
-    if (cache->acct_dirty == zhash_size (cache->entries))
-        return 0;
+    int count = 0;
 
-    FOREACH_ZHASH (cache->entries, key, e) {
-        if (after_size <= cache->purge_target_size
-                        && after_entries <= cache->purge_target_entries)
+    while (after_size > cache->purge_target_size
+                        || after_entries > cache->purge_target_entries) {
+        e = purge_candidate (cache,
+                             after_entries > cache->purge_target_entries);
+        if (!e || cache->epoch - e->lastused < cache->purge_old_entry)
             break;
-        if (!e->valid || e->dirty)
-            continue;
-        if (cache->epoch - e->lastused < cache->purge_old_entry)
-            continue;
-        if (after_entries <= cache->purge_target_entries
-                    && e->len < cache->purge_large_entry)
-            continue;
-        if ((!purge && !(purge = zlist_new ()))
-                    || zlist_append (purge, e) < 0) {
-            errno = ENOMEM;
-            goto done;
-        }
         after_size -= e->len;
         after_entries--;
+        remove_entry (cache, e);
+        count++;
     }
-    if (purge) {
-        flux_log (cache->h, LOG_DEBUG, "content purge: %d entries",
-                  (int)zlist_size (purge));
-        while ((e = zlist_pop (purge)))
-            remove_entry (cache, e);
-    }
-    rc = 0;
-done:
-    zlist_destroy (&purge);
-    return rc;
+    if (count > 0)
+        flux_log (cache->h, LOG_DEBUG, "content purge: %d entries", count);
+    return 0;
 }
 
 static void heartbeat_event (flux_t *h, flux_msg_handler_t *mh,
@@ -860,6 +1440,10 @@ static const struct flux_msg_handler_spec htab[] = {
       FLUX_ROLE_USER },
     { FLUX_MSGTYPE_REQUEST, "content.store",     content_store_request,
       FLUX_ROLE_USER },
+    { FLUX_MSGTYPE_REQUEST, "content.load-batch", content_load_batch_request,
+      FLUX_ROLE_USER },
+    { FLUX_MSGTYPE_REQUEST, "content.store-batch", content_store_batch_request,
+      FLUX_ROLE_USER },
     { FLUX_MSGTYPE_REQUEST, "content.backing",   content_backing_request, 0 },
     { FLUX_MSGTYPE_REQUEST, "content.dropcache", content_dropcache_request, 0 },
     { FLUX_MSGTYPE_REQUEST, "content.stats.get", content_stats_request, 0 },
@@ -963,6 +1547,9 @@ int content_cache_register_attrs (content_cache_t *cache, attr_t *attr)
     if (attr_add_active_uint32 (attr, "content.flush-batch-count",
                 &cache->flush_batch_count, 0) < 0)
         return -1;
+    if (attr_add_active_uint32 (attr, "content.flush-inflight-limit",
+                &cache->flush_inflight_limit, 0) < 0)
+        return -1;
     /* content-hash can be set on the command line
      */
     if (attr_add_active (attr, "content.hash", FLUX_ATTRFLAG_IMMUTABLE,
@@ -1003,6 +1590,7 @@ content_cache_t *content_cache_create (void)
     cache->rank = FLUX_NODEID_ANY;
     cache->blob_size_limit = default_blob_size_limit;
     cache->flush_batch_limit = default_flush_batch_limit;
+    cache->flush_inflight_limit = default_flush_inflight_limit;
     cache->purge_target_entries = default_cache_purge_target_entries;
     cache->purge_target_size = default_cache_purge_target_size;
     cache->purge_old_entry = default_cache_purge_old_entry;
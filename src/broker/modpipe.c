@@ -0,0 +1,320 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* modpipe.c - in-process message transport between broker and module
+ *
+ * Each direction is an spscq_t of flux_msg_t pointers:  'tomod' is
+ * pushed by the broker thread and popped by the module thread, and
+ * 'tobroker' the reverse.  Each consumer sleeps on its queue's eventfd.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <flux/core.h>
+
+#include "src/common/libutil/spscq.h"
+
+#include "modpipe.h"
+
+struct modpipe {
+    spscq_t *tomod;
+    spscq_t *tobroker;
+};
+
+#define MODHANDLE_MAGIC    0xfeefbe03
+typedef struct {
+    int magic;
+    modpipe_t *mp;
+    bool waiting;       /* spscq_wait() was called, eventfd needs clearing */
+    uint32_t testing_userid;
+    uint32_t testing_rolemask;
+    flux_t *h;
+} modhandle_t;
+
+static const struct flux_handle_ops handle_ops;
+
+static void msg_free (void *item)
+{
+    flux_msg_destroy (item);
+}
+
+modpipe_t *modpipe_create (void)
+{
+    modpipe_t *mp;
+
+    if (!(mp = calloc (1, sizeof (*mp)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (!(mp->tomod = spscq_create ()) || !(mp->tobroker = spscq_create ())) {
+        modpipe_destroy (mp);
+        return NULL;
+    }
+    return mp;
+}
+
+void modpipe_destroy (modpipe_t *mp)
+{
+    if (mp) {
+        int saved_errno = errno;
+        spscq_destroy (mp->tomod, msg_free);
+        spscq_destroy (mp->tobroker, msg_free);
+        free (mp);
+        errno = saved_errno;
+    }
+}
+
+int modpipe_send (modpipe_t *mp, flux_msg_t *msg)
+{
+    return spscq_push (mp->tomod, msg);
+}
+
+flux_msg_t *modpipe_recv (modpipe_t *mp)
+{
+    return spscq_pop (mp->tobroker);
+}
+
+const flux_msg_t *modpipe_peek (modpipe_t *mp)
+{
+    return spscq_peek (mp->tobroker);
+}
+
+int modpipe_get_fd (modpipe_t *mp)
+{
+    return spscq_get_fd (mp->tobroker);
+}
+
+bool modpipe_wait (modpipe_t *mp)
+{
+    return spscq_wait (mp->tobroker);
+}
+
+void modpipe_clear (modpipe_t *mp)
+{
+    spscq_clear (mp->tobroker);
+}
+
+void modpipe_notify (modpipe_t *mp)
+{
+    spscq_notify (mp->tobroker);
+}
+
+/* Module end
+ */
+
+static void clear_wait (modhandle_t *ctx)
+{
+    if (ctx->waiting) {
+        spscq_clear (ctx->mp->tomod);
+        ctx->waiting = false;
+    }
+}
+
+static int op_pollevents (void *impl)
+{
+    modhandle_t *ctx = impl;
+    assert (ctx->magic == MODHANDLE_MAGIC);
+    int revents = FLUX_POLLOUT;
+
+    clear_wait (ctx);
+    if (!spscq_wait (ctx->mp->tomod))
+        revents |= FLUX_POLLIN;
+    else
+        ctx->waiting = true;
+    return revents;
+}
+
+static int op_pollfd (void *impl)
+{
+    modhandle_t *ctx = impl;
+    assert (ctx->magic == MODHANDLE_MAGIC);
+
+    return spscq_get_fd (ctx->mp->tomod);
+}
+
+static int op_send (void *impl, const flux_msg_t *msg, int flags)
+{
+    modhandle_t *ctx = impl;
+    assert (ctx->magic == MODHANDLE_MAGIC);
+    flux_msg_t *cpy;
+
+    if (!(cpy = flux_msg_copy (msg, true)))
+        goto error;
+    if (ctx->testing_userid != FLUX_USERID_UNKNOWN
+            || ctx->testing_rolemask != FLUX_ROLE_NONE) {
+        if (flux_msg_set_userid (cpy, ctx->testing_userid) < 0)
+            goto error;
+        if (flux_msg_set_rolemask (cpy, ctx->testing_rolemask) < 0)
+            goto error;
+    }
+    if (spscq_push (ctx->mp->tobroker, cpy) < 0)
+        goto error;
+    return 0;
+error:
+    flux_msg_destroy (cpy);
+    return -1;
+}
+
+static flux_msg_t *op_recv (void *impl, int flags)
+{
+    modhandle_t *ctx = impl;
+    assert (ctx->magic == MODHANDLE_MAGIC);
+    struct pollfd pfd = {
+        .fd = spscq_get_fd (ctx->mp->tomod),
+        .events = POLLIN,
+        .revents = 0,
+    };
+    flux_msg_t *msg;
+
+    while (!(msg = spscq_pop (ctx->mp->tomod))) {
+        if ((flags & FLUX_O_NONBLOCK)) {
+            errno = EWOULDBLOCK;
+            return NULL;
+        }
+        if (spscq_wait (ctx->mp->tomod)) {
+            ctx->waiting = true;
+            if (poll (&pfd, 1, -1) < 0)
+                return NULL;
+        }
+        clear_wait (ctx);
+    }
+    return msg;
+}
+
+static int op_event (modhandle_t *ctx, const char *topic, const char *msg_topic)
+{
+    flux_future_t *f;
+    int rc = -1;
+
+    if (!(f = flux_rpc_pack (ctx->h, msg_topic, FLUX_NODEID_ANY, 0,
+                             "{ s:s }", "topic", topic)))
+        goto done;
+    if (flux_future_get (f, NULL) < 0)
+        goto done;
+    rc = 0;
+done:
+    flux_future_destroy (f);
+    return rc;
+}
+
+static int op_event_subscribe (void *impl, const char *topic)
+{
+    modhandle_t *ctx = impl;
+    assert (ctx->magic == MODHANDLE_MAGIC);
+
+    return op_event (ctx, topic, "cmb.sub");
+}
+
+static int op_event_unsubscribe (void *impl, const char *topic)
+{
+    modhandle_t *ctx = impl;
+    assert (ctx->magic == MODHANDLE_MAGIC);
+
+    return op_event (ctx, topic, "cmb.unsub");
+}
+
+static int op_setopt (void *impl, const char *option,
+                      const void *val, size_t size)
+{
+    modhandle_t *ctx = impl;
+    assert (ctx->magic == MODHANDLE_MAGIC);
+    size_t val_size;
+    int rc = -1;
+
+    if (option && !strcmp (option, FLUX_OPT_TESTING_USERID)) {
+        val_size = sizeof (ctx->testing_userid);
+        if (size != val_size) {
+            errno = EINVAL;
+            goto done;
+        }
+        memcpy (&ctx->testing_userid, val, val_size);
+    } else if (option && !strcmp (option, FLUX_OPT_TESTING_ROLEMASK)) {
+        val_size = sizeof (ctx->testing_rolemask);
+        if (size != val_size) {
+            errno = EINVAL;
+            goto done;
+        }
+        memcpy (&ctx->testing_rolemask, val, val_size);
+    } else {
+        errno = EINVAL;
+        goto done;
+    }
+    rc = 0;
+done:
+    return rc;
+}
+
+static void op_fini (void *impl)
+{
+    modhandle_t *ctx = impl;
+    assert (ctx->magic == MODHANDLE_MAGIC);
+    ctx->magic = ~MODHANDLE_MAGIC;
+    free (ctx);
+}
+
+flux_t *modpipe_open (modpipe_t *mp, int flags)
+{
+    modhandle_t *ctx;
+
+    if (!mp) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(ctx = calloc (1, sizeof (*ctx)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    ctx->magic = MODHANDLE_MAGIC;
+    ctx->mp = mp;
+    ctx->testing_userid = FLUX_USERID_UNKNOWN;
+    ctx->testing_rolemask = FLUX_ROLE_NONE;
+    if (getenv ("FLUX_HANDLE_TRACE"))
+        flags |= FLUX_O_TRACE;
+    if (!(ctx->h = flux_handle_create (ctx, &handle_ops, flags))) {
+        op_fini (ctx);
+        return NULL;
+    }
+    return ctx->h;
+}
+
+static const struct flux_handle_ops handle_ops = {
+    .pollfd = op_pollfd,
+    .pollevents = op_pollevents,
+    .send = op_send,
+    .recv = op_recv,
+    .getopt = NULL,
+    .setopt = op_setopt,
+    .event_subscribe = op_event_subscribe,
+    .event_unsubscribe = op_event_unsubscribe,
+    .impl_destroy = op_fini,
+};
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,47 @@
+#ifndef _BROKER_MODPIPE_H
+#define _BROKER_MODPIPE_H
+
+#include <stdbool.h>
+#include <flux/core.h>
+
+/* A modpipe_t connects the broker to a comms module running in a thread
+ * of the broker process.  Messages are passed by pointer over a pair of
+ * lock-free queues, so they are neither encoded nor copied in transit.
+ */
+typedef struct modpipe modpipe_t;
+
+modpipe_t *modpipe_create (void);
+void modpipe_destroy (modpipe_t *mp);
+
+/* Open the module end as a flux_t handle, for use by the module thread.
+ * Since flux_send() leaves the message with the caller, the handle sends
+ * a copy.
+ */
+flux_t *modpipe_open (modpipe_t *mp, int flags);
+
+/* Broker end: send message to module, taking ownership of it on success.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+int modpipe_send (modpipe_t *mp, flux_msg_t *msg);
+
+/* Broker end: receive message from module, or return NULL with
+ * errno = EAGAIN if none is queued.  modpipe_peek() returns the message
+ * without removing it.
+ */
+flux_msg_t *modpipe_recv (modpipe_t *mp);
+const flux_msg_t *modpipe_peek (modpipe_t *mp);
+
+/* Broker end: get eventfd to watch, and prepare to sleep on it (false if
+ * a message is already queued).  See spscq_wait(), spscq_clear(),
+ * spscq_notify().
+ */
+int modpipe_get_fd (modpipe_t *mp);
+bool modpipe_wait (modpipe_t *mp);
+void modpipe_clear (modpipe_t *mp);
+void modpipe_notify (modpipe_t *mp);
+
+#endif /* !_BROKER_MODPIPE_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -51,13 +51,17 @@
 #include "src/common/libutil/xzmalloc.h"
 #include "src/common/libutil/oom.h"
 #include "src/common/libutil/iterators.h"
+#include "src/common/libutil/subtrie.h"
 
 #include "heartbeat.h"
 #include "module.h"
 #include "modservice.h"
+#include "modpipe.h"
+#include "recvstats.h"
 
 
 #define MODULE_MAGIC    0xfeefbe01
+
 struct module_struct {
     int magic;
 
@@ -68,7 +72,9 @@ struct module_struct {
     int lastseen;
     heartbeat_t *heartbeat;
 
-    zsock_t *sock;          /* broker end of PAIR socket */
+    modpipe_t *pipe;        /* message queues to/from module thread */
+    int recv_budget;        /* messages per module_cb() call */
+    struct recvstats stats;
     uint32_t userid;        /* creds of connection */
     uint32_t rolemask;
 
@@ -94,8 +100,6 @@ struct module_struct {
     flux_msg_t *insmod;
 
     flux_t *h;               /* module's handle */
-
-    zlist_t *subs;          /* subscription strings */
 };
 
 struct modhash_struct {
@@ -103,6 +107,8 @@ struct modhash_struct {
     uint32_t rank;
     flux_t *broker_h;
     heartbeat_t *heartbeat;
+    subtrie_t *subs;        /* event subscriptions of all modules */
+    int recv_budget;
 };
 
 static int setup_module_profiling (module_t *p)
@@ -122,7 +128,6 @@ static void *module_thread (void *arg)
     assert (p->magic == MODULE_MAGIC);
     sigset_t signal_set;
     int errnum;
-    char *uri = xasprintf ("shmem://%s", zuuid_str (p->uuid));
     char **av = NULL;
     char *rankstr = NULL;
     int ac;
@@ -131,10 +136,10 @@ static void *module_thread (void *arg)
 
     setup_module_profiling (p);
 
-    /* Connect to broker socket, enable logging, register built-in services
+    /* Open module end of pipe, enable logging, register built-in services
      */
-    if (!(p->h = flux_open (uri, 0)))
-        log_err_exit ("flux_open %s", uri);
+    if (!(p->h = modpipe_open (p->pipe, 0)))
+        log_err_exit ("%s: modpipe_open", p->name);
     rankstr = xasprintf ("%"PRIu32, p->rank);
     if (flux_attr_fake (p->h, "rank", rankstr, FLUX_ATTRFLAG_IMMUTABLE) < 0) {
         log_err ("%s: error faking rank attribute", p->name);
@@ -180,7 +185,6 @@ static void *module_thread (void *arg)
         flux_log_error (p->h, "flux_send");
     flux_msg_destroy (msg);
 done:
-    free (uri);
     free (rankstr);
     if (av)
         free (av);
@@ -219,7 +223,7 @@ flux_msg_t *module_recvmsg (module_t *p)
 
     assert (p->magic == MODULE_MAGIC);
 
-    if (!(msg = flux_msg_recvzsock (p->sock)))
+    if (!(msg = modpipe_recv (p->pipe)))
         goto error;
     if (flux_msg_get_type (msg, &type) < 0)
         goto error;
@@ -236,7 +240,7 @@ flux_msg_t *module_recvmsg (module_t *p)
         default:
             break;
     }
-    /* All shmem:// connections to the broker have FLUX_ROLE_OWNER
+    /* All module connections to the broker have FLUX_ROLE_OWNER
      * and are "authenticated" as the instance owner.
      * Allow modules so endowed to change the userid/rolemask on messages when
      * sending on behalf of other users.  This is necessary for connectors
@@ -279,8 +283,6 @@ int module_sendmsg (module_t *p, const flux_msg_t *msg)
                 goto done;
             if (flux_msg_push_route (cpy, uuid) < 0)
                 goto done;
-            if (flux_msg_sendzsock (p->sock, cpy) < 0)
-                goto done;
             break;
         }
         case FLUX_MSGTYPE_RESPONSE: { /* simulate ROUTER socket */
@@ -288,15 +290,18 @@ int module_sendmsg (module_t *p, const flux_msg_t *msg)
                 goto done;
             if (flux_msg_pop_route (cpy, NULL) < 0)
                 goto done;
-            if (flux_msg_sendzsock (p->sock, cpy) < 0)
-                goto done;
             break;
         }
         default:
-            if (flux_msg_sendzsock (p->sock, msg) < 0)
+            if (!(cpy = flux_msg_copy (msg, true)))
                 goto done;
             break;
     }
+    /* The module thread takes ownership of the copy.
+     */
+    if (modpipe_send (p->pipe, cpy) < 0)
+        goto done;
+    cpy = NULL;
     rc = 0;
 done:
     flux_msg_destroy (cpy);
@@ -345,7 +350,7 @@ static void module_destroy (module_t *p)
 
     flux_watcher_stop (p->broker_w);
     flux_watcher_destroy (p->broker_w);
-    zsock_destroy (&p->sock);
+    modpipe_destroy (p->pipe);
 
     dlclose (p->dso);
     zuuid_destroy (&p->uuid);
@@ -359,12 +364,6 @@ static void module_destroy (module_t *p)
             flux_msg_destroy (msg);
     }
     flux_msg_destroy (p->insmod);
-    if (p->subs) {
-        char *s;
-        while ((s = zlist_pop (p->subs)))
-            free (s);
-        zlist_destroy (&p->subs);
-    }
     zlist_destroy (&p->rmmod);
     p->magic = ~MODULE_MAGIC;
     free (p);
@@ -389,14 +388,49 @@ done:
     return rc;
 }
 
+static bool is_keepalive (const flux_msg_t *msg)
+{
+    int type;
+    return (flux_msg_get_type (msg, &type) == 0
+                                && type == FLUX_MSGTYPE_KEEPALIVE);
+}
+
+/* Call the poller callback once per queued message, up to a limit so
+ * that a busy module can't starve the rest of the broker.  If messages
+ * remain, notify so this is called again on the next reactor loop.
+ * A keepalive may report that the module exited, upon which the poller
+ * callback destroys the module, so 'p' is not touched after handling one.
+ */
 static void module_cb (flux_reactor_t *r, flux_watcher_t *w,
                        int revents, void *arg)
 {
     module_t *p = arg;
     assert (p->magic == MODULE_MAGIC);
+    const flux_msg_t *msg;
+    int count = 0;
+
     p->lastseen = heartbeat_get_epoch (p->heartbeat);
-    if (p->poller_cb)
+    if (!p->poller_cb)
+        return;
+    modpipe_clear (p->pipe);
+    while ((msg = modpipe_peek (p->pipe))) {
+        if (count == p->recv_budget) {
+            modpipe_notify (p->pipe);
+            recvstats_update (&p->stats, count, p->recv_budget);
+            return;
+        }
+        if (is_keepalive (msg)) {
+            modpipe_notify (p->pipe);
+            recvstats_update (&p->stats, count + 1, p->recv_budget);
+            p->poller_cb (p, p->poller_arg);
+            return;
+        }
         p->poller_cb (p, p->poller_arg);
+        count++;
+    }
+    recvstats_update (&p->stats, count, p->recv_budget);
+    if (!modpipe_wait (p->pipe))
+        modpipe_notify (p->pipe);
 }
 
 int module_start (module_t *p)
@@ -405,6 +439,9 @@ int module_start (module_t *p)
     int errnum;
     int rc = -1;
 
+    /* Ask the module thread to wake module_cb() when it first sends.
+     */
+    (void)modpipe_wait (p->pipe);
     flux_watcher_start (p->broker_w);
     if ((errnum = pthread_create (&p->t, NULL, module_thread, p))) {
         errno = errnum;
@@ -559,23 +596,20 @@ module_t *module_add (modhash_t *mh, const char *path)
         oom ();
     if (!(p->rmmod = zlist_new ()))
         oom ();
-    if (!(p->subs = zlist_new ()))
-        oom ();
 
     p->rank = mh->rank;
     p->broker_h = mh->broker_h;
     p->heartbeat = mh->heartbeat;
+    p->recv_budget = mh->recv_budget;
 
-    /* Broker end of PAIR socket is opened here.
+    /* Broker end of the pipe is watched here.
      */
-    if (!(p->sock = zsock_new_pair (NULL)))
-        log_err_exit ("zsock_new_pair");
-    if (zsock_bind (p->sock, "inproc://%s", module_get_uuid (p)) < 0)
-        log_err_exit ("zsock_bind inproc://%s", module_get_uuid (p));
-    if (!(p->broker_w = flux_zmq_watcher_create (flux_get_reactor (p->broker_h),
-                                                 p->sock, FLUX_POLLIN,
-                                                 module_cb, p)))
-        log_err_exit ("flux_zmq_watcher_create");
+    if (!(p->pipe = modpipe_create ()))
+        log_err_exit ("modpipe_create");
+    if (!(p->broker_w = flux_fd_watcher_create (flux_get_reactor (p->broker_h),
+                                                modpipe_get_fd (p->pipe),
+                                                FLUX_POLLIN, module_cb, p)))
+        log_err_exit ("flux_fd_watcher_create");
     /* Set creds for connection.
      * Since this is a point to point connection between broker threads,
      * credentials are always those of the instance owner.
@@ -595,6 +629,7 @@ module_t *module_add (modhash_t *mh, const char *path)
 void module_remove (modhash_t *mh, module_t *p)
 {
     assert (p->magic == MODULE_MAGIC);
+    subtrie_remove_all (mh->subs, p);
     zhash_delete (mh->zh_byuuid, module_get_uuid (p));
 }
 
@@ -603,6 +638,9 @@ modhash_t *modhash_create (void)
     modhash_t *mh = xzmalloc (sizeof (*mh));
     if (!(mh->zh_byuuid = zhash_new ()))
         oom ();
+    if (!(mh->subs = subtrie_create ()))
+        oom ();
+    mh->recv_budget = RECV_BUDGET_DEFAULT;
     return mh;
 }
 
@@ -620,6 +658,7 @@ void modhash_destroy (modhash_t *mh)
             }
         }
         zhash_destroy (&mh->zh_byuuid);
+        subtrie_destroy (mh->subs);
         free (mh);
     }
 }
@@ -639,6 +678,49 @@ void modhash_set_heartbeat (modhash_t *mh, heartbeat_t *hb)
     mh->heartbeat = hb;
 }
 
+void modhash_set_recv_budget (modhash_t *mh, int budget)
+{
+    const char *uuid;
+    module_t *p;
+
+    mh->recv_budget = budget;
+    FOREACH_ZHASH (mh->zh_byuuid, uuid, p)
+        p->recv_budget = budget;
+}
+
+json_t *modhash_recvstats_encode (modhash_t *mh)
+{
+    json_t *o;
+    json_t *stats_o;
+    const char *uuid;
+    module_t *p;
+
+    if (!(o = json_object ()))
+        goto nomem;
+    FOREACH_ZHASH (mh->zh_byuuid, uuid, p) {
+        if (!(stats_o = recvstats_encode (&p->stats)))
+            goto nomem;
+        if (json_object_set_new (o, p->name, stats_o) < 0) {
+            json_decref (stats_o);
+            goto nomem;
+        }
+    }
+    return o;
+nomem:
+    json_decref (o);
+    errno = ENOMEM;
+    return NULL;
+}
+
+void modhash_recvstats_clear (modhash_t *mh)
+{
+    const char *uuid;
+    module_t *p;
+
+    FOREACH_ZHASH (mh->zh_byuuid, uuid, p)
+        recvstats_clear (&p->stats);
+}
+
 flux_modlist_t *module_get_modlist (modhash_t *mh)
 {
     flux_modlist_t *mods;
@@ -700,8 +782,8 @@ int module_subscribe (modhash_t *mh, const char *uuid, const char *topic)
         errno = ENOENT;
         goto done;
     }
-    if (zlist_push (p->subs, xstrdup (topic)) < 0)
-        oom ();
+    if (subtrie_insert (mh->subs, topic, p) < 0)
+        goto done;
     rc = 0;
 done:
     return rc;
@@ -710,55 +792,32 @@ done:
 int module_unsubscribe (modhash_t *mh, const char *uuid, const char *topic)
 {
     module_t *p = zhash_lookup (mh->zh_byuuid, uuid);
-    char *s;
     int rc = -1;
 
     if (!p) {
         errno = ENOENT;
         goto done;
     }
-    s = zlist_first (p->subs);
-    while (s) {
-        if (!strcmp (topic, s)) {
-            zlist_remove (p->subs, s);
-            free (s);
-            break;
-        }
-        s = zlist_next (p->subs);
-    }
+    (void)subtrie_remove (mh->subs, topic, p); /* not subscribed is OK */
     rc = 0;
 done:
     return rc;
 }
 
-static bool match_sub (module_t *p, const char *topic)
+static int event_mcast_cb (void *subscriber, void *arg)
 {
-    char *s = zlist_first (p->subs);
-
-    while (s) {
-        if (!strncmp (topic, s, strlen (s)))
-            return true;
-        s = zlist_next (p->subs);
-    }
-    return false;
+    return module_sendmsg (subscriber, arg);
 }
 
 int module_event_mcast (modhash_t *mh, const flux_msg_t *msg)
 {
     const char *topic;
-    module_t *p;
     int rc = -1;
 
     if (flux_msg_get_topic (msg, &topic) < 0)
         goto done;
-    p = zhash_first (mh->zh_byuuid);
-    while (p) {
-        if (match_sub (p, topic)) {
-            if (module_sendmsg (p, msg) < 0)
-                goto done;
-        }
-        p = zhash_next (mh->zh_byuuid);
-    }
+    if (subtrie_match (mh->subs, topic, event_mcast_cb, (void *)msg) < 0)
+        goto done;
     rc = 0;
 done:
     return rc;
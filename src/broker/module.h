@@ -1,6 +1,8 @@
 #ifndef _BROKER_MODULE_H
 #define _BROKER_MODULE_H
 
+#include <jansson.h>
+
 #include "heartbeat.h"
 
 typedef struct module_struct module_t;
@@ -17,6 +19,17 @@ void modhash_set_rank (modhash_t *mh, uint32_t rank);
 void modhash_set_flux (modhash_t *mh, flux_t *h);
 void modhash_set_heartbeat (modhash_t *mh, heartbeat_t *hb);
 
+/* Handle up to 'budget' messages from a module each time it is ready
+ * before yielding to other watchers (default RECV_BUDGET_DEFAULT).
+ */
+void modhash_set_recv_budget (modhash_t *mh, int budget);
+
+/* Encode messages per wakeup statistics of the loaded modules as a JSON
+ * object keyed by module name, or clear them.
+ */
+json_t *modhash_recvstats_encode (modhash_t *mh);
+void modhash_recvstats_clear (modhash_t *mh);
+
 /* Prepare module at 'path' for starting.
  */
 module_t *module_add (modhash_t *mh, const char *path);
@@ -39,7 +52,7 @@ const char *module_get_service (module_t *p);
  */
 const char *module_get_uuid (module_t *p);
 
-/* The poller callback is called when module socket is ready for
+/* The poller callback is called once for each message ready for
  * reading with module_recvmsg().
  */
 void module_set_poller_cb (module_t *p, modpoller_cb_f cb, void *arg);
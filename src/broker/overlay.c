@@ -26,6 +26,7 @@
 #include "config.h"
 #endif
 #include <stdarg.h>
+#include <arpa/inet.h>
 #include <czmq.h>
 #include <flux/core.h>
 #include <inttypes.h>
@@ -40,11 +41,26 @@
 #include "heartbeat.h"
 #include "overlay.h"
 #include "attr.h"
+#include "recvstats.h"
+
+/* Events published on the event socket within 'event_batch_window' seconds
+ * of each other are sent as one message with this topic.  Its payload is a
+ * sequence of encoded events, each preceded by its size as a 4 byte integer
+ * in network byte order.  A window of zero batches the events published
+ * during one reactor loop iteration.  A negative window disables batching.
+ */
+static const char *event_batch_topic = "cmb.event-batch";
+static const double default_event_batch_window = 0.;
+
+/* Publish a batch early once it holds this many bytes.
+ */
+static const size_t event_batch_max = 65536;
 
 struct endpoint {
     zsock_t *zs;
     char *uri;
     flux_watcher_t *w;
+    struct recvstats stats;
 };
 
 struct overlay_struct {
@@ -74,10 +90,17 @@ struct overlay_struct {
     overlay_cb_f event_cb;
     void *event_arg;
     bool event_munge;
+    double event_batch_window;
+    zlist_t *event_batch;       /* events waiting to be published */
+    size_t event_batch_size;    /* encoded size of event_batch */
+    flux_watcher_t *event_batch_prep;
+    flux_watcher_t *event_batch_timer;
+    zlist_t *event_queue;       /* received events not yet handled */
 
     struct endpoint *relay;
 
     int idle_warning;
+    int recv_budget;            /* messages handled per socket wakeup */
 };
 
 typedef struct {
@@ -87,6 +110,17 @@ typedef struct {
 
 static void heartbeat_handler (flux_t *h, flux_msg_handler_t *mh,
                                const flux_msg_t *msg, void *arg);
+static int event_batch_flush (overlay_t *ov);
+
+static void msglist_destroy (zlist_t **lp)
+{
+    if (*lp) {
+        flux_msg_t *msg;
+        while ((msg = zlist_pop (*lp)))
+            flux_msg_destroy (msg);
+        zlist_destroy (lp);
+    }
+}
 
 static void endpoint_destroy (struct endpoint *ep)
 {
@@ -112,6 +146,12 @@ void overlay_destroy (overlay_t *ov)
             flux_msg_handler_destroy (ov->heartbeat);
         if (ov->h)
             (void)flux_event_unsubscribe (ov->h, "hb");
+        if (event_batch_flush (ov) < 0)
+            log_err ("overlay: publishing event batch");
+        flux_watcher_destroy (ov->event_batch_prep);
+        flux_watcher_destroy (ov->event_batch_timer);
+        msglist_destroy (&ov->event_batch);
+        msglist_destroy (&ov->event_queue);
         endpoint_destroy (ov->parent);
         endpoint_destroy (ov->child);
         endpoint_destroy (ov->event);
@@ -126,9 +166,13 @@ overlay_t *overlay_create ()
     overlay_t *ov = xzmalloc (sizeof (*ov));
     ov->rank = FLUX_NODEID_ANY;
     ov->parent_lastsent = -1;
+    ov->event_batch_window = default_event_batch_window;
+    ov->recv_budget = RECV_BUDGET_DEFAULT;
 
     if (!(ov->children = zhash_new ()))
         oom ();
+    if (!(ov->event_batch = zlist_new ()) || !(ov->event_queue = zlist_new ()))
+        oom ();
     return ov;
 }
 
@@ -206,6 +250,48 @@ nomem:
     return NULL;
 }
 
+static int recvstats_set (json_t *o, const char *name, struct endpoint *ep)
+{
+    json_t *stats_o;
+
+    if (!ep || !ep->w)
+        return 0;
+    if (!(stats_o = recvstats_encode (&ep->stats)))
+        return -1;
+    if (json_object_set_new (o, name, stats_o) < 0) {
+        json_decref (stats_o);
+        return -1;
+    }
+    return 0;
+}
+
+json_t *overlay_recvstats_encode (overlay_t *ov)
+{
+    json_t *o;
+
+    if (!(o = json_object ()))
+        goto nomem;
+    if (recvstats_set (o, "child", ov->child) < 0
+            || recvstats_set (o, "parent", ov->parent) < 0
+            || recvstats_set (o, "event", ov->event) < 0)
+        goto nomem;
+    return o;
+nomem:
+    json_decref (o);
+    errno = ENOMEM;
+    return NULL;
+}
+
+void overlay_recvstats_clear (overlay_t *ov)
+{
+    if (ov->child)
+        recvstats_clear (&ov->child->stats);
+    if (ov->parent)
+        recvstats_clear (&ov->parent->stats);
+    if (ov->event)
+        recvstats_clear (&ov->event->stats);
+}
+
 void overlay_log_idle_children (overlay_t *ov)
 {
     const char *uuid;
@@ -397,27 +483,195 @@ void overlay_set_event_cb (overlay_t *ov, overlay_cb_f cb, void *arg)
     ov->event_arg = arg;
 }
 
-int overlay_sendmsg_event (overlay_t *ov, const flux_msg_t *msg)
+static int event_send (overlay_t *ov, const flux_msg_t *msg)
 {
+    if (ov->event_munge)
+        return flux_msg_sendzsock_munge (ov->event->zs, msg, ov->sec);
+    return flux_msg_sendzsock (ov->event->zs, msg);
+}
+
+/* Pack the pending events into one message.  The batch takes the
+ * sequence number of its last event, but receivers use the sequence
+ * numbers of the events inside it.  The events are left on the list.
+ */
+static flux_msg_t *event_batch_encode (overlay_t *ov)
+{
+    flux_msg_t *batch = NULL;
+    flux_msg_t *msg;
+    char *buf, *p;
+    uint32_t seq = 0;
+    uint32_t n;
+    size_t size;
+
+    buf = p = xzmalloc (ov->event_batch_size);
+    msg = zlist_first (ov->event_batch);
+    while (msg) {
+        size = flux_msg_encode_size (msg);
+        n = htonl (size);
+        memcpy (p, &n, sizeof (n));
+        p += sizeof (n);
+        if (flux_msg_encode (msg, p, size) < 0
+                || flux_msg_get_seq (msg, &seq) < 0)
+            goto done;
+        p += size;
+        msg = zlist_next (ov->event_batch);
+    }
+    if (!(batch = flux_msg_create (FLUX_MSGTYPE_EVENT))
+            || flux_msg_set_topic (batch, event_batch_topic) < 0
+            || flux_msg_set_seq (batch, seq) < 0
+            || flux_msg_set_payload (batch, 0, buf, p - buf) < 0) {
+        flux_msg_destroy (batch);
+        batch = NULL;
+    }
+done:
+    free (buf);
+    return batch;
+}
+
+/* Send the pending events as one batch message.  If there is only one,
+ * or they cannot be packed into a batch, send them one at a time so that
+ * downstream ranks see no gap in the event sequence.
+ */
+static int event_batch_flush (overlay_t *ov)
+{
+    flux_msg_t *batch = NULL;
+    flux_msg_t *msg = NULL;
     int rc = -1;
 
-    if (!ov->event || !ov->event->zs)
+    if (ov->event_batch_prep)
+        flux_watcher_stop (ov->event_batch_prep);
+    if (ov->event_batch_timer)
+        flux_watcher_stop (ov->event_batch_timer);
+    if (zlist_size (ov->event_batch) == 0)
         return 0;
-    if (ov->event_munge) {
-        if (flux_msg_sendzsock_munge (ov->event->zs, msg, ov->sec) < 0)
-            goto done;
-    } else {
-        if (flux_msg_sendzsock (ov->event->zs, msg) < 0)
+    if (!ov->event || !ov->event->zs) {
+        errno = EINVAL;
+        goto done;
+    }
+    if (zlist_size (ov->event_batch) > 1) {
+        if (!(batch = event_batch_encode (ov)))
+            log_err ("overlay: encoding event batch, sending events singly");
+        else if (event_send (ov, batch) < 0)
             goto done;
     }
+    if (!batch) {
+        while ((msg = zlist_pop (ov->event_batch))) {
+            if (event_send (ov, msg) < 0)
+                goto done;
+            flux_msg_destroy (msg);
+        }
+    }
     rc = 0;
 done:
+    flux_msg_destroy (msg);
+    while ((msg = zlist_pop (ov->event_batch)))
+        flux_msg_destroy (msg);
+    ov->event_batch_size = 0;
+    flux_msg_destroy (batch);
     return rc;
 }
 
+static void event_batch_cb (flux_reactor_t *r, flux_watcher_t *w,
+                            int revents, void *arg)
+{
+    overlay_t *ov = arg;
+    if (event_batch_flush (ov) < 0)
+        log_err ("overlay: publishing event batch");
+}
+
+static void event_batch_arm (overlay_t *ov)
+{
+    flux_reactor_t *r = flux_get_reactor (ov->h);
+
+    if (ov->event_batch_window == 0.) {
+        if (!ov->event_batch_prep
+                && !(ov->event_batch_prep = flux_prepare_watcher_create (r,
+                                                     event_batch_cb, ov)))
+            log_err_exit ("flux_prepare_watcher_create");
+        flux_watcher_start (ov->event_batch_prep);
+    } else {
+        if (!ov->event_batch_timer
+                && !(ov->event_batch_timer = flux_timer_watcher_create (r,
+                                        0., 0., event_batch_cb, ov)))
+            log_err_exit ("flux_timer_watcher_create");
+        flux_timer_watcher_reset (ov->event_batch_timer,
+                                  ov->event_batch_window, 0.);
+        flux_watcher_start (ov->event_batch_timer);
+    }
+}
+
+int overlay_sendmsg_event (overlay_t *ov, const flux_msg_t *msg)
+{
+    flux_msg_t *cpy;
+
+    if (!ov->event || !ov->event->zs)
+        return 0;
+    if (ov->event_batch_window < 0. || !ov->h)
+        return event_send (ov, msg);
+    if (!(cpy = flux_msg_copy (msg, true)))
+        return -1;
+    if (zlist_append (ov->event_batch, cpy) < 0)
+        oom ();
+    ov->event_batch_size += sizeof (uint32_t) + flux_msg_encode_size (cpy);
+    if (ov->event_batch_size >= event_batch_max)
+        return event_batch_flush (ov);
+    if (zlist_size (ov->event_batch) == 1)
+        event_batch_arm (ov);
+    return 0;
+}
+
+/* Decode the events in 'batch' onto the received event queue.
+ */
+static int event_batch_decode (overlay_t *ov, const flux_msg_t *batch)
+{
+    zlist_t *l;
+    flux_msg_t *msg;
+    const char *p;
+    const void *buf;
+    int size;
+    uint32_t n;
+
+    if (flux_msg_get_payload (batch, NULL, &buf, &size) < 0)
+        return -1;
+    if (!(l = zlist_new ()))
+        oom ();
+    p = buf;
+    while (size > 0) {
+        if (size < sizeof (n))
+            goto eproto;
+        memcpy (&n, p, sizeof (n));
+        n = ntohl (n);
+        p += sizeof (n);
+        size -= sizeof (n);
+        if (n > size || !(msg = flux_msg_decode (p, n)))
+            goto eproto;
+        if (zlist_append (l, msg) < 0)
+            oom ();
+        p += n;
+        size -= n;
+    }
+    while ((msg = zlist_pop (l))) {
+        if (zlist_append (ov->event_queue, msg) < 0)
+            oom ();
+    }
+    zlist_destroy (&l);
+    return 0;
+eproto:
+    msglist_destroy (&l);
+    errno = EPROTO;
+    return -1;
+}
+
+/* Return the next received event.  The events of a batch are returned
+ * one per call, in order.
+ */
 flux_msg_t *overlay_recvmsg_event (overlay_t *ov)
 {
     flux_msg_t *msg = NULL;
+    const char *topic;
+
+    if ((msg = zlist_pop (ov->event_queue)))
+        goto done;
     if (!ov->event || !ov->event->zs) {
         errno = EINVAL;
         goto done;
@@ -429,6 +683,14 @@ flux_msg_t *overlay_recvmsg_event (overlay_t *ov)
         if (!(msg = flux_msg_recvzsock (ov->event->zs)))
             goto done;
     }
+    if (flux_msg_get_topic (msg, &topic) == 0
+            && !strcmp (topic, event_batch_topic)) {
+        if (event_batch_decode (ov, msg) < 0)
+            log_err ("overlay: dropping malformed event batch");
+        flux_msg_destroy (msg);
+        if (!(msg = zlist_pop (ov->event_queue)))
+            errno = EPROTO;
+    }
 done:
     return msg;
 }
@@ -463,13 +725,38 @@ done:
     return rc;
 }
 
+void overlay_set_recv_budget (overlay_t *ov, int budget)
+{
+    ov->recv_budget = budget;
+}
+
+static bool zsock_readable (void *zsock)
+{
+    return (zsock_events (zsock) & ZMQ_POLLIN);
+}
+
+/* Call 'cb' once per message waiting on 'zsock', up to the receive budget.
+ * If messages remain, the zmq watcher stays ready and is called again on
+ * the next reactor loop iteration, after the other ready watchers have
+ * had their turn, so a busy socket can't starve the others.
+ */
+static void drain (overlay_t *ov, struct endpoint *ep, overlay_cb_f cb,
+                   void *arg)
+{
+    int count = 0;
+
+    do {
+        cb (ov, ep->zs, arg);
+    } while (++count < ov->recv_budget && zsock_readable (ep->zs));
+    recvstats_update (&ep->stats, count, ov->recv_budget);
+}
+
 static void child_cb (flux_reactor_t *r, flux_watcher_t *w,
                       int revents, void *arg)
 {
-    void *zsock = flux_zmq_watcher_get_zsock (w);
     overlay_t *ov = arg;
     if (ov->child_cb)
-        ov->child_cb (ov, zsock, ov->child_arg);
+        drain (ov, ov->child, ov->child_cb, ov->child_arg);
 }
 
 static int bind_child (overlay_t *ov, struct endpoint *ep)
@@ -506,13 +793,28 @@ static int bind_event_pub (overlay_t *ov, struct endpoint *ep)
     return 0;
 }
 
+/* Like drain(), but the rest of a received event batch is always handed
+ * over before returning, since the socket may not become ready again to
+ * get them handled.  The events of a batch count against the budget.
+ */
 static void event_cb (flux_reactor_t *r, flux_watcher_t *w,
                       int revents, void *arg)
 {
     void *zsock = flux_zmq_watcher_get_zsock (w);
     overlay_t *ov = arg;
-    if (ov->event_cb)
+    int count = 0;
+
+    while (ov->event_cb) {
         ov->event_cb (ov, zsock, ov->event_arg);
+        count++;
+        while (ov->event_cb && zlist_size (ov->event_queue) > 0) {
+            ov->event_cb (ov, zsock, ov->event_arg);
+            count++;
+        }
+        if (count >= ov->recv_budget || !zsock_readable (zsock))
+            break;
+    }
+    recvstats_update (&ov->event->stats, count, ov->recv_budget);
 }
 
 static int connect_event_sub (overlay_t *ov, struct endpoint *ep)
@@ -534,10 +836,9 @@ static int connect_event_sub (overlay_t *ov, struct endpoint *ep)
 static void parent_cb (flux_reactor_t *r, flux_watcher_t *w,
                        int revents, void *arg)
 {
-    void *zsock = flux_zmq_watcher_get_zsock (w);
     overlay_t *ov = arg;
     if (ov->parent_cb)
-        ov->parent_cb (ov, zsock, ov->parent_arg);
+        drain (ov, ov->parent, ov->parent_cb, ov->parent_arg);
 }
 
 static int connect_parent (overlay_t *ov, struct endpoint *ep)
@@ -625,6 +926,40 @@ static int overlay_attr_get_cb (const char *name, const char **val, void *arg)
         *val = overlay_get_parent(overlay);
     else if (!strcmp (name, "mcast.relay-endpoint"))
         *val = overlay_get_relay(overlay);
+    else if (!strcmp (name, "event.batch-window")) {
+        static char s[32];
+        snprintf (s, sizeof (s), "%g", overlay->event_batch_window);
+        *val = s;
+    }
+    else {
+        errno = ENOENT;
+        goto done;
+    }
+    rc = 0;
+done:
+    return rc;
+}
+
+static int overlay_attr_set_cb (const char *name, const char *val, void *arg)
+{
+    overlay_t *overlay = arg;
+    double window;
+    char *endptr;
+    int rc = -1;
+
+    if (!strcmp (name, "event.batch-window")) {
+        errno = 0;
+        window = strtod (val, &endptr);
+        if (errno != 0 || *endptr != '\0' || endptr == val) {
+            errno = EINVAL;
+            goto done;
+        }
+        /* Publish anything batched under the old window first.
+         */
+        if (event_batch_flush (overlay) < 0)
+            goto done;
+        overlay->event_batch_window = window;
+    }
     else {
         errno = ENOENT;
         goto done;
@@ -644,6 +979,10 @@ int overlay_register_attrs (overlay_t *overlay, attr_t *attrs)
                          FLUX_ATTRFLAG_IMMUTABLE,
                          overlay_attr_get_cb, NULL, overlay) < 0)
         return -1;
+    if (attr_add_active (attrs, "event.batch-window", 0,
+                         overlay_attr_get_cb, overlay_attr_set_cb,
+                         overlay) < 0)
+        return -1;
     if (attr_add_uint32 (attrs, "rank", overlay->rank,
                          FLUX_ATTRFLAG_IMMUTABLE) < 0)
         return -1;
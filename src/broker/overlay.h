@@ -1,6 +1,8 @@
 #ifndef _BROKER_OVERLAY_H
 #define _BROKER_OVERLAY_H
 
+#include <jansson.h>
+
 #include "attr.h"
 
 typedef struct overlay_struct overlay_t;
@@ -52,6 +54,17 @@ void overlay_checkin_child (overlay_t *ov, const char *uuid);
  */
 char *overlay_lspeer_encode (overlay_t *ov);
 
+/* Handle up to 'budget' messages each time a socket becomes ready before
+ * yielding to other watchers (default RECV_BUDGET_DEFAULT).
+ */
+void overlay_set_recv_budget (overlay_t *ov, int budget);
+
+/* Encode messages per wakeup statistics for the child, parent, and event
+ * sockets as a JSON object keyed by socket name, or clear them.
+ */
+json_t *overlay_recvstats_encode (overlay_t *ov);
+void overlay_recvstats_clear (overlay_t *ov);
+
 /* The event socket is SUB for ranks > 0, and PUB for rank 0.
  * Internally, all events are routed to rank 0 before being published.
  */
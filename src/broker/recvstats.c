@@ -0,0 +1,75 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* recvstats.c - messages per wakeup statistics */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include <jansson.h>
+
+#include "recvstats.h"
+
+void recvstats_update (struct recvstats *st, int count, int budget)
+{
+    if (count == 0)
+        return;
+    st->wakeups++;
+    st->msgs += count;
+    if (st->max < count)
+        st->max = count;
+    if (count >= budget)
+        st->budget_hits++;
+}
+
+void recvstats_clear (struct recvstats *st)
+{
+    memset (st, 0, sizeof (*st));
+}
+
+void recvstats_add (struct recvstats *dst, const struct recvstats *src)
+{
+    dst->wakeups += src->wakeups;
+    dst->msgs += src->msgs;
+    if (dst->max < src->max)
+        dst->max = src->max;
+    dst->budget_hits += src->budget_hits;
+}
+
+json_t *recvstats_encode (const struct recvstats *st)
+{
+    double mean = st->wakeups > 0 ? (double)st->msgs / st->wakeups : 0.;
+
+    return json_pack ("{s:i s:i s:i s:i s:f}",
+                      "wakeups", st->wakeups,
+                      "msgs", st->msgs,
+                      "max", st->max,
+                      "budget-hits", st->budget_hits,
+                      "mean", mean);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,39 @@
+#ifndef _BROKER_RECVSTATS_H
+#define _BROKER_RECVSTATS_H
+
+#include <jansson.h>
+
+/* Messages handled per wakeup by a watcher that handles up to a budget
+ * of messages each time it is called, then yields to the other ready
+ * watchers and picks up where it left off on the next loop iteration.
+ */
+struct recvstats {
+    int wakeups;        /* calls that handled at least one message */
+    int msgs;           /* messages handled */
+    int max;            /* most messages handled in one call */
+    int budget_hits;    /* calls that stopped at the budget */
+};
+
+enum {
+    RECV_BUDGET_DEFAULT = 64,
+};
+
+/* Record a call that handled 'count' messages with budget 'budget'.
+ */
+void recvstats_update (struct recvstats *st, int count, int budget);
+
+void recvstats_clear (struct recvstats *st);
+
+/* Add the counts of 'src' to 'dst'.
+ */
+void recvstats_add (struct recvstats *dst, const struct recvstats *src);
+
+/* Encode as a JSON object, including the mean messages per wakeup.
+ */
+json_t *recvstats_encode (const struct recvstats *st);
+
+#endif /* !_BROKER_RECVSTATS_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,218 @@
+/* cachebench.c - measure content cache heartbeat cost vs cache size
+ *
+ * Usage: cachebench [max-entries]
+ *
+ * Fill the rank 0 content cache with clean entries (a fake backing store
+ * answers content-backing.store-batch), growing by powers of ten up to
+ * max-entries (default 10M), and at each size report the time taken to
+ * dispatch a heartbeat event, which drives cache purge.  The cache is kept
+ * over its size target but under its entry target, with entries smaller
+ * than content.purge-large-entry, so no entry may be purged.  "hb(ms)" is
+ * measured in the epoch the entries were used in, so none is old enough
+ * to purge either;  "hb-old(ms)" is measured once all entries are old.
+ * Ideally both costs stay flat as the cache grows.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <flux/core.h>
+#include <czmq.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "attr.h"
+#include "content-cache.h"
+
+#include "src/common/libutil/blobref.h"
+#include "src/common/libutil/blobvec.h"
+#include "src/common/libutil/monotime.h"
+#include "src/common/libutil/log.h"
+
+static const int window = 1024;
+
+static int pending;
+static int epoch;
+
+static void backing_store_batch_cb (flux_t *h, flux_msg_handler_t *mh,
+                                    const flux_msg_t *msg, void *arg)
+{
+    const void *buf;
+    int size;
+    int offset = 0;
+    const void *data;
+    int len;
+    blobref_t blobref;
+    blobvec_t *bv;
+
+    if (flux_request_decode_raw (msg, NULL, &buf, &size) < 0
+            || !(bv = blobvec_create ()))
+        log_err_exit ("content-backing.store-batch");
+    while (blobvec_next (buf, size, &offset, &data, &len) > 0) {
+        if (blobref_hash ("sha1", (uint8_t *)data, len, blobref) < 0
+                || blobvec_append (bv, blobref, strlen (blobref) + 1) < 0)
+            log_err_exit ("content-backing.store-batch");
+    }
+    if (flux_respond_raw (h, msg, 0, blobvec_data (bv),
+                          blobvec_size (bv)) < 0)
+        log_err_exit ("content-backing.store-batch: flux_respond_raw");
+    blobvec_destroy (bv);
+}
+
+static void heartbeat_cb (flux_t *h, flux_msg_handler_t *mh,
+                          const flux_msg_t *msg, void *arg)
+{
+    flux_reactor_stop (flux_get_reactor (h));
+}
+
+static const struct flux_msg_handler_spec htab[] = {
+    { FLUX_MSGTYPE_REQUEST, "content-backing.store-batch",
+      backing_store_batch_cb, 0 },
+    { FLUX_MSGTYPE_EVENT,   "hb", heartbeat_cb, 0 },
+    FLUX_MSGHANDLER_TABLE_END,
+};
+
+static void stop_cb (flux_future_t *f, void *arg)
+{
+    flux_reactor_stop (flux_future_get_reactor (f));
+}
+
+static void rpc_wait (flux_t *h, flux_future_t *f, const char *name)
+{
+    if (!f || flux_future_then (f, -1., stop_cb, NULL) < 0)
+        log_err_exit ("%s", name);
+    if (flux_reactor_run (flux_get_reactor (h), 0) < 0)
+        log_err_exit ("%s: flux_reactor_run", name);
+    if (flux_future_get (f, NULL) < 0)
+        log_err_exit ("%s", name);
+    flux_future_destroy (f);
+}
+
+static void store_cb (flux_future_t *f, void *arg)
+{
+    flux_reactor_t *r = flux_future_get_reactor (f);
+
+    if (flux_content_store_get (f, NULL) < 0)
+        log_err_exit ("content.store");
+    flux_future_destroy (f);
+    if (--pending == 0)
+        flux_reactor_stop (r);
+}
+
+/* Store blobs [first, last) in windows of outstanding RPCs,
+ * then flush so all entries are clean.
+ */
+static void fill (flux_t *h, int first, int last)
+{
+    char data[32];
+    flux_future_t *f;
+    int i = first;
+
+    while (i < last) {
+        while (i < last && pending < window) {
+            snprintf (data, sizeof (data), "blob-%d", i++);
+            if (!(f = flux_content_store (h, data, strlen (data), 0))
+                    || flux_future_then (f, -1., store_cb, NULL) < 0)
+                log_err_exit ("content.store");
+            pending++;
+        }
+        if (flux_reactor_run (flux_get_reactor (h), 0) < 0)
+            log_err_exit ("flux_reactor_run");
+    }
+    rpc_wait (h, flux_rpc (h, "content.flush", NULL, FLUX_NODEID_ANY, 0),
+              "content.flush");
+}
+
+/* Return elapsed time (msec) to dispatch one heartbeat event for 'epoch'.
+ */
+static double heartbeat (flux_t *h)
+{
+    struct timespec t0;
+    flux_msg_t *msg;
+
+    monotime (&t0);
+    if (!(msg = flux_heartbeat_encode (epoch)) || flux_send (h, msg, 0) < 0)
+        log_err_exit ("sending heartbeat");
+    flux_msg_destroy (msg);
+    if (flux_reactor_run (flux_get_reactor (h), 0) < 0)
+        log_err_exit ("flux_reactor_run");
+    return monotime_since (t0);
+}
+
+int main (int argc, char *argv[])
+{
+    flux_t *h;
+    content_cache_t *cache;
+    attr_t *attrs;
+    flux_msg_handler_t **handlers = NULL;
+    const char *old_entry;
+    char s[16];
+    int max = 10*1000*1000;
+    int count = 0;
+    int size;
+    struct timespec t0;
+    double fill_ms;
+    double hb_ms;
+    double hb_old_ms;
+    int i;
+
+    log_init ("cachebench");
+    if (argc > 2) {
+        fprintf (stderr, "Usage: cachebench [max-entries]\n");
+        exit (1);
+    }
+    if (argc == 2)
+        max = strtoul (argv[1], NULL, 10);
+
+    (void)setenv ("FLUX_CONNECTOR_PATH",
+                  flux_conf_get ("connector_path", CONF_FLAG_INTREE), 0);
+    if (!(h = flux_open ("loop://", 0)))
+        log_err_exit ("flux_open loop://");
+    if (!(cache = content_cache_create ()))
+        log_err_exit ("content_cache_create");
+    if (content_cache_set_flux (cache, h) < 0)
+        log_err_exit ("content_cache_set_flux");
+    if (!(attrs = attr_create ())
+            || content_cache_register_attrs (cache, attrs) < 0)
+        log_err_exit ("content_cache_register_attrs");
+    snprintf (s, sizeof (s), "%d", max + 1);
+    if (attr_set (attrs, "content.purge-target-size", "0", true) < 0
+            || attr_set (attrs, "content.purge-target-entries", s, true) < 0
+            || attr_get (attrs, "content.purge-old-entry",
+                         &old_entry, NULL) < 0)
+        log_err_exit ("setting purge targets");
+    if (flux_msg_handler_addvec (h, htab, NULL, &handlers) < 0)
+        log_err_exit ("flux_msg_handler_addvec");
+    rpc_wait (h, flux_rpc_pack (h, "content.backing", FLUX_NODEID_ANY, 0,
+                                "{s:b s:s}", "backing", 1, "name", "bench"),
+              "content.backing");
+
+    printf ("%10s %12s %12s %12s\n", "entries", "fill(s)", "hb(ms)",
+            "hb-old(ms)");
+    for (size = 1000; size <= max; size *= 10) {
+        monotime (&t0);
+        fill (h, count, size);
+        fill_ms = monotime_since (t0);
+        count = size;
+        hb_ms = 0;
+        for (i = 0; i < 3; i++)
+            hb_ms += heartbeat (h);
+        epoch += strtoul (old_entry, NULL, 10);
+        hb_old_ms = 0;
+        for (i = 0; i < 3; i++)
+            hb_old_ms += heartbeat (h);
+        printf ("%10d %12.3f %12.3f %12.3f\n", count, fill_ms / 1000,
+                hb_ms / 3, hb_old_ms / 3);
+    }
+
+    flux_msg_handler_delvec (handlers);
+    content_cache_destroy (cache);
+    attr_destroy (attrs);
+    flux_close (h);
+    log_fini ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
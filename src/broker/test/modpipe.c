@@ -0,0 +1,101 @@
+#include <flux/core.h>
+#include <czmq.h>
+#include <stdio.h>
+
+#include "modpipe.h"
+
+#include "src/common/libtap/tap.h"
+
+static bool check_topic (const flux_msg_t *msg, const char *topic)
+{
+    const char *s;
+    return msg && flux_msg_get_topic (msg, &s) == 0 && !strcmp (s, topic);
+}
+
+int main (int argc, char **argv)
+{
+    modpipe_t *mp;
+    flux_t *h;
+    flux_msg_t *msg, *rmsg;
+    const flux_msg_t *pmsg;
+    uint32_t userid = 42;
+    int i;
+
+    plan (NO_PLAN);
+
+    ok ((mp = modpipe_create ()) != NULL,
+        "modpipe_create works");
+    ok ((h = modpipe_open (mp, 0)) != NULL,
+        "modpipe_open works");
+
+    /* broker to module */
+    ok (!(flux_pollevents (h) & FLUX_POLLIN),
+        "module end is not readable");
+    if (!(msg = flux_request_encode ("a.b", NULL)))
+        BAIL_OUT ("flux_request_encode failed");
+    ok (modpipe_send (mp, msg) == 0,
+        "modpipe_send works");
+    ok ((flux_pollevents (h) & FLUX_POLLIN),
+        "module end is readable");
+    rmsg = flux_recv (h, FLUX_MATCH_ANY, FLUX_O_NONBLOCK);
+    ok (rmsg == msg,
+        "module received the same message, not a copy");
+    flux_msg_destroy (rmsg);
+    errno = 0;
+    ok (flux_recv (h, FLUX_MATCH_ANY, FLUX_O_NONBLOCK) == NULL
+        && (errno == EWOULDBLOCK || errno == EAGAIN),
+        "nonblocking flux_recv on empty pipe fails with EWOULDBLOCK");
+
+    /* module to broker */
+    errno = 0;
+    ok (modpipe_recv (mp) == NULL && errno == EAGAIN,
+        "modpipe_recv on empty pipe fails with EAGAIN");
+    ok (modpipe_wait (mp) == true,
+        "modpipe_wait says broker may sleep");
+    if (!(msg = flux_request_encode ("c.d", NULL)))
+        BAIL_OUT ("flux_request_encode failed");
+    ok (flux_send (h, msg, 0) == 0,
+        "module sent a message");
+    ok (modpipe_wait (mp) == false,
+        "modpipe_wait says broker should not sleep");
+    modpipe_clear (mp);
+    ok ((pmsg = modpipe_peek (mp)) != NULL && check_topic (pmsg, "c.d"),
+        "modpipe_peek works");
+    rmsg = modpipe_recv (mp);
+    ok (rmsg != msg && check_topic (rmsg, "c.d"),
+        "broker received a copy of it");
+    flux_msg_destroy (rmsg);
+    flux_msg_destroy (msg);
+
+    /* testing userid is applied to the copy */
+    ok (flux_opt_set (h, FLUX_OPT_TESTING_USERID, &userid,
+                      sizeof (userid)) == 0,
+        "set testing userid on module end");
+    if (!(msg = flux_request_encode ("e.f", NULL)))
+        BAIL_OUT ("flux_request_encode failed");
+    ok (flux_send (h, msg, 0) == 0,
+        "module sent a message");
+    flux_msg_destroy (msg);
+    userid = 0;
+    rmsg = modpipe_recv (mp);
+    ok (rmsg && flux_msg_get_userid (rmsg, &userid) == 0 && userid == 42,
+        "broker received it with the testing userid");
+    flux_msg_destroy (rmsg);
+
+    /* leave messages queued in both directions for modpipe_destroy() */
+    for (i = 0; i < 4; i++) {
+        if (!(msg = flux_request_encode ("g.h", NULL))
+                || flux_send (h, msg, 0) < 0
+                || modpipe_send (mp, msg) < 0)
+            BAIL_OUT ("could not queue messages");
+    }
+    flux_close (h);
+    modpipe_destroy (mp);
+
+    done_testing ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,198 @@
+/* modpipebench.c - compare broker to module message transports
+ *
+ * Usage: modpipebench [count]
+ *
+ * A thread standing in for a comms module answers requests, while the main
+ * thread, standing in for the broker, makes 'count' (default 100000) round
+ * trips one at a time, then sends 'count' requests before reading any
+ * response.  This is done over a shmem:// socket pair, the transport that
+ * modules used before, and over a modpipe_t.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <flux/core.h>
+#include <czmq.h>
+#include <stdio.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include "modpipe.h"
+
+#include "src/common/libutil/monotime.h"
+#include "src/common/libutil/log.h"
+
+struct transport {
+    const char *name;
+    flux_t *h;          /* module end */
+    int (*send) (struct transport *t, flux_msg_t *msg);
+    flux_msg_t *(*recv) (struct transport *t);
+    flux_t *h_broker;   /* shmem:// broker end */
+    modpipe_t *mp;      /* modpipe broker end */
+};
+
+/* Module thread: turn each request into a response and send it back,
+ * until a request with topic "stop" arrives.
+ */
+static void *module_thread (void *arg)
+{
+    struct transport *t = arg;
+    flux_msg_t *msg;
+    const char *topic;
+
+    for (;;) {
+        if (!(msg = flux_recv (t->h, FLUX_MATCH_ANY, 0)))
+            log_err_exit ("%s: flux_recv", t->name);
+        if (flux_msg_get_topic (msg, &topic) < 0)
+            log_err_exit ("%s: flux_msg_get_topic", t->name);
+        if (!strcmp (topic, "stop")) {
+            flux_msg_destroy (msg);
+            break;
+        }
+        if (flux_msg_set_type (msg, FLUX_MSGTYPE_RESPONSE) < 0
+                || flux_send (t->h, msg, 0) < 0)
+            log_err_exit ("%s: flux_send", t->name);
+        flux_msg_destroy (msg);
+    }
+    return NULL;
+}
+
+static int shmem_send (struct transport *t, flux_msg_t *msg)
+{
+    int rc = flux_send (t->h_broker, msg, 0);
+    flux_msg_destroy (msg);
+    return rc;
+}
+
+static flux_msg_t *shmem_recv (struct transport *t)
+{
+    return flux_recv (t->h_broker, FLUX_MATCH_ANY, 0);
+}
+
+static int modpipe_bench_send (struct transport *t, flux_msg_t *msg)
+{
+    if (modpipe_send (t->mp, msg) < 0) {
+        flux_msg_destroy (msg);
+        return -1;
+    }
+    return 0;
+}
+
+static flux_msg_t *modpipe_bench_recv (struct transport *t)
+{
+    struct pollfd pfd = {
+        .fd = modpipe_get_fd (t->mp),
+        .events = POLLIN,
+        .revents = 0,
+    };
+    flux_msg_t *msg;
+
+    while (!(msg = modpipe_recv (t->mp))) {
+        if (modpipe_wait (t->mp)) {
+            if (poll (&pfd, 1, -1) < 0)
+                return NULL;
+            modpipe_clear (t->mp);
+        }
+    }
+    return msg;
+}
+
+static void send_request (struct transport *t, const char *topic)
+{
+    flux_msg_t *msg;
+
+    if (!(msg = flux_request_encode (topic, NULL))
+            || t->send (t, msg) < 0)
+        log_err_exit ("%s: sending %s", t->name, topic);
+}
+
+static void recv_response (struct transport *t)
+{
+    flux_msg_t *msg;
+
+    if (!(msg = t->recv (t)))
+        log_err_exit ("%s: receiving response", t->name);
+    flux_msg_destroy (msg);
+}
+
+static void bench (struct transport *t, int count)
+{
+    pthread_t thread;
+    struct timespec t0;
+    double rtt_us, batch_us;
+    int e, i;
+
+    if ((e = pthread_create (&thread, NULL, module_thread, t)) != 0)
+        log_errn_exit (e, "pthread_create");
+
+    monotime (&t0);
+    for (i = 0; i < count; i++) {
+        send_request (t, "bench");
+        recv_response (t);
+    }
+    rtt_us = monotime_since (t0) * 1000 / count;
+
+    monotime (&t0);
+    for (i = 0; i < count; i++)
+        send_request (t, "bench");
+    for (i = 0; i < count; i++)
+        recv_response (t);
+    batch_us = monotime_since (t0) * 1000 / count;
+
+    send_request (t, "stop");
+    if ((e = pthread_join (thread, NULL)) != 0)
+        log_errn_exit (e, "pthread_join");
+    printf ("%-10s %12.3f %12.3f\n", t->name, rtt_us, batch_us);
+}
+
+int main (int argc, char *argv[])
+{
+    struct transport shmem = {
+        .name = "shmem",
+        .send = shmem_send,
+        .recv = shmem_recv,
+    };
+    struct transport pipe = {
+        .name = "modpipe",
+        .send = modpipe_bench_send,
+        .recv = modpipe_bench_recv,
+    };
+    int count = 100000;
+
+    log_init ("modpipebench");
+    if (argc > 2) {
+        fprintf (stderr, "Usage: modpipebench [count]\n");
+        exit (1);
+    }
+    if (argc == 2)
+        count = strtoul (argv[1], NULL, 10);
+    if (count <= 0)
+        log_msg_exit ("count must be positive");
+
+    (void)setenv ("FLUX_CONNECTOR_PATH",
+                  flux_conf_get ("connector_path", CONF_FLAG_INTREE), 0);
+    if (!(shmem.h_broker = flux_open ("shmem://modpipebench&bind", 0)))
+        log_err_exit ("flux_open shmem://modpipebench&bind");
+    if (!(shmem.h = flux_open ("shmem://modpipebench&connect", 0)))
+        log_err_exit ("flux_open shmem://modpipebench&connect");
+    if (!(pipe.mp = modpipe_create ()))
+        log_err_exit ("modpipe_create");
+    if (!(pipe.h = modpipe_open (pipe.mp, 0)))
+        log_err_exit ("modpipe_open");
+
+    printf ("%-10s %12s %12s\n", "transport", "rtt(us)", "batch(us)");
+    bench (&shmem, count);
+    bench (&pipe, count);
+
+    flux_close (shmem.h);
+    flux_close (shmem.h_broker);
+    flux_close (pipe.h);
+    modpipe_destroy (pipe.mp);
+    log_fini ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
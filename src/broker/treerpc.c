@@ -0,0 +1,578 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* treerpc.c - fan out multi-rank RPCs over the overlay
+ *
+ * A <service>.mrpc request names a topic, an optional payload, and a
+ * nodeset.  Each broker sends the request on to the target service if its
+ * own rank is in the nodeset, and forwards a <service>.mrpc request naming
+ * the rest of each child's subtree to that child.  The responses of this
+ * rank and of each subtree are gathered with flux_reduce, and once every
+ * target in the subtree has been heard from, returned as one response.
+ * A request to N ranks thus costs each broker a message per child rather
+ * than costing the sender and rank 0 a message per target.
+ *
+ * Requests are sent on behalf of the original requestor:  they carry its
+ * credentials, which the target services check as usual.
+ *
+ * Only services that answer each request with exactly one response may
+ * be called this way.  Payloads travel as JSON strings, so the request
+ * payload and each response payload must be JSON:  a target that responds
+ * with a raw payload is reported as having failed with EPROTO.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <czmq.h>
+#include <jansson.h>
+#include <flux/core.h>
+
+#include "src/common/libutil/nodeset.h"
+#include "src/common/libutil/kary.h"
+
+#include "treerpc.h"
+
+struct treerpc_ctx {
+    flux_t *h;
+    char *topic;                /* <service>.mrpc */
+    uint32_t rank;
+    uint32_t size;
+    int k;
+    flux_msg_handler_t *mh;
+    zlist_t *pending;           /* struct treerpc awaiting responses */
+};
+
+/* A request being fanned out from this rank.
+ */
+struct treerpc {
+    struct treerpc_ctx *ctx;
+    flux_msg_t *request;        /* request to answer, NULL if none wanted */
+    flux_reduce_t *reduce;      /* gathers arrays of responses */
+    zlist_t *subreqs;           /* struct subreq in flight */
+    bool done;
+};
+
+/* A request sent to the target service on this rank, or forwarded to
+ * a child for the ranks in its subtree.
+ */
+struct subreq {
+    struct treerpc *t;
+    flux_future_t *f;
+    uint32_t rank;
+    nodeset_t *ns;              /* child: target ranks, NULL if local */
+};
+
+static void subreq_destroy (struct subreq *sr)
+{
+    if (sr) {
+        flux_future_destroy (sr->f);
+        if (sr->ns)
+            nodeset_destroy (sr->ns);
+        free (sr);
+    }
+}
+
+static void treerpc_destroy (struct treerpc *t)
+{
+    if (t) {
+        int saved_errno = errno;
+        if (t->subreqs) {
+            struct subreq *sr;
+            while ((sr = zlist_pop (t->subreqs)))
+                subreq_destroy (sr);
+            zlist_destroy (&t->subreqs);
+        }
+        flux_reduce_destroy (t->reduce);
+        flux_msg_destroy (t->request);
+        free (t);
+        errno = saved_errno;
+    }
+}
+
+/* Merge the arrays of responses gathered so far.
+ */
+static void reduce_cb (flux_reduce_t *r, int batchnum, void *arg)
+{
+    struct treerpc *t = arg;
+    json_t *merged;
+    json_t *item;
+
+    if (!(merged = json_array ())) {
+        flux_log (t->ctx->h, LOG_ERR, "treerpc: out of memory");
+        return;
+    }
+    while ((item = flux_reduce_pop (r))) {
+        if (json_array_extend (merged, item) < 0)
+            flux_log (t->ctx->h, LOG_ERR, "treerpc: out of memory");
+        json_decref (item);
+    }
+    if (flux_reduce_push (r, merged) < 0) {
+        flux_log (t->ctx->h, LOG_ERR, "treerpc: out of memory");
+        json_decref (merged);
+    }
+}
+
+/* Every target has been heard from:  answer the request.
+ * Called as both the sink (rank 0) and forward (other ranks) operation.
+ */
+static void respond_cb (flux_reduce_t *r, int batchnum, void *arg)
+{
+    struct treerpc *t = arg;
+    json_t *responses = flux_reduce_pop (r);
+
+    if (flux_respond_pack (t->ctx->h, t->request, "{s:o}",
+                           "responses", responses) < 0)
+        flux_log_error (t->ctx->h, "treerpc: flux_respond_pack");
+    t->done = true;
+}
+
+static int itemweight_cb (void *item)
+{
+    return json_array_size (item);
+}
+
+static void item_destroy (void *item)
+{
+    json_decref (item);
+}
+
+static struct flux_reduce_ops reduce_ops = {
+    .destroy = item_destroy,
+    .reduce = reduce_cb,
+    .sink = respond_cb,
+    .forward = respond_cb,
+    .itemweight = itemweight_cb,
+};
+
+static struct treerpc *treerpc_create (struct treerpc_ctx *ctx,
+                                       const flux_msg_t *request,
+                                       unsigned int count)
+{
+    struct treerpc *t;
+
+    if (!(t = calloc (1, sizeof (*t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    t->ctx = ctx;
+    if (!(t->subreqs = zlist_new ())) {
+        errno = ENOMEM;
+        goto error;
+    }
+    if (request) {
+        if (!(t->request = flux_msg_copy (request, false)))
+            goto error;
+        if (!(t->reduce = flux_reduce_create (ctx->h, reduce_ops, 0., t,
+                                              FLUX_REDUCE_HWMFLUSH)))
+            goto error;
+        if (flux_reduce_opt_set (t->reduce, FLUX_REDUCE_OPT_HWM,
+                                 &count, sizeof (count)) < 0)
+            goto error;
+    }
+    return t;
+error:
+    treerpc_destroy (t);
+    return NULL;
+}
+
+/* Append an array of responses.  The request is answered from within
+ * flux_reduce_append() once the last one is in.
+ */
+static void treerpc_append (struct treerpc *t, json_t *responses)
+{
+    if (!responses) {
+        flux_log (t->ctx->h, LOG_ERR, "treerpc: out of memory");
+        return;
+    }
+    if (flux_reduce_append (t->reduce, responses, 0) < 0) {
+        flux_log_error (t->ctx->h, "treerpc: flux_reduce_append");
+        json_decref (responses);
+    }
+}
+
+static json_t *response_encode (uint32_t rank, int errnum,
+                                const char *json_str)
+{
+    json_t *o;
+
+    if (!(o = json_pack ("{s:i s:i}", "rank", rank, "errnum", errnum)))
+        return NULL;
+    if (json_str && json_object_set_new (o, "payload",
+                                         json_string (json_str)) < 0) {
+        json_decref (o);
+        return NULL;
+    }
+    return o;
+}
+
+/* Encode the same error for every rank in 'ns'.
+ */
+static json_t *error_encode (nodeset_t *ns, int errnum)
+{
+    nodeset_iterator_t *itr;
+    json_t *responses;
+    uint32_t rank;
+
+    if (!(responses = json_array ()))
+        return NULL;
+    if (!(itr = nodeset_iterator_create (ns)))
+        goto error;
+    while ((rank = nodeset_next (itr)) != NODESET_EOF) {
+        if (json_array_append_new (responses,
+                                   response_encode (rank, errnum, NULL)) < 0)
+            goto error;
+    }
+    nodeset_iterator_destroy (itr);
+    return responses;
+error:
+    if (itr)
+        nodeset_iterator_destroy (itr);
+    json_decref (responses);
+    return NULL;
+}
+
+/* A subrequest has been answered:  destroy it, and the whole request too
+ * if that was the last response needed.
+ */
+static void subreq_done (struct subreq *sr)
+{
+    struct treerpc *t = sr->t;
+    struct treerpc_ctx *ctx = t->ctx;
+
+    zlist_remove (t->subreqs, sr);
+    subreq_destroy (sr);
+    if (t->done) {
+        zlist_remove (ctx->pending, t);
+        treerpc_destroy (t);
+    }
+}
+
+static void local_continuation (flux_future_t *f, void *arg)
+{
+    struct subreq *sr = arg;
+    const char *json_str = NULL;
+    int errnum = 0;
+    json_t *responses;
+
+    /* flux_rpc_get() fails with EPROTO on a raw response payload,
+     * which is passed on as this rank's error.
+     */
+    if (flux_rpc_get (f, &json_str) < 0)
+        errnum = errno;
+    if ((responses = json_array ()))
+        json_array_append_new (responses,
+                               response_encode (sr->rank, errnum, json_str));
+    treerpc_append (sr->t, responses);
+    subreq_done (sr);
+}
+
+static void child_continuation (flux_future_t *f, void *arg)
+{
+    struct subreq *sr = arg;
+    json_t *responses;
+
+    if (flux_rpc_get_unpack (f, "{s:o}", "responses", &responses) < 0)
+        responses = error_encode (sr->ns, errno);
+    else if (!json_is_array (responses))
+        responses = error_encode (sr->ns, EPROTO);
+    else
+        responses = json_copy (responses);
+    treerpc_append (sr->t, responses);
+    subreq_done (sr);
+}
+
+/* Send a request on behalf of the requestor of 'orig'.
+ */
+static flux_future_t *send_request (struct treerpc_ctx *ctx,
+                                    const flux_msg_t *orig,
+                                    const char *topic, const char *json_str,
+                                    uint32_t nodeid, int flags)
+{
+    flux_msg_t *msg;
+    uint32_t userid, rolemask;
+    flux_future_t *f = NULL;
+
+    if (!(msg = flux_request_encode (topic, json_str)))
+        return NULL;
+    if (flux_msg_get_userid (orig, &userid) < 0
+            || flux_msg_get_rolemask (orig, &rolemask) < 0
+            || flux_msg_set_userid (msg, userid) < 0
+            || flux_msg_set_rolemask (msg, rolemask) < 0)
+        goto done;
+    f = flux_rpc_message (ctx->h, msg, nodeid, flags);
+done:
+    flux_msg_destroy (msg);
+    return f;
+}
+
+static int subreq_send (struct treerpc *t, const flux_msg_t *orig,
+                        const char *topic, const char *json_str,
+                        uint32_t nodeid, nodeset_t *ns, int flags)
+{
+    struct subreq *sr;
+
+    if (!(sr = calloc (1, sizeof (*sr)))) {
+        errno = ENOMEM;
+        goto error;
+    }
+    sr->t = t;
+    sr->rank = nodeid;
+    sr->ns = ns;
+    if (!(sr->f = send_request (t->ctx, orig, topic, json_str, nodeid, flags)))
+        goto error;
+    if (!(flags & FLUX_RPC_NORESPONSE)) {
+        if (flux_future_then (sr->f, -1., ns ? child_continuation
+                                             : local_continuation, sr) < 0)
+            goto error;
+        if (zlist_append (t->subreqs, sr) < 0) {
+            errno = ENOMEM;
+            goto error;
+        }
+    }
+    else
+        subreq_destroy (sr);
+    return 0;
+error:
+    if (sr)
+        sr->ns = NULL; /* still owned by the caller */
+    subreq_destroy (sr);
+    return -1;
+}
+
+static char *forward_encode (const char *topic, nodeset_t *ns,
+                             const char *payload, bool noresponse)
+{
+    json_t *o;
+    char *s = NULL;
+
+    if (!(o = json_pack ("{s:s s:s s:b}", "topic", topic,
+                                          "nodeset", nodeset_string (ns),
+                                          "noresponse", noresponse)))
+        goto done;
+    if (payload && json_object_set_new (o, "payload",
+                                        json_string (payload)) < 0)
+        goto done;
+    s = json_dumps (o, JSON_COMPACT);
+done:
+    json_decref (o);
+    if (!s)
+        errno = ENOMEM;
+    return s;
+}
+
+/* Sort the target ranks into this rank, each child's subtree, and ranks
+ * that can't be reached from here, then send the requests.
+ */
+static struct treerpc *treerpc_fanout (struct treerpc_ctx *ctx,
+                                       const flux_msg_t *msg,
+                                       const char *topic,
+                                       const char *payload,
+                                       nodeset_t *ns,
+                                       bool noresponse)
+{
+    struct treerpc *t = NULL;
+    nodeset_t **sub;
+    nodeset_t *unreachable = NULL;
+    nodeset_iterator_t *itr = NULL;
+    bool local = false;
+    int flags = noresponse ? FLUX_RPC_NORESPONSE : 0;
+    uint32_t rank, child;
+    char *s;
+    int i;
+
+    if (!(sub = calloc (ctx->k, sizeof (sub[0])))
+            || !(unreachable = nodeset_create ())
+            || !(itr = nodeset_iterator_create (ns))) {
+        errno = ENOMEM;
+        goto error;
+    }
+    while ((rank = nodeset_next (itr)) != NODESET_EOF) {
+        if (rank == ctx->rank) {
+            local = true;
+            continue;
+        }
+        child = KARY_NONE;
+        if (rank < ctx->size)
+            child = kary_child_route (ctx->k, ctx->size, ctx->rank, rank);
+        for (i = 0; i < ctx->k && child != KARY_NONE; i++) {
+            if (kary_childof (ctx->k, ctx->size, ctx->rank, i) == child)
+                break;
+        }
+        if (child == KARY_NONE || i == ctx->k) {
+            nodeset_add_rank (unreachable, rank);
+            continue;
+        }
+        if (!sub[i] && !(sub[i] = nodeset_create ())) {
+            errno = ENOMEM;
+            goto error;
+        }
+        nodeset_add_rank (sub[i], rank);
+    }
+    if (!(t = treerpc_create (ctx, noresponse ? NULL : msg,
+                              nodeset_count (ns))))
+        goto error;
+    if (local) {
+        if (subreq_send (t, msg, topic, payload, ctx->rank, NULL, flags) < 0)
+            goto error;
+    }
+    for (i = 0; i < ctx->k; i++) {
+        if (!sub[i])
+            continue;
+        if (!(s = forward_encode (topic, sub[i], payload, noresponse)))
+            goto error;
+        child = kary_childof (ctx->k, ctx->size, ctx->rank, i);
+        if (subreq_send (t, msg, ctx->topic, s, child,
+                         noresponse ? NULL : sub[i], flags) < 0) {
+            free (s);
+            goto error;
+        }
+        free (s);
+        if (!noresponse)
+            sub[i] = NULL; /* now owned by subreq */
+    }
+    if (!noresponse && nodeset_count (unreachable) > 0)
+        treerpc_append (t, error_encode (unreachable, EHOSTUNREACH));
+    nodeset_iterator_destroy (itr);
+    nodeset_destroy (unreachable);
+    for (i = 0; i < ctx->k; i++)
+        if (sub[i])
+            nodeset_destroy (sub[i]);
+    free (sub);
+    return t;
+error:
+    treerpc_destroy (t);
+    if (itr)
+        nodeset_iterator_destroy (itr);
+    if (unreachable)
+        nodeset_destroy (unreachable);
+    if (sub) {
+        for (i = 0; i < ctx->k; i++)
+            if (sub[i])
+                nodeset_destroy (sub[i]);
+        free (sub);
+    }
+    return NULL;
+}
+
+static void treerpc_request_cb (flux_t *h, flux_msg_handler_t *mh,
+                                const flux_msg_t *msg, void *arg)
+{
+    struct treerpc_ctx *ctx = arg;
+    const char *topic;
+    const char *nodeset;
+    const char *payload = NULL;
+    int noresponse = 0;
+    nodeset_t *ns = NULL;
+    struct treerpc *t;
+
+    if (flux_request_unpack (msg, NULL, "{s:s s:s s?s s?b}",
+                             "topic", &topic,
+                             "nodeset", &nodeset,
+                             "payload", &payload,
+                             "noresponse", &noresponse) < 0)
+        goto error;
+    if (!(ns = nodeset_create_string (nodeset))
+            || nodeset_count (ns) == 0) {
+        errno = EINVAL;
+        goto error;
+    }
+    if (!(t = treerpc_fanout (ctx, msg, topic, payload, ns, noresponse)))
+        goto error;
+    if (noresponse || t->done)
+        treerpc_destroy (t);
+    else if (zlist_append (ctx->pending, t) < 0) {
+        treerpc_destroy (t);
+        errno = ENOMEM;
+        goto error;
+    }
+    nodeset_destroy (ns);
+    return;
+error:
+    if (!noresponse && flux_respond (h, msg, errno, NULL) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+    if (ns)
+        nodeset_destroy (ns);
+}
+
+static void treerpc_finalize (void *arg)
+{
+    struct treerpc_ctx *ctx = arg;
+
+    if (ctx) {
+        if (ctx->pending) {
+            struct treerpc *t;
+            while ((t = zlist_pop (ctx->pending)))
+                treerpc_destroy (t);
+            zlist_destroy (&ctx->pending);
+        }
+        flux_msg_handler_destroy (ctx->mh);
+        free (ctx->topic);
+        free (ctx);
+    }
+}
+
+int treerpc_initialize (flux_t *h, const char *service, int tbon_k)
+{
+    struct flux_match match = FLUX_MATCH_REQUEST;
+    struct treerpc_ctx *ctx;
+
+    if (!(ctx = calloc (1, sizeof (*ctx)))) {
+        errno = ENOMEM;
+        goto error;
+    }
+    ctx->h = h;
+    ctx->k = tbon_k;
+    if (flux_get_rank (h, &ctx->rank) < 0
+            || flux_get_size (h, &ctx->size) < 0)
+        goto error;
+    if (!(ctx->pending = zlist_new ())) {
+        errno = ENOMEM;
+        goto error;
+    }
+    if (asprintf (&ctx->topic, "%s.mrpc", service) < 0) {
+        errno = ENOMEM;
+        goto error;
+    }
+    match.topic_glob = ctx->topic;
+    if (!(ctx->mh = flux_msg_handler_create (h, match, treerpc_request_cb,
+                                             ctx)))
+        goto error;
+    flux_msg_handler_allow_rolemask (ctx->mh, FLUX_ROLE_ALL);
+    flux_msg_handler_start (ctx->mh);
+    flux_aux_set (h, "flux::treerpc", ctx, treerpc_finalize);
+    return 0;
+error:
+    treerpc_finalize (ctx);
+    return -1;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,16 @@
+#ifndef _BROKER_TREERPC_H
+#define _BROKER_TREERPC_H
+
+#include <flux/core.h>
+
+/* Register the <service>.mrpc handler, which fans a request out to the
+ * ranks in a nodeset over the k-ary overlay and gathers their responses
+ * (see FLUX_RPC_TREE in flux_mrpc(3)).
+ */
+int treerpc_initialize (flux_t *h, const char *service, int tbon_k);
+
+#endif /* !_BROKER_TREERPC_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -24,6 +24,7 @@
 #include "builtin.h"
 
 #include <unistd.h>
+#include <jansson.h>
 
 #include "src/common/libutil/blobref.h"
 #include "src/common/libutil/read_all.h"
@@ -59,6 +60,44 @@ static int internal_content_load (optparse_t *p, int ac, char *av[])
     return (0);
 }
 
+static int internal_content_load_batch (optparse_t *p, int ac, char *av[])
+{
+    int n;
+    const uint8_t *data;
+    int size;
+    flux_t *h;
+    flux_future_t *f;
+    int flags = 0;
+    int i;
+    int errors = 0;
+
+    n = optparse_option_index (p);
+    if (n == ac) {
+        optparse_print_usage (p);
+        exit (1);
+    }
+    if (!(h = builtin_get_flux_handle (p)))
+        log_err_exit ("flux_open");
+    if (optparse_hasopt (p, "bypass-cache"))
+        flags |= CONTENT_FLAG_CACHE_BYPASS;
+    if (!(f = flux_content_load_batch (h, (const char **)&av[n], ac - n,
+                                       flags)))
+        log_err_exit ("flux_content_load_batch");
+    for (i = 0; i < ac - n; i++) {
+        if (flux_content_load_batch_get (f, i, (const void **)&data,
+                                         &size) < 0) {
+            log_err ("%s", av[n + i]);
+            errors++;
+            continue;
+        }
+        if (write_all (STDOUT_FILENO, data, size) < 0)
+            log_err_exit ("write");
+    }
+    flux_future_destroy (f);
+    flux_close (h);
+    return (errors > 0 ? 1 : 0);
+}
+
 static int internal_content_store (optparse_t *p, int ac, char *av[])
 {
     uint8_t *data;
@@ -129,9 +168,100 @@ static int internal_content_dropcache (optparse_t *p, int ac, char *av[])
     return (0);
 }
 
+static int internal_content_compact (optparse_t *p, int ac, char *av[])
+{
+    flux_t *h;
+    flux_future_t *f = NULL;
+    int n = optparse_option_index (p);
+    json_t *roots;
+    int live, freed;
+    json_int_t freed_bytes;
+
+    if (n == ac) {
+        optparse_print_usage (p);
+        exit (1);
+    }
+    if (!(roots = json_array ()))
+        log_msg_exit ("out of memory");
+    for (; n < ac; n++) {
+        json_t *o;
+        if (blobref_validate (av[n]) < 0)
+            log_msg_exit ("%s: invalid blobref", av[n]);
+        if (!(o = json_string (av[n])) || json_array_append_new (roots, o) < 0)
+            log_msg_exit ("out of memory");
+    }
+    if (!(h = builtin_get_flux_handle (p)))
+        log_err_exit ("flux_open");
+    if (!(f = flux_rpc_pack (h, "content-backing.compact", 0, 0,
+                             "{s:O}", "roots", roots)))
+        log_err_exit ("content-backing.compact");
+    if (flux_rpc_get_unpack (f, "{s:i s:i s:I}",
+                             "live", &live,
+                             "freed", &freed,
+                             "freed-bytes", &freed_bytes) < 0)
+        log_err_exit ("content-backing.compact");
+    printf ("%d live, %d freed (%jd bytes)\n", live, freed,
+            (intmax_t)freed_bytes);
+    json_decref (roots);
+    flux_future_destroy (f);
+    flux_close (h);
+    return (0);
+}
+
 static int spam_max_inflight;
 static int spam_cur_inflight;
 
+static void store_batch_completion (flux_future_t *f, void *arg)
+{
+    flux_t *h = arg;
+    int *count = flux_future_aux_get (f, "count");
+    const char *blobref;
+    int i;
+
+    for (i = 0; i < *count; i++) {
+        if (flux_content_store_batch_get (f, i, &blobref) < 0)
+            log_err_exit ("store");
+        printf ("%s\n", blobref);
+    }
+    flux_future_destroy (f);
+    if (--spam_cur_inflight < spam_max_inflight/2)
+        flux_reactor_stop (flux_get_reactor (h));
+}
+
+/* Send blobs [first, first+count) in one store-batch request.
+ */
+static flux_future_t *spam_store_batch (flux_t *h, int first, int count)
+{
+    int size = 256;
+    char *data;
+    const void **bufs;
+    int *lens;
+    int *n;
+    flux_future_t *f;
+    int i;
+
+    if (!(data = calloc (count, size))
+            || !(bufs = calloc (count, sizeof (bufs[0])))
+            || !(lens = calloc (count, sizeof (lens[0])))
+            || !(n = malloc (sizeof (*n))))
+        log_msg_exit ("out of memory");
+    for (i = 0; i < count; i++) {
+        snprintf (data + i * size, size, "spam-o-matic pid=%d seq=%d",
+                  getpid(), first + i);
+        bufs[i] = data + i * size;
+        lens[i] = size;
+    }
+    if (!(f = flux_content_store_batch (h, bufs, lens, count, 0)))
+        log_err_exit ("flux_content_store_batch(%d)", first);
+    *n = count;
+    if (flux_future_aux_set (f, "count", n, free) < 0)
+        log_err_exit ("flux_future_aux_set");
+    free (data);
+    free (bufs);
+    free (lens);
+    return f;
+}
+
 static void store_completion (flux_future_t *f, void *arg)
 {
     flux_t *h = arg;
@@ -152,16 +282,19 @@ static int internal_content_spam (optparse_t *p, int ac, char *av[])
     flux_t *h;
     char data[256];
     int size = 256;
+    int n = optparse_option_index (p);
+    int batch;
 
-    if (ac != 2 && ac != 3) {
+    if (ac - n != 1 && ac - n != 2) {
         optparse_print_usage (p);
         exit (1);
     }
-    count = strtoul (av[1], NULL, 10);
-    if (ac == 3)
-        spam_max_inflight = strtoul (av[2], NULL, 10);
+    count = strtoul (av[n], NULL, 10);
+    if (ac - n == 2)
+        spam_max_inflight = strtoul (av[n + 1], NULL, 10);
     else
         spam_max_inflight = 1;
+    batch = optparse_get_int (p, "batch", 0);
 
     if (!(h = builtin_get_flux_handle (p)))
         log_err_exit ("flux_open");
@@ -170,6 +303,15 @@ static int internal_content_spam (optparse_t *p, int ac, char *av[])
     i = 0;
     while (i < count || spam_cur_inflight > 0) {
         while (i < count && spam_cur_inflight < spam_max_inflight) {
+            if (batch > 0) {
+                int nb = count - i < batch ? count - i : batch;
+                f = spam_store_batch (h, i, nb);
+                if (flux_future_then (f, -1., store_batch_completion, h) < 0)
+                    log_err_exit ("flux_future_then(%d)", i);
+                spam_cur_inflight++;
+                i += nb;
+                continue;
+            }
             snprintf (data, size, "spam-o-matic pid=%d seq=%d", getpid(), i);
             if (!(f = flux_content_store (h, data, size, 0)))
                 log_err_exit ("flux_content_store(%d)", i);
@@ -199,6 +341,12 @@ static struct optparse_option load_opts[] = {
     OPTPARSE_TABLE_END,
 };
 
+static struct optparse_option spam_opts[] = {
+    { .name = "batch",  .key = 'B',  .has_arg = 1, .arginfo = "N",
+      .usage = "Store N entries per content.store-batch request", },
+    OPTPARSE_TABLE_END,
+};
+
 static struct optparse_option store_opts[] = {
     { .name = "bypass-cache",  .key = 'b',  .has_arg = 0,
       .usage = "Store directly to rank 0 content service", },
@@ -213,6 +361,13 @@ static struct optparse_subcommand content_subcmds[] = {
       0,
       load_opts,
     },
+    { "load-batch",
+      "[OPTIONS] BLOBREF...",
+      "Load blobs for digests BLOBREF... in one request to stdout",
+      internal_content_load_batch,
+      0,
+      load_opts,
+    },
     { "store",
       "[OPTIONS]",
       "Store blob from stdin, print BLOBREF on stdout",
@@ -234,12 +389,19 @@ static struct optparse_subcommand content_subcmds[] = {
       0,
       NULL,
     },
+    { "compact",
+      "BLOBREF...",
+      "Discard blobs not reachable from root BLOBREFs from backing store",
+      internal_content_compact,
+      0,
+      NULL,
+    },
     { "spam",
-      "N [M]",
+      "[OPTIONS] N [M]",
       "Store N random entries, keeping M requests in flight (default 1)",
       internal_content_spam,
       0,
-      NULL,
+      spam_opts,
     },
     OPTPARSE_SUBCMD_END
 };
@@ -79,9 +79,8 @@ typedef struct {
     int wfd;
     flux_watcher_t *inw;
     flux_watcher_t *outw;
-    struct flux_msg_iobuf inbuf;
-    struct flux_msg_iobuf outbuf;
-    zlist_t *outqueue;  /* queue of outbound flux_msg_t */
+    flux_msg_reader_t *reader;
+    flux_msg_writer_t *writer;  /* queue of outbound messages */
     proxy_ctx_t *ctx;
     zhash_t *disconnect_notify;
     zhash_t *subscriptions;
@@ -165,7 +164,8 @@ static client_t * client_create (proxy_ctx_t *ctx, int rfd, int wfd)
         oom ();
     if (!(c->subscriptions = zhash_new ()))
         oom ();
-    if (!(c->outqueue = zlist_new ()))
+    if (!(c->reader = flux_msg_reader_create (c->rfd))
+                    || !(c->writer = flux_msg_writer_create (c->wfd)))
         oom ();
     c->inw = flux_fd_watcher_create (ctx->reactor, c->rfd,
                                      FLUX_POLLIN, client_read_cb, c);
@@ -176,8 +176,6 @@ static client_t * client_create (proxy_ctx_t *ctx, int rfd, int wfd)
         goto error;
     }
     flux_watcher_start (c->inw);
-    flux_msg_iobuf_init (&c->inbuf);
-    flux_msg_iobuf_init (&c->outbuf);
     if (set_nonblock (c->rfd, true) < 0) {
         flux_log_error (h, "set_nonblock");
         goto error;
@@ -193,47 +191,39 @@ error:
     return NULL;
 }
 
+/* Write as much of the outbound queue as the client will take
+ * with one writev().
+ */
 static int client_send_try (client_t *c)
 {
-    flux_msg_t *msg = zlist_head (c->outqueue);
-
-    if (msg) {
-        if (flux_msg_sendfd (c->wfd, msg, &c->outbuf) < 0) {
-            if (errno != EWOULDBLOCK && errno != EAGAIN)
-                return -1;
-            //flux_log (c->ctx->h, LOG_DEBUG, "send: client not ready");
-            flux_watcher_start (c->outw);
-            errno = 0;
-        } else {
-            msg = zlist_pop (c->outqueue);
-            flux_msg_destroy (msg);
-        }
+    if (flux_msg_writer_flush (c->writer) < 0) {
+        if (errno != EWOULDBLOCK && errno != EAGAIN)
+            return -1;
+        //flux_log (c->ctx->h, LOG_DEBUG, "send: client not ready");
+        errno = 0;
     }
     return 0;
 }
 
-static int client_send_nocopy (client_t *c, flux_msg_t **msg)
+/* Queue message and let client_write_cb() send it when the fd is
+ * writable, so that messages queued in the same reactor loop iteration
+ * go out together.  The message is encoded when queued.
+ */
+static int client_send (client_t *c, const flux_msg_t *msg)
 {
-    if (zlist_append (c->outqueue, *msg) < 0) {
-        errno = ENOMEM;
+    if (flux_msg_writer_push (c->writer, msg) < 0)
         return -1;
-    }
-    *msg = NULL;
-    return client_send_try (c);
+    flux_watcher_start (c->outw);
+    return 0;
 }
 
-static int client_send (client_t *c, const flux_msg_t *msg)
+static int client_send_nocopy (client_t *c, flux_msg_t **msg)
 {
-    flux_msg_t *cpy = flux_msg_copy (msg, true);
-    int rc;
-
-    if (!cpy) {
-        errno = ENOMEM;
+    if (client_send (c, *msg) < 0)
         return -1;
-    }
-    rc = client_send_nocopy (c, &cpy);
-    flux_msg_destroy (cpy);
-    return rc;
+    flux_msg_destroy (*msg);
+    *msg = NULL;
+    return 0;
 }
 
 static subscription_t *subscription_create (const char *topic)
@@ -445,19 +435,13 @@ static void client_destroy (client_t *c)
     zhash_destroy (&c->subscriptions);
     if (c->uuid)
         zuuid_destroy (&c->uuid);
-    if (c->outqueue) {
-        flux_msg_t *msg;
-        while ((msg = zlist_pop (c->outqueue)))
-            flux_msg_destroy (msg);
-        zlist_destroy (&c->outqueue);
-    }
     flux_watcher_stop (c->outw);
     flux_watcher_destroy (c->outw);
-    flux_msg_iobuf_clean (&c->outbuf);
+    flux_msg_writer_destroy (c->writer);
 
     flux_watcher_stop (c->inw);
     flux_watcher_destroy (c->inw);
-    flux_msg_iobuf_clean (&c->inbuf);
+    flux_msg_reader_destroy (c->reader);
 
     if (c->rfd != -1)
         close (c->rfd);
@@ -480,7 +464,7 @@ static void client_write_cb (flux_reactor_t *r, flux_watcher_t *w,
             goto disconnect;
         //flux_log (h, LOG_DEBUG, "send: client ready");
     }
-    if (zlist_size (c->outqueue) == 0)
+    if (flux_msg_writer_count (c->writer) == 0)
         flux_watcher_stop (w);
     return;
 disconnect:
@@ -520,35 +504,17 @@ static bool internal_request (client_t *c, const flux_msg_t *msg)
     return true;
 }
 
-static void client_read_cb (flux_reactor_t *r, flux_watcher_t *w,
-                            int revents, void *arg)
+/* Handle one message received from client.
+ * Returns -1 if the client should be disconnected.
+ */
+static int client_recv_msg (client_t *c, flux_msg_t *msg)
 {
-    client_t *c = arg;
-    proxy_ctx_t *ctx = c->ctx;
-    flux_t *h = ctx->h;
-    flux_msg_t *msg = NULL;
+    flux_t *h = c->ctx->h;
     int type;
 
-    if (revents & FLUX_POLLERR)
-        goto disconnect;
-    if (!(revents & FLUX_POLLIN))
-        return;
-    /* EPROTO, ECONNRESET are normal disconnect errors
-     * EWOULDBLOCK, EAGAIN stores state in c->inbuf for continuation
-     */
-    //flux_log (h, LOG_DEBUG, "recv: client ready");
-    if (!(msg = flux_msg_recvfd (c->rfd, &c->inbuf))) {
-        if (errno == EWOULDBLOCK || errno == EAGAIN) {
-            //flux_log (h, LOG_DEBUG, "recv: client not ready");
-            return;
-        }
-        if (errno != ECONNRESET && errno != EPROTO)
-            flux_log_error (h, "flux_msg_recvfd");
-        goto disconnect;
-    }
     if (flux_msg_get_type (msg, &type) < 0) {
         flux_log_error (h, "flux_msg_get_type");
-        goto disconnect;
+        return -1;
     }
     switch (type) {
         case FLUX_MSGTYPE_REQUEST:
@@ -556,7 +522,7 @@ static void client_read_cb (flux_reactor_t *r, flux_watcher_t *w,
                 /* insert disconnect notifier before forwarding request */
                 if (c->disconnect_notify && disconnect_update (c, msg) < 0) {
                     flux_log_error (h, "disconnect_update");
-                    goto disconnect;
+                    return -1;
                 }
                 if (flux_msg_push_route (msg, zuuid_str (c->uuid)) < 0)
                     oom (); /* FIXME */
@@ -573,10 +539,45 @@ static void client_read_cb (flux_reactor_t *r, flux_watcher_t *w,
                       flux_msg_typestr (type));
             break;
     }
-    flux_msg_destroy (msg);
+    return 0;
+}
+
+static void client_read_cb (flux_reactor_t *r, flux_watcher_t *w,
+                            int revents, void *arg)
+{
+    client_t *c = arg;
+    proxy_ctx_t *ctx = c->ctx;
+    flux_t *h = ctx->h;
+    flux_msg_t *msg;
+    int rc;
+
+    if (revents & FLUX_POLLERR)
+        goto disconnect;
+    if (!(revents & FLUX_POLLIN))
+        return;
+    /* EPROTO, ECONNRESET are normal disconnect errors
+     * EWOULDBLOCK, EAGAIN leaves partial message in c->reader for
+     * continuation.  One read may buffer several messages, and the fd
+     * won't become readable again for those, so handle them all here.
+     */
+    //flux_log (h, LOG_DEBUG, "recv: client ready");
+    do {
+        if (!(msg = flux_msg_reader_recv (c->reader))) {
+            if (errno == EWOULDBLOCK || errno == EAGAIN) {
+                //flux_log (h, LOG_DEBUG, "recv: client not ready");
+                return;
+            }
+            if (errno != ECONNRESET && errno != EPROTO)
+                flux_log_error (h, "flux_msg_reader_recv");
+            goto disconnect;
+        }
+        rc = client_recv_msg (c, msg);
+        flux_msg_destroy (msg);
+        if (rc < 0)
+            goto disconnect;
+    } while (flux_msg_reader_pending (c->reader));
     return;
 disconnect:
-    flux_msg_destroy (msg);
     zlist_remove (ctx->clients, c);
     client_destroy (c);
     if (ctx->oneshot)
@@ -321,7 +321,7 @@ int cmd_load (optparse_t *p, int argc, char **argv)
         log_err_exit ("flux_open");
     if (parse_nodeset (h, p, &ns) < 0)
         goto done;
-    if (!(r = flux_mrpc (h, topic, json_str, ns, 0)))
+    if (!(r = flux_mrpc (h, topic, json_str, ns, FLUX_RPC_TREE)))
         log_err_exit ("%s", topic);
     do {
         if (flux_mrpc_get (r, NULL) < 0) {
@@ -373,7 +373,7 @@ int cmd_remove (optparse_t *p, int argc, char **argv)
         log_err_exit ("flux_open");
     if (parse_nodeset (h, p, &ns) < 0)
         goto done;
-    if (!(r = flux_mrpc (h, topic, json_str, ns, 0)))
+    if (!(r = flux_mrpc (h, topic, json_str, ns, FLUX_RPC_TREE)))
         log_err_exit ("%s %s", topic, modname);
     do {
         if (flux_mrpc_get (r, NULL) < 0) {
@@ -551,7 +551,7 @@ int cmd_list (optparse_t *p, int argc, char **argv)
     printf ("%-20s %-7s %-7s %4s  %c  %s\n",
             "Module", "Size", "Digest", "Idle", 'S', "Nodeset");
     topic = xasprintf ("%s.lsmod", service);
-    if (!(r = flux_mrpc (h, topic, NULL, ns, 0)))
+    if (!(r = flux_mrpc (h, topic, NULL, ns, FLUX_RPC_TREE)))
         log_err_exit ("%s", topic);
     do {
         const char *json_str;
@@ -0,0 +1,488 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* cbor.c - compact binary encoding of JSON message payloads
+ *
+ * Only definite length items are produced or accepted, and integers
+ * and lengths use the shortest form.  Real numbers are encoded as double
+ * precision floats, since that is what jansson stores.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jansson.h>
+
+#include "cbor.h"
+
+enum {
+    MAJOR_UINT = 0,
+    MAJOR_NEGINT = 1,
+    MAJOR_BYTES = 2,
+    MAJOR_TEXT = 3,
+    MAJOR_ARRAY = 4,
+    MAJOR_MAP = 5,
+    MAJOR_TAG = 6,
+    MAJOR_SIMPLE = 7,
+};
+
+enum {
+    SIMPLE_FALSE = 20,
+    SIMPLE_TRUE = 21,
+    SIMPLE_NULL = 22,
+    SIMPLE_FLOAT32 = 26,
+    SIMPLE_FLOAT64 = 27,
+};
+
+/* Same as the jansson parser.
+ */
+static const int max_depth = 2048;
+
+struct obuf {
+    uint8_t *data;
+    size_t len;
+    size_t size;
+};
+
+struct ibuf {
+    const uint8_t *p;
+    const uint8_t *end;
+};
+
+static int obuf_reserve (struct obuf *ob, size_t n)
+{
+    if (ob->len + n > ob->size) {
+        size_t size = ob->size ? ob->size : 256;
+        uint8_t *data;
+
+        while (size < ob->len + n)
+            size *= 2;
+        if (!(data = realloc (ob->data, size))) {
+            errno = ENOMEM;
+            return -1;
+        }
+        ob->data = data;
+        ob->size = size;
+    }
+    return 0;
+}
+
+static void put_uint (uint8_t *p, uint64_t val, int n)
+{
+    while (n-- > 0) {
+        p[n] = val & 0xff;
+        val >>= 8;
+    }
+}
+
+/* Encode initial byte for 'major' type, followed by 'val' in the
+ * shortest form.
+ */
+static int put_head (struct obuf *ob, int major, uint64_t val)
+{
+    uint8_t *p;
+
+    if (obuf_reserve (ob, 9) < 0)
+        return -1;
+    p = ob->data + ob->len;
+    if (val < 24) {
+        *p = (major << 5) | val;
+        ob->len += 1;
+    }
+    else if (val <= 0xff) {
+        *p = (major << 5) | 24;
+        put_uint (p + 1, val, 1);
+        ob->len += 2;
+    }
+    else if (val <= 0xffff) {
+        *p = (major << 5) | 25;
+        put_uint (p + 1, val, 2);
+        ob->len += 3;
+    }
+    else if (val <= 0xffffffff) {
+        *p = (major << 5) | 26;
+        put_uint (p + 1, val, 4);
+        ob->len += 5;
+    }
+    else {
+        *p = (major << 5) | 27;
+        put_uint (p + 1, val, 8);
+        ob->len += 9;
+    }
+    return 0;
+}
+
+static int put_text (struct obuf *ob, const char *s)
+{
+    size_t len = strlen (s);
+
+    if (put_head (ob, MAJOR_TEXT, len) < 0 || obuf_reserve (ob, len) < 0)
+        return -1;
+    memcpy (ob->data + ob->len, s, len);
+    ob->len += len;
+    return 0;
+}
+
+static int put_double (struct obuf *ob, double d)
+{
+    uint64_t val;
+
+    if (obuf_reserve (ob, 9) < 0)
+        return -1;
+    memcpy (&val, &d, sizeof (val));
+    ob->data[ob->len] = (MAJOR_SIMPLE << 5) | SIMPLE_FLOAT64;
+    put_uint (ob->data + ob->len + 1, val, 8);
+    ob->len += 9;
+    return 0;
+}
+
+static int encode_item (struct obuf *ob, json_t *o, int depth)
+{
+    json_int_t i;
+    void *iter;
+    size_t index;
+
+    if (depth > max_depth) {
+        errno = EINVAL;
+        return -1;
+    }
+    switch (json_typeof (o)) {
+        case JSON_OBJECT:
+            if (put_head (ob, MAJOR_MAP, json_object_size (o)) < 0)
+                return -1;
+            iter = json_object_iter (o);
+            while (iter) {
+                if (put_text (ob, json_object_iter_key (iter)) < 0
+                        || encode_item (ob, json_object_iter_value (iter),
+                                        depth + 1) < 0)
+                    return -1;
+                iter = json_object_iter_next (o, iter);
+            }
+            break;
+        case JSON_ARRAY:
+            if (put_head (ob, MAJOR_ARRAY, json_array_size (o)) < 0)
+                return -1;
+            for (index = 0; index < json_array_size (o); index++) {
+                if (encode_item (ob, json_array_get (o, index), depth + 1) < 0)
+                    return -1;
+            }
+            break;
+        case JSON_STRING:
+            if (put_text (ob, json_string_value (o)) < 0)
+                return -1;
+            break;
+        case JSON_INTEGER:
+            i = json_integer_value (o);
+            if (i >= 0) {
+                if (put_head (ob, MAJOR_UINT, i) < 0)
+                    return -1;
+            }
+            else if (put_head (ob, MAJOR_NEGINT, -1 - i) < 0)
+                return -1;
+            break;
+        case JSON_REAL:
+            if (put_double (ob, json_real_value (o)) < 0)
+                return -1;
+            break;
+        case JSON_TRUE:
+            if (put_head (ob, MAJOR_SIMPLE, SIMPLE_TRUE) < 0)
+                return -1;
+            break;
+        case JSON_FALSE:
+            if (put_head (ob, MAJOR_SIMPLE, SIMPLE_FALSE) < 0)
+                return -1;
+            break;
+        case JSON_NULL:
+            if (put_head (ob, MAJOR_SIMPLE, SIMPLE_NULL) < 0)
+                return -1;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+    return 0;
+}
+
+void *cbor_encode (json_t *o, size_t *size)
+{
+    struct obuf ob = { .data = NULL, .len = 0, .size = 0 };
+
+    if (!o || !size) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (encode_item (&ob, o, 0) < 0) {
+        int saved_errno = errno;
+        free (ob.data);
+        errno = saved_errno;
+        return NULL;
+    }
+    *size = ob.len;
+    return ob.data;
+}
+
+/* Decode initial byte and its argument.
+ * For major type 7, 'val' is the simple value or the raw float bits.
+ */
+static int get_head (struct ibuf *ib, int *major, int *info, uint64_t *val)
+{
+    int n;
+
+    if (ib->p >= ib->end)
+        goto eproto;
+    *major = *ib->p >> 5;
+    *info = *ib->p & 0x1f;
+    ib->p++;
+    if (*info < 24) {
+        *val = *info;
+        return 0;
+    }
+    switch (*info) {
+        case 24:
+            n = 1;
+            break;
+        case 25:
+            n = 2;
+            break;
+        case 26:
+            n = 4;
+            break;
+        case 27:
+            n = 8;
+            break;
+        default: /* reserved or indefinite length */
+            goto eproto;
+    }
+    if (ib->end - ib->p < n)
+        goto eproto;
+    *val = 0;
+    while (n-- > 0)
+        *val = (*val << 8) | *ib->p++;
+    return 0;
+eproto:
+    errno = EPROTO;
+    return -1;
+}
+
+/* Copy text string of 'len' bytes to a NUL-terminated string in '*s',
+ * using 'buf' if it is large enough.  If *s != buf, the caller must free it.
+ * jansson cannot represent strings with embedded NULs.
+ */
+static int get_text (struct ibuf *ib, uint64_t len,
+                     char *buf, size_t bufsize, char **s)
+{
+    char *cp;
+
+    if (ib->end - ib->p < len || memchr (ib->p, '\0', len)) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (len < bufsize)
+        cp = buf;
+    else if (!(cp = malloc (len + 1))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy (cp, ib->p, len);
+    cp[len] = '\0';
+    ib->p += len;
+    *s = cp;
+    return 0;
+}
+
+static json_t *decode_item (struct ibuf *ib, int depth);
+
+static json_t *decode_array (struct ibuf *ib, uint64_t count, int depth)
+{
+    json_t *a, *o;
+    uint64_t i;
+
+    if (count > ib->end - ib->p) { /* each item is at least one byte */
+        errno = EPROTO;
+        return NULL;
+    }
+    if (!(a = json_array ()))
+        goto nomem;
+    for (i = 0; i < count; i++) {
+        if (!(o = decode_item (ib, depth + 1)))
+            goto error;
+        if (json_array_append_new (a, o) < 0)
+            goto nomem;
+    }
+    return a;
+nomem:
+    errno = ENOMEM;
+error:
+    json_decref (a);
+    return NULL;
+}
+
+static json_t *decode_map (struct ibuf *ib, uint64_t count, int depth)
+{
+    json_t *obj, *o;
+    char buf[128];
+    char *key;
+    int major, info;
+    uint64_t val;
+    uint64_t i;
+    int rc;
+
+    if (count > (ib->end - ib->p) / 2) { /* each pair is at least 2 bytes */
+        errno = EPROTO;
+        return NULL;
+    }
+    if (!(obj = json_object ())) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (i = 0; i < count; i++) {
+        if (get_head (ib, &major, &info, &val) < 0)
+            goto error;
+        if (major != MAJOR_TEXT) {
+            errno = EPROTO;
+            goto error;
+        }
+        if (get_text (ib, val, buf, sizeof (buf), &key) < 0)
+            goto error;
+        if (!(o = decode_item (ib, depth + 1))) {
+            if (key != buf)
+                free (key);
+            goto error;
+        }
+        rc = json_object_set_new (obj, key, o); /* fails on invalid UTF-8 */
+        if (key != buf)
+            free (key);
+        if (rc < 0) {
+            errno = EPROTO;
+            goto error;
+        }
+    }
+    return obj;
+error:
+    json_decref (obj);
+    return NULL;
+}
+
+static json_t *decode_item (struct ibuf *ib, int depth)
+{
+    json_t *o = NULL;
+    int major, info;
+    uint64_t val;
+    char buf[128];
+    char *s;
+    uint32_t u32;
+    float f;
+    double d;
+
+    if (depth > max_depth)
+        goto eproto;
+    if (get_head (ib, &major, &info, &val) < 0)
+        return NULL;
+    switch (major) {
+        case MAJOR_UINT:
+            if (val > INT64_MAX)
+                goto eproto;
+            o = json_integer (val);
+            break;
+        case MAJOR_NEGINT:
+            if (val > INT64_MAX)
+                goto eproto;
+            o = json_integer (-1 - (json_int_t)val);
+            break;
+        case MAJOR_TEXT:
+            if (get_text (ib, val, buf, sizeof (buf), &s) < 0)
+                return NULL;
+            o = json_string (s); /* fails on invalid UTF-8 */
+            if (s != buf)
+                free (s);
+            if (!o)
+                goto eproto;
+            break;
+        case MAJOR_ARRAY:
+            return decode_array (ib, val, depth);
+        case MAJOR_MAP:
+            return decode_map (ib, val, depth);
+        case MAJOR_SIMPLE:
+            switch (info) {
+                case SIMPLE_FALSE:
+                    o = json_false ();
+                    break;
+                case SIMPLE_TRUE:
+                    o = json_true ();
+                    break;
+                case SIMPLE_NULL:
+                    o = json_null ();
+                    break;
+                case SIMPLE_FLOAT32:
+                    u32 = val;
+                    memcpy (&f, &u32, sizeof (f));
+                    if (!(o = json_real (f))) /* fails on NaN, inf */
+                        goto eproto;
+                    break;
+                case SIMPLE_FLOAT64:
+                    memcpy (&d, &val, sizeof (d));
+                    if (!(o = json_real (d)))
+                        goto eproto;
+                    break;
+                default:
+                    goto eproto;
+            }
+            break;
+        default: /* byte strings and tags have no JSON equivalent */
+            goto eproto;
+    }
+    if (!o)
+        errno = ENOMEM;
+    return o;
+eproto:
+    errno = EPROTO;
+    return NULL;
+}
+
+json_t *cbor_decode (const void *buf, size_t size)
+{
+    struct ibuf ib = { .p = buf, .end = (const uint8_t *)buf + size };
+    json_t *o;
+
+    if (!buf) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(o = decode_item (&ib, 0)))
+        return NULL;
+    if (ib.p != ib.end) {
+        json_decref (o);
+        errno = EPROTO;
+        return NULL;
+    }
+    return o;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
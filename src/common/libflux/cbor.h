@@ -0,0 +1,26 @@
+#ifndef _FLUX_CORE_CBOR_H
+#define _FLUX_CORE_CBOR_H
+
+#include <stddef.h>
+#include <jansson.h>
+
+/* Encode a JSON value as CBOR (RFC 7049).
+ * Returns a malloc'ed buffer of '*size' bytes which the caller must free,
+ * or NULL on failure with errno set.
+ */
+void *cbor_encode (json_t *o, size_t *size);
+
+/* Decode a CBOR item occupying all of 'buf' to a JSON value.
+ * Only the subset of CBOR that maps to JSON is accepted: definite length
+ * integers, text strings, arrays, maps with text string keys,
+ * single and double precision floats, true, false, and null.
+ * Returns a new reference, or NULL on failure with errno set
+ * (EPROTO for malformed or unsupported input).
+ */
+json_t *cbor_decode (const void *buf, size_t size);
+
+#endif /* !_FLUX_CORE_CBOR_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
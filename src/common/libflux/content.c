@@ -27,12 +27,24 @@
 #endif
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <flux/core.h>
 
 #include "content.h"
 
 #include "src/common/libutil/blobref.h"
+#include "src/common/libutil/blobvec.h"
+
+/* Batch RPCs carry a blobvec of blobs or blobrefs in each direction.
+ * The response is decoded once, on first access, into an array of
+ * items attached to the future.
+ */
+struct batch_result {
+    int count;
+    const void **data;
+    int *len;
+};
 
 flux_future_t *flux_content_load (flux_t *h, const char *blobref, int flags)
 {
@@ -87,6 +99,186 @@ int flux_content_store_get (flux_future_t *f, const char **blobref)
     return 0;
 }
 
+static void batch_result_destroy (void *arg)
+{
+    struct batch_result *res = arg;
+    if (res) {
+        free (res->data);
+        free (res->len);
+        free (res);
+    }
+}
+
+static struct batch_result *batch_result_get (flux_future_t *f)
+{
+    struct batch_result *res;
+    const void *buf;
+    int size;
+    int offset = 0;
+    int i;
+
+    if ((res = flux_future_aux_get (f, "flux::content_batch")))
+        return res;
+    if (flux_rpc_get_raw (f, &buf, &size) < 0)
+        return NULL;
+    if (!(res = calloc (1, sizeof (*res))))
+        goto nomem;
+    if ((res->count = blobvec_count_encoded (buf, size)) < 0)
+        goto error;
+    if (res->count > 0) {
+        if (!(res->data = calloc (res->count, sizeof (res->data[0])))
+                || !(res->len = calloc (res->count, sizeof (res->len[0]))))
+            goto nomem;
+    }
+    for (i = 0; i < res->count; i++) {
+        if (blobvec_next (buf, size, &offset, &res->data[i], &res->len[i]) < 1)
+            goto eproto;
+    }
+    if (flux_future_aux_set (f, "flux::content_batch", res,
+                             batch_result_destroy) < 0)
+        goto error;
+    return res;
+eproto:
+    errno = EPROTO;
+    goto error;
+nomem:
+    errno = ENOMEM;
+error:
+    batch_result_destroy (res);
+    return NULL;
+}
+
+static struct batch_result *batch_result_get_index (flux_future_t *f,
+                                                    int index)
+{
+    struct batch_result *res;
+
+    if (!(res = batch_result_get (f)))
+        return NULL;
+    if (index < 0 || index >= res->count) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return res;
+}
+
+flux_future_t *flux_content_load_batch (flux_t *h,
+                                        const char *blobrefs[], int count,
+                                        int flags)
+{
+    const char *topic = "content.load-batch";
+    uint32_t rank = FLUX_NODEID_ANY;
+    blobvec_t *bv = NULL;
+    flux_future_t *f = NULL;
+    int saved_errno;
+    int i;
+
+    if (!h || !blobrefs || count < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((flags & CONTENT_FLAG_UPSTREAM))
+        rank = FLUX_NODEID_UPSTREAM;
+    if ((flags & CONTENT_FLAG_CACHE_BYPASS)) {
+        topic = "content-backing.load-batch";
+        rank = 0;
+    }
+    if (!(bv = blobvec_create ()))
+        return NULL;
+    for (i = 0; i < count; i++) {
+        if (!blobrefs[i] || blobref_validate (blobrefs[i]) < 0) {
+            errno = EINVAL;
+            goto done;
+        }
+        if (blobvec_append (bv, blobrefs[i], strlen (blobrefs[i]) + 1) < 0)
+            goto done;
+    }
+    f = flux_rpc_raw (h, topic, blobvec_data (bv), blobvec_size (bv), rank, 0);
+done:
+    saved_errno = errno;
+    blobvec_destroy (bv);
+    errno = saved_errno;
+    return f;
+}
+
+int flux_content_load_batch_get (flux_future_t *f, int index,
+                                 const void **buf, int *len)
+{
+    struct batch_result *res;
+
+    if (!(res = batch_result_get_index (f, index)))
+        return -1;
+    if (res->len[index] < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (buf)
+        *buf = res->data[index];
+    if (len)
+        *len = res->len[index];
+    return 0;
+}
+
+flux_future_t *flux_content_store_batch (flux_t *h,
+                                         const void *bufs[], const int lens[],
+                                         int count, int flags)
+{
+    const char *topic = "content.store-batch";
+    uint32_t rank = FLUX_NODEID_ANY;
+    blobvec_t *bv = NULL;
+    flux_future_t *f = NULL;
+    int saved_errno;
+    int i;
+
+    if (!h || !bufs || !lens || count < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((flags & CONTENT_FLAG_UPSTREAM))
+        rank = FLUX_NODEID_UPSTREAM;
+    if ((flags & CONTENT_FLAG_CACHE_BYPASS)) {
+        topic = "content-backing.store-batch";
+        rank = 0;
+    }
+    if (!(bv = blobvec_create ()))
+        return NULL;
+    for (i = 0; i < count; i++) {
+        if (lens[i] < 0) {
+            errno = EINVAL;
+            goto done;
+        }
+        if (blobvec_append (bv, bufs[i], lens[i]) < 0)
+            goto done;
+    }
+    f = flux_rpc_raw (h, topic, blobvec_data (bv), blobvec_size (bv), rank, 0);
+done:
+    saved_errno = errno;
+    blobvec_destroy (bv);
+    errno = saved_errno;
+    return f;
+}
+
+int flux_content_store_batch_get (flux_future_t *f, int index,
+                                  const char **blobref)
+{
+    struct batch_result *res;
+    const char *ref;
+    int ref_size;
+
+    if (!(res = batch_result_get_index (f, index)))
+        return -1;
+    ref = res->data[index];
+    ref_size = res->len[index];
+    if (!ref || ref_size < 1 || ref[ref_size - 1] != '\0'
+                             || blobref_validate (ref) < 0) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (blobref)
+        *blobref = ref;
+    return 0;
+}
+
 /*
  * vi:tabstop=4 shiftwidth=4 expandtab
  */
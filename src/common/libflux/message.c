@@ -29,13 +29,16 @@
 #include <stdbool.h>
 #include <string.h>
 #include <arpa/inet.h>
+#include <sys/uio.h>
 #include <assert.h>
 #include <fnmatch.h>
 #include <inttypes.h>
+#include <zmq.h>
 #include <czmq.h>
 #include <jansson.h>
 
 #include "message.h"
+#include "cbor.h"
 
 /* Begin manual codec
  */
@@ -52,10 +55,23 @@
 #define PROTO_OFF_BIGINT2   16 /* 4 bytes */
 
 #define FLUX_MSG_MAGIC 0x33321eee
+
+#define PAYLOAD_ENCODING    (FLUX_MSGFLAG_JSON | FLUX_MSGFLAG_CBOR)
+
+/* The payload frame, if any, is kept apart from the other frames in a
+ * zmq_msg_t.  libzmq reference counts the content of messages too large
+ * to be stored inline, so copies of a message made with flux_msg_copy(),
+ * and frames sent with flux_msg_sendzsock() or received with
+ * flux_msg_recvzsock(), share one payload buffer.  The payload is never
+ * modified in place;  setting a new payload replaces the buffer, so the
+ * sharing is copy-on-write.
+ */
 struct flux_msg {
     int magic;
-    zmsg_t *zmsg;
+    zmsg_t *zmsg;           /* route, topic, and proto frames */
+    zmq_msg_t payload;
     json_t *json;
+    char *json_str;         /* JSON rendering of CBOR payload */
     zhash_t *aux;
 };
 
@@ -228,16 +244,59 @@ static void proto_init (uint8_t *data, int len, uint8_t flags)
 /* End manual codec
  */
 
-flux_msg_t *flux_msg_create (int type)
+/* Replace payload with a copy of 'buf'.
+ */
+static int payload_set (flux_msg_t *msg, const void *buf, size_t size)
 {
-    uint8_t proto[PROTO_SIZE];
-    flux_msg_t *msg = calloc (1, sizeof (*msg));
+    zmq_msg_t zm;
 
-    if (!msg) {
+    if (zmq_msg_init_size (&zm, size) < 0) {
         errno = ENOMEM;
-        goto error;
+        return -1;
+    }
+    if (size > 0)
+        memcpy (zmq_msg_data (&zm), buf, size);
+    (void)zmq_msg_move (&msg->payload, &zm);
+    (void)zmq_msg_close (&zm);
+    return 0;
+}
+
+static void payload_clear (flux_msg_t *msg)
+{
+    (void)zmq_msg_close (&msg->payload);
+    (void)zmq_msg_init (&msg->payload);
+}
+
+static void *payload_data (const flux_msg_t *msg)
+{
+    return zmq_msg_data ((zmq_msg_t *)&msg->payload);
+}
+
+static size_t payload_size (const flux_msg_t *msg)
+{
+    return zmq_msg_size ((zmq_msg_t *)&msg->payload);
+}
+
+static flux_msg_t *msg_alloc (void)
+{
+    flux_msg_t *msg;
+
+    if (!(msg = calloc (1, sizeof (*msg)))) {
+        errno = ENOMEM;
+        return NULL;
     }
     msg->magic = FLUX_MSG_MAGIC;
+    (void)zmq_msg_init (&msg->payload);
+    return msg;
+}
+
+flux_msg_t *flux_msg_create (int type)
+{
+    uint8_t proto[PROTO_SIZE];
+    flux_msg_t *msg;
+
+    if (!(msg = msg_alloc ()))
+        goto error;
     proto_init (proto, PROTO_SIZE, 0);
     if (proto_set_type (proto, PROTO_SIZE, type) < 0) {
         errno = EINVAL;
@@ -261,7 +320,9 @@ void flux_msg_destroy (flux_msg_t *msg)
         assert (msg->magic == FLUX_MSG_MAGIC);
         int saved_errno = errno;
         json_decref (msg->json);
+        free (msg->json_str);
         zmsg_destroy (&msg->zmsg);
+        (void)zmq_msg_close (&msg->payload);
         msg->magic =~ FLUX_MSG_MAGIC;
         zhash_destroy (&msg->aux);
         free (msg);
@@ -300,6 +361,11 @@ void *flux_msg_aux_get (const flux_msg_t *msg, const char *name)
 
 }
 
+static size_t encode_frame_size (size_t n)
+{
+    return (n < 0xff ? 1 : 1 + 4) + n;
+}
+
 size_t flux_msg_encode_size (const flux_msg_t *msg)
 {
     zframe_t *zf;
@@ -307,40 +373,51 @@ size_t flux_msg_encode_size (const flux_msg_t *msg)
 
     zf = zmsg_first (msg->zmsg);
     while (zf) {
-        size_t n = zframe_size (zf);
-        if (n < 255)
-            size += 1;
-        else
-            size += 1 + 4;
-        size += n;
+        size += encode_frame_size (zframe_size (zf));
         zf = zmsg_next (msg->zmsg);
     }
+    if (flux_msg_has_payload (msg))
+        size += encode_frame_size (payload_size (msg));
     return size;
 }
 
+/* Encode frame of 'n' bytes at 'p', with 'avail' bytes of space.
+ * Returns pointer past encoded frame, or NULL if there is no space.
+ */
+static uint8_t *encode_frame (uint8_t *p, size_t avail,
+                              const void *data, size_t n)
+{
+    if (avail < encode_frame_size (n))
+        return NULL;
+    if (n < 0xff)
+        *p++ = (uint8_t)n;
+    else {
+        *p++ = 0xff;
+        *(uint32_t *)p = htonl (n);
+        p += 4;
+    }
+    memcpy (p, data, n);
+    return p + n;
+}
 
 int flux_msg_encode (const flux_msg_t *msg, void *buf, size_t size)
 {
     uint8_t *p = buf;
-    zframe_t *zf;
+    bool payload = flux_msg_has_payload (msg);
+    zframe_t *zf, *next;
 
     zf = zmsg_first (msg->zmsg);
     while (zf) {
-        size_t n = zframe_size (zf);
-        if (n < 0xff) {
-            if (size - (p - (uint8_t *)buf) < n + 1)
+        next = zmsg_next (msg->zmsg);
+        if (!next && payload) { /* payload precedes proto frame */
+            if (!(p = encode_frame (p, size - (p - (uint8_t *)buf),
+                                    payload_data (msg), payload_size (msg))))
                 goto nospace;
-            *p++ = (uint8_t)n;
-        } else {
-            if (size - (p - (uint8_t *)buf) < n + 1 + 4)
-                goto nospace;
-            *p++ = 0xff;
-            *(uint32_t *)p = htonl (n);
-            p += 4;
         }
-        memcpy (p, zframe_data (zf), n);
-        p += n;
-        zf = zmsg_next (msg->zmsg);
+        if (!(p = encode_frame (p, size - (p - (uint8_t *)buf),
+                                zframe_data (zf), zframe_size (zf))))
+            goto nospace;
+        zf = next;
     }
     return 0;
 nospace:
@@ -348,42 +425,96 @@ nospace:
     return -1;
 }
 
+/* Decode frame at '*pp', advancing '*pp' past it.
+ * Returns 0 on success, -1 if the frame extends past 'end'.
+ */
+static int decode_frame (const uint8_t **pp, const uint8_t *end,
+                         const uint8_t **datap, size_t *np)
+{
+    const uint8_t *p = *pp;
+    size_t n;
+
+    if (end - p < 1)
+        return -1;
+    n = *p++;
+    if (n == 0xff) {
+        if (end - p < 4)
+            return -1;
+        n = ntohl (*(uint32_t *)p);
+        p += 4;
+    }
+    if (end - p < n)
+        return -1;
+    *datap = p;
+    *np = n;
+    *pp = p + n;
+    return 0;
+}
+
 flux_msg_t *flux_msg_decode (const void *buf, size_t size)
 {
-    flux_msg_t *msg = calloc (1, sizeof (*msg));
-    uint8_t const *p = buf;
+    flux_msg_t *msg;
+    const uint8_t *end = (const uint8_t *)buf + size;
+    const uint8_t *p;
+    const uint8_t *data = NULL;
+    size_t n = 0;
+    int count = 0;
+    int delim_index = -1;
+    int payload_index = -1;
+    uint8_t flags;
     zframe_t *zf;
     int saved_errno;
+    int i;
 
-    if (!msg)
-        goto nomem;
-    msg->magic = FLUX_MSG_MAGIC;
+    /* Find proto frame (last) to learn whether there is a payload frame,
+     * so that it can be decoded directly into msg->payload.  It follows
+     * the route stack (up to the empty delimiter frame) and topic, if any,
+     * and must precede the proto frame.
+     */
+    p = buf;
+    while (p < end) {
+        if (decode_frame (&p, end, &data, &n) < 0) {
+            errno = EINVAL;
+            return NULL;
+        }
+        if (n == 0 && delim_index == -1)
+            delim_index = count;
+        count++;
+    }
+    if (count > 0 && proto_get_flags ((uint8_t *)data, n, &flags) == 0
+                  && (flags & FLUX_MSGFLAG_PAYLOAD)) {
+        payload_index = 0;
+        if ((flags & FLUX_MSGFLAG_ROUTE))
+            payload_index = delim_index + 1;
+        if ((flags & FLUX_MSGFLAG_TOPIC))
+            payload_index++;
+        if (((flags & FLUX_MSGFLAG_ROUTE) && delim_index == -1)
+                                        || payload_index >= count - 1) {
+            errno = EPROTO;
+            return NULL;
+        }
+    }
+
+    if (!(msg = msg_alloc ()))
+        return NULL;
     if (!(msg->zmsg = zmsg_new ()))
         goto nomem;
-    while (p - (uint8_t *)buf < size) {
-        size_t n = *p++;
-        if (n == 0xff) {
-            if (size - (p - (uint8_t *)buf) < 4) {
-                saved_errno = EINVAL;
-                goto error;
-            }
-            n = ntohl (*(uint32_t *)p);
-            p += 4;
-        }
-        if (size - (p - (uint8_t *)buf) < n) {
-            saved_errno = EINVAL;
-            goto error;
+    p = buf;
+    for (i = 0; i < count; i++) {
+        (void)decode_frame (&p, end, &data, &n);
+        if (i == payload_index) {
+            if (payload_set (msg, data, n) < 0)
+                goto nomem;
+            continue;
         }
-        if (!(zf = zframe_new (p, n)))
+        if (!(zf = zframe_new (data, n)))
             goto nomem;
         if (zmsg_append (msg->zmsg, &zf) < 0)
             goto nomem;
-        p += n;
     }
     return msg;
 nomem:
-    saved_errno = EINVAL;
-error:
+    saved_errno = ENOMEM;
     flux_msg_destroy (msg);
     errno = saved_errno;
     return NULL;
@@ -949,21 +1080,23 @@ char *flux_msg_get_route_string (const flux_msg_t *msg)
     return buf;
 }
 
-static bool payload_overlap (const void *b, zframe_t *zf)
+static bool payload_overlap (const void *b, const flux_msg_t *msg)
 {
-    return ((char *)b >= (char *)zframe_data (zf)
-         && (char *)b <  (char *)zframe_data (zf) + zframe_size (zf));
+    return ((char *)b >= (char *)payload_data (msg)
+         && (char *)b <  (char *)payload_data (msg) + payload_size (msg));
 }
 
 int flux_msg_set_payload (flux_msg_t *msg, int flags, const void *buf, int size)
 {
-    zframe_t *zf;
     uint8_t msgflags;
     int rc = -1;
 
     json_decref (msg->json);            /* invalidate cached json object */
     msg->json = NULL;
-    if (flags != 0 && flags != FLUX_MSGFLAG_JSON) {
+    free (msg->json_str);
+    msg->json_str = NULL;
+    if (flags != 0 && flags != FLUX_MSGFLAG_JSON
+                   && flags != FLUX_MSGFLAG_CBOR) {
         errno = EINVAL;
         goto done;
     }
@@ -973,50 +1106,31 @@ int flux_msg_set_payload (flux_msg_t *msg, int flags, const void *buf, int size)
         rc = 0;
         goto done;
     }
-    zf = zmsg_first (msg->zmsg);
-    if ((msgflags & FLUX_MSGFLAG_ROUTE)) {
-        while (zf && zframe_size (zf) > 0)
-            zf = zmsg_next (msg->zmsg);      /* skip route frame */
-        if (zf)
-            zf = zmsg_next (msg->zmsg);      /* skip route delim */
-    }
-    if ((msgflags & FLUX_MSGFLAG_TOPIC)) {
-        if (zf)
-            zf = zmsg_next (msg->zmsg);      /* skip topic frame */
-    }
-    if (!zf) {                          /* must at least have proto frame */
-        errno = EPROTO;
-        goto done;
-    }
     /* Case #1: replace existing payload.
      */
     if ((msgflags & FLUX_MSGFLAG_PAYLOAD) && (buf != NULL && size > 0)) {
-        if (zframe_data (zf) != buf || zframe_size (zf) != size) {
-            if (payload_overlap (buf, zf)) {
+        if (payload_data (msg) != buf || payload_size (msg) != size) {
+            if (payload_overlap (buf, msg)) {
                 errno = EINVAL;
                 goto done;
             }
-            zframe_reset (zf, buf, size);
+            if (payload_set (msg, buf, size) < 0)
+                goto done;
         }
-        msgflags &= ~(uint8_t)FLUX_MSGFLAG_JSON;
+        msgflags &= ~(uint8_t)PAYLOAD_ENCODING;
         msgflags |= flags;
     /* Case #2: add payload.
      */
     } else if (!(msgflags & FLUX_MSGFLAG_PAYLOAD) && (buf != NULL && size > 0)){
-        zmsg_remove (msg->zmsg, zf);
-        if (zmsg_addmem (msg->zmsg, buf, size) < 0
-                                        || zmsg_append (msg->zmsg, &zf) < 0) {
-            errno = ENOMEM;
+        if (payload_set (msg, buf, size) < 0)
             goto done;
-        }
-        msgflags &= ~(uint8_t)FLUX_MSGFLAG_JSON;
+        msgflags &= ~(uint8_t)PAYLOAD_ENCODING;
         msgflags |= FLUX_MSGFLAG_PAYLOAD | flags;
     /* Case #3: remove payload.
      */
     } else if ((msgflags & FLUX_MSGFLAG_PAYLOAD) && (buf == NULL || size == 0)){
-        zmsg_remove (msg->zmsg, zf);
-        zframe_destroy (&zf);
-        msgflags &= ~(uint8_t)(FLUX_MSGFLAG_PAYLOAD | FLUX_MSGFLAG_JSON);
+        payload_clear (msg);
+        msgflags &= ~(uint8_t)(FLUX_MSGFLAG_PAYLOAD | PAYLOAD_ENCODING);
     }
     if (flux_msg_set_flags (msg, msgflags) < 0)
         goto done;
@@ -1025,6 +1139,23 @@ done:
     return rc;
 }
 
+static int set_cbor (flux_msg_t *msg, json_t *json)
+{
+    void *buf;
+    size_t size;
+    int rc;
+
+    if (!json_is_object (json)) { /* ensure payload is json object */
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(buf = cbor_encode (json, &size)))
+        return -1;
+    rc = flux_msg_set_payload (msg, FLUX_MSGFLAG_CBOR, buf, size);
+    free (buf);
+    return rc;
+}
+
 int flux_msg_vpack (flux_msg_t *msg, const char *fmt, va_list ap)
 {
     json_error_t error;
@@ -1050,6 +1181,35 @@ done:
     return rc;
 }
 
+int flux_msg_vpack_cbor (flux_msg_t *msg, const char *fmt, va_list ap)
+{
+    json_error_t error;
+    json_t *json;
+    int rc = -1;
+
+    if (!(json = json_vpack_ex (&error, 0, fmt, ap))) {
+        errno = EINVAL;
+        goto done;
+    }
+    if (set_cbor (msg, json) < 0)
+        goto done;
+    rc = 0;
+done:
+    json_decref (json);
+    return rc;
+}
+
+int flux_msg_pack_cbor (flux_msg_t *msg, const char *fmt, ...)
+{
+    va_list ap;
+    int rc;
+
+    va_start (ap, fmt);
+    rc = flux_msg_vpack_cbor (msg, fmt, ap);
+    va_end (ap);
+    return rc;
+}
+
 int flux_msg_pack (flux_msg_t *msg, const char *fmt, ...)
 {
     va_list ap;
@@ -1064,7 +1224,6 @@ int flux_msg_pack (flux_msg_t *msg, const char *fmt, ...)
 int flux_msg_get_payload (const flux_msg_t *msg, int *flags,
                           const void **buf, int *size)
 {
-    zframe_t *zf;
     uint8_t msgflags;
 
     if (flux_msg_get_flags (msg, &msgflags) < 0)
@@ -1073,27 +1232,12 @@ int flux_msg_get_payload (const flux_msg_t *msg, int *flags,
         errno = EPROTO;
         return -1;
     }
-    zf = zmsg_first (msg->zmsg);
-    if ((msgflags & FLUX_MSGFLAG_ROUTE)) {
-        while (zf && zframe_size (zf) > 0)
-            zf = zmsg_next (msg->zmsg);
-        if (zf)
-            zf = zmsg_next (msg->zmsg);
-    }
-    if ((msgflags & FLUX_MSGFLAG_TOPIC)) {
-        if (zf)
-            zf = zmsg_next (msg->zmsg);
-    }
-    if (!zf) {
-        errno = EPROTO;
-        return -1;
-    }
     if (flags)
-        *flags = msgflags & FLUX_MSGFLAG_JSON;
+        *flags = msgflags & PAYLOAD_ENCODING;
     if (buf)
-        *buf = zframe_data (zf);
+        *buf = payload_data (msg);
     if (size)
-        *size = zframe_size (zf);
+        *size = payload_size (msg);
     return 0;
 }
 
@@ -1123,8 +1267,31 @@ done:
     return rc;
 }
 
-int flux_msg_get_json (const flux_msg_t *msg, const char **s)
+/* Decode CBOR payload to msg->json, if not already done.
+ */
+static int decode_cbor (flux_msg_t *msg, const void *buf, int size)
 {
+    json_t *json;
+
+    if (!msg->json) {
+        if (!(json = cbor_decode (buf, size)))
+            return -1;
+        if (!json_is_object (json)) {
+            json_decref (json);
+            errno = EPROTO;
+            return -1;
+        }
+        msg->json = json;
+    }
+    return 0;
+}
+
+/* N.B. A CBOR payload is rendered as JSON for callers that expect a
+ * JSON string.  The result is cached in the message like msg->json.
+ */
+int flux_msg_get_json (const flux_msg_t *cmsg, const char **s)
+{
+    flux_msg_t *msg = (flux_msg_t *)cmsg;
     const char *buf;
     int size;
     int flags;
@@ -1137,6 +1304,16 @@ int flux_msg_get_json (const flux_msg_t *msg, const char **s)
     if (flux_msg_get_payload (msg, &flags, (const void **)&buf, &size) < 0) {
         errno = 0;
         *s = NULL;
+    } else if ((flags & FLUX_MSGFLAG_CBOR)) {
+        if (!msg->json_str) {
+            if (decode_cbor (msg, buf, size) < 0)
+                goto done;
+            if (!(msg->json_str = json_dumps (msg->json, JSON_COMPACT))) {
+                errno = ENOMEM;
+                goto done;
+            }
+        }
+        *s = msg->json_str;
     } else {
         if (!buf || size == 0 || !(flags & FLUX_MSGFLAG_JSON)
                               || buf[size - 1] != '\0'
@@ -1159,6 +1336,8 @@ int flux_msg_vunpack (const flux_msg_t *cmsg, const char *fmt, va_list ap)
 {
     int rc = -1;
     const char *json_str;
+    const void *buf;
+    int size, flags;
     json_error_t error;
     flux_msg_t *msg = (flux_msg_t *)cmsg;
 
@@ -1166,6 +1345,11 @@ int flux_msg_vunpack (const flux_msg_t *cmsg, const char *fmt, va_list ap)
         errno = EINVAL;
         goto done;
     }
+    if (!msg->json && flux_msg_get_payload (msg, &flags, &buf, &size) == 0
+                   && (flags & FLUX_MSGFLAG_CBOR)) {
+        if (decode_cbor (msg, buf, size) < 0)
+            goto done;
+    }
     if (!msg->json) {
         if (flux_msg_get_json (msg, &json_str) < 0)
             goto done;
@@ -1196,7 +1380,7 @@ int flux_msg_unpack (const flux_msg_t *msg, const char *fmt, ...)
 
 int flux_msg_set_topic (flux_msg_t *msg, const char *topic)
 {
-    zframe_t *zf, *zf2 = NULL;
+    zframe_t *zf;
     uint8_t flags;
     int rc = -1;
 
@@ -1216,12 +1400,9 @@ int flux_msg_set_topic (flux_msg_t *msg, const char *topic)
     if ((flags & FLUX_MSGFLAG_TOPIC) && topic) {        /* case 1: repl topic */
         zframe_reset (zf, topic, strlen (topic) + 1);
     } else if (!(flags & FLUX_MSGFLAG_TOPIC) && topic) {/* case 2: add topic */
-        zmsg_remove (msg->zmsg, zf);
-        if ((flags & FLUX_MSGFLAG_PAYLOAD) && (zf2 = zmsg_next (msg->zmsg)))
-            zmsg_remove (msg->zmsg, zf2);
+        zmsg_remove (msg->zmsg, zf);    /* proto frame */
         if (zmsg_addmem (msg->zmsg, topic, strlen (topic) + 1) < 0
-                                    || zmsg_append (msg->zmsg, &zf) < 0
-                                    || (zf2 && zmsg_append (msg->zmsg, &zf2) < 0)) {
+                                    || zmsg_append (msg->zmsg, &zf) < 0) {
             errno = ENOMEM;
             goto done;
         }
@@ -1292,9 +1473,7 @@ flux_msg_t *flux_msg_copy (const flux_msg_t *msg, bool payload)
 {
     flux_msg_t *cpy = NULL;
     zframe_t *zf;
-    int count;
     uint8_t flags;
-    bool skip_payload = false;
 
     if (msg->magic != FLUX_MSG_MAGIC) {
         errno = EINVAL;
@@ -1302,25 +1481,22 @@ flux_msg_t *flux_msg_copy (const flux_msg_t *msg, bool payload)
     }
     if (flux_msg_get_flags (msg, &flags) < 0)
         goto error;
-    if (!payload && (flags & FLUX_MSGFLAG_PAYLOAD)) {
-        flags &= ~(FLUX_MSGFLAG_PAYLOAD | FLUX_MSGFLAG_JSON);
-        skip_payload = true;
-    }
-    if (!(cpy = calloc (1, sizeof (*cpy))))
-        goto nomem;
-    cpy->magic = FLUX_MSG_MAGIC;
+    if (!payload)
+        flags &= ~(FLUX_MSGFLAG_PAYLOAD | PAYLOAD_ENCODING);
+    if (!(cpy = msg_alloc ()))
+        goto error;
     if (!(cpy->zmsg = zmsg_new ()))
         goto nomem;
 
-    count = 0;
     zf = zmsg_first (msg->zmsg);
     while (zf) {
-        if (!skip_payload || count != zmsg_size (msg->zmsg) - 2) {
-            if (zmsg_addmem (cpy->zmsg, zframe_data (zf), zframe_size (zf)) < 0)
-                goto nomem;
-        }
+        if (zmsg_addmem (cpy->zmsg, zframe_data (zf), zframe_size (zf)) < 0)
+            goto nomem;
         zf = zmsg_next (msg->zmsg);
-        count++;
+    }
+    if ((flags & FLUX_MSGFLAG_PAYLOAD)) {
+        if (zmq_msg_copy (&cpy->payload, (zmq_msg_t *)&msg->payload) < 0)
+            goto nomem;
     }
     if (flux_msg_set_flags (cpy, flags) < 0)
         goto error;
@@ -1545,6 +1721,278 @@ done:
     return msg;
 }
 
+/* Buffered framed I/O.
+ * Frames are an 8 byte header (IOBUF_MAGIC, size) followed by an
+ * encoded message, as sent by flux_msg_sendfd().
+ */
+#define MSG_READER_BUFSIZE  (64*1024)
+#define MSG_WRITER_IOVMAX   256
+
+struct flux_msg_reader {
+    int fd;
+    uint8_t *buf;
+    size_t size;            /* allocated size of buf */
+    size_t start;           /* offset of first unparsed byte */
+    size_t end;             /* offset past last byte read */
+};
+
+struct msg_frame {
+    uint8_t *buf;
+    size_t size;
+};
+
+struct flux_msg_writer {
+    int fd;
+    struct msg_frame *q;
+    int qsize;              /* allocated entries in q */
+    int head;               /* first unsent frame */
+    int tail;               /* one past last queued frame */
+    size_t done;            /* bytes of q[head] already sent */
+};
+
+flux_msg_reader_t *flux_msg_reader_create (int fd)
+{
+    flux_msg_reader_t *r;
+
+    if (fd < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(r = calloc (1, sizeof (*r)))
+            || !(r->buf = malloc (MSG_READER_BUFSIZE))) {
+        free (r);
+        errno = ENOMEM;
+        return NULL;
+    }
+    r->fd = fd;
+    r->size = MSG_READER_BUFSIZE;
+    return r;
+}
+
+void flux_msg_reader_destroy (flux_msg_reader_t *r)
+{
+    if (r) {
+        int saved_errno = errno;
+        free (r->buf);
+        free (r);
+        errno = saved_errno;
+    }
+}
+
+/* Determine the size of the frame at the front of the buffer.
+ * Returns 1 if it is complete, 0 if more data is needed (*framesize is
+ * then the number of bytes needed to make progress), or -1 on a bad frame.
+ */
+static int reader_frame (flux_msg_reader_t *r, size_t *framesize)
+{
+    const uint8_t *p = r->buf + r->start;
+    uint32_t magic, size;
+
+    if (r->end - r->start < 8) {
+        *framesize = 8;
+        return 0;
+    }
+    memcpy (&magic, &p[0], 4);
+    memcpy (&size, &p[4], 4);
+    if (magic != IOBUF_MAGIC) {
+        errno = EPROTO;
+        return -1;
+    }
+    *framesize = (size_t)ntohl (size) + 8;
+    return r->end - r->start >= *framesize ? 1 : 0;
+}
+
+/* Make room for a frame of 'framesize' bytes starting at r->start.
+ */
+static int reader_reserve (flux_msg_reader_t *r, size_t framesize)
+{
+    if (r->start + framesize <= r->size)
+        return 0;
+    if (r->start > 0) {
+        memmove (r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+    }
+    if (framesize > r->size) {
+        uint8_t *buf;
+        if (!(buf = realloc (r->buf, framesize))) {
+            errno = ENOMEM;
+            return -1;
+        }
+        r->buf = buf;
+        r->size = framesize;
+    }
+    return 0;
+}
+
+/* Once the buffer is drained, drop back to the default size
+ * if it was grown for a large message.
+ */
+static void reader_reset (flux_msg_reader_t *r)
+{
+    r->start = r->end = 0;
+    if (r->size > MSG_READER_BUFSIZE) {
+        uint8_t *buf;
+        if ((buf = realloc (r->buf, MSG_READER_BUFSIZE))) {
+            r->buf = buf;
+            r->size = MSG_READER_BUFSIZE;
+        }
+    }
+}
+
+flux_msg_t *flux_msg_reader_recv (flux_msg_reader_t *r)
+{
+    flux_msg_t *msg;
+    size_t framesize;
+    ssize_t n;
+    int rc;
+
+    if (!r) {
+        errno = EINVAL;
+        return NULL;
+    }
+    while ((rc = reader_frame (r, &framesize)) == 0) {
+        if (reader_reserve (r, framesize) < 0)
+            return NULL;
+        n = read (r->fd, r->buf + r->end, r->size - r->end);
+        if (n < 0)
+            return NULL;
+        if (n == 0) {
+            errno = EPROTO;
+            return NULL;
+        }
+        r->end += n;
+    }
+    if (rc < 0)
+        return NULL;
+    msg = flux_msg_decode (r->buf + r->start + 8, framesize - 8);
+    r->start += framesize;
+    if (r->start == r->end)
+        reader_reset (r);
+    return msg;
+}
+
+bool flux_msg_reader_pending (flux_msg_reader_t *r)
+{
+    size_t framesize;
+
+    /* A bad frame counts as pending so the next recv reports it.
+     */
+    return r && reader_frame (r, &framesize) != 0;
+}
+
+flux_msg_writer_t *flux_msg_writer_create (int fd)
+{
+    flux_msg_writer_t *w;
+
+    if (fd < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(w = calloc (1, sizeof (*w)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    w->fd = fd;
+    return w;
+}
+
+void flux_msg_writer_destroy (flux_msg_writer_t *w)
+{
+    if (w) {
+        int saved_errno = errno;
+        int i;
+        for (i = w->head; i < w->tail; i++)
+            free (w->q[i].buf);
+        free (w->q);
+        free (w);
+        errno = saved_errno;
+    }
+}
+
+int flux_msg_writer_push (flux_msg_writer_t *w, const flux_msg_t *msg)
+{
+    struct msg_frame f;
+    uint32_t hdr[2];
+
+    if (!w || !msg) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (w->tail == w->qsize) {
+        if (w->head > 0) {
+            memmove (w->q, w->q + w->head,
+                     (w->tail - w->head) * sizeof (w->q[0]));
+            w->tail -= w->head;
+            w->head = 0;
+        }
+        else {
+            int qsize = w->qsize ? w->qsize * 2 : 16;
+            struct msg_frame *q;
+            if (!(q = realloc (w->q, qsize * sizeof (q[0])))) {
+                errno = ENOMEM;
+                return -1;
+            }
+            w->q = q;
+            w->qsize = qsize;
+        }
+    }
+    f.size = flux_msg_encode_size (msg) + 8;
+    if (!(f.buf = malloc (f.size))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    hdr[0] = IOBUF_MAGIC;
+    hdr[1] = htonl (f.size - 8);
+    memcpy (f.buf, hdr, 8);
+    if (flux_msg_encode (msg, f.buf + 8, f.size - 8) < 0) {
+        free (f.buf);
+        return -1;
+    }
+    w->q[w->tail++] = f;
+    return 0;
+}
+
+int flux_msg_writer_flush (flux_msg_writer_t *w)
+{
+    struct iovec iov[MSG_WRITER_IOVMAX];
+    ssize_t n;
+    int i, count;
+
+    if (!w) {
+        errno = EINVAL;
+        return -1;
+    }
+    while (w->head < w->tail) {
+        count = 0;
+        for (i = w->head; i < w->tail && count < MSG_WRITER_IOVMAX; i++) {
+            size_t skip = i == w->head ? w->done : 0;
+            iov[count].iov_base = w->q[i].buf + skip;
+            iov[count].iov_len = w->q[i].size - skip;
+            count++;
+        }
+        if ((n = writev (w->fd, iov, count)) < 0)
+            return -1;
+        while (n > 0) {
+            size_t left = w->q[w->head].size - w->done;
+            if ((size_t)n < left) {
+                w->done += n;
+                break;
+            }
+            n -= left;
+            free (w->q[w->head++].buf);
+            w->done = 0;
+        }
+    }
+    w->head = w->tail = 0;
+    return 0;
+}
+
+int flux_msg_writer_count (flux_msg_writer_t *w)
+{
+    return w ? w->tail - w->head : 0;
+}
+
 int flux_msg_sendzsock (void *sock, const flux_msg_t *msg)
 {
     int rc = -1;
@@ -1556,12 +2004,25 @@ int flux_msg_sendzsock (void *sock, const flux_msg_t *msg)
 
     void *handle = zsock_resolve (sock);
     int flags = ZFRAME_REUSE | ZFRAME_MORE;
+    bool payload = flux_msg_has_payload (msg);
     zframe_t *zf = zmsg_first (msg->zmsg);
     size_t count = 0;
 
     while (zf) {
-        if (++count == zmsg_size (msg->zmsg))
+        if (++count == zmsg_size (msg->zmsg)) {
+            if (payload) { /* payload precedes proto frame */
+                zmq_msg_t cpy;
+                (void)zmq_msg_init (&cpy);
+                if (zmq_msg_copy (&cpy, (zmq_msg_t *)&msg->payload) < 0
+                        || zmq_msg_send (&cpy, handle, ZMQ_SNDMORE) < 0) {
+                    int saved_errno = errno;
+                    (void)zmq_msg_close (&cpy);
+                    errno = saved_errno;
+                    goto done;
+                }
+            }
             flags &= ~ZFRAME_MORE;
+        }
         if (zframe_send (&zf, handle, flags) < 0)
             goto done;
         zf = zmsg_next (msg->zmsg);
@@ -1571,21 +2032,74 @@ done:
     return rc;
 }
 
+/* Append frame 'zm' to msg->zmsg.
+ */
+static int append_frame (flux_msg_t *msg, zmq_msg_t *zm)
+{
+    if (zmsg_addmem (msg->zmsg, zmq_msg_data (zm), zmq_msg_size (zm)) < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/* Frames are received one at a time so that the payload frame, which
+ * is the one before the final (proto) frame, can be kept without copying.
+ */
 flux_msg_t *flux_msg_recvzsock (void *sock)
 {
-    zmsg_t *zmsg;
+    void *handle = zsock_resolve (sock);
     flux_msg_t *msg;
+    zmq_msg_t prev, cur;
+    bool have_prev = false;
+    uint8_t flags;
+    int saved_errno;
 
-    if (!(zmsg = zmsg_recv (sock)))
+    if (!(msg = msg_alloc ()))
         return NULL;
-    if (!(msg = calloc (1, sizeof (*msg)))) {
-        zmsg_destroy (&zmsg);
+    (void)zmq_msg_init (&prev);
+    (void)zmq_msg_init (&cur);
+    if (!(msg->zmsg = zmsg_new ())) {
         errno = ENOMEM;
-        return NULL;
+        goto error;
     }
-    msg->magic = FLUX_MSG_MAGIC;
-    msg->zmsg = zmsg;
+    for (;;) {
+        if (zmq_msg_recv (&cur, handle, 0) < 0)
+            goto error;
+        if (!zmq_msg_more (&cur))
+            break;
+        if (have_prev && append_frame (msg, &prev) < 0)
+            goto error;
+        (void)zmq_msg_move (&prev, &cur);
+        have_prev = true;
+    }
+    if (proto_get_flags (zmq_msg_data (&cur), zmq_msg_size (&cur),
+                                                            &flags) < 0) {
+        errno = EPROTO;
+        goto error;
+    }
+    if (have_prev) {
+        if ((flags & FLUX_MSGFLAG_PAYLOAD))
+            (void)zmq_msg_move (&msg->payload, &prev);
+        else if (append_frame (msg, &prev) < 0)
+            goto error;
+    }
+    else if ((flags & FLUX_MSGFLAG_PAYLOAD)) {
+        errno = EPROTO;
+        goto error;
+    }
+    if (append_frame (msg, &cur) < 0)
+        goto error;
+    (void)zmq_msg_close (&prev);
+    (void)zmq_msg_close (&cur);
     return msg;
+error:
+    saved_errno = errno;
+    (void)zmq_msg_close (&prev);
+    (void)zmq_msg_close (&cur);
+    flux_msg_destroy (msg);
+    errno = saved_errno;
+    return NULL;
 }
 
 int flux_msg_sendzsock_munge (void *sock, const flux_msg_t *msg,
@@ -1654,7 +2168,7 @@ done:
 
 int flux_msg_frames (const flux_msg_t *msg)
 {
-    return zmsg_size (msg->zmsg);
+    return zmsg_size (msg->zmsg) + (flux_msg_has_payload (msg) ? 1 : 0);
 }
 
 /*
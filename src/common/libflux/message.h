@@ -31,6 +31,7 @@ enum {
     FLUX_MSGFLAG_ROUTE      = 0x08,	/* message is routable */
     FLUX_MSGFLAG_UPSTREAM   = 0x10, /* request nodeid is sender (route away) */
     FLUX_MSGFLAG_PRIVATE    = 0x20, /* private to instance owner and sender */
+    FLUX_MSGFLAG_CBOR       = 0x40, /* message payload is CBOR */
 };
 
 struct flux_match {
@@ -82,6 +83,8 @@ int flux_msg_aux_set (const flux_msg_t *msg, const char *name,
 void *flux_msg_aux_get (const flux_msg_t *msg, const char *name);
 
 /* Duplicate msg, omitting payload if 'payload' is false.
+ * The copy shares the payload buffer with 'msg' until either one
+ * sets a new payload.
  */
 flux_msg_t *flux_msg_copy (const flux_msg_t *msg, bool payload);
 
@@ -114,6 +117,36 @@ int flux_msg_sendfd (int fd, const flux_msg_t *msg,
  */
 flux_msg_t *flux_msg_recvfd (int fd, struct flux_msg_iobuf *iobuf);
 
+/* Buffered framed I/O on a file descriptor, using the same wire format
+ * as flux_msg_sendfd() and flux_msg_recvfd().
+ *
+ * A reader reads as much as is available into its buffer and parses
+ * messages from it, so a burst of messages costs one read().
+ * flux_msg_reader_recv() returns the next message, or NULL with errno set
+ * (EAGAIN/EWOULDBLOCK if a non-blocking fd has no complete message,
+ * EPROTO on EOF or a bad frame).  Since buffered messages do not make
+ * the fd readable, callers driven by an fd watcher should keep receiving
+ * while flux_msg_reader_pending() returns true.
+ *
+ * A writer queues encoded messages and sends as many as possible
+ * with one writev().  flux_msg_writer_flush() returns 0 once the queue
+ * is empty, or -1 with errno set, e.g. EAGAIN/EWOULDBLOCK if a non-blocking
+ * fd filled up; unwritten messages remain queued for the next flush.
+ */
+typedef struct flux_msg_reader flux_msg_reader_t;
+typedef struct flux_msg_writer flux_msg_writer_t;
+
+flux_msg_reader_t *flux_msg_reader_create (int fd);
+void flux_msg_reader_destroy (flux_msg_reader_t *r);
+flux_msg_t *flux_msg_reader_recv (flux_msg_reader_t *r);
+bool flux_msg_reader_pending (flux_msg_reader_t *r);
+
+flux_msg_writer_t *flux_msg_writer_create (int fd);
+void flux_msg_writer_destroy (flux_msg_writer_t *w);
+int flux_msg_writer_push (flux_msg_writer_t *w, const flux_msg_t *msg);
+int flux_msg_writer_flush (flux_msg_writer_t *w);
+int flux_msg_writer_count (flux_msg_writer_t *w);
+
 /* Send message to zeromq socket.
  * Returns 0 on success, -1 on failure with errno set.
  */
@@ -161,7 +194,7 @@ int flux_msg_get_topic (const flux_msg_t *msg, const char **topic);
  * The new payload will be copied (caller retains ownership).
  * Any old payload is deleted.
  * flux_msg_get_payload returns pointer to msg-owned buf.
- * Flags can be 0 or FLUX_MSGFLAG_JSON (hint for decoding).
+ * Flags can be 0, FLUX_MSGFLAG_JSON, or FLUX_MSGFLAG_CBOR (hint for decoding).
  */
 int flux_msg_get_payload (const flux_msg_t *msg, int *flags,
                           const void **buf, int *size);
@@ -174,10 +207,15 @@ bool flux_msg_has_payload (const flux_msg_t *msg);
  * flux_msg_get_json() will set json_str to NULL if there is no payload
  * pack/unpack functions use jansson pack/unpack style arguments for
  * encoding/decoding the JSON object payload directly from/to its members.
+ * pack_cbor functions encode the object in CBOR (RFC 7049), which is
+ * smaller and faster to decode.  unpack accepts either encoding, and
+ * flux_msg_get_json() renders a CBOR payload as JSON.
  */
 int flux_msg_set_json (flux_msg_t *msg, const char *json_str);
 int flux_msg_pack (flux_msg_t *msg, const char *fmt, ...);
 int flux_msg_vpack (flux_msg_t *msg, const char *fmt, va_list ap);
+int flux_msg_pack_cbor (flux_msg_t *msg, const char *fmt, ...);
+int flux_msg_vpack_cbor (flux_msg_t *msg, const char *fmt, va_list ap);
 
 int flux_msg_get_json (const flux_msg_t *msg, const char **json_str);
 int flux_msg_unpack (const flux_msg_t *msg, const char *fmt, ...);
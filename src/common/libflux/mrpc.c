@@ -28,6 +28,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #if HAVE_CALIPER
 #include <caliper/cali.h>
@@ -48,6 +49,13 @@
 
 #define MRPC_MAGIC 0x114422ae
 
+/* With FLUX_RPC_TREE, one request is sent to this broker service on rank 0,
+ * which forwards it down the overlay to the subtrees holding the target
+ * ranks.  The response carries the responses of all the targets, which are
+ * unpacked into messages that look as though each rank responded directly.
+ */
+static const char *mrpc_tree_topic = "cmb.mrpc";
+
 struct flux_mrpc_struct {
     int magic;
     struct flux_match m;
@@ -63,6 +71,11 @@ struct flux_mrpc_struct {
     zhash_t *aux;
     flux_free_f aux_destroy;
     int usecount;
+    bool tree;                  /* request was sent with FLUX_RPC_TREE */
+    bool tree_done;             /* tree response has been received */
+    char *topic;                /* tree: topic of the fanned out request */
+    char *nodeset;              /* tree: target ranks */
+    zlist_t *rx_queue;          /* tree: unpacked responses not yet handled */
 };
 
 static void flux_mrpc_usecount_incr (flux_mrpc_t *mrpc)
@@ -85,10 +98,18 @@ static void flux_mrpc_usecount_decr (flux_mrpc_t *mrpc)
              * if the rpc was not completed.  Lacking a proper cancellation
              * protocol, we simply leak them.  See issue #212.
              */
-            if (mrpc->rx_count >= mrpc->rx_expected)
+            if (mrpc->rx_count >= mrpc->rx_expected || mrpc->tree_done)
                 flux_matchtag_free (mrpc->h, mrpc->m.matchtag);
         }
         flux_msg_destroy (mrpc->rx_msg);
+        if (mrpc->rx_queue) {
+            flux_msg_t *msg;
+            while ((msg = zlist_pop (mrpc->rx_queue)))
+                flux_msg_destroy (msg);
+            zlist_destroy (&mrpc->rx_queue);
+        }
+        free (mrpc->topic);
+        free (mrpc->nodeset);
         zhash_destroy (&mrpc->aux);
         mrpc->magic =~ MRPC_MAGIC;
         free (mrpc);
@@ -178,6 +199,129 @@ static int mrpc_request_prepare_send (flux_mrpc_t *mrpc, flux_msg_t *msg,
     return 0;
 }
 
+static bool is_tree_response (flux_mrpc_t *mrpc, const flux_msg_t *msg)
+{
+    const char *topic;
+
+    if (!mrpc->tree || mrpc->tree_done)
+        return false;
+    if (flux_msg_get_topic (msg, &topic) < 0)
+        return false;
+    return !strcmp (topic, mrpc_tree_topic);
+}
+
+/* Queue a response from 'rank', with its nodeid stashed in the matchtag
+ * as mrpc_request_prepare() would have for a point-to-point request.
+ */
+static int tree_queue_response (flux_mrpc_t *mrpc, uint32_t rank,
+                                int errnum, const char *json_str)
+{
+    uint32_t matchgrp = mrpc->m.matchtag & FLUX_MATCHTAG_GROUP_MASK;
+    flux_msg_t *msg;
+
+    if ((rank & FLUX_MATCHTAG_GROUP_MASK) != 0) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (!(msg = flux_response_encode (mrpc->topic, errnum,
+                                      errnum ? NULL : json_str)))
+        return -1;
+    if (flux_msg_set_matchtag (msg, matchgrp | rank) < 0) {
+        flux_msg_destroy (msg);
+        return -1;
+    }
+    if (zlist_append (mrpc->rx_queue, msg) < 0) {
+        flux_msg_destroy (msg);
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/* The tree request failed as a whole:  fail it on every target rank.
+ */
+static int tree_fail (flux_mrpc_t *mrpc, int errnum)
+{
+    nodeset_t *ns;
+    nodeset_iterator_t *itr = NULL;
+    flux_msg_t *msg;
+    uint32_t rank;
+    int rc = -1;
+
+    while ((msg = zlist_pop (mrpc->rx_queue)))
+        flux_msg_destroy (msg);
+    if (!(ns = nodeset_create_string (mrpc->nodeset))
+            || !(itr = nodeset_iterator_create (ns))) {
+        errno = ENOMEM;
+        goto done;
+    }
+    while ((rank = nodeset_next (itr)) != NODESET_EOF) {
+        if (tree_queue_response (mrpc, rank, errnum, NULL) < 0)
+            goto done;
+    }
+    rc = 0;
+done:
+    if (itr)
+        nodeset_iterator_destroy (itr);
+    if (ns)
+        nodeset_destroy (ns);
+    return rc;
+}
+
+/* Unpack the responses carried by the response to the tree request.
+ */
+static int tree_unpack (flux_mrpc_t *mrpc, const flux_msg_t *msg)
+{
+    json_t *responses;
+    json_t *entry;
+    size_t index;
+    int rank, errnum;
+    const char *json_str;
+
+    mrpc->tree_done = true;
+    if (flux_response_decode (msg, NULL, NULL) < 0)
+        return tree_fail (mrpc, errno);
+    if (flux_msg_unpack (msg, "{s:o}", "responses", &responses) < 0
+            || !json_is_array (responses))
+        return tree_fail (mrpc, EPROTO);
+    json_array_foreach (responses, index, entry) {
+        json_str = NULL;
+        if (json_unpack (entry, "{s:i s:i s?s}", "rank", &rank,
+                                                 "errnum", &errnum,
+                                                 "payload", &json_str) < 0
+                || rank < 0)
+            return tree_fail (mrpc, EPROTO);
+        if (tree_queue_response (mrpc, rank, errnum, json_str) < 0)
+            return tree_fail (mrpc, errno);
+    }
+    return 0;
+}
+
+/* Receive the next response, unpacking the tree response if that is
+ * what arrives.
+ */
+static flux_msg_t *mrpc_recv (flux_mrpc_t *mrpc, int flags)
+{
+    flux_msg_t *msg;
+    int rc;
+
+    if (mrpc->rx_queue && (msg = zlist_pop (mrpc->rx_queue)))
+        return msg;
+    if (!(msg = flux_recv (mrpc->h, mrpc->m, flags)))
+        return NULL;
+    if (is_tree_response (mrpc, msg)) {
+        rc = tree_unpack (mrpc, msg);
+        flux_msg_destroy (msg);
+        if (rc < 0)
+            return NULL;
+        if (!(msg = zlist_pop (mrpc->rx_queue))) {
+            errno = EPROTO;
+            return NULL;
+        }
+    }
+    return msg;
+}
+
 bool flux_mrpc_check (flux_mrpc_t *mrpc)
 {
     assert (mrpc->magic == MRPC_MAGIC);
@@ -186,7 +330,7 @@ bool flux_mrpc_check (flux_mrpc_t *mrpc)
 #if HAVE_CALIPER
     cali_begin_string_byname ("flux.message.rpc", "single");
 #endif
-    if (!(mrpc->rx_msg = flux_recv (mrpc->h, mrpc->m, FLUX_O_NONBLOCK))) {
+    if (!(mrpc->rx_msg = mrpc_recv (mrpc, FLUX_O_NONBLOCK))) {
         if (errno == EAGAIN || errno == EWOULDBLOCK)
             errno = 0;
         else
@@ -211,7 +355,7 @@ static int mrpc_get (flux_mrpc_t *mrpc)
         cali_begin_string_byname ("flux.message.rpc", "single");
 #endif
 
-        if (!(mrpc->rx_msg = flux_recv (mrpc->h, mrpc->m, 0)))
+        if (!(mrpc->rx_msg = mrpc_recv (mrpc, 0)))
             mrpc->rx_errnum = errno;
 
 #if HAVE_CALIPER
@@ -308,23 +452,45 @@ done:
     return rc;
 }
 
+static void mrpc_deliver (flux_mrpc_t *mrpc, flux_msg_t *msg)
+{
+    if (mrpc->rx_msg || mrpc->rx_errnum)
+        (void)flux_mrpc_next (mrpc);
+    mrpc->rx_msg = msg;
+    mrpc->rx_count++;
+    mrpc->then_cb (mrpc, mrpc->then_arg);
+}
+
 /* Internal callback for matching response.
  * For the multi-response case, overwrite previous message if
  * flux_mrpc_next () was not called.
+ * The responses unpacked from a tree response are handed over one by one
+ * while the caller still holds a reference and a continuation.
  */
 static void mrpc_cb (flux_t *h, flux_msg_handler_t *mh,
                     const flux_msg_t *msg, void *arg)
 {
     flux_mrpc_t *mrpc = arg;
+    flux_msg_t *rx_msg;
     assert (mrpc->then_cb != NULL);
 
     flux_mrpc_usecount_incr (mrpc);
-    if (mrpc->rx_msg || mrpc->rx_errnum)
-        (void)flux_mrpc_next (mrpc);
-    if (!(mrpc->rx_msg = flux_msg_copy (msg, true)))
-        goto done;
-    mrpc->rx_count++;
-    mrpc->then_cb (mrpc, mrpc->then_arg);
+    if (is_tree_response (mrpc, msg)) {
+        if (tree_unpack (mrpc, msg) < 0) {
+            if (mrpc->rx_msg || mrpc->rx_errnum)
+                (void)flux_mrpc_next (mrpc);
+            mrpc->rx_errnum = errno;
+            mrpc->then_cb (mrpc, mrpc->then_arg);
+            goto done;
+        }
+        while (mrpc->then_cb && mrpc->usecount > 1
+                             && (rx_msg = zlist_pop (mrpc->rx_queue)))
+            mrpc_deliver (mrpc, rx_msg);
+    } else {
+        if (!(rx_msg = flux_msg_copy (msg, true)))
+            goto done;
+        mrpc_deliver (mrpc, rx_msg);
+    }
 done:
     if (mrpc->rx_count >= mrpc->rx_expected || flux_fatality (mrpc->h))
         flux_msg_handler_stop (mrpc->mh);
@@ -353,6 +519,15 @@ int flux_mrpc_then (flux_mrpc_t *mrpc, flux_mrpc_continuation_f cb, void *arg)
                     goto done;
             (void)flux_mrpc_next (mrpc);
         }
+        if (mrpc->rx_queue) {
+            flux_msg_t *msg;
+            while ((msg = zlist_pop (mrpc->rx_queue))) {
+                int rc = flux_requeue (mrpc->h, msg, FLUX_RQ_TAIL);
+                flux_msg_destroy (msg);
+                if (rc < 0)
+                    goto done;
+            }
+        }
     } else if (!cb && mrpc->then_cb) {
         flux_msg_handler_stop (mrpc->mh);
     }
@@ -408,6 +583,55 @@ error:
     return NULL;
 }
 
+static int mrpc_tree_send (flux_mrpc_t *mrpc, nodeset_t *ns, int flags,
+                           const flux_msg_t *msg)
+{
+    const char *topic;
+    const char *json_str = NULL;
+    json_t *o = NULL;
+    char *s = NULL;
+    flux_msg_t *req = NULL;
+    int rc = -1;
+
+    if ((nodeset_max (ns) & FLUX_MATCHTAG_GROUP_MASK) != 0) {
+        errno = ERANGE;
+        goto done;
+    }
+    if (flux_request_decode (msg, &topic, &json_str) < 0)
+        goto done;
+    if (!(mrpc->topic = strdup (topic))
+            || !(mrpc->nodeset = strdup (nodeset_string (ns)))
+            || !(mrpc->rx_queue = zlist_new ())) {
+        errno = ENOMEM;
+        goto done;
+    }
+    if (!(o = json_pack ("{s:s s:s s:b}",
+                         "topic", topic,
+                         "nodeset", mrpc->nodeset,
+                         "noresponse", (flags & FLUX_RPC_NORESPONSE) != 0))
+            || (json_str && json_object_set_new (o, "payload",
+                                                 json_string (json_str)) < 0)
+            || !(s = json_dumps (o, JSON_COMPACT))) {
+        errno = ENOMEM;
+        goto done;
+    }
+    if (!(req = flux_request_encode (mrpc_tree_topic, s)))
+        goto done;
+    if (flux_msg_set_matchtag (req, mrpc->m.matchtag) < 0)
+        goto done;
+    if (flux_msg_set_nodeid (req, 0, 0) < 0)
+        goto done;
+    if (flux_send (mrpc->h, req, 0) < 0)
+        goto done;
+    mrpc->tree = true;
+    rc = 0;
+done:
+    flux_msg_destroy (req);
+    free (s);
+    json_decref (o);
+    return rc;
+}
+
 static flux_mrpc_t *mrpc (flux_t *h,
                           const char *nodeset,
                           int flags,
@@ -451,6 +675,12 @@ static flux_mrpc_t *mrpc (flux_t *h,
         rx_expected = 0;
     if (!(mrpc = mrpc_create (h, rx_expected)))
         goto error;
+    if ((flags & FLUX_RPC_TREE) && count > 1) {
+        if (mrpc_tree_send (mrpc, ns, flags, msg) < 0)
+            goto error;
+        nodeset_destroy (ns);
+        return mrpc;
+    }
     if (!(itr = nodeset_iterator_create (ns)))
         goto error;
 #if HAVE_CALIPER
@@ -54,11 +54,20 @@ struct fastpath {
     int len;
 };
 
-
+/* Index for requests and unmatched responses:
+ * handlers with an exact topic are found by hashing the message topic,
+ * leaving only glob (or topic-less) handlers to be scanned in order.
+ * Handlers are numbered when they become active, and within each list,
+ * ordered newest first like the handlers list, so the first match is
+ * the same handler that a scan of the handlers list would find.
+ */
 struct dispatch {
     flux_t *h;
     zlist_t *handlers;
     zlist_t *handlers_new;
+    zhash_t *exact;         /* topic => zlist_t of handlers */
+    zlist_t *globs;
+    uint64_t seq;
     struct fastpath norm;
     struct fastpath group;
     flux_watcher_t *w;
@@ -80,6 +89,7 @@ struct flux_msg_handler {
     uint32_t rolemask;
     flux_msg_handler_f fn;
     void *arg;
+    uint64_t seq;           /* nonzero once indexed */
     uint8_t running:1;
 };
 
@@ -117,6 +127,11 @@ static void dispatch_usecount_decr (struct dispatch *d)
             assert (zlist_size (d->handlers_new) == 0);
             zlist_destroy (&d->handlers_new);
         }
+        if (d->globs) {
+            assert (zlist_size (d->globs) == 0);
+            zlist_destroy (&d->globs);
+        }
+        zhash_destroy (&d->exact);
         flux_watcher_destroy (d->w);
         fastpath_free (&d->norm);
         fastpath_free (&d->group);
@@ -149,6 +164,10 @@ static struct dispatch *dispatch_get (flux_t *h)
             goto nomem;
         if (!(d->handlers_new = zlist_new ()))
             goto nomem;
+        if (!(d->exact = zhash_new ()))
+            goto nomem;
+        if (!(d->globs = zlist_new ()))
+            goto nomem;
         d->h = h;
         d->w = flux_handle_watcher_create (r, h, FLUX_POLLIN, handle_cb, d);
         if (!d->w)
@@ -270,6 +289,96 @@ static void fastpath_response_unregister (struct dispatch *d, uint32_t tag)
         fastpath_clr (&d->norm, tag);
 }
 
+/* Topics are matched with fnmatch(3), so a topic containing any of its
+ * special characters must be treated as a glob.
+ */
+static bool is_exact_topic (const char *s)
+{
+    if (!s || strlen (s) == 0 || strpbrk (s, "*?[]\\"))
+        return false;
+    return true;
+}
+
+static void bucket_destroy (void *arg)
+{
+    zlist_t *bucket = arg;
+    zlist_destroy (&bucket);
+}
+
+static int index_add (struct dispatch *d, struct flux_msg_handler *mh)
+{
+    const char *topic = mh->match.topic_glob;
+    zlist_t *bucket;
+
+    if (is_exact_topic (topic)) {
+        if (!(bucket = zhash_lookup (d->exact, topic))) {
+            if (!(bucket = zlist_new ()))
+                goto nomem;
+            zhash_update (d->exact, topic, bucket);
+            zhash_freefn (d->exact, topic, bucket_destroy);
+        }
+        if (zlist_push (bucket, mh) < 0)
+            goto nomem;
+    }
+    else {
+        if (zlist_push (d->globs, mh) < 0)
+            goto nomem;
+    }
+    mh->seq = ++d->seq;
+    return 0;
+nomem:
+    errno = ENOMEM;
+    return -1;
+}
+
+static void index_remove (struct dispatch *d, struct flux_msg_handler *mh)
+{
+    const char *topic = mh->match.topic_glob;
+    zlist_t *bucket;
+
+    if (mh->seq == 0)
+        return;
+    if (is_exact_topic (topic)) {
+        if ((bucket = zhash_lookup (d->exact, topic))) {
+            zlist_remove (bucket, mh);
+            if (zlist_size (bucket) == 0)
+                zhash_delete (d->exact, topic);
+        }
+    }
+    else
+        zlist_remove (d->globs, mh);
+    mh->seq = 0;
+}
+
+/* Find the newest running handler that matches 'msg'.
+ * Globs older than the best exact match need not be checked.
+ */
+static struct flux_msg_handler *index_lookup (struct dispatch *d,
+                                              const flux_msg_t *msg)
+{
+    struct flux_msg_handler *mh;
+    struct flux_msg_handler *exact = NULL;
+    const char *topic;
+    zlist_t *bucket;
+
+    if (flux_msg_get_topic (msg, &topic) == 0
+                        && (bucket = zhash_lookup (d->exact, topic))) {
+        FOREACH_ZLIST (bucket, mh) {
+            if (mh->running && flux_msg_cmp (msg, mh->match)) {
+                exact = mh;
+                break;
+            }
+        }
+    }
+    FOREACH_ZLIST (d->globs, mh) {
+        if (exact && mh->seq < exact->seq)
+            break;
+        if (mh->running && flux_msg_cmp (msg, mh->match))
+            return mh;
+    }
+    return exact;
+}
+
 static int copy_match (struct flux_match *dst,
                        const struct flux_match src)
 {
@@ -317,37 +426,36 @@ static bool dispatch_message (struct dispatch *d,
             match = true;
         }
     }
-    /* slowpath */
-    if (!match) {
+    /* events are delivered to all matching handlers */
+    if (type == FLUX_MSGTYPE_EVENT) {
         FOREACH_ZLIST (d->handlers, mh) {
-            if (!mh->running)
-                continue;
-            if (flux_msg_cmp (msg, mh->match)) {
+            if (mh->running && flux_msg_cmp (msg, mh->match))
                 call_handler (mh, msg);
-                if (type != FLUX_MSGTYPE_EVENT) {
-                    match = true;
-                    break;
-                }
-            }
+        }
+    }
+    /* others are delivered to the first matching handler */
+    else if (!match) {
+        if ((mh = index_lookup (d, msg))) {
+            call_handler (mh, msg);
+            match = true;
         }
     }
     return match;
 }
 
-static int transfer_items_zlist (zlist_t *from, zlist_t *to)
+static int transfer_handlers_new (struct dispatch *d)
 {
-    void *item;
-    int rc = -1;
+    struct flux_msg_handler *mh;
 
-    while ((item = zlist_pop (from))) {
-        if (zlist_push (to, item) < 0) {
+    while ((mh = zlist_pop (d->handlers_new))) {
+        if (zlist_push (d->handlers, mh) < 0) {
             errno = ENOMEM;
-            goto done;
+            return -1;
         }
+        if (index_add (d, mh) < 0)
+            return -1;
     }
-    rc = 0;
-done:
-    return rc;
+    return 0;
 }
 
 static void handle_cb (flux_reactor_t *r,
@@ -378,7 +486,7 @@ static void handle_cb (flux_reactor_t *r,
     /* Add any new handlers here, making handler creation
      * safe to call during handlers list traversal below.
      */
-    if (transfer_items_zlist (d->handlers_new, d->handlers) < 0)
+    if (transfer_handlers_new (d) < 0)
         goto done;
 
 #if defined(HAVE_CALIPER)
@@ -508,6 +616,7 @@ void flux_msg_handler_destroy (flux_msg_handler_t *mh)
         } else {
             zlist_remove (mh->d->handlers_new, mh);
             zlist_remove (mh->d->handlers, mh);
+            index_remove (mh->d, mh);
         }
         flux_msg_handler_stop (mh);
         dispatch_usecount_decr (mh->d);
@@ -218,13 +218,21 @@ fatal:
     return -1;
 }
 
+/* Respond in the payload encoding of the request, if it had one.
+ */
 static int flux_respond_vpack (flux_t *h, const flux_msg_t *request,
                                const char *fmt, va_list ap)
 {
     flux_msg_t *msg = derive_response (h, request, 0);
+    int flags = 0;
     if (!msg)
         goto fatal;
-    if (flux_msg_vpack (msg, fmt, ap) < 0)
+    (void)flux_msg_get_payload (request, &flags, NULL, NULL);
+    if ((flags & FLUX_MSGFLAG_CBOR)) {
+        if (flux_msg_vpack_cbor (msg, fmt, ap) < 0)
+            goto fatal;
+    }
+    else if (flux_msg_vpack (msg, fmt, ap) < 0)
         goto fatal;
     if (flux_send (h, msg, 0) < 0)
         goto fatal;
@@ -267,6 +267,25 @@ done:
     return f;
 }
 
+flux_future_t *flux_rpc_message (flux_t *h,
+                                 const flux_msg_t *msg,
+                                 uint32_t nodeid,
+                                 int flags)
+{
+    flux_msg_t *cpy;
+    flux_future_t *f;
+
+    if (!msg) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(cpy = flux_msg_copy (msg, true)))
+        return NULL;
+    f = flux_rpc_msg (h, nodeid, flags, cpy);
+    flux_msg_destroy (cpy);
+    return f;
+}
+
 flux_future_t *flux_rpc_raw (flux_t *h,
                              const char *topic,
                              const void *data,
@@ -297,7 +316,11 @@ static flux_future_t *flux_rpc_vpack (flux_t *h,
 
     if (!(msg = flux_request_encode (topic, NULL)))
         goto done;
-    if (flux_msg_vpack (msg, fmt, ap) < 0)
+    if ((flags & FLUX_RPC_CBOR)) {
+        if (flux_msg_vpack_cbor (msg, fmt, ap) < 0)
+            goto done;
+    }
+    else if (flux_msg_vpack (msg, fmt, ap) < 0)
         goto done;
     f = flux_rpc_msg (h, nodeid, flags, msg);
 done:
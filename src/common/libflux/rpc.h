@@ -10,6 +10,8 @@ extern "C" {
 
 enum {
     FLUX_RPC_NORESPONSE = 1,
+    FLUX_RPC_CBOR = 2,      /* flux_rpc_pack: encode payload in CBOR */
+    FLUX_RPC_TREE = 4,      /* flux_mrpc: fan out over the overlay */
 };
 
 flux_future_t *flux_rpc (flux_t *h, const char *topic, const char *json_str,
@@ -22,6 +24,12 @@ flux_future_t *flux_rpc_raw (flux_t *h, const char *topic,
                              const void *data, int len,
                              uint32_t nodeid, int flags);
 
+/* Send a copy of request 'msg', e.g. one with credentials set by a service
+ * acting on behalf of the original requestor.
+ */
+flux_future_t *flux_rpc_message (flux_t *h, const flux_msg_t *msg,
+                                 uint32_t nodeid, int flags);
+
 int flux_rpc_get (flux_future_t *f, const char **json_str);
 
 int flux_rpc_get_unpack (flux_future_t *f, const char *fmt, ...);
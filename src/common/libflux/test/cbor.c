@@ -0,0 +1,183 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jansson.h>
+
+#include "src/common/libflux/cbor.h"
+#include "src/common/libtap/tap.h"
+
+/* Examples from RFC 7049 appendix A.
+ */
+struct example {
+    const char *json;
+    size_t size;
+    const char *cbor;
+};
+
+static struct example examples[] = {
+    { "0",                      1, "\x00" },
+    { "23",                     1, "\x17" },
+    { "24",                     2, "\x18\x18" },
+    { "100",                    2, "\x18\x64" },
+    { "1000",                   3, "\x19\x03\xe8" },
+    { "1000000",                5, "\x1a\x00\x0f\x42\x40" },
+    { "1000000000000",          9, "\x1b\x00\x00\x00\xe8\xd4\xa5\x10\x00" },
+    { "-1",                     1, "\x20" },
+    { "-100",                   2, "\x38\x63" },
+    { "-1000",                  3, "\x39\x03\xe7" },
+    { "1.1",                    9, "\xfb\x3f\xf1\x99\x99\x99\x99\x99\x9a" },
+    { "false",                  1, "\xf4" },
+    { "true",                   1, "\xf5" },
+    { "null",                   1, "\xf6" },
+    { "\"\"",                   1, "\x60" },
+    { "\"a\"",                  2, "\x61\x61" },
+    { "\"\\u00fc\"",            3, "\x62\xc3\xbc" },
+    { "[]",                     1, "\x80" },
+    { "[1,2,3]",                4, "\x83\x01\x02\x03" },
+    { "[1,[2,3],[4,5]]",        8, "\x83\x01\x82\x02\x03\x82\x04\x05" },
+    { "{}",                     1, "\xa0" },
+    { "{\"a\":1}",              4, "\xa1\x61\x61\x01" },
+    { "{\"a\":[2,3]}",          6, "\xa1\x61\x61\x82\x02\x03" },
+};
+
+/* Inputs that must be rejected with EPROTO.
+ */
+struct invalid {
+    const char *desc;
+    size_t size;
+    const char *cbor;
+};
+
+static struct invalid invalid[] = {
+    { "empty buffer",               0, "" },
+    { "truncated argument",         2, "\x19\x03" },
+    { "truncated string",           2, "\x62\x61" },
+    { "truncated array",            2, "\x82\x01" },
+    { "trailing data",              2, "\x01\x02" },
+    { "reserved additional info",   1, "\x1c" },
+    { "indefinite length array",    3, "\x9f\x01\xff" },
+    { "byte string",                2, "\x41\x00" },
+    { "tag",                        2, "\xc1\x01" },
+    { "half precision float",       3, "\xf9\x3c\x00" },
+    { "undefined",                  1, "\xf7" },
+    { "non-text map key",           3, "\xa1\x01\x02" },
+    { "string with NUL",            2, "\x61\x00" },
+    { "invalid UTF-8",              2, "\x61\xff" },
+    { "float64 NaN",                9, "\xfb\x7f\xf8\x00\x00\x00\x00\x00\x00" },
+    { "uint beyond int64",          9, "\x1b\xff\xff\xff\xff\xff\xff\xff\xff" },
+    { "array count beyond buffer",  5, "\x9a\xff\xff\xff\xff" },
+};
+
+void check_examples (void)
+{
+    json_t *o, *o2;
+    void *buf;
+    size_t size;
+    int i;
+
+    for (i = 0; i < sizeof (examples) / sizeof (examples[0]); i++) {
+        struct example *ex = &examples[i];
+        if (!(o = json_loads (ex->json, JSON_DECODE_ANY, NULL)))
+            BAIL_OUT ("could not parse %s", ex->json);
+        buf = cbor_encode (o, &size);
+        ok (buf != NULL && size == ex->size
+            && memcmp (buf, ex->cbor, size) == 0,
+            "cbor_encode %s works", ex->json);
+        free (buf);
+        o2 = cbor_decode (ex->cbor, ex->size);
+        ok (o2 != NULL && json_equal (o, o2),
+            "cbor_decode %s works", ex->json);
+        json_decref (o2);
+        json_decref (o);
+    }
+}
+
+void check_float32 (void)
+{
+    json_t *o;
+
+    o = cbor_decode ("\xfa\x47\xc3\x50\x00", 5);
+    ok (o != NULL && json_is_real (o) && json_real_value (o) == 100000.0,
+        "cbor_decode accepts single precision float");
+    json_decref (o);
+}
+
+void check_invalid (void)
+{
+    json_t *o;
+    int i;
+
+    for (i = 0; i < sizeof (invalid) / sizeof (invalid[0]); i++) {
+        errno = 0;
+        o = cbor_decode (invalid[i].cbor, invalid[i].size);
+        ok (o == NULL && errno == EPROTO,
+            "cbor_decode fails with EPROTO on %s", invalid[i].desc);
+        json_decref (o);
+    }
+    errno = 0;
+    ok (cbor_decode (NULL, 0) == NULL && errno == EINVAL,
+        "cbor_decode buf=NULL fails with EINVAL");
+    errno = 0;
+    ok (cbor_encode (NULL, NULL) == NULL && errno == EINVAL,
+        "cbor_encode o=NULL fails with EINVAL");
+}
+
+void check_roundtrip (void)
+{
+    json_t *o, *o2;
+    void *buf;
+    size_t size;
+    char *s;
+    char key[64];
+    int i;
+
+    /* Long strings and large containers use multi-byte lengths.
+     */
+    if (!(s = malloc (70000)))
+        BAIL_OUT ("out of memory");
+    memset (s, 'x', 69999);
+    s[69999] = '\0';
+    if (!(o = json_pack ("{s:s s:I s:I s:f s:[i,b,n]}",
+                         "long", s,
+                         "min", (json_int_t)INT64_MIN,
+                         "max", (json_int_t)INT64_MAX,
+                         "real", -0.25,
+                         "array", 1, 0)))
+        BAIL_OUT ("json_pack failed");
+    for (i = 0; i < 1000; i++) {
+        snprintf (key, sizeof (key), "a-key-long-enough-to-need-more-space-%d",
+                  i);
+        if (json_object_set_new (o, key, json_integer (i)) < 0)
+            BAIL_OUT ("json_object_set_new failed");
+    }
+    buf = cbor_encode (o, &size);
+    ok (buf != NULL,
+        "cbor_encode works on large object");
+    o2 = buf ? cbor_decode (buf, size) : NULL;
+    ok (o2 != NULL && json_equal (o, o2),
+        "cbor_decode returns equivalent object");
+    ok (buf != NULL && cbor_decode (buf, size - 1) == NULL && errno == EPROTO,
+        "cbor_decode fails with EPROTO on truncated object");
+    json_decref (o2);
+    json_decref (o);
+    free (buf);
+    free (s);
+}
+
+int main (int argc, char *argv[])
+{
+    plan (NO_PLAN);
+
+    check_examples ();
+    check_float32 ();
+    check_invalid ();
+    check_roundtrip ();
+
+    done_testing ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
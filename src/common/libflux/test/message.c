@@ -4,6 +4,8 @@
 #include <czmq.h>
 #include <errno.h>
 #include <stdio.h>
+#include <sys/socket.h>
+#include <jansson.h>
 
 #include "src/common/libflux/message.h"
 #include "src/common/libtap/tap.h"
@@ -165,6 +167,86 @@ void check_payload_json (void)
     flux_msg_destroy (msg);
 }
 
+void check_payload_cbor (void)
+{
+    flux_msg_t *msg, *msg2;
+    const char *s;
+    const void *buf;
+    int size, flags, i;
+    void *ebuf;
+    size_t esize;
+    json_t *o = NULL, *o2 = NULL;
+
+    ok ((msg = flux_msg_create (FLUX_MSGTYPE_REQUEST)) != NULL,
+       "flux_msg_create works");
+    errno = 0;
+    ok (flux_msg_pack_cbor (msg, "[i,i,i]", 1, 2, 3) < 0 && errno == EINVAL,
+       "flux_msg_pack_cbor array fails with EINVAL");
+    ok (flux_msg_pack_cbor (msg, "{s:i s:s s:[i,i]}",
+                            "foo", 42, "bar", "baz", "a", 1, 2) == 0,
+       "flux_msg_pack_cbor works");
+    ok (flux_msg_get_payload (msg, &flags, &buf, &size) == 0
+            && flags == FLUX_MSGFLAG_CBOR && size > 0
+            && *(uint8_t *)buf == 0xa3,
+       "payload is a CBOR map with FLUX_MSGFLAG_CBOR set");
+    i = 0;
+    s = NULL;
+    ok (flux_msg_unpack (msg, "{s:i s:s}", "foo", &i, "bar", &s) == 0
+            && i == 42 && s && !strcmp (s, "baz"),
+       "flux_msg_unpack decodes CBOR payload");
+    ok (flux_msg_get_json (msg, &s) == 0 && s != NULL
+            && (o = json_loads (s, 0, NULL)) != NULL
+            && (o2 = json_pack ("{s:i s:s s:[i,i]}",
+                                "foo", 42, "bar", "baz", "a", 1, 2)) != NULL
+            && json_equal (o, o2),
+       "flux_msg_get_json renders CBOR payload as JSON");
+    json_decref (o);
+    json_decref (o2);
+
+    /* Encoding flag survives encode/decode.
+     */
+    esize = flux_msg_encode_size (msg);
+    ebuf = malloc (esize);
+    assert (ebuf != NULL);
+    ok (flux_msg_encode (msg, ebuf, esize) == 0
+            && (msg2 = flux_msg_decode (ebuf, esize)) != NULL,
+       "encoded and decoded message");
+    free (ebuf);
+    i = 0;
+    ok (flux_msg_get_payload (msg2, &flags, NULL, NULL) == 0
+            && flags == FLUX_MSGFLAG_CBOR
+            && flux_msg_unpack (msg2, "{s:i}", "foo", &i) == 0 && i == 42,
+       "decoded message has CBOR payload");
+    flux_msg_destroy (msg2);
+
+    /* Replacing the payload clears the encoding flag and cached decodings.
+     */
+    ok (flux_msg_pack (msg, "{s:i}", "foo", 43) == 0
+            && flux_msg_get_payload (msg, &flags, NULL, NULL) == 0
+            && flags == FLUX_MSGFLAG_JSON
+            && flux_msg_unpack (msg, "{s:i}", "foo", &i) == 0 && i == 43
+            && flux_msg_get_json (msg, &s) == 0 && !strcmp (s, "{\"foo\":43}"),
+       "flux_msg_pack replaces CBOR payload with JSON");
+
+    /* Using the lower level flux_msg_set_payload with FLUX_MSGFLAG_CBOR
+     * we can sneak in a malformed CBOR payload and test decoding.
+     */
+    errno = 0;
+    ok (flux_msg_set_payload (msg, FLUX_MSGFLAG_CBOR, "\x83\x01\x02\x03", 4)
+            == 0 && flux_msg_get_json (msg, &s) < 0 && errno == EPROTO,
+        "flux_msg_get_json CBOR array fails with EPROTO");
+    errno = 0;
+    ok (flux_msg_set_payload (msg, FLUX_MSGFLAG_CBOR, "\xa1\x61", 2) == 0
+            && flux_msg_unpack (msg, "{s:i}", "a", &i) < 0 && errno == EPROTO,
+        "flux_msg_unpack truncated CBOR fails with EPROTO");
+    errno = 0;
+    ok (flux_msg_set_payload (msg, FLUX_MSGFLAG_CBOR | FLUX_MSGFLAG_JSON,
+                              "\xa0", 1) < 0 && errno == EINVAL,
+        "flux_msg_set_payload with both encoding flags fails with EINVAL");
+
+    flux_msg_destroy (msg);
+}
+
 void check_payload_json_formatted (void)
 {
     flux_msg_t *msg;
@@ -502,6 +584,78 @@ void check_encode (void)
     flux_msg_destroy (msg2);
 }
 
+/* Encode/decode a routed request with a payload, which is carried
+ * separately from the other frames.
+ */
+void check_encode_payload (void)
+{
+    flux_msg_t *msg, *msg2;
+    void *buf;
+    size_t size;
+    char pay[1024];
+    const void *buf2;
+    int size2;
+    const char *topic;
+    char *s = NULL;
+
+    memset (pay, 'p', sizeof (pay));
+    ok ((msg = flux_msg_create (FLUX_MSGTYPE_REQUEST)) != NULL
+            && flux_msg_enable_route (msg) == 0
+            && flux_msg_push_route (msg, "id1") == 0
+            && flux_msg_set_topic (msg, "foo.bar") == 0
+            && flux_msg_set_payload (msg, 0, pay, sizeof (pay)) == 0,
+        "created routed request with payload");
+    size = flux_msg_encode_size (msg);
+    buf = malloc (size);
+    assert (buf != NULL);
+    ok (flux_msg_encode (msg, buf, size) == 0,
+        "flux_msg_encode works");
+    ok (flux_msg_encode (msg, buf, size - 1) < 0 && errno == EINVAL,
+        "flux_msg_encode fails with EINVAL if buffer is too small");
+    ok ((msg2 = flux_msg_decode (buf, size)) != NULL,
+        "flux_msg_decode works");
+    ok (flux_msg_decode (buf, size - 1) == NULL && errno == EINVAL,
+        "flux_msg_decode fails with EINVAL on truncated buffer");
+    free (buf);
+    ok (flux_msg_frames (msg2) == 5,
+        "decoded message has 5 frames");
+    ok (flux_msg_get_route_first (msg2, &s) == 0 && s && !strcmp (s, "id1"),
+        "decoded expected route");
+    free (s);
+    ok (flux_msg_get_topic (msg2, &topic) == 0 && !strcmp (topic, "foo.bar"),
+        "decoded expected topic string");
+    ok (flux_msg_get_payload (msg2, NULL, &buf2, &size2) == 0
+            && size2 == sizeof (pay) && memcmp (buf2, pay, size2) == 0,
+        "decoded expected payload");
+    flux_msg_destroy (msg);
+    flux_msg_destroy (msg2);
+}
+
+/* The payload flag set in the proto frame without a payload frame
+ * is a protocol error.
+ */
+void check_decode_proto (void)
+{
+    flux_msg_t *msg;
+    uint8_t *buf;
+    size_t size;
+
+    ok ((msg = flux_msg_create (FLUX_MSGTYPE_REQUEST)) != NULL
+            && flux_msg_set_topic (msg, "foo.bar") == 0,
+        "created request with topic and no payload");
+    size = flux_msg_encode_size (msg);
+    buf = malloc (size);
+    assert (buf != NULL);
+    ok (flux_msg_encode (msg, buf, size) == 0,
+        "flux_msg_encode works");
+    buf[size - 20 + 3] |= FLUX_MSGFLAG_PAYLOAD; /* proto flags */
+    errno = 0;
+    ok (flux_msg_decode (buf, size) == NULL && errno == EPROTO,
+        "flux_msg_decode fails with EPROTO if payload frame is missing");
+    free (buf);
+    flux_msg_destroy (msg);
+}
+
 /* Send a small message over a blocking pipe.
  * We assume that there's enough buffer to do this in one go.
  */
@@ -535,6 +689,125 @@ void check_sendfd (void)
     close (pfd[0]);
 }
 
+/* Queue several messages, including one larger than the reader's default
+ * buffer, send them with one flush, and read them back over a
+ * non-blocking socketpair.
+ */
+void check_reader_writer (void)
+{
+    int sfd[2];
+    flux_msg_writer_t *w;
+    flux_msg_reader_t *r;
+    flux_msg_t *msg;
+    const char *topic;
+    const void *buf;
+    int size;
+    char *big;
+    int i, count, errors;
+
+    ok (socketpair (PF_LOCAL, SOCK_STREAM | SOCK_NONBLOCK, 0, sfd) == 0,
+        "got non-blocking socketpair");
+    ok ((w = flux_msg_writer_create (sfd[0])) != NULL,
+        "flux_msg_writer_create works");
+    ok ((r = flux_msg_reader_create (sfd[1])) != NULL,
+        "flux_msg_reader_create works");
+    errno = 0;
+    ok (flux_msg_reader_create (-1) == NULL && errno == EINVAL,
+        "flux_msg_reader_create fd=-1 fails with EINVAL");
+    ok (flux_msg_reader_pending (r) == false,
+        "flux_msg_reader_pending returns false on empty reader");
+    errno = 0;
+    ok (flux_msg_reader_recv (r) == NULL
+        && (errno == EAGAIN || errno == EWOULDBLOCK),
+        "flux_msg_reader_recv fails with EAGAIN when no data is ready");
+
+    errors = 0;
+    for (i = 0; i < 16; i++) {
+        char s[32];
+        snprintf (s, sizeof (s), "foo.%d", i);
+        if (!(msg = flux_msg_create (FLUX_MSGTYPE_EVENT))
+                || flux_msg_set_topic (msg, s) < 0
+                || flux_msg_writer_push (w, msg) < 0)
+            errors++;
+        flux_msg_destroy (msg);
+    }
+    ok (errors == 0,
+        "flux_msg_writer_push queued 16 messages");
+    if (!(big = malloc (100000)))
+        BAIL_OUT ("out of memory");
+    memset (big, 'x', 100000);
+    if (!(msg = flux_msg_create (FLUX_MSGTYPE_REQUEST))
+            || flux_msg_set_topic (msg, "foo.big") < 0
+            || flux_msg_set_payload (msg, 0, big, 100000) < 0)
+        BAIL_OUT ("could not create large message");
+    ok (flux_msg_writer_push (w, msg) == 0,
+        "flux_msg_writer_push queued a 100K message");
+    flux_msg_destroy (msg);
+    ok (flux_msg_writer_count (w) == 17,
+        "flux_msg_writer_count returns 17");
+
+    /* Alternate flushing and reading, since the socket buffer may not
+     * hold everything at once.
+     */
+    count = errors = 0;
+    while (count < 17) {
+        if (flux_msg_writer_flush (w) < 0
+                && errno != EAGAIN && errno != EWOULDBLOCK)
+            break;
+        while ((msg = flux_msg_reader_recv (r))) {
+            char s[32];
+            if (count < 16)
+                snprintf (s, sizeof (s), "foo.%d", count);
+            else
+                snprintf (s, sizeof (s), "foo.big");
+            if (flux_msg_get_topic (msg, &topic) < 0 || strcmp (topic, s) != 0)
+                errors++;
+            if (count == 16 && (flux_msg_get_payload (msg, NULL, &buf,
+                                                      &size) < 0
+                                || size != 100000
+                                || memcmp (buf, big, size) != 0))
+                errors++;
+            flux_msg_destroy (msg);
+            count++;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            break;
+    }
+    ok (count == 17 && errors == 0,
+        "flux_msg_reader_recv returned all messages in order");
+    ok (flux_msg_writer_count (w) == 0,
+        "flux_msg_writer_count returns 0 after flush");
+    ok (flux_msg_reader_pending (r) == false,
+        "flux_msg_reader_pending returns false after all were received");
+
+    /* Two small messages written together are both buffered by one read.
+     */
+    if (!(msg = flux_msg_create (FLUX_MSGTYPE_EVENT))
+            || flux_msg_writer_push (w, msg) < 0
+            || flux_msg_writer_push (w, msg) < 0
+            || flux_msg_writer_flush (w) < 0)
+        BAIL_OUT ("could not send two messages");
+    flux_msg_destroy (msg);
+    msg = flux_msg_reader_recv (r);
+    ok (msg != NULL && flux_msg_reader_pending (r) == true,
+        "flux_msg_reader_pending returns true with a message buffered");
+    flux_msg_destroy (msg);
+    msg = flux_msg_reader_recv (r);
+    ok (msg != NULL && flux_msg_reader_pending (r) == false,
+        "flux_msg_reader_recv returned buffered message");
+    flux_msg_destroy (msg);
+
+    close (sfd[0]);
+    errno = 0;
+    ok (flux_msg_reader_recv (r) == NULL && errno == EPROTO,
+        "flux_msg_reader_recv fails with EPROTO on EOF");
+
+    free (big);
+    flux_msg_writer_destroy (w);
+    flux_msg_reader_destroy (r);
+    close (sfd[1]);
+}
+
 void check_sendzsock (void)
 {
     zsock_t *zsock[2] = { NULL, NULL };
@@ -542,6 +815,11 @@ void check_sendzsock (void)
     const char *topic;
     int type;
     const char *uri = "inproc://test";
+    char buf[1024];
+    const void *buf2;
+    int size;
+
+    memset (buf, 'x', sizeof (buf));
 
     ok ((zsock[0] = zsock_new_pair (NULL)) != NULL
                     && zsock_bind (zsock[0], "%s", uri) == 0
@@ -575,6 +853,21 @@ void check_sendzsock (void)
             && flux_msg_has_payload (msg2) == false,
         "try2: decoded message looks like what was sent");
     flux_msg_destroy (msg2);
+
+    /* Send it with a payload.
+     */
+    ok (flux_msg_set_payload (msg, 0, buf, sizeof (buf)) == 0,
+        "try3: added payload");
+    ok (flux_msg_sendzsock (zsock[1], msg) == 0,
+        "try3: flux_msg_sendzsock works");
+    ok ((msg2 = flux_msg_recvzsock (zsock[0])) != NULL,
+        "try3: flux_msg_recvzsock works");
+    ok (flux_msg_get_topic (msg2, &topic) == 0 && !strcmp (topic, "foo.bar")
+            && flux_msg_get_payload (msg2, NULL, &buf2, &size) == 0
+            && size == sizeof (buf) && memcmp (buf2, buf, size) == 0
+            && flux_msg_frames (msg2) == 3,
+        "try3: decoded message looks like what was sent");
+    flux_msg_destroy (msg2);
     flux_msg_destroy (msg);
 
     zsock_destroy (&zsock[0]);
@@ -659,6 +952,49 @@ void check_copy (void)
     flux_msg_destroy (msg);
 }
 
+/* Copies share the payload buffer until one of them sets a new payload.
+ */
+void check_copy_payload (void)
+{
+    flux_msg_t *msg, *cpy;
+    char buf[4096];
+    char buf2[4096];
+    const void *pay, *cpypay;
+    int len, cpylen;
+
+    memset (buf, 'a', sizeof (buf));
+    memset (buf2, 'b', sizeof (buf2));
+    ok ((msg = flux_msg_create (FLUX_MSGTYPE_EVENT)) != NULL
+            && flux_msg_set_topic (msg, "foo") == 0
+            && flux_msg_set_payload (msg, 0, buf, sizeof (buf)) == 0,
+        "created event with payload");
+    ok ((cpy = flux_msg_copy (msg, true)) != NULL,
+        "flux_msg_copy works");
+    ok (flux_msg_get_payload (msg, NULL, &pay, &len) == 0
+            && flux_msg_get_payload (cpy, NULL, &cpypay, &cpylen) == 0
+            && pay == cpypay && len == cpylen,
+        "copy shares payload buffer with original");
+    ok (flux_msg_frames (cpy) == 3,
+        "copy has 3 frames");
+    ok (flux_msg_set_payload (cpy, 0, buf2, sizeof (buf2)) == 0,
+        "set new payload on copy");
+    ok (flux_msg_get_payload (cpy, NULL, &cpypay, &cpylen) == 0
+            && cpypay != pay && cpylen == sizeof (buf2)
+            && memcmp (cpypay, buf2, cpylen) == 0,
+        "copy has new payload");
+    ok (flux_msg_get_payload (msg, NULL, &pay, &len) == 0
+            && len == sizeof (buf) && memcmp (pay, buf, len) == 0,
+        "original payload is unchanged");
+    flux_msg_destroy (msg);
+    ok (flux_msg_get_payload (cpy, NULL, &cpypay, &cpylen) == 0
+            && cpylen == sizeof (buf2) && memcmp (cpypay, buf2, cpylen) == 0,
+        "copy payload survives destruction of original");
+    ok (flux_msg_set_payload (cpy, 0, NULL, 0) == 0
+            && !flux_msg_has_payload (cpy) && flux_msg_frames (cpy) == 2,
+        "payload can be removed from copy");
+    flux_msg_destroy (cpy);
+}
+
 void check_print (void)
 {
     flux_msg_t *msg;
@@ -716,15 +1052,20 @@ int main (int argc, char *argv[])
     check_payload ();
     check_payload_json ();
     check_payload_json_formatted ();
+    check_payload_cbor ();
     check_matchtag ();
     check_security ();
     check_aux ();
     check_copy ();
+    check_copy_payload ();
 
     check_cmp ();
 
     check_encode ();
+    check_encode_payload ();
+    check_decode_proto ();
     check_sendfd ();
+    check_reader_writer ();
     check_sendzsock ();
 
     //check_print ();
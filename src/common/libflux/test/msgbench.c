@@ -0,0 +1,139 @@
+/* msgbench.c - measure the cost of fanning out a message to many peers
+ *
+ * Usage: msgbench [children]
+ *
+ * For a range of payload sizes, send an event to each of 'children'
+ * (default 256) inproc sockets the way the overlay multicasts to its
+ * children:  copy the message, push a route, and send it.  Two methods are
+ * timed: "shared", where each copy shares the original payload buffer, and
+ * "deep", which emulates the old behavior by giving each copy its own copy
+ * of the payload.  Receiving is not timed.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <czmq.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/common/libflux/message.h"
+#include "src/common/libutil/monotime.h"
+#include "src/common/libutil/log.h"
+
+static const int iterations = 8;
+
+static flux_msg_t *copy_shared (const flux_msg_t *msg)
+{
+    return flux_msg_copy (msg, true);
+}
+
+static flux_msg_t *copy_deep (const flux_msg_t *msg)
+{
+    flux_msg_t *cpy;
+    const void *buf;
+    int size;
+
+    if (!(cpy = flux_msg_copy (msg, false))
+            || flux_msg_get_payload (msg, NULL, &buf, &size) < 0
+            || flux_msg_set_payload (cpy, 0, buf, size) < 0)
+        log_err_exit ("copy_deep");
+    return cpy;
+}
+
+/* Return elapsed time (msec) to send 'msg' to all children.
+ */
+static double fanout (const flux_msg_t *msg, zsock_t **tx, zsock_t **rx,
+                      int children, flux_msg_t *(*copy)(const flux_msg_t *))
+{
+    struct timespec t0;
+    flux_msg_t *cpy;
+    char id[16];
+    double ms;
+    int i;
+
+    monotime (&t0);
+    for (i = 0; i < children; i++) {
+        snprintf (id, sizeof (id), "%d", i);
+        if (!(cpy = copy (msg))
+                || flux_msg_enable_route (cpy) < 0
+                || flux_msg_push_route (cpy, id) < 0
+                || flux_msg_sendzsock (tx[i], cpy) < 0)
+            log_err_exit ("sending to child %d", i);
+        flux_msg_destroy (cpy);
+    }
+    ms = monotime_since (t0);
+    for (i = 0; i < children; i++) {
+        if (!(cpy = flux_msg_recvzsock (rx[i])))
+            log_err_exit ("receiving from child %d", i);
+        flux_msg_destroy (cpy);
+    }
+    return ms;
+}
+
+int main (int argc, char *argv[])
+{
+    int sizes[] = { 64, 1024, 65536, 1024*1024 };
+    int children = 256;
+    zsock_t **tx, **rx;
+    flux_msg_t *msg;
+    char *payload;
+    char uri[64];
+    double shared_ms, deep_ms;
+    int i, j;
+
+    log_init ("msgbench");
+    if (argc > 2) {
+        fprintf (stderr, "Usage: msgbench [children]\n");
+        exit (1);
+    }
+    if (argc == 2)
+        children = strtoul (argv[1], NULL, 10);
+    if (children < 1)
+        log_msg_exit ("children must be > 0");
+    if (!(tx = calloc (children, sizeof (tx[0])))
+            || !(rx = calloc (children, sizeof (rx[0]))))
+        log_msg_exit ("out of memory");
+    for (i = 0; i < children; i++) {
+        snprintf (uri, sizeof (uri), "inproc://msgbench-%d", i);
+        if (!(rx[i] = zsock_new_pair (NULL))
+                || zsock_bind (rx[i], "%s", uri) < 0
+                || !(tx[i] = zsock_new_pair (uri)))
+            log_err_exit ("creating inproc socket pair %d", i);
+    }
+
+    printf ("%10s %10s %12s %12s\n", "payload", "children",
+            "shared(ms)", "deep(ms)");
+    for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+        if (!(payload = malloc (sizes[i])))
+            log_msg_exit ("out of memory");
+        memset (payload, 'x', sizes[i]);
+        if (!(msg = flux_msg_create (FLUX_MSGTYPE_EVENT))
+                || flux_msg_set_topic (msg, "msgbench.event") < 0
+                || flux_msg_set_payload (msg, 0, payload, sizes[i]) < 0)
+            log_err_exit ("creating event");
+        shared_ms = deep_ms = 0;
+        for (j = 0; j < iterations; j++) {
+            shared_ms += fanout (msg, tx, rx, children, copy_shared);
+            deep_ms += fanout (msg, tx, rx, children, copy_deep);
+        }
+        printf ("%10d %10d %12.3f %12.3f\n", sizes[i], children,
+                shared_ms / iterations, deep_ms / iterations);
+        flux_msg_destroy (msg);
+        free (payload);
+    }
+
+    for (i = 0; i < children; i++) {
+        zsock_destroy (&tx[i]);
+        zsock_destroy (&rx[i]);
+    }
+    free (tx);
+    free (rx);
+    log_fini ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
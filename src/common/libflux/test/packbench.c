@@ -0,0 +1,147 @@
+/* packbench.c - compare JSON and CBOR payload encoding of kvs.fence requests
+ *
+ * Usage: packbench [clients]
+ *
+ * Pack one kvs.fence request per client (default 1024), each carrying a
+ * transaction of 'ops' put operations shaped like those created by libkvs,
+ * then unpack them all as the kvs module does.  For each encoding, report
+ * the payload size of one request and the total time to pack and unpack
+ * the requests of all clients.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jansson.h>
+
+#include "src/common/libflux/message.h"
+#include "src/common/libutil/monotime.h"
+#include "src/common/libutil/log.h"
+
+/* A treeobj val containing a base64-encoded 48 byte PMI value.
+ */
+static const char *value =
+    "a2V5LXZhbHVlLXBhaXItZnJvbS1wbWktcHV0LWluY2x1ZGluZy1idXNpbmVzcy1jYXJk";
+
+static json_t *create_ops (int client, int count)
+{
+    json_t *ops, *op;
+    char key[64];
+    int i;
+
+    if (!(ops = json_array ()))
+        log_msg_exit ("json_array");
+    for (i = 0; i < count; i++) {
+        snprintf (key, sizeof (key), "lwj.0.0.1.pmi.kvs-%d-%d", client, i);
+        if (!(op = json_pack ("{s:s s:i s:{s:i s:s s:s}}",
+                              "key", key,
+                              "flags", 0,
+                              "dirent",
+                                "ver", 1,
+                                "type", "val",
+                                "data", value))
+                || json_array_append_new (ops, op) < 0)
+            log_msg_exit ("json_pack");
+    }
+    return ops;
+}
+
+static int pack (flux_msg_t *msg, bool cbor, json_t *ops, int clients)
+{
+    const char *fmt = "{s:s s:i s:s s:i s:O}";
+
+    if (cbor)
+        return flux_msg_pack_cbor (msg, fmt, "name", "pmi-barrier-1",
+                                   "nprocs", clients, "namespace", "primary",
+                                   "flags", 0, "ops", ops);
+    return flux_msg_pack (msg, fmt, "name", "pmi-barrier-1",
+                          "nprocs", clients, "namespace", "primary",
+                          "flags", 0, "ops", ops);
+}
+
+static void bench (int clients, int nops, bool cbor)
+{
+    flux_msg_t **msgs;
+    json_t **ops;
+    json_t *o;
+    const char *name, *namespace;
+    int nprocs, flags;
+    int size = 0;
+    struct timespec t0;
+    double pack_ms, unpack_ms;
+    int i;
+
+    if (!(msgs = calloc (clients, sizeof (msgs[0])))
+            || !(ops = calloc (clients, sizeof (ops[0]))))
+        log_msg_exit ("out of memory");
+    for (i = 0; i < clients; i++) {
+        ops[i] = create_ops (i, nops);
+        if (!(msgs[i] = flux_msg_create (FLUX_MSGTYPE_REQUEST)))
+            log_err_exit ("flux_msg_create");
+    }
+
+    monotime (&t0);
+    for (i = 0; i < clients; i++) {
+        if (pack (msgs[i], cbor, ops[i], clients) < 0)
+            log_err_exit ("pack");
+    }
+    pack_ms = monotime_since (t0);
+
+    monotime (&t0);
+    for (i = 0; i < clients; i++) {
+        if (flux_msg_unpack (msgs[i], "{s:o s:s s:s s:i s:i}",
+                             "ops", &o,
+                             "name", &name,
+                             "namespace", &namespace,
+                             "flags", &flags,
+                             "nprocs", &nprocs) < 0)
+            log_err_exit ("unpack");
+    }
+    unpack_ms = monotime_since (t0);
+
+    if (flux_msg_get_payload (msgs[0], NULL, NULL, &size) < 0)
+        log_err_exit ("flux_msg_get_payload");
+    printf ("%8d %6d %8s %10d %12.3f %12.3f\n", clients, nops,
+            cbor ? "cbor" : "json", size, pack_ms, unpack_ms);
+
+    for (i = 0; i < clients; i++) {
+        flux_msg_destroy (msgs[i]);
+        json_decref (ops[i]);
+    }
+    free (msgs);
+    free (ops);
+}
+
+int main (int argc, char *argv[])
+{
+    int nops[] = { 1, 16, 256 };
+    int clients = 1024;
+    int i;
+
+    log_init ("packbench");
+    if (argc > 2) {
+        fprintf (stderr, "Usage: packbench [clients]\n");
+        exit (1);
+    }
+    if (argc == 2)
+        clients = strtoul (argv[1], NULL, 10);
+    if (clients < 1)
+        log_msg_exit ("clients must be > 0");
+
+    printf ("%8s %6s %8s %10s %12s %12s\n", "clients", "ops", "encoding",
+            "bytes", "pack(ms)", "unpack(ms)");
+    for (i = 0; i < sizeof (nops) / sizeof (nops[0]); i++) {
+        bench (clients, nops[i], false);
+        bench (clients, nops[i], true);
+    }
+
+    log_fini ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
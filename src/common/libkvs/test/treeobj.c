@@ -357,6 +357,80 @@ void test_dir (void)
     json_decref (dir);
 }
 
+void test_hdir (void)
+{
+    json_t *hdir, *bucket, *dirref, *val;
+    char key[TREEOBJ_HDIR_MAX_KEYLEN + 1];
+    char key2[TREEOBJ_HDIR_MAX_KEYLEN + 1];
+    char *s;
+
+    bucket = treeobj_create_dir ();
+    dirref = treeobj_create_dirref (blobrefs[0]);
+    val = treeobj_create_val ("foo", 4);
+    if (!bucket || !dirref || !val)
+        BAIL_OUT ("can't continue without test values");
+
+    ok (treeobj_hdir_key ("foo", 8, key) == 0 && strlen (key) == 8,
+        "treeobj_hdir_key keylen=8 works");
+    ok (treeobj_hdir_key ("foo", 2, key2) == 0 && strlen (key2) == 2
+            && !strncmp (key, key2, 2),
+        "treeobj_hdir_key keylen=2 returns prefix of longer key");
+    ok (treeobj_hdir_key ("", 1, key) == 0 && !strcmp (key, "8"),
+        "treeobj_hdir_key of empty name is FNV-1a offset basis prefix");
+    errno = 0;
+    ok (treeobj_hdir_key ("foo", 0, key) < 0 && errno == EINVAL,
+        "treeobj_hdir_key keylen=0 fails with EINVAL");
+    errno = 0;
+    ok (treeobj_hdir_key ("foo", TREEOBJ_HDIR_MAX_KEYLEN + 1, key) < 0
+            && errno == EINVAL,
+        "treeobj_hdir_key keylen too long fails with EINVAL");
+
+    ok ((hdir = treeobj_create_hdir ()) != NULL,
+        "treeobj_create_hdir works");
+    ok (treeobj_is_hdir (hdir) && !treeobj_is_dir (hdir),
+        "treeobj_is_hdir returns true, treeobj_is_dir false");
+    ok (treeobj_validate (hdir) == 0,
+        "treeobj_validate likes empty hdir");
+    errno = 0;
+    ok (treeobj_hdir_keylen (hdir) < 0 && errno == EINVAL,
+        "treeobj_hdir_keylen fails with EINVAL on empty hdir");
+    ok (treeobj_insert_entry (hdir, "3f", bucket) == 0
+            && treeobj_insert_entry (hdir, "a0", dirref) == 0
+            && treeobj_get_count (hdir) == 2,
+        "treeobj_insert_entry adds dir and dirref buckets");
+    ok (treeobj_hdir_keylen (hdir) == 2,
+        "treeobj_hdir_keylen returns bucket key length");
+    ok (treeobj_validate (hdir) == 0,
+        "treeobj_validate likes populated hdir");
+    errno = 0;
+    ok (treeobj_insert_entry (hdir, "3", bucket) < 0 && errno == EINVAL,
+        "treeobj_insert_entry fails with EINVAL on wrong key length");
+    errno = 0;
+    ok (treeobj_insert_entry (hdir, "3G", bucket) < 0 && errno == EINVAL,
+        "treeobj_insert_entry fails with EINVAL on non-hex key");
+    errno = 0;
+    ok (treeobj_insert_entry (hdir, "3e", val) < 0 && errno == EINVAL,
+        "treeobj_insert_entry fails with EINVAL on val bucket");
+    ok (treeobj_peek_entry (hdir, "a0") == dirref,
+        "treeobj_peek_entry works on hdir");
+
+    ok ((s = treeobj_encode (hdir)) != NULL,
+        "treeobj_encode works on hdir");
+    free (s);
+    ok (json_object_set (treeobj_get_data (hdir), "4", bucket) == 0
+            && treeobj_validate (hdir) < 0,
+        "treeobj_validate rejects hdir with mixed key lengths");
+    ok (treeobj_delete_entry (hdir, "4") == 0
+            && treeobj_delete_entry (hdir, "3f") == 0
+            && treeobj_get_count (hdir) == 1,
+        "treeobj_delete_entry works on hdir");
+
+    json_decref (hdir);
+    json_decref (bucket);
+    json_decref (dirref);
+    json_decref (val);
+}
+
 void test_dir_peek (void)
 {
     json_t *dir;
@@ -751,6 +825,7 @@ int main(int argc, char** argv)
     test_dirref ();
     test_dir ();
     test_dir_peek ();
+    test_hdir ();
     test_copy ();
     test_deep_copy ();
     test_symlink ();
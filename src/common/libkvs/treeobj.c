@@ -28,7 +28,10 @@
 #include "config.h"
 #endif
 #include <errno.h>
+#include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <assert.h>
 
 #include "treeobj.h"
@@ -37,6 +40,21 @@
 
 static const int treeobj_version = 1;
 
+/* Return true if 'key' is a valid hdir bucket key of length 'len'.
+ */
+static bool valid_hdir_key (const char *key, int len)
+{
+    int i;
+
+    if (len < 1 || len > TREEOBJ_HDIR_MAX_KEYLEN || strlen (key) != len)
+        return false;
+    for (i = 0; i < len; i++) {
+        if (!strchr ("0123456789abcdef", key[i]))
+            return false;
+    }
+    return true;
+}
+
 static int treeobj_unpack (json_t *obj, const char **typep, json_t **datap)
 {
     json_t *data;
@@ -114,6 +132,21 @@ int treeobj_validate (const json_t *obj)
                 goto inval;
         }
     }
+    else if (!strcmp (type, "hdir")) {
+        const char *key;
+        int keylen = -1;
+        if (!json_is_object (data))
+            goto inval;
+        json_object_foreach ((json_t *)data, key, o) {
+            if (keylen < 0)
+                keylen = strlen (key);
+            if (!valid_hdir_key (key, keylen)
+                    || treeobj_validate (o) < 0
+                    || !(treeobj_is_dir (o) || treeobj_is_dirref (o)
+                                            || treeobj_is_hdir (o)))
+                goto inval;
+        }
+    }
     else if (!strcmp (type, "symlink")) {
         if (!json_is_string (data))
             goto inval;
@@ -169,6 +202,12 @@ bool treeobj_is_dirref (const json_t *obj)
     return type && !strcmp (type, "dirref");
 }
 
+bool treeobj_is_hdir (const json_t *obj)
+{
+    const char *type = treeobj_get_type (obj);
+    return type && !strcmp (type, "hdir");
+}
+
 json_t *treeobj_get_data (json_t *obj)
 {
     json_t *data;
@@ -245,7 +284,7 @@ int treeobj_get_count (const json_t *obj)
     if (!strcmp (type, "valref") || !strcmp (type, "dirref")) {
         count = json_array_size (data);
     }
-    else if (!strcmp (type, "dir")) {
+    else if (!strcmp (type, "dir") || !strcmp (type, "hdir")) {
         count = json_object_size (data);
     }
     else if (!strcmp (type, "symlink") || !strcmp (type, "val")) {
@@ -264,7 +303,7 @@ json_t *treeobj_get_entry (json_t *obj, const char *name)
     json_t *data, *obj2;
 
     if (treeobj_unpack (obj, &type, &data) < 0
-            || strcmp (type, "dir") != 0) {
+            || (strcmp (type, "dir") != 0 && strcmp (type, "hdir") != 0)) {
         errno = EINVAL;
         return NULL;
     }
@@ -281,7 +320,7 @@ int treeobj_delete_entry (json_t *obj, const char *name)
     json_t *data;
 
     if (treeobj_unpack (obj, &type, &data) < 0
-            || strcmp (type, "dir") != 0) {
+            || (strcmp (type, "dir") != 0 && strcmp (type, "hdir") != 0)) {
         errno = EINVAL;
         return -1;
     }
@@ -298,11 +337,25 @@ int treeobj_insert_entry (json_t *obj, const char *name, json_t *obj2)
     json_t *data;
 
     if (!name || !obj2 || treeobj_unpack (obj, &type, &data) < 0
-            || strcmp (type, "dir") != 0
             || treeobj_validate (obj2) < 0) {
         errno = EINVAL;
         return -1;
     }
+    if (!strcmp (type, "hdir")) {
+        void *iter = json_object_iter (data);
+        int keylen = iter ? strlen (json_object_iter_key (iter))
+                          : strlen (name);
+        if (!valid_hdir_key (name, keylen)
+                || !(treeobj_is_dir (obj2) || treeobj_is_dirref (obj2)
+                                           || treeobj_is_hdir (obj2))) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    else if (strcmp (type, "dir") != 0) {
+        errno = EINVAL;
+        return -1;
+    }
     if (json_object_set (data, name, obj2) < 0) {
         errno = EINVAL;
         return -1;
@@ -316,7 +369,7 @@ const json_t *treeobj_peek_entry (const json_t *obj, const char *name)
     const json_t *data, *obj2;
 
     if (treeobj_peek (obj, &type, &data) < 0
-            || strcmp (type, "dir") != 0) {
+            || (strcmp (type, "dir") != 0 && strcmp (type, "hdir") != 0)) {
         errno = EINVAL;
         return NULL;
     }
@@ -339,10 +392,11 @@ json_t *treeobj_copy (json_t *obj)
         return NULL;
     }
     /* shallow copy of treeobj data and deep copy of treeobj is
-     * identical except for dir object.
+     * identical except for dir and hdir objects.
      */
-    if (treeobj_is_dir (obj)) {
-        if (!(cpy = treeobj_create_dir ()))
+    if (treeobj_is_dir (obj) || treeobj_is_hdir (obj)) {
+        if (!(cpy = treeobj_is_dir (obj) ? treeobj_create_dir ()
+                                         : treeobj_create_hdir ()))
             return NULL;
 
         if (!(datacpy = json_copy (data))) {
@@ -432,6 +486,54 @@ json_t *treeobj_create_dir (void)
     return obj;
 }
 
+json_t *treeobj_create_hdir (void)
+{
+    json_t *obj;
+
+    if (!(obj = json_pack ("{s:i s:s s:{}}", "ver", treeobj_version,
+                                            "type", "hdir",
+                                            "data"))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return obj;
+}
+
+int treeobj_hdir_key (const char *name, int keylen, char *buf)
+{
+    const unsigned char *p;
+    uint32_t hash = 2166136261U; /* 32-bit FNV-1a */
+    char hex[9];
+
+    if (!name || !buf || keylen < 1 || keylen > TREEOBJ_HDIR_MAX_KEYLEN) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (p = (const unsigned char *)name; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 16777619U;
+    }
+    snprintf (hex, sizeof (hex), "%08" PRIx32, hash);
+    memcpy (buf, hex, keylen);
+    buf[keylen] = '\0';
+    return 0;
+}
+
+int treeobj_hdir_keylen (const json_t *obj)
+{
+    const json_t *data;
+    const char *type;
+    void *iter;
+
+    if (treeobj_peek (obj, &type, &data) < 0
+            || strcmp (type, "hdir") != 0
+            || !(iter = json_object_iter ((json_t *)data))) {
+        errno = EINVAL;
+        return -1;
+    }
+    return strlen (json_object_iter_key (iter));
+}
+
 json_t *treeobj_create_symlink (const char *target)
 {
     json_t *obj;
@@ -17,6 +17,7 @@ json_t *treeobj_create_val (const void *data, int len);
 json_t *treeobj_create_valref (const char *blobref);
 json_t *treeobj_create_dir (void);
 json_t *treeobj_create_dirref (const char *blobref);
+json_t *treeobj_create_hdir (void);
 
 /* Validate treeobj, recursively.
  * Return 0 if valid, -1 with errno = EINVAL if invalid.
@@ -34,6 +35,7 @@ bool treeobj_is_val (const json_t *obj);
 bool treeobj_is_valref (const json_t *obj);
 bool treeobj_is_dir (const json_t *obj);
 bool treeobj_is_dirref (const json_t *obj);
+bool treeobj_is_hdir (const json_t *obj);
 
 /* get type-specific value.
  * For dirref/valref, this is an array of blobrefs.
@@ -59,12 +61,14 @@ int treeobj_decode_val (const json_t *obj, void **data, int *len);
 /* get type-specific count.
  * For dirref/valref, this is the number of blobrefs.
  * For directory, this is number of entries
+ * For hdir, this is the number of buckets
  * For symlink or val, this is 1.
  * Return count on success, -1 on error with errno = EINVAL.
  */
 int treeobj_get_count (const json_t *obj);
 
 /* get/add/remove directory entry
+ * These also get/add/remove the buckets of an hdir, by bucket key.
  * Get returns JSON object (owned by 'obj', do not destory), NULL on error.
  * insert takes a reference on 'obj2' (caller retains ownership).
  * insert/delete return 0 on success, -1 on error with errno set.
@@ -106,6 +110,22 @@ const char *treeobj_get_blobref (const json_t *obj, int index);
 json_t *treeobj_create_valref_buf (const char *hashtype, int maxblob,
                                    void *data, int len);
 
+/* A sharded directory ("hdir") holds the entries of a large directory
+ * in buckets.  Its data is a dictionary mapping bucket keys to dir,
+ * dirref, or hdir objects.  A bucket key is a prefix of the lowercase
+ * hex 32-bit FNV-1a hash of the entry name; all keys in one hdir have
+ * the same length, and the keys of an hdir nested in bucket "3f" have
+ * length 3 and begin with "3f".
+ *
+ * treeobj_hdir_key() computes the 'keylen' character bucket key for
+ * 'name' into 'buf', which must have room for keylen + 1 characters.
+ * treeobj_hdir_keylen() returns the key length of a non-empty hdir.
+ * Both return -1 with errno = EINVAL on error.
+ */
+#define TREEOBJ_HDIR_MAX_KEYLEN 8
+int treeobj_hdir_key (const char *name, int keylen, char *buf);
+int treeobj_hdir_keylen (const json_t *obj);
+
 /* Convert a treeobj to/from string.
  * The return value of treeobj_decode must be destroyed with json_decref().
  * The return value of treeobj_encode must be destroyed with free().
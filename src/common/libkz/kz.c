@@ -24,7 +24,27 @@
 
 /* kz.c - KVS streams */
 
-/* We use a kvs directory to represent a character stream.
+/* If the kzstream service is loaded, streams are written to and read
+ * from the service, which holds recent blocks in memory, stores them in
+ * the content store in chunks, and commits an index of the chunks to the
+ * KVS as "name.index" at end of stream.  Otherwise, we use a kvs directory
+ * to represent a character stream, as described below.
+ *
+ * With the service:
+ * kz_put buffers blocks and sends them in one kzstream.append request
+ * when the buffer is full, or at each put unless KZ_FLAGS_NOCOMMIT_PUT.
+ * Appends are not waited for individually;  up to 'append_window' may be
+ * in flight, and an error is returned by a later call.  kz_flush sends
+ * buffered blocks.  kz_close appends an EOF and waits until the stream
+ * has been archived, unless KZ_FLAGS_NOCOMMIT_CLOSE.
+ * kz_get reads from the service, or from the archived index once the
+ * service has dropped the stream.  A ready callback is driven by
+ * responses to a "watch" read, instead of a kvs watch.
+ * KZ_FLAGS_NOCOMMIT_OPEN has no effect, since nothing is committed at open.
+ * A reader that opens a stream through a KVS symlink reads the stream
+ * named by the link target.
+ *
+ * Without the service:
  * Blocks are written as sequenced keys (monotonic int) in the directory.
  * Each block is represented as a zio json frame.
  *
@@ -43,6 +63,8 @@
  *
  * kz_flush
  * If KZ_FLAGS_WRITE, issues a kvs_commit(), otherwise no-op.
+ * The commit is skipped if no kz stream on the handle has uncommitted
+ * puts, e.g. because kz_flush was just called on another stream.
  *
  * kz_close
  * If KZ_FLAGS_WRITE, puts a value containing the EOF flag and issues
@@ -55,9 +77,11 @@
 #include <getopt.h>
 #include <assert.h>
 #include <libgen.h>
+#include <inttypes.h>
 #include <sys/wait.h>
 #include <termios.h>
 #include <czmq.h>
+#include <jansson.h>
 #include <flux/core.h>
 
 #include "kz.h"
@@ -66,6 +90,28 @@
 #include "src/common/libutil/xzmalloc.h"
 #include "src/common/libsubprocess/zio.h"
 
+/* Send buffered blocks once they total this many bytes.
+ */
+static const int append_size = 65536;
+
+/* Maximum number of appends in flight per stream.
+ */
+static const int append_window = 16;
+
+/* Maximum number of symlinks followed to find the stream a reader opens.
+ */
+static const int max_symlinks = 8;
+
+/* A block read from the service, or a stored chunk of 'count' blocks
+ * that has not been loaded yet.
+ */
+struct rblock {
+    int offset;
+    int count;
+    char *data;
+    char *ref;
+};
+
 struct kz_struct {
     int flags;
     char *name;
@@ -80,10 +126,74 @@ struct kz_struct {
     char *grpname;
     int fencecount;
     bool watching;
+    bool service;           /* stream is handled by kzstream service */
+    int errnum;             /* deferred append or watch error */
+    json_t *wbuf;           /* blocks not yet sent */
+    int wbuf_size;
+    int woffset;            /* stream offset of first block in wbuf */
+    zlist_t *appends;       /* appends in flight */
+    zlist_t *rbuf;          /* struct rblock, in offset order */
+    int rend;               /* stream offset after last received block */
+    bool rdone;             /* no more data will be received */
+    flux_future_t *watch_f;
+    uint32_t matchtag;
 };
 
+typedef struct {
+    zhash_t *watchers;      /* kz_t hashed by stringified matchtag */
+    flux_msg_handler_t *mh;
+} kz_watch_ctx_t;
+
+static void rblock_destroy (struct rblock *rb)
+{
+    if (rb) {
+        int saved_errno = errno;
+        free (rb->data);
+        free (rb->ref);
+        free (rb);
+        errno = saved_errno;
+    }
+}
+
+static struct rblock *rblock_create (int offset, int count,
+                                     const char *data, const char *ref)
+{
+    struct rblock *rb;
+
+    if (!(rb = calloc (1, sizeof (*rb))))
+        goto nomem;
+    rb->offset = offset;
+    rb->count = count;
+    if ((data && !(rb->data = strdup (data)))
+            || (ref && !(rb->ref = strdup (ref))))
+        goto nomem;
+    return rb;
+nomem:
+    rblock_destroy (rb);
+    errno = ENOMEM;
+    return NULL;
+}
+
+static void watch_stop (kz_t *kz, bool unwatch);
+
 static void kz_destroy (kz_t *kz)
 {
+    struct rblock *rb;
+    flux_future_t *f;
+
+    if (kz->watch_f)
+        watch_stop (kz, false);
+    if (kz->rbuf) {
+        while ((rb = zlist_pop (kz->rbuf)))
+            rblock_destroy (rb);
+        zlist_destroy (&kz->rbuf);
+    }
+    if (kz->appends) {
+        while ((f = zlist_pop (kz->appends)))
+            flux_future_destroy (f);
+        zlist_destroy (&kz->appends);
+    }
+    json_decref (kz->wbuf);
     if (kz->name)
         free (kz->name);
     if (kz->dir)
@@ -109,45 +219,360 @@ done:
     return ret;
 }
 
+/* Without the service, puts are added to the handle's anonymous KVS
+ * transaction.  Count puts not yet committed on each handle, so that
+ * when output of many streams is flushed together, the first kz_flush()
+ * commits them all, and the others do not issue empty commits.
+ */
+static int *uncommitted (flux_t *h)
+{
+    const char *auxkey = "flux::kz_uncommitted";
+    int *count = flux_aux_get (h, auxkey);
+
+    if (!count) {
+        count = xzmalloc (sizeof (*count));
+        flux_aux_set (h, auxkey, count, free);
+    }
+    return count;
+}
+
+static int kvs_commit (kz_t *kz)
+{
+    if (flux_kvs_commit_anon (kz->h, 0) < 0)
+        return -1;
+    *uncommitted (kz->h) = 0;
+    return 0;
+}
+
+/* Add data from a kzstream.read response, which begins at stream 'offset'
+ * and may overlap data already received.
+ */
+static int rbuf_add (kz_t *kz, int offset, json_t *data)
+{
+    size_t index;
+    json_t *value;
+    struct rblock *rb;
+    const char *ref;
+    int count;
+
+    if (!json_is_array (data)) {
+        errno = EPROTO;
+        return -1;
+    }
+    json_array_foreach (data, index, value) {
+        if (json_is_string (value)) {
+            ref = NULL;
+            count = 1;
+        }
+        else if (json_unpack (value, "{s:s s:i}", "ref", &ref,
+                                                  "count", &count) < 0
+                    || count < 0) {
+            errno = EPROTO;
+            return -1;
+        }
+        if (offset + count > kz->rend) {
+            if (!(rb = rblock_create (offset, count,
+                                      ref ? NULL : json_string_value (value),
+                                      ref)))
+                return -1;
+            if (zlist_append (kz->rbuf, rb) < 0) {
+                rblock_destroy (rb);
+                errno = ENOMEM;
+                return -1;
+            }
+            kz->rend = offset + count;
+        }
+        offset += count;
+    }
+    return 0;
+}
+
+/* Replace stored chunk 'rb' at the head of rbuf with its blocks.
+ */
+static int rbuf_load (kz_t *kz, struct rblock *rb)
+{
+    flux_future_t *f;
+    const void *buf;
+    int len;
+    json_t *blocks = NULL;
+    struct rblock *nrb;
+    int i;
+    int rc = -1;
+
+    if (!(f = flux_content_load (kz->h, rb->ref, 0))
+            || flux_content_load_get (f, &buf, &len) < 0)
+        goto done;
+    if (!(blocks = json_loadb (buf, len, 0, NULL))
+            || !json_is_array (blocks)
+            || json_array_size (blocks) != rb->count) {
+        errno = EPROTO;
+        goto done;
+    }
+    for (i = rb->count - 1; i >= 0; i--) {
+        const char *s = json_string_value (json_array_get (blocks, i));
+        if (!s) {
+            errno = EPROTO;
+            goto done;
+        }
+        if (rb->offset + i < kz->seq)
+            break;
+        if (!(nrb = rblock_create (rb->offset + i, 1, s, NULL)))
+            goto done;
+        if (zlist_push (kz->rbuf, nrb) < 0) {
+            rblock_destroy (nrb);
+            errno = ENOMEM;
+            goto done;
+        }
+    }
+    rc = 0;
+done:
+    json_decref (blocks);
+    flux_future_destroy (f);
+    return rc;
+}
+
+/* Return the next block received from the service, or NULL with
+ * errno = EAGAIN if there is none.
+ */
+static char *rbuf_next (kz_t *kz)
+{
+    struct rblock *rb;
+    char *json_str;
+
+    while ((rb = zlist_pop (kz->rbuf))) {
+        if (rb->offset + rb->count <= kz->seq) {
+            rblock_destroy (rb);
+            continue;
+        }
+        if (rb->ref) {
+            if (rbuf_load (kz, rb) < 0) {
+                zlist_push (kz->rbuf, rb);
+                return NULL;
+            }
+            rblock_destroy (rb);
+            continue;
+        }
+        json_str = rb->data;
+        rb->data = NULL;
+        kz->seq = rb->offset + 1;
+        rblock_destroy (rb);
+        return json_str;
+    }
+    errno = EAGAIN;
+    return NULL;
+}
+
+/* Read the index of an archived stream.
+ */
+static int archive_load (kz_t *kz)
+{
+    flux_future_t *f = NULL;
+    char *key;
+    json_t *chunks;
+    int version;
+    int rc = -1;
+
+    if (asprintf (&key, "%s.index", kz->name) < 0)
+        oom ();
+    if (!(f = flux_kvs_lookup (kz->h, 0, key))
+            || flux_kvs_lookup_get_unpack (f, "{s:i s:o}",
+                                           "version", &version,
+                                           "chunks", &chunks) < 0)
+        goto done;
+    if (version != 1) {
+        errno = EPROTO;
+        goto done;
+    }
+    if (rbuf_add (kz, 0, chunks) < 0)
+        goto done;
+    kz->rdone = true;
+    rc = 0;
+done:
+    flux_future_destroy (f);
+    free (key);
+    return rc;
+}
+
+static flux_future_t *read_rpc (kz_t *kz, bool wait, bool watch,
+                                bool noexist)
+{
+    return flux_rpc_pack (kz->h, "kzstream.read", 0, 0,
+                          "{s:s s:i s:b s:b s:b}",
+                          "name", kz->name,
+                          "offset", kz->rend,
+                          "wait", wait,
+                          "watch", watch,
+                          "noexist", noexist);
+}
+
+static int read_rpc_get (kz_t *kz, flux_future_t *f)
+{
+    int offset;
+    json_t *data;
+    int eof;
+
+    if (flux_rpc_get_unpack (f, "{s:i s:o s:b}",
+                             "offset", &offset,
+                             "data", &data,
+                             "eof", &eof) < 0)
+        return -1;
+    if (rbuf_add (kz, offset, data) < 0)
+        return -1;
+    if (eof)
+        kz->rdone = true;
+    return 0;
+}
+
+static int read_service (kz_t *kz, bool wait, bool noexist)
+{
+    flux_future_t *f;
+    int rc = -1;
+
+    if (!(f = read_rpc (kz, wait, false, noexist)))
+        return -1;
+    if (read_rpc_get (kz, f) < 0)
+        goto done;
+    rc = 0;
+done:
+    flux_future_destroy (f);
+    return rc;
+}
+
+/* Check for the stream without KZ_FLAGS_NOEXIST, so that a stream
+ * written without the service is found in the KVS.
+ */
+static int open_read_service (kz_t *kz)
+{
+    return read_service (kz, false, false);
+}
+
+static int open_write_service (kz_t *kz)
+{
+    flux_future_t *f;
+    int rc = -1;
+
+    if (!(f = flux_rpc_pack (kz->h, "kzstream.open", 0, 0, "{s:s s:b}",
+                             "name", kz->name,
+                             "trunc", (kz->flags & KZ_FLAGS_TRUNC) ? 1 : 0))
+            || flux_future_get (f, NULL) < 0)
+        goto done;
+    rc = 0;
+done:
+    flux_future_destroy (f);
+    return rc;
+}
+
+static int open_write_kvs (kz_t *kz)
+{
+    if (flux_kvs_mkdir (kz->h, kz->name) < 0) /* N.B. does not catch EEXIST */
+        return -1;
+    (*uncommitted (kz->h))++;
+    if (!(kz->flags & KZ_FLAGS_NOCOMMIT_OPEN)) {
+        if (kvs_commit (kz) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int open_read_kvs (kz_t *kz)
+{
+    if (!(kz->flags & KZ_FLAGS_NOEXIST)) {
+        const flux_kvsdir_t *dir;
+        flux_future_t *f;
+
+        if (!(f = flux_kvs_lookup (kz->h, FLUX_KVS_READDIR, kz->name))
+            || flux_kvs_lookup_get_dir (f, &dir) < 0
+            || !(kz->dir = flux_kvsdir_copy (dir))) {
+            flux_future_destroy (f);
+            return -1;
+        }
+        flux_future_destroy (f);
+    }
+    return 0;
+}
+
+/* The service knows a stream by the name it was written under, so a
+ * reader opening it through a KVS symlink (e.g. a task's stdin, linked
+ * to a shared input stream) must use the link target.  Return a copy of
+ * the target of 'name', following up to 'max_symlinks' links, or a copy
+ * of 'name' if it is not a symlink.
+ */
+static char *resolve_name (flux_t *h, const char *name)
+{
+    char *key = xstrdup (name);
+    flux_future_t *f;
+    const char *target;
+    int i;
+
+    for (i = 0; i < max_symlinks; i++) {
+        if (!(f = flux_kvs_lookup (h, FLUX_KVS_READLINK, key))
+                || flux_kvs_lookup_get_symlink (f, &target) < 0) {
+            flux_future_destroy (f);
+            break;
+        }
+        free (key);
+        key = xstrdup (target);
+        flux_future_destroy (f);
+    }
+    return key;
+}
+
 kz_t *kz_open (flux_t *h, const char *name, int flags)
 {
     kz_t *kz = xzmalloc (sizeof (*kz));
 
     kz->flags = flags;
-    kz->name = xstrdup (name);
+    if ((flags & KZ_FLAGS_READ) && !(flags & KZ_FLAGS_WRITE))
+        kz->name = resolve_name (h, name);
+    else
+        kz->name = xstrdup (name);
     if ((kz->stream = strchr (kz->name, '.')))
         kz->stream++;
     else
         kz->stream = kz->name;
     kz->h = h;
+    if (!(kz->rbuf = zlist_new ())
+            || !(kz->appends = zlist_new ())
+            || !(kz->wbuf = json_array ()))
+        oom ();
 
     if ((flags & KZ_FLAGS_WRITE)) {
-        if (key_exists (h, name)) {
-            if (!(flags & KZ_FLAGS_TRUNC)) {
-                errno = EEXIST;
-                goto error;
-            } else if (flux_kvs_unlink (h, name) < 0)
-                goto error;
+        bool exists = key_exists (h, name);
+        if (exists && !(flags & KZ_FLAGS_TRUNC)) {
+            errno = EEXIST;
+            goto error;
         }
-        if (flux_kvs_mkdir (h, name) < 0) /* N.B. does not catch EEXIST */
+        if (open_write_service (kz) == 0)
+            kz->service = true;
+        else if (errno != ENOSYS)
             goto error;
-        if (!(flags & KZ_FLAGS_NOCOMMIT_OPEN)) {
-            if (flux_kvs_commit_anon (h, 0) < 0)
+        if (exists) {
+            if (flux_kvs_unlink (h, name) < 0)
+                goto error;
+            if (kz->service && kvs_commit (kz) < 0)
                 goto error;
         }
+        if (!kz->service && open_write_kvs (kz) < 0)
+            goto error;
     } else if ((flags & KZ_FLAGS_READ)) {
-        if (!(flags & KZ_FLAGS_NOEXIST)) {
-            const flux_kvsdir_t *dir;
-            flux_future_t *f;
-
-            if (!(f = flux_kvs_lookup (h, FLUX_KVS_READDIR, name))
-                || flux_kvs_lookup_get_dir (f, &dir) < 0
-                || !(kz->dir = flux_kvsdir_copy (dir))) {
-                flux_future_destroy (f);
-                goto error;
-            }
-            flux_future_destroy (f);
+        /* A stream that is unknown to the service may have been archived,
+         * written without the service, or not be created yet.
+         * An archived stream can be read without the service.
+         */
+        if (open_read_service (kz) == 0)
+            kz->service = true;
+        else if (errno != ENOSYS && errno != ENOENT)
+            goto error;
+        else {
+            bool nosys = (errno == ENOSYS);
+            if (archive_load (kz) == 0)
+                kz->service = true;
+            else if (!nosys && (flags & KZ_FLAGS_NOEXIST)
+                            && !key_exists (h, kz->name))
+                kz->service = true;
         }
+        if (!kz->service && open_read_kvs (kz) < 0)
+            goto error;
     }
     return kz;
 error:
@@ -161,7 +586,8 @@ static int kz_fence (kz_t *kz)
     int rc;
     if (asprintf (&name, "%s.%d", kz->grpname, kz->fencecount++) < 0)
         oom ();
-    rc = flux_kvs_fence_anon (kz->h, name, kz->nprocs, 0);
+    if ((rc = flux_kvs_fence_anon (kz->h, name, kz->nprocs, 0)) == 0)
+        *uncommitted (kz->h) = 0;
     free (name);
     return rc;
 }
@@ -189,6 +615,86 @@ error:
     return NULL;
 }
 
+/* Wait for the oldest append in flight.  An error is held in
+ * kz->errnum and returned by the next put, flush, or close.
+ */
+static void append_wait (kz_t *kz)
+{
+    flux_future_t *f;
+
+    if ((f = zlist_pop (kz->appends))) {
+        if (flux_future_get (f, NULL) < 0 && !kz->errnum)
+            kz->errnum = errno;
+        flux_future_destroy (f);
+    }
+}
+
+static int append_wait_all (kz_t *kz)
+{
+    while (zlist_size (kz->appends) > 0)
+        append_wait (kz);
+    if (kz->errnum) {
+        errno = kz->errnum;
+        return -1;
+    }
+    return 0;
+}
+
+/* Send buffered blocks to the service.
+ */
+static int append_send (kz_t *kz, bool eof, int rpc_flags)
+{
+    flux_future_t *f;
+    int count = json_array_size (kz->wbuf);
+
+    if (kz->errnum) {
+        errno = kz->errnum;
+        return -1;
+    }
+    if (count == 0 && !eof)
+        return 0;
+    if (!(f = flux_rpc_pack (kz->h, "kzstream.append", 0, rpc_flags,
+                             "{s:s s:i s:O s:b}",
+                             "name", kz->name,
+                             "offset", kz->woffset,
+                             "blocks", kz->wbuf,
+                             "eof", eof)))
+        return -1;
+    kz->woffset += count;
+    json_array_clear (kz->wbuf);
+    kz->wbuf_size = 0;
+    if ((rpc_flags & FLUX_RPC_NORESPONSE)) {
+        flux_future_destroy (f);
+        return 0;
+    }
+    if (zlist_append (kz->appends, f) < 0)
+        oom ();
+    while (zlist_size (kz->appends) > append_window)
+        append_wait (kz);
+    if (kz->errnum) {
+        errno = kz->errnum;
+        return -1;
+    }
+    return 0;
+}
+
+static int putnext_service (kz_t *kz, const char *json_str)
+{
+    if (kz->errnum) {
+        errno = kz->errnum;
+        return -1;
+    }
+    if (json_array_append_new (kz->wbuf, json_string (json_str)) < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    kz->wbuf_size += strlen (json_str);
+    kz->seq++;
+    if (!(kz->flags & KZ_FLAGS_NOCOMMIT_PUT) || kz->wbuf_size >= append_size)
+        return append_send (kz, false, 0);
+    return 0;
+}
+
 static int putnext (kz_t *kz, const char *json_str)
 {
     char *key = NULL;
@@ -198,12 +704,15 @@ static int putnext (kz_t *kz, const char *json_str)
         errno = EINVAL;
         goto done;
     }
+    if (kz->service)
+        return putnext_service (kz, json_str);
     if (asprintf (&key, "%s.%.6d", kz->name, kz->seq++) < 0)
         oom ();
     if (flux_kvs_put (kz->h, key, json_str) < 0)
         goto done;
+    (*uncommitted (kz->h))++;
     if (!(kz->flags & KZ_FLAGS_NOCOMMIT_PUT)) {
-        if (flux_kvs_commit_anon (kz->h, 0) < 0)
+        if (kvs_commit (kz) < 0)
             goto done;
     }
     rc = 0;
@@ -244,6 +753,36 @@ done:
     return rc;
 }
 
+/* Get the next block from the service.  Once the stream has ended and
+ * all its blocks have been returned, fail with ENODATA (EAGAIN if
+ * KZ_FLAGS_NONBLOCK).
+ */
+static char *getnext_service (kz_t *kz)
+{
+    bool nonblock = (kz->flags & KZ_FLAGS_NONBLOCK);
+    char *json_str;
+
+    if ((json_str = rbuf_next (kz)) || errno != EAGAIN)
+        return json_str;
+    if (!kz->rdone && !kz->watch_f) {
+        /* If the service has dropped the stream, it has been archived.
+         */
+        if (read_service (kz, !nonblock,
+                          (kz->flags & KZ_FLAGS_NOEXIST)) < 0
+                && (errno != ENOENT || archive_load (kz) < 0))
+            return NULL;
+        if ((json_str = rbuf_next (kz)) || errno != EAGAIN)
+            return json_str;
+    }
+    if (kz->errnum)
+        errno = kz->errnum;
+    else if (kz->rdone && !nonblock)
+        errno = ENODATA;
+    else
+        errno = EAGAIN;
+    return NULL;
+}
+
 static char *getnext (kz_t *kz)
 {
     const char *json_str;
@@ -255,6 +794,8 @@ static char *getnext (kz_t *kz)
         errno = EINVAL;
         goto done;
     }
+    if (kz->service)
+        return getnext_service (kz);
     if (asprintf (&key, "%s.%.6d", kz->name, kz->seq) < 0)
         oom ();
     if (!(f = flux_kvs_lookup (kz->h, 0, key))
@@ -277,6 +818,8 @@ static char *getnext_blocking (kz_t *kz)
 {
     char *json_str = NULL;
 
+    if (kz->service)
+        return getnext_service (kz);
     while (!(json_str = getnext (kz))) {
         if (errno != EAGAIN)
             break;
@@ -324,8 +867,16 @@ int kz_get (kz_t *kz, char **datap)
         json_str = getnext (kz);
     else
         json_str = getnext_blocking (kz);
-    if (!json_str)
+    if (!json_str) {
+        /* stream ended without an EOF block, e.g. writer disconnected */
+        if (kz->service && kz->rdone && !kz->errnum
+                        && (errno == ENODATA || errno == EAGAIN)
+                        && zlist_size (kz->rbuf) == 0) {
+            kz->eof = true;
+            len = 0;
+        }
         goto done;
+    }
     if ((len = zio_json_decode (json_str, (void **) &data, &kz->eof)) < 0) {
         errno = EPROTO;
         goto done;
@@ -340,18 +891,58 @@ done:
 int kz_flush (kz_t *kz)
 {
     int rc = 0;
-    if ((kz->flags & KZ_FLAGS_WRITE))
-        rc = flux_kvs_commit_anon (kz->h, 0);
+    if ((kz->flags & KZ_FLAGS_WRITE)) {
+        if (kz->service)
+            rc = append_send (kz, false, 0);
+        else if (*uncommitted (kz->h) > 0)
+            rc = kvs_commit (kz);
+    }
     return rc;
 }
 
+/* Append EOF.  Unless KZ_FLAGS_NOCOMMIT_CLOSE, wait until the stream
+ * has been archived.
+ */
+static int close_service (kz_t *kz)
+{
+    int rpc_flags = 0;
+    char *json_str;
+    int rc;
+
+    if (!(kz->flags & KZ_FLAGS_RAW)) {
+        if (!(json_str = zio_json_encode (NULL, 0, true))) { /* EOF */
+            errno = EPROTO;
+            return -1;
+        }
+        rc = json_array_append_new (kz->wbuf, json_string (json_str));
+        free (json_str);
+        if (rc < 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    if ((kz->flags & KZ_FLAGS_NOCOMMIT_CLOSE))
+        rpc_flags |= FLUX_RPC_NORESPONSE;
+    if (append_send (kz, true, rpc_flags) < 0)
+        return -1;
+    return append_wait_all (kz);
+}
+
 int kz_close (kz_t *kz)
 {
     int rc = -1;
     char *json_str = NULL;
     char *key = NULL;
 
-    if ((kz->flags & KZ_FLAGS_WRITE)) {
+    if ((kz->flags & KZ_FLAGS_WRITE) && kz->service) {
+        if (close_service (kz) < 0)
+            goto done;
+        if (kz->nprocs > 0 && kz->grpname) {
+            if (kz_fence (kz) < 0)
+                goto done;
+        }
+    }
+    else if ((kz->flags & KZ_FLAGS_WRITE)) {
         if (!(kz->flags & KZ_FLAGS_RAW)) {
             if (asprintf (&key, "%s.%.6d", kz->name, kz->seq++) < 0)
                 oom ();
@@ -361,9 +952,10 @@ int kz_close (kz_t *kz)
             }
             if (flux_kvs_put (kz->h, key, json_str) < 0)
                 goto done;
+            (*uncommitted (kz->h))++;
         }
         if (!(kz->flags & KZ_FLAGS_NOCOMMIT_CLOSE)) {
-            if (flux_kvs_commit_anon (kz->h, 0) < 0)
+            if (kvs_commit (kz) < 0)
                 goto done;
         }
         if (kz->nprocs > 0 && kz->grpname) {
@@ -371,6 +963,8 @@ int kz_close (kz_t *kz)
                 goto done;
         }
     }
+    if (kz->watch_f)
+        watch_stop (kz, true);
     if (kz->watching) {
         (void)flux_kvs_unwatch (kz->h, kz->name);
         kz->watching = false;
@@ -397,6 +991,138 @@ static int kvswatch_cb (const char *key, flux_kvsdir_t *dir,
     return 0;
 }
 
+static void watch_response_cb (flux_t *h, flux_msg_handler_t *mh,
+                               const flux_msg_t *msg, void *arg);
+
+static void freectx (kz_watch_ctx_t *ctx)
+{
+    if (ctx) {
+        zhash_destroy (&ctx->watchers);
+        flux_msg_handler_destroy (ctx->mh);
+        free (ctx);
+    }
+}
+
+static kz_watch_ctx_t *getctx (flux_t *h, bool create)
+{
+    const char *auxkey = "flux::kz_watch";
+    kz_watch_ctx_t *ctx = flux_aux_get (h, auxkey);
+    struct flux_match match = FLUX_MATCH_RESPONSE;
+
+    if (!ctx && create) {
+        if (!(ctx = calloc (1, sizeof (*ctx))))
+            goto nomem;
+        if (!(ctx->watchers = zhash_new ()))
+            goto nomem;
+        match.topic_glob = "kzstream.read";
+        if (!(ctx->mh = flux_msg_handler_create (h, match,
+                                                 watch_response_cb, ctx)))
+            goto nomem;
+        flux_aux_set (h, auxkey, ctx, (flux_free_f)freectx);
+    }
+    return ctx;
+nomem:
+    freectx (ctx);
+    errno = ENOMEM;
+    return NULL;
+}
+
+/* Stop receiving watch responses.  If 'unwatch' is true, tell the
+ * service, so it stops sending them.
+ */
+static void watch_stop (kz_t *kz, bool unwatch)
+{
+    kz_watch_ctx_t *ctx = getctx (kz->h, false);
+    flux_future_t *f;
+    char k[16];
+
+    if (unwatch) {
+        if ((f = flux_rpc_pack (kz->h, "kzstream.unwatch", 0, 0, "{s:s s:i}",
+                                "name", kz->name,
+                                "matchtag", (int)kz->matchtag)))
+            (void)flux_future_get (f, NULL);
+        flux_future_destroy (f);
+    }
+    if (ctx) {
+        snprintf (k, sizeof (k), "%"PRIu32, kz->matchtag);
+        zhash_delete (ctx->watchers, k);
+        if (zhash_size (ctx->watchers) == 0)
+            flux_msg_handler_stop (ctx->mh);
+    }
+    flux_future_destroy (kz->watch_f); // frees matchtag
+    kz->watch_f = NULL;
+}
+
+static void watch_response_cb (flux_t *h, flux_msg_handler_t *mh,
+                               const flux_msg_t *msg, void *arg)
+{
+    kz_watch_ctx_t *ctx = arg;
+    uint32_t matchtag;
+    char k[16];
+    kz_t *kz;
+    int offset;
+    json_t *data;
+    int eof;
+
+    if (flux_msg_get_matchtag (msg, &matchtag) < 0)
+        return;
+    snprintf (k, sizeof (k), "%"PRIu32, matchtag);
+    if (!(kz = zhash_lookup (ctx->watchers, k)))
+        return;
+    if (flux_response_decode (msg, NULL, NULL) < 0
+            || flux_msg_unpack (msg, "{s:i s:o s:b}",
+                                "offset", &offset,
+                                "data", &data,
+                                "eof", &eof) < 0
+            || rbuf_add (kz, offset, data) < 0) {
+        kz->errnum = errno;
+        eof = 1;
+    }
+    if (eof) {
+        kz->rdone = true;
+        watch_stop (kz, false);
+    }
+    if (kz->ready_cb)
+        kz->ready_cb (kz, kz->ready_arg);
+}
+
+/* Ask the service to send data as it is appended.  The first response
+ * is received synchronously, so data that is already available may be
+ * passed to the ready callback before returning, as with a kvs watch.
+ */
+static int watch_start (kz_t *kz)
+{
+    kz_watch_ctx_t *ctx;
+    flux_future_t *f;
+    const flux_msg_t *msg;
+    char k[16];
+
+    if (!(f = read_rpc (kz, false, true, (kz->flags & KZ_FLAGS_NOEXIST))))
+        return -1;
+    if (read_rpc_get (kz, f) < 0) {
+        flux_future_destroy (f);
+        if (errno != ENOENT)
+            return -1;
+        return archive_load (kz);
+    }
+    if (kz->rdone) {
+        flux_future_destroy (f);
+        return 0;
+    }
+    if (flux_future_get (f, &msg) < 0
+            || flux_msg_get_matchtag (msg, &kz->matchtag) < 0
+            || !(ctx = getctx (kz->h, true))) {
+        flux_future_destroy (f);
+        return -1;
+    }
+    kz->watch_f = f;
+    snprintf (k, sizeof (k), "%"PRIu32, kz->matchtag);
+    zhash_update (ctx->watchers, k, kz);
+    if (zhash_size (ctx->watchers) == 1)
+        flux_msg_handler_start (ctx->mh);
+    return 0;
+}
+
 int kz_set_ready_cb (kz_t *kz, kz_ready_f ready_cb, void *arg)
 {
     if (!(kz->flags & KZ_FLAGS_READ)) {
@@ -405,6 +1131,15 @@ int kz_set_ready_cb (kz_t *kz, kz_ready_f ready_cb, void *arg)
     }
     kz->ready_cb = ready_cb;
     kz->ready_arg = arg;
+    if (kz->service) {
+        if (!kz->watch_f && !kz->rdone) {
+            if (watch_start (kz) < 0)
+                return -1;
+        }
+        if (ready_cb && (zlist_size (kz->rbuf) > 0 || kz->rdone))
+            ready_cb (kz, arg);
+        return 0;
+    }
     if (!kz->watching) {
         if (flux_kvs_watch_dir (kz->h, kvswatch_cb, kz, "%s", kz->name) < 0)
             return -1;
@@ -51,6 +51,8 @@ int kz_get (kz_t *kz, char **datap);
 
 /* Commit any data written to the stream which has not already
  * been committed.  Calling this on a kz opened with KZ_FLAGS_READ is a no-op.
+ * Without the kzstream service, this commits the puts of all streams
+ * on the handle, so flushing many streams together costs one commit.
  */
 int kz_flush (kz_t *kz);
 
@@ -0,0 +1,185 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include "blobvec.h"
+
+#define BLOBVEC_ABSENT  0xffffffff
+
+struct blobvec {
+    uint8_t *buf;
+    int size;
+    int alloc;
+    int count;
+};
+
+blobvec_t *blobvec_create (void)
+{
+    blobvec_t *bv = calloc (1, sizeof (*bv));
+    if (!bv) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return bv;
+}
+
+void blobvec_destroy (blobvec_t *bv)
+{
+    if (bv) {
+        free (bv->buf);
+        free (bv);
+    }
+}
+
+static int grow (blobvec_t *bv, int needed)
+{
+    int newalloc = bv->alloc > 0 ? bv->alloc : 256;
+    uint8_t *newbuf;
+
+    while (newalloc - bv->size < needed)
+        newalloc *= 2;
+    if (newalloc != bv->alloc) {
+        if (!(newbuf = realloc (bv->buf, newalloc))) {
+            errno = ENOMEM;
+            return -1;
+        }
+        bv->buf = newbuf;
+        bv->alloc = newalloc;
+    }
+    return 0;
+}
+
+int blobvec_append (blobvec_t *bv, const void *data, int len)
+{
+    uint32_t hdr;
+
+    if (!bv || (len < 0 && (data != NULL || len != -1))
+             || (len > 0 && !data)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (grow (bv, sizeof (hdr) + (len > 0 ? len : 0)) < 0)
+        return -1;
+    hdr = htonl (len < 0 ? BLOBVEC_ABSENT : len);
+    memcpy (bv->buf + bv->size, &hdr, sizeof (hdr));
+    bv->size += sizeof (hdr);
+    if (len > 0) {
+        memcpy (bv->buf + bv->size, data, len);
+        bv->size += len;
+    }
+    bv->count++;
+    return 0;
+}
+
+void *blobvec_append_space (blobvec_t *bv, int len)
+{
+    uint32_t hdr;
+    void *data;
+
+    if (!bv || len < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (grow (bv, sizeof (hdr) + len) < 0)
+        return NULL;
+    hdr = htonl (len);
+    memcpy (bv->buf + bv->size, &hdr, sizeof (hdr));
+    bv->size += sizeof (hdr);
+    data = bv->buf + bv->size;
+    bv->size += len;
+    bv->count++;
+    return data;
+}
+
+const void *blobvec_data (blobvec_t *bv)
+{
+    return bv ? bv->buf : NULL;
+}
+
+int blobvec_size (blobvec_t *bv)
+{
+    return bv ? bv->size : 0;
+}
+
+int blobvec_count (blobvec_t *bv)
+{
+    return bv ? bv->count : 0;
+}
+
+int blobvec_next (const void *buf, int size, int *offset,
+                  const void **data, int *len)
+{
+    const uint8_t *p = buf;
+    uint32_t hdr;
+
+    if (*offset == size)
+        return 0;
+    if (!buf || *offset < 0 || *offset > size
+             || size - *offset < sizeof (hdr))
+        goto eproto;
+    memcpy (&hdr, p + *offset, sizeof (hdr));
+    hdr = ntohl (hdr);
+    *offset += sizeof (hdr);
+    if (hdr == BLOBVEC_ABSENT) {
+        *data = NULL;
+        *len = -1;
+        return 1;
+    }
+    if (hdr > size - *offset)
+        goto eproto;
+    *data = hdr > 0 ? p + *offset : NULL;
+    *len = hdr;
+    *offset += hdr;
+    return 1;
+eproto:
+    errno = EPROTO;
+    return -1;
+}
+
+int blobvec_count_encoded (const void *buf, int size)
+{
+    const void *data;
+    int len;
+    int offset = 0;
+    int count = 0;
+    int rc;
+
+    while ((rc = blobvec_next (buf, size, &offset, &data, &len)) == 1)
+        count++;
+    if (rc < 0)
+        return -1;
+    return count;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
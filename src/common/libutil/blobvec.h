@@ -0,0 +1,50 @@
+#ifndef _UTIL_BLOBVEC_H
+#define _UTIL_BLOBVEC_H
+
+/* blobvec - pack a sequence of byte arrays into one buffer
+ *
+ * Each item is encoded as a 4 byte length in network byte order,
+ * followed by that many bytes of data.  A length of 0xffffffff marks an
+ * absent item, which is appended and decoded as data=NULL, len=-1.
+ */
+
+typedef struct blobvec blobvec_t;
+
+blobvec_t *blobvec_create (void);
+void blobvec_destroy (blobvec_t *bv);
+
+/* Append an item, or an absent item if data is NULL and len is -1.
+ * Returns 0 on success, -1 on error with errno set.
+ */
+int blobvec_append (blobvec_t *bv, const void *data, int len);
+
+/* Append an item of 'len' bytes and return a pointer to its (uninitialized)
+ * data, so the caller can fill it in place.  The pointer is invalidated
+ * by the next append.  Returns NULL on error with errno set.
+ */
+void *blobvec_append_space (blobvec_t *bv, int len);
+
+/* Access the encoded buffer and the number of items it contains.
+ */
+const void *blobvec_data (blobvec_t *bv);
+int blobvec_size (blobvec_t *bv);
+int blobvec_count (blobvec_t *bv);
+
+/* Decode the next item from encoded buffer 'buf' of length 'size'.
+ * '*offset' should be 0 on the first call and is advanced past the item.
+ * Returns 1 if an item was decoded, 0 at end of buffer, or -1 with
+ * errno = EPROTO if the buffer is malformed.
+ */
+int blobvec_next (const void *buf, int size, int *offset,
+                  const void **data, int *len);
+
+/* Count the items in encoded buffer 'buf' of length 'size'.
+ * Returns count on success, or -1 with errno = EPROTO if malformed.
+ */
+int blobvec_count_encoded (const void *buf, int size);
+
+#endif /* !_UTIL_BLOBVEC_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,420 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* shmchan.c - bidirectional message channel in shared memory */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <flux/core.h>
+
+#include "shmring.h"
+#include "shmchan.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC         0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING   0x0002U
+#endif
+
+/* Ring A carries messages from broker to client, ring B from client to
+ * broker.  Each occupies half of the memfd.  Eventfd 0 wakes the broker,
+ * eventfd 1 wakes the client.
+ */
+struct shmchan {
+    int memfd;
+    int efd[2];
+    int local;              /* index of this side's eventfd */
+    void *mem;
+    size_t memsize;
+    shmring_t *tx;
+    shmring_t *rx;
+
+    uint8_t *txbuf;         /* partially sent message */
+    size_t txsize;
+    size_t txdone;
+    size_t txwant;          /* record size that last failed to fit */
+
+    uint8_t *rxbuf;         /* partially received message */
+    size_t rxsize;
+    size_t rxalloc;
+    bool rxerror;           /* peer sent an oversized message */
+
+    size_t maxmsg;
+};
+
+static int create_memfd (const char *name, unsigned int flags)
+{
+#if HAVE_MEMFD_CREATE
+    return memfd_create (name, flags);
+#elif defined(SYS_memfd_create)
+    return syscall (SYS_memfd_create, name, flags);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+void shmchan_destroy (shmchan_t *ch)
+{
+    if (ch) {
+        int saved_errno = errno;
+        shmring_destroy (ch->tx);
+        shmring_destroy (ch->rx);
+        if (ch->mem)
+            (void)munmap (ch->mem, ch->memsize);
+        if (ch->memfd >= 0)
+            (void)close (ch->memfd);
+        if (ch->efd[0] >= 0)
+            (void)close (ch->efd[0]);
+        if (ch->efd[1] >= 0)
+            (void)close (ch->efd[1]);
+        free (ch->txbuf);
+        free (ch->rxbuf);
+        free (ch);
+        errno = saved_errno;
+    }
+}
+
+static shmchan_t *chan_alloc (void)
+{
+    shmchan_t *ch;
+
+    if (!(ch = calloc (1, sizeof (*ch)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    ch->memfd = ch->efd[0] = ch->efd[1] = -1;
+    ch->maxmsg = SHMCHAN_MAXMSG_DEFAULT;
+    return ch;
+}
+
+static int chan_map (shmchan_t *ch)
+{
+    ch->mem = mmap (NULL, ch->memsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    ch->memfd, 0);
+    if (ch->mem == MAP_FAILED) {
+        ch->mem = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+shmchan_t *shmchan_create (size_t capacity)
+{
+    shmchan_t *ch;
+    size_t ringsize = shmring_memsize (capacity);
+    uint8_t *ringA, *ringB;
+
+    if (ringsize == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(ch = chan_alloc ()))
+        return NULL;
+    ch->memsize = ringsize * 2;
+    ch->local = 0;
+    if ((ch->memfd = create_memfd ("flux-shmchan",
+                                   MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0)
+        goto error;
+    if (ftruncate (ch->memfd, ch->memsize) < 0)
+        goto error;
+#ifdef F_ADD_SEALS
+    /* The client must not be able to shrink the memory out from under
+     * the broker, which would fault on access.
+     */
+    if (fcntl (ch->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW
+                                                     | F_SEAL_SEAL) < 0)
+        goto error;
+#endif
+    if ((ch->efd[0] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0
+            || (ch->efd[1] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        goto error;
+    if (chan_map (ch) < 0)
+        goto error;
+    ringA = ch->mem;
+    ringB = ringA + ringsize;
+    if (!(ch->tx = shmring_create (ringA, ringsize, capacity, true))
+            || !(ch->rx = shmring_create (ringB, ringsize, capacity, true)))
+        goto error;
+    return ch;
+error:
+    shmchan_destroy (ch);
+    return NULL;
+}
+
+shmchan_t *shmchan_attach (int fds[SHMCHAN_NFDS])
+{
+    shmchan_t *ch;
+    struct stat sb;
+    uint8_t *ringA, *ringB;
+    size_t ringsize;
+
+    if (!(ch = chan_alloc ()))
+        return NULL;
+    ch->memfd = fds[0];
+    ch->efd[0] = fds[1];
+    ch->efd[1] = fds[2];
+    ch->local = 1;
+    if (fstat (ch->memfd, &sb) < 0)
+        goto error;
+    if (sb.st_size <= 0 || (sb.st_size & 1)) {
+        errno = EPROTO;
+        goto error;
+    }
+    ch->memsize = sb.st_size;
+    if (chan_map (ch) < 0)
+        goto error;
+    ringsize = ch->memsize / 2;
+    ringA = ch->mem;
+    ringB = ringA + ringsize;
+    if (!(ch->rx = shmring_create (ringA, ringsize, 0, false))
+            || !(ch->tx = shmring_create (ringB, ringsize, 0, false)))
+        goto error;
+    return ch;
+error:
+    shmchan_destroy (ch);
+    return NULL;
+}
+
+void shmchan_set_maxmsg (shmchan_t *ch, size_t size)
+{
+    ch->maxmsg = size;
+}
+
+void shmchan_get_fds (shmchan_t *ch, int fds[SHMCHAN_NFDS])
+{
+    fds[0] = ch->memfd;
+    fds[1] = ch->efd[0];
+    fds[2] = ch->efd[1];
+}
+
+int shmchan_get_fd (shmchan_t *ch)
+{
+    return ch->efd[ch->local];
+}
+
+static void wake_peer (shmchan_t *ch)
+{
+    (void)eventfd_write (ch->efd[!ch->local], 1);
+}
+
+void shmchan_clear (shmchan_t *ch)
+{
+    eventfd_t val;
+
+    (void)eventfd_read (ch->efd[ch->local], &val);
+}
+
+static size_t tx_chunk (shmchan_t *ch)
+{
+    size_t max = shmring_maxrecord (ch->tx);
+    size_t left = ch->txsize - ch->txdone;
+
+    return left < max ? left : max;
+}
+
+int shmchan_flush (shmchan_t *ch)
+{
+    void *p;
+    size_t n;
+
+    while (ch->txdone < ch->txsize) {
+        n = tx_chunk (ch);
+        if (!(p = shmring_reserve (ch->tx, n))) {
+            ch->txwant = n;
+            return -1;
+        }
+        memcpy (p, ch->txbuf + ch->txdone, n);
+        ch->txdone += n;
+        if (shmring_commit (ch->tx, ch->txdone < ch->txsize ? SHMRING_MORE
+                                                            : 0))
+            wake_peer (ch);
+    }
+    free (ch->txbuf);
+    ch->txbuf = NULL;
+    ch->txsize = ch->txdone = 0;
+    ch->txwant = 0;
+    return 0;
+}
+
+int shmchan_send (shmchan_t *ch, const flux_msg_t *msg)
+{
+    size_t size;
+    void *p;
+
+    if (!ch || !msg) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (shmchan_flush (ch) < 0)
+        return -1;
+    size = flux_msg_encode_size (msg);
+    if (size > ch->maxmsg) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (size <= shmring_maxrecord (ch->tx)) {
+        if (!(p = shmring_reserve (ch->tx, size))) {
+            ch->txwant = size;
+            return -1;
+        }
+        ch->txwant = 0;
+        if (flux_msg_encode (msg, p, size) < 0)
+            return -1;
+        if (shmring_commit (ch->tx, 0))
+            wake_peer (ch);
+        return 0;
+    }
+    if (!(ch->txbuf = malloc (size))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (flux_msg_encode (msg, ch->txbuf, size) < 0) {
+        free (ch->txbuf);
+        ch->txbuf = NULL;
+        return -1;
+    }
+    ch->txsize = size;
+    ch->txdone = 0;
+    if (shmchan_flush (ch) < 0 && errno != EAGAIN)
+        return -1;
+    return 0;
+}
+
+/* Append a record to the partially received message.  A message that
+ * grows past the limit is dropped and the channel is put in an error
+ * state, since the rest of it can't be told apart from later messages.
+ */
+static int rx_append (shmchan_t *ch, const void *data, size_t len)
+{
+    if (ch->rxsize + len > ch->maxmsg) {
+        free (ch->rxbuf);
+        ch->rxbuf = NULL;
+        ch->rxsize = ch->rxalloc = 0;
+        ch->rxerror = true;
+        errno = EPROTO;
+        return -1;
+    }
+    if (ch->rxsize + len > ch->rxalloc) {
+        size_t rxalloc = ch->rxalloc ? ch->rxalloc : 4096;
+        uint8_t *rxbuf;
+        while (rxalloc < ch->rxsize + len)
+            rxalloc *= 2;
+        if (!(rxbuf = realloc (ch->rxbuf, rxalloc))) {
+            errno = ENOMEM;
+            return -1;
+        }
+        ch->rxbuf = rxbuf;
+        ch->rxalloc = rxalloc;
+    }
+    memcpy (ch->rxbuf + ch->rxsize, data, len);
+    ch->rxsize += len;
+    return 0;
+}
+
+flux_msg_t *shmchan_recv (shmchan_t *ch)
+{
+    flux_msg_t *msg;
+    const void *p;
+    size_t len;
+    int flags;
+
+    if (!ch) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (ch->rxerror) {
+        errno = EPROTO;
+        return NULL;
+    }
+    for (;;) {
+        if (!(p = shmring_peek (ch->rx, &len, &flags)))
+            return NULL;
+        /* Common case: message fits in one record, decode in place.
+         */
+        if (ch->rxsize == 0 && !(flags & SHMRING_MORE)
+                            && len <= ch->maxmsg) {
+            msg = flux_msg_decode (p, len);
+            break;
+        }
+        if (rx_append (ch, p, len) < 0)
+            return NULL;
+        if (!(flags & SHMRING_MORE)) {
+            msg = flux_msg_decode (ch->rxbuf, ch->rxsize);
+            free (ch->rxbuf);
+            ch->rxbuf = NULL;
+            ch->rxsize = ch->rxalloc = 0;
+            break;
+        }
+        if (shmring_consume (ch->rx))
+            wake_peer (ch);
+    }
+    if (shmring_consume (ch->rx))
+        wake_peer (ch);
+    return msg;
+}
+
+bool shmchan_send_ready (shmchan_t *ch)
+{
+    return ch->txdone == ch->txsize;
+}
+
+bool shmchan_recv_ready (shmchan_t *ch)
+{
+    size_t len;
+
+    if (ch->rxerror)
+        return true;
+    return shmring_peek (ch->rx, &len, NULL) != NULL || errno == EPROTO;
+}
+
+bool shmchan_wait (shmchan_t *ch)
+{
+    if (!shmring_reader_wait (ch->rx))
+        return false;
+    if (ch->txwant > 0 && !shmring_writer_wait (ch->tx, ch->txwant))
+        return false;
+    return true;
+}
+
+void shmchan_notify (shmchan_t *ch)
+{
+    (void)eventfd_write (ch->efd[ch->local], 1);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
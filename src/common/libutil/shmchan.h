@@ -0,0 +1,100 @@
+/*
+ *  shmchan_t - bidirectional message channel in shared memory
+ *
+ *  A pair of shmring_t rings in a sealed memfd, one per direction, with
+ *  an eventfd per side for wakeups.  The broker side creates the channel
+ *  and passes its file descriptors to the client, which attaches to it.
+ *  Messages larger than a ring record are sent as a series of records.
+ *
+ *  No system calls are made to move messages unless the peer is sleeping
+ *  (see shmchan_wait()).
+ */
+
+#ifndef _UTIL_SHMCHAN_H
+#define _UTIL_SHMCHAN_H
+
+#include <stdbool.h>
+#include <flux/core.h>
+
+typedef struct shmchan shmchan_t;
+
+enum {
+    SHMCHAN_NFDS = 3,   /* memfd, broker eventfd, client eventfd */
+};
+
+/* Default limit on the size of a message sent or received.
+ */
+#define SHMCHAN_MAXMSG_DEFAULT  (1UL << 30)
+
+/* Create channel with 'capacity' bytes per direction (a power of two),
+ * for the broker side.
+ */
+shmchan_t *shmchan_create (size_t capacity);
+
+/* Attach to channel for the client side, taking ownership of 'fds'
+ * as returned by shmchan_get_fds() in the broker.
+ */
+shmchan_t *shmchan_attach (int fds[SHMCHAN_NFDS]);
+
+void shmchan_destroy (shmchan_t *ch);
+
+/* Set the largest message this side will send or reassemble.
+ * shmchan_send() fails with EMSGSIZE on a larger message, and
+ * shmchan_recv() fails with EPROTO if the peer sends one.
+ */
+void shmchan_set_maxmsg (shmchan_t *ch, size_t size);
+
+/* Get file descriptors to be passed to the client.
+ * They remain owned by the channel.
+ */
+void shmchan_get_fds (shmchan_t *ch, int fds[SHMCHAN_NFDS]);
+
+/* Get eventfd that becomes readable when this side has been woken.
+ */
+int shmchan_get_fd (shmchan_t *ch);
+
+/* Send message.  Returns 0 if the message was accepted, or -1 with
+ * errno = EAGAIN if there is no room (or a partial message is still
+ * pending).  A large message may be accepted before all of it has been
+ * written;  the rest is written by later calls to shmchan_send() or
+ * shmchan_flush().
+ */
+int shmchan_send (shmchan_t *ch, const flux_msg_t *msg);
+
+/* Continue writing a partially sent message.
+ * Returns 0 once nothing is pending, or -1 with errno = EAGAIN.
+ */
+int shmchan_flush (shmchan_t *ch);
+
+/* Receive message.  Returns message, or NULL with errno set:
+ * EAGAIN if no complete message is available, EPROTO if the peer
+ * corrupted the ring or sent a message larger than the limit.
+ * Once EPROTO is returned, all later calls fail the same way.
+ */
+flux_msg_t *shmchan_recv (shmchan_t *ch);
+
+/* Test whether a message can be sent now (no partial message is pending),
+ * or whether some of a message is ready to be received.
+ */
+bool shmchan_send_ready (shmchan_t *ch);
+bool shmchan_recv_ready (shmchan_t *ch);
+
+/* Prepare to sleep until the eventfd becomes readable:  the peer will
+ * wake this side when it sends, or when it makes room for the message
+ * that last failed with EAGAIN.  Returns false if there is already
+ * something to do, in which case the caller should not sleep.
+ * Call shmchan_clear() on wakeup to reset the eventfd.
+ */
+bool shmchan_wait (shmchan_t *ch);
+void shmchan_clear (shmchan_t *ch);
+
+/* Make this side's eventfd readable, e.g. to be called back again
+ * after yielding to other work.
+ */
+void shmchan_notify (shmchan_t *ch);
+
+#endif /* !_UTIL_SHMCHAN_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
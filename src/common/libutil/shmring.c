@@ -0,0 +1,270 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* shmring.c - single producer, single consumer record ring */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "shmring.h"
+
+#define SHMRING_MAGIC   0x5348524e
+#define CACHELINE       64
+#define PAD_FLAG        0x80000000
+
+/* Shared state.  The producer owns 'head' and the consumer owns 'tail';
+ * they are kept on separate cache lines.  Each side sets its own
+ * waiting flag, and the other side clears it when delivering a wakeup.
+ */
+struct shmring_hdr {
+    uint32_t magic;
+    uint32_t capacity;
+    uint8_t pad0[CACHELINE - 8];
+    uint64_t head;              /* bytes committed */
+    uint32_t writer_waiting;
+    uint8_t pad1[CACHELINE - 12];
+    uint64_t tail;              /* bytes consumed */
+    uint32_t reader_waiting;
+    uint8_t pad2[CACHELINE - 12];
+};
+
+/* Each record is preceded by this header and padded to 8 bytes.
+ * A record that would wrap is preceded by a pad record filling the
+ * end of the ring.
+ */
+struct shmring_rec {
+    uint32_t len;
+    uint32_t flags;
+};
+
+struct shmring {
+    struct shmring_hdr *hdr;
+    uint8_t *data;
+    size_t capacity;
+    uint64_t mask;
+    uint64_t head;              /* producer: private copy of hdr->head */
+    uint64_t rpos;              /* producer: position of reserved record */
+    size_t rlen;                /* producer: length of reserved record */
+    uint64_t tail;              /* consumer: private copy of hdr->tail */
+    uint64_t next_tail;         /* consumer: tail after peeked record */
+};
+
+static size_t record_size (size_t len)
+{
+    return (sizeof (struct shmring_rec) + len + 7) & ~(size_t)7;
+}
+
+size_t shmring_memsize (size_t capacity)
+{
+    if (capacity < 64 || (capacity & (capacity - 1)) != 0
+                      || capacity > UINT32_MAX)
+        return 0;
+    return sizeof (struct shmring_hdr) + capacity;
+}
+
+shmring_t *shmring_create (void *mem, size_t size, size_t capacity, bool init)
+{
+    struct shmring_hdr *hdr = mem;
+    shmring_t *r;
+
+    if (!mem) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!init) {
+        if (size < sizeof (*hdr) || hdr->magic != SHMRING_MAGIC) {
+            errno = EINVAL;
+            return NULL;
+        }
+        capacity = hdr->capacity;
+    }
+    if (shmring_memsize (capacity) == 0 || shmring_memsize (capacity) > size) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(r = calloc (1, sizeof (*r)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (init) {
+        memset (hdr, 0, sizeof (*hdr));
+        hdr->capacity = capacity;
+        __atomic_store_n (&hdr->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+    }
+    r->hdr = hdr;
+    r->data = (uint8_t *)mem + sizeof (*hdr);
+    r->capacity = capacity;
+    r->mask = capacity - 1;
+    r->head = __atomic_load_n (&hdr->head, __ATOMIC_ACQUIRE);
+    r->tail = __atomic_load_n (&hdr->tail, __ATOMIC_ACQUIRE);
+    r->next_tail = r->tail;
+    return r;
+}
+
+void shmring_destroy (shmring_t *r)
+{
+    free (r);
+}
+
+size_t shmring_maxrecord (shmring_t *r)
+{
+    return r->capacity / 2 - sizeof (struct shmring_rec);
+}
+
+/* Return the number of bytes (pad included) needed to write a record
+ * of 'len' bytes at 'head'.
+ */
+static size_t space_needed (shmring_t *r, uint64_t head, size_t len,
+                            size_t *pad)
+{
+    size_t need = record_size (len);
+    size_t contig = r->capacity - (head & r->mask);
+
+    *pad = contig < need ? contig : 0;
+    return *pad + need;
+}
+
+void *shmring_reserve (shmring_t *r, size_t len)
+{
+    uint64_t head = r->head;
+    uint64_t tail = __atomic_load_n (&r->hdr->tail, __ATOMIC_ACQUIRE);
+    struct shmring_rec *rec;
+    size_t pad;
+
+    if (len > shmring_maxrecord (r)) {
+        errno = EMSGSIZE;
+        return NULL;
+    }
+    if (space_needed (r, head, len, &pad) > r->capacity - (head - tail)) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    if (pad > 0) {
+        rec = (struct shmring_rec *)(r->data + (head & r->mask));
+        rec->len = pad - sizeof (*rec);
+        rec->flags = PAD_FLAG;
+    }
+    r->rpos = head + pad;
+    r->rlen = len;
+    return r->data + (r->rpos & r->mask) + sizeof (*rec);
+}
+
+bool shmring_commit (shmring_t *r, int flags)
+{
+    struct shmring_rec *rec;
+
+    rec = (struct shmring_rec *)(r->data + (r->rpos & r->mask));
+    rec->len = r->rlen;
+    rec->flags = flags & ~PAD_FLAG;
+    r->head = r->rpos + record_size (r->rlen);
+    __atomic_store_n (&r->hdr->head, r->head, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&r->hdr->reader_waiting, __ATOMIC_SEQ_CST))
+        return __atomic_exchange_n (&r->hdr->reader_waiting, 0,
+                                    __ATOMIC_SEQ_CST) != 0;
+    return false;
+}
+
+/* The peer may scribble on shared memory, so positions are kept
+ * privately, and each record header is read once and checked against
+ * the ring bounds before it is used.
+ */
+const void *shmring_peek (shmring_t *r, size_t *len, int *flags)
+{
+    uint64_t tail = r->tail;
+    uint64_t head = __atomic_load_n (&r->hdr->head, __ATOMIC_ACQUIRE);
+    struct shmring_rec *rec;
+    uint32_t rlen, rflags;
+    size_t off;
+
+    if (head - tail > r->capacity)
+        goto proto;
+    while (tail != head) {
+        off = tail & r->mask;
+        rec = (struct shmring_rec *)(r->data + off);
+        rlen = __atomic_load_n (&rec->len, __ATOMIC_RELAXED);
+        rflags = __atomic_load_n (&rec->flags, __ATOMIC_RELAXED);
+        if (head - tail < sizeof (*rec)
+                || rlen > r->capacity - off - sizeof (*rec)
+                || record_size (rlen) > head - tail)
+            goto proto;
+        if (!(rflags & PAD_FLAG)) {
+            *len = rlen;
+            if (flags)
+                *flags = rflags;
+            r->next_tail = tail + record_size (rlen);
+            return rec + 1;
+        }
+        tail += record_size (rlen);
+    }
+    errno = EAGAIN;
+    return NULL;
+proto:
+    errno = EPROTO;
+    return NULL;
+}
+
+bool shmring_consume (shmring_t *r)
+{
+    r->tail = r->next_tail;
+    __atomic_store_n (&r->hdr->tail, r->tail, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&r->hdr->writer_waiting, __ATOMIC_SEQ_CST))
+        return __atomic_exchange_n (&r->hdr->writer_waiting, 0,
+                                    __ATOMIC_SEQ_CST) != 0;
+    return false;
+}
+
+bool shmring_reader_wait (shmring_t *r)
+{
+    __atomic_store_n (&r->hdr->reader_waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&r->hdr->head, __ATOMIC_SEQ_CST) != r->tail) {
+        __atomic_store_n (&r->hdr->reader_waiting, 0, __ATOMIC_SEQ_CST);
+        return false;
+    }
+    return true;
+}
+
+bool shmring_writer_wait (shmring_t *r, size_t len)
+{
+    uint64_t head = r->head;
+    uint64_t tail;
+    size_t pad;
+    size_t need = space_needed (r, head, len, &pad);
+
+    __atomic_store_n (&r->hdr->writer_waiting, 1, __ATOMIC_SEQ_CST);
+    tail = __atomic_load_n (&r->hdr->tail, __ATOMIC_SEQ_CST);
+    if (need <= r->capacity - (head - tail)) {
+        __atomic_store_n (&r->hdr->writer_waiting, 0, __ATOMIC_SEQ_CST);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,78 @@
+/*
+ *  shmring_t - single producer, single consumer record ring
+ *
+ *  A ring of variable sized records in a memory region that may be shared
+ *  between two processes, one writing and one reading.  Records are stored
+ *  contiguously, so they may be written and read in place.
+ *
+ *  The ring performs no I/O.  When one side finds the ring empty (or full)
+ *  and wants to sleep, it calls shmring_reader_wait() (or
+ *  shmring_writer_wait()), and the other side's next commit (or consume)
+ *  reports that a wakeup is needed, which the caller delivers by some other
+ *  means, e.g. an eventfd.  While both sides are busy no wakeups are needed.
+ */
+
+#ifndef _UTIL_SHMRING_H
+#define _UTIL_SHMRING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct shmring shmring_t;
+
+/* Record flags.
+ */
+enum {
+    SHMRING_MORE = 1,   /* record is continued in the next record */
+};
+
+/* Return the size of a memory region holding a ring with 'capacity'
+ * bytes of record space, or 0 if 'capacity' is not a power of two
+ * of at least 64.
+ */
+size_t shmring_memsize (size_t capacity);
+
+/* Create a handle for the ring in 'mem'.  If 'init' is true, initialize
+ * a new ring with 'capacity' bytes of record space; otherwise attach to
+ * an existing ring, which must fit within 'size' bytes.
+ * Returns handle on success, NULL on failure with errno set.
+ */
+shmring_t *shmring_create (void *mem, size_t size, size_t capacity, bool init);
+void shmring_destroy (shmring_t *r);
+
+/* Return the largest record that may be written.
+ */
+size_t shmring_maxrecord (shmring_t *r);
+
+/* Producer: reserve space for a record of 'len' bytes and return a pointer
+ * to it, or NULL with errno = EAGAIN if the ring is too full, or EMSGSIZE
+ * if 'len' exceeds shmring_maxrecord().  Publish the record with
+ * shmring_commit(), which returns true if the reader must be woken.
+ */
+void *shmring_reserve (shmring_t *r, size_t len);
+bool shmring_commit (shmring_t *r, int flags);
+
+/* Consumer: return a pointer to the next record and its size and flags,
+ * or NULL with errno = EAGAIN if the ring is empty.  Release the record
+ * with shmring_consume(), which returns true if the writer must be woken.
+ */
+const void *shmring_peek (shmring_t *r, size_t *len, int *flags);
+bool shmring_consume (shmring_t *r);
+
+/* Consumer: note intent to sleep until a record is committed.
+ * Returns false if the ring is not empty, in which case the caller
+ * should not sleep.
+ */
+bool shmring_reader_wait (shmring_t *r);
+
+/* Producer: note intent to sleep until a record of 'len' bytes fits.
+ * Returns false if it already fits, in which case the caller
+ * should not sleep.
+ */
+bool shmring_writer_wait (shmring_t *r, size_t len);
+
+#endif /* !_UTIL_SHMRING_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
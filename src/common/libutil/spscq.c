@@ -0,0 +1,214 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* spscq.c - lock-free single producer, single consumer pointer queue
+ *
+ * A singly linked list from the consumer's 'tail' (the last node consumed,
+ * which serves as a dummy) to the producer's 'head' (the last node pushed).
+ * Nodes before 'tail' belong to the producer again, which reuses them from
+ * 'first' onward;  'tail_copy' caches the producer's last look at 'tail'
+ * so the shared cache line is read only when the cache seems exhausted.
+ *
+ * Sleeping uses the same store-then-check protocol on both sides:
+ * the consumer sets 'waiting' and then looks for a node, and the producer
+ * links a node and then looks at 'waiting', both with sequentially
+ * consistent atomics, so at least one of them sees the other.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "spscq.h"
+
+#define CACHELINE 64
+
+struct node {
+    struct node *next;
+    void *item;
+};
+
+struct spscq {
+    /* consumer */
+    struct node *tail __attribute__ ((aligned (CACHELINE)));
+    int waiting;
+
+    /* producer */
+    struct node *head __attribute__ ((aligned (CACHELINE)));
+    struct node *first;
+    struct node *tail_copy;
+
+    int efd __attribute__ ((aligned (CACHELINE)));
+};
+
+spscq_t *spscq_create (void)
+{
+    spscq_t *q;
+    struct node *n;
+
+    if (posix_memalign ((void **)&q, CACHELINE, sizeof (*q)) != 0) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (!(n = calloc (1, sizeof (*n)))) {
+        free (q);
+        errno = ENOMEM;
+        return NULL;
+    }
+    q->tail = q->head = q->first = q->tail_copy = n;
+    q->waiting = 0;
+    if ((q->efd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        int saved_errno = errno;
+        free (n);
+        free (q);
+        errno = saved_errno;
+        return NULL;
+    }
+    return q;
+}
+
+void spscq_destroy (spscq_t *q, spscq_free_f free_fn)
+{
+    if (q) {
+        int saved_errno = errno;
+        struct node *n, *next;
+        void *item;
+
+        while ((item = spscq_pop (q))) {
+            if (free_fn)
+                free_fn (item);
+        }
+        for (n = q->first; n != NULL; n = next) {
+            next = n->next;
+            free (n);
+        }
+        (void)close (q->efd);
+        free (q);
+        errno = saved_errno;
+    }
+}
+
+static struct node *node_alloc (spscq_t *q)
+{
+    struct node *n;
+
+    if (q->first == q->tail_copy) {
+        q->tail_copy = __atomic_load_n (&q->tail, __ATOMIC_ACQUIRE);
+        if (q->first == q->tail_copy) {
+            if (!(n = malloc (sizeof (*n))))
+                errno = ENOMEM;
+            return n;
+        }
+    }
+    n = q->first;
+    q->first = n->next;
+    return n;
+}
+
+int spscq_push (spscq_t *q, void *item)
+{
+    struct node *n;
+
+    if (!item) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(n = node_alloc (q)))
+        return -1;
+    n->item = item;
+    n->next = NULL;
+    __atomic_store_n (&q->head->next, n, __ATOMIC_SEQ_CST);
+    q->head = n;
+    if (__atomic_load_n (&q->waiting, __ATOMIC_SEQ_CST)
+            && __atomic_exchange_n (&q->waiting, 0, __ATOMIC_SEQ_CST))
+        (void)eventfd_write (q->efd, 1);
+    return 0;
+}
+
+void *spscq_pop (spscq_t *q)
+{
+    struct node *next;
+    void *item;
+
+    if (!(next = __atomic_load_n (&q->tail->next, __ATOMIC_ACQUIRE))) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    item = next->item;
+    /* Publishing the new tail hands the old one back to the producer.
+     */
+    __atomic_store_n (&q->tail, next, __ATOMIC_RELEASE);
+    return item;
+}
+
+void *spscq_peek (spscq_t *q)
+{
+    struct node *next;
+
+    if (!(next = __atomic_load_n (&q->tail->next, __ATOMIC_ACQUIRE))) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    return next->item;
+}
+
+bool spscq_empty (spscq_t *q)
+{
+    return __atomic_load_n (&q->tail->next, __ATOMIC_ACQUIRE) == NULL;
+}
+
+bool spscq_wait (spscq_t *q)
+{
+    __atomic_store_n (&q->waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&q->tail->next, __ATOMIC_SEQ_CST) != NULL) {
+        __atomic_store_n (&q->waiting, 0, __ATOMIC_SEQ_CST);
+        return false;
+    }
+    return true;
+}
+
+void spscq_clear (spscq_t *q)
+{
+    eventfd_t val;
+
+    (void)eventfd_read (q->efd, &val);
+}
+
+void spscq_notify (spscq_t *q)
+{
+    (void)eventfd_write (q->efd, 1);
+}
+
+int spscq_get_fd (spscq_t *q)
+{
+    return q->efd;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,68 @@
+/*
+ *  spscq_t - lock-free single producer, single consumer pointer queue
+ *
+ *  An unbounded queue for passing pointers (and ownership of what they
+ *  point to) from one thread to another without locks.  Nodes are recycled
+ *  by the producer once the consumer is past them, so a queue in steady
+ *  state does not allocate.
+ *
+ *  The consumer may sleep on an eventfd:  it calls spscq_wait() and, if
+ *  that returns true, polls spscq_get_fd().  The producer writes the
+ *  eventfd only when the consumer has announced that it is sleeping.
+ */
+
+#ifndef _UTIL_SPSCQ_H
+#define _UTIL_SPSCQ_H
+
+#include <stdbool.h>
+
+typedef struct spscq spscq_t;
+
+typedef void (*spscq_free_f)(void *item);
+
+spscq_t *spscq_create (void);
+
+/* Destroy queue, calling 'free_fn' (if non-NULL) on items still queued.
+ */
+void spscq_destroy (spscq_t *q, spscq_free_f free_fn);
+
+/* Producer: append 'item', which must not be NULL.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+int spscq_push (spscq_t *q, void *item);
+
+/* Consumer: remove the oldest item and return it,
+ * or return NULL with errno = EAGAIN if the queue is empty.
+ */
+void *spscq_pop (spscq_t *q);
+
+/* Consumer: return the oldest item without removing it,
+ * or NULL with errno = EAGAIN if the queue is empty.
+ */
+void *spscq_peek (spscq_t *q);
+
+/* Consumer: test whether the queue is empty.
+ */
+bool spscq_empty (spscq_t *q);
+
+/* Consumer: prepare to sleep until an item is pushed.  Returns false if
+ * the queue is not empty, in which case the caller should not sleep.
+ * Call spscq_clear() on wakeup to reset the eventfd.
+ */
+bool spscq_wait (spscq_t *q);
+void spscq_clear (spscq_t *q);
+
+/* Consumer: make the eventfd readable, e.g. to be called back again
+ * after yielding to other work.
+ */
+void spscq_notify (spscq_t *q);
+
+/* Get eventfd that becomes readable when the consumer has been woken.
+ */
+int spscq_get_fd (spscq_t *q);
+
+#endif /* !_UTIL_SPSCQ_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
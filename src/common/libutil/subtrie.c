@@ -0,0 +1,355 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* subtrie.c - index of topic prefix subscriptions
+ *
+ * A trie with one node per character of a subscribed prefix.  Each node
+ * holds the subscribers to the prefix that ends there, in an array sorted
+ * by pointer value.  Matching a topic walks the trie along the topic and
+ * visits the subscribers of each node on the way.  A subscriber with more
+ * than one matching prefix is reported only at the first node, which is
+ * detected by searching the earlier nodes on the path.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "subtrie.h"
+
+struct entry {
+    void *subscriber;
+    int refcount;
+};
+
+struct node {
+    char c;
+    struct node **children;     /* sorted by c */
+    int nchildren;
+    struct entry *entries;      /* sorted by subscriber */
+    int nentries;
+    int size;
+};
+
+struct subtrie {
+    struct node root;
+    int count;
+    struct node **path;         /* scratch space for subtrie_match() */
+    int pathsize;
+};
+
+static void node_clear (struct node *n)
+{
+    int i;
+
+    for (i = 0; i < n->nchildren; i++) {
+        node_clear (n->children[i]);
+        free (n->children[i]);
+    }
+    free (n->children);
+    free (n->entries);
+}
+
+/* Binary search for child 'c'.  Returns index of child if found,
+ * otherwise -(insertion point) - 1.
+ */
+static int child_search (struct node *n, char c)
+{
+    int lo = 0;
+    int hi = n->nchildren - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (n->children[mid]->c == c)
+            return mid;
+        if (n->children[mid]->c < c)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -lo - 1;
+}
+
+static struct node *child_lookup (struct node *n, char c)
+{
+    int i = child_search (n, c);
+    return i >= 0 ? n->children[i] : NULL;
+}
+
+static struct node *child_add (struct node *n, char c)
+{
+    struct node **children;
+    struct node *child;
+    int i = child_search (n, c);
+
+    if (i >= 0)
+        return n->children[i];
+    i = -i - 1;
+    if (!(child = calloc (1, sizeof (*child))))
+        goto nomem;
+    if (!(children = realloc (n->children,
+                              (n->nchildren + 1) * sizeof (*children)))) {
+        free (child);
+        goto nomem;
+    }
+    child->c = c;
+    memmove (&children[i + 1], &children[i],
+             (n->nchildren - i) * sizeof (*children));
+    children[i] = child;
+    n->children = children;
+    n->nchildren++;
+    return child;
+nomem:
+    errno = ENOMEM;
+    return NULL;
+}
+
+static void child_delete (struct node *n, struct node *child)
+{
+    int i = child_search (n, child->c);
+
+    node_clear (child);
+    free (child);
+    memmove (&n->children[i], &n->children[i + 1],
+             (n->nchildren - i - 1) * sizeof (n->children[0]));
+    n->nchildren--;
+}
+
+/* Binary search for 'subscriber'.  Returns index of entry if found,
+ * otherwise -(insertion point) - 1.
+ */
+static int entry_search (struct node *n, void *subscriber)
+{
+    int lo = 0;
+    int hi = n->nentries - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (n->entries[mid].subscriber == subscriber)
+            return mid;
+        if ((char *)n->entries[mid].subscriber < (char *)subscriber)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -lo - 1;
+}
+
+/* Add a reference to 'subscriber'.
+ * Returns 1 if a new entry was created, 0 if not, -1 on error.
+ */
+static int entry_add (struct node *n, void *subscriber)
+{
+    int i = entry_search (n, subscriber);
+
+    if (i >= 0) {
+        n->entries[i].refcount++;
+        return 0;
+    }
+    i = -i - 1;
+    if (n->nentries == n->size) {
+        int size = n->size ? n->size * 2 : 4;
+        struct entry *entries;
+        if (!(entries = realloc (n->entries, size * sizeof (*entries)))) {
+            errno = ENOMEM;
+            return -1;
+        }
+        n->entries = entries;
+        n->size = size;
+    }
+    memmove (&n->entries[i + 1], &n->entries[i],
+             (n->nentries - i) * sizeof (n->entries[0]));
+    n->entries[i].subscriber = subscriber;
+    n->entries[i].refcount = 1;
+    n->nentries++;
+    return 1;
+}
+
+static void entry_delete (struct node *n, int i)
+{
+    memmove (&n->entries[i], &n->entries[i + 1],
+             (n->nentries - i - 1) * sizeof (n->entries[0]));
+    n->nentries--;
+}
+
+static bool node_is_empty (struct node *n)
+{
+    return n->nentries == 0 && n->nchildren == 0;
+}
+
+subtrie_t *subtrie_create (void)
+{
+    subtrie_t *t;
+
+    if (!(t = calloc (1, sizeof (*t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return t;
+}
+
+void subtrie_destroy (subtrie_t *t)
+{
+    if (t) {
+        int saved_errno = errno;
+        node_clear (&t->root);
+        free (t->path);
+        free (t);
+        errno = saved_errno;
+    }
+}
+
+int subtrie_insert (subtrie_t *t, const char *prefix, void *subscriber)
+{
+    struct node *n = &t->root;
+    struct node **path;
+    int depth = strlen (prefix);
+    int rc;
+
+    if (!subscriber) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* Ensure subtrie_match() has room for a path of this depth.
+     */
+    if (depth + 1 > t->pathsize) {
+        if (!(path = realloc (t->path, (depth + 1) * sizeof (*path)))) {
+            errno = ENOMEM;
+            return -1;
+        }
+        t->path = path;
+        t->pathsize = depth + 1;
+    }
+    while (*prefix) {
+        if (!(n = child_add (n, *prefix++)))
+            return -1; /* N.B. empty nodes are left behind */
+    }
+    if ((rc = entry_add (n, subscriber)) < 0)
+        return -1;
+    t->count += rc;
+    return 0;
+}
+
+/* Remove subscription from the subtree at 'n', pruning empty nodes.
+ */
+static int remove_prefix (subtrie_t *t, struct node *n,
+                          const char *prefix, void *subscriber)
+{
+    struct node *child;
+    int i;
+
+    if (*prefix == '\0') {
+        if ((i = entry_search (n, subscriber)) < 0) {
+            errno = ENOENT;
+            return -1;
+        }
+        if (--n->entries[i].refcount == 0) {
+            entry_delete (n, i);
+            t->count--;
+        }
+        return 0;
+    }
+    if (!(child = child_lookup (n, *prefix))) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (remove_prefix (t, child, prefix + 1, subscriber) < 0)
+        return -1;
+    if (node_is_empty (child))
+        child_delete (n, child);
+    return 0;
+}
+
+int subtrie_remove (subtrie_t *t, const char *prefix, void *subscriber)
+{
+    return remove_prefix (t, &t->root, prefix, subscriber);
+}
+
+static void remove_all (subtrie_t *t, struct node *n, void *subscriber)
+{
+    int i;
+
+    if ((i = entry_search (n, subscriber)) >= 0) {
+        entry_delete (n, i);
+        t->count--;
+    }
+    for (i = n->nchildren - 1; i >= 0; i--) {
+        struct node *child = n->children[i];
+        remove_all (t, child, subscriber);
+        if (node_is_empty (child))
+            child_delete (n, child);
+    }
+}
+
+void subtrie_remove_all (subtrie_t *t, void *subscriber)
+{
+    remove_all (t, &t->root, subscriber);
+}
+
+int subtrie_match (subtrie_t *t, const char *topic,
+                   subtrie_match_f cb, void *arg)
+{
+    struct node *n = &t->root;
+    int depth = 0;
+    int i, j, k;
+
+    /* Collect nodes with subscribers along the topic path.
+     * The path can be no longer than the longest prefix ever inserted.
+     */
+    while (n) {
+        if (n->nentries > 0)
+            t->path[depth++] = n;
+        if (*topic == '\0')
+            break;
+        n = child_lookup (n, *topic++);
+    }
+    for (i = 0; i < depth; i++) {
+        struct node *n = t->path[i];
+        for (j = 0; j < n->nentries; j++) {
+            void *subscriber = n->entries[j].subscriber;
+            for (k = 0; k < i; k++) {
+                if (entry_search (t->path[k], subscriber) >= 0)
+                    break;
+            }
+            if (k < i)
+                continue; /* already reported */
+            if (cb (subscriber, arg) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+int subtrie_count (subtrie_t *t)
+{
+    return t->count;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
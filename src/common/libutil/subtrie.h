@@ -0,0 +1,52 @@
+/*
+ *  subtrie_t - index of topic prefix subscriptions
+ *
+ *  Maps topic string prefixes to sets of subscribers, so that the
+ *  subscribers to a topic can be found in time proportional to the
+ *  length of the topic, rather than the number of subscriptions.
+ *  A subscriber is an opaque pointer.
+ */
+
+#ifndef _UTIL_SUBTRIE_H
+#define _UTIL_SUBTRIE_H
+
+typedef struct subtrie subtrie_t;
+
+/* Callback for subtrie_match().  Return 0 to continue, -1 to stop.
+ */
+typedef int (*subtrie_match_f)(void *subscriber, void *arg);
+
+subtrie_t *subtrie_create (void);
+void subtrie_destroy (subtrie_t *t);
+
+/* Subscribe 'subscriber' to topics beginning with 'prefix'.
+ * Subscriptions are reference counted:  a subscription added N times
+ * must be removed N times.  Returns 0 on success, -1 on failure with errno set.
+ */
+int subtrie_insert (subtrie_t *t, const char *prefix, void *subscriber);
+
+/* Drop one reference on a subscription.
+ * Returns 0 on success, -1 with errno = ENOENT if there is no such
+ * subscription.
+ */
+int subtrie_remove (subtrie_t *t, const char *prefix, void *subscriber);
+
+/* Drop all subscriptions of 'subscriber'.
+ */
+void subtrie_remove_all (subtrie_t *t, void *subscriber);
+
+/* Call 'cb' once for each subscriber with a subscription that is a
+ * prefix of 'topic'.  Returns 0 on success, or -1 if 'cb' returned -1.
+ */
+int subtrie_match (subtrie_t *t, const char *topic,
+                   subtrie_match_f cb, void *arg);
+
+/* Return the number of distinct (prefix, subscriber) subscriptions.
+ */
+int subtrie_count (subtrie_t *t);
+
+#endif /* !_UTIL_SUBTRIE_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
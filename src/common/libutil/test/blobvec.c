@@ -0,0 +1,93 @@
+#include <errno.h>
+#include <string.h>
+
+#include "src/common/libtap/tap.h"
+#include "src/common/libutil/blobvec.h"
+
+int main (int argc, char *argv[])
+{
+    blobvec_t *bv;
+    const void *buf;
+    const void *data;
+    int size, len, offset;
+    char trunc[4] = { 0, 0, 0, 9 };
+    void *p;
+
+    plan (NO_PLAN);
+
+    ok ((bv = blobvec_create ()) != NULL,
+        "blobvec_create works");
+    ok (blobvec_count (bv) == 0 && blobvec_size (bv) == 0,
+        "empty blobvec has count=0 size=0");
+    ok (blobvec_append (bv, "foo", 4) == 0,
+        "blobvec_append foo works");
+    ok (blobvec_append (bv, NULL, 0) == 0,
+        "blobvec_append zero length item works");
+    ok (blobvec_append (bv, NULL, -1) == 0,
+        "blobvec_append absent item works");
+    ok (blobvec_append (bv, "barbaz", 7) == 0,
+        "blobvec_append barbaz works");
+    errno = 0;
+    ok (blobvec_append (bv, "x", -2) < 0 && errno == EINVAL,
+        "blobvec_append len=-2 fails with EINVAL");
+    errno = 0;
+    ok (blobvec_append (bv, NULL, 1) < 0 && errno == EINVAL,
+        "blobvec_append data=NULL len=1 fails with EINVAL");
+    ok (blobvec_count (bv) == 4,
+        "blobvec_count returns 4");
+    buf = blobvec_data (bv);
+    size = blobvec_size (bv);
+    ok (size == 4*4 + 4 + 7,
+        "blobvec_size returns expected size");
+    ok (blobvec_count_encoded (buf, size) == 4,
+        "blobvec_count_encoded returns 4");
+
+    offset = 0;
+    ok (blobvec_next (buf, size, &offset, &data, &len) == 1
+        && len == 4 && !strcmp (data, "foo"),
+        "blobvec_next returns foo");
+    ok (blobvec_next (buf, size, &offset, &data, &len) == 1
+        && len == 0 && data == NULL,
+        "blobvec_next returns zero length item");
+    ok (blobvec_next (buf, size, &offset, &data, &len) == 1
+        && len == -1 && data == NULL,
+        "blobvec_next returns absent item");
+    ok (blobvec_next (buf, size, &offset, &data, &len) == 1
+        && len == 7 && !strcmp (data, "barbaz"),
+        "blobvec_next returns barbaz");
+    ok (blobvec_next (buf, size, &offset, &data, &len) == 0,
+        "blobvec_next returns 0 at end");
+
+    errno = 0;
+    ok (blobvec_count_encoded (buf, size - 1) < 0 && errno == EPROTO,
+        "blobvec_count_encoded on truncated buffer fails with EPROTO");
+    errno = 0;
+    ok (blobvec_count_encoded (trunc, sizeof (trunc)) < 0 && errno == EPROTO,
+        "blobvec_count_encoded with length past end fails with EPROTO");
+    ok (blobvec_count_encoded (NULL, 0) == 0,
+        "blobvec_count_encoded on empty buffer returns 0");
+
+    blobvec_destroy (bv);
+
+    ok ((bv = blobvec_create ()) != NULL,
+        "blobvec_create works");
+    ok ((p = blobvec_append_space (bv, 4)) != NULL,
+        "blobvec_append_space works");
+    memcpy (p, "abc", 4);
+    errno = 0;
+    ok (blobvec_append_space (bv, -1) == NULL && errno == EINVAL,
+        "blobvec_append_space len=-1 fails with EINVAL");
+    offset = 0;
+    ok (blobvec_next (blobvec_data (bv), blobvec_size (bv), &offset,
+                      &data, &len) == 1
+        && len == 4 && !strcmp (data, "abc"),
+        "blobvec_next returns item filled in place");
+    blobvec_destroy (bv);
+
+    done_testing ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
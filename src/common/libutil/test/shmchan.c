@@ -0,0 +1,214 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <flux/core.h>
+
+#include "src/common/libtap/tap.h"
+#include "src/common/libutil/shmchan.h"
+
+static flux_msg_t *create_msg (const char *topic, int size)
+{
+    flux_msg_t *msg;
+    char *buf = NULL;
+
+    if (size > 0) {
+        if (!(buf = malloc (size)))
+            BAIL_OUT ("out of memory");
+        memset (buf, 'x', size);
+    }
+    if (!(msg = flux_msg_create (FLUX_MSGTYPE_EVENT))
+            || flux_msg_set_topic (msg, topic) < 0
+            || (size > 0 && flux_msg_set_payload (msg, 0, buf, size) < 0))
+        BAIL_OUT ("could not create message");
+    free (buf);
+    return msg;
+}
+
+static bool check_msg (flux_msg_t *msg, const char *topic, int size)
+{
+    const char *s;
+    const void *buf;
+    int n = 0;
+
+    if (!msg || flux_msg_get_topic (msg, &s) < 0 || strcmp (s, topic) != 0)
+        return false;
+    if (size > 0 && (flux_msg_get_payload (msg, NULL, &buf, &n) < 0
+                                                    || n != size))
+        return false;
+    return true;
+}
+
+void basic (void)
+{
+    shmchan_t *b, *c;
+    int fds[SHMCHAN_NFDS], cfds[SHMCHAN_NFDS];
+    flux_msg_t *msg, *rmsg;
+    int i;
+
+    errno = 0;
+    ok (shmchan_create (1000) == NULL && errno == EINVAL,
+        "shmchan_create fails with EINVAL on bad capacity");
+    ok ((b = shmchan_create (4096)) != NULL,
+        "shmchan_create works");
+    shmchan_get_fds (b, fds);
+    for (i = 0; i < SHMCHAN_NFDS; i++)
+        if ((cfds[i] = dup (fds[i])) < 0)
+            BAIL_OUT ("dup failed");
+    ok ((c = shmchan_attach (cfds)) != NULL,
+        "shmchan_attach works");
+
+    ok (shmchan_send_ready (b) && shmchan_recv_ready (c) == false,
+        "channel is empty");
+    errno = 0;
+    ok (shmchan_recv (c) == NULL && errno == EAGAIN,
+        "shmchan_recv on empty channel fails with EAGAIN");
+    ok (shmchan_wait (c) == true,
+        "shmchan_wait says client may sleep");
+
+    msg = create_msg ("a.b", 10);
+    ok (shmchan_send (b, msg) == 0,
+        "broker sent small message");
+    flux_msg_destroy (msg);
+    ok (shmchan_recv_ready (c) == true,
+        "client is ready to receive");
+    ok (shmchan_wait (c) == false,
+        "shmchan_wait says client should not sleep");
+    rmsg = shmchan_recv (c);
+    ok (check_msg (rmsg, "a.b", 10),
+        "client received it");
+    flux_msg_destroy (rmsg);
+    shmchan_clear (c);
+
+    msg = create_msg ("c.d", 0);
+    ok (shmchan_send (c, msg) == 0,
+        "client sent message");
+    flux_msg_destroy (msg);
+    rmsg = shmchan_recv (b);
+    ok (check_msg (rmsg, "c.d", 0),
+        "broker received it");
+    flux_msg_destroy (rmsg);
+
+    shmchan_destroy (b);
+    shmchan_destroy (c);
+}
+
+/* Send a message much larger than the ring, alternating between
+ * flushing and receiving.
+ */
+void large (void)
+{
+    shmchan_t *b, *c;
+    int fds[SHMCHAN_NFDS], cfds[SHMCHAN_NFDS];
+    flux_msg_t *msg, *rmsg = NULL;
+    int i, n;
+
+    if (!(b = shmchan_create (4096)))
+        BAIL_OUT ("shmchan_create failed");
+    shmchan_get_fds (b, fds);
+    for (i = 0; i < SHMCHAN_NFDS; i++)
+        if ((cfds[i] = dup (fds[i])) < 0)
+            BAIL_OUT ("dup failed");
+    if (!(c = shmchan_attach (cfds)))
+        BAIL_OUT ("shmchan_attach failed");
+
+    msg = create_msg ("large", 100000);
+    ok (shmchan_send (b, msg) == 0,
+        "broker sent 100K message through 4K ring");
+    flux_msg_destroy (msg);
+    ok (shmchan_send_ready (b) == false,
+        "part of the message is pending");
+    msg = create_msg ("small", 0);
+    errno = 0;
+    ok (shmchan_send (b, msg) < 0 && errno == EAGAIN,
+        "next message can't be sent yet");
+    n = 0;
+    while (!rmsg && n++ < 1000) {
+        if (!(rmsg = shmchan_recv (c)) && errno != EAGAIN)
+            break;
+        (void)shmchan_flush (b);
+    }
+    ok (check_msg (rmsg, "large", 100000),
+        "client reassembled the message");
+    flux_msg_destroy (rmsg);
+    ok (shmchan_send_ready (b) == true && shmchan_send (b, msg) == 0,
+        "next message could be sent");
+    flux_msg_destroy (msg);
+    rmsg = shmchan_recv (c);
+    ok (check_msg (rmsg, "small", 0),
+        "client received it");
+    flux_msg_destroy (rmsg);
+
+    shmchan_destroy (b);
+    shmchan_destroy (c);
+}
+
+/* A message larger than the limit is refused by the sender, and if sent
+ * anyway, puts the receiver in an error state rather than being
+ * reassembled.
+ */
+void maxmsg (void)
+{
+    shmchan_t *b, *c;
+    int fds[SHMCHAN_NFDS], cfds[SHMCHAN_NFDS];
+    flux_msg_t *msg, *rmsg = NULL;
+    int i, n;
+
+    if (!(b = shmchan_create (4096)))
+        BAIL_OUT ("shmchan_create failed");
+    shmchan_get_fds (b, fds);
+    for (i = 0; i < SHMCHAN_NFDS; i++)
+        if ((cfds[i] = dup (fds[i])) < 0)
+            BAIL_OUT ("dup failed");
+    if (!(c = shmchan_attach (cfds)))
+        BAIL_OUT ("shmchan_attach failed");
+
+    msg = create_msg ("large", 100000);
+    shmchan_set_maxmsg (b, 50000);
+    errno = 0;
+    ok (shmchan_send (b, msg) < 0 && errno == EMSGSIZE,
+        "shmchan_send of message over the limit fails with EMSGSIZE");
+    ok (shmchan_send_ready (b) == true,
+        "and nothing is pending");
+
+    shmchan_set_maxmsg (b, SHMCHAN_MAXMSG_DEFAULT);
+    shmchan_set_maxmsg (c, 50000);
+    ok (shmchan_send (b, msg) == 0,
+        "broker sent 100K message to client with 50K limit");
+    flux_msg_destroy (msg);
+    n = 0;
+    errno = 0;
+    while (!rmsg && n++ < 1000) {
+        if (!(rmsg = shmchan_recv (c)) && errno != EAGAIN)
+            break;
+        (void)shmchan_flush (b);
+    }
+    ok (rmsg == NULL && errno == EPROTO,
+        "shmchan_recv fails with EPROTO once the limit is exceeded");
+    errno = 0;
+    ok (shmchan_recv (c) == NULL && errno == EPROTO,
+        "and keeps failing");
+    ok (shmchan_recv_ready (c) == true,
+        "shmchan_recv_ready reports the error");
+
+    shmchan_destroy (b);
+    shmchan_destroy (c);
+}
+
+int main (int argc, char *argv[])
+{
+    plan (NO_PLAN);
+
+    basic ();
+    large ();
+    maxmsg ();
+
+    done_testing ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,237 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "src/common/libtap/tap.h"
+#include "src/common/libutil/shmring.h"
+
+static bool put (shmring_t *r, const char *s, int flags)
+{
+    void *p;
+
+    if (!(p = shmring_reserve (r, strlen (s))))
+        return false;
+    memcpy (p, s, strlen (s));
+    (void)shmring_commit (r, flags);
+    return true;
+}
+
+static bool get (shmring_t *r, const char *s, int flags)
+{
+    const void *p;
+    size_t len;
+    int f;
+
+    if (!(p = shmring_peek (r, &len, &f)))
+        return false;
+    if (len != strlen (s) || memcmp (p, s, len) != 0 || f != flags)
+        return false;
+    (void)shmring_consume (r);
+    return true;
+}
+
+void basic (void)
+{
+    size_t size = shmring_memsize (256);
+    void *mem;
+    shmring_t *w, *r;
+    size_t len;
+    int i, n;
+
+    ok (shmring_memsize (100) == 0 && shmring_memsize (32) == 0,
+        "shmring_memsize rejects bad capacity");
+    if (!(mem = calloc (1, size)))
+        BAIL_OUT ("out of memory");
+    errno = 0;
+    ok (shmring_create (mem, size, 0, false) == NULL && errno == EINVAL,
+        "shmring_create fails with EINVAL on uninitialized memory");
+    ok ((w = shmring_create (mem, size, 256, true)) != NULL,
+        "shmring_create init=true works");
+    ok ((r = shmring_create (mem, size, 0, false)) != NULL,
+        "shmring_create init=false attaches to the ring");
+    ok (shmring_maxrecord (w) == 120,
+        "shmring_maxrecord returns half the capacity less a header");
+
+    errno = 0;
+    ok (shmring_peek (r, &len, NULL) == NULL && errno == EAGAIN,
+        "shmring_peek on empty ring fails with EAGAIN");
+    errno = 0;
+    ok (shmring_reserve (w, 121) == NULL && errno == EMSGSIZE,
+        "shmring_reserve of oversized record fails with EMSGSIZE");
+
+    ok (put (w, "hello", 0) && put (w, "world", SHMRING_MORE),
+        "wrote two records");
+    ok (get (r, "hello", 0) && get (r, "world", SHMRING_MORE),
+        "read two records with their flags");
+
+    /* Fill the ring, then drain it.  Record positions drift so that
+     * records eventually have to be padded past the end of the ring.
+     */
+    n = 0;
+    while (put (w, "0123456789abcdefghij", 0))
+        n++;
+    ok (n > 0 && errno == EAGAIN,
+        "shmring_reserve fails with EAGAIN when the ring is full");
+    for (i = 0; i < n; i++)
+        if (!get (r, "0123456789abcdefghij", 0))
+            break;
+    ok (i == n && shmring_peek (r, &len, NULL) == NULL,
+        "read back all records");
+    for (i = 0; i < 100; i++) {
+        if (!put (w, "0123456789abcdefghijklmnopqrstuvwxyz", 0)
+                || !put (w, "abc", 0)
+                || !get (r, "0123456789abcdefghijklmnopqrstuvwxyz", 0)
+                || !get (r, "abc", 0))
+            break;
+    }
+    ok (i == 100,
+        "records of mixed sizes wrap around the ring");
+
+    shmring_destroy (w);
+    shmring_destroy (r);
+    free (mem);
+}
+
+void wakeup (void)
+{
+    size_t size = shmring_memsize (64);
+    void *mem;
+    shmring_t *w, *r;
+    size_t len;
+
+    if (!(mem = calloc (1, size))
+            || !(w = shmring_create (mem, size, 64, true))
+            || !(r = shmring_create (mem, size, 0, false)))
+        BAIL_OUT ("could not create ring");
+
+    ok (shmring_reader_wait (r) == true,
+        "shmring_reader_wait returns true on empty ring");
+    ok (put (w, "x", 0),
+        "wrote a record");
+    ok (shmring_reader_wait (r) == false,
+        "shmring_reader_wait returns false on non-empty ring");
+    ok (get (r, "x", 0),
+        "read the record");
+
+    ok (shmring_reader_wait (r) == true,
+        "reader is waiting");
+    ok (shmring_reserve (w, 1) != NULL && shmring_commit (w, 0) == true,
+        "shmring_commit reports that the reader must be woken");
+    ok (shmring_reserve (w, 1) != NULL && shmring_commit (w, 0) == false,
+        "shmring_commit does not report it again");
+
+    ok (put (w, "01234567", 0) && put (w, "abcdefghi", 0) == false,
+        "ring is full");
+    ok (shmring_writer_wait (w, 9) == true,
+        "shmring_writer_wait returns true on full ring");
+    ok (shmring_peek (r, &len, NULL) != NULL && shmring_consume (r) == true,
+        "shmring_consume reports that the writer must be woken");
+    ok (shmring_writer_wait (w, 9) == false,
+        "shmring_writer_wait returns false when a record fits");
+
+    shmring_destroy (w);
+    shmring_destroy (r);
+    free (mem);
+}
+
+void corrupt (void)
+{
+    size_t size = shmring_memsize (64);
+    void *mem;
+    uint32_t *p;
+    shmring_t *w, *r;
+    size_t len;
+
+    if (!(mem = calloc (1, size))
+            || !(w = shmring_create (mem, size, 64, true))
+            || !(r = shmring_create (mem, size, 0, false)))
+        BAIL_OUT ("could not create ring");
+    if (!(p = shmring_reserve (w, 4)))
+        BAIL_OUT ("shmring_reserve failed");
+    shmring_commit (w, 0);
+    p[-2] = 1000; /* record length */
+    errno = 0;
+    ok (shmring_peek (r, &len, NULL) == NULL && errno == EPROTO,
+        "shmring_peek fails with EPROTO on corrupt record length");
+    shmring_destroy (w);
+    shmring_destroy (r);
+    free (mem);
+}
+
+/* Stream records of varying size through a small ring between two threads.
+ */
+#define STRESS_COUNT 20000
+
+static void *stress_writer (void *arg)
+{
+    shmring_t *w = arg;
+    uint32_t *p;
+    uint32_t i, j, n;
+
+    for (i = 0; i < STRESS_COUNT; i++) {
+        n = i % 17 + 1;
+        while (!(p = shmring_reserve (w, n * sizeof (*p))))
+            sched_yield ();
+        for (j = 0; j < n; j++)
+            p[j] = i;
+        shmring_commit (w, 0);
+    }
+    return NULL;
+}
+
+void stress (void)
+{
+    size_t size = shmring_memsize (256);
+    void *mem;
+    shmring_t *w, *r;
+    pthread_t t;
+    const uint32_t *p;
+    size_t len;
+    uint32_t i, j;
+    int errors = 0;
+
+    if (!(mem = calloc (1, size))
+            || !(w = shmring_create (mem, size, 256, true))
+            || !(r = shmring_create (mem, size, 0, false)))
+        BAIL_OUT ("could not create ring");
+    if (pthread_create (&t, NULL, stress_writer, w) != 0)
+        BAIL_OUT ("pthread_create failed");
+    for (i = 0; i < STRESS_COUNT; i++) {
+        while (!(p = shmring_peek (r, &len, NULL)))
+            sched_yield ();
+        if (len != (i % 17 + 1) * sizeof (*p))
+            errors++;
+        for (j = 0; j < len / sizeof (*p); j++)
+            if (p[j] != i)
+                errors++;
+        shmring_consume (r);
+    }
+    pthread_join (t, NULL);
+    ok (errors == 0,
+        "%d records passed between threads intact", STRESS_COUNT);
+    shmring_destroy (w);
+    shmring_destroy (r);
+    free (mem);
+}
+
+int main (int argc, char *argv[])
+{
+    plan (NO_PLAN);
+
+    basic ();
+    wakeup ();
+    corrupt ();
+    stress ();
+
+    done_testing ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
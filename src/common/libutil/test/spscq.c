@@ -0,0 +1,163 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include "src/common/libtap/tap.h"
+#include "src/common/libutil/spscq.h"
+
+static int freed;
+
+static void free_item (void *item)
+{
+    free (item);
+    freed++;
+}
+
+void basic (void)
+{
+    spscq_t *q;
+    int a, b, c;
+    int i, n;
+
+    ok ((q = spscq_create ()) != NULL,
+        "spscq_create works");
+    ok (spscq_empty (q) == true,
+        "queue is empty");
+    errno = 0;
+    ok (spscq_pop (q) == NULL && errno == EAGAIN,
+        "spscq_pop on empty queue fails with EAGAIN");
+    errno = 0;
+    ok (spscq_push (q, NULL) < 0 && errno == EINVAL,
+        "spscq_push of NULL fails with EINVAL");
+
+    ok (spscq_push (q, &a) == 0 && spscq_push (q, &b) == 0
+                                && spscq_push (q, &c) == 0,
+        "pushed three items");
+    ok (spscq_empty (q) == false,
+        "queue is not empty");
+    ok (spscq_peek (q) == &a && spscq_peek (q) == &a,
+        "spscq_peek returns the first item without removing it");
+    ok (spscq_pop (q) == &a && spscq_pop (q) == &b && spscq_pop (q) == &c,
+        "popped them in order");
+    ok (spscq_pop (q) == NULL,
+        "queue is empty again");
+
+    n = 0;
+    for (i = 0; i < 1000; i++) {
+        if (spscq_push (q, &a) < 0 || spscq_pop (q) != &a)
+            break;
+        n++;
+    }
+    ok (n == 1000,
+        "push/pop with node reuse works");
+
+    for (i = 0; i < 3; i++) {
+        int *p = malloc (sizeof (*p));
+        if (!p || spscq_push (q, p) < 0)
+            BAIL_OUT ("spscq_push failed");
+    }
+    freed = 0;
+    spscq_destroy (q, free_item);
+    ok (freed == 3,
+        "spscq_destroy freed queued items");
+}
+
+void wakeup (void)
+{
+    spscq_t *q;
+    struct pollfd pfd;
+    int a;
+
+    if (!(q = spscq_create ()))
+        BAIL_OUT ("spscq_create failed");
+    pfd.fd = spscq_get_fd (q);
+    pfd.events = POLLIN;
+
+    ok (spscq_wait (q) == true,
+        "spscq_wait on empty queue returns true");
+    ok (poll (&pfd, 1, 0) == 0,
+        "eventfd is not readable");
+    ok (spscq_push (q, &a) == 0 && poll (&pfd, 1, 0) == 1,
+        "push made eventfd readable");
+    spscq_clear (q);
+    ok (poll (&pfd, 1, 0) == 0,
+        "spscq_clear reset eventfd");
+    ok (spscq_push (q, &a) == 0 && poll (&pfd, 1, 0) == 0,
+        "push without waiting consumer does not touch eventfd");
+    ok (spscq_wait (q) == false,
+        "spscq_wait on non-empty queue returns false");
+    spscq_notify (q);
+    ok (poll (&pfd, 1, 0) == 1,
+        "spscq_notify made eventfd readable");
+
+    spscq_destroy (q, NULL);
+}
+
+/* Pass a sequence of items from one thread to another,
+ * with the consumer sleeping on the eventfd when the queue is empty.
+ */
+#define STRESS_COUNT 100000
+
+static void *stress_producer (void *arg)
+{
+    spscq_t *q = arg;
+    uintptr_t i;
+
+    for (i = 1; i <= STRESS_COUNT; i++) {
+        if (spscq_push (q, (void *)i) < 0)
+            BAIL_OUT ("spscq_push failed");
+    }
+    return NULL;
+}
+
+void stress (void)
+{
+    spscq_t *q;
+    pthread_t t;
+    struct pollfd pfd;
+    uintptr_t i, item;
+    int errors = 0;
+
+    if (!(q = spscq_create ()))
+        BAIL_OUT ("spscq_create failed");
+    pfd.fd = spscq_get_fd (q);
+    pfd.events = POLLIN;
+    if (pthread_create (&t, NULL, stress_producer, q) != 0)
+        BAIL_OUT ("pthread_create failed");
+    for (i = 1; i <= STRESS_COUNT; i++) {
+        while (!(item = (uintptr_t)spscq_pop (q))) {
+            if (spscq_wait (q)) {
+                if (poll (&pfd, 1, -1) < 0)
+                    BAIL_OUT ("poll failed");
+                spscq_clear (q);
+            }
+        }
+        if (item != i)
+            errors++;
+    }
+    pthread_join (t, NULL);
+    ok (errors == 0,
+        "%d items passed between threads in order", STRESS_COUNT);
+    spscq_destroy (q, NULL);
+}
+
+int main (int argc, char *argv[])
+{
+    plan (NO_PLAN);
+
+    basic ();
+    wakeup ();
+    stress ();
+
+    done_testing ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
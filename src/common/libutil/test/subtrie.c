@@ -0,0 +1,228 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "src/common/libtap/tap.h"
+#include "src/common/libutil/subtrie.h"
+
+#define MAXSUBS 8
+
+struct result {
+    void *subs[MAXSUBS];
+    int count;
+    int stop_after;
+};
+
+static int match_cb (void *subscriber, void *arg)
+{
+    struct result *res = arg;
+
+    if (res->count < MAXSUBS)
+        res->subs[res->count] = subscriber;
+    res->count++;
+    if (res->stop_after > 0 && res->count == res->stop_after)
+        return -1;
+    return 0;
+}
+
+static bool found (struct result *res, void *subscriber)
+{
+    int i;
+
+    for (i = 0; i < res->count && i < MAXSUBS; i++)
+        if (res->subs[i] == subscriber)
+            return true;
+    return false;
+}
+
+static int match (subtrie_t *t, const char *topic, struct result *res)
+{
+    memset (res, 0, sizeof (*res));
+    return subtrie_match (t, topic, match_cb, res);
+}
+
+void test_basic (void)
+{
+    subtrie_t *t;
+    struct result res;
+    int a, b, c;
+
+    t = subtrie_create ();
+    ok (t != NULL, "subtrie_create works");
+    ok (subtrie_count (t) == 0, "subtrie_count == 0");
+    ok (match (t, "foo", &res) == 0 && res.count == 0,
+        "empty trie matches nothing");
+
+    ok (subtrie_insert (t, "hb", &a) == 0, "subtrie_insert hb a works");
+    ok (subtrie_insert (t, "kvs.", &b) == 0, "subtrie_insert kvs. b works");
+    ok (subtrie_insert (t, "kvs.setroot", &c) == 0,
+        "subtrie_insert kvs.setroot c works");
+    ok (subtrie_count (t) == 3, "subtrie_count == 3");
+
+    ok (match (t, "hb", &res) == 0 && res.count == 1 && found (&res, &a),
+        "hb matches a");
+    ok (match (t, "h", &res) == 0 && res.count == 0,
+        "h matches nothing");
+    ok (match (t, "kvs.setroot", &res) == 0 && res.count == 2
+        && found (&res, &b) && found (&res, &c),
+        "kvs.setroot matches b and c");
+    ok (match (t, "kvs.setroot-foo", &res) == 0 && res.count == 2,
+        "kvs.setroot-foo matches b and c");
+    ok (match (t, "kvs.foo", &res) == 0 && res.count == 1
+        && found (&res, &b),
+        "kvs.foo matches b");
+    ok (match (t, "kvs", &res) == 0 && res.count == 0,
+        "kvs matches nothing");
+
+    ok (subtrie_insert (t, "", &a) == 0, "subtrie_insert \"\" a works");
+    ok (match (t, "kvs.setroot", &res) == 0 && res.count == 3,
+        "\"\" matches all topics");
+    ok (subtrie_remove (t, "", &a) == 0, "subtrie_remove \"\" a works");
+    ok (match (t, "kvs.setroot", &res) == 0 && res.count == 2,
+        "kvs.setroot matches b and c again");
+
+    subtrie_destroy (t);
+}
+
+void test_dedup (void)
+{
+    subtrie_t *t;
+    struct result res;
+    int a, b;
+
+    if (!(t = subtrie_create ()))
+        BAIL_OUT ("subtrie_create failed");
+    ok (subtrie_insert (t, "kvs", &a) == 0
+        && subtrie_insert (t, "kvs.", &a) == 0
+        && subtrie_insert (t, "kvs.setroot", &a) == 0
+        && subtrie_insert (t, "kvs.setroot", &b) == 0,
+        "subscribed a three times along one path, and b once");
+    ok (subtrie_count (t) == 4, "subtrie_count == 4");
+    ok (match (t, "kvs.setroot", &res) == 0 && res.count == 2
+        && found (&res, &a) && found (&res, &b),
+        "kvs.setroot reports a and b once each");
+
+    memset (&res, 0, sizeof (res));
+    res.stop_after = 1;
+    ok (subtrie_match (t, "kvs.setroot", match_cb, &res) < 0
+        && res.count == 1,
+        "subtrie_match stops when callback fails");
+
+    subtrie_destroy (t);
+}
+
+void test_refcount (void)
+{
+    subtrie_t *t;
+    struct result res;
+    int a;
+
+    if (!(t = subtrie_create ()))
+        BAIL_OUT ("subtrie_create failed");
+    ok (subtrie_insert (t, "hb", &a) == 0
+        && subtrie_insert (t, "hb", &a) == 0,
+        "subtrie_insert hb a twice works");
+    ok (subtrie_count (t) == 1, "subtrie_count == 1");
+    ok (subtrie_remove (t, "hb", &a) == 0, "subtrie_remove hb a works");
+    ok (match (t, "hb", &res) == 0 && res.count == 1,
+        "hb still matches a");
+    ok (subtrie_remove (t, "hb", &a) == 0,
+        "subtrie_remove hb a works again");
+    ok (match (t, "hb", &res) == 0 && res.count == 0,
+        "hb matches nothing");
+    ok (subtrie_count (t) == 0, "subtrie_count == 0");
+
+    errno = 0;
+    ok (subtrie_remove (t, "hb", &a) < 0 && errno == ENOENT,
+        "subtrie_remove of removed subscription fails with ENOENT");
+    errno = 0;
+    ok (subtrie_remove (t, "nope", &a) < 0 && errno == ENOENT,
+        "subtrie_remove of unknown prefix fails with ENOENT");
+    errno = 0;
+    ok (subtrie_insert (t, "hb", NULL) < 0 && errno == EINVAL,
+        "subtrie_insert subscriber=NULL fails with EINVAL");
+
+    subtrie_destroy (t);
+}
+
+void test_remove_all (void)
+{
+    subtrie_t *t;
+    struct result res;
+    int a, b;
+
+    if (!(t = subtrie_create ()))
+        BAIL_OUT ("subtrie_create failed");
+    ok (subtrie_insert (t, "", &a) == 0
+        && subtrie_insert (t, "hb", &a) == 0
+        && subtrie_insert (t, "hb", &a) == 0
+        && subtrie_insert (t, "kvs.setroot", &a) == 0
+        && subtrie_insert (t, "kvs.", &b) == 0,
+        "subscribed a and b to several topics");
+    subtrie_remove_all (t, &a);
+    ok (subtrie_count (t) == 1, "subtrie_remove_all a left one subscription");
+    ok (match (t, "kvs.setroot", &res) == 0 && res.count == 1
+        && found (&res, &b),
+        "kvs.setroot matches only b");
+    ok (match (t, "hb", &res) == 0 && res.count == 0,
+        "hb matches nothing");
+    subtrie_remove_all (t, &b);
+    ok (subtrie_count (t) == 0, "subtrie_remove_all b left nothing");
+
+    subtrie_destroy (t);
+}
+
+void test_many (void)
+{
+    subtrie_t *t;
+    struct result res;
+    int subs[256];
+    char topic[64];
+    int i, errors = 0;
+
+    if (!(t = subtrie_create ()))
+        BAIL_OUT ("subtrie_create failed");
+    for (i = 0; i < 256; i++) {
+        snprintf (topic, sizeof (topic), "event.%d", i);
+        if (subtrie_insert (t, topic, &subs[i]) < 0)
+            BAIL_OUT ("subtrie_insert failed");
+    }
+    ok (subtrie_count (t) == 256, "subscribed 256 subscribers");
+    for (i = 0; i < 256; i++) {
+        snprintf (topic, sizeof (topic), "event.%d", i);
+        if (match (t, topic, &res) < 0 || !found (&res, &subs[i]))
+            errors++;
+    }
+    ok (errors == 0, "each subscriber matches its own topic");
+    ok (match (t, "event.25", &res) == 0 && res.count == 2
+        && found (&res, &subs[2]) && found (&res, &subs[25]),
+        "event.25 matches event.2 and event.25 subscribers");
+    for (i = 0; i < 256; i++) {
+        snprintf (topic, sizeof (topic), "event.%d", i);
+        if (subtrie_remove (t, topic, &subs[i]) < 0)
+            errors++;
+    }
+    ok (errors == 0 && subtrie_count (t) == 0,
+        "unsubscribed all subscribers");
+
+    subtrie_destroy (t);
+}
+
+int main (int argc, char *argv[])
+{
+    plan (NO_PLAN);
+
+    test_basic ();
+    test_dedup ();
+    test_refcount ();
+    test_remove_all ();
+    test_many ();
+
+    done_testing ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
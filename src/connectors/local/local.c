@@ -45,8 +45,8 @@ typedef struct {
     int magic;
     int fd;
     int fd_nonblock;
-    struct flux_msg_iobuf outbuf;
-    struct flux_msg_iobuf inbuf;
+    flux_msg_writer_t *writer;
+    flux_msg_reader_t *reader;
     uint32_t testing_userid;
     uint32_t testing_rolemask;
     flux_t *h;
@@ -92,6 +92,10 @@ static int op_pollevents (void *impl)
             revents |= FLUX_POLLERR;
             break;
     }
+    /* Messages already read into the buffer don't make the fd readable.
+     */
+    if (flux_msg_reader_pending (c->reader))
+        revents |= FLUX_POLLIN;
     return revents;
 }
 
@@ -101,11 +105,19 @@ static int op_pollfd (void *impl)
     return c->fd;
 }
 
+/* If a previous non-blocking send failed with EAGAIN, its message is
+ * still queued in the writer, and the caller is retrying with the same
+ * message.  Finish sending that one rather than queueing it again.
+ */
 static int send_normal (local_ctx_t *c, const flux_msg_t *msg, int flags)
 {
     if (set_nonblock (c, (flags & FLUX_O_NONBLOCK)) < 0)
         return -1;
-    if (flux_msg_sendfd (c->fd, msg, &c->outbuf) < 0)
+    if (flux_msg_writer_count (c->writer) == 0) {
+        if (flux_msg_writer_push (c->writer, msg) < 0)
+            return -1;
+    }
+    if (flux_msg_writer_flush (c->writer) < 0)
         return -1;
     return 0;
 }
@@ -146,7 +158,7 @@ static flux_msg_t *op_recv (void *impl, int flags)
 
     if (set_nonblock (c, (flags & FLUX_O_NONBLOCK)) < 0)
         return NULL;
-    return flux_msg_recvfd (c->fd, &c->inbuf);
+    return flux_msg_reader_recv (c->reader);
 }
 
 static int op_event (void *impl, const char *topic, const char *msg_topic)
@@ -214,8 +226,8 @@ static void op_fini (void *impl)
     local_ctx_t *c = impl;
     assert (c->magic == CTX_MAGIC);
 
-    flux_msg_iobuf_clean (&c->outbuf);
-    flux_msg_iobuf_clean (&c->inbuf);
+    flux_msg_writer_destroy (c->writer);
+    flux_msg_reader_destroy (c->reader);
     if (c->fd >= 0)
         (void)close (c->fd);
     c->magic = ~CTX_MAGIC;
@@ -301,8 +313,10 @@ flux_t *connector_init (const char *path, int flags)
         errno = e;
         goto error;
     }
-    flux_msg_iobuf_init (&c->outbuf);
-    flux_msg_iobuf_init (&c->inbuf);
+    if (!(c->writer = flux_msg_writer_create (c->fd)))
+        goto error;
+    if (!(c->reader = flux_msg_reader_create (c->fd)))
+        goto error;
     if (!(c->h = flux_handle_create (c, &handle_ops, flags)))
         goto error;
     return c->h;
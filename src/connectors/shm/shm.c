@@ -0,0 +1,471 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* shm.c - connector that moves messages through shared memory rings
+ *
+ * The client connects to the connector-local socket as the local
+ * connector does, then asks connector-local to create a shared memory
+ * channel (see src/common/libutil/shmchan.h) and pass it back over the
+ * socket.  After that the socket is only used to detect disconnection.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <unistd.h>
+#include <flux/core.h>
+
+#include "src/common/libutil/log.h"
+#include "src/common/libutil/shmchan.h"
+
+#define CTX_MAGIC   0x5a3e1c07
+typedef struct {
+    int magic;
+    int fd;             /* connector-local socket */
+    int epfd;           /* watches channel eventfd and socket */
+    shmchan_t *chan;
+    bool waiting;       /* shmchan_wait() was called, eventfd needs clearing */
+    uint32_t testing_userid;
+    uint32_t testing_rolemask;
+    flux_t *h;
+} shm_ctx_t;
+
+static const struct flux_handle_ops handle_ops;
+
+/* Once the channel is attached, connector-local sends nothing more on
+ * the socket, so any activity there means it has gone away.
+ */
+static bool socket_closed (shm_ctx_t *c)
+{
+    struct pollfd pfd = { .fd = c->fd, .events = POLLIN, .revents = 0 };
+
+    return poll (&pfd, 1, 0) != 0;
+}
+
+static void clear_wait (shm_ctx_t *c)
+{
+    if (c->waiting) {
+        shmchan_clear (c->chan);
+        c->waiting = false;
+    }
+}
+
+/* Block until woken by connector-local, unless there is already
+ * something to do.
+ */
+static int wait_chan (shm_ctx_t *c)
+{
+    struct pollfd pfd[2] = {
+        { .fd = shmchan_get_fd (c->chan), .events = POLLIN, .revents = 0 },
+        { .fd = c->fd, .events = POLLIN, .revents = 0 },
+    };
+
+    if (shmchan_wait (c->chan)) {
+        c->waiting = true;
+        if (poll (pfd, 2, -1) < 0)
+            return -1;
+        if (pfd[1].revents) {
+            errno = ECONNRESET;
+            return -1;
+        }
+    }
+    clear_wait (c);
+    return 0;
+}
+
+static int op_pollevents (void *impl)
+{
+    shm_ctx_t *c = impl;
+    int revents;
+
+    if (c->waiting) {
+        clear_wait (c);
+        if (socket_closed (c))
+            return FLUX_POLLERR;
+    }
+    /* If there is nothing to receive, arm the wakeup before reporting,
+     * so that the reactor may sleep on op_pollfd().  shmchan_wait() fails
+     * only if something changed, so this loop makes progress.
+     */
+    for (;;) {
+        revents = 0;
+        (void)shmchan_flush (c->chan);
+        if (shmchan_recv_ready (c->chan))
+            revents |= FLUX_POLLIN;
+        if (shmchan_send_ready (c->chan))
+            revents |= FLUX_POLLOUT;
+        if ((revents & FLUX_POLLIN))
+            break;
+        if (shmchan_wait (c->chan)) {
+            c->waiting = true;
+            break;
+        }
+    }
+    return revents;
+}
+
+static int op_pollfd (void *impl)
+{
+    shm_ctx_t *c = impl;
+    return c->epfd;
+}
+
+/* A blocking send returns once the whole message is in the ring.
+ */
+static int send_normal (shm_ctx_t *c, const flux_msg_t *msg, int flags)
+{
+    while (shmchan_send (c->chan, msg) < 0) {
+        if (errno != EAGAIN || (flags & FLUX_O_NONBLOCK))
+            return -1;
+        if (wait_chan (c) < 0)
+            return -1;
+    }
+    if (!(flags & FLUX_O_NONBLOCK)) {
+        while (shmchan_flush (c->chan) < 0) {
+            if (errno != EAGAIN || wait_chan (c) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int send_testing (shm_ctx_t *c, const flux_msg_t *msg, int flags)
+{
+    flux_msg_t *cpy;
+    int rc = -1;
+
+    if (!(cpy = flux_msg_copy (msg, true)))
+        goto done;
+    if (flux_msg_set_userid (cpy, c->testing_userid) < 0)
+        goto done;
+    if (flux_msg_set_rolemask (cpy, c->testing_rolemask) < 0)
+        goto done;
+    rc = send_normal (c, cpy, flags);
+done:
+    flux_msg_destroy (cpy);
+    return rc;
+}
+
+static int op_send (void *impl, const flux_msg_t *msg, int flags)
+{
+    shm_ctx_t *c = impl;
+    assert (c->magic == CTX_MAGIC);
+    if (c->testing_userid != FLUX_USERID_UNKNOWN
+                                || c->testing_rolemask != FLUX_ROLE_NONE)
+        return send_testing (c, msg, flags);
+    else
+        return send_normal (c, msg, flags);
+}
+
+static flux_msg_t *op_recv (void *impl, int flags)
+{
+    shm_ctx_t *c = impl;
+    flux_msg_t *msg;
+    assert (c->magic == CTX_MAGIC);
+
+    (void)shmchan_flush (c->chan);
+    while (!(msg = shmchan_recv (c->chan))) {
+        if (errno != EAGAIN || (flags & FLUX_O_NONBLOCK))
+            return NULL;
+        if (wait_chan (c) < 0)
+            return NULL;
+        (void)shmchan_flush (c->chan);
+    }
+    return msg;
+}
+
+static int op_event (void *impl, const char *topic, const char *msg_topic)
+{
+    shm_ctx_t *c = impl;
+    flux_future_t *f;
+    int rc = -1;
+
+    assert (c->magic == CTX_MAGIC);
+
+    if (!(f = flux_rpc_pack (c->h, msg_topic, FLUX_NODEID_ANY, 0,
+                             "{s:s}", "topic", topic)))
+        goto done;
+    if (flux_future_get (f, NULL) < 0)
+        goto done;
+    rc = 0;
+done:
+    flux_future_destroy (f);
+    return rc;
+}
+
+static int op_event_subscribe (void *impl, const char *topic)
+{
+    return op_event (impl, topic, "local.sub");
+}
+
+static int op_event_unsubscribe (void *impl, const char *topic)
+{
+    return op_event (impl, topic, "local.unsub");
+}
+
+static int op_setopt (void *impl, const char *option,
+                      const void *val, size_t size)
+{
+    shm_ctx_t *ctx = impl;
+    assert (ctx->magic == CTX_MAGIC);
+    size_t val_size;
+    int rc = -1;
+
+    if (option && !strcmp (option, FLUX_OPT_TESTING_USERID)) {
+        val_size = sizeof (ctx->testing_userid);
+        if (size != val_size) {
+            errno = EINVAL;
+            goto done;
+        }
+        memcpy (&ctx->testing_userid, val, val_size);
+    } else if (option && !strcmp (option, FLUX_OPT_TESTING_ROLEMASK)) {
+        val_size = sizeof (ctx->testing_rolemask);
+        if (size != val_size) {
+            errno = EINVAL;
+            goto done;
+        }
+        memcpy (&ctx->testing_rolemask, val, val_size);
+    } else {
+        errno = EINVAL;
+        goto done;
+    }
+    rc = 0;
+done:
+    return rc;
+}
+
+static void op_fini (void *impl)
+{
+    shm_ctx_t *c = impl;
+    assert (c->magic == CTX_MAGIC);
+
+    shmchan_destroy (c->chan);
+    if (c->epfd >= 0)
+        (void)close (c->epfd);
+    if (c->fd >= 0)
+        (void)close (c->fd);
+    c->magic = ~CTX_MAGIC;
+    free (c);
+}
+
+static int env_getint (char *name, int dflt)
+{
+    char *s = getenv (name);
+    return s ? strtol (s, NULL, 10) : dflt;
+}
+
+/* Connect socket `fd` to unix domain socket `file` and fail after `retries`
+ *  attempts with exponential retry backoff starting at 16ms.
+ * Return 0 on success, or -1 on failure.
+ */
+static int connect_sock_with_retry (int fd, const char *file, int retries)
+{
+    int count = 0;
+    struct sockaddr_un addr;
+    useconds_t s = 8 * 1000;
+    int maxdelay = 2000000;
+    do {
+        memset (&addr, 0, sizeof (struct sockaddr_un));
+        addr.sun_family = AF_UNIX;
+        if (strncpy (addr.sun_path, file, sizeof (addr.sun_path) - 1) < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) == 0)
+            return 0;
+        if (s < maxdelay)
+            s = 2*s < maxdelay ? 2*s : maxdelay;
+    } while ((++count <= retries) && (usleep (s) == 0));
+    return -1;
+}
+
+/* Receive the channel file descriptors, sent by connector-local as
+ * ancillary data on a single byte.
+ */
+static int recv_fds (int fd, int fds[SHMCHAN_NFDS])
+{
+    char cbuf[CMSG_SPACE (sizeof (int) * SHMCHAN_NFDS)];
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char b;
+    ssize_t n;
+
+    iov.iov_base = &b;
+    iov.iov_len = 1;
+    memset (&mh, 0, sizeof (mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cbuf;
+    mh.msg_controllen = sizeof (cbuf);
+    if ((n = recvmsg (fd, &mh, MSG_CMSG_CLOEXEC)) < 0)
+        return -1;
+    if (n == 0) {
+        errno = ECONNRESET;
+        return -1;
+    }
+    cmsg = CMSG_FIRSTHDR (&mh);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET
+              || cmsg->cmsg_type != SCM_RIGHTS
+              || cmsg->cmsg_len != CMSG_LEN (sizeof (int) * SHMCHAN_NFDS)) {
+        errno = EPROTO;
+        return -1;
+    }
+    memcpy (fds, CMSG_DATA (cmsg), sizeof (int) * SHMCHAN_NFDS);
+    return 0;
+}
+
+/* Ask connector-local for a shared memory channel.  The response is
+ * followed on the socket by the channel file descriptors, unless it
+ * is an error.  The socket is blocking here.
+ */
+static int attach_chan (shm_ctx_t *c)
+{
+    flux_msg_t *msg;
+    int fds[SHMCHAN_NFDS];
+    int i, rc = -1;
+
+    if (!(msg = flux_request_encode ("local.shm-attach", NULL)))
+        return -1;
+    if (flux_msg_sendfd (c->fd, msg, NULL) < 0)
+        goto done;
+    flux_msg_destroy (msg);
+    if (!(msg = flux_msg_recvfd (c->fd, NULL)))
+        goto done;
+    if (flux_response_decode (msg, NULL, NULL) < 0)
+        goto done;
+    if (recv_fds (c->fd, fds) < 0)
+        goto done;
+    if (!(c->chan = shmchan_attach (fds))) {
+        int saved_errno = errno;
+        for (i = 0; i < SHMCHAN_NFDS; i++)
+            (void)close (fds[i]);
+        errno = saved_errno;
+        goto done;
+    }
+    rc = 0;
+done:
+    flux_msg_destroy (msg);
+    return rc;
+}
+
+static int epoll_add (int epfd, int fd)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+
+    return epoll_ctl (epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* Path is interpreted as the directory containing the unix domain socket.
+ */
+flux_t *connector_init (const char *path, int flags)
+{
+    shm_ctx_t *c = NULL;
+    char sockfile[PATH_MAX + 1];
+    int n;
+    int retries = env_getint ("FLUX_LOCAL_CONNECTOR_RETRY_COUNT", 5);
+
+    if (!path) {
+        errno = EINVAL;
+        goto error;
+    }
+    n = snprintf (sockfile, sizeof (sockfile), "%s/local", path);
+    if (n >= sizeof (sockfile)) {
+        errno = EINVAL;
+        goto error;
+    }
+    if (!(c = malloc (sizeof (*c)))) {
+        errno = ENOMEM;
+        goto error;
+    }
+    memset (c, 0, sizeof (*c));
+    c->magic = CTX_MAGIC;
+    c->epfd = -1;
+
+    c->testing_userid = FLUX_USERID_UNKNOWN;
+    c->testing_rolemask = FLUX_ROLE_NONE;
+
+    c->fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (c->fd < 0)
+        goto error;
+    if (connect_sock_with_retry (c->fd, sockfile, retries) < 0)
+        goto error;
+    /* read 1 byte indicating success or failure of auth */
+    unsigned char e;
+    int rc;
+    rc = read (c->fd, &e, 1);
+    if (rc < 0)
+        goto error;
+    if (rc == 0) {
+        errno = ECONNRESET;
+        goto error;
+    }
+    if (e != 0) {
+        errno = e;
+        goto error;
+    }
+    if (attach_chan (c) < 0)
+        goto error;
+    if ((c->epfd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+        goto error;
+    if (epoll_add (c->epfd, shmchan_get_fd (c->chan)) < 0)
+        goto error;
+    if (epoll_add (c->epfd, c->fd) < 0)
+        goto error;
+    if (!(c->h = flux_handle_create (c, &handle_ops, flags)))
+        goto error;
+    return c->h;
+error:
+    if (c) {
+        int saved_errno = errno;
+        op_fini (c);
+        errno = saved_errno;
+    }
+    return NULL;
+}
+
+static const struct flux_handle_ops handle_ops = {
+    .pollfd = op_pollfd,
+    .pollevents = op_pollevents,
+    .send = op_send,
+    .recv = op_recv,
+    .event_subscribe = op_event_subscribe,
+    .event_unsubscribe = op_event_unsubscribe,
+    .setopt = op_setopt,
+    .getopt = NULL,
+    .impl_destroy = op_fini,
+};
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
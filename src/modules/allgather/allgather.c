@@ -0,0 +1,553 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* allgather.c - gather key-value sets over the overlay
+ *
+ * Each of 'nprocs' participants enters a named allgather with an object
+ * of key-value pairs.  Sets are merged on their way up the tree with
+ * flux_reduce, and rank 0 (or the lowest rank that sees all 'nprocs'
+ * entries) answers each request it holds with the merged set.  Ranks
+ * in between answer their own requests when the response to their
+ * upstream request arrives, so the result fans back out along the same
+ * path without passing through the KVS.
+ *
+ * Requests held by a rank come from local clients (e.g. wrexecd) and
+ * from downstream instances of this module.  A rank flushes what it has
+ * gathered upstream once it has seen all the entries expected from its
+ * subtree, or after a short timeout scaled by its distance from the
+ * leaves.  Entries that arrive after a timed flush are forwarded on
+ * their own.  The entries expected from a subtree are known only if
+ * requests include the optional "ranks" array, the rank each of the
+ * 'nprocs' entries comes from.  Otherwise only the timeout applies.
+ *
+ * A gather that sees no new entries for 'max_gather_age' heartbeats,
+ * e.g. because a participant died, fails with ETIMEDOUT.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <flux/core.h>
+#include <czmq.h>
+#include <jansson.h>
+
+#include "src/common/libutil/kary.h"
+
+/* Flush partial sets upstream after this long (scaled by tree level).
+ */
+static const double default_reduction_timeout = 0.001;
+
+/* Expire incomplete gathers after 'max_gather_age' heartbeats without
+ * a new entry.  If heartbeats are the default of 2 seconds, 150
+ * heartbeats is 5 minutes.
+ */
+static const int max_gather_age = 150;
+
+typedef struct {
+    flux_t *h;
+    uint32_t rank;
+    uint32_t size;
+    int arity;
+    int epoch;                  /* current heartbeat epoch */
+    double timeout;
+    zhash_t *gathers;
+    zlist_t *reap;              /* names of completed gathers */
+    flux_watcher_t *reap_w;
+} allgather_ctx_t;
+
+struct gather {
+    allgather_ctx_t *ctx;
+    char *name;
+    int nprocs;
+    json_t *ranks;              /* source rank of each entry, or NULL */
+    int count;                  /* entries received by this rank */
+    int lastuse_epoch;          /* epoch of last entry received */
+    int sunk;                   /* rank 0: entries merged into 'data' */
+    json_t *data;               /* rank 0: merged set */
+    flux_reduce_t *reduce;
+    zlist_t *requests;          /* requests awaiting the result */
+    zlist_t *forwards;          /* upstream requests in flight */
+    bool complete;
+};
+
+/* A partial set of 'count' entries, the unit of reduction.
+ */
+struct item {
+    int count;
+    json_t *data;
+};
+
+static void r_reduce (flux_reduce_t *r, int batch, void *arg);
+static void r_sink (flux_reduce_t *r, int batch, void *arg);
+static void r_forward (flux_reduce_t *r, int batch, void *arg);
+static int r_itemweight (void *item);
+static void item_destroy (void *arg);
+
+static struct flux_reduce_ops reduce_ops = {
+    .destroy = item_destroy,
+    .reduce = r_reduce,
+    .sink = r_sink,
+    .forward = r_forward,
+    .itemweight = r_itemweight,
+};
+
+static void item_destroy (void *arg)
+{
+    struct item *item = arg;
+    if (item) {
+        json_decref (item->data);
+        free (item);
+    }
+}
+
+static struct item *item_create (int count, json_t *data)
+{
+    struct item *item;
+
+    if (!(item = calloc (1, sizeof (*item))))
+        return NULL;
+    item->count = count;
+    if (!(item->data = json_copy (data))) {
+        free (item);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return item;
+}
+
+static void gather_destroy (void *arg)
+{
+    struct gather *g = arg;
+    if (g) {
+        int saved_errno = errno;
+        flux_msg_t *msg;
+        flux_future_t *f;
+        flux_reduce_destroy (g->reduce);
+        if (g->requests) {
+            while ((msg = zlist_pop (g->requests)))
+                flux_msg_destroy (msg);
+            zlist_destroy (&g->requests);
+        }
+        if (g->forwards) {
+            while ((f = zlist_pop (g->forwards)))
+                flux_future_destroy (f);
+            zlist_destroy (&g->forwards);
+        }
+        json_decref (g->data);
+        json_decref (g->ranks);
+        free (g->name);
+        free (g);
+        errno = saved_errno;
+    }
+}
+
+/* Count the entries in 'ranks' that come from this rank's subtree.
+ */
+static int subtree_count (allgather_ctx_t *ctx, json_t *ranks)
+{
+    size_t index;
+    json_t *value;
+    int count = 0;
+
+    json_array_foreach (ranks, index, value) {
+        uint32_t rank = json_integer_value (value);
+        if (rank == ctx->rank
+            || kary_child_route (ctx->arity, ctx->size,
+                                 ctx->rank, rank) != KARY_NONE)
+            count++;
+    }
+    return count;
+}
+
+/* Create a gather of 'nprocs' entries.  Rank 0 waits for all of them.
+ * Other ranks flush upstream when they have seen the entries expected
+ * from their subtree, if 'ranks' says which those are, or on timeout.
+ */
+static struct gather *gather_create (allgather_ctx_t *ctx, const char *name,
+                                     int nprocs, json_t *ranks)
+{
+    struct gather *g;
+    int flags = 0;
+    int hwm = nprocs;
+
+    if (!(g = calloc (1, sizeof (*g))))
+        return NULL;
+    g->ctx = ctx;
+    g->nprocs = nprocs;
+    g->lastuse_epoch = ctx->epoch;
+    if (!(g->name = strdup (name))
+        || !(g->requests = zlist_new ())
+        || !(g->forwards = zlist_new ())
+        || !(g->data = json_object ())) {
+        errno = ENOMEM;
+        goto error;
+    }
+    if (ranks)
+        g->ranks = json_incref (ranks);
+    if (ctx->rank > 0) {
+        flags |= FLUX_REDUCE_TIMEDFLUSH;
+        if (ranks)
+            hwm = subtree_count (ctx, ranks);
+    }
+    if (ctx->rank == 0 || ranks)
+        flags |= FLUX_REDUCE_HWMFLUSH;
+    if (!(g->reduce = flux_reduce_create (ctx->h, reduce_ops, ctx->timeout,
+                                          g, flags)))
+        goto error;
+    if ((flags & FLUX_REDUCE_HWMFLUSH)
+        && flux_reduce_opt_set (g->reduce, FLUX_REDUCE_OPT_HWM,
+                                &hwm, sizeof (hwm)) < 0)
+        goto error;
+    return g;
+error:
+    gather_destroy (g);
+    return NULL;
+}
+
+/* Answer all requests held for 'g' with 'data', or with 'errnum' if
+ * nonzero, then schedule 'g' for removal.  Removal is deferred since
+ * this may be called from within flux_reduce callbacks.
+ */
+static void gather_complete (struct gather *g, int errnum, json_t *data)
+{
+    allgather_ctx_t *ctx = g->ctx;
+    flux_msg_t *msg;
+    json_t *o = NULL;
+    char *s = NULL;
+    char *name;
+
+    if (g->complete)
+        return;
+    g->complete = true;
+    /* Encode the response once for all requests.
+     */
+    if (!errnum && (!(o = json_pack ("{s:O}", "data", data))
+                    || !(s = json_dumps (o, JSON_COMPACT))))
+        errnum = ENOMEM;
+    json_decref (o);
+    if (errnum)
+        flux_log (ctx->h, LOG_ERR, "%s: %s", g->name, flux_strerror (errnum));
+    while ((msg = zlist_pop (g->requests))) {
+        if (flux_respond (ctx->h, msg, errnum, errnum ? NULL : s) < 0)
+            flux_log_error (ctx->h, "%s: flux_respond", g->name);
+        flux_msg_destroy (msg);
+    }
+    free (s);
+    if (!(name = strdup (g->name)) || zlist_append (ctx->reap, name) < 0) {
+        flux_log (ctx->h, LOG_ERR, "%s: out of memory", g->name);
+        free (name);
+        return;
+    }
+    flux_watcher_start (ctx->reap_w);
+}
+
+static void reap_cb (flux_reactor_t *r, flux_watcher_t *w,
+                     int revents, void *arg)
+{
+    allgather_ctx_t *ctx = arg;
+    char *name;
+
+    while ((name = zlist_pop (ctx->reap))) {
+        zhash_delete (ctx->gathers, name);
+        free (name);
+    }
+}
+
+/* Reduction ops
+ */
+
+/* Pop all items, push one with their merged sets.
+ */
+static void r_reduce (flux_reduce_t *r, int batch, void *arg)
+{
+    struct item *item, *first;
+
+    if (!(first = flux_reduce_pop (r)))
+        return;
+    while ((item = flux_reduce_pop (r))) {
+        first->count += item->count;
+        (void)json_object_update (first->data, item->data);
+        item_destroy (item);
+    }
+    if (flux_reduce_push (r, first) < 0)
+        item_destroy (first);
+}
+
+/* (rank 0 only) Merge one item into the result.
+ */
+static void r_sink (flux_reduce_t *r, int batch, void *arg)
+{
+    struct gather *g = arg;
+    struct item *item = flux_reduce_pop (r);
+
+    if (!item)
+        return;
+    g->sunk += item->count;
+    if (json_object_update (g->data, item->data) < 0)
+        gather_complete (g, ENOMEM, NULL);
+    else if (g->sunk == g->nprocs)
+        gather_complete (g, 0, g->data);
+    item_destroy (item);
+}
+
+static void forward_continuation (flux_future_t *f, void *arg)
+{
+    struct gather *g = arg;
+    json_t *data;
+
+    if (flux_rpc_get_unpack (f, "{s:o}", "data", &data) < 0)
+        gather_complete (g, errno, NULL);
+    else
+        gather_complete (g, 0, data);
+}
+
+/* (rank > 0 only) Send one item upstream.  If this rank has seen all
+ * entries and has sent nothing upstream, the item is the complete set:
+ * answer locally instead.
+ */
+static void r_forward (flux_reduce_t *r, int batch, void *arg)
+{
+    struct gather *g = arg;
+    struct item *item = flux_reduce_pop (r);
+    allgather_ctx_t *ctx = g->ctx;
+    flux_future_t *f = NULL;
+
+    if (!item || g->complete)
+        goto done;
+    if (item->count == g->nprocs && zlist_size (g->forwards) == 0) {
+        gather_complete (g, 0, item->data);
+        goto done;
+    }
+    if (!(f = flux_rpc_pack (ctx->h, "allgather.enter", FLUX_NODEID_UPSTREAM,
+                             0, "{s:s s:i s:i s:O s:O}",
+                             "name", g->name,
+                             "nprocs", g->nprocs,
+                             "count", item->count,
+                             "data", item->data,
+                             "ranks", g->ranks ? g->ranks : json_null ()))
+        || flux_future_then (f, -1., forward_continuation, g) < 0
+        || zlist_append (g->forwards, f) < 0) {
+        flux_future_destroy (f);
+        gather_complete (g, errno ? errno : ENOMEM, NULL);
+        goto done;
+    }
+done:
+    item_destroy (item);
+}
+
+static int r_itemweight (void *item)
+{
+    return ((struct item *)item)->count;
+}
+
+/* Handle entry from a local client or a downstream allgather module.
+ */
+static void enter_request_cb (flux_t *h, flux_msg_handler_t *mh,
+                              const flux_msg_t *msg, void *arg)
+{
+    allgather_ctx_t *ctx = arg;
+    struct gather *g;
+    struct item *item = NULL;
+    flux_msg_t *cpy = NULL;
+    const char *name;
+    int nprocs, count;
+    json_t *data;
+    json_t *ranks = NULL;
+
+    if (flux_request_unpack (msg, NULL, "{s:s s:i s:i s:o s?o}",
+                             "name", &name,
+                             "nprocs", &nprocs,
+                             "count", &count,
+                             "data", &data,
+                             "ranks", &ranks) < 0)
+        goto error;
+    if (ranks && json_is_null (ranks))
+        ranks = NULL;
+    if (nprocs <= 0 || count <= 0 || !json_is_object (data)
+        || (ranks && (!json_is_array (ranks)
+                      || json_array_size (ranks) != nprocs))) {
+        errno = EPROTO;
+        goto error;
+    }
+    if (!(g = zhash_lookup (ctx->gathers, name))) {
+        if (!(g = gather_create (ctx, name, nprocs, ranks)))
+            goto error;
+        zhash_update (ctx->gathers, name, g);
+        zhash_freefn (ctx->gathers, name, gather_destroy);
+    }
+    if (g->complete) {
+        errno = EEXIST;
+        goto error;
+    }
+    if (nprocs != g->nprocs || g->count + count > g->nprocs) {
+        errno = EINVAL;
+        goto error;
+    }
+    if (!(item = item_create (count, data))
+        || !(cpy = flux_msg_copy (msg, false))
+        || zlist_append (g->requests, cpy) < 0)
+        goto error;
+    cpy = NULL;
+    g->count += count;
+    g->lastuse_epoch = ctx->epoch;
+    if (flux_reduce_append (g->reduce, item, 0) < 0) {
+        item_destroy (item);
+        gather_complete (g, errno ? errno : ENOMEM, NULL);
+    }
+    return;
+error:
+    if (flux_respond (h, msg, errno, NULL) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+    flux_msg_destroy (cpy);
+    item_destroy (item);
+}
+
+/* Fail gathers that have waited too long for their remaining entries.
+ */
+static void heartbeat_cb (flux_t *h, flux_msg_handler_t *mh,
+                          const flux_msg_t *msg, void *arg)
+{
+    allgather_ctx_t *ctx = arg;
+    struct gather *g;
+
+    if (flux_heartbeat_decode (msg, &ctx->epoch) < 0) {
+        flux_log_error (h, "%s: flux_heartbeat_decode", __FUNCTION__);
+        return;
+    }
+    g = zhash_first (ctx->gathers);
+    while (g) {
+        if (g->lastuse_epoch == 0)
+            g->lastuse_epoch = ctx->epoch;
+        if (!g->complete && ctx->epoch - g->lastuse_epoch > max_gather_age)
+            gather_complete (g, ETIMEDOUT, NULL);
+        g = zhash_next (ctx->gathers);
+    }
+}
+
+static const struct flux_msg_handler_spec htab[] = {
+    { FLUX_MSGTYPE_REQUEST, "allgather.enter", enter_request_cb, 0 },
+    { FLUX_MSGTYPE_EVENT,   "hb",              heartbeat_cb, 0 },
+    FLUX_MSGHANDLER_TABLE_END,
+};
+
+static int attr_get_int (flux_t *h, const char *attr)
+{
+    const char *s = flux_attr_get (h, attr, NULL);
+    return s ? strtoul (s, NULL, 10) : -1;
+}
+
+/* Give upper levels of the tree time to collect from the levels below.
+ */
+static double timer_scale (flux_t *h)
+{
+    int level, maxlevel;
+    if ((level = attr_get_int (h, "tbon.level")) < 0
+        || (maxlevel = attr_get_int (h, "tbon.maxlevel")) < 0
+        || level > maxlevel)
+        return 1.;
+    return maxlevel - level + 1.;
+}
+
+static void allgather_ctx_destroy (allgather_ctx_t *ctx)
+{
+    if (ctx) {
+        char *name;
+        zhash_destroy (&ctx->gathers);
+        if (ctx->reap) {
+            while ((name = zlist_pop (ctx->reap)))
+                free (name);
+            zlist_destroy (&ctx->reap);
+        }
+        flux_watcher_destroy (ctx->reap_w);
+        free (ctx);
+    }
+}
+
+static allgather_ctx_t *allgather_ctx_create (flux_t *h)
+{
+    allgather_ctx_t *ctx;
+
+    if (!(ctx = calloc (1, sizeof (*ctx))))
+        return NULL;
+    ctx->h = h;
+    if (flux_get_rank (h, &ctx->rank) < 0
+        || flux_get_size (h, &ctx->size) < 0)
+        goto error;
+    if ((ctx->arity = attr_get_int (h, "tbon.arity")) < 1) {
+        errno = EINVAL;
+        goto error;
+    }
+    ctx->timeout = default_reduction_timeout * timer_scale (h);
+    if (!(ctx->gathers = zhash_new ()) || !(ctx->reap = zlist_new ())) {
+        errno = ENOMEM;
+        goto error;
+    }
+    if (!(ctx->reap_w = flux_timer_watcher_create (flux_get_reactor (h),
+                                                   0., 0., reap_cb, ctx)))
+        goto error;
+    return ctx;
+error:
+    allgather_ctx_destroy (ctx);
+    return NULL;
+}
+
+int mod_main (flux_t *h, int argc, char **argv)
+{
+    allgather_ctx_t *ctx;
+    flux_msg_handler_t **handlers = NULL;
+    int rc = -1;
+
+    if (!(ctx = allgather_ctx_create (h))) {
+        flux_log_error (h, "error creating allgather context");
+        goto done;
+    }
+    if (flux_event_subscribe (h, "hb") < 0) {
+        flux_log_error (h, "flux_event_subscribe");
+        goto done;
+    }
+    if (flux_msg_handler_addvec (h, htab, ctx, &handlers) < 0) {
+        flux_log_error (h, "flux_msg_handler_addvec");
+        goto done;
+    }
+    if (flux_reactor_run (flux_get_reactor (h), 0) < 0) {
+        flux_log_error (h, "flux_reactor_run");
+        goto done;
+    }
+    rc = 0;
+done:
+    flux_msg_handler_delvec (handlers);
+    allgather_ctx_destroy (ctx);
+    return rc;
+}
+
+MOD_NAME ("allgather");
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -46,6 +46,8 @@
 
 #include "src/common/libutil/cleanup.h"
 #include "src/common/libutil/iterators.h"
+#include "src/common/libutil/subtrie.h"
+#include "src/common/libutil/shmchan.h"
 
 enum {
     DEBUG_AUTHFAIL_ONESHOT = 1, /* force auth to fail one time */
@@ -55,6 +57,8 @@ enum {
 
 
 #define LISTEN_BACKLOG      5
+#define SHM_CAPACITY        (1024*1024) /* bytes per direction */
+#define SHM_RECV_BUDGET     64  /* messages per shm callback */
 
 typedef struct {
     int listen_fd;
@@ -64,6 +68,7 @@ typedef struct {
     flux_reactor_t *reactor;
     uid_t instance_owner;
     zhash_t *subscriptions;
+    subtrie_t *subtrie;         /* client subscriptions by topic prefix */
 } mod_local_ctx_t;
 
 typedef void (*unsubscribe_f)(void *handle, const char *topic);
@@ -79,9 +84,12 @@ typedef struct {
     int fd;
     flux_watcher_t *inw;
     flux_watcher_t *outw;
-    struct flux_msg_iobuf inbuf;
-    struct flux_msg_iobuf outbuf;
-    zlist_t *outqueue;  /* queue of outbound flux_msg_t */
+    flux_msg_reader_t *reader;
+    flux_msg_writer_t *writer;  /* queue of outbound messages */
+    shmchan_t *shm;             /* shared memory channel, if attached */
+    shmchan_t *shm_pending;     /* channel to attach once writer drains */
+    flux_watcher_t *shmw;
+    zlist_t *shm_outqueue;      /* messages that didn't fit in the channel */
     mod_local_ctx_t *ctx;
     zhash_t *disconnect_notify;
     zhash_t *subscriptions;
@@ -102,6 +110,8 @@ static void client_read_cb (flux_reactor_t *r, flux_watcher_t *w,
                             int revents, void *arg);
 static void client_write_cb (flux_reactor_t *r, flux_watcher_t *w,
                             int revents, void *arg);
+static void client_shm_cb (flux_reactor_t *r, flux_watcher_t *w,
+                           int revents, void *arg);
 
 static void freectx (void *arg)
 {
@@ -109,6 +119,7 @@ static void freectx (void *arg)
     if (ctx) {
         zlist_destroy (&ctx->clients);
         zhash_destroy (&ctx->subscriptions);
+        subtrie_destroy (ctx->subtrie);
         free (ctx);
     }
 }
@@ -133,6 +144,8 @@ static mod_local_ctx_t *getctx (flux_t *h)
             errno = ENOMEM;
             goto error;
         }
+        if (!(ctx->subtrie = subtrie_create ()))
+            goto error;
         ctx->instance_owner = geteuid ();
         flux_aux_set (h, "flux::local_connector", ctx, freectx);
     }
@@ -252,9 +265,7 @@ static client_t * client_create (mod_local_ctx_t *ctx, int fd)
     c->uuid = zuuid_new ();
     c->disconnect_notify = zhash_new ();
     c->subscriptions = zhash_new ();
-    c->outqueue = zlist_new ();
-    if (!c->uuid || !c->disconnect_notify || !c->subscriptions
-                                          || !c->outqueue) {
+    if (!c->uuid || !c->disconnect_notify || !c->subscriptions) {
         errno = ENOMEM;
         goto error;
     }
@@ -267,9 +278,10 @@ static client_t * client_create (mod_local_ctx_t *ctx, int fd)
     if (!(c->outw = flux_fd_watcher_create (ctx->reactor, fd, FLUX_POLLOUT,
                                             client_write_cb, c)))
         goto error;
+    if (!(c->reader = flux_msg_reader_create (fd))
+                        || !(c->writer = flux_msg_writer_create (fd)))
+        goto error;
     flux_watcher_start (c->inw);
-    flux_msg_iobuf_init (&c->inbuf);
-    flux_msg_iobuf_init (&c->outbuf);
     if (send_auth_response (fd, 0) < 0)
         goto error_noresponse;
     if (set_nonblock (fd, true) < 0)
@@ -283,47 +295,104 @@ error_noresponse:
     return NULL;
 }
 
+/* Write as much of the outbound queue as the client will take
+ * with one writev().
+ */
 static int client_send_try (client_t *c)
 {
-    flux_msg_t *msg = zlist_head (c->outqueue);
-
-    if (msg) {
-        if (flux_msg_sendfd (c->fd, msg, &c->outbuf) < 0) {
-            if (errno != EWOULDBLOCK && errno != EAGAIN)
-                return -1;
-            //flux_log (c->ctx->h, LOG_DEBUG, "send: client not ready");
-            flux_watcher_start (c->outw);
-            errno = 0;
-        } else {
-            msg = zlist_pop (c->outqueue);
-            flux_msg_destroy (msg);
-        }
+    if (flux_msg_writer_flush (c->writer) < 0) {
+        if (errno != EWOULDBLOCK && errno != EAGAIN)
+            return -1;
+        //flux_log (c->ctx->h, LOG_DEBUG, "send: client not ready");
+        errno = 0;
     }
     return 0;
 }
 
-static int client_send_nocopy (client_t *c, flux_msg_t **msg)
+/* Arrange for client_shm_cb() to be called when there is something
+ * to do:  now if the channel is already ready, otherwise when the
+ * client sends or makes room.
+ */
+static void client_shm_arm (client_t *c)
+{
+    if (!shmchan_wait (c->shm))
+        shmchan_notify (c->shm);
+}
+
+/* Send queued messages until the channel is full.
+ */
+static int client_shm_flush (client_t *c)
+{
+    flux_msg_t *msg;
+
+    while ((msg = zlist_first (c->shm_outqueue))) {
+        if (shmchan_send (c->shm, msg) < 0)
+            return errno == EAGAIN ? 0 : -1;
+        zlist_remove (c->shm_outqueue, msg);
+        flux_msg_destroy (msg);
+    }
+    return 0;
+}
+
+/* Queue a copy of message to be sent through the channel.
+ */
+static int client_shm_queue (client_t *c, const flux_msg_t *msg)
 {
-    if (zlist_append (c->outqueue, *msg) < 0) {
+    flux_msg_t *cpy;
+
+    if (!(cpy = flux_msg_copy (msg, true)))
+        return -1;
+    if (zlist_append (c->shm_outqueue, cpy) < 0) {
+        flux_msg_destroy (cpy);
         errno = ENOMEM;
         return -1;
     }
-    *msg = NULL;
-    return client_send_try (c);
+    return 0;
+}
+
+/* Write message directly into the channel if nothing is queued ahead
+ * of it, otherwise queue a copy until the client makes room.
+ */
+static int client_shm_send (client_t *c, const flux_msg_t *msg)
+{
+    if (zlist_size (c->shm_outqueue) == 0) {
+        if (shmchan_send (c->shm, msg) == 0) {
+            if (!shmchan_send_ready (c->shm)) // rest of a large message
+                client_shm_arm (c);
+            return 0;
+        }
+        if (errno != EAGAIN)
+            return -1;
+    }
+    if (client_shm_queue (c, msg) < 0)
+        return -1;
+    client_shm_arm (c);
+    return 0;
 }
 
+/* Queue message and let client_write_cb() send it when the socket is
+ * writable, so that messages queued in the same reactor loop iteration
+ * go out together.  The message is encoded when queued.
+ */
 static int client_send (client_t *c, const flux_msg_t *msg)
 {
-    flux_msg_t *cpy = flux_msg_copy (msg, true);
-    int rc;
+    if (c->shm)
+        return client_shm_send (c, msg);
+    if (c->shm_pending) // client now reads the socket only for the fds
+        return client_shm_queue (c, msg);
+    if (flux_msg_writer_push (c->writer, msg) < 0)
+        return -1;
+    flux_watcher_start (c->outw);
+    return 0;
+}
 
-    if (!cpy) {
-        errno = ENOMEM;
+static int client_send_nocopy (client_t *c, flux_msg_t **msg)
+{
+    if (client_send (c, *msg) < 0)
         return -1;
-    }
-    rc = client_send_nocopy (c, &cpy);
-    flux_msg_destroy (cpy);
-    return rc;
+    flux_msg_destroy (*msg);
+    *msg = NULL;
+    return 0;
 }
 
 static subscription_t *subscription_create (const char *topic)
@@ -414,6 +483,11 @@ static int client_subscribe (client_t *c, const char *topic)
             subscription_destroy (sub);
             goto done;
         }
+        if (subtrie_insert (c->ctx->subtrie, topic, c) < 0) {
+            global_unsubscribe (c->ctx, topic);
+            subscription_destroy (sub);
+            goto done;
+        }
         sub->unsubscribe = (unsubscribe_f) global_unsubscribe;
         sub->handle = c->ctx;
         zhash_update (c->subscriptions, topic, sub);
@@ -436,6 +510,7 @@ static int client_unsubscribe (client_t *c, const char *topic)
         goto done;
     }
     if (--sub->usecount == 0) {
+        (void)subtrie_remove (c->ctx->subtrie, topic, c);
         zhash_delete (c->subscriptions, topic);
         //flux_log (c->ctx->h, LOG_DEBUG, "%s: %s", __FUNCTION__, topic);
     }
@@ -459,21 +534,6 @@ done:
     return rc;
 }
 
-static bool client_is_subscribed (client_t *c, const char *topic)
-{
-    subscription_t *sub;
-
-    if (zhash_lookup (c->subscriptions, topic))
-        return true;
-    sub = zhash_first (c->subscriptions);
-    while (sub) {
-        if (!strncmp (topic, sub->topic, strlen (sub->topic)))
-            return true;
-        sub = zhash_next (c->subscriptions);
-    }
-    return false;
-}
-
 static int disconnect_sendmsg (struct disconnect_notify *d)
 {
     int rc = -1;
@@ -567,21 +627,27 @@ static void client_destroy (client_t *c)
 {
     if (c) {
         zhash_destroy (&c->disconnect_notify);
+        subtrie_remove_all (c->ctx->subtrie, c);
         zhash_destroy (&c->subscriptions);
         zuuid_destroy (&c->uuid);
-        if (c->outqueue) {
-            flux_msg_t *msg;
-            while ((msg = zlist_pop (c->outqueue)))
-                flux_msg_destroy (msg);
-            zlist_destroy (&c->outqueue);
-        }
         flux_watcher_stop (c->outw);
         flux_watcher_destroy (c->outw);
-        flux_msg_iobuf_clean (&c->outbuf);
+        flux_msg_writer_destroy (c->writer);
 
         flux_watcher_stop (c->inw);
         flux_watcher_destroy (c->inw);
-        flux_msg_iobuf_clean (&c->inbuf);
+        flux_msg_reader_destroy (c->reader);
+
+        flux_watcher_stop (c->shmw);
+        flux_watcher_destroy (c->shmw);
+        if (c->shm_outqueue) {
+            flux_msg_t *msg;
+            while ((msg = zlist_pop (c->shm_outqueue)))
+                flux_msg_destroy (msg);
+            zlist_destroy (&c->shm_outqueue);
+        }
+        shmchan_destroy (c->shm);
+        shmchan_destroy (c->shm_pending);
 
         if (c->fd != -1)
             close (c->fd);
@@ -590,6 +656,8 @@ static void client_destroy (client_t *c)
     }
 }
 
+static int client_shm_attach (client_t *c);
+
 static void client_write_cb (flux_reactor_t *r, flux_watcher_t *w,
                              int revents, void *arg)
 {
@@ -602,8 +670,17 @@ static void client_write_cb (flux_reactor_t *r, flux_watcher_t *w,
             goto disconnect;
         //flux_log (h, LOG_DEBUG, "send: client ready");
     }
-    if (zlist_size (c->outqueue) == 0)
+    if (flux_msg_writer_count (c->writer) == 0) {
+        if (c->shm_pending && client_shm_attach (c) < 0) {
+            if (errno != EWOULDBLOCK && errno != EAGAIN) {
+                flux_log_error (c->ctx->h, "%s: error sending fds",
+                                __FUNCTION__);
+                goto disconnect;
+            }
+            return; // try again when the socket is writable
+        }
         flux_watcher_stop (w);
+    }
     return;
 disconnect:
     zlist_remove (c->ctx->clients, c);
@@ -658,43 +735,139 @@ done:
     return true;
 }
 
-static void client_read_cb (flux_reactor_t *r, flux_watcher_t *w,
-                            int revents, void *arg)
+/* Pass channel file descriptors to client as ancillary data on one byte.
+ */
+static int send_fds (int fd, int fds[SHMCHAN_NFDS])
+{
+    char cbuf[CMSG_SPACE (sizeof (int) * SHMCHAN_NFDS)];
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char b = 0;
+
+    iov.iov_base = &b;
+    iov.iov_len = 1;
+    memset (&mh, 0, sizeof (mh));
+    memset (cbuf, 0, sizeof (cbuf));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cbuf;
+    mh.msg_controllen = sizeof (cbuf);
+    cmsg = CMSG_FIRSTHDR (&mh);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (sizeof (int) * SHMCHAN_NFDS);
+    memcpy (CMSG_DATA (cmsg), fds, sizeof (int) * SHMCHAN_NFDS);
+    if (sendmsg (fd, &mh, 0) < 0)
+        return -1;
+    return 0;
+}
+
+/* Once the shm-attach response has been written, pass the channel file
+ * descriptors to the client and start using the channel.  Messages
+ * queued for the client in the meantime are sent through it.
+ * Returns -1 with errno = EAGAIN if the socket is not writable yet.
+ */
+static int client_shm_attach (client_t *c)
+{
+    int fds[SHMCHAN_NFDS];
+
+    shmchan_get_fds (c->shm_pending, fds);
+    if (send_fds (c->fd, fds) < 0)
+        return -1;
+    if (!(c->shmw = flux_fd_watcher_create (c->ctx->reactor,
+                                            shmchan_get_fd (c->shm_pending),
+                                            FLUX_POLLIN,
+                                            client_shm_cb, c)))
+        return -1;
+    c->shm = c->shm_pending;
+    c->shm_pending = NULL;
+    flux_watcher_start (c->shmw);
+    client_shm_arm (c);
+    return 0;
+}
+
+/* Move client to a shared memory channel, on request of the shm connector.
+ * The response is queued on the socket like any other message, and once
+ * it has been written, client_write_cb() sends the channel file
+ * descriptors.  From then on, messages in both directions pass through
+ * the channel, and the socket just detects disconnection.
+ * The channel contents are not trusted:  shmchan_recv() validates each
+ * record, and messages are authenticated as if read from the socket.
+ * Returns -1 if the client should be disconnected.
+ */
+static int shm_attach_request (client_t *c, const flux_msg_t *msg)
+{
+    flux_t *h = c->ctx->h;
+    shmchan_t *shm = NULL;
+    flux_msg_t *rmsg = NULL;
+    uint32_t matchtag;
+    int errnum = 0;
+    int rc = -1;
+
+    if (flux_msg_get_matchtag (msg, &matchtag) < 0) {
+        flux_log_error (h, "%s: flux_msg_get_matchtag", __FUNCTION__);
+        goto done;
+    }
+    if (c->shm || c->shm_pending)
+        errnum = EEXIST;
+    else if (!(shm = shmchan_create (SHM_CAPACITY))) {
+        flux_log_error (h, "%s: shmchan_create", __FUNCTION__);
+        errnum = errno;
+    }
+    else if (!(c->shm_outqueue = zlist_new ())) {
+        errnum = ENOMEM;
+        shmchan_destroy (shm);
+        shm = NULL;
+    }
+    if (!(rmsg = flux_response_encode ("local.shm-attach", errnum, NULL))
+            || flux_msg_set_rolemask (rmsg, FLUX_ROLE_OWNER) < 0
+            || flux_msg_set_matchtag (rmsg, matchtag) < 0) {
+        flux_log_error (h, "%s: error encoding response", __FUNCTION__);
+        goto done;
+    }
+    if (client_send (c, rmsg) < 0) {
+        flux_log_error (h, "%s: error sending response", __FUNCTION__);
+        goto done;
+    }
+    c->shm_pending = shm;
+    shm = NULL;
+    rc = 0;
+done:
+    shmchan_destroy (shm);
+    flux_msg_destroy (rmsg);
+    return rc;
+}
+
+static bool is_shm_attach (const flux_msg_t *msg)
+{
+    const char *topic;
+
+    if (flux_msg_get_topic (msg, &topic) < 0)
+        return false;
+    return !strcmp (topic, "local.shm-attach");
+}
+
+/* Handle one message received from client.
+ * Returns -1 if the client should be disconnected.
+ */
+static int client_recv_msg (client_t *c, flux_msg_t *msg)
 {
-    client_t *c = arg;
     flux_t *h = c->ctx->h;
-    flux_msg_t *msg = NULL;
     int type;
     uint32_t userid, rolemask;
 
-    if (revents & FLUX_POLLERR)
-        goto error_disconnect;
-    if (!(revents & FLUX_POLLIN))
-        return;
-    /* EPROTO, ECONNRESET are normal disconnect errors
-     * EWOULDBLOCK, EAGAIN stores state in c->inbuf for continuation
-     */
-    //flux_log (h, LOG_DEBUG, "recv: client ready");
-    if (!(msg = flux_msg_recvfd (c->fd, &c->inbuf))) {
-        if (errno == EWOULDBLOCK || errno == EAGAIN) {
-            //flux_log (h, LOG_DEBUG, "recv: client not ready");
-            return;
-        }
-        if (errno != ECONNRESET && errno != EPROTO)
-            flux_log_error (h, "flux_msg_recvfd");
-        goto error_disconnect;
-    }
     if (flux_msg_get_type (msg, &type) < 0) {
         flux_log_error (h, "flux_msg_get_type");
-        goto error;
+        return 0;
     }
     if (flux_msg_get_userid (msg, &userid) < 0) {
         flux_log_error (h, "flux_msg_get_userid");
-        goto error;
+        return 0;
     }
     if (flux_msg_get_rolemask (msg, &rolemask) < 0) {
         flux_log_error (h, "flux_msg_get_rolemask");
-        goto error;
+        return 0;
     }
     if (rolemask == FLUX_ROLE_NONE)
         rolemask = c->rolemask;
@@ -710,54 +883,125 @@ static void client_read_cb (flux_reactor_t *r, flux_watcher_t *w,
                 if (flux_respond (h, msg, EPERM, NULL) < 0)
                     flux_log_error (h, "error sending EPERM response");
             } /* else drop */
-            goto done;
+            return 0;
         }
     }
     if (flux_msg_set_userid (msg, userid) < 0) {
         flux_log_error (h, "flux_msg_set_userid");
-        goto error_disconnect;
+        return -1;
     }
     if (flux_msg_set_rolemask (msg, rolemask) < 0) {
         flux_log_error (h, "flux_msg_set_rolemask");
-        goto error_disconnect;
+        return -1;
     }
     switch (type) {
         case FLUX_MSGTYPE_REQUEST:
+            if (is_shm_attach (msg))
+                return shm_attach_request (c, msg);
             if (!internal_request (c, msg)) {
                 /* insert disconnect notifier before forwarding request */
                 if (c->disconnect_notify && disconnect_update (c, msg) < 0) {
                     flux_log_error (h, "disconnect_update");
-                    goto error;
+                    return 0;
                 }
                 if (flux_msg_push_route (msg, zuuid_str (c->uuid)) < 0) {
                     flux_log_error (h, "flux_msg_push_route");
-                    goto error;
+                    return 0;
                 }
                 if (flux_send (h, msg, 0) < 0) {
                     flux_log_error (h, "%s: flux_send", __FUNCTION__);
-                    goto error;
+                    return 0;
                 }
             }
             break;
         case FLUX_MSGTYPE_EVENT:
             if (flux_send (h, msg, 0) < 0) {
                 flux_log_error (h, "%s: flux_send", __FUNCTION__);
-                goto error;
+                return 0;
             }
             break;
         default:
             flux_log (h, LOG_ERR, "drop unexpected %s",
                       flux_msg_typestr (type));
-            goto error;
+            return 0;
     }
-done:
-    flux_msg_destroy (msg);
+    return 0;
+}
+
+static void client_read_cb (flux_reactor_t *r, flux_watcher_t *w,
+                            int revents, void *arg)
+{
+    client_t *c = arg;
+    flux_t *h = c->ctx->h;
+    flux_msg_t *msg;
+    int rc;
+
+    if (revents & FLUX_POLLERR)
+        goto error_disconnect;
+    if (!(revents & FLUX_POLLIN))
+        return;
+    /* EPROTO, ECONNRESET are normal disconnect errors
+     * EWOULDBLOCK, EAGAIN leaves partial message in c->reader for
+     * continuation.  One read may buffer several messages, and the fd
+     * won't become readable again for those, so handle them all here.
+     */
+    //flux_log (h, LOG_DEBUG, "recv: client ready");
+    do {
+        if (!(msg = flux_msg_reader_recv (c->reader))) {
+            if (errno == EWOULDBLOCK || errno == EAGAIN) {
+                //flux_log (h, LOG_DEBUG, "recv: client not ready");
+                return;
+            }
+            if (errno != ECONNRESET && errno != EPROTO)
+                flux_log_error (h, "flux_msg_reader_recv");
+            goto error_disconnect;
+        }
+        rc = client_recv_msg (c, msg);
+        flux_msg_destroy (msg);
+        if (rc < 0)
+            goto error_disconnect;
+    } while (flux_msg_reader_pending (c->reader));
+    return;
+error_disconnect:
+    zlist_remove (c->ctx->clients, c);
+    client_destroy (c);
+}
+
+/* Client sent on the channel or made room in it, or client_shm_arm()
+ * found something to do.  Receive a limited number of messages per call
+ * so that one busy client can't starve the others;  client_shm_arm()
+ * calls back immediately if more remain.
+ */
+static void client_shm_cb (flux_reactor_t *r, flux_watcher_t *w,
+                           int revents, void *arg)
+{
+    client_t *c = arg;
+    flux_t *h = c->ctx->h;
+    flux_msg_t *msg;
+    int i, rc;
+
+    shmchan_clear (c->shm);
+    if (client_shm_flush (c) < 0) {
+        flux_log_error (h, "%s: shmchan_send", __FUNCTION__);
+        goto error_disconnect;
+    }
+    for (i = 0; i < SHM_RECV_BUDGET; i++) {
+        if (!(msg = shmchan_recv (c->shm))) {
+            if (errno == EAGAIN)
+                break;
+            flux_log_error (h, "%s: shmchan_recv", __FUNCTION__);
+            goto error_disconnect;
+        }
+        rc = client_recv_msg (c, msg);
+        flux_msg_destroy (msg);
+        if (rc < 0)
+            goto error_disconnect;
+    }
+    client_shm_arm (c);
     return;
 error_disconnect:
     zlist_remove (c->ctx->clients, c);
     client_destroy (c);
-error:
-    flux_msg_destroy (msg);
 }
 
 /* Determine if message can be routed to client.
@@ -824,6 +1068,32 @@ done:
     flux_msg_destroy (cpy);
 }
 
+struct event_delivery {
+    const flux_msg_t *msg;
+    int count;
+};
+
+static int event_deliver_cb (void *subscriber, void *arg)
+{
+    client_t *c = subscriber;
+    struct event_delivery *d = arg;
+
+    if (!allowed_message (c, d->msg))
+        return 0;
+    if (client_send (c, d->msg) < 0) { /* FIXME handle errors */
+        int type = FLUX_MSGTYPE_ANY;
+        const char *topic = "unknown";
+        (void)flux_msg_get_type (d->msg, &type);
+        (void)flux_msg_get_topic (d->msg, &topic);
+        flux_log_error (c->ctx->h, "send %s %s to client %.*s",
+                        topic, flux_msg_typestr (type),
+                        5, zuuid_str (c->uuid));
+        errno = 0;
+    }
+    d->count++;
+    return 0;
+}
+
 /* Received an event message from broker.
  * Find all subscribers and deliver.
  */
@@ -831,32 +1101,15 @@ static void event_cb (flux_t *h, flux_msg_handler_t *mh,
                       const flux_msg_t *msg, void *arg)
 {
     mod_local_ctx_t *ctx = arg;
-    client_t *c;
+    struct event_delivery d = { .msg = msg, .count = 0 };
     const char *topic;
-    int count = 0;
 
     if (flux_msg_get_topic (msg, &topic) < 0) {
         flux_log_error (h, "%s: dropped", __FUNCTION__);
         return;
     }
-    c = zlist_first (ctx->clients);
-    while (c) {
-        if (client_is_subscribed (c, topic) && allowed_message (c, msg)) {
-            if (client_send (c, msg) < 0) { /* FIXME handle errors */
-                int type = FLUX_MSGTYPE_ANY;
-                const char *topic = "unknown";
-                (void)flux_msg_get_type (msg, &type);
-                (void)flux_msg_get_topic (msg, &topic);
-                flux_log_error (h, "send %s %s to client %.*s",
-                                topic, flux_msg_typestr (type),
-                                5, zuuid_str (c->uuid));
-                errno = 0;
-            }
-            count++;
-        }
-        c = zlist_next (ctx->clients);
-    }
-    //flux_log (h, LOG_DEBUG, "%s: %s to %d clients", __FUNCTION__, topic, count);
+    (void)subtrie_match (ctx->subtrie, topic, event_deliver_cb, &d);
+    //flux_log (h, LOG_DEBUG, "%s: %s to %d clients", __FUNCTION__, topic, d.count);
 }
 
 /* Accept a connection from new client.
@@ -0,0 +1,1336 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* content-log.c - content addressable storage in append-only log segments
+ *
+ * Blobs are appended to segment files, and an in-memory index maps each
+ * blobref to the segment, offset, and size of its blob.  Segments are
+ * mapped with mmap(2), so loads are answered straight from the page cache.
+ * Once the active segment reaches 'segment-size' bytes it is sealed and
+ * a new one is started.  Sealed segments never change, so the index is
+ * written to a compact index file whenever a segment is sealed;  on
+ * startup, the index file is read and only records appended since it was
+ * written are recovered by scanning the segments.  A torn record at the
+ * end of a segment (e.g. after a crash) is truncated.
+ *
+ * Each segment record is a struct log_record, followed by the binary
+ * hash digest of the blob, followed by the blob.
+ *
+ * content-backing.compact discards blobs that are not reachable from a
+ * set of root blobrefs (e.g. KVS root directories).  The active segment is
+ * sealed, fixing the set of segments to sweep, and the content cache is
+ * flushed.  Reachable blobs are marked by walking KVS tree objects from the
+ * roots, and then live blobs are copied out of the swept segments into
+ * the active one in the background (from an idle watcher, 'compact-step'
+ * blobs at a time), after which the swept segments are removed.
+ * Blobs appended after the compaction starts are not swept, and a blob
+ * stored again while a compaction is in progress is kept, but a blob that
+ * is only referenced later from the content cache is not, so the roots
+ * should cover all content that may still be referenced.
+ *
+ * Module options:
+ *   segment-size=N     seal segments at N bytes (default 64M)
+ *   sync               sync the active segment before responding to stores
+ *   compact-step=N     copy up to N blobs per compaction step (default 256)
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <czmq.h>
+#include <jansson.h>
+#include <flux/core.h>
+
+#include "src/common/libutil/blobref.h"
+#include "src/common/libutil/cleanup.h"
+#include "src/common/libutil/xzmalloc.h"
+#include "src/common/libutil/log.h"
+#include "src/common/libutil/blobvec.h"
+#include "src/common/libutil/read_all.h"
+#include "src/common/libkvs/treeobj.h"
+
+#define LOG_RECORD_MAGIC    0x464c5842  /* "FLXB" */
+#define LOG_INDEX_MAGIC     0x464c5849  /* "FLXI" */
+#define LOG_INDEX_VERSION   1
+
+static const size_t default_segment_size = 64*1024*1024;
+static const size_t min_segment_size = 4096;
+static const int default_compact_step = 256;
+
+/* Segment record header.
+ */
+struct log_record {
+    uint32_t magic;
+    uint32_t hash_len;
+    uint32_t size;
+};
+
+/* Index file header, followed by 'segments' struct index_segment,
+ * followed by 'entries' struct index_entry, each followed by 'hash_len'
+ * bytes of hash digest.
+ */
+struct index_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t hash_len;
+    uint32_t segments;
+    uint64_t entries;
+};
+
+struct index_segment {
+    uint64_t id;
+    uint64_t size;
+};
+
+struct index_entry {
+    uint64_t offset;
+    uint32_t seg;
+    uint32_t size;
+};
+
+struct segment {
+    int id;
+    int fd;
+    char *path;
+    void *map;
+    size_t maplen;
+    size_t size;                    /* bytes written */
+    size_t indexed;                 /* bytes covered by index file */
+};
+
+/* Index entry, keyed by blobref.
+ */
+struct entry {
+    struct segment *seg;
+    size_t offset;                  /* offset of blob within segment */
+    uint32_t size;
+    bool live;                      /* kept by compaction */
+    bool marked;                    /* visited by compaction mark phase */
+};
+
+struct compaction {
+    flux_msg_t *msg;
+    json_t *roots;
+    zlist_t *segments;              /* segments still to sweep */
+    struct segment *seg;            /* segment being swept */
+    size_t offset;                  /* next record in 'seg' */
+    int live;
+    int freed;
+    int64_t freed_bytes;
+};
+
+typedef struct {
+    char *dir;
+    char *indexfile;
+    flux_t *h;
+    bool broker_shutdown;
+    const char *hashfun;
+    int hash_len;
+    uint32_t blob_size_limit;
+    size_t segment_size;
+    bool sync;
+    int compact_step;
+    zhash_t *index;                 /* blobref => struct entry */
+    zlist_t *segments;              /* list of struct segment, by id */
+    struct segment *active;         /* segment receiving appends */
+    struct compaction *compact;     /* compaction in progress, or NULL */
+    flux_watcher_t *compact_w;
+} log_ctx_t;
+
+static void segment_destroy (struct segment *seg, bool remove)
+{
+    if (seg) {
+        int saved_errno = errno;
+        if (seg->map)
+            (void)munmap (seg->map, seg->maplen);
+        if (seg->fd >= 0)
+            (void)close (seg->fd);
+        if (remove)
+            (void)unlink (seg->path);
+        free (seg->path);
+        free (seg);
+        errno = saved_errno;
+    }
+}
+
+/* Open segment 'id', creating it if 'create' is true.
+ * The segment is mapped with room to grow to at least 'minlen' bytes.
+ */
+static struct segment *segment_open (log_ctx_t *ctx, int id, bool create,
+                                     size_t minlen)
+{
+    struct segment *seg = xzmalloc (sizeof (*seg));
+    struct stat sb;
+    int flags = O_RDWR;
+
+    seg->id = id;
+    seg->fd = -1;
+    seg->path = xasprintf ("%s/segment.%d", ctx->dir, id);
+    if (create)
+        flags |= O_CREAT | O_EXCL;
+    if ((seg->fd = open (seg->path, flags, 0644)) < 0) {
+        flux_log_error (ctx->h, "open %s", seg->path);
+        goto error;
+    }
+    if (fstat (seg->fd, &sb) < 0) {
+        flux_log_error (ctx->h, "stat %s", seg->path);
+        goto error;
+    }
+    seg->size = sb.st_size;
+    seg->maplen = ctx->segment_size;
+    if (seg->maplen < seg->size)
+        seg->maplen = seg->size;
+    if (seg->maplen < minlen)
+        seg->maplen = minlen;
+    /* N.B. the mapping may extend past the end of the file.  Only the
+     * written part is ever accessed, and appends become visible through
+     * the shared mapping.
+     */
+    seg->map = mmap (NULL, seg->maplen, PROT_READ, MAP_SHARED, seg->fd, 0);
+    if (seg->map == MAP_FAILED) {
+        seg->map = NULL;
+        flux_log_error (ctx->h, "mmap %s", seg->path);
+        goto error;
+    }
+    return seg;
+error:
+    segment_destroy (seg, create);
+    return NULL;
+}
+
+static struct segment *segment_lookup (log_ctx_t *ctx, int id)
+{
+    struct segment *seg = zlist_first (ctx->segments);
+    while (seg && seg->id != id)
+        seg = zlist_next (ctx->segments);
+    return seg;
+}
+
+/* Parse record at 'offset' in 'seg'.  On success, return the record
+ * header in 'rec', a pointer to the hash digest in 'hashp', and the
+ * offset of the blob in 'dataoffp'.  Returns -1 if the record is
+ * incomplete or invalid.
+ */
+static int segment_record (log_ctx_t *ctx, struct segment *seg,
+                           size_t offset, struct log_record *rec,
+                           const void **hashp, size_t *dataoffp)
+{
+    const char *p = (const char *)seg->map + offset;
+    size_t dataoff;
+
+    if (offset + sizeof (*rec) > seg->size)
+        return -1;
+    memcpy (rec, p, sizeof (*rec));
+    if (rec->magic != LOG_RECORD_MAGIC || rec->hash_len != ctx->hash_len)
+        return -1;
+    dataoff = offset + sizeof (*rec) + rec->hash_len;
+    if (dataoff + rec->size > seg->size)
+        return -1;
+    *hashp = p + sizeof (*rec);
+    *dataoffp = dataoff;
+    return 0;
+}
+
+/* Add index entry for 'blobref', unless one already exists.
+ * Returns entry on success, NULL on failure with errno set.
+ */
+static struct entry *index_insert (log_ctx_t *ctx, const char *blobref,
+                                   struct segment *seg, size_t offset,
+                                   uint32_t size)
+{
+    struct entry *e;
+
+    if ((e = zhash_lookup (ctx->index, blobref)))
+        return e;
+    e = xzmalloc (sizeof (*e));
+    e->seg = seg;
+    e->offset = offset;
+    e->size = size;
+    if (zhash_insert (ctx->index, blobref, e) < 0) {
+        free (e);
+        errno = ENOMEM;
+        return NULL;
+    }
+    zhash_freefn (ctx->index, blobref, free);
+    return e;
+}
+
+/* Add index entries for records in 'seg' beyond the part covered by the
+ * index file.  If a torn record is found, truncate the segment there.
+ */
+static int segment_scan (log_ctx_t *ctx, struct segment *seg)
+{
+    size_t offset = seg->indexed;
+    struct log_record rec;
+    const void *hash;
+    size_t dataoff;
+    blobref_t blobref;
+    int count = 0;
+
+    while (segment_record (ctx, seg, offset, &rec, &hash, &dataoff) == 0) {
+        if (blobref_hashtostr (ctx->hashfun, hash, rec.hash_len,
+                                                            blobref) < 0)
+            return -1;
+        if (!index_insert (ctx, blobref, seg, dataoff, rec.size))
+            return -1;
+        offset = dataoff + rec.size;
+        count++;
+    }
+    if (offset < seg->size) {
+        flux_log (ctx->h, LOG_ERR, "%s: truncating %zu bytes at offset %zu",
+                  seg->path, seg->size - offset, offset);
+        if (ftruncate (seg->fd, offset) < 0) {
+            flux_log_error (ctx->h, "truncate %s", seg->path);
+            return -1;
+        }
+        seg->size = offset;
+    }
+    if (count > 0)
+        flux_log (ctx->h, LOG_DEBUG, "%s: recovered %d blobs",
+                  seg->path, count);
+    return 0;
+}
+
+/* Write the index file, atomically replacing the old one.
+ */
+static int index_write (log_ctx_t *ctx)
+{
+    char *tmp = xasprintf ("%s.tmp", ctx->indexfile);
+    struct index_header hdr;
+    struct segment *seg;
+    struct entry *e;
+    uint8_t hash[BLOBREF_MAX_DIGEST_SIZE];
+    FILE *f;
+    int saved_errno;
+
+    if (!(f = fopen (tmp, "w")))
+        goto error;
+    memset (&hdr, 0, sizeof (hdr));
+    hdr.magic = LOG_INDEX_MAGIC;
+    hdr.version = LOG_INDEX_VERSION;
+    hdr.hash_len = ctx->hash_len;
+    hdr.segments = zlist_size (ctx->segments);
+    hdr.entries = zhash_size (ctx->index);
+    if (fwrite (&hdr, sizeof (hdr), 1, f) != 1)
+        goto error;
+    seg = zlist_first (ctx->segments);
+    while (seg) {
+        struct index_segment is = { .id = seg->id, .size = seg->size };
+        if (fwrite (&is, sizeof (is), 1, f) != 1)
+            goto error;
+        seg = zlist_next (ctx->segments);
+    }
+    e = zhash_first (ctx->index);
+    while (e) {
+        struct index_entry ie = { .offset = e->offset, .seg = e->seg->id,
+                                  .size = e->size };
+        if (blobref_strtohash (zhash_cursor (ctx->index), hash,
+                               sizeof (hash)) != ctx->hash_len)
+            goto error;
+        if (fwrite (&ie, sizeof (ie), 1, f) != 1
+                || fwrite (hash, ctx->hash_len, 1, f) != 1)
+            goto error;
+        e = zhash_next (ctx->index);
+    }
+    if (fflush (f) != 0 || fsync (fileno (f)) < 0)
+        goto error;
+    if (fclose (f) != 0) {
+        f = NULL;
+        goto error;
+    }
+    f = NULL;
+    if (rename (tmp, ctx->indexfile) < 0)
+        goto error;
+    free (tmp);
+    return 0;
+error:
+    saved_errno = errno;
+    flux_log_error (ctx->h, "writing %s", ctx->indexfile);
+    if (f)
+        (void)fclose (f);
+    (void)unlink (tmp);
+    free (tmp);
+    errno = saved_errno;
+    return -1;
+}
+
+/* Read the index file, if any, and note how much of each segment it
+ * covers.  An index that is inconsistent with the segments is ignored,
+ * so that all segments are scanned instead.
+ */
+static int index_read (log_ctx_t *ctx)
+{
+    struct index_header hdr;
+    struct segment *seg = NULL;
+    void *buf = NULL;
+    const char *p;
+    ssize_t len;
+    int fd;
+    uint64_t i;
+
+    if ((fd = open (ctx->indexfile, O_RDONLY)) < 0) {
+        if (errno == ENOENT)
+            return 0;
+        flux_log_error (ctx->h, "open %s", ctx->indexfile);
+        return -1;
+    }
+    len = read_all (fd, &buf);
+    (void)close (fd);
+    if (len < 0) {
+        flux_log_error (ctx->h, "read %s", ctx->indexfile);
+        return -1;
+    }
+    p = buf;
+    if (len < sizeof (hdr))
+        goto invalid;
+    memcpy (&hdr, p, sizeof (hdr));
+    p += sizeof (hdr);
+    len -= sizeof (hdr);
+    if (hdr.magic != LOG_INDEX_MAGIC || hdr.version != LOG_INDEX_VERSION
+                                     || hdr.hash_len != ctx->hash_len)
+        goto invalid;
+    for (i = 0; i < hdr.segments; i++) {
+        struct index_segment is;
+        if (len < sizeof (is))
+            goto invalid;
+        memcpy (&is, p, sizeof (is));
+        p += sizeof (is);
+        len -= sizeof (is);
+        if (!(seg = segment_lookup (ctx, is.id)) || seg->size < is.size)
+            goto invalid;
+        seg->indexed = is.size;
+    }
+    for (i = 0; i < hdr.entries; i++) {
+        struct index_entry ie;
+        blobref_t blobref;
+        if (len < sizeof (ie) + hdr.hash_len)
+            goto invalid;
+        memcpy (&ie, p, sizeof (ie));
+        if (!seg || seg->id != ie.seg)
+            seg = segment_lookup (ctx, ie.seg);
+        if (!seg || ie.offset + ie.size > seg->indexed
+                || blobref_hashtostr (ctx->hashfun, p + sizeof (ie),
+                                      hdr.hash_len, blobref) < 0)
+            goto invalid;
+        p += sizeof (ie) + hdr.hash_len;
+        len -= sizeof (ie) + hdr.hash_len;
+        if (!index_insert (ctx, blobref, seg, ie.offset, ie.size)) {
+            free (buf);
+            return -1;
+        }
+    }
+    flux_log (ctx->h, LOG_DEBUG, "%s: %ju blobs", ctx->indexfile,
+              (uintmax_t)hdr.entries);
+    free (buf);
+    return 0;
+invalid:
+    flux_log (ctx->h, LOG_ERR, "%s: invalid index, rebuilding",
+              ctx->indexfile);
+    zhash_purge (ctx->index);
+    seg = zlist_first (ctx->segments);
+    while (seg) {
+        seg->indexed = 0;
+        seg = zlist_next (ctx->segments);
+    }
+    free (buf);
+    return 0;
+}
+
+/* Seal the active segment and start a new one, mapped with room for at
+ * least 'minlen' bytes.  Then write the index, which now covers all
+ * sealed segments.
+ */
+static int segment_seal (log_ctx_t *ctx, size_t minlen)
+{
+    struct segment *seg;
+    int id = ctx->active ? ctx->active->id + 1 : 0;
+
+    if (ctx->active && ctx->sync && fdatasync (ctx->active->fd) < 0) {
+        flux_log_error (ctx->h, "sync %s", ctx->active->path);
+        return -1;
+    }
+    if (!(seg = segment_open (ctx, id, true, minlen)))
+        return -1;
+    if (zlist_append (ctx->segments, seg) < 0) {
+        segment_destroy (seg, true);
+        errno = ENOMEM;
+        return -1;
+    }
+    ctx->active = seg;
+    (void)index_write (ctx); /* rebuilt by scanning if this fails */
+    return 0;
+}
+
+/* Append a record for blob 'data' with hash digest 'hash' to the active
+ * segment, sealing it first if the record doesn't fit.  On success, the
+ * blob's location is returned in 'segp' and 'offsetp'.
+ */
+static int log_append (log_ctx_t *ctx, const void *hash,
+                       const void *data, int size,
+                       struct segment **segp, size_t *offsetp)
+{
+    struct log_record rec = { .magic = LOG_RECORD_MAGIC,
+                              .hash_len = ctx->hash_len, .size = size };
+    size_t len = sizeof (rec) + ctx->hash_len + size;
+    struct iovec iov[3];
+    struct segment *seg;
+    ssize_t n;
+
+    if (ctx->active->size + len > ctx->active->maplen) {
+        if (segment_seal (ctx, len) < 0)
+            return -1;
+    }
+    seg = ctx->active;
+    iov[0].iov_base = &rec;
+    iov[0].iov_len = sizeof (rec);
+    iov[1].iov_base = (void *)hash;
+    iov[1].iov_len = ctx->hash_len;
+    iov[2].iov_base = (void *)data;
+    iov[2].iov_len = size;
+    if ((n = pwritev (seg->fd, iov, 3, seg->size)) != len) {
+        int saved_errno = n < 0 ? errno : ENOSPC;
+        flux_log_error (ctx->h, "write %s", seg->path);
+        (void)ftruncate (seg->fd, seg->size);
+        errno = saved_errno;
+        return -1;
+    }
+    *segp = seg;
+    *offsetp = seg->size + sizeof (rec) + ctx->hash_len;
+    seg->size += len;
+    return 0;
+}
+
+/* Store blob, computing its blobref.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int store_blob (log_ctx_t *ctx, const void *data, int size,
+                       blobref_t blobref)
+{
+    uint8_t hash[BLOBREF_MAX_DIGEST_SIZE];
+    struct segment *seg;
+    size_t offset;
+    struct entry *e;
+
+    if (size > ctx->blob_size_limit) {
+        errno = EFBIG;
+        return -1;
+    }
+    if (blobref_hash (ctx->hashfun, (uint8_t *)data, size, blobref) < 0)
+        return -1;
+    if ((e = zhash_lookup (ctx->index, blobref))) {
+        e->live = true; /* keep if compaction is in progress */
+        return 0;
+    }
+    if (blobref_strtohash (blobref, hash, sizeof (hash)) != ctx->hash_len) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (log_append (ctx, hash, data, size, &seg, &offset) < 0)
+        return -1;
+    if (!(e = index_insert (ctx, blobref, seg, offset, size)))
+        return -1;
+    e->live = true;
+    return 0;
+}
+
+/* Make stores durable before they are acknowledged, if configured.
+ */
+static int store_sync (log_ctx_t *ctx)
+{
+    if (ctx->sync && fdatasync (ctx->active->fd) < 0) {
+        flux_log_error (ctx->h, "sync %s", ctx->active->path);
+        return -1;
+    }
+    return 0;
+}
+
+static void compaction_destroy (struct compaction *cp)
+{
+    if (cp) {
+        int saved_errno = errno;
+        flux_msg_destroy (cp->msg);
+        json_decref (cp->roots);
+        zlist_destroy (&cp->segments);
+        free (cp);
+        errno = saved_errno;
+    }
+}
+
+static struct compaction *compaction_create (const flux_msg_t *msg,
+                                             json_t *roots)
+{
+    struct compaction *cp = xzmalloc (sizeof (*cp));
+
+    if (!(cp->msg = flux_msg_copy (msg, false)))
+        goto error;
+    cp->roots = json_incref (roots);
+    if (!(cp->segments = zlist_new ())) {
+        errno = ENOMEM;
+        goto error;
+    }
+    return cp;
+error:
+    compaction_destroy (cp);
+    return NULL;
+}
+
+/* End the compaction in progress, responding to its request.
+ */
+static void compaction_finish (log_ctx_t *ctx, int errnum)
+{
+    struct compaction *cp = ctx->compact;
+    int rc;
+
+    flux_watcher_stop (ctx->compact_w);
+    if (errnum)
+        rc = flux_respond (ctx->h, cp->msg, errnum, NULL);
+    else {
+        flux_log (ctx->h, LOG_DEBUG, "compact: %d live, %d freed (%jd bytes)",
+                  cp->live, cp->freed, (intmax_t)cp->freed_bytes);
+        rc = flux_respond_pack (ctx->h, cp->msg, "{s:i s:i s:I}",
+                                "live", cp->live,
+                                "freed", cp->freed,
+                                "freed-bytes", (json_int_t)cp->freed_bytes);
+    }
+    if (rc < 0)
+        flux_log_error (ctx->h, "compact: flux_respond");
+    compaction_destroy (cp);
+    ctx->compact = NULL;
+}
+
+/* Mark 'blobref' live.  If 'dir' is true, parse it as a KVS directory
+ * or hdir and push the directories (or buckets) it references onto
+ * 'stack', after marking the values it references.  A blob that is
+ * already live because it was stored again is still walked.
+ */
+static int mark_blob (log_ctx_t *ctx, const char *blobref, bool dir,
+                      zlist_t *stack)
+{
+    struct entry *e;
+    json_t *obj;
+    json_t *data;
+    const char *name;
+    json_t *o;
+    int i, count;
+
+    if (!(e = zhash_lookup (ctx->index, blobref)) || e->marked)
+        return 0;
+    e->marked = true;
+    e->live = true;
+    if (!dir)
+        return 0;
+    if (!(obj = treeobj_decodeb ((char *)e->seg->map + e->offset, e->size)))
+        return 0; /* not a tree object */
+    if (treeobj_is_dir (obj) || treeobj_is_hdir (obj)) {
+        data = treeobj_get_data (obj);
+        json_object_foreach (data, name, o) {
+            if (!treeobj_is_valref (o) && !treeobj_is_dirref (o))
+                continue;
+            count = treeobj_get_count (o);
+            for (i = 0; i < count; i++) {
+                const char *ref = treeobj_get_blobref (o, i);
+                if (!ref)
+                    continue;
+                if (treeobj_is_valref (o))
+                    (void)mark_blob (ctx, ref, false, stack);
+                else if (zlist_append (stack, xstrdup (ref)) < 0) {
+                    json_decref (obj);
+                    errno = ENOMEM;
+                    return -1;
+                }
+            }
+        }
+    }
+    json_decref (obj);
+    return 0;
+}
+
+/* Mark all blobs reachable from the compaction roots.
+ */
+static int mark_reachable (log_ctx_t *ctx, json_t *roots)
+{
+    zlist_t *stack;
+    json_t *o;
+    size_t index;
+    char *ref;
+    int rc = -1;
+
+    if (!(stack = zlist_new ())) {
+        errno = ENOMEM;
+        return -1;
+    }
+    json_array_foreach (roots, index, o) {
+        if (zlist_append (stack, xstrdup (json_string_value (o))) < 0) {
+            errno = ENOMEM;
+            goto done;
+        }
+    }
+    while ((ref = zlist_pop (stack))) {
+        int n = mark_blob (ctx, ref, true, stack);
+        free (ref);
+        if (n < 0)
+            goto done;
+    }
+    rc = 0;
+done:
+    while ((ref = zlist_pop (stack)))
+        free (ref);
+    zlist_destroy (&stack);
+    return rc;
+}
+
+/* Sweep up to 'compact-step' records from the segments to sweep,
+ * copying live blobs to the active segment and dropping the rest.
+ * Segments are removed once they have been swept.
+ */
+static void compact_step_cb (flux_reactor_t *r, flux_watcher_t *w,
+                             int revents, void *arg)
+{
+    log_ctx_t *ctx = arg;
+    struct compaction *cp = ctx->compact;
+    struct log_record rec;
+    const void *hash;
+    size_t dataoff;
+    blobref_t blobref;
+    struct entry *e;
+    int n = 0;
+
+    while (cp->seg && n < ctx->compact_step) {
+        if (cp->offset >= cp->seg->size) {
+            if (fdatasync (ctx->active->fd) < 0) {
+                flux_log_error (ctx->h, "sync %s", ctx->active->path);
+                goto error;
+            }
+            zlist_remove (ctx->segments, cp->seg);
+            segment_destroy (cp->seg, true);
+            cp->seg = zlist_pop (cp->segments);
+            cp->offset = 0;
+            continue;
+        }
+        if (segment_record (ctx, cp->seg, cp->offset,
+                                            &rec, &hash, &dataoff) < 0
+                || blobref_hashtostr (ctx->hashfun, hash, rec.hash_len,
+                                                            blobref) < 0) {
+            errno = EINVAL;
+            flux_log_error (ctx->h, "compact: %s offset %zu",
+                            cp->seg->path, cp->offset);
+            goto error;
+        }
+        e = zhash_lookup (ctx->index, blobref);
+        if (e && e->seg == cp->seg && e->offset == dataoff) {
+            if (e->live) {
+                const void *data = (char *)cp->seg->map + dataoff;
+                if (log_append (ctx, hash, data, rec.size,
+                                            &e->seg, &e->offset) < 0)
+                    goto error;
+                cp->live++;
+            }
+            else {
+                zhash_delete (ctx->index, blobref);
+                cp->freed++;
+                cp->freed_bytes += rec.size;
+            }
+        }
+        cp->offset = dataoff + rec.size;
+        n++;
+    }
+    if (!cp->seg) {
+        (void)index_write (ctx);
+        compaction_finish (ctx, 0);
+    }
+    return;
+error:
+    compaction_finish (ctx, errno);
+}
+
+/* Seal the active segment and take all sealed segments as the ones
+ * to sweep, clearing the marks of their blobs.  Blobs appended from here
+ * on go to segments that are not swept, so they are kept.
+ */
+static int compact_start (log_ctx_t *ctx)
+{
+    struct compaction *cp = ctx->compact;
+    struct segment *seg;
+    struct entry *e;
+
+    if (segment_seal (ctx, 0) < 0)
+        return -1;
+    seg = zlist_first (ctx->segments);
+    while (seg) {
+        if (seg != ctx->active && zlist_append (cp->segments, seg) < 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+        seg = zlist_next (ctx->segments);
+    }
+    e = zhash_first (ctx->index);
+    while (e) {
+        e->live = false;
+        e->marked = false;
+        e = zhash_next (ctx->index);
+    }
+    return 0;
+}
+
+/* The content cache has been flushed, so all blobs reachable from the
+ * roots are in the log.  Mark them, and start sweeping.
+ */
+static void compact_flush_continuation (flux_future_t *f, void *arg)
+{
+    log_ctx_t *ctx = arg;
+    struct compaction *cp = ctx->compact;
+
+    if (!cp) { /* aborted by module shutdown */
+        flux_future_destroy (f);
+        return;
+    }
+    if (flux_future_get (f, NULL) < 0) {
+        flux_log_error (ctx->h, "compact: content.flush");
+        goto error;
+    }
+    if (mark_reachable (ctx, cp->roots) < 0)
+        goto error;
+    cp->seg = zlist_pop (cp->segments);
+    cp->offset = 0;
+    flux_watcher_start (ctx->compact_w);
+    flux_future_destroy (f);
+    return;
+error:
+    compaction_finish (ctx, errno);
+    flux_future_destroy (f);
+}
+
+void compact_cb (flux_t *h, flux_msg_handler_t *mh,
+                 const flux_msg_t *msg, void *arg)
+{
+    log_ctx_t *ctx = arg;
+    json_t *roots;
+    size_t index;
+    json_t *o;
+    flux_future_t *f = NULL;
+
+    if (flux_request_unpack (msg, NULL, "{s:o}", "roots", &roots) < 0)
+        goto error;
+    if (!json_is_array (roots)) {
+        errno = EPROTO;
+        goto error;
+    }
+    json_array_foreach (roots, index, o) {
+        if (blobref_validate (json_string_value (o)) < 0) {
+            errno = EPROTO;
+            goto error;
+        }
+    }
+    if (ctx->compact) {
+        errno = EBUSY;
+        goto error;
+    }
+    if (!(ctx->compact = compaction_create (msg, roots)))
+        goto error;
+    if (compact_start (ctx) < 0
+            || !(f = flux_rpc (h, "content.flush", NULL, FLUX_NODEID_ANY, 0))
+            || flux_future_then (f, -1., compact_flush_continuation, ctx) < 0) {
+        compaction_destroy (ctx->compact);
+        ctx->compact = NULL;
+        goto error;
+    }
+    return;
+error:
+    if (flux_respond (h, msg, errno, NULL) < 0)
+        flux_log_error (h, "compact: flux_respond");
+    flux_future_destroy (f);
+}
+
+void load_cb (flux_t *h, flux_msg_handler_t *mh,
+              const flux_msg_t *msg, void *arg)
+{
+    log_ctx_t *ctx = arg;
+    const char *blobref = "-";
+    int blobref_size;
+    struct entry *e;
+    const void *data = NULL;
+    int size = 0;
+    int rc = -1;
+
+    if (flux_request_decode_raw (msg, NULL, (const void **)&blobref,
+                                 &blobref_size) < 0) {
+        flux_log_error (h, "load: request decode failed");
+        goto done;
+    }
+    if (!blobref || blobref[blobref_size - 1] != '\0') {
+        errno = EPROTO;
+        flux_log_error (h, "load: malformed blobref");
+        goto done;
+    }
+    if (!(e = zhash_lookup (ctx->index, blobref))) {
+        errno = ENOENT;
+        goto done;
+    }
+    data = (char *)e->seg->map + e->offset;
+    size = e->size;
+    rc = 0;
+done:
+    if (flux_respond_raw (h, msg, rc < 0 ? errno : 0, data, size) < 0)
+        flux_log_error (h, "load: flux_respond");
+}
+
+void store_cb (flux_t *h, flux_msg_handler_t *mh,
+               const flux_msg_t *msg, void *arg)
+{
+    log_ctx_t *ctx = arg;
+    const void *data;
+    int size;
+    blobref_t blobref;
+    int rc = -1;
+
+    if (flux_request_decode_raw (msg, NULL, &data, &size) < 0) {
+        flux_log_error (h, "store: request decode failed");
+        goto done;
+    }
+    if (store_blob (ctx, data, size, blobref) < 0)
+        goto done;
+    if (store_sync (ctx) < 0)
+        goto done;
+    rc = 0;
+done:
+    if (flux_respond_raw (h, msg, rc < 0 ? errno : 0,
+                          blobref, rc < 0 ? 0 : strlen (blobref) + 1) < 0)
+        flux_log_error (h, "store: flux_respond");
+}
+
+/* Load a batch of blobs.  Blobs that are not found are returned as
+ * absent items in the response blobvec.
+ */
+void load_batch_cb (flux_t *h, flux_msg_handler_t *mh,
+                    const flux_msg_t *msg, void *arg)
+{
+    log_ctx_t *ctx = arg;
+    blobvec_t *bv = NULL;
+    const void *buf;
+    int bufsize;
+    int offset = 0;
+    const char *blobref;
+    int blobref_size;
+    struct entry *e;
+    int n;
+    int rc = -1;
+
+    if (flux_request_decode_raw (msg, NULL, &buf, &bufsize) < 0) {
+        flux_log_error (h, "load-batch: request decode failed");
+        goto done;
+    }
+    if (!(bv = blobvec_create ()))
+        goto done;
+    while ((n = blobvec_next (buf, bufsize, &offset,
+                              (const void **)&blobref, &blobref_size)) > 0) {
+        if (blobref_size < 1 || blobref[blobref_size - 1] != '\0') {
+            errno = EPROTO;
+            flux_log_error (h, "load-batch: malformed blobref");
+            goto done;
+        }
+        if (!(e = zhash_lookup (ctx->index, blobref)))
+            n = blobvec_append (bv, NULL, -1);
+        else
+            n = blobvec_append (bv, (char *)e->seg->map + e->offset, e->size);
+        if (n < 0)
+            goto done;
+    }
+    if (n < 0) {
+        flux_log_error (h, "load-batch: malformed request");
+        goto done;
+    }
+    rc = 0;
+done:
+    if (flux_respond_raw (h, msg, rc < 0 ? errno : 0,
+                          rc < 0 ? NULL : blobvec_data (bv),
+                          rc < 0 ? 0 : blobvec_size (bv)) < 0)
+        flux_log_error (h, "load-batch: flux_respond");
+    blobvec_destroy (bv);
+}
+
+/* Store a batch of blobs, syncing (if configured) once per batch.
+ */
+void store_batch_cb (flux_t *h, flux_msg_handler_t *mh,
+                     const flux_msg_t *msg, void *arg)
+{
+    log_ctx_t *ctx = arg;
+    blobvec_t *bv = NULL;
+    const void *buf;
+    int bufsize;
+    int offset = 0;
+    const void *data;
+    int size;
+    blobref_t blobref;
+    int n;
+    int rc = -1;
+
+    if (flux_request_decode_raw (msg, NULL, &buf, &bufsize) < 0) {
+        flux_log_error (h, "store-batch: request decode failed");
+        goto done;
+    }
+    if (!(bv = blobvec_create ()))
+        goto done;
+    while ((n = blobvec_next (buf, bufsize, &offset, &data, &size)) > 0) {
+        if (size < 0) {
+            errno = EPROTO;
+            goto done;
+        }
+        if (store_blob (ctx, data, size, blobref) < 0)
+            goto done;
+        if (blobvec_append (bv, blobref, strlen (blobref) + 1) < 0)
+            goto done;
+    }
+    if (n < 0) {
+        flux_log_error (h, "store-batch: malformed request");
+        goto done;
+    }
+    if (store_sync (ctx) < 0)
+        goto done;
+    rc = 0;
+done:
+    if (flux_respond_raw (h, msg, rc < 0 ? errno : 0,
+                          rc < 0 ? NULL : blobvec_data (bv),
+                          rc < 0 ? 0 : blobvec_size (bv)) < 0)
+        flux_log_error (h, "store-batch: flux_respond");
+    blobvec_destroy (bv);
+}
+
+static void freectx (void *arg)
+{
+    log_ctx_t *ctx = arg;
+    if (ctx) {
+        struct segment *seg;
+        compaction_destroy (ctx->compact);
+        flux_watcher_destroy (ctx->compact_w);
+        zhash_destroy (&ctx->index);
+        if (ctx->segments) {
+            while ((seg = zlist_pop (ctx->segments)))
+                segment_destroy (seg, true);
+            zlist_destroy (&ctx->segments);
+        }
+        if (ctx->indexfile) {
+            unlink (ctx->indexfile);
+            free (ctx->indexfile);
+        }
+        free (ctx->dir);
+        free (ctx);
+    }
+}
+
+static void process_args (log_ctx_t *ctx, int ac, char **av)
+{
+    int i;
+
+    for (i = 0; i < ac; i++) {
+        if (strncmp (av[i], "segment-size=", 13) == 0)
+            ctx->segment_size = strtoull (av[i]+13, NULL, 10);
+        else if (strcmp (av[i], "sync") == 0)
+            ctx->sync = true;
+        else if (strncmp (av[i], "compact-step=", 13) == 0)
+            ctx->compact_step = strtoul (av[i]+13, NULL, 10);
+        else
+            flux_log (ctx->h, LOG_ERR, "Unknown option `%s'", av[i]);
+    }
+    if (ctx->segment_size < min_segment_size)
+        ctx->segment_size = min_segment_size;
+    if (ctx->compact_step < 1)
+        ctx->compact_step = 1;
+}
+
+static int segment_id_cmp (const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/* Open existing segments in order of id, then read the index and
+ * scan what it doesn't cover.  The last segment becomes the active one.
+ */
+static int open_segments (log_ctx_t *ctx)
+{
+    DIR *dir;
+    struct dirent *d;
+    int *ids = NULL;
+    int count = 0;
+    struct segment *seg;
+    int i;
+    int rc = -1;
+
+    if (!(dir = opendir (ctx->dir))) {
+        flux_log_error (ctx->h, "opendir %s", ctx->dir);
+        return -1;
+    }
+    while ((d = readdir (dir))) {
+        int id;
+        char c;
+        if (sscanf (d->d_name, "segment.%d%c", &id, &c) != 1 || id < 0)
+            continue;
+        ids = xrealloc (ids, (count + 1) * sizeof (ids[0]));
+        ids[count++] = id;
+    }
+    (void)closedir (dir);
+    qsort (ids, count, sizeof (ids[0]), segment_id_cmp);
+    for (i = 0; i < count; i++) {
+        if (!(seg = segment_open (ctx, ids[i], false, 0)))
+            goto done;
+        if (zlist_append (ctx->segments, seg) < 0) {
+            segment_destroy (seg, false);
+            errno = ENOMEM;
+            goto done;
+        }
+    }
+    if (index_read (ctx) < 0)
+        goto done;
+    seg = zlist_first (ctx->segments);
+    while (seg) {
+        if (segment_scan (ctx, seg) < 0)
+            goto done;
+        seg = zlist_next (ctx->segments);
+    }
+    if ((ctx->active = zlist_last (ctx->segments))) {
+        if (ctx->active->size + min_segment_size > ctx->active->maplen
+                && segment_seal (ctx, 0) < 0)
+            goto done;
+    }
+    else if (segment_seal (ctx, 0) < 0)
+        goto done;
+    rc = 0;
+done:
+    free (ids);
+    return rc;
+}
+
+static log_ctx_t *getctx (flux_t *h, int argc, char **argv)
+{
+    log_ctx_t *ctx = (log_ctx_t *)flux_aux_get (h, "flux::content-log");
+    const char *dir;
+    const char *tmp;
+    bool cleanup = false;
+    blobref_t blobref;
+    uint8_t hash[BLOBREF_MAX_DIGEST_SIZE];
+    int saved_errno;
+
+    if (!ctx) {
+        ctx = xzmalloc (sizeof (*ctx));
+        ctx->h = h;
+        ctx->segment_size = default_segment_size;
+        ctx->compact_step = default_compact_step;
+        process_args (ctx, argc, argv);
+        if (!(ctx->index = zhash_new ()) || !(ctx->segments = zlist_new ())) {
+            saved_errno = ENOMEM;
+            goto error;
+        }
+        if (!(ctx->compact_w = flux_idle_watcher_create (flux_get_reactor (h),
+                                                         compact_step_cb,
+                                                         ctx))) {
+            saved_errno = errno;
+            flux_log_error (h, "flux_idle_watcher_create");
+            goto error;
+        }
+        if (!(ctx->hashfun = flux_attr_get (h, "content.hash", NULL))) {
+            saved_errno = errno;
+            flux_log_error (h, "content.hash");
+            goto error;
+        }
+        if (blobref_hash (ctx->hashfun, "", 0, blobref) < 0
+                || (ctx->hash_len = blobref_strtohash (blobref, hash,
+                                                       sizeof (hash))) < 0) {
+            saved_errno = errno;
+            flux_log_error (h, "content.hash %s", ctx->hashfun);
+            goto error;
+        }
+        if (!(tmp = flux_attr_get (h, "content.blob-size-limit", NULL))) {
+            saved_errno = errno;
+            flux_log_error (h, "content.blob-size-limit");
+            goto error;
+        }
+        ctx->blob_size_limit = strtoul (tmp, NULL, 10);
+
+        if (!(dir = flux_attr_get (h, "persist-directory", NULL))) {
+            if (!(dir = flux_attr_get (h, "broker.rundir", NULL))) {
+                saved_errno = errno;
+                flux_log_error (h, "broker.rundir");
+                goto error;
+            }
+            cleanup = true;
+        }
+        ctx->dir = xasprintf ("%s/content-log", dir);
+        if (mkdir (ctx->dir, 0755) < 0 && errno != EEXIST) {
+            saved_errno = errno;
+            flux_log_error (h, "mkdir %s", ctx->dir);
+            goto error;
+        }
+        if (cleanup)
+            cleanup_push_string (cleanup_directory_recursive, ctx->dir);
+        ctx->indexfile = xasprintf ("%s/index", ctx->dir);
+        if (open_segments (ctx) < 0) {
+            saved_errno = errno;
+            goto error;
+        }
+        flux_aux_set (h, "flux::content-log", ctx, freectx);
+    }
+    return ctx;
+error:
+    freectx (ctx);
+    errno = saved_errno;
+    return NULL;
+}
+
+int register_backing_store (flux_t *h, bool value, const char *name)
+{
+    flux_future_t *f;
+    int saved_errno = 0;
+    int rc = -1;
+
+    if (!(f = flux_rpc_pack (h, "content.backing", FLUX_NODEID_ANY, 0,
+                             "{ s:b s:s }",
+                             "backing", value,
+                             "name", name)))
+        goto done;
+    if (flux_future_get (f, NULL) < 0)
+        goto done;
+    rc = 0;
+done:
+    saved_errno = errno;
+    flux_future_destroy (f);
+    errno = saved_errno;
+    return rc;
+}
+
+/* Intercept broker shutdown event.  If broker is shutting down,
+ * avoid transferring data back to the content cache at unload time.
+ */
+void broker_shutdown_cb (flux_t *h, flux_msg_handler_t *mh,
+                         const flux_msg_t *msg, void *arg)
+{
+    log_ctx_t *ctx = arg;
+    ctx->broker_shutdown = true;
+    flux_log (h, LOG_DEBUG, "broker shutdown in progress");
+}
+
+/* Manage shutdown of this module.
+ * Tell content cache to disable backing store,
+ * then write everything back to it before exiting.
+ */
+void shutdown_cb (flux_t *h, flux_msg_handler_t *mh,
+                  const flux_msg_t *msg, void *arg)
+{
+    log_ctx_t *ctx = arg;
+    flux_future_t *f;
+    struct entry *e;
+    int count = 0;
+
+    flux_log (h, LOG_DEBUG, "shutdown: begin");
+    if (ctx->compact)
+        compaction_finish (ctx, ENOSYS);
+    if (register_backing_store (h, false, "content-log") < 0) {
+        flux_log_error (h, "shutdown: unregistering backing store");
+        goto done;
+    }
+    if (ctx->broker_shutdown) {
+        flux_log (h, LOG_DEBUG, "shutdown: instance is terminating, don't reload to cache");
+        goto done;
+    }
+    e = zhash_first (ctx->index);
+    while (e) {
+        const char *blobref;
+        int blobref_size;
+        if (!(f = flux_rpc_raw (h, "content.store",
+                                (char *)e->seg->map + e->offset, e->size,
+                                FLUX_NODEID_ANY, 0))) {
+            flux_log_error (h, "shutdown: store");
+            goto next;
+        }
+        if (flux_rpc_get_raw (f, (const void **)&blobref, &blobref_size) < 0) {
+            flux_log_error (h, "shutdown: store");
+            flux_future_destroy (f);
+            goto next;
+        }
+        if (!blobref || blobref[blobref_size - 1] != '\0') {
+            flux_log (h, LOG_ERR, "shutdown: store returned malformed blobref");
+            flux_future_destroy (f);
+            goto next;
+        }
+        flux_future_destroy (f);
+        count++;
+next:
+        e = zhash_next (ctx->index);
+    }
+    flux_log (h, LOG_DEBUG, "shutdown: %d entries returned to cache", count);
+done:
+    flux_reactor_stop (flux_get_reactor (h));
+}
+
+static const struct flux_msg_handler_spec htab[] = {
+    { FLUX_MSGTYPE_REQUEST, "content-backing.load",    load_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "content-backing.store",   store_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "content-backing.load-batch", load_batch_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "content-backing.store-batch", store_batch_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "content-backing.compact", compact_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "content-log.shutdown",    shutdown_cb, 0, },
+    { FLUX_MSGTYPE_EVENT,   "shutdown",                broker_shutdown_cb, 0 },
+    FLUX_MSGHANDLER_TABLE_END,
+};
+
+int mod_main (flux_t *h, int argc, char **argv)
+{
+    flux_msg_handler_t **handlers = NULL;
+    log_ctx_t *ctx;
+
+    if (!(ctx = getctx (h, argc, argv)))
+        goto done;
+    if (flux_event_subscribe (h, "shutdown") < 0) {
+        flux_log_error (h, "flux_event_subscribe");
+        goto done;
+    }
+    if (flux_msg_handler_addvec (h, htab, ctx, &handlers) < 0) {
+        flux_log_error (h, "flux_msg_handler_addvec");
+        goto done;
+    }
+    if (register_backing_store (h, true, "content-log") < 0) {
+        flux_log_error (h, "registering backing store");
+        goto done;
+    }
+    if (flux_reactor_run (flux_get_reactor (h), 0) < 0) {
+        flux_log_error (h, "flux_reactor_run");
+        goto done;
+    }
+done:
+    flux_msg_handler_delvec (handlers);
+    return 0;
+}
+
+MOD_NAME ("content-log");
+MOD_SERVICE ("content-backing");
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,261 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* codec.c - compression codecs for content-sqlite */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <errno.h>
+#include <string.h>
+#if HAVE_LZ4
+#include <lz4.h>
+#endif
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "src/common/libminilzo/minilzo.h"
+
+#include "codec.h"
+
+struct codec {
+    int id;
+    const char *name;
+    size_t (*bound)(size_t size);
+    int (*compress)(const void *in, int inlen, void *out, int outlen);
+    int (*decompress)(const void *in, int inlen, void *out, int outlen);
+};
+
+/* none */
+
+static size_t none_bound (size_t size)
+{
+    return size;
+}
+
+static int none_compress (const void *in, int inlen, void *out, int outlen)
+{
+    if (outlen < inlen) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy (out, in, inlen);
+    return inlen;
+}
+
+static int none_decompress (const void *in, int inlen, void *out, int outlen)
+{
+    if (outlen != inlen) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy (out, in, inlen);
+    return 0;
+}
+
+/* lzo */
+
+#define HEAP_ALLOC(var,size) \
+        lzo_align_t __LZO_MMODEL var [ ((size) + (sizeof(lzo_align_t) - 1)) / sizeof(lzo_align_t) ]
+
+static HEAP_ALLOC(lzo_wrkmem, LZO1X_1_MEM_COMPRESS);
+
+static size_t lzo_bound (size_t size)
+{
+    return size + size / 16 + 64 + 3;
+}
+
+static int lzo_compress (const void *in, int inlen, void *out, int outlen)
+{
+    lzo_uint out_len = outlen;
+
+    if (lzo1x_1_compress (in, inlen, out, &out_len, lzo_wrkmem) != LZO_E_OK) {
+        errno = EINVAL;
+        return -1;
+    }
+    return out_len;
+}
+
+static int lzo_decompress (const void *in, int inlen, void *out, int outlen)
+{
+    lzo_uint out_len = outlen;
+
+    if (lzo1x_decompress_safe (in, inlen, out, &out_len, NULL) != LZO_E_OK
+                                                    || out_len != outlen) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/* lz4 */
+
+#if HAVE_LZ4
+static size_t lz4_bound (size_t size)
+{
+    return LZ4_compressBound (size);
+}
+
+static int lz4_compress (const void *in, int inlen, void *out, int outlen)
+{
+    int n;
+
+    if ((n = LZ4_compress_default (in, out, inlen, outlen)) <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return n;
+}
+
+static int lz4_decompress (const void *in, int inlen, void *out, int outlen)
+{
+    if (LZ4_decompress_safe (in, out, inlen, outlen) != outlen) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+#endif /* HAVE_LZ4 */
+
+/* zstd */
+
+#if HAVE_ZSTD
+static const int zstd_level = 3;
+
+static size_t zstd_bound (size_t size)
+{
+    return ZSTD_compressBound (size);
+}
+
+static int zstd_compress (const void *in, int inlen, void *out, int outlen)
+{
+    size_t n = ZSTD_compress (out, outlen, in, inlen, zstd_level);
+
+    if (ZSTD_isError (n)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return n;
+}
+
+static int zstd_decompress (const void *in, int inlen, void *out, int outlen)
+{
+    size_t n = ZSTD_decompress (out, outlen, in, inlen);
+
+    if (ZSTD_isError (n) || n != outlen) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+#endif /* HAVE_ZSTD */
+
+static const struct codec codecs[] = {
+    { CODEC_NONE, "none", none_bound, none_compress, none_decompress },
+    { CODEC_LZO,  "lzo",  lzo_bound,  lzo_compress,  lzo_decompress },
+#if HAVE_LZ4
+    { CODEC_LZ4,  "lz4",  lz4_bound,  lz4_compress,  lz4_decompress },
+#endif
+#if HAVE_ZSTD
+    { CODEC_ZSTD, "zstd", zstd_bound, zstd_compress, zstd_decompress },
+#endif
+};
+
+static const int codecs_count = sizeof (codecs) / sizeof (codecs[0]);
+
+int codec_init (void)
+{
+    if (lzo_init () != LZO_E_OK)
+        return -1;
+    return 0;
+}
+
+const struct codec *codec_lookup (const char *name)
+{
+    int i;
+
+    for (i = 0; i < codecs_count; i++) {
+        if (!strcmp (codecs[i].name, name))
+            return &codecs[i];
+    }
+    return NULL;
+}
+
+const struct codec *codec_lookup_id (int id)
+{
+    int i;
+
+    for (i = 0; i < codecs_count; i++) {
+        if (codecs[i].id == id)
+            return &codecs[i];
+    }
+    return NULL;
+}
+
+const char *codec_list (void)
+{
+    static char buf[64] = "";
+    int i;
+
+    if (buf[0] == '\0') {
+        for (i = 0; i < codecs_count; i++) {
+            if (i > 0)
+                strcat (buf, ",");
+            strcat (buf, codecs[i].name);
+        }
+    }
+    return buf;
+}
+
+const char *codec_name (const struct codec *c)
+{
+    return c->name;
+}
+
+int codec_id (const struct codec *c)
+{
+    return c->id;
+}
+
+size_t codec_bound (const struct codec *c, size_t size)
+{
+    return c->bound (size);
+}
+
+int codec_compress (const struct codec *c, const void *in, int inlen,
+                    void *out, int outlen)
+{
+    return c->compress (in, inlen, out, outlen);
+}
+
+int codec_decompress (const struct codec *c, const void *in, int inlen,
+                      void *out, int outlen)
+{
+    return c->decompress (in, inlen, out, outlen);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
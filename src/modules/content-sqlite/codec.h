@@ -0,0 +1,89 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#ifndef _CONTENT_SQLITE_CODEC_H
+#define _CONTENT_SQLITE_CODEC_H
+
+#include <stddef.h>
+
+/* Compression codecs for content-sqlite.
+ *
+ * Each row in the objects table records the id of the codec that
+ * compressed it, so codec ids are part of the database format and
+ * must never be renumbered.  Codecs that were not found at build time
+ * are not available from codec_lookup(), and codec_lookup_id()
+ * returns NULL for them so that their rows fail cleanly.
+ */
+
+enum {
+    CODEC_NONE = 0,
+    CODEC_LZO = 1,                  /* rows with NULL codec are LZO too */
+    CODEC_LZ4 = 2,
+    CODEC_ZSTD = 3,
+};
+
+struct codec;
+
+/* Initialize codec libraries.  Call once before use.
+ * Returns 0 on success, -1 on failure.
+ */
+int codec_init (void);
+
+/* Look up an available codec by name or id.
+ * Returns NULL if unknown or not built in.
+ */
+const struct codec *codec_lookup (const char *name);
+const struct codec *codec_lookup_id (int id);
+
+/* Return comma-separated list of available codec names.
+ */
+const char *codec_list (void);
+
+const char *codec_name (const struct codec *c);
+int codec_id (const struct codec *c);
+
+/* Return the largest compressed size that compressing 'size' bytes
+ * can produce.
+ */
+size_t codec_bound (const struct codec *c, size_t size);
+
+/* Compress 'in' to 'out', whose length must be at least
+ * codec_bound (c, inlen).
+ * Returns compressed length on success, -1 on failure with errno set.
+ */
+int codec_compress (const struct codec *c, const void *in, int inlen,
+                    void *out, int outlen);
+
+/* Decompress 'in' to 'out', which must be exactly the uncompressed length.
+ * Returns 0 on success, -1 on failure with errno set
+ * (EINVAL if data is corrupt or the length does not match).
+ */
+int codec_decompress (const struct codec *c, const void *in, int inlen,
+                      void *out, int outlen);
+
+#endif /* !_CONTENT_SQLITE_CODEC_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -22,7 +22,25 @@
  *  See also:  http://www.gnu.org/licenses/
 \*****************************************************************************/
 
-/* content-sqlite.c - content addressable storage with sqlite back end */
+/* content-sqlite.c - content addressable storage with sqlite back end
+ *
+ * Stores may be grouped into transactions ("group commit"):  a store is
+ * executed immediately inside an open transaction, but its response is
+ * held until the transaction is committed, which happens once
+ * 'batch-size' blobs have been staged, or 'batch-timeout' seconds after
+ * the transaction was opened, whichever comes first.
+ *
+ * Module options:
+ *   batch-size=N       commit after N blobs are staged (default 1)
+ *   batch-timeout=SECS commit a partial batch after SECS (default 0.001)
+ *   durable            use a write-ahead log with synchronous commits,
+ *                      so committed blobs survive a crash
+ *   codec=NAME         compress new blobs with codec NAME (default lzo)
+ *
+ * Each row records the codec that compressed it (NULL meaning LZO, for
+ * rows written before the codec column was added), so rows written with
+ * any codec remain readable regardless of the codec selected for stores.
+ */
 
 #if HAVE_CONFIG_H
 #include "config.h"
@@ -35,21 +53,38 @@
 #include "src/common/libutil/cleanup.h"
 #include "src/common/libutil/xzmalloc.h"
 #include "src/common/libutil/log.h"
-#include "src/common/libminilzo/minilzo.h"
+#include "src/common/libutil/blobvec.h"
+
+#include "codec.h"
 
-const size_t lzo_buf_chunksize = 1024*1024;
 const size_t compression_threshold = 256; /* compress blobs >= this size */
 
-const char *sql_create_table = "CREATE TABLE objects("
+const char *sql_create_table = "CREATE TABLE IF NOT EXISTS objects("
                                "  hash CHAR(20) PRIMARY KEY,"
                                "  size INT,"
-                               "  object BLOB"
+                               "  object BLOB,"
+                               "  codec INT"
                                ");";
-const char *sql_load = "SELECT object,size FROM objects"
+const char *sql_check_codec = "SELECT codec FROM objects LIMIT 1";
+const char *sql_add_codec = "ALTER TABLE objects ADD COLUMN codec INT";
+const char *sql_load = "SELECT object,size,codec FROM objects"
                        "  WHERE hash = ?1 LIMIT 1";
-const char *sql_store = "INSERT INTO objects (hash,size,object) "
-                        "  values (?1, ?2, ?3)";
-const char *sql_dump = "SELECT object,size FROM objects";
+const char *sql_store = "INSERT INTO objects (hash,size,object,codec) "
+                        "  values (?1, ?2, ?3, ?4)";
+const char *sql_dump = "SELECT object,size,codec FROM objects";
+
+static const char *default_codec = "lzo";
+
+static const int default_batch_size = 1;
+static const double default_batch_timeout = 0.001;
+
+/* A response held until the open transaction commits.
+ */
+struct txn_response {
+    flux_msg_t *msg;
+    void *data;
+    int len;
+};
 
 typedef struct {
     char *dbdir;
@@ -62,15 +97,18 @@ typedef struct {
     bool broker_shutdown;
     const char *hashfun;
     uint32_t blob_size_limit;
-    size_t lzo_bufsize;
-    void *lzo_buf;
+    const struct codec *codec;      /* codec for new blobs */
+    size_t zbufsize;
+    void *zbuf;                     /* compression output */
+    int batch_size;
+    double batch_timeout;
+    bool durable;
+    bool txn_open;
+    int txn_count;                  /* blobs staged in open transaction */
+    zlist_t *txn_responses;         /* list of struct txn_response */
+    flux_watcher_t *txn_timer;
 } sqlite_ctx_t;
 
-#define HEAP_ALLOC(var,size) \
-        lzo_align_t __LZO_MMODEL var [ ((size) + (sizeof(lzo_align_t) - 1)) / sizeof(lzo_align_t) ]
-
-static HEAP_ALLOC(lzo_wrkmem, LZO1X_1_MEM_COMPRESS);
-
 static void log_sqlite_error (sqlite_ctx_t *ctx, const char *fmt, ...)
 {
     va_list ap;
@@ -111,31 +149,102 @@ static void set_errno_from_sqlite_error (sqlite_ctx_t *ctx)
     }
 }
 
+static void txn_response_destroy (struct txn_response *r)
+{
+    if (r) {
+        flux_msg_destroy (r->msg);
+        free (r->data);
+        free (r);
+    }
+}
+
+static struct txn_response *txn_response_create (const flux_msg_t *msg,
+                                                 const void *data, int len)
+{
+    struct txn_response *r;
+
+    if (!(r = calloc (1, sizeof (*r))))
+        goto nomem;
+    if (!(r->msg = flux_msg_copy (msg, false)))
+        goto error;
+    if (len > 0) {
+        if (!(r->data = malloc (len)))
+            goto nomem;
+        memcpy (r->data, data, len);
+        r->len = len;
+    }
+    return r;
+nomem:
+    errno = ENOMEM;
+error:
+    txn_response_destroy (r);
+    return NULL;
+}
+
 static void freectx (void *arg)
 {
     sqlite_ctx_t *ctx = arg;
     if (ctx) {
+        struct txn_response *r;
+        if (ctx->txn_responses) {
+            while ((r = zlist_pop (ctx->txn_responses)))
+                txn_response_destroy (r);
+            zlist_destroy (&ctx->txn_responses);
+        }
+        flux_watcher_destroy (ctx->txn_timer);
         if (ctx->store_stmt)
             sqlite3_finalize (ctx->store_stmt);
         if (ctx->load_stmt)
             sqlite3_finalize (ctx->load_stmt);
         if (ctx->dump_stmt)
             sqlite3_finalize (ctx->dump_stmt);
+        if (ctx->db)
+            sqlite3_close (ctx->db);
         if (ctx->dbdir)
             free (ctx->dbdir);
         if (ctx->dbfile) {
             unlink (ctx->dbfile);
             free (ctx->dbfile);
         }
-        if (ctx->db)
-            sqlite3_close (ctx->db);
-        if (ctx->lzo_buf)
-            free (ctx->lzo_buf);
+        if (ctx->zbuf)
+            free (ctx->zbuf);
         free (ctx);
     }
 }
 
-static sqlite_ctx_t *getctx (flux_t *h)
+static int process_args (sqlite_ctx_t *ctx, int ac, char **av)
+{
+    int i;
+
+    for (i = 0; i < ac; i++) {
+        if (strncmp (av[i], "batch-size=", 11) == 0)
+            ctx->batch_size = strtoul (av[i]+11, NULL, 10);
+        else if (strncmp (av[i], "batch-timeout=", 14) == 0)
+            ctx->batch_timeout = strtod (av[i]+14, NULL);
+        else if (strcmp (av[i], "durable") == 0)
+            ctx->durable = true;
+        else if (strncmp (av[i], "codec=", 6) == 0) {
+            if (!(ctx->codec = codec_lookup (av[i]+6))) {
+                flux_log (ctx->h, LOG_ERR, "Unknown codec `%s' (try %s)",
+                          av[i]+6, codec_list ());
+                errno = EINVAL;
+                return -1;
+            }
+        }
+        else
+            flux_log (ctx->h, LOG_ERR, "Unknown option `%s'", av[i]);
+    }
+    if (ctx->batch_size < 1)
+        ctx->batch_size = 1;
+    if (ctx->batch_timeout < 0.)
+        ctx->batch_timeout = 0.;
+    return 0;
+}
+
+static void txn_timer_cb (flux_reactor_t *r, flux_watcher_t *w,
+                          int revents, void *arg);
+
+static sqlite_ctx_t *getctx (flux_t *h, int argc, char **argv)
 {
     sqlite_ctx_t *ctx = (sqlite_ctx_t *)flux_aux_get (h, "flux::content-sqlite");
     const char *dir;
@@ -146,9 +255,26 @@ static sqlite_ctx_t *getctx (flux_t *h)
 
     if (!ctx) {
         ctx = xzmalloc (sizeof (*ctx));
-        ctx->lzo_buf = xzmalloc (lzo_buf_chunksize);
-        ctx->lzo_bufsize = lzo_buf_chunksize;
         ctx->h = h;
+        ctx->batch_size = default_batch_size;
+        ctx->batch_timeout = default_batch_timeout;
+        ctx->codec = codec_lookup (default_codec);
+        if (process_args (ctx, argc, argv) < 0) {
+            saved_errno = errno;
+            goto error;
+        }
+        if (!(ctx->txn_responses = zlist_new ())) {
+            saved_errno = ENOMEM;
+            goto error;
+        }
+        if (!(ctx->txn_timer = flux_timer_watcher_create (flux_get_reactor (h),
+                                                          ctx->batch_timeout,
+                                                          0., txn_timer_cb,
+                                                          ctx))) {
+            saved_errno = errno;
+            flux_log_error (h, "flux_timer_watcher_create");
+            goto error;
+        }
         if (!(ctx->hashfun = flux_attr_get (h, "content.hash", &flags))) {
             saved_errno = errno;
             flux_log_error (h, "content.hash");
@@ -170,7 +296,7 @@ static sqlite_ctx_t *getctx (flux_t *h)
             cleanup = true;
         }
         ctx->dbdir = xasprintf ("%s/content", dir);
-        if (mkdir (ctx->dbdir, 0755) < 0) {
+        if (mkdir (ctx->dbdir, 0755) < 0 && errno != EEXIST) {
             saved_errno = errno;
             flux_log_error (h, "mkdir %s", ctx->dbdir);
             goto error;
@@ -184,11 +310,18 @@ static sqlite_ctx_t *getctx (flux_t *h)
             flux_log_error (h, "sqlite3_open %s", ctx->dbfile);
             goto error;
         }
-        if (sqlite3_exec (ctx->db, "PRAGMA journal_mode=OFF",
+        /* N.B. locking_mode=EXCLUSIVE must precede journal_mode=WAL
+         * so that sqlite does not need a shared memory wal-index.
+         */
+        if (sqlite3_exec (ctx->db, "PRAGMA locking_mode=EXCLUSIVE",
                                             NULL, NULL, NULL) != SQLITE_OK
-                || sqlite3_exec (ctx->db, "PRAGMA synchronous=OFF",
+                || sqlite3_exec (ctx->db, ctx->durable
+                                            ? "PRAGMA journal_mode=WAL"
+                                            : "PRAGMA journal_mode=OFF",
                                             NULL, NULL, NULL) != SQLITE_OK
-                || sqlite3_exec (ctx->db, "PRAGMA locking_mode=EXCLUSIVE",
+                || sqlite3_exec (ctx->db, ctx->durable
+                                            ? "PRAGMA synchronous=FULL"
+                                            : "PRAGMA synchronous=OFF",
                                             NULL, NULL, NULL) != SQLITE_OK) {
             saved_errno = EINVAL;
             log_sqlite_error (ctx, "setting sqlite pragmas");
@@ -200,6 +333,14 @@ static sqlite_ctx_t *getctx (flux_t *h)
             log_sqlite_error (ctx, "creating table");
             goto error;
         }
+        if (sqlite3_exec (ctx->db, sql_check_codec,
+                                            NULL, NULL, NULL) != SQLITE_OK
+                && sqlite3_exec (ctx->db, sql_add_codec,
+                                            NULL, NULL, NULL) != SQLITE_OK) {
+            saved_errno = EINVAL;
+            log_sqlite_error (ctx, "adding codec column");
+            goto error;
+        }
         if (sqlite3_prepare_v2 (ctx->db, sql_load, -1, &ctx->load_stmt,
                                             NULL) != SQLITE_OK) {
             saved_errno = EINVAL;
@@ -227,120 +368,244 @@ error:
     return NULL;
 }
 
-int grow_lzo_buf (sqlite_ctx_t *ctx, size_t size)
+/* Ensure the compression output buffer holds at least 'size' bytes.
+ */
+static int grow_zbuf (sqlite_ctx_t *ctx, size_t size)
 {
-    size_t newsize = ctx->lzo_bufsize;
     void *newbuf;
-    while (newsize < size)
-        newsize += lzo_buf_chunksize;
-    if (!(newbuf = realloc (ctx->lzo_buf, newsize))) {
+
+    if (ctx->zbufsize >= size)
+        return 0;
+    if (!(newbuf = realloc (ctx->zbuf, size))) {
         errno = ENOMEM;
         return -1;
     }
-    ctx->lzo_bufsize = newsize;
-    ctx->lzo_buf = newbuf;
+    ctx->zbufsize = size;
+    ctx->zbuf = newbuf;
     return 0;
 }
 
-void load_cb (flux_t *h, flux_msg_handler_t *mh,
-              const flux_msg_t *msg, void *arg)
+/* Commit the open transaction, if any, then send the held responses,
+ * or if the commit failed, an error response to each.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int txn_commit (sqlite_ctx_t *ctx)
+{
+    struct txn_response *r;
+    int errnum = 0;
+    int rc = 0;
+
+    if (!ctx->txn_open)
+        return 0;
+    flux_watcher_stop (ctx->txn_timer);
+    if (sqlite3_exec (ctx->db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        log_sqlite_error (ctx, "commit transaction");
+        set_errno_from_sqlite_error (ctx);
+        errnum = errno;
+        if (sqlite3_exec (ctx->db, "ROLLBACK", NULL, NULL, NULL) != SQLITE_OK)
+            log_sqlite_error (ctx, "rollback transaction");
+        rc = -1;
+    }
+    ctx->txn_open = false;
+    ctx->txn_count = 0;
+    while ((r = zlist_pop (ctx->txn_responses))) {
+        if (flux_respond_raw (ctx->h, r->msg, errnum,
+                              errnum ? NULL : r->data,
+                              errnum ? 0 : r->len) < 0)
+            flux_log_error (ctx->h, "store: flux_respond");
+        txn_response_destroy (r);
+    }
+    if (rc < 0)
+        errno = errnum;
+    return rc;
+}
+
+/* Roll back the open transaction, which has nothing staged in it.
+ */
+static void txn_rollback (sqlite_ctx_t *ctx)
+{
+    flux_watcher_stop (ctx->txn_timer);
+    if (sqlite3_exec (ctx->db, "ROLLBACK", NULL, NULL, NULL) != SQLITE_OK)
+        log_sqlite_error (ctx, "rollback transaction");
+    ctx->txn_open = false;
+    ctx->txn_count = 0;
+}
+
+/* Open a transaction for staging stores, if one is not already open,
+ * and a savepoint for the writes of one request, which must be ended
+ * with txn_end().
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int txn_begin (sqlite_ctx_t *ctx)
+{
+    if (!ctx->txn_open) {
+        if (sqlite3_exec (ctx->db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK) {
+            log_sqlite_error (ctx, "begin transaction");
+            set_errno_from_sqlite_error (ctx);
+            return -1;
+        }
+        ctx->txn_open = true;
+        flux_timer_watcher_reset (ctx->txn_timer, ctx->batch_timeout, 0.);
+        flux_watcher_start (ctx->txn_timer);
+    }
+    if (sqlite3_exec (ctx->db, "SAVEPOINT request", NULL, NULL, NULL)
+                                                            != SQLITE_OK) {
+        log_sqlite_error (ctx, "begin savepoint");
+        set_errno_from_sqlite_error (ctx);
+        if (zlist_size (ctx->txn_responses) == 0)
+            txn_rollback (ctx);
+        return -1;
+    }
+    return 0;
+}
+
+/* End the savepoint opened by txn_begin().  If the request failed, its
+ * writes are discarded, so they are not committed with the rest of the
+ * batch, and if nothing else is staged the transaction is rolled back
+ * rather than left open.
+ * Returns -1 with errno set if the writes of a successful request could
+ * not be kept, otherwise 0.
+ */
+static int txn_end (sqlite_ctx_t *ctx, bool success)
+{
+    int saved_errno = errno;
+
+    if (success) {
+        if (sqlite3_exec (ctx->db, "RELEASE request", NULL, NULL, NULL)
+                                                            == SQLITE_OK)
+            return 0;
+        log_sqlite_error (ctx, "release savepoint");
+        set_errno_from_sqlite_error (ctx);
+        saved_errno = errno;
+    }
+    if (zlist_size (ctx->txn_responses) == 0)
+        txn_rollback (ctx);
+    else if (sqlite3_exec (ctx->db, "ROLLBACK TO request", NULL, NULL, NULL)
+                                                            != SQLITE_OK
+            || sqlite3_exec (ctx->db, "RELEASE request", NULL, NULL, NULL)
+                                                            != SQLITE_OK)
+        log_sqlite_error (ctx, "rollback savepoint");
+    errno = saved_errno;
+    return success ? -1 : 0;
+}
+
+/* Hold response to 'msg' until the open transaction commits, which
+ * happens now if 'count' more staged blobs fill the batch.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int txn_stage (sqlite_ctx_t *ctx, const flux_msg_t *msg, int count,
+                      const void *data, int len)
+{
+    struct txn_response *r;
+
+    if (!(r = txn_response_create (msg, data, len)))
+        return -1;
+    if (zlist_append (ctx->txn_responses, r) < 0) {
+        txn_response_destroy (r);
+        errno = ENOMEM;
+        return -1;
+    }
+    ctx->txn_count += count;
+    if (ctx->txn_count >= ctx->batch_size)
+        (void)txn_commit (ctx); /* errors are delivered in responses */
+    return 0;
+}
+
+static void txn_timer_cb (flux_reactor_t *r, flux_watcher_t *w,
+                          int revents, void *arg)
 {
     sqlite_ctx_t *ctx = arg;
-    const char *blobref = "-";
-    int blobref_size;
-    uint8_t hash[BLOBREF_MAX_DIGEST_SIZE];
-    int hash_len;
-    const void *data = NULL;
-    int size = 0;
-    int uncompressed_size;
-    int rc = -1;
     int old_state;
     //delay cancellation to ensure lock-correctness in sqlite
     pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+    (void)txn_commit (ctx);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
+}
 
-    if (flux_request_decode_raw (msg, NULL, (const void **)&blobref,
-                                 &blobref_size) < 0) {
-        flux_log_error (h, "load: request decode failed");
-        goto done;
+/* Decode the current row of 'stmt', whose columns are object,size,codec.
+ * The stored object is returned in 'datap' and 'sizep', valid until 'stmt'
+ * is reset.  If it is compressed, its codec is returned in 'codecp' and its
+ * uncompressed size in 'usizep';  otherwise 'codecp' is set to NULL.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int row_decode (sqlite_ctx_t *ctx, sqlite3_stmt *stmt,
+                       const void **datap, int *sizep,
+                       const struct codec **codecp, int *usizep)
+{
+    const struct codec *codec = NULL;
+    int size;
+    int usize;
+
+    size = sqlite3_column_bytes (stmt, 0);
+    if (sqlite3_column_type (stmt, 0) != SQLITE_BLOB && size > 0) {
+        flux_log (ctx->h, LOG_ERR, "selected value is not a blob");
+        errno = EINVAL;
+        return -1;
     }
-    if (!blobref || blobref[blobref_size - 1] != '\0') {
-        errno = EPROTO;
-        flux_log_error (h, "load: malformed blobref");
-        goto done;
+    if (sqlite3_column_type (stmt, 1) != SQLITE_INTEGER) {
+        flux_log (ctx->h, LOG_ERR, "selected value is not an integer");
+        errno = EINVAL;
+        return -1;
     }
+    usize = sqlite3_column_int (stmt, 1);
+    if (usize != -1) {
+        int id = CODEC_LZO;
+        if (sqlite3_column_type (stmt, 2) != SQLITE_NULL)
+            id = sqlite3_column_int (stmt, 2);
+        if (!(codec = codec_lookup_id (id))) {
+            flux_log (ctx->h, LOG_ERR, "unsupported codec id %d", id);
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    *datap = sqlite3_column_blob (stmt, 0);
+    *sizep = size;
+    *codecp = codec;
+    *usizep = usize;
+    return 0;
+}
+
+/* Look up row for 'blobref' and decode it as described above.
+ * The caller must reset ctx->load_stmt when finished with the data.
+ * Returns 0 on success, -1 on failure with errno set (ENOENT if not found).
+ */
+static int load_row (sqlite_ctx_t *ctx, const char *blobref,
+                     const void **datap, int *sizep,
+                     const struct codec **codecp, int *usizep)
+{
+    uint8_t hash[BLOBREF_MAX_DIGEST_SIZE];
+    int hash_len;
+
     if ((hash_len = blobref_strtohash (blobref, hash, sizeof (hash))) < 0) {
         errno = ENOENT;
-        flux_log_error (h, "load: unexpected foreign blobref");
-        goto done;
+        flux_log_error (ctx->h, "load: unexpected foreign blobref");
+        return -1;
     }
     if (sqlite3_bind_text (ctx->load_stmt, 1, (char *)hash, hash_len,
-                                              SQLITE_STATIC) != SQLITE_OK) {
+                                              SQLITE_TRANSIENT) != SQLITE_OK) {
         log_sqlite_error (ctx, "load: binding key");
         set_errno_from_sqlite_error (ctx);
-        goto done;
+        return -1;
     }
     if (sqlite3_step (ctx->load_stmt) != SQLITE_ROW) {
         //log_sqlite_error (ctx, "load: executing stmt");
         errno = ENOENT;
-        goto done;
-    }
-    size = sqlite3_column_bytes (ctx->load_stmt, 0);
-    if (sqlite3_column_type (ctx->load_stmt, 0) != SQLITE_BLOB && size > 0) {
-        flux_log (h, LOG_ERR, "load: selected value is not a blob");
-        errno = EINVAL;
-        goto done;
-    }
-    data = sqlite3_column_blob (ctx->load_stmt, 0);
-    if (sqlite3_column_type (ctx->load_stmt, 1) != SQLITE_INTEGER) {
-        flux_log (h, LOG_ERR, "load: selected value is not an integer");
-        errno = EINVAL;
-        goto done;
-    }
-    uncompressed_size = sqlite3_column_int (ctx->load_stmt, 1);
-    if (uncompressed_size != -1) {
-        if (ctx->lzo_bufsize < uncompressed_size
-                                && grow_lzo_buf (ctx, uncompressed_size) < 0)
-            goto done;
-        lzo_uint out_len = ctx->lzo_bufsize;
-        int r = lzo1x_decompress (data, size, ctx->lzo_buf, &out_len, NULL);
-        if (r != LZO_E_OK) {
-            errno = EINVAL;
-            goto done;
-        }
-        if (out_len != uncompressed_size) {
-            flux_log (h, LOG_ERR, "load: blob size mismatch");
-            errno = EINVAL;
-            goto done;
-        }
-        data = ctx->lzo_buf;
-        size = uncompressed_size;
+        return -1;
     }
-    rc = 0;
-done:
-    if (flux_respond_raw (h, msg, rc < 0 ? errno : 0, data, size) < 0)
-        flux_log_error (h, "load: flux_respond");
-    (void )sqlite3_reset (ctx->load_stmt);
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
+    return row_decode (ctx, ctx->load_stmt, datap, sizep, codecp, usizep);
 }
 
-void store_cb (flux_t *h, flux_msg_handler_t *mh,
-               const flux_msg_t *msg, void *arg)
+/* Store blob, computing its blobref.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+static int store_blob (sqlite_ctx_t *ctx, const void *data, int size,
+                       blobref_t blobref)
 {
-    sqlite_ctx_t *ctx = arg;
-    const void *data;
-    int size, hash_len;
+    int hash_len;
     uint8_t hash[BLOBREF_MAX_DIGEST_SIZE];
-    blobref_t blobref = "-";
     int uncompressed_size = -1;
     int rc = -1;
-    int old_state;
-    //delay cancellation to ensure lock-correctness in sqlite
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
 
-    if (flux_request_decode_raw (msg, NULL, &data, &size) < 0) {
-        flux_log_error (h, "store: request decode failed");
-        goto done;
-    }
     if (size > ctx->blob_size_limit) {
         errno = EFBIG;
         goto done;
@@ -349,19 +614,19 @@ void store_cb (flux_t *h, flux_msg_handler_t *mh,
         goto done;
     if ((hash_len = blobref_strtohash (blobref, hash, sizeof (hash))) < 0)
         goto done;
-    if (size >= compression_threshold) {
-        int r;
-        lzo_uint out_len = size + size / 16 + 64 + 3;
-        if (ctx->lzo_bufsize < out_len && grow_lzo_buf (ctx, out_len) < 0)
+    if (size >= compression_threshold
+                            && codec_id (ctx->codec) != CODEC_NONE) {
+        int n;
+        if (grow_zbuf (ctx, codec_bound (ctx->codec, size)) < 0)
             goto done;
-        r = lzo1x_1_compress (data, size, ctx->lzo_buf, &out_len, lzo_wrkmem);
-        if (r != LZO_E_OK) {
-            errno = EINVAL;
+        if ((n = codec_compress (ctx->codec, data, size,
+                                 ctx->zbuf, ctx->zbufsize)) < 0)
             goto done;
+        if (n < size) { /* else store uncompressed */
+            uncompressed_size = size;
+            size = n;
+            data = ctx->zbuf;
         }
-        uncompressed_size = size;
-        size = out_len;
-        data = ctx->lzo_buf;
     }
     if (sqlite3_bind_text (ctx->store_stmt, 1, (char *)hash, hash_len,
                            SQLITE_STATIC) != SQLITE_OK) {
@@ -380,6 +645,14 @@ void store_cb (flux_t *h, flux_msg_handler_t *mh,
         set_errno_from_sqlite_error (ctx);
         goto done;
     }
+    if (sqlite3_bind_int (ctx->store_stmt, 4, uncompressed_size == -1
+                                              ? CODEC_NONE
+                                              : codec_id (ctx->codec))
+                                                            != SQLITE_OK) {
+        log_sqlite_error (ctx, "store: binding codec");
+        set_errno_from_sqlite_error (ctx);
+        goto done;
+    }
     if (sqlite3_step (ctx->store_stmt) != SQLITE_DONE
                     && sqlite3_errcode (ctx->db) != SQLITE_CONSTRAINT) {
         log_sqlite_error (ctx, "store: executing stmt");
@@ -388,10 +661,218 @@ void store_cb (flux_t *h, flux_msg_handler_t *mh,
     }
     rc = 0;
 done:
-    if (flux_respond_raw (h, msg, rc < 0 ? errno : 0,
-                                        blobref, strlen (blobref) + 1) < 0)
-        flux_log_error (h, "store: flux_respond");
     (void) sqlite3_reset (ctx->store_stmt);
+    return rc;
+}
+
+void load_cb (flux_t *h, flux_msg_handler_t *mh,
+              const flux_msg_t *msg, void *arg)
+{
+    sqlite_ctx_t *ctx = arg;
+    const char *blobref = "-";
+    int blobref_size;
+    const void *data = NULL;
+    int size = 0;
+    const struct codec *codec;
+    int usize;
+    void *ubuf = NULL;
+    int rc = -1;
+    int old_state;
+    //delay cancellation to ensure lock-correctness in sqlite
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+
+    if (flux_request_decode_raw (msg, NULL, (const void **)&blobref,
+                                 &blobref_size) < 0) {
+        flux_log_error (h, "load: request decode failed");
+        goto done;
+    }
+    if (!blobref || blobref[blobref_size - 1] != '\0') {
+        errno = EPROTO;
+        flux_log_error (h, "load: malformed blobref");
+        goto done;
+    }
+    if (load_row (ctx, blobref, &data, &size, &codec, &usize) < 0)
+        goto done;
+    if (codec) {
+        if (!(ubuf = malloc (usize))) {
+            errno = ENOMEM;
+            goto done;
+        }
+        if (codec_decompress (codec, data, size, ubuf, usize) < 0) {
+            flux_log (h, LOG_ERR, "load: %s decompress failed",
+                      codec_name (codec));
+            goto done;
+        }
+        data = ubuf;
+        size = usize;
+    }
+    rc = 0;
+done:
+    if (flux_respond_raw (h, msg, rc < 0 ? errno : 0, data, size) < 0)
+        flux_log_error (h, "load: flux_respond");
+    (void )sqlite3_reset (ctx->load_stmt);
+    free (ubuf);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
+}
+
+void store_cb (flux_t *h, flux_msg_handler_t *mh,
+               const flux_msg_t *msg, void *arg)
+{
+    sqlite_ctx_t *ctx = arg;
+    const void *data;
+    int size;
+    blobref_t blobref;
+    int old_state;
+    //delay cancellation to ensure lock-correctness in sqlite
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+
+    if (flux_request_decode_raw (msg, NULL, &data, &size) < 0) {
+        flux_log_error (h, "store: request decode failed");
+        goto error;
+    }
+    if (txn_begin (ctx) < 0)
+        goto error;
+    if (store_blob (ctx, data, size, blobref) < 0) {
+        txn_end (ctx, false);
+        goto error;
+    }
+    if (txn_end (ctx, true) < 0)
+        goto error;
+    if (txn_stage (ctx, msg, 1, blobref, strlen (blobref) + 1) < 0)
+        goto error;
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
+    return; /* response is sent when transaction commits */
+error:
+    if (flux_respond_raw (h, msg, errno, NULL, 0) < 0)
+        flux_log_error (h, "store: flux_respond");
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
+}
+
+/* Load a batch of blobs.  Blobs that are not found are returned as
+ * absent items in the response blobvec.  Compressed blobs are
+ * decompressed directly into the response buffer.
+ */
+void load_batch_cb (flux_t *h, flux_msg_handler_t *mh,
+                    const flux_msg_t *msg, void *arg)
+{
+    sqlite_ctx_t *ctx = arg;
+    blobvec_t *bv = NULL;
+    const void *buf;
+    int bufsize;
+    int offset = 0;
+    const char *blobref;
+    int blobref_size;
+    const void *data;
+    int size;
+    const struct codec *codec;
+    int usize;
+    void *out;
+    int n;
+    int rc = -1;
+    int old_state;
+    //delay cancellation to ensure lock-correctness in sqlite
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+
+    if (flux_request_decode_raw (msg, NULL, &buf, &bufsize) < 0) {
+        flux_log_error (h, "load-batch: request decode failed");
+        goto done;
+    }
+    if (!(bv = blobvec_create ()))
+        goto done;
+    while ((n = blobvec_next (buf, bufsize, &offset,
+                              (const void **)&blobref, &blobref_size)) > 0) {
+        if (blobref_size < 1 || blobref[blobref_size - 1] != '\0') {
+            errno = EPROTO;
+            flux_log_error (h, "load-batch: malformed blobref");
+            goto done;
+        }
+        if (load_row (ctx, blobref, &data, &size, &codec, &usize) < 0) {
+            if (errno != ENOENT)
+                goto done;
+            n = blobvec_append (bv, NULL, -1);
+        }
+        else if (!codec)
+            n = blobvec_append (bv, data, size);
+        else if (!(out = blobvec_append_space (bv, usize)))
+            n = -1;
+        else if ((n = codec_decompress (codec, data, size, out, usize)) < 0)
+            flux_log (h, LOG_ERR, "load-batch: %s decompress failed",
+                      codec_name (codec));
+        (void )sqlite3_reset (ctx->load_stmt);
+        if (n < 0)
+            goto done;
+    }
+    if (n < 0) {
+        flux_log_error (h, "load-batch: malformed request");
+        goto done;
+    }
+    rc = 0;
+done:
+    if (flux_respond_raw (h, msg, rc < 0 ? errno : 0,
+                          rc < 0 ? NULL : blobvec_data (bv),
+                          rc < 0 ? 0 : blobvec_size (bv)) < 0)
+        flux_log_error (h, "load-batch: flux_respond");
+    (void )sqlite3_reset (ctx->load_stmt);
+    blobvec_destroy (bv);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
+}
+
+/* Store a batch of blobs.  The blobs are staged in the open transaction
+ * like individual stores, so a batch is committed (and the database synced)
+ * at most once rather than once per blob.
+ */
+void store_batch_cb (flux_t *h, flux_msg_handler_t *mh,
+                     const flux_msg_t *msg, void *arg)
+{
+    sqlite_ctx_t *ctx = arg;
+    blobvec_t *bv = NULL;
+    const void *buf;
+    int bufsize;
+    int offset = 0;
+    const void *data;
+    int size;
+    blobref_t blobref;
+    int n;
+    int old_state;
+    //delay cancellation to ensure lock-correctness in sqlite
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+
+    if (flux_request_decode_raw (msg, NULL, &buf, &bufsize) < 0) {
+        flux_log_error (h, "store-batch: request decode failed");
+        goto error;
+    }
+    if (!(bv = blobvec_create ()))
+        goto error;
+    if (txn_begin (ctx) < 0)
+        goto error;
+    while ((n = blobvec_next (buf, bufsize, &offset, &data, &size)) > 0) {
+        if (size < 0) {
+            errno = EPROTO;
+            goto error_rollback;
+        }
+        if (store_blob (ctx, data, size, blobref) < 0)
+            goto error_rollback;
+        if (blobvec_append (bv, blobref, strlen (blobref) + 1) < 0)
+            goto error_rollback;
+    }
+    if (n < 0) {
+        flux_log_error (h, "store-batch: malformed request");
+        goto error_rollback;
+    }
+    if (txn_end (ctx, true) < 0)
+        goto error;
+    if (txn_stage (ctx, msg, blobvec_count (bv),
+                   blobvec_data (bv), blobvec_size (bv)) < 0)
+        goto error;
+    blobvec_destroy (bv);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
+    return; /* response is sent when transaction commits */
+error_rollback:
+    txn_end (ctx, false);
+error:
+    if (flux_respond_raw (h, msg, errno, NULL, 0) < 0)
+        flux_log_error (h, "store-batch: flux_respond");
+    blobvec_destroy (bv);
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
 }
 
@@ -436,10 +917,16 @@ void shutdown_cb (flux_t *h, flux_msg_handler_t *mh,
 {
     sqlite_ctx_t *ctx = arg;
     flux_future_t *f;
+    void *ubuf = NULL;
     int count = 0;
     int old_state;
 
     flux_log (h, LOG_DEBUG, "shutdown: begin");
+    //delay cancellation to ensure lock-correctness in sqlite
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+    if (txn_commit (ctx) < 0)
+        flux_log_error (h, "shutdown: committing staged stores");
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
     if (register_backing_store (h, false, "content-sqlite") < 0) {
         flux_log_error (h, "shutdown: unregistering backing store");
         goto done;
@@ -454,37 +941,29 @@ void shutdown_cb (flux_t *h, flux_msg_handler_t *mh,
         const char *blobref;
         int blobref_size;
         const void *data = NULL;
-        int uncompressed_size;
-        int size = sqlite3_column_bytes (ctx->dump_stmt, 0);
-        if (sqlite3_column_type (ctx->dump_stmt, 0) != SQLITE_BLOB
-                                                            && size > 0) {
-            flux_log (h, LOG_ERR, "shutdown: encountered non-blob value");
+        int size;
+        const struct codec *codec;
+        int usize;
+        free (ubuf);
+        ubuf = NULL;
+        if (row_decode (ctx, ctx->dump_stmt, &data, &size,
+                                                &codec, &usize) < 0) {
+            flux_log_error (h, "shutdown: decoding row");
             continue;
         }
-        data = sqlite3_column_blob (ctx->dump_stmt, 0);
-        if (sqlite3_column_type (ctx->dump_stmt, 1) != SQLITE_INTEGER) {
-            flux_log (h, LOG_ERR, "shutdown: selected value is not an integer");
-            errno = EINVAL;
-            goto done;
-        }
-        uncompressed_size = sqlite3_column_int (ctx->dump_stmt, 1);
-        if (uncompressed_size != -1) {
-            if (ctx->lzo_bufsize < uncompressed_size
-                            && grow_lzo_buf (ctx, uncompressed_size) < 0)
-                goto done;
-            lzo_uint out_len = ctx->lzo_bufsize;
-            int r = lzo1x_decompress (data, size, ctx->lzo_buf, &out_len, NULL);
-            if (r != LZO_E_OK) {
-                errno = EINVAL;
+        if (codec) {
+            if (!(ubuf = malloc (usize))) {
+                errno = ENOMEM;
+                flux_log_error (h, "shutdown");
                 goto done;
             }
-            if (out_len != uncompressed_size) {
-                flux_log (h, LOG_ERR, "shutdown: blob size mismatch");
-                errno = EINVAL;
-                goto done;
+            if (codec_decompress (codec, data, size, ubuf, usize) < 0) {
+                flux_log (h, LOG_ERR, "shutdown: %s decompress failed",
+                          codec_name (codec));
+                continue;
             }
-            data = ctx->lzo_buf;
-            size = uncompressed_size;
+            data = ubuf;
+            size = usize;
         }
         if (!(f = flux_rpc_raw (h, "content.store", data, size,
                                                         FLUX_NODEID_ANY, 0))) {
@@ -507,6 +986,7 @@ void shutdown_cb (flux_t *h, flux_msg_handler_t *mh,
     (void )sqlite3_reset (ctx->dump_stmt);
     flux_log (h, LOG_DEBUG, "shutdown: %d entries returned to cache", count);
 done:
+    free (ubuf);
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
     flux_reactor_stop (flux_get_reactor (h));
 }
@@ -514,6 +994,8 @@ done:
 static const struct flux_msg_handler_spec htab[] = {
     { FLUX_MSGTYPE_REQUEST, "content-backing.load",    load_cb, 0 },
     { FLUX_MSGTYPE_REQUEST, "content-backing.store",   store_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "content-backing.load-batch", load_batch_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "content-backing.store-batch", store_batch_cb, 0 },
     { FLUX_MSGTYPE_REQUEST, "content-sqlite.shutdown", shutdown_cb, 0, },
     { FLUX_MSGTYPE_EVENT,   "shutdown",                broker_shutdown_cb, 0 },
     FLUX_MSGHANDLER_TABLE_END,
@@ -522,14 +1004,14 @@ static const struct flux_msg_handler_spec htab[] = {
 int mod_main (flux_t *h, int argc, char **argv)
 {
     flux_msg_handler_t **handlers = NULL;
-    int lzo_rc = lzo_init ();
-    sqlite_ctx_t *ctx = getctx (h);
-    if (!ctx)
-        goto done;
-    if (lzo_rc != LZO_E_OK) {
-        flux_log (h, LOG_ERR, "lzo_init failed (rc=%d)", lzo_rc);
+    sqlite_ctx_t *ctx = NULL;
+
+    if (codec_init () < 0) {
+        flux_log (h, LOG_ERR, "codec_init failed");
         goto done;
     }
+    if (!(ctx = getctx (h, argc, argv)))
+        goto done;
     if (flux_event_subscribe (h, "shutdown") < 0) {
         flux_log_error (h, "flux_event_subscribe");
         goto done;
@@ -547,6 +1029,8 @@ int mod_main (flux_t *h, int argc, char **argv)
         goto done;
     }
 done:
+    if (ctx)
+        (void)txn_commit (ctx);
     flux_msg_handler_delvec (handlers);
     return 0;
 }
@@ -0,0 +1,85 @@
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "src/modules/content-sqlite/codec.h"
+#include "src/common/libtap/tap.h"
+
+/* Compressible input: repeated text with some variation.
+ */
+static void fill (char *buf, int len)
+{
+    int i;
+    for (i = 0; i < len; i++)
+        buf[i] = "flux-core content "[i % 18] + (i / 4096) % 3;
+}
+
+static void check_roundtrip (const struct codec *c, const char *in, int len)
+{
+    const char *name = codec_name (c);
+    int bound = codec_bound (c, len);
+    char *out = malloc (bound);
+    char *back = malloc (len > 0 ? len : 1);
+    int n;
+
+    if (!out || !back)
+        BAIL_OUT ("out of memory");
+    n = codec_compress (c, in, len, out, bound);
+    ok (n >= 0 && n <= bound,
+        "%s: compressed %d bytes to %d", name, len, n);
+    ok (codec_decompress (c, out, n, back, len) == 0
+        && memcmp (in, back, len) == 0,
+        "%s: decompressed %d bytes correctly", name, len);
+    if (len > 1) {
+        errno = 0;
+        ok (codec_decompress (c, out, n, back, len - 1) < 0 && errno == EINVAL,
+            "%s: decompress with wrong length fails with EINVAL", name);
+    }
+    free (out);
+    free (back);
+}
+
+int main (int argc, char *argv[])
+{
+    const char *names[] = { "none", "lzo", "lz4", "zstd", NULL };
+    const struct codec *c;
+    int sizes[] = { 1, 256, 4096, 1024*1024 };
+    char *buf;
+    int i, j;
+
+    plan (NO_PLAN);
+
+    ok (codec_init () == 0,
+        "codec_init works");
+    ok (codec_lookup ("nonexistent") == NULL,
+        "codec_lookup of unknown codec returns NULL");
+    ok (codec_lookup_id (99) == NULL,
+        "codec_lookup_id of unknown id returns NULL");
+    ok ((c = codec_lookup ("lzo")) != NULL && codec_id (c) == CODEC_LZO,
+        "lzo codec is always available with id CODEC_LZO");
+    ok ((c = codec_lookup ("none")) != NULL && codec_id (c) == CODEC_NONE,
+        "none codec is always available with id CODEC_NONE");
+    diag ("available codecs: %s", codec_list ());
+
+    if (!(buf = malloc (1024*1024)))
+        BAIL_OUT ("out of memory");
+    fill (buf, 1024*1024);
+    for (i = 0; names[i] != NULL; i++) {
+        if (!(c = codec_lookup (names[i]))) {
+            diag ("%s: not built in", names[i]);
+            continue;
+        }
+        ok (codec_lookup_id (codec_id (c)) == c,
+            "%s: codec_lookup_id finds codec by id", names[i]);
+        for (j = 0; j < sizeof (sizes) / sizeof (sizes[0]); j++)
+            check_roundtrip (c, buf, sizes[j]);
+    }
+    free (buf);
+
+    done_testing ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
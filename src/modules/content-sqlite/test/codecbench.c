@@ -0,0 +1,228 @@
+/* codecbench.c - compare content-sqlite codecs on real blobs
+ *
+ * Usage: codecbench [--db FILE] [--iterations N] [FILE...]
+ *
+ * Blobs are read from a content-sqlite database (e.g. the "content/sqlite"
+ * file under an instance's persist-directory), and/or from files given on
+ * the command line, one blob per file.  Each available codec compresses
+ * and decompresses every blob, and the overall compression ratio and
+ * throughput are reported.  Blobs smaller than the content-sqlite
+ * compression threshold are skipped, since they are stored uncompressed.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sqlite3.h>
+
+#include "src/common/libutil/read_all.h"
+#include "src/common/libutil/monotime.h"
+#include "src/common/libutil/log.h"
+#include "src/modules/content-sqlite/codec.h"
+
+static const int compression_threshold = 256;
+
+#define OPTIONS "hd:i:"
+static const struct option longopts[] = {
+    {"help",            no_argument,        0, 'h'},
+    {"db",              required_argument,  0, 'd'},
+    {"iterations",      required_argument,  0, 'i'},
+    { 0, 0, 0, 0 },
+};
+
+struct blob {
+    void *data;
+    int len;
+};
+
+static struct blob *blobs;
+static int blobs_count;
+static int blobs_alloc;
+
+void usage (void)
+{
+    fprintf (stderr,
+"Usage: codecbench [--db FILE] [--iterations N] [FILE...]\n"
+);
+    exit (1);
+}
+
+static void add_blob (void *data, int len)
+{
+    if (len < compression_threshold) {
+        free (data);
+        return;
+    }
+    if (blobs_count == blobs_alloc) {
+        blobs_alloc = blobs_alloc ? blobs_alloc * 2 : 1024;
+        if (!(blobs = realloc (blobs, blobs_alloc * sizeof (blobs[0]))))
+            log_msg_exit ("out of memory");
+    }
+    blobs[blobs_count].data = data;
+    blobs[blobs_count].len = len;
+    blobs_count++;
+}
+
+static void read_file (const char *path)
+{
+    int fd;
+    void *data;
+    ssize_t len;
+
+    if ((fd = open (path, O_RDONLY)) < 0)
+        log_err_exit ("%s", path);
+    if ((len = read_all (fd, &data)) < 0)
+        log_err_exit ("%s", path);
+    close (fd);
+    add_blob (data, len);
+}
+
+/* Read all objects from a content-sqlite database, decompressing
+ * them with the codec recorded in each row.
+ */
+static void read_db (const char *path)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT object,size,codec FROM objects";
+
+    if (sqlite3_open_v2 (path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+        log_msg_exit ("%s: %s", path, sqlite3_errmsg (db));
+    if (sqlite3_prepare_v2 (db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        sql = "SELECT object,size,NULL FROM objects"; /* no codec column */
+        if (sqlite3_prepare_v2 (db, sql, -1, &stmt, NULL) != SQLITE_OK)
+            log_msg_exit ("%s: %s", path, sqlite3_errmsg (db));
+    }
+    while (sqlite3_step (stmt) == SQLITE_ROW) {
+        const void *obj = sqlite3_column_blob (stmt, 0);
+        int len = sqlite3_column_bytes (stmt, 0);
+        int usize = sqlite3_column_int (stmt, 1);
+        int id = CODEC_LZO;
+        const struct codec *c;
+        void *data;
+
+        if (usize == -1) {
+            if (!(data = malloc (len > 0 ? len : 1)))
+                log_msg_exit ("out of memory");
+            memcpy (data, obj, len);
+            add_blob (data, len);
+            continue;
+        }
+        if (sqlite3_column_type (stmt, 2) != SQLITE_NULL)
+            id = sqlite3_column_int (stmt, 2);
+        if (!(c = codec_lookup_id (id)))
+            log_msg_exit ("%s: unsupported codec id %d", path, id);
+        if (!(data = malloc (usize)))
+            log_msg_exit ("out of memory");
+        if (codec_decompress (c, obj, len, data, usize) < 0)
+            log_err_exit ("%s: %s decompress", path, codec_name (c));
+        add_blob (data, usize);
+    }
+    sqlite3_finalize (stmt);
+    sqlite3_close (db);
+}
+
+static void bench (const struct codec *c, int iterations)
+{
+    struct timespec t0;
+    double compress_ms = 0;
+    double decompress_ms = 0;
+    double in_bytes = 0;
+    double out_bytes = 0;
+    void *out = NULL;
+    void *back = NULL;
+    int outsize = 0;
+    int maxlen = 0;
+    int i, j, n;
+
+    for (i = 0; i < blobs_count; i++) {
+        if (maxlen < blobs[i].len)
+            maxlen = blobs[i].len;
+    }
+    outsize = codec_bound (c, maxlen);
+    if (!(out = malloc (outsize)) || !(back = malloc (maxlen)))
+        log_msg_exit ("out of memory");
+    for (j = 0; j < iterations; j++) {
+        for (i = 0; i < blobs_count; i++) {
+            monotime (&t0);
+            n = codec_compress (c, blobs[i].data, blobs[i].len, out, outsize);
+            compress_ms += monotime_since (t0);
+            if (n < 0)
+                log_err_exit ("%s compress", codec_name (c));
+            monotime (&t0);
+            if (codec_decompress (c, out, n, back, blobs[i].len) < 0)
+                log_err_exit ("%s decompress", codec_name (c));
+            decompress_ms += monotime_since (t0);
+            if (memcmp (back, blobs[i].data, blobs[i].len) != 0)
+                log_msg_exit ("%s: round trip mismatch", codec_name (c));
+            in_bytes += blobs[i].len;
+            out_bytes += n;
+        }
+    }
+    printf ("%-6s %14.0f %14.0f %7.2f %12.1f %12.1f\n",
+            codec_name (c), in_bytes / iterations, out_bytes / iterations,
+            out_bytes > 0 ? in_bytes / out_bytes : 0,
+            compress_ms > 0 ? in_bytes / (compress_ms * 1000) : 0,
+            decompress_ms > 0 ? in_bytes / (decompress_ms * 1000) : 0);
+    free (out);
+    free (back);
+}
+
+int main (int argc, char *argv[])
+{
+    const char *names[] = { "none", "lzo", "lz4", "zstd", NULL };
+    const struct codec *c;
+    int iterations = 3;
+    int ch;
+    int i;
+
+    log_init ("codecbench");
+
+    while ((ch = getopt_long (argc, argv, OPTIONS, longopts, NULL)) != -1) {
+        switch (ch) {
+            case 'h': /* --help */
+                usage ();
+                break;
+            case 'd': /* --db FILE */
+                read_db (optarg);
+                break;
+            case 'i': /* --iterations N */
+                iterations = strtoul (optarg, NULL, 10);
+                break;
+            default:
+                usage ();
+                break;
+        }
+    }
+    if (codec_init () < 0)
+        log_msg_exit ("codec_init failed");
+    for (i = optind; i < argc; i++)
+        read_file (argv[i]);
+    if (blobs_count == 0 || iterations < 1)
+        usage ();
+
+    printf ("%d blobs, %d iterations\n", blobs_count, iterations);
+    printf ("%-6s %14s %14s %7s %12s %12s\n",
+            "codec", "in(bytes)", "out(bytes)", "ratio",
+            "comp(MB/s)", "decomp(MB/s)");
+    for (i = 0; names[i] != NULL; i++) {
+        if ((c = codec_lookup (names[i])))
+            bench (c, iterations);
+    }
+
+    for (i = 0; i < blobs_count; i++)
+        free (blobs[i].data);
+    free (blobs);
+    log_fini ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
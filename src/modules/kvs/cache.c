@@ -56,17 +56,68 @@ struct cache_entry {
     void *data;             /* value raw data */
     int len;
     json_t *o;              /* value treeobj object */
+    size_t o_size;          /* estimated memory used by 'o' */
     int lastuse_epoch;      /* time of last use for cache expiry */
     bool valid;             /* flag indicating if raw data or treeobj
                              * set, don't use data == NULL as test, as
                              * zero length data can be valid */
     bool dirty;
+    struct cache *cache;    /* set once inserted */
+    char *ref;              /* set once inserted */
+    struct cache_entry *lru_prev;   /* more recently used */
+    struct cache_entry *lru_next;   /* less recently used */
 };
 
+/* The lock protects the hash, the LRU list, and the data of inserted
+ * entries against concurrent use by commit worker threads.  Entry
+ * waitqueues and dirty bits are only touched by the module thread.
+ *
+ * Entries are kept on a list in order of last use, most recent first,
+ * so that expiry and trimming can start from the least recently used
+ * end and stop as soon as they reach an entry that is too young.
+ */
 struct cache {
     zhash_t *zh;
+    pthread_mutex_t lock;
+    struct cache_entry *lru_head;
+    struct cache_entry *lru_tail;
+    int epoch;              /* most recent epoch passed to cache_lookup() */
+    size_t raw_bytes;       /* raw data of inserted entries */
+    size_t treeobj_bytes;   /* estimated size of decoded treeobjs */
+    size_t max_bytes;       /* 0 = unlimited */
 };
 
+/* Estimate the memory used by a decoded json object.  The constants
+ * roughly account for jansson's per-value and per-member allocations.
+ */
+static size_t json_size_estimate (const json_t *o)
+{
+    const char *key;
+    json_t *value;
+    size_t index;
+    size_t size;
+
+    switch (json_typeof (o)) {
+        case JSON_OBJECT:
+            size = 64;
+            json_object_foreach ((json_t *)o, key, value)
+                size += 48 + strlen (key) + json_size_estimate (value);
+            break;
+        case JSON_ARRAY:
+            size = 48;
+            json_array_foreach (o, index, value)
+                size += sizeof (json_t *) + json_size_estimate (value);
+            break;
+        case JSON_STRING:
+            size = 32 + json_string_length (o);
+            break;
+        default:
+            size = 24;
+            break;
+    }
+    return size;
+}
+
 struct cache_entry *cache_entry_create (void)
 {
     struct cache_entry *entry;
@@ -172,31 +223,59 @@ int cache_entry_set_raw (struct cache_entry *entry, const void *data, int len)
             return -1;
         memcpy (cpy, data, len);
     }
+    if (entry->cache) {
+        cache_lock (entry->cache);
+        entry->cache->raw_bytes += len;
+    }
     entry->data = cpy;
     entry->len = len;
     entry->valid = true;
+    if (entry->cache)
+        cache_unlock (entry->cache);
     if (entry->waitlist_valid) {
         if (wait_runqueue (entry->waitlist_valid) < 0)
             goto reset_invalid;
     }
     return 0;
 reset_invalid:
+    if (entry->cache) {
+        cache_lock (entry->cache);
+        entry->cache->raw_bytes -= entry->len;
+    }
     free (entry->data);
     entry->data = NULL;
     entry->len = 0;
     entry->valid = false;
+    if (entry->cache)
+        cache_unlock (entry->cache);
     return -1;
 }
 
 const json_t *cache_entry_get_treeobj (struct cache_entry *entry)
 {
-    if (!entry || !entry->valid || !entry->data)
+    const json_t *o = NULL;
+
+    if (!entry)
         return NULL;
+    /* Workpool threads may set or reset 'valid' and 'data', so check
+     * them under the lock.
+     */
+    if (entry->cache)
+        cache_lock (entry->cache);
+    if (!entry->valid || !entry->data)
+        goto done;
     if (!entry->o) {
-        if (!(entry->o = treeobj_decodeb (entry->data, entry->len)))
-            return NULL;
+        if ((entry->o = treeobj_decodeb (entry->data, entry->len))) {
+            entry->o_size = json_size_estimate (entry->o);
+            if (entry->cache)
+                entry->cache->treeobj_bytes += entry->o_size;
+        }
     }
-    return entry->o;
+    o = entry->o;
+done:
+    if (entry->cache)
+        cache_unlock (entry->cache);
+    return o;
 }
 
 void cache_entry_destroy (void *arg)
@@ -205,6 +284,7 @@ void cache_entry_destroy (void *arg)
     if (entry) {
         free (entry->data);
         json_decref (entry->o);
+        free (entry->ref);
         if (entry->waitlist_notdirty)
             wait_queue_destroy (entry->waitlist_notdirty);
         if (entry->waitlist_valid)
@@ -239,42 +319,131 @@ int cache_entry_wait_valid (struct cache_entry *entry, wait_t *wait)
     return 0;
 }
 
+void cache_lock (struct cache *cache)
+{
+    int e = pthread_mutex_lock (&cache->lock);
+    assert (e == 0);
+}
+
+void cache_unlock (struct cache *cache)
+{
+    int e = pthread_mutex_unlock (&cache->lock);
+    assert (e == 0);
+}
+
+static void lru_unlink (struct cache *cache, struct cache_entry *entry)
+{
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        cache->lru_head = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        cache->lru_tail = entry->lru_prev;
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push (struct cache *cache, struct cache_entry *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head)
+        cache->lru_head->lru_prev = entry;
+    else
+        cache->lru_tail = entry;
+    cache->lru_head = entry;
+}
+
+static bool cache_entry_has_waiters (struct cache_entry *entry)
+{
+    return ((entry->waitlist_notdirty
+             && wait_queue_length (entry->waitlist_notdirty))
+            || (entry->waitlist_valid
+                && wait_queue_length (entry->waitlist_valid)));
+}
+
+/* Unlink 'entry' and remove it from the hash, which destroys it.
+ * Call with the lock held.
+ */
+static void cache_delete (struct cache *cache, struct cache_entry *entry)
+{
+    char *ref = entry->ref;
+
+    lru_unlink (cache, entry);
+    cache->raw_bytes -= entry->len;
+    cache->treeobj_bytes -= entry->o_size;
+    entry->ref = NULL;
+    zhash_delete (cache->zh, ref);
+    free (ref);
+}
+
 struct cache_entry *cache_lookup (struct cache *cache, const char *ref,
                                   int current_epoch)
 {
-    struct cache_entry *entry = zhash_lookup (cache->zh, ref);
-    if (entry && current_epoch > entry->lastuse_epoch)
-        entry->lastuse_epoch = current_epoch;
+    struct cache_entry *entry;
+
+    cache_lock (cache);
+    if (current_epoch > cache->epoch)
+        cache->epoch = current_epoch;
+    entry = zhash_lookup (cache->zh, ref);
+    if (entry) {
+        if (current_epoch > entry->lastuse_epoch)
+            entry->lastuse_epoch = current_epoch;
+        if (cache->lru_head != entry) {
+            lru_unlink (cache, entry);
+            lru_push (cache, entry);
+        }
+    }
+    cache_unlock (cache);
     return entry;
 }
 
 void cache_insert (struct cache *cache, const char *ref,
                    struct cache_entry *entry)
 {
-    int rc = zhash_insert (cache->zh, ref, entry);
+    int rc;
+
+    cache_lock (cache);
+    rc = zhash_insert (cache->zh, ref, entry);
     assert (rc == 0);
     zhash_freefn (cache->zh, ref, cache_entry_destroy);
+    entry->ref = strdup (ref);
+    assert (entry->ref != NULL);
+    entry->cache = cache;
+    entry->lastuse_epoch = cache->epoch;
+    lru_push (cache, entry);
+    if (entry->valid)
+        cache->raw_bytes += entry->len;
+    cache->treeobj_bytes += entry->o_size;
+    cache_unlock (cache);
 }
 
 int cache_remove_entry (struct cache *cache, const char *ref)
 {
-    struct cache_entry *entry = zhash_lookup (cache->zh, ref);
+    struct cache_entry *entry;
+    int rc = 0;
 
+    cache_lock (cache);
+    entry = zhash_lookup (cache->zh, ref);
     if (entry
         && !entry->dirty
-        && (!entry->waitlist_notdirty
-            || !wait_queue_length (entry->waitlist_notdirty))
-        && (!entry->waitlist_valid
-            || !wait_queue_length (entry->waitlist_valid))) {
-        zhash_delete (cache->zh, ref);
-        return 1;
+        && !cache_entry_has_waiters (entry)) {
+        cache_delete (cache, entry);
+        rc = 1;
     }
-    return 0;
+    cache_unlock (cache);
+    return rc;
 }
 
 int cache_count_entries (struct cache *cache)
 {
-    return zhash_size (cache->zh);
+    int count;
+
+    cache_lock (cache);
+    count = zhash_size (cache->zh);
+    cache_unlock (cache);
+    return count;
 }
 
 static int cache_entry_age (struct cache_entry *entry, int current_epoch)
@@ -288,30 +457,88 @@ static int cache_entry_age (struct cache_entry *entry, int current_epoch)
 
 int cache_expire_entries (struct cache *cache, int current_epoch, int thresh)
 {
-    zlist_t *keys;
-    char *ref;
-    struct cache_entry *entry;
+    struct cache_entry *entry, *prev;
     int count = 0;
 
-    if (!(keys = zhash_keys (cache->zh))) {
-        errno = ENOMEM;
-        return -1;
+    cache_lock (cache);
+    entry = cache->lru_tail;
+    while (entry) {
+        prev = entry->lru_prev;
+        if (thresh > 0 && cache_entry_age (entry, current_epoch) <= thresh)
+            break; /* remaining entries were used more recently */
+        if (!cache_entry_get_dirty (entry)
+            && cache_entry_get_valid (entry)) {
+            cache_delete (cache, entry);
+            count++;
+        }
+        entry = prev;
     }
-    while ((ref = zlist_pop (keys))) {
-        if ((entry = zhash_lookup (cache->zh, ref))
-            && !cache_entry_get_dirty (entry)
-            && cache_entry_get_valid (entry)
-            && (thresh == 0
-                || cache_entry_age (entry, current_epoch) > thresh)) {
-                zhash_delete (cache->zh, ref);
-                count++;
+    cache_unlock (cache);
+    return count;
+}
+
+void cache_set_max_bytes (struct cache *cache, size_t max_bytes)
+{
+    cache_lock (cache);
+    cache->max_bytes = max_bytes;
+    cache_unlock (cache);
+}
+
+static bool cache_over_budget (struct cache *cache)
+{
+    return (cache->max_bytes > 0
+            && cache->raw_bytes + cache->treeobj_bytes > cache->max_bytes);
+}
+
+int cache_trim (struct cache *cache, int current_epoch, int thresh)
+{
+    struct cache_entry *entry, *prev;
+    int count = 0;
+
+    cache_lock (cache);
+    /* Decoded treeobjs are recreated from raw data on demand,
+     * so give those up first.
+     */
+    entry = cache->lru_tail;
+    while (entry && cache_over_budget (cache)
+           && cache_entry_age (entry, current_epoch) > thresh) {
+        if (entry->o && entry->data && !entry->dirty) {
+            cache->treeobj_bytes -= entry->o_size;
+            json_decref (entry->o);
+            entry->o = NULL;
+            entry->o_size = 0;
         }
-        free (ref);
+        entry = entry->lru_prev;
     }
-    zlist_destroy (&keys);
+    entry = cache->lru_tail;
+    while (entry && cache_over_budget (cache)
+           && cache_entry_age (entry, current_epoch) > thresh) {
+        prev = entry->lru_prev;
+        if (entry->valid
+            && !entry->dirty
+            && !cache_entry_has_waiters (entry)) {
+            cache_delete (cache, entry);
+            count++;
+        }
+        entry = prev;
+    }
+    cache_unlock (cache);
     return count;
 }
 
+void cache_get_bytes (struct cache *cache, size_t *raw_bytes,
+                      size_t *treeobj_bytes, size_t *max_bytes)
+{
+    cache_lock (cache);
+    if (raw_bytes)
+        *raw_bytes = cache->raw_bytes;
+    if (treeobj_bytes)
+        *treeobj_bytes = cache->treeobj_bytes;
+    if (max_bytes)
+        *max_bytes = cache->max_bytes;
+    cache_unlock (cache);
+}
+
 int cache_get_stats (struct cache *cache, tstat_t *ts, int *sizep,
                      int *incompletep, int *dirtyp)
 {
@@ -324,6 +551,7 @@ int cache_get_stats (struct cache *cache, tstat_t *ts, int *sizep,
     int saved_errno;
     int rc = -1;
 
+    cache_lock (cache);
     if (!(keys = zhash_keys (cache->zh))) {
         saved_errno = ENOMEM;
         goto cleanup;
@@ -352,6 +580,7 @@ int cache_get_stats (struct cache *cache, tstat_t *ts, int *sizep,
         *dirtyp = dirty;
     rc = 0;
 cleanup:
+    cache_unlock (cache);
     zlist_destroy (&keys);
     if (rc < 0)
         errno = saved_errno;
@@ -365,6 +594,7 @@ int cache_wait_destroy_msg (struct cache *cache, wait_test_msg_f cb, void *arg)
     int n, count = 0;
     int rc = -1;
 
+    cache_lock (cache);
     FOREACH_ZHASH (cache->zh, key, entry) {
         if (entry->waitlist_valid) {
             if ((n = wait_destroy_msg (entry->waitlist_valid, cb, arg)) < 0)
@@ -379,12 +609,15 @@ int cache_wait_destroy_msg (struct cache *cache, wait_test_msg_f cb, void *arg)
     }
     rc = count;
 done:
+    cache_unlock (cache);
     return rc;
 }
 
 struct cache *cache_create (void)
 {
     struct cache *cache = calloc (1, sizeof (*cache));
+    pthread_mutexattr_t attr;
+
     if (!cache) {
         errno = ENOMEM;
         return NULL;
@@ -394,6 +627,13 @@ struct cache *cache_create (void)
         errno = ENOMEM;
         return NULL;
     }
+    /* Recursive, so a thread holding the lock across several cache
+     * calls (see cache_lock()) may still call them.
+     */
+    pthread_mutexattr_init (&attr);
+    pthread_mutexattr_settype (&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init (&cache->lock, &attr);
+    pthread_mutexattr_destroy (&attr);
     return cache;
 }
 
@@ -401,6 +641,7 @@ void cache_destroy (struct cache *cache)
 {
     if (cache) {
         zhash_destroy (&cache->zh);
+        pthread_mutex_destroy (&cache->lock);
         free (cache);
     }
 }
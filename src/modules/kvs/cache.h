@@ -88,9 +88,21 @@ int cache_entry_wait_valid (struct cache_entry *entry, wait_t *wait);
 struct cache *cache_create (void);
 void cache_destroy (struct cache *cache);
 
+/* Serialize access to the cache with other threads.
+ * All cache functions take the lock internally, except for the entry
+ * waitqueue and dirty bit accessors, which must only be called from the
+ * module thread.  A thread that keeps using an entry, or data returned
+ * by cache_entry_get_treeobj(), after a lookup must hold the lock for as
+ * long as it does so, since the module thread may expire the entry.
+ * The lock is recursive.
+ */
+void cache_lock (struct cache *cache);
+void cache_unlock (struct cache *cache);
+
 /* Look up a cache entry.
  * Update the entry's "last used" time to 'current_epoch',
- * taking care not to not run backwards.
+ * taking care not to not run backwards, and make it the most
+ * recently used entry.
  */
 struct cache_entry *cache_lookup (struct cache *cache,
                                   const char *ref, int current_epoch);
@@ -112,11 +124,34 @@ int cache_remove_entry (struct cache *cache, const char *ref);
 int cache_count_entries (struct cache *cache);
 
 /* Expire cache entries that are not dirty, not incomplete, and last
- * used more than 'thresh' epoch's ago.
+ * used more than 'thresh' epoch's ago.  If 'thresh' is 0, expire all
+ * such entries.  Only the entries older than 'thresh' are visited.
  * Returns -1 on error, expired count on success.
  */
 int cache_expire_entries (struct cache *cache, int current_epoch, int thresh);
 
+/* Set the cache's memory budget in bytes, counting raw data and the
+ * estimated size of decoded treeobjs.  0 (the default) means unlimited.
+ */
+void cache_set_max_bytes (struct cache *cache, size_t max_bytes);
+
+/* If the cache is over its memory budget, shrink it starting from the
+ * least recently used entry:  first drop decoded treeobjs (they are
+ * recreated from raw data on demand), then remove entries that are not
+ * dirty, not incomplete, and have no waiters.  As with
+ * cache_expire_entries(), entries used within 'thresh' epochs of
+ * 'current_epoch' are not touched, so the budget may be exceeded until
+ * they age.  Stops as soon as the cache is within budget.
+ * Returns the number of entries removed.
+ */
+int cache_trim (struct cache *cache, int current_epoch, int thresh);
+
+/* Get the current raw and decoded treeobj memory use and the budget.
+ * Unlike cache_get_stats(), this does not scan the cache.
+ */
+void cache_get_bytes (struct cache *cache, size_t *raw_bytes,
+                      size_t *treeobj_bytes, size_t *max_bytes);
+
 /* Obtain statistics on the cache.
  * Returns -1 on error, 0 on success
  */
@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <ctype.h>
 #include <czmq.h>
 #include <flux/core.h>
@@ -50,6 +51,7 @@ struct commit_mgr {
     const char *namespace;
     const char *hash_name;
     int noop_stores;            /* for kvs.stats.get, etc.*/
+    int dir_shard;              /* shard dirs with more entries (0=never) */
     zhash_t *fences;
     bool iterating_fences;
     zlist_t *removelist;
@@ -58,15 +60,27 @@ struct commit_mgr {
     void *aux;
 };
 
+/* An object encoded by commit_process_offload(), to be added to the
+ * cache by the module thread.
+ */
+struct pending_store {
+    blobref_t ref;
+    void *data;
+    int len;
+};
+
 struct commit {
     int errnum;
     int aux_errnum;
     fence_t *f;
     int blocked:1;
+    int offload:1;     /* running in commit_process_offload() */
     json_t *rootcpy;   /* working copy of root dir */
     blobref_t newroot;
+    json_t *keys;      /* normalized keys changed by ops */
     zlist_t *missing_refs_list;
     zlist_t *dirty_cache_entries_list;
+    zlist_t *pending_stores;
     commit_mgr_t *cm;
     enum {
         COMMIT_STATE_INIT = 1,
@@ -78,10 +92,51 @@ struct commit {
     } state;
 };
 
+/* The flux_t handle may not be used from a worker thread, so errors
+ * are not logged by commit_process_offload().  They are still reported
+ * through the commit's errnum.
+ */
+static void commit_log (commit_t *c, int level, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (c->offload)
+        return;
+    va_start (ap, fmt);
+    flux_vlog (c->cm->h, level, fmt, ap);
+    va_end (ap);
+}
+
+static void commit_log_error (commit_t *c, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (c->offload)
+        return;
+    va_start (ap, fmt);
+    flux_log_verror (c->cm->h, fmt, ap);
+    va_end (ap);
+}
+
+static void pending_store_destroy (struct pending_store *ps)
+{
+    if (ps) {
+        free (ps->data);
+        free (ps);
+    }
+}
+
 static void commit_destroy (commit_t *c)
 {
     if (c) {
         json_decref (c->rootcpy);
+        json_decref (c->keys);
+        if (c->pending_stores) {
+            struct pending_store *ps;
+            while ((ps = zlist_pop (c->pending_stores)))
+                pending_store_destroy (ps);
+            zlist_destroy (&c->pending_stores);
+        }
         if (c->missing_refs_list)
             zlist_destroy (&c->missing_refs_list);
         if (c->dirty_cache_entries_list)
@@ -110,6 +165,10 @@ static commit_t *commit_create (fence_t *f, commit_mgr_t *cm)
         saved_errno = ENOMEM;
         goto error;
     }
+    if (!(c->pending_stores = zlist_new ())) {
+        saved_errno = ENOMEM;
+        goto error;
+    }
     c->cm = cm;
     c->state = COMMIT_STATE_INIT;
     return c;
@@ -157,6 +216,56 @@ const char *commit_get_newroot_ref (commit_t *c)
     return NULL;
 }
 
+json_t *commit_get_keys (commit_t *c)
+{
+    if (c->state == COMMIT_STATE_FINISHED)
+        return c->keys;
+    return NULL;
+}
+
+/* Build the array of distinct keys in 'paths', an array of the
+ * normalized keys that were actually changed, one per op.
+ */
+static json_t *commit_keys_create (char **paths, int count)
+{
+    json_t *keys = NULL, *seen = NULL;
+    int saved_errno;
+    int i;
+
+    if (!(keys = json_array ()) || !(seen = json_object ())) {
+        saved_errno = ENOMEM;
+        goto error;
+    }
+    for (i = 0; i < count; i++) {
+        if (!json_object_get (seen, paths[i])) {
+            if (json_object_set_new (seen, paths[i], json_true ()) < 0
+                    || json_array_append_new (keys,
+                                              json_string (paths[i])) < 0) {
+                saved_errno = ENOMEM;
+                goto error;
+            }
+        }
+    }
+    json_decref (seen);
+    return keys;
+error:
+    json_decref (seen);
+    json_decref (keys);
+    errno = saved_errno;
+    return NULL;
+}
+
+static void commit_paths_destroy (char **paths, int count)
+{
+    int i;
+
+    if (paths) {
+        for (i = 0; i < count; i++)
+            free (paths[i]);
+        free (paths);
+    }
+}
+
 /* On error we should cleanup anything on the dirty cache list
  * that has not yet been passed to the user.  Because this has not
  * been passed to the user, there should be no waiters and the
@@ -204,18 +313,108 @@ static void cleanup_dirty_cache_list (commit_t *c)
         commit_cleanup_dirty_cache_entry (c, entry);
 }
 
+/* Store 'len' bytes of 'data' under key 'ref' in local cache.
+ * Data is copied into the cache entry if one is created.
+ * Returns -1 on error, 0 on success entry already there, 1 on success
+ * entry needs to be flushed to content store
+ */
+static int store_cache_data (commit_t *c, int current_epoch,
+                             const blobref_t ref, const void *data, int len,
+                             struct cache_entry **entryp)
+{
+    struct cache_entry *entry;
+
+    if (!(entry = cache_lookup (c->cm->cache, ref, current_epoch))) {
+        if (!(entry = cache_entry_create ())) {
+            flux_log_error (c->cm->h, "%s: cache_entry_create", __FUNCTION__);
+            return -1;
+        }
+        cache_insert (c->cm->cache, ref, entry);
+    }
+    if (cache_entry_get_valid (entry)) {
+        c->cm->noop_stores++;
+        *entryp = entry;
+        return 0;
+    }
+    if (cache_entry_set_raw (entry, data, len) < 0) {
+        int ret;
+        ret = cache_remove_entry (c->cm->cache, ref);
+        assert (ret == 1);
+        return -1;
+    }
+    if (cache_entry_set_dirty (entry, true) < 0) {
+        flux_log_error (c->cm->h, "%s: cache_entry_set_dirty",__FUNCTION__);
+        int ret;
+        ret = cache_remove_entry (c->cm->cache, ref);
+        assert (ret == 1);
+        return -1;
+    }
+    *entryp = entry;
+    return 1;
+}
+
+/* Keep encoded object for store_pending() to add to the cache later.
+ * Takes ownership of 'data'.
+ */
+static int store_defer (commit_t *c, const blobref_t ref, void *data, int len)
+{
+    struct pending_store *ps;
+
+    if (!(ps = calloc (1, sizeof (*ps)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    strcpy (ps->ref, ref);
+    ps->data = data;
+    ps->len = len;
+    if (zlist_append (c->pending_stores, ps) < 0) {
+        ps->data = NULL;
+        pending_store_destroy (ps);
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/* Add objects encoded by commit_process_offload() to the cache,
+ * in the order they were encoded, and queue dirty ones for flushing.
+ */
+static int store_pending (commit_t *c, int current_epoch)
+{
+    struct pending_store *ps;
+    struct cache_entry *entry;
+    int ret;
+
+    while ((ps = zlist_pop (c->pending_stores))) {
+        ret = store_cache_data (c, current_epoch, ps->ref, ps->data, ps->len,
+                                &entry);
+        pending_store_destroy (ps);
+        if (ret < 0)
+            return -1;
+        if (ret) {
+            if (zlist_push (c->dirty_cache_entries_list, entry) < 0) {
+                commit_cleanup_dirty_cache_entry (c, entry);
+                errno = ENOMEM;
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
 /* Store object 'o' under key 'ref' in local cache.
  * Object reference is still owned by the caller.
  * 'is_raw' indicates this data is a json string w/ base64 value and
  * should be flushed to the content store as raw data after it is
  * decoded.  Otherwise, the json object should be a treeobj.
  * Returns -1 on error, 0 on success entry already there, 1 on success
- * entry needs to be flushed to content store
+ * entry needs to be flushed to content store.  When called from
+ * commit_process_offload(), the cache is left alone:  the encoded
+ * object is kept for store_pending(), and 0 is returned.
  */
 static int store_cache (commit_t *c, int current_epoch, json_t *o,
                         bool is_raw, blobref_t ref, struct cache_entry **entryp)
 {
-    struct cache_entry *entry;
     int saved_errno, rc;
     const char *xdata;
     char *data = NULL;
@@ -226,11 +425,11 @@ static int store_cache (commit_t *c, int current_epoch, json_t *o,
         xlen = strlen (xdata);
         len = base64_decode_length (xlen);
         if (!(data = malloc (len))) {
-            flux_log_error (c->cm->h, "malloc");
+            commit_log_error (c, "malloc");
             goto error;
         }
         if (base64_decode_block (data, &len, xdata, xlen) < 0) {
-            flux_log_error (c->cm->h, "base64_decode_block");
+            commit_log_error (c, "base64_decode_block");
             errno = EPROTO;
             goto error;
         }
@@ -244,43 +443,23 @@ static int store_cache (commit_t *c, int current_epoch, json_t *o,
     }
     else {
         if (treeobj_validate (o) < 0 || !(data = treeobj_encode (o))) {
-            flux_log_error (c->cm->h, "%s: treeobj_encode", __FUNCTION__);
+            commit_log_error (c, "%s: treeobj_encode", __FUNCTION__);
             goto error;
         }
         len = strlen (data);
     }
     if (blobref_hash (c->cm->hash_name, data, len, ref) < 0) {
-        flux_log_error (c->cm->h, "%s: blobref_hash", __FUNCTION__);
+        commit_log_error (c, "%s: blobref_hash", __FUNCTION__);
         goto error;
     }
-    if (!(entry = cache_lookup (c->cm->cache, ref, current_epoch))) {
-        if (!(entry = cache_entry_create ())) {
-            flux_log_error (c->cm->h, "%s: cache_entry_create", __FUNCTION__);
+    if (c->offload) {
+        if (store_defer (c, ref, data, len) < 0)
             goto error;
-        }
-        cache_insert (c->cm->cache, ref, entry);
+        return 0;
     }
-    if (cache_entry_get_valid (entry)) {
-        c->cm->noop_stores++;
-        rc = 0;
-    }
-    else {
-        if (cache_entry_set_raw (entry, data, len) < 0) {
-            int ret;
-            ret = cache_remove_entry (c->cm->cache, ref);
-            assert (ret == 1);
-            goto error;
-        }
-        if (cache_entry_set_dirty (entry, true) < 0) {
-            flux_log_error (c->cm->h, "%s: cache_entry_set_dirty",__FUNCTION__);
-            int ret;
-            ret = cache_remove_entry (c->cm->cache, ref);
-            assert (ret == 1);
-            goto error;
-        }
-        rc = 1;
-    }
-    *entryp = entry;
+    if ((rc = store_cache_data (c, current_epoch, ref, data, len,
+                                entryp)) < 0)
+        goto error;
     free (data);
     return rc;
 
@@ -291,8 +470,53 @@ error:
     return -1;
 }
 
+/* Split directory 'dir' into an hdir whose buckets are keyed by
+ * the first 'keylen' characters of the entry name hash.
+ */
+static json_t *dir_shard (json_t *dir, int keylen)
+{
+    char key[TREEOBJ_HDIR_MAX_KEYLEN + 1];
+    json_t *hdir, *data, *bucket, *o;
+    const char *name;
+    int saved_errno;
+
+    if (!(hdir = treeobj_create_hdir ()))
+        return NULL;
+    if (!(data = treeobj_get_data (dir)))
+        goto error;
+    json_object_foreach (data, name, o) {
+        if (treeobj_hdir_key (name, keylen, key) < 0)
+            goto error;
+        if (!(bucket = treeobj_get_entry (hdir, key))) {
+            if (!(bucket = treeobj_create_dir ()))
+                goto error;
+            if (treeobj_insert_entry (hdir, key, bucket) < 0) {
+                saved_errno = errno;
+                json_decref (bucket);
+                errno = saved_errno;
+                goto error;
+            }
+            json_decref (bucket);
+        }
+        /* entries are valid, skip treeobj_insert_entry() validation */
+        if (json_object_set (treeobj_get_data (bucket), name, o) < 0) {
+            errno = ENOMEM;
+            goto error;
+        }
+    }
+    return hdir;
+error:
+    saved_errno = errno;
+    json_decref (hdir);
+    errno = saved_errno;
+    return NULL;
+}
+
 /* Store DIRVAL objects, converting them to DIRREFs.
  * Store (large) FILEVAL objects, converting them to FILEREFs.
+ * Split DIRVAL objects with more than cm->dir_shard entries into
+ * hdir objects, and store hdir buckets likewise.  Empty buckets are
+ * dropped, and an hdir left with no buckets reverts to an empty dir.
  * Return 0 on success, -1 on error
  */
 static int commit_unroll (commit_t *c, int current_epoch, json_t *dir)
@@ -300,12 +524,17 @@ static int commit_unroll (commit_t *c, int current_epoch, json_t *dir)
     json_t *dir_entry;
     json_t *dir_data;
     json_t *tmp;
+    json_t *empty = NULL;
+    bool is_hdir = treeobj_is_hdir (dir);
+    int keylen;
     blobref_t ref;
     int ret;
     struct cache_entry *entry;
     void *iter;
+    int saved_errno, rc = -1;
+    size_t index;
 
-    assert (treeobj_is_dir (dir));
+    assert (treeobj_is_dir (dir) || is_hdir);
 
     if (!(dir_data = treeobj_get_data (dir)))
         return -1;
@@ -317,25 +546,64 @@ static int commit_unroll (commit_t *c, int current_epoch, json_t *dir)
      */
     while (iter) {
         dir_entry = json_object_iter_value (iter);
-        if (treeobj_is_dir (dir_entry)) {
+        keylen = is_hdir ? strlen (json_object_iter_key (iter)) : 0;
+        if (treeobj_is_dir (dir_entry)
+                && c->cm->dir_shard > 0
+                && treeobj_get_count (dir_entry) > c->cm->dir_shard
+                && keylen < TREEOBJ_HDIR_MAX_KEYLEN) {
+            if (!(tmp = dir_shard (dir_entry, keylen + 1)))
+                goto done;
+            if (json_object_iter_set_new (dir_data, iter, tmp) < 0) {
+                json_decref (tmp);
+                errno = ENOMEM;
+                goto done;
+            }
+            dir_entry = tmp;
+        }
+        if (treeobj_is_dir (dir_entry) || treeobj_is_hdir (dir_entry)) {
             if (commit_unroll (c, current_epoch, dir_entry) < 0) /* depth first */
-                return -1;
+                goto done;
+            if (treeobj_get_count (dir_entry) == 0) {
+                if (is_hdir) {
+                    if (!empty && !(empty = json_array ())) {
+                        errno = ENOMEM;
+                        goto done;
+                    }
+                    if (json_array_append_new (empty,
+                            json_string (json_object_iter_key (iter))) < 0) {
+                        errno = ENOMEM;
+                        goto done;
+                    }
+                    iter = json_object_iter_next (dir_data, iter);
+                    continue;
+                }
+                if (treeobj_is_hdir (dir_entry)) {
+                    if (!(tmp = treeobj_create_dir ()))
+                        goto done;
+                    if (json_object_iter_set_new (dir_data, iter, tmp) < 0) {
+                        json_decref (tmp);
+                        errno = ENOMEM;
+                        goto done;
+                    }
+                    dir_entry = tmp;
+                }
+            }
             if ((ret = store_cache (c, current_epoch, dir_entry,
                                     false, ref, &entry)) < 0)
-                return -1;
+                goto done;
             if (ret) {
                 if (zlist_push (c->dirty_cache_entries_list, entry) < 0) {
                     commit_cleanup_dirty_cache_entry (c, entry);
                     errno = ENOMEM;
-                    return -1;
+                    goto done;
                 }
             }
             if (!(tmp = treeobj_create_dirref (ref)))
-                return -1;
+                goto done;
             if (json_object_iter_set_new (dir, iter, tmp) < 0) {
                 json_decref (tmp);
                 errno = ENOMEM;
-                return -1;
+                goto done;
             }
         }
         else if (treeobj_is_val (dir_entry)) {
@@ -343,34 +611,45 @@ static int commit_unroll (commit_t *c, int current_epoch, json_t *dir)
             const char *str;
 
             if (!(val_data = treeobj_get_data (dir_entry)))
-                return -1;
+                goto done;
             /* jansson >= 2.7 could use json_string_length() instead */
             str = json_string_value (val_data);
             assert (str);
             if (strlen (str) > BLOBREF_MAX_STRING_SIZE) {
                 if ((ret = store_cache (c, current_epoch, val_data,
                                         true, ref, &entry)) < 0)
-                    return -1;
+                    goto done;
                 if (ret) {
                     if (zlist_push (c->dirty_cache_entries_list, entry) < 0) {
                         commit_cleanup_dirty_cache_entry (c, entry);
                         errno = ENOMEM;
-                        return -1;
+                        goto done;
                     }
                 }
                 if (!(tmp = treeobj_create_valref (ref)))
-                    return -1;
+                    goto done;
                 if (json_object_iter_set_new (dir, iter, tmp) < 0) {
                     json_decref (tmp);
                     errno = ENOMEM;
-                    return -1;
+                    goto done;
                 }
             }
         }
         iter = json_object_iter_next (dir_data, iter);
     }
 
-    return 0;
+    if (empty) {
+        json_array_foreach (empty, index, tmp) {
+            if (treeobj_delete_entry (dir, json_string_value (tmp)) < 0)
+                goto done;
+        }
+    }
+    rc = 0;
+done:
+    saved_errno = errno;
+    json_decref (empty);
+    errno = saved_errno;
+    return rc;
 }
 
 static int commit_val_data_to_cache (commit_t *c, int current_epoch,
@@ -485,14 +764,15 @@ static int commit_append (commit_t *c, int current_epoch, json_t *dirent,
         return -1;
     }
     else if (treeobj_is_dir (entry)
-             || treeobj_is_dirref (entry)) {
+             || treeobj_is_dirref (entry)
+             || treeobj_is_hdir (entry)) {
         errno = EISDIR;
         return -1;
     }
     else {
         char *s = json_dumps (entry, 0);
-        flux_log (c->cm->h, LOG_ERR, "%s: corrupt treeobj: %s",
-                  __FUNCTION__, s);
+        commit_log (c, LOG_ERR, "%s: corrupt treeobj: %s",
+                    __FUNCTION__, s);
         free (s);
         errno = ENOTRECOVERABLE;
         return -1;
@@ -500,12 +780,128 @@ static int commit_append (commit_t *c, int current_epoch, json_t *dirent,
     return 0;
 }
 
+/* Set *dirp to a copy of the dir or hdir referenced by 'dirref', for
+ * modification.  If the object is not in the cache, set *missing_ref
+ * and *dirp = NULL.  Return 0 on success, -1 on error with errno set.
+ */
+static int load_dirref (commit_t *c, int current_epoch, const json_t *dirref,
+                        json_t **dirp, const char **missing_ref)
+{
+    struct cache_entry *entry;
+    const char *ref;
+    const json_t *dir;
+    int refcount;
+
+    if ((refcount = treeobj_get_count (dirref)) < 0)
+        return -1;
+
+    if (refcount != 1) {
+        commit_log (c, LOG_ERR, "invalid dirref count: %d", refcount);
+        errno = ENOTRECOVERABLE;
+        return -1;
+    }
+
+    if (!(ref = treeobj_get_blobref (dirref, 0)))
+        return -1;
+
+    /* Hold cache lock while using the entry, in case we are
+     * running in a worker thread.
+     */
+    cache_lock (c->cm->cache);
+    if (!(entry = cache_lookup (c->cm->cache, ref, current_epoch))
+        || !cache_entry_get_valid (entry)) {
+        cache_unlock (c->cm->cache);
+        *missing_ref = ref;
+        *dirp = NULL;
+        return 0;
+    }
+
+    if (!(dir = cache_entry_get_treeobj (entry))) {
+        cache_unlock (c->cm->cache);
+        errno = ENOTRECOVERABLE;
+        return -1;
+    }
+
+    /* do not corrupt store by modifying orig. */
+    if (!(*dirp = treeobj_deep_copy (dir))) {
+        cache_unlock (c->cm->cache);
+        return -1;
+    }
+    cache_unlock (c->cm->cache);
+    return 0;
+}
+
+/* If 'dir' is an hdir, descend through its buckets to the dir that
+ * holds entry 'name', replacing bucket dirrefs with copies in the
+ * working root.  Missing buckets are created if 'create' is true.
+ * Set *dirp to the dir, or to NULL if it does not exist or a bucket
+ * must first be loaded into the cache (*missing_ref is set).
+ * Return 0 on success, -1 on error with errno set.
+ */
+static int resolve_hdir (commit_t *c, int current_epoch, json_t *dir,
+                         const char *name, bool create,
+                         json_t **dirp, const char **missing_ref)
+{
+    char key[TREEOBJ_HDIR_MAX_KEYLEN + 1];
+    json_t *bucket;
+    int keylen = 1;
+
+    while (treeobj_is_hdir (dir)) {
+        if (keylen > TREEOBJ_HDIR_MAX_KEYLEN
+            || (treeobj_get_count (dir) > 0
+                && treeobj_hdir_keylen (dir) != keylen)) {
+            commit_log (c, LOG_ERR, "%s: invalid hdir bucket keys",
+                        __FUNCTION__);
+            errno = ENOTRECOVERABLE;
+            return -1;
+        }
+        if (treeobj_hdir_key (name, keylen, key) < 0)
+            return -1;
+        if (!(bucket = treeobj_get_entry (dir, key))) {
+            if (!create) {
+                *dirp = NULL;
+                return 0;
+            }
+            if (!(bucket = treeobj_create_dir ()))
+                return -1;
+            if (treeobj_insert_entry (dir, key, bucket) < 0) {
+                json_decref (bucket);
+                return -1;
+            }
+            json_decref (bucket);
+        }
+        else if (treeobj_is_dirref (bucket)) {
+            if (load_dirref (c, current_epoch, bucket, &bucket,
+                             missing_ref) < 0)
+                return -1;
+            if (!bucket) {
+                *dirp = NULL;
+                return 0; /* stall */
+            }
+            if (treeobj_insert_entry (dir, key, bucket) < 0) {
+                json_decref (bucket);
+                if (errno == EINVAL)
+                    errno = ENOTRECOVERABLE;
+                return -1;
+            }
+            json_decref (bucket);
+        }
+        dir = bucket;
+        keylen++;
+    }
+    *dirp = dir;
+    return 0;
+}
+
 /* link (key, dirent) into directory 'dir'.
+ * If 'path' is non-NULL, it is set to the normalized key that was
+ * changed, which differs from 'key' if a symlink was followed.
  */
 static int commit_link_dirent (commit_t *c, int current_epoch,
                                json_t *rootdir, const char *key,
                                json_t *dirent, int flags,
-                               const char **missing_ref)
+                               const char **missing_ref,
+                               char **path)
 {
     char *cpy = NULL;
     char *next, *name;
@@ -517,6 +913,13 @@ static int commit_link_dirent (commit_t *c, int current_epoch,
         saved_errno = errno;
         goto done;
     }
+    if (path) {
+        free (*path);
+        if (!(*path = strdup (cpy))) {
+            saved_errno = ENOMEM;
+            goto done;
+        }
+    }
     name = cpy;
 
     /* Special case root
@@ -533,6 +936,15 @@ static int commit_link_dirent (commit_t *c, int current_epoch,
     while ((next = strchr (name, '.'))) {
         *next++ = '\0';
 
+        if (treeobj_is_hdir (dir)) {
+            if (resolve_hdir (c, current_epoch, dir, name,
+                              !json_is_null (dirent), &dir, missing_ref) < 0) {
+                saved_errno = errno;
+                goto done;
+            }
+            if (!dir) /* key deletion - it doesn't exist, or stall */
+                goto success;
+        }
         if (!treeobj_is_dir (dir)) {
             saved_errno = ENOTRECOVERABLE;
             goto done;
@@ -551,47 +963,17 @@ static int commit_link_dirent (commit_t *c, int current_epoch,
                 goto done;
             }
             json_decref (subdir);
-        } else if (treeobj_is_dir (dir_entry)) {
+        } else if (treeobj_is_dir (dir_entry)
+                   || treeobj_is_hdir (dir_entry)) {
             subdir = dir_entry;
         } else if (treeobj_is_dirref (dir_entry)) {
-            struct cache_entry *entry;
-            const char *ref;
-            const json_t *subdirtmp;
-            int refcount;
-
-            if ((refcount = treeobj_get_count (dir_entry)) < 0) {
+            if (load_dirref (c, current_epoch, dir_entry, &subdir,
+                             missing_ref) < 0) {
                 saved_errno = errno;
                 goto done;
             }
-
-            if (refcount != 1) {
-                flux_log (c->cm->h, LOG_ERR, "invalid dirref count: %d",
-                          refcount);
-                saved_errno = ENOTRECOVERABLE;
-                goto done;
-            }
-
-            if (!(ref = treeobj_get_blobref (dir_entry, 0))) {
-                saved_errno = errno;
-                goto done;
-            }
-
-            if (!(entry = cache_lookup (c->cm->cache, ref, current_epoch))
-                || !cache_entry_get_valid (entry)) {
-                *missing_ref = ref;
+            if (!subdir)
                 goto success; /* stall */
-            }
-
-            if (!(subdirtmp = cache_entry_get_treeobj (entry))) {
-                saved_errno = ENOTRECOVERABLE;
-                goto done;
-            }
-
-            /* do not corrupt store by modifying orig. */
-            if (!(subdir = treeobj_deep_copy (subdirtmp))) {
-                saved_errno = errno;
-                goto done;
-            }
 
             if (treeobj_insert_entry (dir, name, subdir) < 0) {
                 saved_errno = errno;
@@ -622,7 +1004,8 @@ static int commit_link_dirent (commit_t *c, int current_epoch,
                                     nkey,
                                     dirent,
                                     flags,
-                                    missing_ref) < 0) {
+                                    missing_ref,
+                                    path) < 0) {
                 saved_errno = errno;
                 free (nkey);
                 goto done;
@@ -649,6 +1032,15 @@ static int commit_link_dirent (commit_t *c, int current_epoch,
     /* This is the final path component of the key.  Add/modify/delete
      * it in the directory.
      */
+    if (treeobj_is_hdir (dir)) {
+        if (resolve_hdir (c, current_epoch, dir, name,
+                          !json_is_null (dirent), &dir, missing_ref) < 0) {
+            saved_errno = errno;
+            goto done;
+        }
+        if (!dir) /* key deletion - it doesn't exist, or stall */
+            goto success;
+    }
     if (!json_is_null (dirent)) {
         if (flags & FLUX_KVS_APPEND) {
             if (commit_append (c, current_epoch, dirent, dir, name) < 0) {
@@ -705,10 +1097,12 @@ commit_process_t commit_process (commit_t *c,
 
             c->state = COMMIT_STATE_LOAD_ROOT;
 
+            cache_lock (c->cm->cache);
             if (!(entry = cache_lookup (c->cm->cache,
                                         rootdir_ref,
                                         current_epoch))
                 || !cache_entry_get_valid (entry)) {
+                cache_unlock (c->cm->cache);
 
                 if (zlist_push (c->missing_refs_list,
                                 (void *)rootdir_ref) < 0) {
@@ -719,14 +1113,17 @@ commit_process_t commit_process (commit_t *c,
             }
 
             if (!(rootdir = cache_entry_get_treeobj (entry))) {
+                cache_unlock (c->cm->cache);
                 c->errnum = ENOTRECOVERABLE;
                 return COMMIT_PROCESS_ERROR;
             }
 
             if (!(c->rootcpy = treeobj_deep_copy (rootdir))) {
                 c->errnum = errno;
+                cache_unlock (c->cm->cache);
                 return COMMIT_PROCESS_ERROR;
             }
+            cache_unlock (c->cm->cache);
 
             c->state = COMMIT_STATE_APPLY_OPS;
             /* fallthrough */
@@ -746,11 +1143,20 @@ commit_process_t commit_process (commit_t *c,
                 int i, len = json_array_size (ops);
                 const char *key;
                 int flags;
+                char **paths;
 
                 /* Caller didn't call commit_iter_missing_refs() */
                 if (zlist_first (c->missing_refs_list))
                     goto stall_load;
 
+                /* Keys actually changed, after following symlinks, which
+                 * are what watchers of this namespace must be told about.
+                 */
+                if (!(paths = calloc (len ? len : 1, sizeof (paths[0])))) {
+                    c->errnum = ENOMEM;
+                    return COMMIT_PROCESS_ERROR;
+                }
+
                 for (i = 0; i < len; i++) {
                     missing_ref = NULL;
                     op = json_array_get (ops, i);
@@ -765,7 +1171,8 @@ commit_process_t commit_process (commit_t *c,
                                             key,
                                             dirent,
                                             flags,
-                                            &missing_ref) < 0) {
+                                            &missing_ref,
+                                            &paths[i]) < 0) {
                         c->errnum = errno;
                         break;
                     }
@@ -781,12 +1188,22 @@ commit_process_t commit_process (commit_t *c,
                 if (c->errnum != 0) {
                     /* empty missing_refs_list to prevent mistakes later */
                     while ((missing_ref = zlist_pop (c->missing_refs_list)));
+                    commit_paths_destroy (paths, len);
                     return COMMIT_PROCESS_ERROR;
                 }
 
-                if (zlist_first (c->missing_refs_list))
+                if (zlist_first (c->missing_refs_list)) {
+                    commit_paths_destroy (paths, len);
                     goto stall_load;
+                }
 
+                json_decref (c->keys);
+                if (!(c->keys = commit_keys_create (paths, len))) {
+                    c->errnum = errno;
+                    commit_paths_destroy (paths, len);
+                    return COMMIT_PROCESS_ERROR;
+                }
+                commit_paths_destroy (paths, len);
             }
             c->state = COMMIT_STATE_STORE;
             /* fallthrough */
@@ -833,6 +1250,19 @@ commit_process_t commit_process (commit_t *c,
             /* fallthrough */
         }
         case COMMIT_STATE_PRE_FINISHED:
+            /* Objects encoded by commit_process_offload() are added to
+             * the cache by the module thread.
+             */
+            if (zlist_first (c->pending_stores)) {
+                if (c->offload)
+                    return COMMIT_PROCESS_DIRTY_CACHE_ENTRIES;
+                if (store_pending (c, current_epoch) < 0) {
+                    c->errnum = errno;
+                    cleanup_dirty_cache_list (c);
+                    return COMMIT_PROCESS_ERROR;
+                }
+            }
+
             /* If we did not fall through to here, caller didn't call
              * commit_iter_dirty_cache_entries()
              */
@@ -844,7 +1274,7 @@ commit_process_t commit_process (commit_t *c,
         case COMMIT_STATE_FINISHED:
             break;
         default:
-            flux_log (c->cm->h, LOG_ERR, "invalid commit state: %d", c->state);
+            commit_log (c, LOG_ERR, "invalid commit state: %d", c->state);
             c->errnum = ENOTRECOVERABLE;
             return COMMIT_PROCESS_ERROR;
     }
@@ -860,6 +1290,26 @@ stall_store:
     return COMMIT_PROCESS_DIRTY_CACHE_ENTRIES;
 }
 
+bool commit_offload (commit_t *c)
+{
+    if (c->errnum
+        || c->state >= COMMIT_STATE_PRE_FINISHED
+        || zlist_first (c->missing_refs_list)
+        || zlist_first (c->dirty_cache_entries_list))
+        return false;
+    c->blocked = 1;
+    return true;
+}
+
+void commit_process_offload (commit_t *c,
+                             int current_epoch,
+                             const blobref_t rootdir_ref)
+{
+    c->offload = 1;
+    (void)commit_process (c, current_epoch, rootdir_ref);
+    c->offload = 0;
+}
+
 int commit_iter_missing_refs (commit_t *c, commit_ref_f cb, void *data)
 {
     const char *ref;
@@ -936,6 +1386,7 @@ commit_mgr_t *commit_mgr_create (struct cache *cache,
     cm->cache = cache;
     cm->namespace = namespace;
     cm->hash_name = hash_name;
+    cm->dir_shard = COMMIT_DIR_SHARD_DEFAULT;
     if (!(cm->fences = zhash_new ())) {
         saved_errno = ENOMEM;
         goto error;
@@ -959,6 +1410,11 @@ commit_mgr_t *commit_mgr_create (struct cache *cache,
     return NULL;
 }
 
+void commit_mgr_set_dir_shard (commit_mgr_t *cm, int entries)
+{
+    cm->dir_shard = entries;
+}
+
 void commit_mgr_destroy (commit_mgr_t *cm)
 {
     if (cm) {
@@ -50,6 +50,11 @@ void *commit_get_aux (commit_t *c);
  * returns COMMIT_PROCESS_FINISHED) */
 const char *commit_get_newroot_ref (commit_t *c);
 
+/* returns array of normalized keys changed by the commit, non-NULL
+ * only if process state complete (commit_process() returns
+ * COMMIT_PROCESS_FINISHED) and the commit had ops */
+json_t *commit_get_keys (commit_t *c);
+
 /* Primary commit processing funtion.
  *
  * Pass in a commit_t that was obtained via
@@ -75,6 +80,24 @@ commit_process_t commit_process (commit_t *c,
                                  int current_epoch,
                                  const blobref_t rootdir_ref);
 
+/* Offloading commit processing to a worker thread.
+ *
+ * commit_offload() returns true if the commit has CPU intensive work
+ * left to do (applying ops, encoding and hashing new objects), and
+ * marks it blocked so commit_mgr_get_ready_commit() no longer returns it.
+ *
+ * commit_process_offload() then does that work without using the flux_t
+ * handle or modifying the cache, so it may be called from another
+ * thread, as long as the cache is only otherwise used under its lock
+ * (see cache_lock()).  New objects are added to the cache by the next
+ * call to commit_process(), which the module thread must make
+ * afterwards, handling the result as above.
+ */
+bool commit_offload (commit_t *c);
+void commit_process_offload (commit_t *c,
+                             int current_epoch,
+                             const blobref_t rootdir_ref);
+
 /* on commit stall, iterate through all missing refs that the caller
  * should load into the cache
  *
@@ -148,6 +171,13 @@ void commit_mgr_remove_commit (commit_mgr_t *cm, commit_t *c);
 /* remove a fence from the commit manager */
 int commit_mgr_remove_fence (commit_mgr_t *cm, const char *name);
 
+/* Directories with more than 'entries' entries are split into hdir
+ * buckets when stored.  Buckets that exceed it are split again.
+ * Set to 0 to disable sharding, the default.
+ */
+#define COMMIT_DIR_SHARD_DEFAULT 0
+void commit_mgr_set_dir_shard (commit_mgr_t *cm, int entries);
+
 int commit_mgr_get_noop_stores (commit_mgr_t *cm);
 void commit_mgr_clear_noop_stores (commit_mgr_t *cm);
 
@@ -53,6 +53,8 @@
 #include "fence.h"
 #include "commit.h"
 #include "kvsroot.h"
+#include "workpool.h"
+#include "pathcache.h"
 
 #define KVS_MAGIC 0xdeadbeef
 
@@ -60,6 +62,11 @@
  */
 const int max_lastuse_age = 5;
 
+/* If over the cache memory budget, trim cache entries not used in the
+ * last 'min_trim_age' heartbeats.
+ */
+const int min_trim_age = 2;
+
 /* Expire namespaces after 'max_namespace_age' heartbeats.
  *
  * If heartbeats are the default of 2 seconds, 1000 heartbeats is
@@ -71,11 +78,20 @@ const int max_namespace_age = 1000;
  */
 const bool event_includes_rootdir = true;
 
+/* Include the keys changed by a commit in the kvs.setroot event, unless
+ * there are more than 'max_event_keys'.  Without them, followers must
+ * re-check every watched key.
+ */
+const int max_event_keys = 1024;
+
 typedef struct {
     int magic;
     struct cache *cache;    /* blobref => cache_entry */
     kvsroot_mgr_t *km;
     int faults;                 /* for kvs.stats.get, etc. */
+    int trimmed;                /* cache entries removed by cache_trim() */
+    int rootdeltas;             /* kvs.setroot events with root dir changes */
+    int rootdeltas_applied;     /* ... that primed the cache with new root */
     flux_t *h;
     uint32_t rank;
     int epoch;              /* tracks current heartbeat epoch */
@@ -83,6 +99,13 @@ typedef struct {
     flux_watcher_t *idle_w;
     flux_watcher_t *check_w;
     int commit_merge;
+    int commit_threads;
+    int setroot_delta;      /* send root dir changes in kvs.setroot */
+    int dir_shard;          /* shard dirs larger than this (0=never) */
+    workpool_t *workpool;       /* commit_process() threads (rank 0) */
+    int lookup_cache;       /* max pathcache entries (0=disabled) */
+    pathcache_t *pathcache;     /* kvs.get walk results */
+    size_t cache_max_bytes; /* cache memory budget (0=unlimited) */
     bool events_init;            /* flag */
     const char *hash_name;
 } kvs_ctx_t;
@@ -109,7 +132,10 @@ static void freectx (void *arg)
 {
     kvs_ctx_t *ctx = arg;
     if (ctx) {
+        /* join workers before destroying what they might be using */
+        workpool_destroy (ctx->workpool);
         cache_destroy (ctx->cache);
+        pathcache_destroy (ctx->pathcache);
         kvsroot_mgr_destroy (ctx->km);
         flux_watcher_destroy (ctx->prep_w);
         flux_watcher_destroy (ctx->check_w);
@@ -173,6 +199,9 @@ static kvs_ctx_t *getctx (flux_t *h)
             flux_watcher_start (ctx->check_w);
         }
         ctx->commit_merge = 1;
+        ctx->setroot_delta = 1;
+        ctx->dir_shard = COMMIT_DIR_SHARD_DEFAULT;
+        ctx->lookup_cache = 4096;
         flux_aux_set (h, "kvssrv", ctx, freectx);
     }
     return ctx;
@@ -284,22 +313,63 @@ cleanup:
     return rc;
 }
 
+/*
+ * watchers
+ */
+
+static int watchers_count (struct kvsroot *root)
+{
+    return wait_queue_length (root->watchlist)
+           + watchidx_count (root->watchidx);
+}
+
+/* Run unindexed waiters, and indexed watchers affected by a change
+ * to JSON array of 'keys'.  If 'keys' is NULL, run all watchers.
+ */
+static int watchers_run (struct kvsroot *root, json_t *keys)
+{
+    int rc = 0;
+
+    if (wait_runqueue (root->watchlist) < 0)
+        rc = -1;
+    if (keys) {
+        if (watchidx_run (root->watchidx, keys) < 0)
+            rc = -1;
+    }
+    else {
+        if (watchidx_run_all (root->watchidx) < 0)
+            rc = -1;
+    }
+    return rc;
+}
+
+static int watchers_destroy_msg (struct kvsroot *root, wait_test_msg_f cb,
+                                 void *arg)
+{
+    if (wait_destroy_msg (root->watchlist, cb, arg) < 0
+        || watchidx_destroy_msg (root->watchidx, cb, arg) < 0)
+        return -1;
+    return 0;
+}
+
 /*
  * set/get root
  */
 
+/* Update root, and run watchers affected by 'keys' (NULL = all).
+ */
 static void setroot (kvs_ctx_t *ctx, struct kvsroot *root,
-                     const char *rootref, int rootseq)
+                     const char *rootref, int rootseq, json_t *keys)
 {
     if (rootseq == 0 || rootseq > root->seq) {
         assert (strlen (rootref) < sizeof (blobref_t));
         strcpy (root->ref, rootref);
         root->seq = rootseq;
-        /* log error on wait_runqueue(), don't error out.  watchers
+        /* log error on watchers_run(), don't error out.  watchers
          * may miss value change, but will never get older one.
          * Maintains consistency model */
-        if (wait_runqueue (root->watchlist) < 0)
-            flux_log_error (ctx->h, "%s: wait_runqueue", __FUNCTION__);
+        if (watchers_run (root, keys) < 0)
+            flux_log_error (ctx->h, "%s: watchers_run", __FUNCTION__);
         root->watchlist_lastrun_epoch = ctx->epoch;
     }
 }
@@ -361,7 +431,7 @@ static void getroot_completion (flux_future_t *f, void *arg)
      * the original callback
      */
     if (!root->remove)
-        setroot (ctx, root, ref, rootseq);
+        setroot (ctx, root, ref, rootseq, NULL);
 
     msg_cb_handler_call (mcb);
 
@@ -709,31 +779,125 @@ static int commit_cache_cb (commit_t *c, struct cache_entry *entry, void *data)
     return 0;
 }
 
+/* Return a JSON object mapping the names of entries in 'newdir' that
+ * differ from those in 'olddir' to their new dirent, or to null if the
+ * entry was removed.
+ */
+static json_t *rootdir_delta (const json_t *olddir, const json_t *newdir)
+{
+    const json_t *olddata, *newdata, *dirent;
+    const char *name;
+    json_t *delta;
+
+    if (!(olddata = treeobj_get_data ((json_t *)olddir))
+            || !(newdata = treeobj_get_data ((json_t *)newdir))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(delta = json_object ())) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    json_object_foreach ((json_t *)newdata, name, dirent) {
+        const json_t *old = json_object_get (olddata, name);
+        if (!old || !json_equal ((json_t *)old, (json_t *)dirent)) {
+            if (json_object_set (delta, name, (json_t *)dirent) < 0)
+                goto nomem;
+        }
+    }
+    json_object_foreach ((json_t *)olddata, name, dirent) {
+        if (!json_object_get (newdata, name)) {
+            if (json_object_set_new (delta, name, json_null ()) < 0)
+                goto nomem;
+        }
+    }
+    return delta;
+nomem:
+    json_decref (delta);
+    errno = ENOMEM;
+    return NULL;
+}
+
+/* If enabled, and the previous root dir object is available, return
+ * the changes from it to 'rootdir' as a JSON object:
+ *   { "prev":s "data":{ name:dirent|null, ... } }
+ * Returns NULL if the full rootdir should be sent instead.
+ */
+static json_t *setroot_delta_create (kvs_ctx_t *ctx, const char *prevref,
+                                     const json_t *rootdir)
+{
+    struct cache_entry *entry;
+    const json_t *prevdir;
+    json_t *delta = NULL;
+    json_t *o = NULL;
+
+    if (!ctx->setroot_delta || !prevref)
+        return NULL;
+    cache_lock (ctx->cache);
+    if (!(entry = cache_lookup (ctx->cache, prevref, ctx->epoch))
+            || !cache_entry_get_valid (entry)
+            || !(prevdir = cache_entry_get_treeobj (entry))
+            || !treeobj_is_dir (prevdir)
+            || !treeobj_is_dir (rootdir))
+        goto done;
+    if (!(delta = rootdir_delta (prevdir, rootdir))) {
+        flux_log_error (ctx->h, "%s: rootdir_delta", __FUNCTION__);
+        goto done;
+    }
+    /* Not worth it if most of the directory changed */
+    if (json_object_size (delta) >= treeobj_get_count (rootdir))
+        goto done;
+    if (!(o = json_pack ("{ s:s s:O }", "prev", prevref, "data", delta)))
+        flux_log_error (ctx->h, "%s: json_pack", __FUNCTION__);
+done:
+    cache_unlock (ctx->cache);
+    json_decref (delta);
+    return o;
+}
+
 static int setroot_event_send (kvs_ctx_t *ctx, struct kvsroot *root,
-                               json_t *names)
+                               json_t *names, json_t *keys,
+                               const char *prevref)
 {
     const json_t *root_dir = NULL;
+    json_t *root_delta = NULL;
     json_t *nullobj = NULL;
+    json_t *nokeys = NULL;
     flux_msg_t *msg = NULL;
     char *setroot_topic = NULL;
     int saved_errno, rc = -1;
 
     assert (ctx->rank == 0);
 
+    if (!(nullobj = json_null ())) {
+        saved_errno = errno;
+        flux_log_error (ctx->h, "%s: json_null", __FUNCTION__);
+        goto done;
+    }
+
     if (event_includes_rootdir) {
         struct cache_entry *entry;
 
         if ((entry = cache_lookup (ctx->cache, root->ref, ctx->epoch)))
             root_dir = cache_entry_get_treeobj (entry);
         assert (root_dir != NULL); // root entry is always in cache on rank 0
+
+        /* Send only the changed entries if followers can apply them
+         * to the previous root dir object.
+         */
+        if ((root_delta = setroot_delta_create (ctx, prevref, root_dir)))
+            root_dir = nullobj;
     }
-    else {
-        if (!(nullobj = json_null ())) {
+    else
+        root_dir = nullobj;
+
+    if (!keys || json_array_size (keys) > max_event_keys) {
+        if (!(nokeys = json_null ())) {
             saved_errno = errno;
             flux_log_error (ctx->h, "%s: json_null", __FUNCTION__);
             goto done;
         }
-        root_dir = nullobj;
+        keys = nokeys;
     }
 
     if (asprintf (&setroot_topic, "kvs.setroot.%s", root->namespace) < 0) {
@@ -742,12 +906,16 @@ static int setroot_event_send (kvs_ctx_t *ctx, struct kvsroot *root,
         goto done;
     }
 
-    if (!(msg = flux_event_pack (setroot_topic, "{ s:s s:i s:s s:O s:O }",
+    if (!(msg = flux_event_pack (setroot_topic,
+                                 "{ s:s s:i s:s s:O s:O s:O s:O }",
                                  "namespace", root->namespace,
                                  "rootseq", root->seq,
                                  "rootref", root->ref,
                                  "names", names,
-                                 "rootdir", root_dir))) {
+                                 "rootdir", root_dir,
+                                 "rootdelta", root_delta ? root_delta
+                                                         : nullobj,
+                                 "keys", keys))) {
         saved_errno = errno;
         flux_log_error (ctx->h, "%s: flux_event_pack", __FUNCTION__);
         goto done;
@@ -765,6 +933,8 @@ done:
     free (setroot_topic);
     flux_msg_destroy (msg);
     json_decref (nullobj);
+    json_decref (root_delta);
+    json_decref (nokeys);
     if (rc < 0)
         errno = saved_errno;
     return rc;
@@ -826,6 +996,59 @@ done:
     return rc;
 }
 
+/* A commit whose ops are being applied on a workpool thread.
+ * The root reference is copied since root->ref may change meanwhile.
+ */
+struct commit_job {
+    commit_t *c;
+    int epoch;
+    blobref_t ref;
+};
+
+static void commit_apply (commit_t *c);
+
+static void commit_job_work (void *arg)
+{
+    struct commit_job *job = arg;
+    commit_process_offload (job->c, job->epoch, job->ref);
+}
+
+static void commit_job_done (void *arg)
+{
+    struct commit_job *job = arg;
+    commit_t *c = job->c;
+
+    free (job);
+    commit_apply (c);
+}
+
+/* Hand commit 'c' to the workpool if it has CPU bound work to do.
+ * Return true if it was handed off, in which case commit_apply() is
+ * called again once the worker is finished.
+ */
+static bool commit_submit_job (kvs_ctx_t *ctx, struct kvsroot *root,
+                               commit_t *c)
+{
+    struct commit_job *job;
+
+    if (!ctx->workpool || !commit_offload (c))
+        return false;
+    if (!(job = calloc (1, sizeof (*job))))
+        goto error;
+    job->c = c;
+    job->epoch = ctx->epoch;
+    strcpy (job->ref, root->ref);
+    if (workpool_submit (ctx->workpool, commit_job_work,
+                         commit_job_done, job) < 0)
+        goto error;
+    return true;
+error:
+    /* commit stays blocked at head of ready list, so process it here */
+    flux_log_error (ctx->h, "%s: workpool_submit", __FUNCTION__);
+    free (job);
+    return false;
+}
+
 /* Commit all the ops for a particular commit/fence request (rank 0 only).
  * The setroot event will cause responses to be sent to the fence requests
  * and clean up the fence_t state.  This function is idempotent.
@@ -863,6 +1086,9 @@ static void commit_apply (commit_t *c)
     if ((errnum = commit_get_aux_errnum (c)))
         goto done;
 
+    if (commit_submit_job (ctx, root, c))
+        return;
+
     if ((ret = commit_process (c,
                                ctx->epoch,
                                root->ref)) == COMMIT_PROCESS_ERROR) {
@@ -933,6 +1159,7 @@ static void commit_apply (commit_t *c)
 done:
     if (errnum == 0) {
         fence_t *f = commit_get_fence (c);
+        blobref_t prevref;
         int count;
         if ((count = json_array_size (fence_get_json_names (f))) > 1) {
             int opcount = 0;
@@ -940,8 +1167,11 @@ done:
             flux_log (ctx->h, LOG_DEBUG, "aggregated %d commits (%d ops)",
                       count, opcount);
         }
-        setroot (ctx, root, commit_get_newroot_ref (c), root->seq + 1);
-        setroot_event_send (ctx, root, fence_get_json_names (f));
+        strcpy (prevref, root->ref);
+        setroot (ctx, root, commit_get_newroot_ref (c), root->seq + 1,
+                 commit_get_keys (c));
+        setroot_event_send (ctx, root, fence_get_json_names (f),
+                            commit_get_keys (c), prevref);
     } else {
         fence_t *f = commit_get_fence (c);
         flux_log (ctx->h, LOG_ERR, "commit failed: %s",
@@ -1084,7 +1314,7 @@ static int heartbeat_root_cb (struct kvsroot *root, void *arg)
     kvs_ctx_t *ctx = arg;
 
     if (root->remove) {
-        if (!wait_queue_length (root->watchlist)
+        if (!watchers_count (root)
             && !commit_mgr_fences_count (root->cm)
             && !commit_mgr_ready_commit_count (root->cm)) {
 
@@ -1101,7 +1331,7 @@ static int heartbeat_root_cb (struct kvsroot *root, void *arg)
              && !root->remove
              && strcasecmp (root->namespace, KVS_PRIMARY_NAMESPACE)
              && (ctx->epoch - root->watchlist_lastrun_epoch) > max_namespace_age
-             && !wait_queue_length (root->watchlist)
+             && !watchers_count (root)
              && !commit_mgr_fences_count (root->cm)
              && !commit_mgr_ready_commit_count (root->cm)) {
         /* remove a root if it not the primary one, has timed out
@@ -1112,13 +1342,13 @@ static int heartbeat_root_cb (struct kvsroot *root, void *arg)
     }
     else {
         /* "touch" objects involved in watched keys */
-        if (wait_queue_length (root->watchlist) > 0
+        if (watchers_count (root) > 0
             && (ctx->epoch - root->watchlist_lastrun_epoch) > max_lastuse_age) {
-            /* log error on wait_runqueue(), don't error out.  watchers
+            /* log error on watchers_run(), don't error out.  watchers
              * may miss value change, but will never get older one.
              * Maintains consistency model */
-            if (wait_runqueue (root->watchlist) < 0)
-                flux_log_error (ctx->h, "%s: wait_runqueue", __FUNCTION__);
+            if (watchers_run (root, NULL) < 0)
+                flux_log_error (ctx->h, "%s: watchers_run", __FUNCTION__);
             root->watchlist_lastrun_epoch = ctx->epoch;
         }
         /* "touch" root */
@@ -1144,6 +1374,7 @@ static void heartbeat_cb (flux_t *h, flux_msg_handler_t *mh,
 
     if (cache_expire_entries (ctx->cache, ctx->epoch, max_lastuse_age) < 0)
         flux_log_error (ctx->h, "%s: cache_expire_entries", __FUNCTION__);
+    ctx->trimmed += cache_trim (ctx->cache, ctx->epoch, min_trim_age);
 }
 
 static int lookup_load_cb (lookup_t *lh, const char *ref, void *data)
@@ -1226,6 +1457,8 @@ static void get_request_cb (flux_t *h, flux_msg_handler_t *mh,
 
         ret = lookup_set_aux_data (lh, ctx);
         assert (ret == 0);
+        ret = lookup_set_pathcache (lh, ctx->pathcache);
+        assert (ret == 0);
     }
     else {
         int err;
@@ -1463,7 +1696,10 @@ static void watch_request_cb (flux_t *h, flux_msg_handler_t *mh,
         out = true;
 
     /* No reply sent or this is a multi-response watch request.
-     * Arrange to wait on root->watchlist for each new commit.
+     * Arrange to wait for each new commit that changes the key.  Wait
+     * for every commit instead if the key was resolved through a symlink,
+     * or if the root changed while the lookup was stalled, since a
+     * change to the key may already have been missed.
      * Reconstruct the payload with 'first' flag clear, and updated value.
      */
     if (!out || !(flags & KVS_WATCH_ONCE)) {
@@ -1482,7 +1718,13 @@ static void watch_request_cb (flux_t *h, flux_msg_handler_t *mh,
         if (!(watcher = wait_create_msg_handler (h, mh, cpy, ctx,
                                                  watch_request_cb)))
             goto done;
-        if (wait_addqueue (root->watchlist, watcher) < 0) {
+        if (lookup_get_followed_link (lh)
+            || strcmp (lookup_get_root_ref (lh), root->ref) != 0)
+            ret = wait_addqueue (root->watchlist, watcher);
+        else
+            ret = watchidx_add (root->watchidx, lookup_get_path (lh),
+                                watcher);
+        if (ret < 0) {
             saved_errno = errno;
             wait_destroy (watcher);
             errno = saved_errno;
@@ -1586,9 +1828,9 @@ static void unwatch_request_cb (flux_t *h, flux_msg_handler_t *mh,
      * but cache_wait_destroy_msg() fails, it's not that big of a
      * deal.  The current state is still maintained.
      */
-    if (wait_destroy_msg (root->watchlist, unwatch_cmp, &p) < 0) {
+    if (watchers_destroy_msg (root, unwatch_cmp, &p) < 0) {
         errnum = errno;
-        flux_log_error (h, "%s: wait_destroy_msg", __FUNCTION__);
+        flux_log_error (h, "%s: watchers_destroy_msg", __FUNCTION__);
         goto done;
     }
     if (cache_wait_destroy_msg (ctx->cache, unwatch_cmp, &p) < 0) {
@@ -1769,7 +2011,8 @@ static void fence_request_cb (flux_t *h, flux_msg_handler_t *mh,
     else {
         flux_future_t *f;
 
-        if (!(f = flux_rpc_pack (h, "kvs.relayfence", 0, FLUX_RPC_NORESPONSE,
+        if (!(f = flux_rpc_pack (h, "kvs.relayfence", 0,
+                                 FLUX_RPC_NORESPONSE | FLUX_RPC_CBOR,
                                  "{ s:O s:s s:s s:i s:i }",
                                  "ops", ops,
                                  "name", name,
@@ -1927,14 +2170,18 @@ static void error_event_cb (flux_t *h, flux_msg_handler_t *mh,
 
 /* Optimization: the current rootdir object is optionally included
  * in the kvs.setroot event.  Prime the local cache with it.
+ * If 'rootref' is non-NULL, skip it unless it hashes to 'rootref'.
  * If there are complications, just skip it.  Not critical.
+ * Returns 0 if a new cache entry was added, else -1.
  */
-static void prime_cache_with_rootdir (kvs_ctx_t *ctx, json_t *rootdir)
+static int prime_cache_with_rootdir (kvs_ctx_t *ctx, json_t *rootdir,
+                                     const char *rootref)
 {
     struct cache_entry *entry;
     blobref_t ref;
     void *data = NULL;
     int len;
+    int rc = -1;
 
     if (treeobj_validate (rootdir) < 0 || !treeobj_is_dir (rootdir)) {
         flux_log (ctx->h, LOG_ERR, "%s: invalid rootdir", __FUNCTION__);
@@ -1949,6 +2196,11 @@ static void prime_cache_with_rootdir (kvs_ctx_t *ctx, json_t *rootdir)
         flux_log_error (ctx->h, "%s: blobref_hash", __FUNCTION__);
         goto done;
     }
+    if (rootref && strcmp (ref, rootref) != 0) {
+        flux_log (ctx->h, LOG_DEBUG, "%s: rootdir does not match %s",
+                  __FUNCTION__, rootref);
+        goto done;
+    }
     if ((entry = cache_lookup (ctx->cache, ref, ctx->epoch)))
         goto done; // already in cache, possibly dirty/invalid - we don't care
     if (!(entry = cache_entry_create ())) {
@@ -1961,8 +2213,64 @@ static void prime_cache_with_rootdir (kvs_ctx_t *ctx, json_t *rootdir)
         goto done;
     }
     cache_insert (ctx->cache, ref, entry);
+    rc = 0;
 done:
     free (data);
+    return rc;
+}
+
+/* Optimization: a kvs.setroot event may carry only the changes to the
+ * root dir since the previous rootseq.  If this is the next rootseq and
+ * the previous root dir is cached, apply them to it and prime the local
+ * cache with the result.  Otherwise the new root dir will be loaded on
+ * demand.
+ */
+static void prime_cache_with_rootdelta (kvs_ctx_t *ctx, struct kvsroot *root,
+                                        int rootseq, const char *rootref,
+                                        json_t *rootdelta)
+{
+    struct cache_entry *entry;
+    const json_t *prevdir;
+    json_t *rootdir = NULL;
+    json_t *data, *dirent;
+    const char *prev, *name;
+
+    if (json_unpack (rootdelta, "{ s:s s:o }",
+                     "prev", &prev,
+                     "data", &data) < 0) {
+        flux_log (ctx->h, LOG_ERR, "%s: invalid rootdelta", __FUNCTION__);
+        return;
+    }
+    /* missed a setroot */
+    if (rootseq != root->seq + 1 || strcmp (prev, root->ref) != 0)
+        return;
+    if ((entry = cache_lookup (ctx->cache, rootref, ctx->epoch)))
+        return;
+    if (!(entry = cache_lookup (ctx->cache, prev, ctx->epoch))
+            || !cache_entry_get_valid (entry)
+            || !(prevdir = cache_entry_get_treeobj (entry))
+            || !treeobj_is_dir (prevdir))
+        return;
+    if (!(rootdir = treeobj_copy ((json_t *)prevdir))) {
+        flux_log_error (ctx->h, "%s: treeobj_copy", __FUNCTION__);
+        return;
+    }
+    json_object_foreach (data, name, dirent) {
+        if (json_is_null (dirent)) {
+            if (treeobj_delete_entry (rootdir, name) < 0 && errno != ENOENT)
+                goto error;
+        }
+        else if (treeobj_insert_entry (rootdir, name, dirent) < 0)
+            goto error;
+    }
+    if (prime_cache_with_rootdir (ctx, rootdir, rootref) == 0)
+        ctx->rootdeltas_applied++;
+    json_decref (rootdir);
+    return;
+error:
+    flux_log_error (ctx->h, "%s: invalid rootdelta entry %s",
+                    __FUNCTION__, name);
+    json_decref (rootdir);
 }
 
 /* Alter the (rootref, rootseq) in response to a setroot event.
@@ -1976,15 +2284,19 @@ static void setroot_event_cb (flux_t *h, flux_msg_handler_t *mh,
     int rootseq;
     const char *rootref;
     json_t *rootdir = NULL;
+    json_t *rootdelta = NULL;
     json_t *names = NULL;
+    json_t *keys = NULL;
     int errnum = 0;
 
-    if (flux_event_unpack (msg, NULL, "{ s:s s:i s:s s:o s:o }",
+    if (flux_event_unpack (msg, NULL, "{ s:s s:i s:s s:o s:o s?o s?o }",
                            "namespace", &namespace,
                            "rootseq", &rootseq,
                            "rootref", &rootref,
                            "names", &names,
-                           "rootdir", &rootdir) < 0) {
+                           "rootdir", &rootdir,
+                           "rootdelta", &rootdelta,
+                           "keys", &keys) < 0) {
         flux_log_error (ctx->h, "%s: flux_event_unpack", __FUNCTION__);
         return;
     }
@@ -2012,14 +2324,19 @@ static void setroot_event_cb (flux_t *h, flux_msg_handler_t *mh,
     if (errnum)
         return;
 
-    /* Optimization: prime local cache with directory object, if provided
-     * in event message.  Ignore failure here - object will be fetched on
-     * demand from content cache if not in local cache.
+    /* Optimization: prime local cache with directory object, or the
+     * changes to it, if provided in event message.  Ignore failure here -
+     * object will be fetched on demand from content cache if not in
+     * local cache.
      */
     if (!json_is_null (rootdir))
-        prime_cache_with_rootdir (ctx, rootdir);
+        prime_cache_with_rootdir (ctx, rootdir, NULL);
+    else if (rootdelta && !json_is_null (rootdelta)) {
+        ctx->rootdeltas++;
+        prime_cache_with_rootdelta (ctx, root, rootseq, rootref, rootdelta);
+    }
 
-    setroot (ctx, root, rootref, rootseq);
+    setroot (ctx, root, rootref, rootseq, json_is_array (keys) ? keys : NULL);
 }
 
 static bool disconnect_cmp (const flux_msg_t *msg, void *arg)
@@ -2041,8 +2358,9 @@ static int disconnect_request_root_cb (struct kvsroot *root, void *arg)
 
     /* Log error, but don't return -1, can continue to iterate
      * remaining roots */
-    if (wait_destroy_msg (root->watchlist, disconnect_cmp, cbd->sender) < 0)
-        flux_log_error (cbd->ctx->h, "%s: wait_destroy_msg", __FUNCTION__);
+    if (watchers_destroy_msg (root, disconnect_cmp, cbd->sender) < 0)
+        flux_log_error (cbd->ctx->h, "%s: watchers_destroy_msg",
+                        __FUNCTION__);
 
     return 0;
 }
@@ -2082,7 +2400,7 @@ static int stats_get_root_cb (struct kvsroot *root, void *arg)
 
     if (!(s = json_pack ("{ s:i s:i s:i s:i s:i }",
                          "#watchers",
-                         wait_queue_length (root->watchlist),
+                         watchers_count (root),
                          "#no-op stores",
                          commit_mgr_get_noop_stores (root->cm),
                          "#fences",
@@ -2108,6 +2426,8 @@ static void stats_get_cb (flux_t *h, flux_msg_handler_t *mh,
     tstat_t ts = { .min = 0.0, .max = 0.0, .M = 0.0, .S = 0.0, .newM = 0.0,
                    .newS = 0.0, .n = 0 };
     int size = 0, incomplete = 0, dirty = 0;
+    int lookup_hits = 0, lookup_misses = 0;
+    size_t raw_bytes, treeobj_bytes, max_bytes;
     int rc = -1;
     double scale = 1E-3;
 
@@ -2130,12 +2450,31 @@ static void stats_get_cb (flux_t *h, flux_msg_handler_t *mh,
         goto done;
     }
 
-    if (!(cstats = json_pack ("{ s:f s:O s:i s:i s:i }",
+    if (ctx->pathcache)
+        pathcache_get_stats (ctx->pathcache, &lookup_hits, &lookup_misses);
+
+    cache_get_bytes (ctx->cache, &raw_bytes, &treeobj_bytes, &max_bytes);
+
+    if (!(cstats = json_pack ("{ s:f s:O s:f s:f s:f"
+                              "  s:i s:i s:i s:i s:i s:i s:i s:i s:i }",
                               "obj size total (MiB)", (double)size/1048576,
                               "obj size (KiB)", tstats,
+                              "raw size (MiB)", (double)raw_bytes/1048576,
+                              "treeobj size (MiB)",
+                              (double)treeobj_bytes/1048576,
+                              "size limit (MiB)", (double)max_bytes/1048576,
+                              "#obj trimmed", ctx->trimmed,
                               "#obj dirty", dirty,
                               "#obj incomplete", incomplete,
-                              "#faults", ctx->faults))) {
+                              "#faults", ctx->faults,
+                              "#lookup cache hits", lookup_hits,
+                              "#lookup cache misses", lookup_misses,
+                              "#lookup cache entries",
+                              ctx->pathcache ? pathcache_count (ctx->pathcache)
+                                             : 0,
+                              "#rootdir deltas", ctx->rootdeltas,
+                              "#rootdir deltas applied",
+                              ctx->rootdeltas_applied))) {
         errno = ENOMEM;
         goto done;
     }
@@ -2195,6 +2534,11 @@ static int stats_clear_root_cb (struct kvsroot *root, void *arg)
 static void stats_clear (kvs_ctx_t *ctx)
 {
     ctx->faults = 0;
+    ctx->trimmed = 0;
+    ctx->rootdeltas = 0;
+    ctx->rootdeltas_applied = 0;
+    if (ctx->pathcache)
+        pathcache_clear_stats (ctx->pathcache);
 
     if (kvsroot_mgr_iter_roots (ctx->km, stats_clear_root_cb, NULL) < 0)
         flux_log_error (ctx->h, "%s: kvsroot_mgr_iter_roots", __FUNCTION__);
@@ -2242,6 +2586,7 @@ static int namespace_create (kvs_ctx_t *ctx, const char *namespace, int flags)
         flux_log_error (ctx->h, "%s: kvsroot_mgr_create_root", __FUNCTION__);
         goto cleanup;
     }
+    commit_mgr_set_dir_shard (root->cm, ctx->dir_shard);
 
     if (!(rootdir = treeobj_create_dir ())) {
         flux_log_error (ctx->h, "%s: treeobj_create_dir", __FUNCTION__);
@@ -2259,7 +2604,7 @@ static int namespace_create (kvs_ctx_t *ctx, const char *namespace, int flags)
         goto cleanup_remove_root;
     }
 
-    setroot (ctx, root, ref, 0);
+    setroot (ctx, root, ref, 0, NULL);
 
     if (event_subscribe (ctx, namespace) < 0) {
         flux_log_error (ctx->h, "%s: event_subscribe", __FUNCTION__);
@@ -2326,12 +2671,12 @@ static void start_root_remove (kvs_ctx_t *ctx, const char *namespace)
         root->remove = true;
 
         /* Now that root has been marked for removal from roothash, run
-         * the watchlist.  watch requests will notice root removed, return
+         * all watchers.  watch requests will notice root removed, return
          * ENOTSUP to watchers.
          */
 
-        if (wait_runqueue (root->watchlist) < 0)
-            flux_log_error (ctx->h, "%s: wait_runqueue", __FUNCTION__);
+        if (watchers_run (root, NULL) < 0)
+            flux_log_error (ctx->h, "%s: watchers_run", __FUNCTION__);
 
         /* Ready fences will be processed and errors returned to
          * callers via the code path in commit_apply().  But not ready
@@ -2466,6 +2811,16 @@ static void process_args (kvs_ctx_t *ctx, int ac, char **av)
     for (i = 0; i < ac; i++) {
         if (strncmp (av[i], "commit-merge=", 13) == 0)
             ctx->commit_merge = strtoul (av[i]+13, NULL, 10);
+        else if (strncmp (av[i], "commit-threads=", 15) == 0)
+            ctx->commit_threads = strtoul (av[i]+15, NULL, 10);
+        else if (strncmp (av[i], "setroot-delta=", 14) == 0)
+            ctx->setroot_delta = strtoul (av[i]+14, NULL, 10);
+        else if (strncmp (av[i], "dir-shard=", 10) == 0)
+            ctx->dir_shard = strtoul (av[i]+10, NULL, 10);
+        else if (strncmp (av[i], "lookup-cache=", 13) == 0)
+            ctx->lookup_cache = strtoul (av[i]+13, NULL, 10);
+        else if (strncmp (av[i], "cache-max-bytes=", 16) == 0)
+            ctx->cache_max_bytes = strtoull (av[i]+16, NULL, 10);
         else
             flux_log (ctx->h, LOG_ERR, "Unknown option `%s'", av[i]);
     }
@@ -2550,10 +2905,25 @@ int mod_main (flux_t *h, int argc, char **argv)
         goto done;
     }
     process_args (ctx, argc, argv);
+    cache_set_max_bytes (ctx->cache, ctx->cache_max_bytes);
+    if (ctx->lookup_cache > 0) {
+        if (!(ctx->pathcache = pathcache_create (ctx->lookup_cache))) {
+            flux_log_error (h, "pathcache_create");
+            goto done;
+        }
+    }
     if (ctx->rank == 0) {
         struct kvsroot *root;
         blobref_t rootref;
 
+        if (ctx->commit_threads > 0) {
+            if (!(ctx->workpool = workpool_create (flux_get_reactor (h),
+                                                   ctx->commit_threads))) {
+                flux_log_error (h, "workpool_create");
+                goto done;
+            }
+        }
+
         if (store_initial_rootdir (ctx, rootref) < 0) {
             flux_log_error (h, "storing initial root object");
             goto done;
@@ -2573,9 +2943,10 @@ int mod_main (flux_t *h, int argc, char **argv)
                 flux_log_error (h, "kvsroot_mgr_create_root");
                 goto done;
             }
+            commit_mgr_set_dir_shard (root->cm, ctx->dir_shard);
         }
 
-        setroot (ctx, root, rootref, 0);
+        setroot (ctx, root, rootref, 0, NULL);
 
         if (event_subscribe (ctx, KVS_PRIMARY_NAMESPACE) < 0) {
             flux_log_error (h, "event_subscribe");
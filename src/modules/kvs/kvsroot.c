@@ -100,6 +100,7 @@ static void kvsroot_destroy (void *data)
             commit_mgr_destroy (root->cm);
         if (root->watchlist)
             wait_queue_destroy (root->watchlist);
+        watchidx_destroy (root->watchidx);
         free (data);
     }
 }
@@ -143,6 +144,11 @@ struct kvsroot *kvsroot_mgr_create_root (kvsroot_mgr_t *km,
         goto error;
     }
 
+    if (!(root->watchidx = watchidx_create ())) {
+        flux_log_error (km->h, "watchidx_create");
+        goto error;
+    }
+
     root->flags = flags;
     root->remove = false;
 
@@ -7,6 +7,7 @@
 #include "cache.h"
 #include "commit.h"
 #include "waitqueue.h"
+#include "watchidx.h"
 #include "src/common/libutil/blobref.h"
 
 typedef struct kvsroot_mgr kvsroot_mgr_t;
@@ -16,7 +17,8 @@ struct kvsroot {
     int seq;
     blobref_t ref;
     commit_mgr_t *cm;
-    waitqueue_t *watchlist;
+    waitqueue_t *watchlist;     /* syncs, and watches not indexed by key */
+    watchidx_t *watchidx;       /* watches indexed by key */
     int watchlist_lastrun_epoch;
     int flags;
     bool remove;
@@ -41,6 +41,7 @@
 
 #include "cache.h"
 #include "kvs_util.h"
+#include "pathcache.h"
 
 #include "lookup.h"
 
@@ -83,9 +84,15 @@ struct lookup {
      */
     const json_t *valref_missing_refs;
     const char *missing_ref;
+    json_t *missing_refs;       /* hdir buckets to load for READDIR */
 
     int errnum;                 /* errnum if error */
     int aux_errnum;
+    bool followed_link;         /* a symlink was resolved during walk */
+
+    pathcache_t *pc;            /* optional cache of walk results */
+    bool pc_checked;
+    json_t *pc_dirent;          /* walk result from 'pc' */
 
     /* API internal */
     json_t *root_dirent;
@@ -100,6 +107,111 @@ struct lookup {
     } state;
 };
 
+/* Look up the dir or hdir referenced by bucket 'dirref' in the cache.
+ * If it is not there, set *stall and return NULL.  On error, set
+ * lh->errnum and return NULL.
+ */
+static const json_t *bucket_load (lookup_t *lh, const json_t *dirref,
+                                  bool *stall)
+{
+    struct cache_entry *entry;
+    const json_t *bucket;
+    const char *refstr;
+
+    *stall = false;
+    if (treeobj_get_count (dirref) != 1
+        || !(refstr = treeobj_get_blobref (dirref, 0))) {
+        lh->errnum = ENOTRECOVERABLE;
+        return NULL;
+    }
+    if (!(entry = cache_lookup (lh->cache, refstr, lh->current_epoch))
+        || !cache_entry_get_valid (entry)) {
+        lh->missing_ref = refstr;
+        *stall = true;
+        return NULL;
+    }
+    if (!(bucket = cache_entry_get_treeobj (entry))
+        || !(treeobj_is_dir (bucket) || treeobj_is_hdir (bucket))) {
+        flux_log (lh->h, LOG_ERR, "hdir bucket is not a directory");
+        lh->errnum = ENOTRECOVERABLE;
+        return NULL;
+    }
+    return bucket;
+}
+
+/* Descend through the buckets of hdir 'dir' to the dir that holds
+ * entry 'name'.  Return the dir, or NULL if there is no such bucket,
+ * if a bucket must be loaded (*stall is set), or on error (lh->errnum
+ * is set).
+ */
+static const json_t *hdir_lookup (lookup_t *lh, const json_t *dir,
+                                  const char *name, bool *stall)
+{
+    char key[TREEOBJ_HDIR_MAX_KEYLEN + 1];
+    int keylen = 1;
+
+    *stall = false;
+    while (dir && treeobj_is_hdir (dir)) {
+        if (keylen > TREEOBJ_HDIR_MAX_KEYLEN
+            || treeobj_hdir_key (name, keylen, key) < 0) {
+            lh->errnum = ENOTRECOVERABLE;
+            return NULL;
+        }
+        if (!(dir = treeobj_peek_entry (dir, key)))
+            return NULL;
+        if (treeobj_is_dirref (dir))
+            dir = bucket_load (lh, dir, stall);
+        keylen++;
+    }
+    return dir;
+}
+
+/* Copy the entries of all buckets of hdir 'hdir' into dir 'dir'.
+ * Buckets that are not in the cache are added to lh->missing_refs.
+ * Return 0 on success, -1 on error with lh->errnum set.
+ */
+static int hdir_flatten (lookup_t *lh, const json_t *hdir, json_t *dir)
+{
+    const json_t *bucket, *o;
+    const char *key, *name;
+    json_t *cpy;
+    bool stall;
+
+    json_object_foreach ((json_t *)treeobj_get_data ((json_t *)hdir),
+                         key, bucket) {
+        if (treeobj_is_dirref (bucket)) {
+            if (!(bucket = bucket_load (lh, bucket, &stall))) {
+                if (!stall)
+                    return -1;
+                if ((!lh->missing_refs
+                     && !(lh->missing_refs = json_array ()))
+                    || json_array_append_new (lh->missing_refs,
+                                       json_string (lh->missing_ref)) < 0) {
+                    lh->errnum = ENOMEM;
+                    return -1;
+                }
+                continue;
+            }
+        }
+        if (treeobj_is_hdir (bucket)) {
+            if (hdir_flatten (lh, bucket, dir) < 0)
+                return -1;
+            continue;
+        }
+        json_object_foreach ((json_t *)treeobj_get_data ((json_t *)bucket),
+                             name, o) {
+            if (!(cpy = treeobj_deep_copy (o))
+                || treeobj_insert_entry (dir, name, cpy) < 0) {
+                lh->errnum = errno;
+                json_decref (cpy);
+                return -1;
+            }
+            json_decref (cpy);
+        }
+    }
+    return 0;
+}
+
 static bool last_pathcomp (zlist_t *pathcomps, const void *data)
 {
     return (zlist_tail (pathcomps) == data);
@@ -266,7 +378,7 @@ static bool walk (lookup_t *lh)
                     lh->errnum = ENOTRECOVERABLE;
                 goto error;
             }
-            if (!treeobj_is_dir (dir)) {
+            if (!treeobj_is_dir (dir) && !treeobj_is_hdir (dir)) {
                 /* dirref pointed to non-dir error, special case when
                  * root_dirent is bad, is EINVAL from user.
                  */
@@ -276,6 +388,16 @@ static bool walk (lookup_t *lh)
                     lh->errnum = ENOTRECOVERABLE;
                 goto error;
             }
+            if (treeobj_is_hdir (dir)) {
+                bool stall;
+
+                /* a missing bucket is like a missing entry */
+                if (!(dir = hdir_lookup (lh, dir, pathcomp, &stall))) {
+                    if (stall)
+                        goto stall;
+                    goto error;
+                }
+            }
         } else {
             /* Unexpected dirent type */
             if (treeobj_is_valref (wl->dirent)
@@ -329,6 +451,8 @@ static bool walk (lookup_t *lh)
                     goto error;
                 }
 
+                lh->followed_link = true;
+
                 /* "recursively" determine link dirent */
                 if (!(wl = walk_levels_push (lh,
                                              linkstr,
@@ -456,6 +580,8 @@ void lookup_destroy (lookup_t *lh)
         free (lh->root_ref);
         free (lh->path);
         json_decref (lh->val);
+        json_decref (lh->missing_refs);
+        json_decref (lh->pc_dirent);
         json_decref (lh->root_dirent);
         zlist_destroy (&lh->levels);
         lh->magic = ~LOOKUP_MAGIC;
@@ -499,6 +625,35 @@ int lookup_set_aux_errnum (lookup_t *lh, int errnum)
     return EINVAL;
 }
 
+/* A symlink in the last path component is followed unless the
+ * caller asked for the link (or treeobj) itself.
+ */
+static bool follow_last_link (lookup_t *lh)
+{
+    return !(lh->flags & FLUX_KVS_READLINK)
+           && !(lh->flags & FLUX_KVS_TREEOBJ);
+}
+
+/* Try the walk result cache once per lookup.  On a hit, set lh->wdirent
+ * as walk() would, and return true.
+ */
+static bool walk_cached (lookup_t *lh)
+{
+    const json_t *dirent;
+    bool followed_link;
+
+    if (!lh->pc || lh->pc_checked)
+        return false;
+    lh->pc_checked = true;
+    if (pathcache_lookup (lh->pc, lh->root_ref, lh->path,
+                          follow_last_link (lh), &dirent, &followed_link) < 0)
+        return false;
+    lh->pc_dirent = json_incref ((json_t *)dirent);
+    lh->wdirent = lh->pc_dirent;
+    lh->followed_link = followed_link;
+    return true;
+}
+
 json_t *lookup_get_value (lookup_t *lh)
 {
     if (lh
@@ -516,7 +671,16 @@ int lookup_iter_missing_refs (lookup_t *lh, lookup_ref_f cb, void *data)
         && (lh->state == LOOKUP_STATE_CHECK_ROOT
             || lh->state == LOOKUP_STATE_WALK
             || lh->state == LOOKUP_STATE_VALUE)) {
-        if (lh->valref_missing_refs) {
+        if (lh->missing_refs) {
+            size_t index;
+            json_t *o;
+
+            json_array_foreach (lh->missing_refs, index, o) {
+                if (cb (lh, json_string_value (o), data) < 0)
+                    return -1;
+            }
+        }
+        else if (lh->valref_missing_refs) {
             int refcount, i;
 
             if (!treeobj_is_valref (lh->valref_missing_refs)) {
@@ -596,6 +760,13 @@ int lookup_get_flags (lookup_t *lh)
     return -1;
 }
 
+bool lookup_get_followed_link (lookup_t *lh)
+{
+    if (lh && lh->magic == LOOKUP_MAGIC)
+        return lh->followed_link;
+    return false;
+}
+
 void *lookup_get_aux_data (lookup_t *lh)
 {
     if (lh && lh->magic == LOOKUP_MAGIC)
@@ -612,6 +783,15 @@ int lookup_set_current_epoch (lookup_t *lh, int epoch)
     return -1;
 }
 
+int lookup_set_pathcache (lookup_t *lh, pathcache_t *pc)
+{
+    if (lh && lh->magic == LOOKUP_MAGIC) {
+        lh->pc = pc;
+        return 0;
+    }
+    return -1;
+}
+
 int lookup_set_aux_data (lookup_t *lh, void *data)
 {
     if (lh && lh->magic == LOOKUP_MAGIC) {
@@ -777,6 +957,9 @@ bool lookup (lookup_t *lh)
         return true;
     }
 
+    json_decref (lh->missing_refs);
+    lh->missing_refs = NULL;
+
     switch (lh->state) {
         case LOOKUP_STATE_INIT:
         case LOOKUP_STATE_CHECK_ROOT:
@@ -822,8 +1005,17 @@ bool lookup (lookup_t *lh)
             lh->state = LOOKUP_STATE_WALK;
             /* fallthrough */
         case LOOKUP_STATE_WALK:
-            if (!walk (lh))
-                goto stall;
+            if (!walk_cached (lh)) {
+                if (!walk (lh))
+                    goto stall;
+                if (lh->pc && lh->errnum == 0) {
+                    if (pathcache_insert (lh->pc, lh->root_ref, lh->path,
+                                          follow_last_link (lh), lh->wdirent,
+                                          lh->followed_link) < 0)
+                        flux_log_error (lh->h, "%s: pathcache_insert",
+                                        __FUNCTION__);
+                }
+            }
             if (lh->errnum != 0)
                 goto done;
             if (!lh->wdirent) {
@@ -874,6 +1066,22 @@ bool lookup (lookup_t *lh)
                     lh->errnum = ENOTRECOVERABLE;
                     goto done;
                 }
+                if (treeobj_is_hdir (valtmp)) {
+                    /* return sharded dir as a single dir */
+                    if (!(lh->val = treeobj_create_dir ())) {
+                        lh->errnum = errno;
+                        goto done;
+                    }
+                    if (hdir_flatten (lh, valtmp, lh->val) < 0
+                        || lh->missing_refs) {
+                        json_decref (lh->val);
+                        lh->val = NULL;
+                        if (lh->errnum)
+                            goto done;
+                        goto stall;
+                    }
+                    goto done;
+                }
                 if (!treeobj_is_dir (valtmp)) {
                     /* dirref points to not dir */
                     lh->errnum = ENOTRECOVERABLE;
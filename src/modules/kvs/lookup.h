@@ -3,6 +3,7 @@
 
 #include <flux/core.h>
 #include "cache.h"
+#include "pathcache.h"
 
 typedef struct lookup lookup_t;
 
@@ -45,7 +46,8 @@ int lookup_set_aux_errnum (lookup_t *lh, int errnum);
 json_t *lookup_get_value (lookup_t *lh);
 
 /* On lookup stall, get missing reference that should be loaded into
- * the KVS cache via callback function.
+ * the KVS cache via callback function.  There may be several, e.g.
+ * the buckets of a sharded directory being read.
  *
  * return -1 in callback to break iteration
  */
@@ -82,6 +84,11 @@ const char *lookup_get_path (lookup_t *lh);
  */
 int lookup_get_flags (lookup_t *lh);
 
+/* Returns true if resolving the path followed a symlink, so the
+ * value depends on keys other than the path and its ancestors.
+ */
+bool lookup_get_followed_link (lookup_t *lh);
+
 /* Get auxiliarry data set by user */
 void *lookup_get_aux_data (lookup_t *lh);
 
@@ -94,6 +101,11 @@ int lookup_set_current_epoch (lookup_t *lh, int epoch);
  */
 int lookup_set_aux_data (lookup_t *lh, void *data);
 
+/* Use 'pc' to skip the walk of a path already resolved against the
+ * same root, and to remember the result of a new walk.
+ */
+int lookup_set_pathcache (lookup_t *lh, pathcache_t *pc);
+
 /* Lookup the key path in the KVS cache starting at root.
  *
  * Return true on success or error.  After return, error should be
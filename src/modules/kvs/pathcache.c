@@ -0,0 +1,207 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* pathcache.c - cache of resolved (rootref, path) lookups */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <czmq.h>
+#include <jansson.h>
+
+#include "pathcache.h"
+
+struct pathent {
+    json_t *dirent;
+    bool followed_link;
+};
+
+struct pathcache {
+    zhash_t *young;
+    zhash_t *old;
+    int maxsize;
+    int hits;
+    int misses;
+};
+
+static void pathent_destroy (void *arg)
+{
+    struct pathent *pe = arg;
+
+    if (pe) {
+        json_decref (pe->dirent);
+        free (pe);
+    }
+}
+
+static char *pathkey (const char *rootref, const char *path, bool follow)
+{
+    char *key;
+
+    if (asprintf (&key, "%s:%c:%s", rootref, follow ? 'f' : 'n', path) < 0) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return key;
+}
+
+/* Add 'pe' to the young generation, first aging the generations if
+ * it is full.  On error, 'pe' is destroyed.
+ */
+static int pathent_insert (pathcache_t *pc, const char *key,
+                           struct pathent *pe)
+{
+    int half = pc->maxsize > 1 ? pc->maxsize / 2 : 1;
+
+    if (zhash_size (pc->young) >= half) {
+        zhash_t *tmp;
+
+        if (!(tmp = zhash_new ())) {
+            pathent_destroy (pe);
+            errno = ENOMEM;
+            return -1;
+        }
+        zhash_destroy (&pc->old);
+        pc->old = pc->young;
+        pc->young = tmp;
+    }
+    zhash_delete (pc->young, key);
+    if (zhash_insert (pc->young, key, pe) < 0) {
+        pathent_destroy (pe);
+        errno = ENOMEM;
+        return -1;
+    }
+    zhash_freefn (pc->young, key, pathent_destroy);
+    return 0;
+}
+
+pathcache_t *pathcache_create (int maxsize)
+{
+    pathcache_t *pc;
+
+    if (maxsize < 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(pc = calloc (1, sizeof (*pc)))
+            || !(pc->young = zhash_new ())
+            || !(pc->old = zhash_new ())) {
+        pathcache_destroy (pc);
+        errno = ENOMEM;
+        return NULL;
+    }
+    pc->maxsize = maxsize;
+    return pc;
+}
+
+void pathcache_destroy (pathcache_t *pc)
+{
+    if (pc) {
+        int saved_errno = errno;
+        zhash_destroy (&pc->young);
+        zhash_destroy (&pc->old);
+        free (pc);
+        errno = saved_errno;
+    }
+}
+
+int pathcache_lookup (pathcache_t *pc, const char *rootref, const char *path,
+                      bool follow, const json_t **dirent, bool *followed_link)
+{
+    struct pathent *pe;
+    char *key;
+
+    if (!(key = pathkey (rootref, path, follow)))
+        return -1;
+    if (!(pe = zhash_lookup (pc->young, key))) {
+        /* promote a hit in the old generation */
+        if ((pe = zhash_lookup (pc->old, key))) {
+            zhash_freefn (pc->old, key, NULL);
+            zhash_delete (pc->old, key);
+            if (pathent_insert (pc, key, pe) < 0)
+                pe = NULL;
+        }
+    }
+    free (key);
+    if (!pe) {
+        pc->misses++;
+        errno = ENOENT;
+        return -1;
+    }
+    pc->hits++;
+    *dirent = pe->dirent;
+    *followed_link = pe->followed_link;
+    return 0;
+}
+
+int pathcache_insert (pathcache_t *pc, const char *rootref, const char *path,
+                      bool follow, const json_t *dirent, bool followed_link)
+{
+    struct pathent *pe;
+    char *key;
+    int rc;
+
+    if (!(key = pathkey (rootref, path, follow)))
+        return -1;
+    if (!(pe = calloc (1, sizeof (*pe)))
+            || (dirent && !(pe->dirent = json_deep_copy (dirent)))) {
+        free (pe);
+        free (key);
+        errno = ENOMEM;
+        return -1;
+    }
+    pe->followed_link = followed_link;
+    zhash_delete (pc->old, key);
+    rc = pathent_insert (pc, key, pe);
+    free (key);
+    return rc;
+}
+
+int pathcache_count (pathcache_t *pc)
+{
+    return zhash_size (pc->young) + zhash_size (pc->old);
+}
+
+void pathcache_get_stats (pathcache_t *pc, int *hits, int *misses)
+{
+    if (hits)
+        *hits = pc->hits;
+    if (misses)
+        *misses = pc->misses;
+}
+
+void pathcache_clear_stats (pathcache_t *pc)
+{
+    pc->hits = 0;
+    pc->misses = 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,75 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#ifndef _FLUX_KVS_PATHCACHE_H
+#define _FLUX_KVS_PATHCACHE_H
+
+#include <stdbool.h>
+#include <jansson.h>
+
+/* A pathcache_t remembers the dirent that a path resolved to, relative
+ * to a root blobref.  Since a root blobref names immutable content, an
+ * entry never becomes stale; entries for old roots simply age out.
+ * Negative results (no such path) are cached as a NULL dirent.
+ *
+ * The cache holds up to 'maxsize' entries (at least 2) in two
+ * generations.  New and recently used entries go in the young
+ * generation.  When it fills to maxsize/2, the old generation is
+ * dropped and the young one takes its place.
+ */
+
+typedef struct pathcache pathcache_t;
+
+pathcache_t *pathcache_create (int maxsize);
+void pathcache_destroy (pathcache_t *pc);
+
+/* Look up 'path' relative to 'rootref'.  'follow' indicates whether a
+ * symlink in the final path component was followed.  On a hit, set
+ * *dirent (owned by the cache, NULL if the path does not exist) and
+ * *followed_link, and return 0.  On a miss, return -1 with errno = ENOENT.
+ */
+int pathcache_lookup (pathcache_t *pc, const char *rootref, const char *path,
+                      bool follow, const json_t **dirent, bool *followed_link);
+
+/* Remember that 'path' relative to 'rootref' resolved to 'dirent'
+ * (copied), or to nothing if 'dirent' is NULL.
+ * Returns -1 on error, 0 on success.
+ */
+int pathcache_insert (pathcache_t *pc, const char *rootref, const char *path,
+                      bool follow, const json_t *dirent, bool followed_link);
+
+/* Return the number of entries.
+ */
+int pathcache_count (pathcache_t *pc);
+
+/* Get/clear hit and miss counters.
+ */
+void pathcache_get_stats (pathcache_t *pc, int *hits, int *misses);
+void pathcache_clear_stats (pathcache_t *pc);
+
+#endif /* !_FLUX_KVS_PATHCACHE_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -556,6 +556,95 @@ void cache_expiration_tests (void)
     cache_destroy (cache);
 }
 
+void cache_trim_tests (void)
+{
+    struct cache *cache;
+    struct cache_entry *e;
+    size_t raw_bytes, treeobj_bytes, max_bytes;
+    char ref[32];
+    json_t *o;
+    int i;
+
+    ok ((cache = cache_create ()) != NULL,
+        "cache_create works");
+    cache_get_bytes (cache, &raw_bytes, &treeobj_bytes, &max_bytes);
+    ok (raw_bytes == 0 && treeobj_bytes == 0 && max_bytes == 0,
+        "cache_get_bytes reports empty, unlimited cache");
+
+    /* Insert 8 entries in epoch 1, decoding each of them.
+     */
+    for (i = 0; i < 8; i++) {
+        snprintf (ref, sizeof (ref), "ref%d", i);
+        if (!(o = treeobj_create_val (ref, strlen (ref)))
+            || !(e = cache_entry_create ())
+            || cache_entry_set_treeobj (e, o) < 0)
+            BAIL_OUT ("could not create cache entry");
+        json_decref (o);
+        cache_insert (cache, ref, e);
+        if (!(e = cache_lookup (cache, ref, 1))
+            || !cache_entry_get_treeobj (e))
+            BAIL_OUT ("could not decode cache entry");
+    }
+    cache_get_bytes (cache, &raw_bytes, &treeobj_bytes, NULL);
+    ok (raw_bytes > 0 && treeobj_bytes > 0,
+        "cache_get_bytes accounts for raw and decoded data");
+    ok (cache_trim (cache, 2, 0) == 0 && cache_count_entries (cache) == 8,
+        "cache_trim removes nothing without a budget");
+
+    /* ref0 is now the most recently used entry */
+    ok (cache_lookup (cache, "ref0", 1) != NULL,
+        "cache_lookup ref0 works");
+
+    cache_set_max_bytes (cache, raw_bytes);
+    ok (cache_trim (cache, 1, 0) == 0,
+        "cache_trim removes nothing used in the current epoch");
+    cache_get_bytes (cache, NULL, &treeobj_bytes, NULL);
+    ok (treeobj_bytes > 0,
+        "and leaves decoded treeobjs alone");
+    ok (cache_trim (cache, 2, 1) == 0,
+        "cache_trim removes nothing used within thresh epochs");
+    cache_get_bytes (cache, NULL, &treeobj_bytes, NULL);
+    ok (treeobj_bytes > 0,
+        "and leaves decoded treeobjs alone");
+
+    ok (cache_trim (cache, 2, 0) == 0 && cache_count_entries (cache) == 8,
+        "cache_trim within raw size removes no entries");
+    cache_get_bytes (cache, NULL, &treeobj_bytes, NULL);
+    ok (treeobj_bytes == 0,
+        "but drops decoded treeobjs");
+    ok ((e = cache_lookup (cache, "ref1", 1)) != NULL
+        && cache_entry_get_treeobj (e) != NULL,
+        "dropped treeobj is decoded again on demand");
+
+    cache_set_max_bytes (cache, raw_bytes / 2);
+    ok (cache_entry_set_dirty (cache_lookup (cache, "ref2", 1), true) == 0,
+        "cache_entry_set_dirty ref2 works");
+    ok (cache_trim (cache, 2, 0) == 4,
+        "cache_trim removes 4 entries to get within budget");
+    cache_get_bytes (cache, &raw_bytes, &treeobj_bytes, &max_bytes);
+    ok (raw_bytes + treeobj_bytes <= max_bytes,
+        "cache is within budget");
+    ok (cache_lookup (cache, "ref2", 1) != NULL,
+        "dirty entry was not removed");
+    ok (cache_lookup (cache, "ref0", 1) != NULL
+        && cache_lookup (cache, "ref1", 1) != NULL,
+        "most recently used entries were not removed");
+    ok (cache_lookup (cache, "ref3", 1) == NULL
+        && cache_lookup (cache, "ref6", 1) == NULL
+        && cache_lookup (cache, "ref7", 1) != NULL,
+        "least recently used entries were removed");
+
+    ok (cache_entry_set_dirty (cache_lookup (cache, "ref2", 1), false) == 0,
+        "cache_entry_set_dirty ref2 false works");
+    ok (cache_expire_entries (cache, 2, 0) == 4,
+        "cache_expire_entries thresh=0 expires the rest");
+    cache_get_bytes (cache, &raw_bytes, &treeobj_bytes, NULL);
+    ok (raw_bytes == 0 && treeobj_bytes == 0,
+        "cache_get_bytes reports empty cache");
+
+    cache_destroy (cache);
+}
+
 int main (int argc, char *argv[])
 {
     plan (NO_PLAN);
@@ -567,6 +656,7 @@ int main (int argc, char *argv[])
     waiter_tests ();
     cache_expiration_tests ();
     cache_remove_entry_tests ();
+    cache_trim_tests ();
 
     done_testing ();
     return (0);
@@ -599,6 +599,70 @@ void commit_basic_commit_process_test (void)
     cache_destroy (cache);
 }
 
+void commit_process_offload_test (void)
+{
+    struct cache *cache;
+    int count = 0;
+    commit_mgr_t *cm;
+    commit_t *c;
+    blobref_t rootref;
+    const char *newroot;
+
+    cache = create_cache_with_empty_rootdir (rootref);
+
+    ok ((cm = commit_mgr_create (cache,
+                                 KVS_PRIMARY_NAMESPACE,
+                                 "sha1",
+                                 NULL,
+                                 &test_global)) != NULL,
+        "commit_mgr_create works");
+
+    create_ready_commit (cm, "fence1", "dir.key1", "1", 0, 0);
+
+    ok ((c = commit_mgr_get_ready_commit (cm)) != NULL,
+        "commit_mgr_get_ready_commit returns ready commit");
+
+    ok (commit_offload (c) == true,
+        "commit_offload returns true for new commit");
+
+    ok (commit_mgr_get_ready_commit (cm) == NULL,
+        "commit_mgr_get_ready_commit returns NULL for offloaded commit");
+
+    count = cache_count_entries (cache);
+    commit_process_offload (c, 1, rootref);
+
+    ok (cache_count_entries (cache) == count,
+        "commit_process_offload did not add entries to the cache");
+
+    ok (commit_offload (c) == false,
+        "commit_offload returns false once offloaded work is done");
+
+    ok (commit_process (c, 1, rootref) == COMMIT_PROCESS_DIRTY_CACHE_ENTRIES,
+        "commit_process returns COMMIT_PROCESS_DIRTY_CACHE_ENTRIES");
+
+    ok (cache_count_entries (cache) == count + 2,
+        "commit_process added new root and dir to the cache");
+
+    count = 0;
+    ok (commit_iter_dirty_cache_entries (c, cache_count_dirty_cb, &count) == 0,
+        "commit_iter_dirty_cache_entries works for dirty cache entries");
+
+    ok (count == 2,
+        "correct number of cache entries were dirty");
+
+    ok (commit_process (c, 1, rootref) == COMMIT_PROCESS_FINISHED,
+        "commit_process returns COMMIT_PROCESS_FINISHED");
+
+    ok ((newroot = commit_get_newroot_ref (c)) != NULL,
+        "commit_get_newroot_ref returns != NULL when processing complete");
+
+    verify_value (cache, newroot, "dir.key1", "1");
+
+    commit_mgr_remove_commit (cm, c);
+    commit_mgr_destroy (cm);
+    cache_destroy (cache);
+}
+
 void commit_basic_commit_process_test_multiple_fences (void)
 {
     struct cache *cache;
@@ -684,6 +748,7 @@ void commit_basic_commit_process_test_multiple_fences_merge (void)
     commit_t *c;
     blobref_t rootref;
     const char *newroot;
+    json_t *keys;
 
     cache = create_cache_with_empty_rootdir (rootref);
 
@@ -726,6 +791,12 @@ void commit_basic_commit_process_test_multiple_fences_merge (void)
     verify_value (cache, newroot, "foo.key1", "1");
     verify_value (cache, newroot, "bar.key2", "2");
 
+    ok ((keys = commit_get_keys (c)) != NULL
+        && json_array_size (keys) == 2
+        && !strcmp (json_string_value (json_array_get (keys, 0)), "foo.key1")
+        && !strcmp (json_string_value (json_array_get (keys, 1)), "bar.key2"),
+        "commit_get_keys returns keys of merged commits");
+
     commit_mgr_remove_commit (cm, c);
 
     ok ((c = commit_mgr_get_ready_commit (cm)) == NULL,
@@ -1446,6 +1517,7 @@ void commit_process_follow_link (void)
     blobref_t root_ref;
     blobref_t dir_ref;
     const char *newroot;
+    json_t *keys;
 
     ok ((cache = cache_create ()) != NULL,
         "cache_create works");
@@ -1505,6 +1577,11 @@ void commit_process_follow_link (void)
 
     verify_value (cache, newroot, "symlink.val", "52");
 
+    ok ((keys = commit_get_keys (c)) != NULL
+        && json_array_size (keys) == 1
+        && !strcmp (json_string_value (json_array_get (keys, 0)), "dir.val"),
+        "commit_get_keys returns key with symlink resolved");
+
     commit_mgr_destroy (cm);
     cache_destroy (cache);
 }
@@ -2074,6 +2151,151 @@ void commit_process_giant_dir (void)
     cache_destroy (cache);
 }
 
+/* Return the object referenced by dirref 'name' in root dir 'root_ref'.
+ */
+const json_t *get_root_dirref_object (struct cache *cache,
+                                      const char *root_ref,
+                                      const char *name)
+{
+    struct cache_entry *entry;
+    const json_t *dirref;
+    const char *ref;
+
+    if (!(entry = cache_lookup (cache, root_ref, 1))
+        || !(dirref = treeobj_peek_entry (cache_entry_get_treeobj (entry),
+                                          name))
+        || !treeobj_is_dirref (dirref)
+        || !(ref = treeobj_get_blobref (dirref, 0))
+        || !(entry = cache_lookup (cache, ref, 1)))
+        return NULL;
+    return cache_entry_get_treeobj (entry);
+}
+
+void process_sharded_commit (commit_mgr_t *cm,
+                             const char *name,
+                             const char *root_ref,
+                             bool delete,
+                             blobref_t newroot)
+{
+    commit_t *c;
+    fence_t *f;
+    json_t *ops;
+    char key[64];
+    char val[64];
+    int i;
+
+    ok ((f = fence_create (name, 1, 0)) != NULL,
+        "fence_create works");
+    ops = json_array ();
+    for (i = 0; i < 64; i++) {
+        snprintf (key, sizeof (key), "dir.key%d", i);
+        snprintf (val, sizeof (val), "%d", i);
+        ops_append (ops, key, delete ? NULL : val, 0);
+    }
+    ok (fence_add_request_data (f, ops) == 0,
+        "fence_add_request_data add works");
+    json_decref (ops);
+    ok (commit_mgr_add_fence (cm, f) == 0
+        && commit_mgr_process_fence_request (cm, name) == 0,
+        "commit_mgr_add_fence and commit_mgr_process_fence_request work");
+
+    ok ((c = commit_mgr_get_ready_commit (cm)) != NULL,
+        "commit_mgr_get_ready_commit returns ready commit");
+
+    ok (commit_process (c, 1, root_ref) == COMMIT_PROCESS_DIRTY_CACHE_ENTRIES,
+        "commit_process returns COMMIT_PROCESS_DIRTY_CACHE_ENTRIES");
+
+    ok (commit_iter_dirty_cache_entries (c, cache_noop_cb, NULL) == 0,
+        "commit_iter_dirty_cache_entries works for dirty cache entries");
+
+    ok (commit_process (c, 1, root_ref) == COMMIT_PROCESS_FINISHED,
+        "commit_process returns COMMIT_PROCESS_FINISHED");
+
+    ok (commit_get_newroot_ref (c) != NULL,
+        "commit_get_newroot_ref returns != NULL when processing complete");
+    strcpy (newroot, commit_get_newroot_ref (c));
+
+    commit_mgr_remove_commit (cm, c);
+    ok (commit_mgr_remove_fence (cm, name) == 0,
+        "commit_mgr_remove_fence works");
+}
+
+void commit_process_sharded_dir (void)
+{
+    struct cache *cache;
+    commit_mgr_t *cm;
+    blobref_t root_ref;
+    blobref_t newroot;
+    blobref_t newroot2;
+    const json_t *o;
+    json_t *dir;
+    lookup_t *lh;
+    char key[64];
+    char val[64];
+    int i;
+
+    cache = create_cache_with_empty_rootdir (root_ref);
+
+    ok ((cm = commit_mgr_create (cache,
+                                 KVS_PRIMARY_NAMESPACE,
+                                 "sha1",
+                                 NULL,
+                                 &test_global)) != NULL,
+        "commit_mgr_create works");
+
+    /* 64 keys in a dir with a shard threshold of 4 entries, so
+     * that some buckets are split again.
+     */
+    commit_mgr_set_dir_shard (cm, 4);
+
+    process_sharded_commit (cm, "fence1", root_ref, false, newroot);
+
+    ok ((o = get_root_dirref_object (cache, newroot, "dir")) != NULL
+        && treeobj_is_hdir (o),
+        "dir was stored as hdir");
+    ok (treeobj_hdir_keylen (o) == 1,
+        "hdir has one character bucket keys");
+
+    for (i = 0; i < 64; i++) {
+        snprintf (key, sizeof (key), "dir.key%d", i);
+        snprintf (val, sizeof (val), "%d", i);
+        verify_value (cache, newroot, key, val);
+    }
+    verify_value (cache, newroot, "dir.key64", NULL);
+
+    ok ((lh = lookup_create (cache,
+                             1,
+                             KVS_PRIMARY_NAMESPACE,
+                             newroot,
+                             "dir",
+                             NULL,
+                             FLUX_KVS_READDIR)) != NULL,
+        "lookup_create dir works");
+    ok (lookup (lh) == true,
+        "lookup found result");
+    ok ((dir = lookup_get_value (lh)) != NULL
+        && treeobj_is_dir (dir)
+        && treeobj_get_count (dir) == 64,
+        "lookup_get_value returns dir with all 64 entries");
+    ok (treeobj_peek_entry (dir, "key42") != NULL,
+        "dir contains key42");
+    json_decref (dir);
+    lookup_destroy (lh);
+
+    /* deleting all keys drops all buckets, leaving an empty dir
+     */
+    process_sharded_commit (cm, "fence2", newroot, true, newroot2);
+
+    ok ((o = get_root_dirref_object (cache, newroot2, "dir")) != NULL
+        && treeobj_is_dir (o)
+        && treeobj_get_count (o) == 0,
+        "dir reverts to empty dir after all keys are deleted");
+    verify_value (cache, newroot2, "dir.key42", NULL);
+
+    commit_mgr_destroy (cm);
+    cache_destroy (cache);
+}
+
 void commit_process_append (void)
 {
     struct cache *cache;
@@ -2293,6 +2515,7 @@ int main (int argc, char *argv[])
     commit_mgr_merge_tests ();
     commit_basic_tests ();
     commit_basic_commit_process_test ();
+    commit_process_offload_test ();
     commit_basic_commit_process_test_multiple_fences ();
     commit_basic_commit_process_test_multiple_fences_merge ();
     commit_basic_root_not_dir ();
@@ -2315,6 +2538,7 @@ int main (int argc, char *argv[])
     commit_process_bad_dirrefs ();
     commit_process_big_fileval ();
     commit_process_giant_dir ();
+    commit_process_sharded_dir ();
     commit_process_append ();
     commit_process_append_errors ();
 
@@ -0,0 +1,313 @@
+/* commitbench.c - measure commit throughput across independent namespaces
+ *
+ * Usage: commitbench [namespaces] [commits] [threads]
+ *
+ * Create 'namespaces' (default 16) namespaces sharing one cache, each with
+ * a directory of 1024 keys, then apply 'commits' (default 64) commits of
+ * 16 ops to each, one commit per namespace in flight at a time as in the
+ * kvs module.  Report aggregate commits/sec with commits processed inline
+ * on the reactor thread, and with commit_process_offload() run on a
+ * workpool of 1 up to 'threads' (default: online CPUs) threads.  For the
+ * workpool runs, also report the time spent in commit_process_offload(),
+ * summed over threads, as a share of the elapsed time.  With one thread,
+ * this is the part of commit processing that can run in parallel, which
+ * bounds the speedup more threads (and CPUs) can give.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <jansson.h>
+#include <flux/core.h>
+
+#include "src/common/libkvs/kvs.h"
+#include "src/common/libkvs/treeobj.h"
+#include "src/common/libkvs/kvs_txn_private.h"
+#include "src/common/libutil/blobref.h"
+#include "src/common/libutil/monotime.h"
+#include "src/common/libutil/log.h"
+#include "src/modules/kvs/cache.h"
+#include "src/modules/kvs/commit.h"
+#include "src/modules/kvs/fence.h"
+#include "src/modules/kvs/workpool.h"
+
+#define DIR_ENTRIES     1024
+#define COMMIT_OPS      16
+
+struct ns {
+    commit_mgr_t *cm;
+    blobref_t rootref;
+    int id;
+    int seq;                    /* commits applied so far */
+    int commits;
+    char name[64];              /* fence in flight */
+    commit_t *c;
+    double offload_ms;          /* time spent on a workpool thread */
+};
+
+struct bench {
+    flux_reactor_t *r;
+    workpool_t *wp;
+    struct cache *cache;
+    struct ns *ns;
+    int count;
+    int active;                 /* namespaces with commits left */
+};
+
+static json_t *create_ops (int id, int seq, int nops)
+{
+    json_t *ops, *dirent, *op;
+    char key[64];
+    char value[64];
+    int i;
+
+    if (!(ops = json_array ()))
+        log_msg_exit ("json_array");
+    for (i = 0; i < nops; i++) {
+        snprintf (key, sizeof (key), "pmi.kvs-%d",
+                  (seq * nops + i) % DIR_ENTRIES);
+        snprintf (value, sizeof (value), "ns%d-commit%d-value%d", id, seq, i);
+        if (!(dirent = treeobj_create_val (value, strlen (value)))
+                || txn_encode_op (key, 0, dirent, &op) < 0
+                || json_array_append_new (ops, op) < 0)
+            log_err_exit ("encoding op for %s", key);
+        json_decref (dirent);
+    }
+    return ops;
+}
+
+/* Make the next commit for 'ns' ready.
+ */
+static commit_t *next_commit (struct ns *ns, int nops)
+{
+    fence_t *f;
+    json_t *ops = create_ops (ns->id, ns->seq, nops);
+
+    snprintf (ns->name, sizeof (ns->name), "ns%d.%d", ns->id, ns->seq);
+    if (!(f = fence_create (ns->name, 1, 0))
+            || fence_add_request_data (f, ops) < 0
+            || commit_mgr_add_fence (ns->cm, f) < 0
+            || commit_mgr_process_fence_request (ns->cm, ns->name) < 0
+            || !(ns->c = commit_mgr_get_ready_commit (ns->cm)))
+        log_err_exit ("creating commit");
+    json_decref (ops);
+    return ns->c;
+}
+
+/* Stand in for the content store, which the module waits for before
+ * marking new objects clean.
+ */
+static int store_cb (commit_t *c, struct cache_entry *entry, void *data)
+{
+    return cache_entry_clear_dirty (entry);
+}
+
+/* Finish the commit in flight on the module thread, as commit_apply() does.
+ */
+static void finish_commit (struct ns *ns)
+{
+    commit_process_t ret;
+
+    while ((ret = commit_process (ns->c, 1, ns->rootref))
+                                            != COMMIT_PROCESS_FINISHED) {
+        if (ret != COMMIT_PROCESS_DIRTY_CACHE_ENTRIES)
+            log_msg_exit ("commit_process: %s",
+                          strerror (commit_get_errnum (ns->c)));
+        if (commit_iter_dirty_cache_entries (ns->c, store_cb, NULL) < 0)
+            log_err_exit ("commit_iter_dirty_cache_entries");
+    }
+    strcpy (ns->rootref, commit_get_newroot_ref (ns->c));
+    commit_mgr_remove_commit (ns->cm, ns->c);
+    if (commit_mgr_remove_fence (ns->cm, ns->name) < 0)
+        log_err_exit ("commit_mgr_remove_fence");
+    ns->c = NULL;
+    ns->seq++;
+}
+
+static void start_commit (struct bench *b, struct ns *ns);
+
+static void work_cb (void *arg)
+{
+    struct ns *ns = arg;
+    struct timespec t0;
+
+    monotime (&t0);
+    commit_process_offload (ns->c, 1, ns->rootref);
+    ns->offload_ms += monotime_since (t0);
+}
+
+static void done_cb (void *arg)
+{
+    struct ns *ns = arg;
+    struct bench *b = (struct bench *)commit_get_aux (ns->c);
+
+    finish_commit (ns);
+    start_commit (b, ns);
+}
+
+static void start_commit (struct bench *b, struct ns *ns)
+{
+    if (ns->seq == ns->commits) {
+        if (--b->active == 0)
+            flux_reactor_stop (b->r);
+        return;
+    }
+    (void)next_commit (ns, COMMIT_OPS);
+    if (!commit_offload (ns->c))
+        log_msg_exit ("commit_offload returned false");
+    if (workpool_submit (b->wp, work_cb, done_cb, ns) < 0)
+        log_err_exit ("workpool_submit");
+}
+
+static struct bench *bench_create (int count, int commits)
+{
+    struct bench *b;
+    struct cache_entry *entry;
+    json_t *rootdir;
+    blobref_t rootref;
+    char *s;
+    int i;
+
+    if (!(b = calloc (1, sizeof (*b)))
+            || !(b->ns = calloc (count, sizeof (b->ns[0]))))
+        log_msg_exit ("out of memory");
+    if (!(b->cache = cache_create ())
+            || !(rootdir = treeobj_create_dir ())
+            || !(s = treeobj_encode (rootdir))
+            || blobref_hash ("sha1", s, strlen (s), rootref) < 0
+            || !(entry = cache_entry_create ())
+            || cache_entry_set_raw (entry, s, strlen (s)) < 0)
+        log_err_exit ("creating root directory");
+    cache_insert (b->cache, rootref, entry);
+    free (s);
+    json_decref (rootdir);
+    b->count = count;
+    for (i = 0; i < count; i++) {
+        struct ns *ns = &b->ns[i];
+        char name[64];
+
+        snprintf (name, sizeof (name), "ns%d", i);
+        if (!(ns->cm = commit_mgr_create (b->cache, name, "sha1", NULL, b)))
+            log_err_exit ("commit_mgr_create");
+        ns->id = i;
+        strcpy (ns->rootref, rootref);
+        /* populate, then count only the timed commits */
+        ns->commits = 1;
+        (void)next_commit (ns, DIR_ENTRIES);
+        finish_commit (ns);
+        ns->commits = commits + 1;
+    }
+    return b;
+}
+
+static void bench_destroy (struct bench *b)
+{
+    int i;
+
+    for (i = 0; i < b->count; i++)
+        commit_mgr_destroy (b->ns[i].cm);
+    cache_destroy (b->cache);
+    free (b->ns);
+    free (b);
+}
+
+/* Apply all commits, returning elapsed time (msec).
+ * With 'threads' == 0, commits are processed inline, round robin.
+ */
+static double bench_run (struct bench *b, int threads)
+{
+    struct timespec t0;
+    int i;
+
+    monotime (&t0);
+    if (threads == 0) {
+        for (;;) {
+            int busy = 0;
+            for (i = 0; i < b->count; i++) {
+                struct ns *ns = &b->ns[i];
+                if (ns->seq == ns->commits)
+                    continue;
+                (void)next_commit (ns, COMMIT_OPS);
+                finish_commit (ns);
+                busy++;
+            }
+            if (busy == 0)
+                break;
+        }
+        return monotime_since (t0);
+    }
+    if (!(b->r = flux_reactor_create (0)))
+        log_err_exit ("flux_reactor_create");
+    if (!(b->wp = workpool_create (b->r, threads)))
+        log_err_exit ("workpool_create");
+    b->active = b->count;
+    for (i = 0; i < b->count; i++)
+        start_commit (b, &b->ns[i]);
+    if (flux_reactor_run (b->r, 0) < 0)
+        log_err_exit ("flux_reactor_run");
+    workpool_destroy (b->wp);
+    flux_reactor_destroy (b->r);
+    return monotime_since (t0);
+}
+
+static void run (int count, int commits, int threads)
+{
+    struct bench *b = bench_create (count, commits);
+    double ms = bench_run (b, threads);
+    double offload_ms = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+        offload_ms += b->ns[i].offload_ms;
+    if (threads == 0)
+        printf ("%8s %12.1f %12.0f %12s\n", "inline", ms,
+                (count * commits) / (ms / 1000), "-");
+    else
+        printf ("%8d %12.1f %12.0f %12.1f\n", threads, ms,
+                (count * commits) / (ms / 1000), 100 * offload_ms / ms);
+    bench_destroy (b);
+}
+
+int main (int argc, char *argv[])
+{
+    int count = 16;
+    int commits = 64;
+    int threads = sysconf (_SC_NPROCESSORS_ONLN);
+    int i;
+
+    log_init ("commitbench");
+    if (argc > 4) {
+        fprintf (stderr,
+                 "Usage: commitbench [namespaces] [commits] [threads]\n");
+        exit (1);
+    }
+    if (argc > 1)
+        count = strtoul (argv[1], NULL, 10);
+    if (argc > 2)
+        commits = strtoul (argv[2], NULL, 10);
+    if (argc > 3)
+        threads = strtoul (argv[3], NULL, 10);
+    if (count < 1 || commits < 1)
+        log_msg_exit ("namespaces and commits must be > 0");
+    if (threads < 1)
+        threads = 1;
+
+    printf ("%d namespaces, %d commits of %d ops each, %d online CPUs\n",
+            count, commits, COMMIT_OPS, (int)sysconf (_SC_NPROCESSORS_ONLN));
+    printf ("%8s %12s %12s %12s\n", "threads", "time(ms)", "commits/s",
+            "offload(%)");
+    run (count, commits, 0);
+    for (i = 1; i <= threads; i *= 2)
+        run (count, commits, i);
+
+    log_fini ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,180 @@
+/* dirbench.c - measure the cost of updating one key in a large directory
+ *
+ * Usage: dirbench [updates]
+ *
+ * For a range of directory sizes, commit a directory with that many
+ * entries, then commit 'updates' (default 64) transactions that each
+ * replace one entry.  Report the mean latency of commit_process() for
+ * an update, and the mean number and total size of the blobs that it
+ * stores.  Each size is run with directory sharding disabled, and with
+ * a shard threshold of SHARD_ENTRIES.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jansson.h>
+
+#include "src/common/libkvs/kvs.h"
+#include "src/common/libkvs/treeobj.h"
+#include "src/common/libkvs/kvs_txn_private.h"
+#include "src/common/libutil/blobref.h"
+#include "src/common/libutil/monotime.h"
+#include "src/common/libutil/log.h"
+#include "src/modules/kvs/cache.h"
+#include "src/modules/kvs/commit.h"
+#include "src/modules/kvs/fence.h"
+
+#define SHARD_ENTRIES   1024
+
+struct stored {
+    int count;
+    int bytes;
+};
+
+static int count_stored_cb (commit_t *c, struct cache_entry *entry, void *data)
+{
+    struct stored *st = data;
+    const void *buf;
+    int len;
+
+    if (cache_entry_get_raw (entry, &buf, &len) < 0)
+        log_err_exit ("cache_entry_get_raw");
+    st->count++;
+    st->bytes += len;
+    return 0;
+}
+
+static void append_op (json_t *ops, const char *key, const char *value)
+{
+    json_t *dirent, *op;
+
+    if (!(dirent = treeobj_create_val (value, strlen (value)))
+            || txn_encode_op (key, 0, dirent, &op) < 0
+            || json_array_append_new (ops, op) < 0)
+        log_err_exit ("encoding op for %s", key);
+    json_decref (dirent);
+}
+
+/* Commit 'ops' against 'rootref', and replace 'rootref' with the new
+ * root.  Return the time spent in commit_process() (msec).
+ */
+static double commit_ops (commit_mgr_t *cm, json_t *ops, blobref_t rootref,
+                          struct stored *st)
+{
+    const char *name = "dirbench";
+    struct timespec t0;
+    double ms;
+    fence_t *f;
+    commit_t *c;
+    commit_process_t ret;
+
+    if (!(f = fence_create (name, 1, 0))
+            || fence_add_request_data (f, ops) < 0
+            || commit_mgr_add_fence (cm, f) < 0
+            || commit_mgr_process_fence_request (cm, name) < 0
+            || !(c = commit_mgr_get_ready_commit (cm)))
+        log_err_exit ("creating commit");
+    monotime (&t0);
+    while ((ret = commit_process (c, 1, rootref)) != COMMIT_PROCESS_FINISHED) {
+        if (ret != COMMIT_PROCESS_DIRTY_CACHE_ENTRIES)
+            log_msg_exit ("commit_process: %s",
+                          strerror (commit_get_errnum (c)));
+        if (commit_iter_dirty_cache_entries (c, count_stored_cb, st) < 0)
+            log_err_exit ("commit_iter_dirty_cache_entries");
+    }
+    ms = monotime_since (t0);
+    strcpy (rootref, commit_get_newroot_ref (c));
+    commit_mgr_remove_commit (cm, c);
+    if (commit_mgr_remove_fence (cm, name) < 0)
+        log_err_exit ("commit_mgr_remove_fence");
+    return ms;
+}
+
+static void bench (int size, int updates, int dir_shard)
+{
+    struct cache *cache;
+    struct cache_entry *entry;
+    commit_mgr_t *cm;
+    blobref_t rootref;
+    struct stored st = { 0, 0 };
+    json_t *rootdir, *ops;
+    char *s;
+    char key[64];
+    double ms = 0;
+    int i;
+
+    if (!(cache = cache_create ())
+            || !(rootdir = treeobj_create_dir ())
+            || !(s = treeobj_encode (rootdir))
+            || blobref_hash ("sha1", s, strlen (s), rootref) < 0
+            || !(entry = cache_entry_create ())
+            || cache_entry_set_raw (entry, s, strlen (s)) < 0)
+        log_err_exit ("creating root directory");
+    cache_insert (cache, rootref, entry);
+    free (s);
+    json_decref (rootdir);
+    if (!(cm = commit_mgr_create (cache, KVS_PRIMARY_NAMESPACE, "sha1",
+                                  NULL, NULL)))
+        log_err_exit ("commit_mgr_create");
+    commit_mgr_set_dir_shard (cm, dir_shard);
+
+    if (!(ops = json_array ()))
+        log_msg_exit ("json_array");
+    for (i = 0; i < size; i++) {
+        snprintf (key, sizeof (key), "lwj.pmi.kvs-%d", i);
+        append_op (ops, key, "initial-value");
+    }
+    (void)commit_ops (cm, ops, rootref, &st);
+    json_decref (ops);
+
+    memset (&st, 0, sizeof (st));
+    for (i = 0; i < updates; i++) {
+        if (!(ops = json_array ()))
+            log_msg_exit ("json_array");
+        snprintf (key, sizeof (key), "lwj.pmi.kvs-%d", (i * 7919) % size);
+        append_op (ops, key, "updated-value");
+        ms += commit_ops (cm, ops, rootref, &st);
+        json_decref (ops);
+    }
+    printf ("%8d %6d %12.3f %8.1f %12.1f\n", size, dir_shard,
+            ms / updates, (double)st.count / updates,
+            (double)st.bytes / updates);
+
+    commit_mgr_destroy (cm);
+    cache_destroy (cache);
+}
+
+int main (int argc, char *argv[])
+{
+    int sizes[] = { 1024, 16384, 131072 };
+    int updates = 64;
+    int i;
+
+    log_init ("dirbench");
+    if (argc > 2) {
+        fprintf (stderr, "Usage: dirbench [updates]\n");
+        exit (1);
+    }
+    if (argc == 2)
+        updates = strtoul (argv[1], NULL, 10);
+    if (updates < 1)
+        log_msg_exit ("updates must be > 0");
+
+    printf ("%8s %6s %12s %8s %12s\n", "entries", "shard",
+            "commit(ms)", "blobs", "bytes");
+    for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+        bench (sizes[i], updates, 0);
+        bench (sizes[i], updates, SHARD_ENTRIES);
+    }
+
+    log_fini ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -1665,6 +1665,150 @@ void lookup_stall (void) {
     cache_destroy (cache);
 }
 
+/* lookup tests with pathcache */
+void lookup_pathcache (void) {
+    json_t *root;
+    json_t *dir;
+    json_t *test;
+    struct cache *cache;
+    pathcache_t *pc;
+    lookup_t *lh;
+    blobref_t dir_ref;
+    blobref_t root_ref;
+    int hits, misses;
+
+    ok ((cache = cache_create ()) != NULL,
+        "cache_create works");
+    ok ((pc = pathcache_create (16)) != NULL,
+        "pathcache_create works");
+
+    /* This cache is
+     *
+     * dir_ref
+     * "val" : val to "foo"
+     * "symlink" : symlink to "dir.val"
+     *
+     * root_ref
+     * "dir" : dirref to dir_ref
+     */
+
+    dir = treeobj_create_dir ();
+    treeobj_insert_entry (dir, "val", treeobj_create_val ("foo", 3));
+    treeobj_insert_entry (dir, "symlink", treeobj_create_symlink ("dir.val"));
+
+    treeobj_hash ("sha1", dir, dir_ref);
+    cache_insert (cache, dir_ref, create_cache_entry_treeobj (dir));
+
+    root = treeobj_create_dir ();
+    treeobj_insert_entry (root, "dir", treeobj_create_dirref (dir_ref));
+
+    treeobj_hash ("sha1", root, root_ref);
+    cache_insert (cache, root_ref, create_cache_entry_treeobj (root));
+
+    /* walk results are cached */
+    ok ((lh = lookup_create (cache,
+                             1,
+                             KVS_PRIMARY_NAMESPACE,
+                             root_ref,
+                             "dir.val",
+                             NULL,
+                             0)) != NULL,
+        "lookup_create on dir.val");
+    ok (lookup_set_pathcache (lh, pc) == 0,
+        "lookup_set_pathcache works");
+    test = treeobj_create_val ("foo", 3);
+    check (lh, 0, test, "lookup dir.val");
+    json_decref (test);
+
+    ok ((lh = lookup_create (cache,
+                             1,
+                             KVS_PRIMARY_NAMESPACE,
+                             root_ref,
+                             "dir.noexist",
+                             NULL,
+                             0)) != NULL,
+        "lookup_create on dir.noexist");
+    lookup_set_pathcache (lh, pc);
+    check (lh, 0, NULL, "lookup dir.noexist");
+
+    ok ((lh = lookup_create (cache,
+                             1,
+                             KVS_PRIMARY_NAMESPACE,
+                             root_ref,
+                             "dir.symlink",
+                             NULL,
+                             FLUX_KVS_READLINK)) != NULL,
+        "lookup_create on dir.symlink");
+    lookup_set_pathcache (lh, pc);
+    test = treeobj_create_symlink ("dir.val");
+    check (lh, 0, test, "readlink dir.symlink");
+    json_decref (test);
+
+    ok (pathcache_count (pc) == 3,
+        "pathcache holds three entries");
+
+    /* drop the directory so that a walk would stall */
+    ok (cache_remove_entry (cache, dir_ref) == 1,
+        "cache_remove_entry removed directory");
+
+    ok ((lh = lookup_create (cache,
+                             1,
+                             KVS_PRIMARY_NAMESPACE,
+                             root_ref,
+                             "dir.val",
+                             NULL,
+                             0)) != NULL,
+        "lookup_create on dir.val");
+    lookup_set_pathcache (lh, pc);
+    test = treeobj_create_val ("foo", 3);
+    check (lh, 0, test, "lookup dir.val skips walk");
+    json_decref (test);
+
+    ok ((lh = lookup_create (cache,
+                             1,
+                             KVS_PRIMARY_NAMESPACE,
+                             root_ref,
+                             "dir.noexist",
+                             NULL,
+                             0)) != NULL,
+        "lookup_create on dir.noexist");
+    lookup_set_pathcache (lh, pc);
+    check (lh, 0, NULL, "lookup dir.noexist skips walk");
+
+    ok ((lh = lookup_create (cache,
+                             1,
+                             KVS_PRIMARY_NAMESPACE,
+                             root_ref,
+                             "dir.symlink",
+                             NULL,
+                             FLUX_KVS_READLINK)) != NULL,
+        "lookup_create on dir.symlink");
+    lookup_set_pathcache (lh, pc);
+    test = treeobj_create_symlink ("dir.val");
+    check (lh, 0, test, "readlink dir.symlink skips walk");
+    json_decref (test);
+
+    /* following the link is a different walk */
+    ok ((lh = lookup_create (cache,
+                             1,
+                             KVS_PRIMARY_NAMESPACE,
+                             root_ref,
+                             "dir.symlink",
+                             NULL,
+                             0)) != NULL,
+        "lookup_create on dir.symlink");
+    lookup_set_pathcache (lh, pc);
+    check_stall (lh, EAGAIN, 1, dir_ref, "lookup dir.symlink stalls");
+    lookup_destroy (lh);
+
+    pathcache_get_stats (pc, &hits, &misses);
+    ok (hits == 3 && misses == 4,
+        "pathcache counted 3 hits and 4 misses");
+
+    pathcache_destroy (pc);
+    cache_destroy (cache);
+}
+
 int main (int argc, char *argv[])
 {
     plan (NO_PLAN);
@@ -1679,6 +1823,7 @@ int main (int argc, char *argv[])
     lookup_alt_root ();
     lookup_stall_root ();
     lookup_stall ();
+    lookup_pathcache ();
     done_testing ();
     return (0);
 }
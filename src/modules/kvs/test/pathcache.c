@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <jansson.h>
+
+#include "src/modules/kvs/pathcache.h"
+#include "src/common/libkvs/treeobj.h"
+#include "src/common/libtap/tap.h"
+
+static const char *root1 = "sha1-508259c0f7fd50e47716b50ad1f0fc6ed46017f9";
+static const char *root2 = "sha1-ded5ba42480fe75dcebba1ce068489ff7be2186a";
+
+void basic (void)
+{
+    pathcache_t *pc;
+    json_t *val;
+    const json_t *dirent;
+    bool followed_link;
+    int hits, misses;
+
+    errno = 0;
+    ok (pathcache_create (0) == NULL && errno == EINVAL,
+        "pathcache_create maxsize=0 fails with EINVAL");
+    ok ((pc = pathcache_create (16)) != NULL,
+        "pathcache_create works");
+    ok (pathcache_count (pc) == 0,
+        "pathcache_count returns 0");
+
+    errno = 0;
+    ok (pathcache_lookup (pc, root1, "a.b", true, &dirent,
+                          &followed_link) < 0 && errno == ENOENT,
+        "pathcache_lookup of unknown path fails with ENOENT");
+
+    if (!(val = treeobj_create_val ("foo", 3)))
+        BAIL_OUT ("treeobj_create_val failed");
+    ok (pathcache_insert (pc, root1, "a.b", true, val, true) == 0,
+        "pathcache_insert works");
+    ok (pathcache_insert (pc, root1, "a.c", true, NULL, false) == 0,
+        "pathcache_insert of negative entry works");
+    ok (pathcache_count (pc) == 2,
+        "pathcache_count returns 2");
+
+    dirent = NULL;
+    followed_link = false;
+    ok (pathcache_lookup (pc, root1, "a.b", true, &dirent,
+                          &followed_link) == 0
+        && dirent != NULL && dirent != val && json_equal (dirent, val)
+        && followed_link == true,
+        "pathcache_lookup returns copy of dirent and followed_link");
+    ok (pathcache_lookup (pc, root1, "a.c", true, &dirent,
+                          &followed_link) == 0
+        && dirent == NULL && followed_link == false,
+        "pathcache_lookup returns negative entry");
+    ok (pathcache_lookup (pc, root2, "a.b", true, &dirent,
+                          &followed_link) < 0,
+        "pathcache_lookup with different root misses");
+    ok (pathcache_lookup (pc, root1, "a.b", false, &dirent,
+                          &followed_link) < 0,
+        "pathcache_lookup with different follow flag misses");
+
+    pathcache_get_stats (pc, &hits, &misses);
+    ok (hits == 2 && misses == 3,
+        "pathcache_get_stats reports 2 hits and 3 misses");
+    pathcache_clear_stats (pc);
+    pathcache_get_stats (pc, &hits, &misses);
+    ok (hits == 0 && misses == 0,
+        "pathcache_clear_stats works");
+
+    json_decref (val);
+    pathcache_destroy (pc);
+}
+
+void bounded (void)
+{
+    pathcache_t *pc;
+    const json_t *dirent;
+    bool followed_link;
+    char path[64];
+    int i, n;
+
+    if (!(pc = pathcache_create (8)))
+        BAIL_OUT ("pathcache_create failed");
+
+    for (i = 0; i < 100; i++) {
+        snprintf (path, sizeof (path), "key%d", i);
+        if (pathcache_insert (pc, root1, path, true, NULL, false) < 0)
+            BAIL_OUT ("pathcache_insert failed");
+        /* keep key0 in use */
+        (void)pathcache_lookup (pc, root1, "key0", true, &dirent,
+                                &followed_link);
+    }
+    ok (pathcache_count (pc) <= 8,
+        "pathcache_count stays within maxsize");
+    ok (pathcache_lookup (pc, root1, "key0", true, &dirent,
+                          &followed_link) == 0,
+        "recently used entry was retained");
+    ok (pathcache_lookup (pc, root1, "key99", true, &dirent,
+                          &followed_link) == 0,
+        "most recently inserted entry was retained");
+    n = 0;
+    for (i = 1; i < 90; i++) {
+        snprintf (path, sizeof (path), "key%d", i);
+        if (pathcache_lookup (pc, root1, path, true, &dirent,
+                              &followed_link) == 0)
+            n++;
+    }
+    ok (n == 0,
+        "old unused entries were dropped");
+
+    pathcache_destroy (pc);
+}
+
+int main (int argc, char *argv[])
+{
+    plan (NO_PLAN);
+
+    basic ();
+    bounded ();
+
+    done_testing ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
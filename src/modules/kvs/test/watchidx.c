@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <jansson.h>
+
+#include "src/modules/kvs/watchidx.h"
+#include "src/common/libflux/message.h"
+#include "src/common/libtap/tap.h"
+
+/* Watched keys, and a count of how many times each waiter ran.
+ */
+static const char *watched[] = {
+    ".", "a", "a.b", "a.b.c", "a.bc", "a-b", "ab", "b", "b.a",
+};
+#define NWATCHED (sizeof (watched) / sizeof (watched[0]))
+static int counts[NWATCHED];
+
+static watchidx_t *readd_wi;    /* if set, waiters add themselves back */
+
+static void add_waiter (watchidx_t *wi, int i);
+
+static void wait_cb (void *arg)
+{
+    int i = (int)(long)arg;
+
+    counts[i]++;
+    if (readd_wi)
+        add_waiter (readd_wi, i);
+}
+
+static void add_waiter (watchidx_t *wi, int i)
+{
+    wait_t *w;
+
+    if (!(w = wait_create (wait_cb, (void *)(long)i)))
+        BAIL_OUT ("wait_create failed");
+    if (watchidx_add (wi, watched[i], w) < 0)
+        BAIL_OUT ("watchidx_add failed");
+}
+
+static watchidx_t *create_watched (void)
+{
+    watchidx_t *wi;
+    int i;
+
+    if (!(wi = watchidx_create ()))
+        BAIL_OUT ("watchidx_create failed");
+    for (i = 0; i < NWATCHED; i++)
+        add_waiter (wi, i);
+    memset (counts, 0, sizeof (counts));
+    return wi;
+}
+
+/* Run the waiters affected by 'key', and return a string listing
+ * the keys of the waiters that ran, e.g. "a a.b".
+ */
+static const char *run_key (const char *key)
+{
+    static char buf[256];
+    watchidx_t *wi = create_watched ();
+    json_t *keys;
+    int i;
+
+    if (!(keys = json_pack ("[s]", key)))
+        BAIL_OUT ("json_pack failed");
+    if (watchidx_run (wi, keys) < 0)
+        BAIL_OUT ("watchidx_run failed");
+    buf[0] = '\0';
+    for (i = 0; i < NWATCHED; i++) {
+        if (counts[i] > 0) {
+            if (buf[0] != '\0')
+                strcat (buf, " ");
+            strcat (buf, watched[i]);
+        }
+    }
+    json_decref (keys);
+    watchidx_destroy (wi);
+    return buf;
+}
+
+void basic (void)
+{
+    watchidx_t *wi;
+    json_t *keys;
+
+    ok ((wi = watchidx_create ()) != NULL,
+        "watchidx_create works");
+    ok (watchidx_count (wi) == 0,
+        "watchidx_count returns 0 on empty index");
+    if (!(keys = json_pack ("[s]", "a")))
+        BAIL_OUT ("json_pack failed");
+    ok (watchidx_run (wi, keys) == 0,
+        "watchidx_run works on empty index");
+    ok (watchidx_run_all (wi) == 0,
+        "watchidx_run_all works on empty index");
+    errno = 0;
+    ok (watchidx_add (wi, NULL, NULL) < 0 && errno == EINVAL,
+        "watchidx_add fails with EINVAL on bad input");
+    errno = 0;
+    ok (watchidx_run (wi, NULL) < 0 && errno == EINVAL,
+        "watchidx_run fails with EINVAL on non-array keys");
+    json_decref (keys);
+    watchidx_destroy (wi);
+    watchidx_destroy (NULL);
+    diag ("watchidx_destroy accepts NULL");
+}
+
+void affected (void)
+{
+    const char *s;
+
+    s = run_key ("a.b");
+    ok (!strcmp (s, ". a a.b a.b.c"),
+        "change to a.b runs root, ancestor, key and descendant: %s", s);
+    s = run_key ("a");
+    ok (!strcmp (s, ". a a.b a.b.c a.bc"),
+        "change to a runs all keys below a: %s", s);
+    s = run_key ("a.b.c");
+    ok (!strcmp (s, ". a a.b a.b.c"),
+        "change to a.b.c runs ancestors: %s", s);
+    s = run_key ("ab");
+    ok (!strcmp (s, ". ab"),
+        "change to ab does not run a or a.b: %s", s);
+    s = run_key ("a-b.x");
+    ok (!strcmp (s, ". a-b"),
+        "change to a-b.x runs a-b only: %s", s);
+    s = run_key ("c.d");
+    ok (!strcmp (s, "."),
+        "change to unwatched key runs root only: %s", s);
+    s = run_key (".");
+    ok (!strcmp (s, ". a a.b a.b.c a.bc a-b ab b b.a"),
+        "change to root runs everything: %s", s);
+}
+
+void run_multiple (void)
+{
+    watchidx_t *wi = create_watched ();
+    json_t *keys;
+    int i, total;
+
+    if (!(keys = json_pack ("[s,s,s]", "a.b.c", "b", "a.b")))
+        BAIL_OUT ("json_pack failed");
+    ok (watchidx_count (wi) == NWATCHED,
+        "watchidx_count returns number of waiters");
+    ok (watchidx_run (wi, keys) == 0,
+        "watchidx_run works with multiple keys");
+    for (i = 0, total = 0; i < NWATCHED; i++) {
+        if (counts[i] > 1)
+            break;
+        total += counts[i];
+    }
+    ok (i == NWATCHED && total == 6,
+        "each affected waiter ran exactly once");
+    ok (watchidx_count (wi) == NWATCHED - 6,
+        "waiters that ran were removed from the index");
+    ok (watchidx_run_all (wi) == 0 && watchidx_count (wi) == 0,
+        "watchidx_run_all runs remaining waiters");
+    for (i = 0; i < NWATCHED; i++) {
+        if (counts[i] != 1)
+            break;
+    }
+    ok (i == NWATCHED,
+        "every waiter has now run once");
+    json_decref (keys);
+    watchidx_destroy (wi);
+}
+
+void readd (void)
+{
+    watchidx_t *wi = create_watched ();
+    json_t *keys;
+
+    if (!(keys = json_pack ("[s]", "b")))
+        BAIL_OUT ("json_pack failed");
+    readd_wi = wi;
+    ok (watchidx_run (wi, keys) == 0,
+        "watchidx_run works when waiters add themselves back");
+    ok (watchidx_count (wi) == NWATCHED,
+        "re-added waiters are in the index");
+    ok (counts[0] == 1 && counts[7] == 1 && counts[8] == 1,
+        "each affected waiter ran once");
+    ok (watchidx_run (wi, keys) == 0 && counts[7] == 2,
+        "re-added waiter runs on the next change");
+    readd_wi = NULL;
+    json_decref (keys);
+    watchidx_destroy (wi);
+}
+
+static void msghand (flux_t *h, flux_msg_handler_t *mh,
+                     const flux_msg_t *msg, void *arg)
+{
+    int *count = arg;
+    (*count)++;
+}
+
+static void count_cb (void *arg)
+{
+    int *count = arg;
+    (*count)++;
+}
+
+static bool msgcmp (const flux_msg_t *msg, void *arg)
+{
+    const char *topic;
+    return flux_msg_get_topic (msg, &topic) == 0 && !strcmp (topic, arg);
+}
+
+void destroy_msg (void)
+{
+    watchidx_t *wi;
+    flux_msg_t *msg;
+    wait_t *w;
+    int count = 0;
+    int i;
+
+    if (!(wi = watchidx_create ()))
+        BAIL_OUT ("watchidx_create failed");
+    for (i = 0; i < 4; i++) {
+        if (!(msg = flux_msg_create (FLUX_MSGTYPE_REQUEST))
+                || flux_msg_set_topic (msg, i % 2 ? "odd" : "even") < 0)
+            BAIL_OUT ("could not create message");
+        if (!(w = wait_create_msg_handler (NULL, NULL, msg, &count, msghand)))
+            BAIL_OUT ("wait_create_msg_handler failed");
+        if (watchidx_add (wi, i < 2 ? "x" : "y", w) < 0)
+            BAIL_OUT ("watchidx_add failed");
+        flux_msg_destroy (msg);
+    }
+    ok (watchidx_destroy_msg (wi, msgcmp, "odd") == 2,
+        "watchidx_destroy_msg destroys matching waiters");
+    ok (watchidx_count (wi) == 2,
+        "non-matching waiters remain");
+    ok (watchidx_run_all (wi) == 0 && count == 2,
+        "destroyed waiters do not run");
+    watchidx_destroy (wi);
+}
+
+/* With many watchers on distinct keys, a change to one key should run
+ * only the watchers of that key.
+ */
+void many (void)
+{
+    watchidx_t *wi;
+    json_t *keys;
+    char key[64];
+    wait_t *w;
+    int count = 0;
+    int i;
+
+    if (!(wi = watchidx_create ()))
+        BAIL_OUT ("watchidx_create failed");
+    for (i = 0; i < 10000; i++) {
+        snprintf (key, sizeof (key), "lwj.%d.state", i);
+        if (!(w = wait_create (count_cb, &count)))
+            BAIL_OUT ("wait_create failed");
+        if (watchidx_add (wi, key, w) < 0)
+            BAIL_OUT ("watchidx_add failed");
+    }
+    if (!(keys = json_pack ("[s]", "lwj.4242.state")))
+        BAIL_OUT ("json_pack failed");
+    ok (watchidx_run (wi, keys) == 0 && count == 1
+        && watchidx_count (wi) == 9999,
+        "with 10000 waiters, changing one key runs one waiter");
+    json_decref (keys);
+    watchidx_destroy (wi);
+}
+
+int main (int argc, char *argv[])
+{
+    plan (NO_PLAN);
+
+    basic ();
+    affected ();
+    run_multiple ();
+    readd ();
+    destroy_msg ();
+    many ();
+
+    done_testing ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,345 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* watchidx.c - waiters indexed by watched key */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <czmq.h>
+#include <jansson.h>
+
+#include "watchidx.h"
+
+struct watchkey {
+    char *key;
+    waitqueue_t *q;
+};
+
+/* Keys are kept sorted so that all keys below directory "a" can be
+ * found as the contiguous range beginning at "a.".
+ */
+struct watchidx {
+    struct watchkey **keys;
+    int len;
+    int size;
+};
+
+static void watchkey_destroy (struct watchkey *wk)
+{
+    if (wk) {
+        wait_queue_destroy (wk->q);
+        free (wk->key);
+        free (wk);
+    }
+}
+
+static struct watchkey *watchkey_create (const char *key)
+{
+    struct watchkey *wk;
+
+    if (!(wk = calloc (1, sizeof (*wk)))
+            || !(wk->key = strdup (key))
+            || !(wk->q = wait_queue_create ())) {
+        watchkey_destroy (wk);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return wk;
+}
+
+watchidx_t *watchidx_create (void)
+{
+    watchidx_t *wi;
+
+    if (!(wi = calloc (1, sizeof (*wi)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return wi;
+}
+
+void watchidx_destroy (watchidx_t *wi)
+{
+    if (wi) {
+        int i;
+        for (i = 0; i < wi->len; i++)
+            watchkey_destroy (wi->keys[i]);
+        free (wi->keys);
+        free (wi);
+    }
+}
+
+/* Compare 's' with the string formed by the first 'n' characters of
+ * 'key', followed by 'sep' if it is not '\0'.
+ */
+static int keycmp (const char *s, const char *key, int n, char sep)
+{
+    int cmp;
+
+    if ((cmp = strncmp (s, key, n)) != 0)
+        return cmp;
+    s += n;
+    if (sep != '\0') {
+        if (*s != sep)
+            return (unsigned char)*s < (unsigned char)sep ? -1 : 1;
+        s++;
+    }
+    return *s == '\0' ? 0 : 1;
+}
+
+/* Return the index of the first key >= keycmp() string (or wi->len).
+ */
+static int lower_bound (watchidx_t *wi, const char *key, int n, char sep)
+{
+    int lo = 0, hi = wi->len;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (keycmp (wi->keys[mid]->key, key, n, sep) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Look up the first 'n' characters of 'key'.  On return, '*indexp' is
+ * the position where it was found, or should be inserted.
+ */
+static struct watchkey *lookup (watchidx_t *wi, const char *key, int n,
+                                int *indexp)
+{
+    int i = lower_bound (wi, key, n, '\0');
+
+    *indexp = i;
+    if (i < wi->len && keycmp (wi->keys[i]->key, key, n, '\0') == 0)
+        return wi->keys[i];
+    return NULL;
+}
+
+static int insert_at (watchidx_t *wi, int i, struct watchkey *wk)
+{
+    if (wi->len == wi->size) {
+        int size = wi->size ? wi->size * 2 : 16;
+        struct watchkey **keys;
+        if (!(keys = realloc (wi->keys, size * sizeof (keys[0])))) {
+            errno = ENOMEM;
+            return -1;
+        }
+        wi->keys = keys;
+        wi->size = size;
+    }
+    memmove (&wi->keys[i + 1], &wi->keys[i],
+             (wi->len - i) * sizeof (wi->keys[0]));
+    wi->keys[i] = wk;
+    wi->len++;
+    return 0;
+}
+
+int watchidx_add (watchidx_t *wi, const char *key, wait_t *wait)
+{
+    struct watchkey *wk;
+    int i;
+
+    if (!wi || !key || !wait) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(wk = lookup (wi, key, strlen (key), &i))) {
+        if (!(wk = watchkey_create (key)))
+            return -1;
+        if (insert_at (wi, i, wk) < 0) {
+            watchkey_destroy (wk);
+            return -1;
+        }
+    }
+    return wait_addqueue (wk->q, wait);
+}
+
+int watchidx_count (watchidx_t *wi)
+{
+    int i, count = 0;
+
+    if (wi) {
+        for (i = 0; i < wi->len; i++)
+            count += wait_queue_length (wi->keys[i]->q);
+    }
+    return count;
+}
+
+/* Mark entries affected by a change to 'key'.
+ */
+static void mark_key (watchidx_t *wi, const char *key, bool *hit)
+{
+    const char *p;
+    int i, len = strlen (key);
+
+    if (!strcmp (key, ".")) {
+        for (i = 0; i < wi->len; i++)
+            hit[i] = true;
+        return;
+    }
+    /* the key itself, and the root directory */
+    if (lookup (wi, key, len, &i))
+        hit[i] = true;
+    if (lookup (wi, ".", 1, &i))
+        hit[i] = true;
+    /* ancestor directories */
+    for (p = strchr (key, '.'); p != NULL; p = strchr (p + 1, '.')) {
+        if (lookup (wi, key, p - key, &i))
+            hit[i] = true;
+    }
+    /* keys below 'key' are the contiguous range prefixed by "key." */
+    for (i = lower_bound (wi, key, len, '.'); i < wi->len; i++) {
+        const char *s = wi->keys[i]->key;
+        if (strncmp (s, key, len) != 0 || s[len] != '.')
+            break;
+        hit[i] = true;
+    }
+}
+
+/* Remove the marked entries from the index and run them.
+ */
+static int run_marked (watchidx_t *wi, bool *hit)
+{
+    struct watchkey **run;
+    int i, j, n = 0;
+    int rc = 0;
+
+    for (i = 0; i < wi->len; i++) {
+        if (hit[i])
+            n++;
+    }
+    if (n == 0)
+        return 0;
+    if (!(run = calloc (n, sizeof (run[0])))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0, j = 0, n = 0; i < wi->len; i++) {
+        if (hit[i])
+            run[n++] = wi->keys[i];
+        else
+            wi->keys[j++] = wi->keys[i];
+    }
+    wi->len = j;
+    for (i = 0; i < n; i++) {
+        if (wait_runqueue (run[i]->q) < 0) {
+            /* put back waiters that could not be run, unless a
+             * replayed waiter has already re-created the key */
+            if (!lookup (wi, run[i]->key, strlen (run[i]->key), &j)
+                    && insert_at (wi, j, run[i]) == 0) {
+                run[i] = NULL;
+            }
+            rc = -1;
+        }
+        watchkey_destroy (run[i]);
+    }
+    free (run);
+    if (rc < 0)
+        errno = ENOMEM;
+    return rc;
+}
+
+int watchidx_run (watchidx_t *wi, json_t *keys)
+{
+    json_t *o;
+    size_t index;
+    bool *hit;
+    int rc;
+
+    if (!wi || !json_is_array (keys)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (wi->len == 0)
+        return 0;
+    if (!(hit = calloc (wi->len, sizeof (hit[0])))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    json_array_foreach (keys, index, o) {
+        const char *key = json_string_value (o);
+        if (key)
+            mark_key (wi, key, hit);
+    }
+    rc = run_marked (wi, hit);
+    free (hit);
+    return rc;
+}
+
+int watchidx_run_all (watchidx_t *wi)
+{
+    bool *hit;
+    int i, rc;
+
+    if (!wi) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (wi->len == 0)
+        return 0;
+    if (!(hit = calloc (wi->len, sizeof (hit[0])))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < wi->len; i++)
+        hit[i] = true;
+    rc = run_marked (wi, hit);
+    free (hit);
+    return rc;
+}
+
+int watchidx_destroy_msg (watchidx_t *wi, wait_test_msg_f cb, void *arg)
+{
+    int i, j, n, count = 0;
+
+    if (!wi) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < wi->len; i++) {
+        if ((n = wait_destroy_msg (wi->keys[i]->q, cb, arg)) < 0)
+            return -1;
+        count += n;
+    }
+    /* drop keys with no remaining waiters */
+    for (i = 0, j = 0; i < wi->len; i++) {
+        if (wait_queue_length (wi->keys[i]->q) == 0)
+            watchkey_destroy (wi->keys[i]);
+        else
+            wi->keys[j++] = wi->keys[i];
+    }
+    wi->len = j;
+    return count;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,71 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#ifndef _FLUX_KVS_WATCHIDX_H
+#define _FLUX_KVS_WATCHIDX_H
+
+#include <jansson.h>
+
+#include "waitqueue.h"
+
+/* A watchidx_t holds waiters indexed by the (normalized) key they watch,
+ * so that after a commit, only waiters whose key may have changed need
+ * be run.  A change to key K affects waiters on K, on any ancestor
+ * directory of K, and on any key below K.  The root directory "."
+ * is an ancestor of every key.
+ */
+
+typedef struct watchidx watchidx_t;
+
+watchidx_t *watchidx_create (void);
+void watchidx_destroy (watchidx_t *wi);
+
+/* Add 'wait' to the waiters on normalized key 'key'.
+ */
+int watchidx_add (watchidx_t *wi, const char *key, wait_t *wait);
+
+/* Return the total number of waiters.
+ */
+int watchidx_count (watchidx_t *wi);
+
+/* Run waiters affected by a change to any of the keys in JSON array
+ * 'keys'.  All affected waiters are removed from the index before any
+ * are run, so they may safely add themselves back.
+ * Returns -1 on error, 0 on success.
+ */
+int watchidx_run (watchidx_t *wi, json_t *keys);
+
+/* Run all waiters.
+ */
+int watchidx_run_all (watchidx_t *wi);
+
+/* Destroy all waiters fitting message match criteria.
+ */
+int watchidx_destroy_msg (watchidx_t *wi, wait_test_msg_f cb, void *arg);
+
+#endif /* !_FLUX_KVS_WATCHIDX_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
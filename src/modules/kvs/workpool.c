@@ -0,0 +1,230 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* workpool.c - run work items on threads, complete them in the reactor */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <czmq.h>
+#include <flux/core.h>
+
+#include "workpool.h"
+
+struct work {
+    workpool_f work;
+    workpool_f done;
+    void *arg;
+};
+
+struct workpool {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    zlist_t *queue;         /* submitted, not yet started */
+    zlist_t *done;          /* finished, completion not yet called */
+    bool shutdown;
+    pthread_t *threads;
+    int nthreads;
+    int fds[2];             /* workers wake the reactor via fds[1] */
+    flux_watcher_t *w;
+};
+
+static void *worker (void *arg)
+{
+    workpool_t *wp = arg;
+    struct work *work;
+    bool notify;
+    char c = 0;
+
+    pthread_mutex_lock (&wp->lock);
+    for (;;) {
+        while (!wp->shutdown && zlist_size (wp->queue) == 0)
+            pthread_cond_wait (&wp->cond, &wp->lock);
+        if (wp->shutdown)
+            break;
+        work = zlist_pop (wp->queue);
+        pthread_mutex_unlock (&wp->lock);
+
+        work->work (work->arg);
+
+        pthread_mutex_lock (&wp->lock);
+        notify = (zlist_size (wp->done) == 0);
+        if (zlist_append (wp->done, work) < 0) {
+            free (work);    /* ENOMEM - completion is lost */
+            continue;
+        }
+        /* One byte per transition to non-empty, drained by the reactor.
+         * A failed write means the pipe is already full, so the reactor
+         * will wake up regardless.
+         */
+        if (notify && write (wp->fds[1], &c, 1) < 0)
+            continue;
+    }
+    pthread_mutex_unlock (&wp->lock);
+    return NULL;
+}
+
+static void completion_cb (flux_reactor_t *r, flux_watcher_t *w,
+                           int revents, void *arg)
+{
+    workpool_t *wp = arg;
+    zlist_t *done, *empty;
+    struct work *work;
+    char buf[64];
+
+    while (read (wp->fds[0], buf, sizeof (buf)) > 0)
+        ;
+    if (!(empty = zlist_new ()))
+        return;
+    pthread_mutex_lock (&wp->lock);
+    done = wp->done;
+    wp->done = empty;
+    pthread_mutex_unlock (&wp->lock);
+
+    while ((work = zlist_pop (done))) {
+        work->done (work->arg);
+        free (work);
+    }
+    zlist_destroy (&done);
+}
+
+static void purge_work (zlist_t *l)
+{
+    struct work *work;
+
+    if (l) {
+        while ((work = zlist_pop (l)))
+            free (work);
+        zlist_destroy (&l);
+    }
+}
+
+void workpool_destroy (workpool_t *wp)
+{
+    if (wp) {
+        int saved_errno = errno;
+        int i;
+
+        pthread_mutex_lock (&wp->lock);
+        wp->shutdown = true;
+        pthread_cond_broadcast (&wp->cond);
+        pthread_mutex_unlock (&wp->lock);
+        for (i = 0; i < wp->nthreads; i++)
+            pthread_join (wp->threads[i], NULL);
+        free (wp->threads);
+        flux_watcher_destroy (wp->w);
+        if (wp->fds[0] >= 0)
+            close (wp->fds[0]);
+        if (wp->fds[1] >= 0)
+            close (wp->fds[1]);
+        purge_work (wp->queue);
+        purge_work (wp->done);
+        pthread_cond_destroy (&wp->cond);
+        pthread_mutex_destroy (&wp->lock);
+        free (wp);
+        errno = saved_errno;
+    }
+}
+
+workpool_t *workpool_create (flux_reactor_t *r, int nthreads)
+{
+    workpool_t *wp;
+    int errnum;
+
+    if (!r || nthreads < 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(wp = calloc (1, sizeof (*wp)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_init (&wp->lock, NULL);
+    pthread_cond_init (&wp->cond, NULL);
+    wp->fds[0] = wp->fds[1] = -1;
+    if (!(wp->queue = zlist_new ()) || !(wp->done = zlist_new ())) {
+        errno = ENOMEM;
+        goto error;
+    }
+    if (pipe2 (wp->fds, O_NONBLOCK | O_CLOEXEC) < 0)
+        goto error;
+    if (!(wp->w = flux_fd_watcher_create (r, wp->fds[0], FLUX_POLLIN,
+                                          completion_cb, wp)))
+        goto error;
+    if (!(wp->threads = calloc (nthreads, sizeof (wp->threads[0])))) {
+        errno = ENOMEM;
+        goto error;
+    }
+    while (wp->nthreads < nthreads) {
+        if ((errnum = pthread_create (&wp->threads[wp->nthreads], NULL,
+                                      worker, wp))) {
+            errno = errnum;
+            goto error;
+        }
+        wp->nthreads++;
+    }
+    flux_watcher_start (wp->w);
+    return wp;
+error:
+    workpool_destroy (wp);
+    return NULL;
+}
+
+int workpool_submit (workpool_t *wp, workpool_f work, workpool_f done,
+                     void *arg)
+{
+    struct work *w;
+
+    if (!wp || !work || !done) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(w = calloc (1, sizeof (*w)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    w->work = work;
+    w->done = done;
+    w->arg = arg;
+    pthread_mutex_lock (&wp->lock);
+    if (zlist_append (wp->queue, w) < 0) {
+        pthread_mutex_unlock (&wp->lock);
+        free (w);
+        errno = ENOMEM;
+        return -1;
+    }
+    pthread_cond_signal (&wp->cond);
+    pthread_mutex_unlock (&wp->lock);
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
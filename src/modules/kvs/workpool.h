@@ -0,0 +1,61 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#ifndef _FLUX_KVS_WORKPOOL_H
+#define _FLUX_KVS_WORKPOOL_H
+
+#include <flux/core.h>
+
+/* A workpool_t runs work items on a fixed set of threads, and calls
+ * each item's completion callback from the reactor thread once the
+ * work is done.  Work items must not use the flux_t handle.
+ *
+ * Items are started in the order submitted, but may complete in any order.
+ */
+
+typedef struct workpool workpool_t;
+
+typedef void (*workpool_f)(void *arg);
+
+/* Create a pool of 'nthreads' threads, with completions delivered via
+ * reactor 'r'.
+ */
+workpool_t *workpool_create (flux_reactor_t *r, int nthreads);
+
+/* Stop and join all threads.  Work that has not yet completed is dropped
+ * without calling its completion callback.
+ */
+void workpool_destroy (workpool_t *wp);
+
+/* Queue 'work' to be run on a pool thread.  When it returns, 'done'
+ * is called from the reactor thread.  Both are passed 'arg'.
+ */
+int workpool_submit (workpool_t *wp, workpool_f work, workpool_f done,
+                     void *arg);
+
+#endif /* !_FLUX_KVS_WORKPOOL_H */
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,990 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* kzstream.c - append-only stream service for libkz
+ *
+ * Each stream is an ordered list of blocks (zio json frames), appended
+ * by one writer and read by any number of readers.  Blocks are held in
+ * memory until enough of them accumulate to fill a chunk, which is then
+ * stored in the content store as a JSON array of blocks.  A stream's
+ * index is the list of its chunk blobrefs and block counts.
+ *
+ * Readers are answered from memory (inline blocks and chunk refs, which
+ * the reader loads itself).  A "watch" read is kept and receives a new
+ * response each time data is appended, instead of relying on KVS watches.
+ *
+ * At end of stream (EOF append, or disconnect of the writer), the last
+ * chunk is stored and the index is committed to the KVS as "<name>.index".
+ * Archival commits for streams that end close together are merged into
+ * one KVS transaction.  Archived streams are kept for 'archive_age'
+ * heartbeats so that readers racing with KVS propagation can still be
+ * answered, then dropped.
+ *
+ * The service runs on rank 0;  libkz sends all requests there.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <flux/core.h>
+#include <czmq.h>
+#include <jansson.h>
+
+#include "src/common/libutil/iterators.h"
+
+/* Store a chunk once it holds this many bytes of blocks.
+ */
+static const int default_chunk_size = 65536;
+
+/* Keep archived streams this many heartbeats.
+ */
+static const int default_archive_age = 2;
+
+typedef struct {
+    flux_t *h;
+    zhash_t *streams;
+    zlist_t *archive_queue;     /* ended streams ready to archive */
+    zlist_t *commits;           /* archive commits in progress */
+    flux_watcher_t *archive_w;
+    int epoch;
+    int chunk_size;
+    int archive_age;
+    struct {
+        int appends;
+        int blocks;
+        int chunks;
+        int archived;
+        int commits;
+    } stats;
+} kzstream_ctx_t;
+
+struct chunk {
+    int offset;                 /* stream offset of first block */
+    int count;
+    int size;                   /* bytes of block data */
+    json_t *blocks;             /* array of blocks, until stored */
+    char *ref;                  /* blobref, once stored */
+    flux_future_t *f;           /* content store in progress */
+    struct stream *s;
+};
+
+struct reader {
+    flux_msg_t *msg;
+    char *sender;
+    uint32_t matchtag;
+    int offset;                 /* next block to send */
+    bool watch;                 /* else respond once */
+};
+
+struct stream {
+    char *name;
+    bool created;               /* false for a placeholder with readers */
+    char *writer;               /* sender that opened the stream */
+    int count;                  /* blocks appended */
+    zlist_t *chunks;            /* in offset order */
+    struct chunk *tail;         /* unsealed chunk receiving appends */
+    int stores;                 /* content stores in progress */
+    zlist_t *readers;
+    bool eof;
+    bool archiving;
+    bool archived;
+    int archived_epoch;
+    int errnum;
+    flux_msg_t *eof_request;    /* respond once archived */
+    kzstream_ctx_t *ctx;
+};
+
+static void archive_check (struct stream *s);
+
+static void chunk_destroy (struct chunk *c)
+{
+    if (c) {
+        int saved_errno = errno;
+        json_decref (c->blocks);
+        free (c->ref);
+        flux_future_destroy (c->f);
+        free (c);
+        errno = saved_errno;
+    }
+}
+
+static struct chunk *chunk_create (struct stream *s)
+{
+    struct chunk *c;
+
+    if (!(c = calloc (1, sizeof (*c)))
+            || !(c->blocks = json_array ())) {
+        chunk_destroy (c);
+        errno = ENOMEM;
+        return NULL;
+    }
+    c->offset = s->count;
+    c->s = s;
+    return c;
+}
+
+static void reader_destroy (struct reader *r)
+{
+    if (r) {
+        int saved_errno = errno;
+        flux_msg_destroy (r->msg);
+        free (r->sender);
+        free (r);
+        errno = saved_errno;
+    }
+}
+
+static struct reader *reader_create (const flux_msg_t *msg, int offset,
+                                     bool watch)
+{
+    struct reader *r;
+
+    if (!(r = calloc (1, sizeof (*r))))
+        return NULL;
+    if (!(r->msg = flux_msg_copy (msg, false))
+            || flux_msg_get_route_first (msg, &r->sender) < 0
+            || flux_msg_get_matchtag (msg, &r->matchtag) < 0) {
+        reader_destroy (r);
+        return NULL;
+    }
+    r->offset = offset;
+    r->watch = watch;
+    return r;
+}
+
+/* Discard stream contents, failing any readers with 'errnum'.
+ */
+static void stream_clear (struct stream *s, int errnum)
+{
+    struct chunk *c;
+    struct reader *r;
+
+    while ((r = zlist_pop (s->readers))) {
+        if (flux_respond (s->ctx->h, r->msg, errnum, NULL) < 0)
+            flux_log_error (s->ctx->h, "%s: flux_respond", __FUNCTION__);
+        reader_destroy (r);
+    }
+    while ((c = zlist_pop (s->chunks)))
+        chunk_destroy (c);
+    s->tail = NULL;
+    s->stores = 0;
+    s->count = 0;
+    s->eof = false;
+    s->archived = false;
+    s->errnum = 0;
+    free (s->writer);
+    s->writer = NULL;
+    if (s->eof_request) {
+        if (flux_respond (s->ctx->h, s->eof_request, errnum, NULL) < 0)
+            flux_log_error (s->ctx->h, "%s: flux_respond", __FUNCTION__);
+        flux_msg_destroy (s->eof_request);
+        s->eof_request = NULL;
+    }
+}
+
+static void stream_destroy (void *arg)
+{
+    struct stream *s = arg;
+
+    if (s) {
+        int saved_errno = errno;
+        if (s->chunks && s->readers)
+            stream_clear (s, ENOSYS);
+        zlist_destroy (&s->chunks);
+        zlist_destroy (&s->readers);
+        free (s->name);
+        free (s);
+        errno = saved_errno;
+    }
+}
+
+static struct stream *stream_create (kzstream_ctx_t *ctx, const char *name)
+{
+    struct stream *s;
+
+    if (!(s = calloc (1, sizeof (*s))))
+        goto nomem;
+    s->ctx = ctx;
+    if (!(s->name = strdup (name))
+            || !(s->chunks = zlist_new ())
+            || !(s->readers = zlist_new ()))
+        goto nomem;
+    zhash_update (ctx->streams, name, s);
+    zhash_freefn (ctx->streams, name, stream_destroy);
+    return s;
+nomem:
+    stream_destroy (s);
+    errno = ENOMEM;
+    return NULL;
+}
+
+/* Build the data array for a read starting at 'offset':  inline blocks,
+ * and {"ref":s, "count":i} objects for stored chunks.  A stored chunk
+ * may begin before 'offset', so the offset of the first element is
+ * returned in 'startp'.
+ */
+static json_t *stream_data (struct stream *s, int offset, int *startp)
+{
+    json_t *data;
+    json_t *o;
+    struct chunk *c;
+    int start = offset;
+    bool first = true;
+    int i;
+
+    if (!(data = json_array ()))
+        goto nomem;
+    FOREACH_ZLIST (s->chunks, c) {
+        if (c->offset + c->count <= offset)
+            continue;
+        if (c->ref) {
+            if (first)
+                start = c->offset;
+            if (!(o = json_pack ("{s:s s:i}", "ref", c->ref,
+                                              "count", c->count))
+                    || json_array_append_new (data, o) < 0)
+                goto nomem;
+        }
+        else {
+            for (i = first ? offset - c->offset : 0; i < c->count; i++) {
+                if (json_array_append (data, json_array_get (c->blocks, i)) < 0)
+                    goto nomem;
+            }
+        }
+        first = false;
+    }
+    *startp = start;
+    return data;
+nomem:
+    json_decref (data);
+    errno = ENOMEM;
+    return NULL;
+}
+
+static int respond_data (struct stream *s, const flux_msg_t *msg, int offset)
+{
+    json_t *data;
+    int start;
+
+    if (!(data = stream_data (s, offset, &start)))
+        return -1;
+    return flux_respond_pack (s->ctx->h, msg, "{s:i s:o s:b}",
+                              "offset", start,
+                              "data", data,
+                              "eof", s->eof);
+}
+
+/* Send new data to readers.  Watch readers stay until end of stream,
+ * others are answered once.
+ */
+static void notify_readers (struct stream *s)
+{
+    struct reader *r;
+    zlist_t *done = NULL;
+
+    FOREACH_ZLIST (s->readers, r) {
+        if (r->offset >= s->count && !s->eof)
+            continue;
+        if (respond_data (s, r->msg, r->offset) < 0)
+            flux_log_error (s->ctx->h, "%s: respond_data", __FUNCTION__);
+        r->offset = s->count;
+        if (!r->watch || s->eof) {
+            if (!done && !(done = zlist_new ())) {
+                flux_log_error (s->ctx->h, "%s: zlist_new", __FUNCTION__);
+                break;
+            }
+            zlist_append (done, r);
+        }
+    }
+    if (done) {
+        while ((r = zlist_pop (done))) {
+            zlist_remove (s->readers, r);
+            reader_destroy (r);
+        }
+        zlist_destroy (&done);
+    }
+}
+
+static void store_continuation (flux_future_t *f, void *arg)
+{
+    struct chunk *c = arg;
+    struct stream *s = c->s;
+    const char *ref;
+
+    if (flux_content_store_get (f, &ref) < 0) {
+        flux_log_error (s->ctx->h, "%s: %s", __FUNCTION__, s->name);
+        s->errnum = errno;
+    }
+    else if (!(c->ref = strdup (ref))) {
+        flux_log_error (s->ctx->h, "%s: strdup", __FUNCTION__);
+        s->errnum = ENOMEM;
+    }
+    else {
+        json_decref (c->blocks);
+        c->blocks = NULL;
+        s->ctx->stats.chunks++;
+    }
+    flux_future_destroy (f);
+    c->f = NULL;
+    s->stores--;
+    archive_check (s);
+}
+
+/* Store the tail chunk in the content store.  Until that completes,
+ * readers are sent its blocks inline.
+ */
+static int seal_tail (struct stream *s)
+{
+    struct chunk *c = s->tail;
+    char *buf;
+
+    if (!c)
+        return 0;
+    s->tail = NULL;
+    if (!(buf = json_dumps (c->blocks, JSON_COMPACT))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    c->f = flux_content_store (s->ctx->h, buf, strlen (buf), 0);
+    free (buf);
+    if (!c->f || flux_future_then (c->f, -1., store_continuation, c) < 0)
+        return -1;
+    s->stores++;
+    return 0;
+}
+
+static int stream_append (struct stream *s, const char *block)
+{
+    if (!s->tail) {
+        if (!(s->tail = chunk_create (s)))
+            return -1;
+        if (zlist_append (s->chunks, s->tail) < 0) {
+            chunk_destroy (s->tail);
+            s->tail = NULL;
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    if (json_array_append_new (s->tail->blocks, json_string (block)) < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    s->tail->count++;
+    s->tail->size += strlen (block);
+    s->count++;
+    s->ctx->stats.blocks++;
+    if (s->tail->size >= s->ctx->chunk_size)
+        return seal_tail (s);
+    return 0;
+}
+
+/* End the stream.  If 'msg' is non-NULL, respond to it once the stream
+ * has been archived.
+ */
+static int stream_end (struct stream *s, const flux_msg_t *msg)
+{
+    s->eof = true;
+    if (msg && !(s->eof_request = flux_msg_copy (msg, false)))
+        return -1;
+    if (seal_tail (s) < 0)
+        s->errnum = errno;
+    notify_readers (s);
+    archive_check (s);
+    return 0;
+}
+
+/* Queue an ended stream for archival once all its chunks are stored.
+ */
+static void archive_check (struct stream *s)
+{
+    kzstream_ctx_t *ctx = s->ctx;
+
+    if (!s->eof || s->stores > 0 || s->archiving || s->archived)
+        return;
+    if (zlist_append (ctx->archive_queue, s) < 0) {
+        flux_log (ctx->h, LOG_ERR, "%s: out of memory", __FUNCTION__);
+        return;
+    }
+    s->archiving = true;
+    flux_watcher_start (ctx->archive_w);
+}
+
+static json_t *stream_index (struct stream *s)
+{
+    json_t *chunks;
+    json_t *o;
+    struct chunk *c;
+
+    if (!(chunks = json_array ()))
+        goto nomem;
+    FOREACH_ZLIST (s->chunks, c) {
+        if (!(o = json_pack ("{s:s s:i}", "ref", c->ref, "count", c->count))
+                || json_array_append_new (chunks, o) < 0)
+            goto nomem;
+    }
+    return chunks;
+nomem:
+    json_decref (chunks);
+    errno = ENOMEM;
+    return NULL;
+}
+
+static void archive_finish (struct stream *s, int errnum)
+{
+    kzstream_ctx_t *ctx = s->ctx;
+
+    s->archiving = false;
+    s->archived = true;
+    s->archived_epoch = ctx->epoch;
+    if (errnum)
+        s->errnum = errnum;
+    else
+        ctx->stats.archived++;
+    if (s->eof_request) {
+        if (flux_respond (ctx->h, s->eof_request, s->errnum, NULL) < 0)
+            flux_log_error (ctx->h, "%s: flux_respond", __FUNCTION__);
+        flux_msg_destroy (s->eof_request);
+        s->eof_request = NULL;
+    }
+}
+
+static void batch_destroy (void *arg)
+{
+    zlist_t *batch = arg;
+    zlist_destroy (&batch);
+}
+
+static void archive_continuation (flux_future_t *f, void *arg)
+{
+    kzstream_ctx_t *ctx = arg;
+    zlist_t *batch = flux_future_aux_get (f, "batch");
+    struct stream *s;
+    int errnum = 0;
+
+    if (flux_future_get (f, NULL) < 0) {
+        flux_log_error (ctx->h, "%s: flux_kvs_commit", __FUNCTION__);
+        errnum = errno;
+    }
+    while ((s = zlist_pop (batch)))
+        archive_finish (s, errnum);
+    zlist_remove (ctx->commits, f);
+    flux_future_destroy (f);
+}
+
+/* Commit the indices of all streams queued for archival in one
+ * KVS transaction.
+ */
+static void archive_cb (flux_reactor_t *r, flux_watcher_t *w,
+                        int revents, void *arg)
+{
+    kzstream_ctx_t *ctx = arg;
+    flux_kvs_txn_t *txn = NULL;
+    flux_future_t *f = NULL;
+    zlist_t *batch = NULL;
+    struct stream *s;
+    json_t *chunks;
+    char *key;
+
+    flux_watcher_stop (w);
+    if (!(txn = flux_kvs_txn_create ()) || !(batch = zlist_new ())) {
+        flux_log_error (ctx->h, "%s: out of memory", __FUNCTION__);
+        goto error;
+    }
+    while ((s = zlist_pop (ctx->archive_queue))) {
+        if (s->errnum) {
+            archive_finish (s, s->errnum);
+            continue;
+        }
+        if (!(chunks = stream_index (s))
+                || asprintf (&key, "%s.index", s->name) < 0) {
+            json_decref (chunks);
+            archive_finish (s, ENOMEM);
+            continue;
+        }
+        if (flux_kvs_txn_pack (txn, 0, key, "{s:i s:i s:o}",
+                               "version", 1,
+                               "count", s->count,
+                               "chunks", chunks) < 0) {
+            archive_finish (s, errno);
+            free (key);
+            continue;
+        }
+        free (key);
+        if (zlist_append (batch, s) < 0)
+            archive_finish (s, ENOMEM);
+    }
+    if (zlist_size (batch) > 0) {
+        if (!(f = flux_kvs_commit (ctx->h, 0, txn))
+                || flux_future_then (f, -1., archive_continuation, ctx) < 0
+                || zlist_append (ctx->commits, f) < 0) {
+            flux_log_error (ctx->h, "%s: flux_kvs_commit", __FUNCTION__);
+            goto error;
+        }
+        if (flux_future_aux_set (f, "batch", batch, batch_destroy) < 0) {
+            flux_log_error (ctx->h, "%s: flux_future_aux_set", __FUNCTION__);
+            goto error;
+        }
+        batch = NULL;
+        ctx->stats.commits++;
+    }
+    zlist_destroy (&batch);
+    flux_kvs_txn_destroy (txn);
+    return;
+error:
+    while (batch && (s = zlist_pop (batch)))
+        archive_finish (s, EIO);
+    zlist_destroy (&batch);
+    while ((s = zlist_pop (ctx->archive_queue)))
+        archive_finish (s, EIO);
+    if (f) {
+        zlist_remove (ctx->commits, f);
+        flux_future_destroy (f);
+    }
+    flux_kvs_txn_destroy (txn);
+}
+
+/* Drop a placeholder stream that no longer has readers.
+ */
+static void placeholder_check (kzstream_ctx_t *ctx, struct stream *s)
+{
+    if (!s->created && zlist_size (s->readers) == 0)
+        zhash_delete (ctx->streams, s->name);
+}
+
+static void open_request_cb (flux_t *h, flux_msg_handler_t *mh,
+                             const flux_msg_t *msg, void *arg)
+{
+    kzstream_ctx_t *ctx = arg;
+    const char *name;
+    int trunc = 0;
+    struct stream *s;
+    char *sender = NULL;
+
+    if (flux_request_unpack (msg, NULL, "{s:s s?b}",
+                             "name", &name,
+                             "trunc", &trunc) < 0)
+        goto error;
+    if (flux_msg_get_route_first (msg, &sender) < 0)
+        goto error;
+    if ((s = zhash_lookup (ctx->streams, name)) && s->created) {
+        if (!trunc) {
+            errno = EEXIST;
+            goto error;
+        }
+        if (s->archiving || s->stores > 0) {
+            errno = EBUSY;
+            goto error;
+        }
+        stream_clear (s, ENODATA);
+    }
+    if (!s && !(s = stream_create (ctx, name)))
+        goto error;
+    s->created = true;
+    s->writer = sender;
+    if (flux_respond (h, msg, 0, NULL) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+    return;
+error:
+    if (flux_respond (h, msg, errno, NULL) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+    free (sender);
+}
+
+static void append_request_cb (flux_t *h, flux_msg_handler_t *mh,
+                               const flux_msg_t *msg, void *arg)
+{
+    kzstream_ctx_t *ctx = arg;
+    const char *name;
+    int offset;
+    json_t *blocks;
+    int eof = 0;
+    struct stream *s;
+    size_t index;
+    json_t *value;
+    uint32_t matchtag;
+
+    if (flux_request_unpack (msg, NULL, "{s:s s:i s:o s?b}",
+                             "name", &name,
+                             "offset", &offset,
+                             "blocks", &blocks,
+                             "eof", &eof) < 0)
+        goto error;
+    if (!json_is_array (blocks)) {
+        errno = EPROTO;
+        goto error;
+    }
+    if (!(s = zhash_lookup (ctx->streams, name)) || !s->created) {
+        errno = ENOENT;
+        goto error;
+    }
+    if (s->eof) {
+        errno = EINVAL;
+        goto error;
+    }
+    if (offset != s->count) {
+        errno = EPROTO;
+        goto error;
+    }
+    json_array_foreach (blocks, index, value) {
+        if (!json_is_string (value)) {
+            errno = EPROTO;
+            goto error;
+        }
+        if (stream_append (s, json_string_value (value)) < 0) {
+            flux_log_error (h, "%s: %s", __FUNCTION__, name);
+            s->errnum = errno;
+        }
+    }
+    ctx->stats.appends++;
+    if (eof) {
+        /* A writer that does not wait for archival sends EOF
+         * with FLUX_RPC_NORESPONSE.
+         */
+        if (flux_msg_get_matchtag (msg, &matchtag) < 0)
+            goto error;
+        if (stream_end (s, matchtag != FLUX_MATCHTAG_NONE ? msg : NULL) < 0)
+            goto error;
+        return; /* respond once archived */
+    }
+    notify_readers (s);
+    if (flux_respond (h, msg, s->errnum, NULL) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+    return;
+error:
+    if (flux_respond (h, msg, errno, NULL) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+}
+
+/* Read from 'offset'.  Without "wait" or "watch", respond immediately,
+ * possibly with no data.  With "wait", respond once there is data or
+ * the stream has ended.  With "watch", respond immediately, then again
+ * each time there is new data, until the stream ends.  With "noexist",
+ * reading a stream that has not been opened yet is not an error.
+ */
+static void read_request_cb (flux_t *h, flux_msg_handler_t *mh,
+                             const flux_msg_t *msg, void *arg)
+{
+    kzstream_ctx_t *ctx = arg;
+    const char *name;
+    int offset;
+    int wait = 0;
+    int watch = 0;
+    int noexist = 0;
+    struct stream *s;
+    struct reader *r;
+    bool now;
+
+    if (flux_request_unpack (msg, NULL, "{s:s s:i s?b s?b s?b}",
+                             "name", &name,
+                             "offset", &offset,
+                             "wait", &wait,
+                             "watch", &watch,
+                             "noexist", &noexist) < 0)
+        goto error;
+    if (offset < 0) {
+        errno = EPROTO;
+        goto error;
+    }
+    if (!(s = zhash_lookup (ctx->streams, name))) {
+        if (!noexist) {
+            errno = ENOENT;
+            goto error;
+        }
+        if (!wait && !watch) {
+            if (flux_respond_pack (h, msg, "{s:i s:[] s:b}",
+                                   "offset", offset,
+                                   "data",
+                                   "eof", false) < 0)
+                flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+            return;
+        }
+        if (!(s = stream_create (ctx, name)))
+            goto error;
+    }
+    now = (watch || !wait || offset < s->count || s->eof);
+    if (now) {
+        if (respond_data (s, msg, offset) < 0)
+            flux_log_error (h, "%s: respond_data", __FUNCTION__);
+        offset = s->count;
+    }
+    if ((watch && !s->eof) || !now) {
+        if (!(r = reader_create (msg, offset, watch))
+                || zlist_append (s->readers, r) < 0) {
+            reader_destroy (r);
+            flux_log_error (h, "%s: adding reader", __FUNCTION__);
+            if (!now)
+                goto error;
+        }
+    }
+    placeholder_check (ctx, s);
+    return;
+error:
+    if (flux_respond (h, msg, errno, NULL) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+}
+
+static void unwatch_request_cb (flux_t *h, flux_msg_handler_t *mh,
+                                const flux_msg_t *msg, void *arg)
+{
+    kzstream_ctx_t *ctx = arg;
+    const char *name;
+    int matchtag;
+    char *sender = NULL;
+    struct stream *s;
+    struct reader *r;
+
+    if (flux_request_unpack (msg, NULL, "{s:s s:i}",
+                             "name", &name,
+                             "matchtag", &matchtag) < 0
+            || flux_msg_get_route_first (msg, &sender) < 0)
+        goto error;
+    if ((s = zhash_lookup (ctx->streams, name))) {
+        FOREACH_ZLIST (s->readers, r) {
+            if (r->matchtag == matchtag && !strcmp (r->sender, sender))
+                break;
+        }
+        if (r) {
+            zlist_remove (s->readers, r);
+            reader_destroy (r);
+        }
+        placeholder_check (ctx, s);
+    }
+    free (sender);
+    if (flux_respond (h, msg, 0, NULL) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+    return;
+error:
+    free (sender);
+    if (flux_respond (h, msg, errno, NULL) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+}
+
+/* Drop readers belonging to a disconnected client, and end any stream
+ * it was writing, so that what was written is archived.
+ */
+static void disconnect_request_cb (flux_t *h, flux_msg_handler_t *mh,
+                                   const flux_msg_t *msg, void *arg)
+{
+    kzstream_ctx_t *ctx = arg;
+    char *sender;
+    zlist_t *names;
+    char *name;
+    struct stream *s;
+    struct reader *r;
+    zlist_t *gone;
+
+    if (flux_msg_get_route_first (msg, &sender) < 0)
+        return;
+    if (!(names = zhash_keys (ctx->streams)) || !(gone = zlist_new ())) {
+        flux_log_error (h, "%s: out of memory", __FUNCTION__);
+        zlist_destroy (&names);
+        free (sender);
+        return;
+    }
+    while ((name = zlist_pop (names))) {
+        if ((s = zhash_lookup (ctx->streams, name))) {
+            FOREACH_ZLIST (s->readers, r) {
+                if (!strcmp (r->sender, sender))
+                    zlist_append (gone, r);
+            }
+            while ((r = zlist_pop (gone))) {
+                zlist_remove (s->readers, r);
+                reader_destroy (r);
+            }
+            if (s->created && !s->eof && s->writer
+                           && !strcmp (s->writer, sender)) {
+                if (stream_end (s, NULL) < 0)
+                    flux_log_error (h, "%s: stream_end", __FUNCTION__);
+            }
+            placeholder_check (ctx, s);
+        }
+        free (name);
+    }
+    zlist_destroy (&gone);
+    zlist_destroy (&names);
+    free (sender);
+}
+
+static void stats_request_cb (flux_t *h, flux_msg_handler_t *mh,
+                              const flux_msg_t *msg, void *arg)
+{
+    kzstream_ctx_t *ctx = arg;
+
+    if (flux_respond_pack (h, msg, "{s:i s:i s:i s:i s:i s:i}",
+                           "#streams", (int)zhash_size (ctx->streams),
+                           "#appends", ctx->stats.appends,
+                           "#blocks", ctx->stats.blocks,
+                           "#chunks stored", ctx->stats.chunks,
+                           "#streams archived", ctx->stats.archived,
+                           "#archive commits", ctx->stats.commits) < 0)
+        flux_log_error (h, "%s: flux_respond", __FUNCTION__);
+}
+
+/* Forget archived streams after 'archive_age' heartbeats.  By then,
+ * readers on all ranks will find the index in the KVS.
+ */
+static void heartbeat_cb (flux_t *h, flux_msg_handler_t *mh,
+                          const flux_msg_t *msg, void *arg)
+{
+    kzstream_ctx_t *ctx = arg;
+    zlist_t *names;
+    char *name;
+    struct stream *s;
+
+    if (flux_heartbeat_decode (msg, &ctx->epoch) < 0) {
+        flux_log_error (h, "%s: flux_heartbeat_decode", __FUNCTION__);
+        return;
+    }
+    if (!(names = zhash_keys (ctx->streams))) {
+        flux_log_error (h, "%s: zhash_keys", __FUNCTION__);
+        return;
+    }
+    while ((name = zlist_pop (names))) {
+        if ((s = zhash_lookup (ctx->streams, name))
+                && s->archived
+                && ctx->epoch - s->archived_epoch > ctx->archive_age
+                && zlist_size (s->readers) == 0)
+            zhash_delete (ctx->streams, name);
+        free (name);
+    }
+    zlist_destroy (&names);
+}
+
+static void freectx (void *arg)
+{
+    kzstream_ctx_t *ctx = arg;
+    flux_future_t *f;
+
+    if (ctx) {
+        if (ctx->commits) {
+            while ((f = zlist_pop (ctx->commits)))
+                flux_future_destroy (f);
+            zlist_destroy (&ctx->commits);
+        }
+        zlist_destroy (&ctx->archive_queue);
+        zhash_destroy (&ctx->streams);
+        flux_watcher_destroy (ctx->archive_w);
+        free (ctx);
+    }
+}
+
+static kzstream_ctx_t *getctx (flux_t *h)
+{
+    kzstream_ctx_t *ctx = flux_aux_get (h, "kzstream");
+    flux_reactor_t *r = flux_get_reactor (h);
+
+    if (!ctx) {
+        if (!(ctx = calloc (1, sizeof (*ctx)))) {
+            errno = ENOMEM;
+            goto error;
+        }
+        ctx->h = h;
+        ctx->chunk_size = default_chunk_size;
+        ctx->archive_age = default_archive_age;
+        if (!(ctx->streams = zhash_new ())
+                || !(ctx->archive_queue = zlist_new ())
+                || !(ctx->commits = zlist_new ())) {
+            errno = ENOMEM;
+            goto error;
+        }
+        if (!(ctx->archive_w = flux_timer_watcher_create (r, 0., 0.,
+                                                          archive_cb, ctx)))
+            goto error;
+        flux_aux_set (h, "kzstream", ctx, freectx);
+    }
+    return ctx;
+error:
+    freectx (ctx);
+    return NULL;
+}
+
+static void process_args (kzstream_ctx_t *ctx, int ac, char **av)
+{
+    int i;
+
+    for (i = 0; i < ac; i++) {
+        if (strncmp (av[i], "chunk-size=", 11) == 0)
+            ctx->chunk_size = strtoul (av[i]+11, NULL, 10);
+        else if (strncmp (av[i], "archive-age=", 12) == 0)
+            ctx->archive_age = strtoul (av[i]+12, NULL, 10);
+        else
+            flux_log (ctx->h, LOG_ERR, "Unknown option `%s'", av[i]);
+    }
+}
+
+static struct flux_msg_handler_spec htab[] = {
+    { FLUX_MSGTYPE_REQUEST, "kzstream.open",        open_request_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "kzstream.append",      append_request_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "kzstream.read",        read_request_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "kzstream.unwatch",     unwatch_request_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "kzstream.disconnect",  disconnect_request_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "kzstream.stats.get",   stats_request_cb, 0 },
+    { FLUX_MSGTYPE_EVENT,   "hb",                   heartbeat_cb, 0 },
+    FLUX_MSGHANDLER_TABLE_END,
+};
+
+int mod_main (flux_t *h, int argc, char **argv)
+{
+    kzstream_ctx_t *ctx = getctx (h);
+    flux_msg_handler_t **handlers = NULL;
+    int rc = -1;
+
+    if (!ctx) {
+        flux_log_error (h, "error creating kzstream context");
+        goto done;
+    }
+    process_args (ctx, argc, argv);
+    if (ctx->chunk_size < 1) {
+        flux_log (h, LOG_ERR, "chunk-size must be > 0");
+        errno = EINVAL;
+        goto done;
+    }
+    if (flux_event_subscribe (h, "hb") < 0) {
+        flux_log_error (h, "flux_event_subscribe");
+        goto done;
+    }
+    if (flux_msg_handler_addvec (h, htab, ctx, &handlers) < 0) {
+        flux_log_error (h, "flux_msg_handler_addvec");
+        goto done;
+    }
+    if (flux_reactor_run (flux_get_reactor (h), 0) < 0) {
+        flux_log_error (h, "flux_reactor_run");
+        goto done;
+    }
+    rc = 0;
+done:
+    flux_msg_handler_delvec (handlers);
+    return rc;
+}
+
+MOD_NAME ("kzstream");
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -49,6 +49,7 @@
 #include "src/common/libutil/sds.h"
 #include "src/common/libutil/fdwalk.h"
 #include "src/common/libutil/shortjson.h"
+#include "src/common/libutil/base64.h"
 #include "src/common/libsubprocess/zio.h"
 #include "src/common/libpmi/simple_server.h"
 #include "src/common/libkz/kz.h"
@@ -89,9 +90,21 @@ struct prog_ctx {
     flux_kvsdir_t *kvs;     /* Handle to this job's dir in kvs */
     flux_kvsdir_t *resources; /* Handle to this node's resource dir in kvs */
     int *cores_per_node;    /* Number of tasks/cores per nodeid in this job */
+    int *noderanks;         /* Broker rank of each nodeid in this job */
 
     kz_t *kz_err;           /* kz stream for errors and debug */
 
+    /*
+     *  Task output batching: output from all tasks is flushed together
+     *   once io_batch_bytes are pending, or io_batch_timeout seconds
+     *   after the first unflushed output.
+     */
+    zlist_t *io_pending;    /* task kz streams with unflushed output */
+    int io_pending_bytes;
+    int io_batch_bytes;
+    double io_batch_timeout;
+    flux_watcher_t *io_timer;
+
     flux_watcher_t *fdw;
     flux_msg_handler_t *mw;
 
@@ -99,6 +112,12 @@ struct prog_ctx {
     unsigned int barrier_sequence;
     char barrier_name[64];
     flux_kvs_txn_t *barrier_txn;
+    char *pmi_kvsname;
+    zhash_t *pmi_cache;     /* pmi_kvsname values known on this node */
+    bool pmi_allgather;     /* exchange puts with allgather, not kvs fence */
+    json_object *pmi_puts;  /* allgather: puts since last barrier */
+    int pmi_gets;           /* PMI_KVS_Get requests served */
+    int pmi_lookups;        /* ... that cost a KVS lookup */
 
     uint32_t noderank;
 
@@ -344,9 +363,67 @@ const char * ioname (int s)
     return "";
 }
 
+/*
+ *  Flush all task output streams with pending output.  With the KVS
+ *   backend, the first kz_flush() commits the puts of all streams in
+ *   one transaction, and the rest have nothing left to commit.
+ */
+static void io_batch_flush (struct prog_ctx *ctx)
+{
+    kz_t *kz;
+
+    while ((kz = zlist_pop (ctx->io_pending))) {
+        if (kz_flush (kz) < 0)
+            wlog_err (ctx, "kz_flush: %s", flux_strerror (errno));
+    }
+    ctx->io_pending_bytes = 0;
+    if (ctx->io_timer)
+        flux_watcher_stop (ctx->io_timer);
+}
+
+static void io_timer_cb (flux_reactor_t *r, flux_watcher_t *w,
+                         int revents, void *arg)
+{
+    io_batch_flush (arg);
+}
+
+/*
+ *  Add len bytes of output written to kz to the current batch.
+ */
+static void io_batch_add (struct prog_ctx *ctx, kz_t *kz, int len)
+{
+    bool first = (zlist_size (ctx->io_pending) == 0);
+
+    if (!zlist_exists (ctx->io_pending, kz)
+        && zlist_append (ctx->io_pending, kz) < 0) {
+        wlog_err (ctx, "io_batch_add: out of memory");
+        if (kz_flush (kz) < 0)
+            wlog_err (ctx, "kz_flush: %s", flux_strerror (errno));
+        return;
+    }
+    ctx->io_pending_bytes += len;
+    if (ctx->io_pending_bytes >= ctx->io_batch_bytes || !ctx->io_timer)
+        io_batch_flush (ctx);
+    else if (first) {
+        flux_timer_watcher_reset (ctx->io_timer, ctx->io_batch_timeout, 0.);
+        flux_watcher_start (ctx->io_timer);
+    }
+}
+
+/*
+ *  Flush the current batch before kz is closed, if it includes kz.
+ *   Pending output of other tasks stays ahead of this task's EOF.
+ */
+static void io_batch_remove (struct prog_ctx *ctx, kz_t *kz)
+{
+    if (zlist_exists (ctx->io_pending, kz))
+        io_batch_flush (ctx);
+}
+
 /*
  *  Turn a possibly multi-line zio json_string into one kz_put() per
- *   line with a delayed commit until after the line(s) are complete.
+ *   line.  Unless stdio-delay-commit is set, add the output to the
+ *   current batch, so it is flushed along with that of other tasks.
  */
 int task_kz_put_lines (struct task_info *t, kz_t *kz, const char *data, int len)
 {
@@ -375,7 +452,7 @@ int task_kz_put_lines (struct task_info *t, kz_t *kz, const char *data, int len)
     sdsfreesplitres (line, count);
 
     if (!prog_ctx_getopt (t->ctx, "stdio-delay-commit"))
-        kz_flush (kz);
+        io_batch_add (t->ctx, kz, len);
 
     return (count);
 }
@@ -431,6 +508,7 @@ int io_cb (zio_t *z, const char *s, int len, void *arg)
     if (len > 0)
         task_kz_put_lines (t, kz, s, len);
     else if (kz) {
+        io_batch_remove (t->ctx, kz);
         kz_close (kz);
         t->kz [type] = NULL;
         prog_ctx_remove_completion_ref (t->ctx, "task.%d.%s",
@@ -551,6 +629,7 @@ void task_io_flush (struct task_info *t)
         /* Close all kz objects that haven't been closed already
          */
         if (t->kz [i]) {
+            io_batch_remove (t->ctx, t->kz [i]);
             kz_close (t->kz [i]);
             t->kz [i] = NULL;
         }
@@ -643,6 +722,9 @@ void prog_ctx_destroy (struct prog_ctx *ctx)
 
     if (ctx->fdw)
         flux_watcher_destroy (ctx->fdw);
+    if (ctx->io_timer)
+        flux_watcher_destroy (ctx->io_timer);
+    zlist_destroy (&ctx->io_pending);
     if (ctx->mw)
         flux_msg_handler_destroy (ctx->mw);
 
@@ -657,6 +739,7 @@ void prog_ctx_destroy (struct prog_ctx *ctx)
         pmi_simple_server_destroy (ctx->pmi);
 
     free (ctx->cores_per_node);
+    free (ctx->noderanks);
 
     if (ctx->options)
         zhash_destroy (&ctx->options);
@@ -664,6 +747,10 @@ void prog_ctx_destroy (struct prog_ctx *ctx)
         zhash_destroy (&ctx->completion_refs);
 
     flux_kvs_txn_destroy (ctx->barrier_txn);
+    if (ctx->pmi_cache)
+        zhash_destroy (&ctx->pmi_cache);
+    free (ctx->pmi_kvsname);
+    Jput (ctx->pmi_puts);
 
     free (ctx);
 }
@@ -736,6 +823,8 @@ struct prog_ctx * prog_ctx_create (void)
     if (!(ctx->options = zhash_new ())
         || !(ctx->completion_refs = zhash_new ()))
         wlog_fatal (ctx, 1, "zhash_new");
+    if (!(ctx->io_pending = zlist_new ()))
+        wlog_fatal (ctx, 1, "zlist_new");
 
     ctx->envz = NULL;
     ctx->envz_len = 0;
@@ -873,7 +962,7 @@ int prog_ctx_get_nodeinfo (struct prog_ctx *ctx)
         }
         ctx->globalbasis += ctx->cores_per_node [i];
     }
-    free (nodeids);
+    ctx->noderanks = nodeids;
     wlog_debug (ctx, "%s: node%d: basis=%d",
         ctx->kvspath, ctx->nodeid, ctx->globalbasis);
     return (0);
@@ -2127,6 +2216,31 @@ int task_info_io_setup (struct task_info *t)
     return (0);
 }
 
+/*
+ *  Task output batch limits may be set with the stdio-batch-bytes and
+ *   stdio-batch-ms options.  A limit of 0 flushes every write.
+ */
+static int prog_ctx_io_batch_init (struct prog_ctx *ctx)
+{
+    const char *s;
+
+    ctx->io_batch_bytes = 65536;
+    ctx->io_batch_timeout = 0.01;
+    if ((s = prog_ctx_getopt (ctx, "stdio-batch-bytes")))
+        ctx->io_batch_bytes = strtoul (s, NULL, 10);
+    if ((s = prog_ctx_getopt (ctx, "stdio-batch-ms")))
+        ctx->io_batch_timeout = strtoul (s, NULL, 10) / 1000.;
+
+    ctx->io_timer = flux_timer_watcher_create (flux_get_reactor (ctx->flux),
+            ctx->io_batch_timeout, 0.,
+            io_timer_cb,
+            (void *) ctx);
+    if (!ctx->io_timer)
+        return wlog_err (ctx, "flux_timer_watcher_create: %s",
+                        flux_strerror (errno));
+    return (0);
+}
+
 int prog_ctx_reactor_init (struct prog_ctx *ctx)
 {
     int i;
@@ -2143,6 +2257,9 @@ int prog_ctx_reactor_init (struct prog_ctx *ctx)
         return wlog_err (ctx, "flux_event_subscribe (hb): %s",
                         flux_strerror (errno));
 
+    if (prog_ctx_io_batch_init (ctx) < 0)
+        return (-1);
+
     for (i = 0; i < ctx->nprocs; i++) {
         task_info_io_setup (ctx->task [i]);
         zio_flux_attach (ctx->task[i]->pmi_zio, ctx->flux);
@@ -2173,6 +2290,14 @@ static int wreck_pmi_kvs_put (void *arg, const char *kvsname,
     char *kvskey = NULL;
     int rc = -1;
 
+    if (ctx->pmi_allgather) {
+        if (!ctx->pmi_puts && !(ctx->pmi_puts = Jnew ())) {
+            wlog_err (ctx, "pmi_kvs_put: Jnew: %s", strerror (ENOMEM));
+            return (-1);
+        }
+        Jadd_str (ctx->pmi_puts, key, val);
+        return (0);
+    }
     if (asprintf (&kvskey, "%s.%s", kvsname, key) < 0) {
         wlog_err (ctx, "pmi_kvs_put: asprintf: %s", strerror (errno));
         goto done;
@@ -2202,11 +2327,29 @@ static int wreck_pmi_kvs_get (void *arg, const char *kvsname, const char *key,
     int rc = 0;
     flux_future_t *f;
 
+    ctx->pmi_gets++;
+
+    /*  Serve the get from keys prefetched after the last barrier, if
+     *   possible.  Anything not found there (e.g. a large value stored
+     *   by reference) falls through to a lookup of the single key.
+     */
+    if (ctx->pmi_cache && ctx->pmi_kvsname
+        && !strcmp (kvsname, ctx->pmi_kvsname)
+        && (s = zhash_lookup (ctx->pmi_cache, key))) {
+        if (strlen (s) >= len) {
+            errno = ENOSPC;
+            return (-1);
+        }
+        strcpy (val, s);
+        return (0);
+    }
+
     if (asprintf (&kvskey, "%s.%s", kvsname, key) < 0) {
         wlog_err (ctx, "pmi_kvs_get: asprintf: %s", strerror (errno));
         return (-1);
     }
 
+    ctx->pmi_lookups++;
     if (!(f = flux_kvs_lookup (ctx->flux, 0, kvskey))) {
         wlog_err (ctx, "pmi_kvs_get: flux_kvs_lookup: %s", strerror (errno));
         free (kvskey);
@@ -2240,13 +2383,256 @@ static void wreck_barrier_next (struct prog_ctx *ctx)
               ctx->id, ctx->barrier_sequence++);
 }
 
+static void wreck_pmi_cache_clear (struct prog_ctx *ctx)
+{
+    if (ctx->pmi_cache)
+        zhash_purge (ctx->pmi_cache);
+}
+
+/*
+ *  Decode the value of treeobj 'dirent' into the string originally
+ *   stored with flux_kvs_txn_pack (..., "s", val).  Caller must free.
+ */
+static char *pmi_dirent_decode (json_object *dirent)
+{
+    const char *type, *data;
+    char *buf = NULL;
+    char *s = NULL;
+    int len, xlen;
+    json_object *o = NULL;
+
+    if (!Jget_str (dirent, "type", &type) || strcmp (type, "val") != 0
+        || !Jget_str (dirent, "data", &data))
+        goto done;
+    xlen = strlen (data);
+    len = base64_decode_length (xlen);
+    if (!(buf = malloc (len)))
+        goto done;
+    if (base64_decode_block (buf, &len, data, xlen) < 0)
+        goto done;
+    if (!(o = Jfromstr (buf))
+        || json_object_get_type (o) != json_type_string)
+        goto done;
+    s = strdup (json_object_get_string (o));
+done:
+    Jput (o);
+    free (buf);
+    return (s);
+}
+
+/*
+ *  Fill the PMI key cache from the treeobj directory 'dirobj'.
+ *   Entries that are not plain values are skipped.
+ */
+static int wreck_pmi_cache_load (struct prog_ctx *ctx, const char *dirobj)
+{
+    json_object *o;
+    json_object *data;
+    char *s;
+    int rc = -1;
+
+    if (!ctx->pmi_cache && !(ctx->pmi_cache = zhash_new ())) {
+        errno = ENOMEM;
+        return (-1);
+    }
+    if (!(o = Jfromstr (dirobj)) || !Jget_obj (o, "data", &data)
+        || json_object_get_type (data) != json_type_object) {
+        errno = EPROTO;
+        goto done;
+    }
+    {
+        json_object_object_foreach (data, name, dirent) {
+            if (!(s = pmi_dirent_decode (dirent)))
+                continue;
+            zhash_update (ctx->pmi_cache, name, s);
+            zhash_freefn (ctx->pmi_cache, name, free);
+        }
+    }
+    rc = 0;
+done:
+    Jput (o);
+    return (rc);
+}
+
+/*
+ *  Add the key-value pairs in 'data' to the PMI key cache.
+ */
+static int wreck_pmi_cache_update (struct prog_ctx *ctx, json_object *data)
+{
+    char *s;
+
+    if (!ctx->pmi_cache && !(ctx->pmi_cache = zhash_new ())) {
+        errno = ENOMEM;
+        return (-1);
+    }
+    if (json_object_get_type (data) != json_type_object) {
+        errno = EPROTO;
+        return (-1);
+    }
+    {
+        json_object_object_foreach (data, name, val) {
+            if (json_object_get_type (val) != json_type_string
+                || !(s = strdup (json_object_get_string (val))))
+                continue;
+            zhash_update (ctx->pmi_cache, name, s);
+            zhash_freefn (ctx->pmi_cache, name, free);
+        }
+    }
+    return (0);
+}
+
+static void wreck_pmi_prefetch_cb (flux_future_t *f, void *arg)
+{
+    struct prog_ctx *ctx = arg;
+    const char *dirobj;
+
+    if (flux_kvs_lookup_get_treeobj (f, &dirobj) < 0
+        || wreck_pmi_cache_load (ctx, dirobj) < 0) {
+        if (errno != ENOENT)
+            wlog_debug (ctx, "pmi: prefetch %s: %s", ctx->pmi_kvsname,
+                        strerror (errno));
+        wreck_pmi_cache_clear (ctx);
+    }
+    pmi_simple_server_barrier_complete (ctx->pmi, 0);
+    flux_future_destroy (f);
+}
+
+/*
+ *  Once the fence is complete, fetch the whole PMI kvsname directory in
+ *   one lookup before releasing the local tasks from the barrier, so that
+ *   their subsequent gets are served from memory instead of costing one
+ *   KVS lookup each.  If the lookup can't be started, release the tasks
+ *   anyway and let gets fall back to individual lookups.
+ */
 static void wreck_barrier_complete (flux_future_t *f, void *arg)
 {
     struct prog_ctx *ctx = arg;
     int rc = flux_future_get (f, NULL);
-    pmi_simple_server_barrier_complete (ctx->pmi, rc);
+    flux_future_t *lf = NULL;
+
+    flux_future_destroy (f);
+    wreck_barrier_next (ctx);
+
+    if (rc == 0 && ctx->pmi_kvsname) {
+        if (!(lf = flux_kvs_lookup (ctx->flux, FLUX_KVS_READDIR,
+                                    ctx->pmi_kvsname))
+            || flux_future_then (lf, -1., wreck_pmi_prefetch_cb, ctx) < 0) {
+            wlog_debug (ctx, "pmi: prefetch %s: %s", ctx->pmi_kvsname,
+                        strerror (errno));
+            flux_future_destroy (lf);
+            lf = NULL;
+        }
+    }
+    if (!lf)
+        pmi_simple_server_barrier_complete (ctx->pmi, rc);
+}
+
+static int wreck_pmi_barrier_enter (void *arg);
+
+/*
+ *  The allgather module is not loaded: put this barrier's keys into a
+ *   transaction and use the kvs fence for this and later barriers.
+ */
+static void wreck_pmi_allgather_fallback (struct prog_ctx *ctx)
+{
+    json_object *puts = ctx->pmi_puts;
+
+    wlog_debug (ctx, "pmi: allgather unavailable, using kvs fence");
+    ctx->pmi_allgather = false;
+    ctx->pmi_puts = NULL;
+    if (puts) {
+        json_object_object_foreach (puts, key, val) {
+            if (wreck_pmi_kvs_put (ctx, ctx->pmi_kvsname, key,
+                                   json_object_get_string (val)) < 0)
+                goto error;
+        }
+    }
+    if (wreck_pmi_barrier_enter (ctx) < 0)
+        goto error;
+    Jput (puts);
+    return;
+error:
+    Jput (puts);
+    wreck_barrier_next (ctx);
+    pmi_simple_server_barrier_complete (ctx->pmi, -1);
+}
+
+/*
+ *  The allgather response contains the keys put on all nodes since the
+ *   last barrier.  They are added to the PMI key cache, which, unlike
+ *   with the kvs fence, holds every key put so far in the job.
+ */
+static void wreck_allgather_complete (flux_future_t *f, void *arg)
+{
+    struct prog_ctx *ctx = arg;
+    const char *json_str;
+    json_object *o = NULL;
+    json_object *data;
+    int rc = -1;
+
+    if (flux_rpc_get (f, &json_str) < 0) {
+        if (errno == ENOSYS) {
+            flux_future_destroy (f);
+            wreck_pmi_allgather_fallback (ctx);
+            return;
+        }
+        wlog_err (ctx, "pmi: allgather %s: %s", ctx->barrier_name,
+                  strerror (errno));
+        goto done;
+    }
+    if (!json_str || !(o = Jfromstr (json_str))
+        || !Jget_obj (o, "data", &data)
+        || wreck_pmi_cache_update (ctx, data) < 0) {
+        wlog_err (ctx, "pmi: allgather %s: malformed response",
+                  ctx->barrier_name);
+        goto done;
+    }
+    rc = 0;
+done:
+    Jput (o);
+    Jput (ctx->pmi_puts);
+    ctx->pmi_puts = NULL;
     flux_future_destroy (f);
     wreck_barrier_next (ctx);
+    pmi_simple_server_barrier_complete (ctx->pmi, rc);
+}
+
+static int wreck_pmi_allgather_enter (struct prog_ctx *ctx)
+{
+    flux_future_t *f;
+    json_object *o = Jnew ();
+    int rc = -1;
+
+    Jadd_str (o, "name", ctx->barrier_name);
+    Jadd_int (o, "nprocs", ctx->nnodes);
+    Jadd_int (o, "count", 1);
+    json_object_object_add (o, "data", ctx->pmi_puts ? Jget (ctx->pmi_puts)
+                                                     : Jnew ());
+    /*  Tell allgather which rank each entry comes from, so that brokers
+     *   along the way know how many to wait for from their subtree.
+     */
+    if (ctx->noderanks) {
+        json_object *ranks = Jnew_ar ();
+        int i;
+        for (i = 0; i < ctx->nnodes; i++)
+            Jadd_ar_int (ranks, ctx->noderanks[i]);
+        json_object_object_add (o, "ranks", ranks);
+    }
+    if (!(f = flux_rpc (ctx->flux, "allgather.enter", Jtostr (o),
+                        FLUX_NODEID_ANY, 0))) {
+        wlog_err (ctx, "pmi_barrier_enter: flux_rpc: %s", strerror (errno));
+        goto done;
+    }
+    if (flux_future_then (f, -1., wreck_allgather_complete, ctx) < 0) {
+        wlog_err (ctx, "pmi_barrier_enter: flux_future_then: %s",
+                  strerror (errno));
+        flux_future_destroy (f);
+        goto done;
+    }
+    rc = 0;
+done:
+    Jput (o);
+    return (rc);
 }
 
 static int wreck_pmi_barrier_enter (void *arg)
@@ -2254,6 +2640,14 @@ static int wreck_pmi_barrier_enter (void *arg)
     struct prog_ctx *ctx = arg;
     flux_future_t *f;
 
+    if (ctx->pmi_allgather)
+        return (wreck_pmi_allgather_enter (ctx));
+
+    /*  Puts made since the last barrier become visible with this one,
+     *   so values cached after the last barrier are no longer current.
+     */
+    wreck_pmi_cache_clear (ctx);
+
     if ((f = flux_kvs_fence (ctx->flux, 0, ctx->barrier_name,
                              ctx->nnodes, ctx->barrier_txn)) == NULL) {
         wlog_err (ctx, "pmi_barrier_enter: flux_kvs_fence: %s",
@@ -2287,6 +2681,7 @@ static int prog_ctx_initialize_pmi (struct prog_ctx *ctx)
         .response_send = wreck_pmi_send,
         .debug_trace = wreck_pmi_debug_trace,
     };
+    const char *exchange;
     int flags = 0;
     if (asprintf (&kvsname, "%s.pmi", ctx->kvspath) < 0) {
         flux_log_error (ctx->flux, "initialize_pmi: asprintf");
@@ -2294,6 +2689,14 @@ static int prog_ctx_initialize_pmi (struct prog_ctx *ctx)
     }
     if (prog_ctx_getopt (ctx, "trace-pmi-server"))
         flags |= PMI_SIMPLE_SERVER_TRACE;
+    ctx->pmi_allgather = true;
+    if ((exchange = prog_ctx_getopt (ctx, "pmi-exchange"))) {
+        if (!strcmp (exchange, "kvs"))
+            ctx->pmi_allgather = false;
+        else if (strcmp (exchange, "allgather"))
+            wlog_msg (ctx, "Invalid pmi-exchange=%s, using allgather",
+                      exchange);
+    }
     ctx->barrier_sequence = 0;
     wreck_barrier_next (ctx);
     ctx->pmi = pmi_simple_server_create (ops, (int) ctx->id,
@@ -2304,7 +2707,8 @@ static int prog_ctx_initialize_pmi (struct prog_ctx *ctx)
                                          ctx);
     if (!ctx->pmi)
         flux_log_error (ctx->flux, "pmi_simple_server_create");
-    free (kvsname);
+    free (ctx->pmi_kvsname);
+    ctx->pmi_kvsname = kvsname;
     return (ctx->pmi == NULL ? -1 : 0);
 }
 
@@ -2427,6 +2831,9 @@ int main (int ac, char **av)
     }
 
     if (exec_rc == 0) {
+        if (ctx->pmi)
+            wlog_debug (ctx, "node%d: pmi: %d gets, %d kvs lookups",
+                        ctx->nodeid, ctx->pmi_gets, ctx->pmi_lookups);
         rexec_state_change (ctx, "complete");
         wlog_msg (ctx, "job complete. exiting...");
 
@@ -0,0 +1,212 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* storebench.c - measure content backing store throughput
+ *
+ * Store N distinct blobs of a given size directly to the backing store,
+ * keeping a window of requests outstanding, and report blobs/sec.
+ * Run content-sqlite with different batch-size options to compare
+ * group commit settings (see storebench.sh).
+ *
+ * With --compact, request a compaction of the backing store with the given
+ * root blobref before storing, so that the stores race with it.  Once the
+ * compaction has finished, load each stored blob back and check it.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <getopt.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <flux/core.h>
+
+#include "src/common/libutil/xzmalloc.h"
+#include "src/common/libutil/monotime.h"
+#include "src/common/libutil/log.h"
+
+#define OPTIONS "hc:s:w:C:"
+static const struct option longopts[] = {
+    {"help",            no_argument,        0, 'h'},
+    {"count",           required_argument,  0, 'c'},
+    {"size",            required_argument,  0, 's'},
+    {"window",          required_argument,  0, 'w'},
+    {"compact",         required_argument,  0, 'C'},
+    { 0, 0, 0, 0 },
+};
+
+static int pending;
+static int window = 256;
+static char **blobrefs;
+static bool compacting;
+
+void usage (void)
+{
+    fprintf (stderr,
+"Usage: storebench [--count N] [--size BYTES] [--window N] [--compact REF]\n"
+);
+    exit (1);
+}
+
+static void store_cb (flux_future_t *f, void *arg)
+{
+    flux_reactor_t *r = flux_future_get_reactor (f);
+    int i = (intptr_t)arg;
+    const char *blobref;
+
+    if (flux_content_store_get (f, &blobref) < 0)
+        log_err_exit ("content-backing.store");
+    blobrefs[i] = xstrdup (blobref);
+    flux_future_destroy (f);
+    if (--pending <= window / 2)
+        flux_reactor_stop (r);
+}
+
+static void compact_cb (flux_future_t *f, void *arg)
+{
+    int live, freed;
+
+    if (flux_rpc_get_unpack (f, "{s:i s:i}",
+                             "live", &live,
+                             "freed", &freed) < 0)
+        log_err_exit ("content-backing.compact");
+    printf ("compact: %d live, %d freed\n", live, freed);
+    compacting = false;
+    flux_reactor_stop (flux_future_get_reactor (f));
+    flux_future_destroy (f);
+}
+
+int main (int argc, char *argv[])
+{
+    flux_t *h;
+    int ch;
+    int count = 10000;
+    int size = 256;
+    char *data;
+    struct timespec t0;
+    double elapsed;
+    flux_future_t *f;
+    const char *compact = NULL;
+    int i;
+
+    log_init ("storebench");
+
+    while ((ch = getopt_long (argc, argv, OPTIONS, longopts, NULL)) != -1) {
+        switch (ch) {
+            case 'h': /* --help */
+                usage ();
+                break;
+            case 'c': /* --count N */
+                count = strtoul (optarg, NULL, 10);
+                break;
+            case 's': /* --size BYTES */
+                size = strtoul (optarg, NULL, 10);
+                break;
+            case 'w': /* --window N */
+                window = strtoul (optarg, NULL, 10);
+                break;
+            case 'C': /* --compact REF */
+                compact = optarg;
+                break;
+            default:
+                usage ();
+                break;
+        }
+    }
+    if (optind != argc)
+        usage ();
+    if (size < 32 || count < 1 || window < 1)
+        usage ();
+
+    if (!(h = flux_open (NULL, 0)))
+        log_err_exit ("flux_open");
+    data = xzmalloc (size);
+    blobrefs = xzmalloc (count * sizeof (blobrefs[0]));
+
+    if (compact) {
+        if (!(f = flux_rpc_pack (h, "content-backing.compact", 0, 0,
+                                 "{s:[s]}", "roots", compact))
+                || flux_future_then (f, -1., compact_cb, NULL) < 0)
+            log_err_exit ("content-backing.compact");
+        compacting = true;
+    }
+
+    /* Make blobs unique across runs so that each store inserts a row.
+     */
+    monotime (&t0);
+    i = 0;
+    while (i < count || pending > 0) {
+        while (i < count && pending < window) {
+            snprintf (data, size, "storebench pid=%d t=%ld seq=%d",
+                      getpid (), (long)t0.tv_nsec, i++);
+            if (!(f = flux_content_store (h, data, size,
+                                          CONTENT_FLAG_CACHE_BYPASS))
+                    || flux_future_then (f, -1., store_cb,
+                                         (void *)(intptr_t)(i - 1)) < 0)
+                log_err_exit ("flux_content_store");
+            pending++;
+        }
+        if (flux_reactor_run (flux_get_reactor (h), 0) < 0)
+            log_err_exit ("flux_reactor_run");
+    }
+    elapsed = monotime_since (t0) / 1000;
+
+    printf ("%8d %8d %10.3f %12.0f\n", size, count, elapsed, count / elapsed);
+
+    if (compact) {
+        while (compacting) {
+            if (flux_reactor_run (flux_get_reactor (h), 0) < 0)
+                log_err_exit ("flux_reactor_run");
+        }
+        for (i = 0; i < count; i++) {
+            const void *buf;
+            int len;
+            memset (data, 0, size);
+            snprintf (data, size, "storebench pid=%d t=%ld seq=%d",
+                      getpid (), (long)t0.tv_nsec, i);
+            if (!(f = flux_content_load (h, blobrefs[i],
+                                         CONTENT_FLAG_CACHE_BYPASS))
+                    || flux_content_load_get (f, &buf, &len) < 0)
+                log_err_exit ("load %s (blob %d)", blobrefs[i], i);
+            if (len != size || memcmp (buf, data, size) != 0)
+                log_msg_exit ("blob %d is corrupt", i);
+            flux_future_destroy (f);
+        }
+    }
+
+    for (i = 0; i < count; i++)
+        free (blobrefs[i]);
+    free (blobrefs);
+    free (data);
+    flux_close (h);
+    log_fini ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
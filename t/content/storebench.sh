@@ -0,0 +1,23 @@
+#!/bin/sh
+#
+# Measure content-sqlite store throughput (blobs/sec) versus group commit
+# batch size and blob size.  Run within an instance, e.g.
+#
+#   flux start -o,-Slog-stderr-level=1 t/content/storebench.sh [durable]
+#
+# Any arguments are passed through as extra content-sqlite module options.
+#
+
+STOREBENCH=$(dirname $0)/storebench
+COUNT=${COUNT:-20000}
+WINDOW=${WINDOW:-1024}
+
+printf "%6s %8s %8s %10s %12s\n" batch size count "time(s)" "blobs/s"
+for batch in 1 16 64 256 1024; do
+    flux module remove content-sqlite
+    flux module load content-sqlite batch-size=$batch "$@" || exit 1
+    for size in 64 1024 4096 65536; do
+        printf "%6d " $batch
+        $STOREBENCH --count $COUNT --size $size --window $WINDOW || exit 1
+    done
+done
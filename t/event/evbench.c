@@ -0,0 +1,210 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* evbench.c - measure event throughput versus event batch window
+ *
+ * For each window in a comma-separated list, set the event.batch-window
+ * attribute on rank 0, then publish 'count' events with a 'size' byte
+ * payload, keeping at most 'inflight' published but not yet received.
+ * Report the elapsed time and events/sec for each window.  Events are
+ * checked to arrive in order.  Run on a rank > 0 so that events reach
+ * this program through the rank 0 event socket.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <getopt.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <flux/core.h>
+
+#include "src/common/libutil/xzmalloc.h"
+#include "src/common/libutil/monotime.h"
+#include "src/common/libutil/log.h"
+
+#define OPTIONS "hc:z:i:w:"
+static const struct option longopts[] = {
+    {"help",            no_argument,        0, 'h'},
+    {"count",           required_argument,  0, 'c'},
+    {"size",            required_argument,  0, 'z'},
+    {"inflight",        required_argument,  0, 'i'},
+    {"window",          required_argument,  0, 'w'},
+    { 0, 0, 0, 0 },
+};
+
+void usage (void)
+{
+    fprintf (stderr,
+"Usage: evbench [--count N] [--size BYTES] [--inflight N]\n"
+"               [--window SECS[,SECS...]]\n"
+);
+    exit (1);
+}
+
+static char *get_window (flux_t *h)
+{
+    flux_future_t *f;
+    const char *window;
+    char *cpy;
+
+    if (!(f = flux_rpc_pack (h, "attr.get", 0, 0, "{s:s}",
+                             "name", "event.batch-window"))
+            || flux_rpc_get_unpack (f, "{s:s}", "value", &window) < 0)
+        log_err_exit ("getting event.batch-window on rank 0");
+    cpy = xstrdup (window);
+    flux_future_destroy (f);
+    return cpy;
+}
+
+static void set_window (flux_t *h, const char *window)
+{
+    flux_future_t *f;
+
+    if (!(f = flux_rpc_pack (h, "attr.set", 0, 0, "{s:s s:s}",
+                             "name", "event.batch-window",
+                             "value", window))
+            || flux_future_get (f, NULL) < 0)
+        log_err_exit ("setting event.batch-window=%s on rank 0", window);
+    flux_future_destroy (f);
+}
+
+/* Publish 'count' events and receive them back.  Return elapsed msec.
+ */
+static double bench (flux_t *h, const char *topic, int count,
+                     const char *data, int inflight)
+{
+    struct flux_match match = FLUX_MATCH_EVENT;
+    struct timespec t0;
+    flux_msg_t *msg;
+    const char *s;
+    int sent = 0;
+    int received = 0;
+    int seq;
+
+    match.topic_glob = (char *)topic;
+    monotime (&t0);
+    while (received < count) {
+        while (sent < count && sent - received < inflight) {
+            if (!(msg = flux_event_pack (topic, "{s:i s:s}",
+                                         "seq", sent,
+                                         "data", data))
+                    || flux_send (h, msg, 0) < 0)
+                log_err_exit ("publishing %s", topic);
+            flux_msg_destroy (msg);
+            sent++;
+        }
+        if (!(msg = flux_recv (h, match, 0)))
+            log_err_exit ("flux_recv");
+        if (flux_event_unpack (msg, NULL, "{s:i s:s}",
+                               "seq", &seq,
+                               "data", &s) < 0)
+            log_err_exit ("flux_event_unpack");
+        if (seq != received)
+            log_msg_exit ("%s: received event %d, expected %d",
+                          topic, seq, received);
+        flux_msg_destroy (msg);
+        received++;
+    }
+    return monotime_since (t0);
+}
+
+int main (int argc, char *argv[])
+{
+    flux_t *h;
+    int ch;
+    int count = 10000;
+    int size = 64;
+    int inflight = 256;
+    char *windows = "-1,0,0.001,0.01";
+    char *cpy, *window, *saveptr = NULL;
+    char *orig;
+    char topic[64];
+    char *data;
+    double ms;
+    int i = 0;
+
+    log_init ("evbench");
+
+    while ((ch = getopt_long (argc, argv, OPTIONS, longopts, NULL)) != -1) {
+        switch (ch) {
+            case 'h': /* --help */
+                usage ();
+                break;
+            case 'c': /* --count N */
+                count = strtoul (optarg, NULL, 10);
+                break;
+            case 'z': /* --size BYTES */
+                size = strtoul (optarg, NULL, 10);
+                break;
+            case 'i': /* --inflight N */
+                inflight = strtoul (optarg, NULL, 10);
+                break;
+            case 'w': /* --window SECS[,SECS...] */
+                windows = optarg;
+                break;
+            default:
+                usage ();
+                break;
+        }
+    }
+    if (optind != argc)
+        usage ();
+    if (count < 1 || size < 0 || inflight < 1)
+        usage ();
+
+    if (!(h = flux_open (NULL, 0)))
+        log_err_exit ("flux_open");
+    if (flux_event_subscribe (h, "evbench.") < 0)
+        log_err_exit ("flux_event_subscribe");
+    data = xzmalloc (size + 1);
+    memset (data, 'x', size);
+
+    printf ("%10s %8s %8s %12s %12s\n", "window", "events", "size",
+            "time(ms)", "events/sec");
+    orig = get_window (h);
+    cpy = xstrdup (windows);
+    window = strtok_r (cpy, ",", &saveptr);
+    while (window) {
+        set_window (h, window);
+        snprintf (topic, sizeof (topic), "evbench.%d", i++);
+        ms = bench (h, topic, count, data, inflight);
+        printf ("%10s %8d %8d %12.3f %12.0f\n", window, count, size,
+                ms, count / (ms / 1000));
+        window = strtok_r (NULL, ",", &saveptr);
+    }
+    set_window (h, orig);
+
+    free (orig);
+    free (cpy);
+    free (data);
+    flux_close (h);
+    log_fini ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,178 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* kzbench.c - measure kz stream throughput
+ *
+ * Write 'count' lines of 'size' bytes to each of 'streams' streams,
+ * interleaving puts across streams the way wrexecd writes task output,
+ * then read each stream back.  Report the write and read times and the
+ * overall puts/sec.  Run with and without the kzstream module loaded to
+ * compare the stream service with per-block KVS keys.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <getopt.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <flux/core.h>
+
+#include "src/common/libutil/xzmalloc.h"
+#include "src/common/libutil/monotime.h"
+#include "src/common/libutil/log.h"
+#include "src/common/libkz/kz.h"
+
+#define OPTIONS "hs:c:z:dp:"
+static const struct option longopts[] = {
+    {"help",            no_argument,        0, 'h'},
+    {"streams",         required_argument,  0, 's'},
+    {"count",           required_argument,  0, 'c'},
+    {"size",            required_argument,  0, 'z'},
+    {"delay-commit",    no_argument,        0, 'd'},
+    {"prefix",          required_argument,  0, 'p'},
+    { 0, 0, 0, 0 },
+};
+
+void usage (void)
+{
+    fprintf (stderr,
+"Usage: kzbench [--streams N] [--count N] [--size BYTES] [--delay-commit]\n"
+"               [--prefix NAME]\n"
+);
+    exit (1);
+}
+
+int main (int argc, char *argv[])
+{
+    flux_t *h;
+    int ch;
+    int streams = 64;
+    int count = 1000;
+    int size = 80;
+    int flags = KZ_FLAGS_WRITE;
+    char *prefix = NULL;
+    char *line;
+    char name[256];
+    kz_t **kz;
+    struct timespec t0;
+    double write_ms, read_ms;
+    char *data;
+    int i, j, len, total;
+
+    log_init ("kzbench");
+
+    while ((ch = getopt_long (argc, argv, OPTIONS, longopts, NULL)) != -1) {
+        switch (ch) {
+            case 'h': /* --help */
+                usage ();
+                break;
+            case 's': /* --streams N */
+                streams = strtoul (optarg, NULL, 10);
+                break;
+            case 'c': /* --count N */
+                count = strtoul (optarg, NULL, 10);
+                break;
+            case 'z': /* --size BYTES */
+                size = strtoul (optarg, NULL, 10);
+                break;
+            case 'd': /* --delay-commit */
+                flags |= KZ_FLAGS_DELAYCOMMIT;
+                break;
+            case 'p': /* --prefix NAME */
+                prefix = optarg;
+                break;
+            default:
+                usage ();
+                break;
+        }
+    }
+    if (optind != argc)
+        usage ();
+    if (streams < 1 || count < 1 || size < 2)
+        usage ();
+
+    if (!(h = flux_open (NULL, 0)))
+        log_err_exit ("flux_open");
+    kz = xzmalloc (streams * sizeof (kz[0]));
+    line = xzmalloc (size);
+    memset (line, 'x', size - 1);
+    line[size - 1] = '\n';
+
+    monotime (&t0);
+    for (i = 0; i < streams; i++) {
+        snprintf (name, sizeof (name), "%s.%d",
+                  prefix ? prefix : "kzbench", i);
+        if (!(kz[i] = kz_open (h, name, flags | KZ_FLAGS_TRUNC)))
+            log_err_exit ("kz_open %s", name);
+    }
+    for (j = 0; j < count; j++) {
+        for (i = 0; i < streams; i++) {
+            if (kz_put (kz[i], line, size) < 0)
+                log_err_exit ("kz_put");
+        }
+    }
+    for (i = 0; i < streams; i++) {
+        if (kz_close (kz[i]) < 0)
+            log_err_exit ("kz_close");
+    }
+    write_ms = monotime_since (t0);
+
+    monotime (&t0);
+    for (i = 0; i < streams; i++) {
+        snprintf (name, sizeof (name), "%s.%d",
+                  prefix ? prefix : "kzbench", i);
+        if (!(kz[i] = kz_open (h, name, KZ_FLAGS_READ)))
+            log_err_exit ("kz_open %s", name);
+        total = 0;
+        while ((len = kz_get (kz[i], &data)) > 0) {
+            total += len;
+            free (data);
+        }
+        if (len < 0)
+            log_err_exit ("kz_get");
+        if (total != count * size)
+            log_msg_exit ("%s: read %d of %d bytes", name, total,
+                          count * size);
+        if (kz_close (kz[i]) < 0)
+            log_err_exit ("kz_close");
+    }
+    read_ms = monotime_since (t0);
+
+    printf ("%8s %8s %8s %12s %12s %12s\n", "streams", "puts", "size",
+            "write(ms)", "read(ms)", "puts/sec");
+    printf ("%8d %8d %8d %12.3f %12.3f %12.0f\n", streams, count, size,
+            write_ms, read_ms, (streams * count) / (write_ms / 1000));
+
+    free (line);
+    free (kz);
+    flux_close (h);
+    log_fini ();
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -3,6 +3,7 @@
 #include <flux/core.h>
 
 #include "src/common/libutil/xzmalloc.h"
+#include "src/common/libutil/monotime.h"
 #include "src/common/libtap/tap.h"
 
 int cb_called;
@@ -243,6 +244,165 @@ void test_cloned_dispatch (flux_t *orig)
     diag ("destroyed reactor, closed clone");
 }
 
+/* Send one message with 'topic' and run the reactor once to dispatch it.
+ */
+static void dispatch_one (flux_t *h, int type, const char *topic)
+{
+    flux_msg_t *msg;
+
+    if (type == FLUX_MSGTYPE_EVENT)
+        msg = flux_event_encode (topic, NULL);
+    else
+        msg = flux_request_encode (topic, NULL);
+    if (!msg || flux_send (h, msg, 0) < 0)
+        BAIL_OUT ("could not send %s", topic);
+    flux_msg_destroy (msg);
+    cb_called = 0;
+    cb_mh = NULL;
+    if (flux_reactor_run (flux_get_reactor (h), FLUX_REACTOR_NOWAIT) < 0)
+        BAIL_OUT ("flux_reactor_run failed");
+}
+
+static flux_msg_handler_t *handler_start (flux_t *h, int type,
+                                          const char *topic)
+{
+    struct flux_match m = FLUX_MATCH_ANY;
+    flux_msg_handler_t *mh;
+
+    m.typemask = type;
+    m.topic_glob = (char *)topic;
+    if (!(mh = flux_msg_handler_create (h, m, cb, NULL)))
+        BAIL_OUT ("flux_msg_handler_create %s failed", topic);
+    flux_msg_handler_start (mh);
+    return mh;
+}
+
+/* Exact topic and glob handlers are matched newest first.
+ */
+void test_first_match (flux_t *h)
+{
+    flux_msg_handler_t *exact, *glob, *exact2;
+
+    exact = handler_start (h, FLUX_MSGTYPE_REQUEST, "first.a");
+    glob = handler_start (h, FLUX_MSGTYPE_REQUEST, "first.*");
+
+    dispatch_one (h, FLUX_MSGTYPE_REQUEST, "first.a");
+    ok (cb_called == 1 && cb_mh == glob,
+        "newer glob handler matched request before older exact handler");
+    dispatch_one (h, FLUX_MSGTYPE_REQUEST, "first.b");
+    ok (cb_called == 1 && cb_mh == glob,
+        "glob handler matched request with other topic");
+
+    flux_msg_handler_stop (glob);
+    dispatch_one (h, FLUX_MSGTYPE_REQUEST, "first.a");
+    ok (cb_called == 1 && cb_mh == exact,
+        "exact handler matched request when glob handler was stopped");
+    flux_msg_handler_start (glob);
+
+    exact2 = handler_start (h, FLUX_MSGTYPE_REQUEST, "first.a");
+    dispatch_one (h, FLUX_MSGTYPE_REQUEST, "first.a");
+    ok (cb_called == 1 && cb_mh == exact2,
+        "newer exact handler matched request before older glob handler");
+    flux_msg_handler_destroy (exact2);
+    dispatch_one (h, FLUX_MSGTYPE_REQUEST, "first.a");
+    ok (cb_called == 1 && cb_mh == glob,
+        "glob handler matched request after exact handler was destroyed");
+
+    flux_msg_handler_destroy (glob);
+    flux_msg_handler_destroy (exact);
+
+    exact = handler_start (h, FLUX_MSGTYPE_EVENT, "first.ev");
+    glob = handler_start (h, FLUX_MSGTYPE_EVENT, "first.*");
+    dispatch_one (h, FLUX_MSGTYPE_EVENT, "first.ev");
+    ok (cb_called == 2,
+        "event was delivered to both exact and glob handlers");
+    flux_msg_handler_destroy (glob);
+    flux_msg_handler_destroy (exact);
+}
+
+/* Any fnmatch(3) pattern is a glob, not just those with '*' or '?'.
+ */
+void test_bracket_glob (flux_t *h)
+{
+    flux_msg_handler_t *glob, *escaped;
+
+    glob = handler_start (h, FLUX_MSGTYPE_REQUEST, "bracket.[ab]");
+    dispatch_one (h, FLUX_MSGTYPE_REQUEST, "bracket.a");
+    ok (cb_called == 1 && cb_mh == glob,
+        "bracket expression handler matched first alternative");
+    dispatch_one (h, FLUX_MSGTYPE_REQUEST, "bracket.b");
+    ok (cb_called == 1 && cb_mh == glob,
+        "bracket expression handler matched second alternative");
+    dispatch_one (h, FLUX_MSGTYPE_REQUEST, "bracket.c");
+    ok (cb_called == 0,
+        "bracket expression handler did not match other topic");
+    flux_msg_handler_destroy (glob);
+
+    escaped = handler_start (h, FLUX_MSGTYPE_REQUEST, "bracket.\\x");
+    dispatch_one (h, FLUX_MSGTYPE_REQUEST, "bracket.x");
+    ok (cb_called == 1 && cb_mh == escaped,
+        "handler with escaped character matched unescaped topic");
+    flux_msg_handler_destroy (escaped);
+}
+
+static int bench_count;
+static int bench_total;
+
+static void bench_cb (flux_t *h, flux_msg_handler_t *mh,
+                      const flux_msg_t *msg, void *arg)
+{
+    if (++bench_count == bench_total)
+        flux_reactor_stop (flux_get_reactor (h));
+}
+
+/* Measure request dispatch rate vs number of registered handlers.
+ * Requests are sent to the oldest handler, which was the last one
+ * checked when handlers were matched by scanning the list.
+ */
+void test_dispatch_rate (flux_t *h)
+{
+    int counts[] = { 1, 16, 64, 256 };
+    const int total = 10000;
+    flux_msg_handler_t **handlers;
+    struct flux_match m = FLUX_MATCH_REQUEST;
+    struct timespec t0;
+    flux_msg_t *msg;
+    char topic[64];
+    double ms;
+    int i, j;
+
+    for (i = 0; i < sizeof (counts) / sizeof (counts[0]); i++) {
+        if (!(handlers = calloc (counts[i], sizeof (handlers[0]))))
+            BAIL_OUT ("out of memory");
+        for (j = 0; j < counts[i]; j++) {
+            snprintf (topic, sizeof (topic), "bench.%d", j);
+            m.topic_glob = topic;
+            if (!(handlers[j] = flux_msg_handler_create (h, m, bench_cb,
+                                                         NULL)))
+                BAIL_OUT ("flux_msg_handler_create failed");
+            flux_msg_handler_start (handlers[j]);
+        }
+        bench_count = 0;
+        bench_total = total;
+        monotime (&t0);
+        for (j = 0; j < total; j++) {
+            if (!(msg = flux_request_encode ("bench.0", NULL))
+                    || flux_send (h, msg, 0) < 0)
+                BAIL_OUT ("could not send request");
+            flux_msg_destroy (msg);
+        }
+        if (flux_reactor_run (flux_get_reactor (h), 0) < 0)
+            BAIL_OUT ("flux_reactor_run failed");
+        ms = monotime_since (t0);
+        ok (bench_count == total,
+            "dispatched %d requests with %d handlers", total, counts[i]);
+        diag ("%4d handlers: %.0f msgs/sec", counts[i], total / (ms / 1000));
+        for (j = 0; j < counts[i]; j++)
+            flux_msg_handler_destroy (handlers[j]);
+        free (handlers);
+    }
+}
+
 int main (int argc, char *argv[])
 {
     flux_t *h;
@@ -262,6 +422,9 @@ int main (int argc, char *argv[])
     test_simple_msg_handler (h);
     test_fastpath (h);
     test_cloned_dispatch (h);
+    test_first_match (h);
+    test_bracket_glob (h);
+    test_dispatch_rate (h);
 
     flux_close (h);
     done_testing();
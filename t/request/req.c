@@ -193,6 +193,17 @@ void err_request_cb (flux_t *h, flux_msg_handler_t *mh,
         flux_log_error (h, "%s: flux_respond", __FUNCTION__);
 }
 
+/* Always respond with a raw (non-JSON) payload
+ */
+void raw_request_cb (flux_t *h, flux_msg_handler_t *mh,
+                     const flux_msg_t *msg, void *arg)
+{
+    const char data[] = "raw";
+
+    if (flux_respond_raw (h, msg, 0, data, sizeof (data)) < 0)
+        flux_log_error (h, "%s: flux_respond_raw", __FUNCTION__);
+}
+
 /* Echo a json payload back to requestor.
  */
 void echo_request_cb (flux_t *h, flux_msg_handler_t *mh,
@@ -386,6 +397,7 @@ const struct flux_msg_handler_spec htab[] = {
     { FLUX_MSGTYPE_REQUEST, "req.null",              null_request_cb, 0 },
     { FLUX_MSGTYPE_REQUEST, "req.echo",              echo_request_cb, 0 },
     { FLUX_MSGTYPE_REQUEST, "req.err",               err_request_cb, 0 },
+    { FLUX_MSGTYPE_REQUEST, "req.raw",               raw_request_cb, 0 },
     { FLUX_MSGTYPE_REQUEST, "req.src",               src_request_cb, 0 },
     { FLUX_MSGTYPE_REQUEST, "req.nsrc",              nsrc_request_cb, 0 },
     { FLUX_MSGTYPE_REQUEST, "req.sink",              sink_request_cb, 0 },
@@ -0,0 +1,178 @@
+/*****************************************************************************\
+ *  Copyright (c) 2018 Lawrence Livermore National Security, LLC.  Produced at
+ *  the Lawrence Livermore National Laboratory (cf, AUTHORS, DISCLAIMER.LLNS).
+ *  LLNL-CODE-658032 All rights reserved.
+ *
+ *  This file is part of the Flux resource manager framework.
+ *  For details, see https://github.com/flux-framework.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  Flux is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* tmrpc.c - send a request to several ranks with FLUX_RPC_TREE
+ *
+ * Print one line per target rank, "rank: payload" or "rank: error".
+ * With --subtree RANK, send the cmb.mrpc request that the broker on RANK
+ * would get from its parent, and print the responses of its subtree,
+ * which come back together in one message.
+ * Exit with status 1 if any rank failed.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <getopt.h>
+#include <inttypes.h>
+#include <jansson.h>
+#include <flux/core.h>
+
+#include "src/common/libutil/log.h"
+
+#define OPTIONS "hs:"
+static const struct option longopts[] = {
+    {"help",       no_argument,        0, 'h'},
+    {"subtree",    required_argument,  0, 's'},
+    { 0, 0, 0, 0 },
+};
+
+void usage (void)
+{
+    fprintf (stderr,
+"Usage: tmrpc [--subtree RANK] NODESET TOPIC [JSON]\n"
+);
+    exit (1);
+}
+
+/* Print one rank's response, returning -1 if it is an error.
+ */
+int print_response (uint32_t rank, int errnum, const char *json_str)
+{
+    if (errnum) {
+        printf ("%" PRIu32 ": %s\n", rank, flux_strerror (errnum));
+        return -1;
+    }
+    printf ("%" PRIu32 ": %s\n", rank, json_str ? json_str : "ok");
+    return 0;
+}
+
+int send_mrpc (flux_t *h, const char *nodeset, const char *topic,
+               const char *json_str)
+{
+    flux_mrpc_t *mrpc;
+    const char *s;
+    uint32_t rank;
+    int errnum;
+    int rc = 0;
+
+    if (!(mrpc = flux_mrpc (h, topic, json_str, nodeset, FLUX_RPC_TREE)))
+        log_err_exit ("flux_mrpc");
+    do {
+        if (flux_mrpc_get_nodeid (mrpc, &rank) < 0)
+            log_err_exit ("flux_mrpc_get_nodeid");
+        errnum = 0;
+        if (flux_mrpc_get (mrpc, &s) < 0) {
+            errnum = errno;
+            s = NULL;
+        }
+        if (print_response (rank, errnum, s) < 0)
+            rc = -1;
+    } while (flux_mrpc_next (mrpc) == 0);
+    flux_mrpc_destroy (mrpc);
+    return rc;
+}
+
+int send_subtree (flux_t *h, uint32_t nodeid, const char *nodeset,
+                  const char *topic, const char *json_str)
+{
+    flux_future_t *f;
+    json_t *o;
+    json_t *responses;
+    json_t *entry;
+    size_t index;
+    int rank, errnum;
+    const char *s;
+    int rc = 0;
+
+    if (!(o = json_pack ("{s:s s:s}", "topic", topic, "nodeset", nodeset)))
+        log_msg_exit ("json_pack failed");
+    if (json_str && json_object_set_new (o, "payload",
+                                         json_string (json_str)) < 0)
+        log_msg_exit ("json_object_set_new failed");
+    if (!(f = flux_rpc_pack (h, "cmb.mrpc", nodeid, 0, "O", o)))
+        log_err_exit ("flux_rpc_pack");
+    if (flux_rpc_get_unpack (f, "{s:o}", "responses", &responses) < 0)
+        log_err_exit ("cmb.mrpc");
+    if (!json_is_array (responses))
+        log_msg_exit ("cmb.mrpc: responses is not an array");
+    printf ("responses: %zu\n", json_array_size (responses));
+    json_array_foreach (responses, index, entry) {
+        s = NULL;
+        if (json_unpack (entry, "{s:i s:i s?s}", "rank", &rank,
+                                                 "errnum", &errnum,
+                                                 "payload", &s) < 0)
+            log_msg_exit ("cmb.mrpc: malformed response entry");
+        if (print_response (rank, errnum, s) < 0)
+            rc = -1;
+    }
+    flux_future_destroy (f);
+    json_decref (o);
+    return rc;
+}
+
+int main (int argc, char *argv[])
+{
+    flux_t *h;
+    int ch;
+    uint32_t nodeid = FLUX_NODEID_ANY;
+    const char *nodeset, *topic;
+    const char *json_str = NULL;
+    int rc;
+
+    log_init ("tmrpc");
+
+    while ((ch = getopt_long (argc, argv, OPTIONS, longopts, NULL)) != -1) {
+        switch (ch) {
+            case 'h': /* --help */
+                usage ();
+                break;
+            case 's': /* --subtree RANK */
+                nodeid = strtoul (optarg, NULL, 10);
+                break;
+            default:
+                usage ();
+                break;
+        }
+    }
+    if (argc - optind != 2 && argc - optind != 3)
+        usage ();
+    nodeset = argv[optind++];
+    topic = argv[optind++];
+    if (optind < argc)
+        json_str = argv[optind++];
+
+    if (!(h = flux_open (NULL, 0)))
+        log_err_exit ("flux_open");
+    if (nodeid == FLUX_NODEID_ANY)
+        rc = send_mrpc (h, nodeset, topic, json_str);
+    else
+        rc = send_subtree (h, nodeid, nodeset, topic, json_str);
+    flux_close (h);
+    return (rc < 0 ? 1 : 0);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -93,6 +93,11 @@ test_expect_success 'module: unload test module (all ranks)' '
 	flux module remove -r all parent
 '
 
+test_expect_success 'module: remove reports the error of each rank (all ranks)' '
+	flux module remove -r all nosuchmodule 2>rmmod.err &&
+	test $(grep -c "cmb.rmmod\[" rmmod.err) -eq ${SIZE}
+'
+
 test_expect_success 'module: insmod returns initialization error' '
 	test_must_fail flux module load \
 		${FLUX_BUILD_DIR}/t/module/.libs/parent.so --init-failure
@@ -251,6 +256,38 @@ test_expect_success 'flux module stats --rusage --parse maxrss works' '
 	test "$RSS" -gt 0
 '
 
+test_expect_success 'flux module stats cmb reports messages per wakeup' '
+	flux module stats cmb >cmb.stats &&
+	grep -q recv-budget cmb.stats &&
+	BUDGET=$(flux module stats --parse recv-budget cmb) &&
+	test "$BUDGET" = $(flux getattr broker.recv-budget) &&
+	MSGS=$(flux module stats --parse modules.connector-local.msgs cmb) &&
+	test "$MSGS" -gt 0 &&
+	flux module stats --parse overlay.child.wakeups cmb
+'
+
+test_expect_success 'broker.recv-budget rejects bad values' '
+	test_must_fail flux setattr broker.recv-budget 0 &&
+	test_must_fail flux setattr broker.recv-budget foo
+'
+
+test_expect_success 'broker.recv-budget may be changed at runtime' '
+	flux setattr broker.recv-budget 1 &&
+	test $(flux getattr broker.recv-budget) = 1 &&
+	test $(flux module stats --parse recv-budget cmb) = 1 &&
+	HITS=$(flux module stats \
+		--parse modules.connector-local.budget-hits cmb) &&
+	test "$HITS" -gt 0 &&
+	flux setattr broker.recv-budget 64
+'
+
+test_expect_success 'flux module stats --clear cmb works' '
+	flux module stats --clear cmb &&
+	HITS=$(flux module stats \
+		--parse modules.connector-local.budget-hits cmb) &&
+	test "$HITS" = 0
+'
+
 # try to hit some error cases
 
 test_expect_success 'flux module with no arguments prints usage and fails' '
@@ -7,6 +7,7 @@ test_description='Test event propagation'
 SIZE=4
 LASTRANK=$(($SIZE-1))
 test_under_flux ${SIZE} minimal
+evbench=${FLUX_BUILD_DIR}/t/event/evbench
 
 test_expect_success 'heartbeat is received on all ranks' '
 	run_timeout 5 \
@@ -33,4 +34,29 @@ test_expect_success "events from rank $LASTRANK received correctly on rank 0" '
         test_cmp trace.expected trace
 '
 
+test_expect_success 'event.batch-window defaults to 0' '
+	test "$(flux getattr event.batch-window)" = "0"
+'
+
+test_expect_success 'event.batch-window rejects a non-numeric value' '
+	test_must_fail flux setattr event.batch-window foo &&
+	test "$(flux getattr event.batch-window)" = "0"
+'
+
+test_expect_success 'heartbeat is received on all ranks with batch window' '
+	flux setattr event.batch-window 0.01 &&
+	test_when_finished "flux setattr event.batch-window 0" &&
+	run_timeout 5 \
+          flux exec flux event sub --count=1 hb >output_event_sub2 &&
+	test $(grep "^hb" output_event_sub2 | wc -l) -eq $SIZE
+'
+
+test_expect_success "evbench receives events in order on rank $LASTRANK" '
+	run_timeout 60 flux exec -r $LASTRANK \
+		${evbench} --count 2000 --window -1,0,0.001,0.01 >evbench.out &&
+	cat evbench.out &&
+	test $(grep -c "^ *[-0-9.]* *2000 " evbench.out) -eq 4 &&
+	test "$(flux getattr event.batch-window)" = "0"
+'
+
 test_done
@@ -158,4 +158,27 @@ test_expect_success 'store 1K blobs from all ranks using async RPC' '
 	flux exec flux content spam 1024 256
 '
 
+# Write 1024 blobs per rank, 64 per content.store-batch request
+test_expect_success 'store 1K blobs from all ranks using store-batch RPC' '
+	flux exec flux content spam --batch=64 1024 4
+'
+
+test_expect_success 'load-batch and verify test blobs on all ranks' '
+	cat 0.0.store 64.0.store 4k.0.store 1m.0.store >batch.expect &&
+	flux exec sh -c "flux content load-batch \
+		$(cat 0.0.hash) $(cat 64.0.hash) $(cat 4k.0.hash) \
+		$(cat 1m.0.hash) | cmp - batch.expect"
+'
+
+test_expect_success 'load-batch fails on unknown blobref but returns others' '
+	MISSING=`echo never-stored | $BLOBREF $HASHFUN` &&
+	test_must_fail flux content load-batch $(cat 64.0.hash) $MISSING \
+		>batch.partial &&
+	test_cmp 64.0.store batch.partial
+'
+
+test_expect_success 'load-batch fails on malformed blobref' '
+	test_must_fail flux content load-batch not-a-blobref
+'
+
 test_done
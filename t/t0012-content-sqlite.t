@@ -14,6 +14,7 @@ test_under_flux ${SIZE} minimal
 echo "# $0: flux session size will be ${SIZE}"
 
 BLOBREF=${FLUX_BUILD_DIR}/t/kvs/blobref
+STOREBENCH=${FLUX_BUILD_DIR}/t/content/storebench
 
 MAXBLOB=`flux getattr content.blob-size-limit`
 HASHFUN=`flux getattr content.hash`
@@ -203,6 +204,56 @@ test_expect_success 'exercise batching of asynchronous flush to backing store' '
 	test $OLD_COUNT -le $NEW_COUNT
 '
 
+test_expect_success 'reload content-sqlite module with group commit' '
+	flux module remove --rank 0 content-sqlite &&
+	flux module load --rank 0 content-sqlite \
+		batch-size=64 batch-timeout=0.01 durable
+'
+
+test_expect_success 'store blobs bypassing cache with group commit' '
+	$STOREBENCH --count 1000 --size 64 --window 100 &&
+	$STOREBENCH --count 10 --size 4096 --window 1 &&
+	dd if=/dev/urandom count=1 bs=4096 >4k.1.store 2>/dev/null &&
+	flux content store --bypass-cache <4k.1.store >4k.1.hash
+'
+
+test_expect_success 'load blob stored with group commit bypassing cache' '
+	HASHSTR=`cat 4k.1.hash` &&
+	flux content load --bypass-cache ${HASHSTR} >4k.1.load &&
+	test_cmp 4k.1.store 4k.1.load
+'
+
+test_expect_success 'flush rank 0 cache with group commit' '
+	store_junk groupcommit 100 &&
+	run_timeout 10 flux content flush &&
+	NDIRTY=`flux module stats --type int --parse dirty content` &&
+	test $NDIRTY -eq 0
+'
+
+test_expect_success 'content-sqlite module refuses unknown codec' '
+	flux module remove --rank 0 content-sqlite &&
+	test_must_fail flux module load --rank 0 content-sqlite codec=bogus
+'
+
+test_expect_success 'load content-sqlite module with codec=none' '
+	flux module load --rank 0 content-sqlite codec=none
+'
+
+test_expect_success 'store and load compressible blob with codec=none' '
+	dd if=/dev/zero count=16 bs=4096 >zero.none.store 2>/dev/null &&
+	flux content store --bypass-cache <zero.none.store >zero.none.hash &&
+	flux content load --bypass-cache `cat zero.none.hash` >zero.none.load &&
+	test_cmp zero.none.store zero.none.load
+'
+
+test_expect_success 'reload content-sqlite module with default codec' '
+	flux module remove --rank 0 content-sqlite &&
+	flux module load --rank 0 content-sqlite &&
+	flux content flush &&
+	flux content load --bypass-cache `cat zero.none.hash` >zero.none.load2 &&
+	test_cmp zero.none.store zero.none.load2
+'
+
 test_expect_success 'remove content-sqlite module on rank 0' '
 	flux module remove --rank 0 content-sqlite
 '
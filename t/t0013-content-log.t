@@ -0,0 +1,122 @@
+#!/bin/sh
+
+test_description='Test content-log service'
+
+. `dirname $0`/sharness.sh
+
+# Size the session to one more than the number of cores, minimum of 4
+SIZE=$(test_size_large)
+test_under_flux ${SIZE} minimal
+echo "# $0: flux session size will be ${SIZE}"
+
+BLOBREF=${FLUX_BUILD_DIR}/t/kvs/blobref
+STOREBENCH=${FLUX_BUILD_DIR}/t/content/storebench
+
+HASHFUN=`flux getattr content.hash`
+
+store_junk() {
+    local name=$1
+    local n=$2
+    for i in `seq 1 $n`; do \
+        echo "$name:$i" | flux content store >/dev/null || return 1
+    done
+}
+
+test_expect_success 'load content-log module on rank 0' '
+	flux module load --rank 0 content-log segment-size=65536
+'
+
+test_expect_success 'store 100 blobs on rank 0' '
+	store_junk test 100 &&
+	flux content flush &&
+	NDIRTY=`flux module stats --type int --parse dirty content` &&
+	test $NDIRTY -eq 0
+'
+
+test_expect_success 'store blobs bypassing cache' '
+	cat /dev/null >0.0.store &&
+	flux content store --bypass-cache <0.0.store >0.0.hash &&
+	dd if=/dev/urandom count=1 bs=64 >64.0.store 2>/dev/null &&
+	flux content store --bypass-cache <64.0.store >64.0.hash &&
+	dd if=/dev/urandom count=1 bs=4096 >4k.0.store 2>/dev/null &&
+	flux content store --bypass-cache <4k.0.store >4k.0.hash &&
+	dd if=/dev/urandom count=256 bs=4096 >1m.0.store 2>/dev/null &&
+	flux content store --bypass-cache <1m.0.store >1m.0.hash
+'
+
+test_expect_success 'load blobs bypassing cache' '
+	flux content load --bypass-cache `cat 0.0.hash` >0.0.load &&
+	test_cmp 0.0.store 0.0.load &&
+	flux content load --bypass-cache `cat 64.0.hash` >64.0.load &&
+	test_cmp 64.0.store 64.0.load &&
+	flux content load --bypass-cache `cat 4k.0.hash` >4k.0.load &&
+	test_cmp 4k.0.store 4k.0.load &&
+	flux content load --bypass-cache `cat 1m.0.hash` >1m.0.load &&
+	test_cmp 1m.0.store 1m.0.load
+'
+
+test_expect_success 'load-batch blobs bypassing cache' '
+	cat 64.0.store 4k.0.store >batch.expect &&
+	flux content load-batch --bypass-cache \
+		`cat 64.0.hash` `cat 4k.0.hash` >batch.load &&
+	test_cmp batch.expect batch.load
+'
+
+test_expect_success 'store blobs with store-batch across segments' '
+	$STOREBENCH --count 1000 --size 1024 --window 16
+'
+
+test_expect_success 'load unknown blob bypassing cache fails' '
+	MISSING=`echo never-stored | $BLOBREF $HASHFUN` &&
+	test_must_fail flux content load --bypass-cache $MISSING
+'
+
+test_expect_success 'compact with a KVS directory root' '
+	echo live-value >val.store &&
+	flux content store <val.store >val.hash &&
+	VALREF=`cat val.hash` &&
+	printf "{\"data\":{\"v\":{\"data\":[\"%s\"],\"type\":\"valref\",\"ver\":1}},\"type\":\"dir\",\"ver\":1}" \
+		$VALREF >dir.store &&
+	DIRREF=`flux content store <dir.store` &&
+	echo dead-value | flux content store >dead.hash &&
+	flux content compact $DIRREF >compact.out &&
+	cat compact.out &&
+	grep "^2 live" compact.out &&
+	flux content load --bypass-cache $VALREF >val.load &&
+	test_cmp val.store val.load &&
+	flux content load --bypass-cache $DIRREF >dir.load &&
+	test_cmp dir.store dir.load &&
+	test_must_fail flux content load --bypass-cache `cat dead.hash`
+'
+
+test_expect_success 'compact fails on malformed root' '
+	test_must_fail flux content compact not-a-blobref
+'
+
+test_expect_success 'reload content-log module' '
+	flux module remove --rank 0 content-log &&
+	flux module load --rank 0 content-log &&
+	flux content flush &&
+	flux content load --bypass-cache `cat val.hash` >val.load2 &&
+	test_cmp val.store val.load2
+'
+
+test_expect_success 'blobs stored during a compaction are kept' '
+	flux module remove --rank 0 content-log &&
+	flux module load --rank 0 content-log segment-size=65536 \
+		compact-step=1 &&
+	$STOREBENCH --count 1000 --size 1024 --window 16 &&
+	DIRREF=`flux content store --bypass-cache <dir.store` &&
+	$STOREBENCH --count 1000 --size 1024 --window 16 \
+		--compact $DIRREF >compact.store.out &&
+	cat compact.store.out &&
+	grep "^compact: 2 live" compact.store.out &&
+	flux content load --bypass-cache `cat val.hash` >val.load3 &&
+	test_cmp val.store val.load3
+'
+
+test_expect_success 'remove content-log module on rank 0' '
+	flux module remove --rank 0 content-log
+'
+
+test_done
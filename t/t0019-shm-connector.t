@@ -0,0 +1,46 @@
+#!/bin/sh
+#
+
+test_description='Test shm:// connector'
+
+. `dirname $0`/sharness.sh
+SIZE=2
+test_under_flux ${SIZE}
+
+export TEST_SOCKDIR=$(echo $FLUX_URI | sed -e "s!local://!!")
+export SHM_URI=shm://${TEST_SOCKDIR}
+
+test_expect_success 'shm:// connector forwards getattr request' '
+	ATTR_SIZE=$(FLUX_URI=$SHM_URI flux getattr size) &&
+	test "$ATTR_SIZE" = "$SIZE"
+'
+
+test_expect_success 'shm:// connector fails on nonexistent socket' '
+	! FLUX_URI=shm://${TEST_SOCKDIR}/noexist \
+	  FLUX_LOCAL_CONNECTOR_RETRY_COUNT=0 flux getattr size
+'
+
+test_expect_success 'shm:// connector works with kvs put/get' '
+	FLUX_URI=$SHM_URI flux kvs put test.shm=hello &&
+	test "$(FLUX_URI=$SHM_URI flux kvs get test.shm)" = "hello"
+'
+
+test_expect_success 'shm:// connector moves messages larger than the ring' '
+	run_timeout 5 env FLUX_URI=$SHM_URI \
+	  flux ping --pad 4194304 --count 4 --interval 0 0
+'
+
+test_expect_success 'shm:// connector handles a stream of messages' '
+	run_timeout 10 env FLUX_URI=$SHM_URI \
+	  flux ping --pad 1024 --count 10240 --interval 0 0 &&
+	run_timeout 10 env FLUX_URI=$SHM_URI \
+	  flux ping --pad 1024 --count 1024 --batch --interval 0 1
+'
+
+test_expect_success 'shm:// connector delivers events' '
+	run_timeout 5 env FLUX_URI=$SHM_URI \
+	  flux event sub --count=1 hb >output_event_sub &&
+	test $(grep "^hb" output_event_sub | wc -l) -eq 1
+'
+
+test_done
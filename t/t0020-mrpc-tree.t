@@ -0,0 +1,93 @@
+#!/bin/sh
+#
+
+test_description='Test multi-rank RPCs sent with FLUX_RPC_TREE
+
+Verify that a tree mrpc reaches the target ranks, that each broker
+gathers the responses of its subtree, and that per-rank errors
+are handed back per rank.
+'
+
+. `dirname $0`/sharness.sh
+SIZE=4
+test_under_flux ${SIZE} minimal
+
+# With the default TBON fanout of 2, rank 0 has children 1 and 2,
+# and rank 1 has child 3.
+
+TMRPC=${FLUX_BUILD_DIR}/t/request/tmrpc
+
+test_expect_success 'load req module on all ranks' '
+	flux module load --rank=all \
+		${FLUX_BUILD_DIR}/t/request/.libs/req.so
+'
+
+test_expect_success 'tree mrpc to all ranks gets a response from each' '
+	cat >all.exp <<-EOT &&
+	0: {"x":42}
+	1: {"x":42}
+	2: {"x":42}
+	3: {"x":42}
+	EOT
+	${TMRPC} all req.echo "{\"x\":42}" >all.raw &&
+	sort -n all.raw >all.out &&
+	test_cmp all.exp all.out
+'
+
+test_expect_success 'tree mrpc to a subset gets a response from each target' '
+	cat >subset.exp <<-EOT &&
+	1: {"x":42}
+	3: {"x":42}
+	EOT
+	${TMRPC} "[1,3]" req.echo "{\"x\":42}" >subset.raw &&
+	sort -n subset.raw >subset.out &&
+	test_cmp subset.exp subset.out
+'
+
+test_expect_success 'rank 1 returns its whole subtree in one response' '
+	cat >subtree.exp <<-EOT &&
+	responses: 2
+	1: {"x":42}
+	3: {"x":42}
+	EOT
+	${TMRPC} --subtree 1 "[1,3]" req.echo "{\"x\":42}" >subtree.raw &&
+	head -1 subtree.raw >subtree.out &&
+	tail -n +2 subtree.raw | sort -n >>subtree.out &&
+	test_cmp subtree.exp subtree.out
+'
+
+test_expect_success 'ranks outside the subtree get EHOSTUNREACH' '
+	test_must_fail ${TMRPC} --subtree 1 "[2-3]" req.echo "{}" \
+		>unreach.out &&
+	grep "^2: No route to host" unreach.out &&
+	grep "^3: {}" unreach.out
+'
+
+test_expect_success 'service error is returned per rank' '
+	test_must_fail ${TMRPC} all req.err >err.out &&
+	test $(grep -c "^[0-3]: " err.out) -eq ${SIZE} &&
+	test $(grep -c "^[0-3]: {" err.out) -eq 0
+'
+
+test_expect_success 'raw response payloads are rejected with EPROTO' '
+	test_must_fail ${TMRPC} all req.raw >raw.out &&
+	test $(grep -c "^[0-3]: Protocol error" raw.out) -eq ${SIZE}
+'
+
+test_expect_success 'remove req module on rank 2' '
+	flux module remove --rank=2 req
+'
+
+test_expect_success 'one failing rank does not fail the others' '
+	test_must_fail ${TMRPC} all req.echo "{\"x\":42}" >fail.out &&
+	grep "^0: {\"x\":42}" fail.out &&
+	grep "^1: {\"x\":42}" fail.out &&
+	grep "^2: Function not implemented" fail.out &&
+	grep "^3: {\"x\":42}" fail.out
+'
+
+test_expect_success 'remove req module on the other ranks' '
+	flux module remove --rank="[0-1,3]" req
+'
+
+test_done
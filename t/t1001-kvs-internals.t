@@ -267,6 +267,35 @@ test_expect_success 'kvs: unlink on rank 0, does not exist all ranks' '
 	flux exec sh -c "flux kvs wait ${VERS} && ! flux kvs get --json $DIR.xxx"
 '
 
+# setroot events carry only the changed root dir entries by default,
+# which followers apply to their cached copy of the previous root dir
+test_expect_success 'kvs: root dir changes on rank 0, seen on all ranks' '
+	VERS=$(flux kvs version) &&
+	flux exec -r 1 sh -c "flux kvs wait ${VERS}" &&
+	flux exec -r 1 flux module stats -c kvs &&
+	flux kvs put --json rootdelta_a=1 rootdelta_b=2 &&
+	flux kvs put --json rootdelta_a=3 &&
+	flux kvs unlink rootdelta_b &&
+	VERS=$(flux kvs version) &&
+	flux exec sh -c "flux kvs wait ${VERS} && \
+		test \$(flux kvs get --json rootdelta_a) = 3 && \
+		! flux kvs get --json rootdelta_b" &&
+	APPLIED=$(flux exec -r 1 flux module stats --type int \
+		--parse "cache.#rootdir deltas applied" kvs) &&
+	test $APPLIED -ge 3 &&
+	flux kvs unlink rootdelta_a
+'
+
+test_expect_success 'kvs: repeated lookup hits the lookup cache' '
+	flux kvs put $DIR.pathcache=1 &&
+	flux module stats -c kvs &&
+	flux kvs get $DIR.pathcache &&
+	flux kvs get $DIR.pathcache &&
+	HITS=$(flux module stats --type int --parse "cache.#lookup cache hits" kvs) &&
+	test $HITS -ge 1 &&
+	flux kvs unlink $DIR.pathcache
+'
+
 #
 # test clear of stats
 #
@@ -297,4 +326,41 @@ test_expect_success 'kvs: clear stats globally' '
         flux exec sh -c "flux module stats kvs | grep no-op | grep -q 0"
 '
 
+#
+# test directory sharding, which is off unless enabled with dir-shard=N
+#
+
+test_expect_success 'kvs: large directory is not sharded by default' '
+	flux kvs put $(for i in $(seq 1 1100); do echo $DIR.unsharded.k$i=$i; done) &&
+	dirhash=$(flux kvs get --treeobj $DIR.unsharded | grep -P "sha1-[A-Za-z0-9]+" -o) &&
+	! flux content load ${dirhash} | grep -q \"hdir\" &&
+	flux kvs unlink -Rf $DIR.unsharded
+'
+
+test_expect_success 'kvs: reload kvs with directory sharding enabled' '
+	flux module remove -r all -x 0 kvs &&
+	flux module remove -r 0 kvs &&
+	flux module load -r 0 kvs dir-shard=1024 &&
+	flux module load -r all -x 0 kvs dir-shard=1024
+'
+
+test_expect_success 'kvs: large directory is stored sharded' '
+	flux kvs put $(for i in $(seq 1 1100); do echo $DIR.sharded.k$i=$i; done) &&
+	dirhash=$(flux kvs get --treeobj $DIR.sharded | grep -P "sha1-[A-Za-z0-9]+" -o) &&
+	flux content load ${dirhash} | grep -q \"hdir\" &&
+	test $(flux kvs dir $DIR.sharded | wc -l) -eq 1100 &&
+	test $(flux kvs get $DIR.sharded.k777) -eq 777
+'
+
+test_expect_success 'kvs: sharded directory can be updated on all ranks' '
+	flux kvs put $DIR.sharded.k777=abc &&
+	flux kvs unlink $DIR.sharded.k1 &&
+	VERS=$(flux kvs version) &&
+	flux exec sh -c "flux kvs wait ${VERS} && \
+		test \$(flux kvs get $DIR.sharded.k777) = abc && \
+		! flux kvs get $DIR.sharded.k1 && \
+		test \$(flux kvs dir $DIR.sharded | wc -l) -eq 1099" &&
+	flux kvs unlink -Rf $DIR.sharded
+'
+
 test_done
@@ -42,6 +42,24 @@ test_expect_success NO_CHAIN_LINT 'kvs: watch a key'  '
         test_cmp watch_out expected
 '
 
+test_expect_success NO_CHAIN_LINT 'kvs: watch a key written through a symlink'  '
+	flux kvs unlink -Rf $DIR &&
+        flux kvs put --json $DIR.a.foo=0 &&
+        flux kvs link $DIR.a $DIR.link &&
+        wait_watch_put "$DIR.a.foo" "0"
+        rm -f watch_out
+	stdbuf -oL flux kvs watch -o -c 1 $DIR.a.foo >watch_out &
+        watchpid=$! &&
+        wait_watch_file watch_out "0"
+        flux kvs put --json $DIR.link.foo=1 &&
+        wait $watchpid
+	cat >expected <<-EOF &&
+	0
+	1
+	EOF
+        test_cmp watch_out expected
+'
+
 test_expect_success NO_CHAIN_LINT 'kvs: watch a key that at first doesnt exist'  '
 	flux kvs unlink -Rf $DIR &&
         wait_watch_empty "$DIR.foo"
@@ -47,4 +47,91 @@ test_expect_success 'kz: KZ_FLAGS_DELAYCOMMIT content gets committed' '
 	test_cmp kztest.5.in kztest.5.out
 '
 
+test_expect_success 'kz: load kzstream module' '
+	flux module load -r 0 kzstream
+'
+
+test_expect_success 'kzstream: hello world copy in, copy out' '
+	echo "hello world" >kzstest.1.in &&
+	${FLUX_BUILD_DIR}/t/kz/kzutil --b 4096 -c - kzstest.1 <kzstest.1.in &&
+	${FLUX_BUILD_DIR}/t/kz/kzutil -c kzstest.1 - >kzstest.1.out &&
+	test_cmp kzstest.1.in kzstest.1.out
+'
+
+test_expect_success 'kzstream: stream index is archived to the KVS at close' '
+	test "$(flux kvs dir -d kzstest.1)" = "kzstest.1.index" &&
+	flux kvs get kzstest.1.index | grep chunks
+'
+
+test_expect_success 'kzstream: 128K urandom copy in, copy out' '
+	dd if=/dev/urandom bs=4096 count=32 2>/dev/null >kzstest.2.in &&
+	${FLUX_BUILD_DIR}/t/kz/kzutil -b 4096 -c - kzstest.2 <kzstest.2.in &&
+	${FLUX_BUILD_DIR}/t/kz/kzutil -c kzstest.2 - >kzstest.2.out &&
+	test_cmp kzstest.2.in kzstest.2.out
+'
+
+test_expect_success 'kzstream: stream can be read on another rank' '
+	flux exec -r 1 ${FLUX_BUILD_DIR}/t/kz/kzutil -c kzstest.2 - \
+		>kzstest.2.out2 &&
+	test_cmp kzstest.2.in kzstest.2.out2
+'
+
+test_expect_success 'kzstream: stream can be read through a symlink' '
+	flux kvs link kzstest.2 kzstest.link &&
+	${FLUX_BUILD_DIR}/t/kz/kzutil -c kzstest.link - >kzstest.2.out4 &&
+	test_cmp kzstest.2.in kzstest.2.out4
+'
+
+test_expect_success 'kzstream: stream can be read through a chain of symlinks' '
+	flux kvs link kzstest.link kzstest.link2 &&
+	${FLUX_BUILD_DIR}/t/kz/kzutil -c kzstest.link2 - >kzstest.2.out5 &&
+	test_cmp kzstest.2.in kzstest.2.out5
+'
+
+test_expect_success 'kzstream: write to existing stream (without KZ_FLAGS_TRUNC) fails' '
+	echo "hello world" >kzstest.3.in &&
+	${FLUX_BUILD_DIR}/t/kz/kzutil -c - kzstest.3 <kzstest.3.in &&
+	! ${FLUX_BUILD_DIR}/t/kz/kzutil -c - kzstest.3 <kzstest.3.in
+'
+
+test_expect_success 'kzstream: KZ_FLAGS_TRUNC truncates original content' '
+	dd if=/dev/urandom bs=4096 count=32 2>/dev/null >kzstest.4.in &&
+	${FLUX_BUILD_DIR}/t/kz/kzutil -b 4096 -c - kzstest.4 <kzstest.4.in &&
+	echo "hello world" >kzstest.4.in2 &&
+	${FLUX_BUILD_DIR}/t/kz/kzutil -t -c - kzstest.4 <kzstest.4.in2 &&
+	${FLUX_BUILD_DIR}/t/kz/kzutil -c kzstest.4 - >kzstest.4.out &&
+	test_cmp kzstest.4.in2 kzstest.4.out
+'
+
+test_expect_success 'kzstream: KZ_FLAGS_DELAYCOMMIT content gets written' '
+	dd if=/dev/urandom bs=4096 count=32 2>/dev/null >kzstest.5.in &&
+	${FLUX_BUILD_DIR}/t/kz/kzutil -d -b 4096 -c - kzstest.5 <kzstest.5.in &&
+	${FLUX_BUILD_DIR}/t/kz/kzutil -c kzstest.5 - >kzstest.5.out &&
+	test_cmp kzstest.5.in kzstest.5.out
+'
+
+test_expect_success 'kzstream: kzbench runs' '
+	${FLUX_BUILD_DIR}/t/kz/kzbench --streams 4 --count 100 &&
+	${FLUX_BUILD_DIR}/t/kz/kzbench --streams 4 --count 100 --delay-commit
+'
+
+test_expect_success 'kzstream: stats show archived streams' '
+	test $(flux module stats --type int \
+		--parse "#streams archived" kzstream) -ge 13
+'
+
+test_expect_success 'kz: remove kzstream module' '
+	flux module remove -r 0 kzstream
+'
+
+test_expect_success 'kz: archived stream can be read without kzstream' '
+	${FLUX_BUILD_DIR}/t/kz/kzutil -c kzstest.2 - >kzstest.2.out3 &&
+	test_cmp kzstest.2.in kzstest.2.out3
+'
+
+test_expect_success 'kz: archived stream can be read through a symlink' '
+	${FLUX_BUILD_DIR}/t/kz/kzutil -c kzstest.link - >kzstest.2.out6 &&
+	test_cmp kzstest.2.in kzstest.2.out6
+'
+
 test_done
@@ -58,6 +58,21 @@ test_expect_success 'wreckrun: does not drop output' '
 	run_timeout 5 flux wreckrun -N1 -n1 cat expected >output &&
 	test_cmp expected output
 '
+test_expect_success 'wreckrun: batched output keeps per-task line order' '
+	run_timeout 10 flux wreckrun -l -n${SIZE} \
+		-o stdio-batch-bytes=1000000,stdio-batch-ms=200 \
+		sh -c "seq 1 100" >output.batch &&
+	for i in $(seq 0 $((${SIZE}-1))); do
+		seq 1 100 | sed "s/^/$i: /" >expected.batch.$i &&
+		grep "^$i: " output.batch >output.batch.$i &&
+		test_cmp expected.batch.$i output.batch.$i || return 1
+	done
+'
+test_expect_success 'wreckrun: stdio-batch-bytes=0 flushes each read' '
+	run_timeout 5 flux wreckrun -N1 -n1 -o stdio-batch-bytes=0 \
+		cat expected >output.nobatch &&
+	test_cmp expected output.nobatch
+'
 test_expect_success 'wreckrun: handles stdin' '
 	cat >expected.stdin <<-EOF &&
 	This is a test.
@@ -170,4 +170,44 @@ test_expect_success 'pmi: (put*16) / barrier / (get*16*size) pattern works' '
 	grep -q "get phase" output_kvstest4
 '
 
+test_expect_success 'pmi: (put*16) / barrier / (get*16*size) works on one node' '
+	run_program 60 ${SIZE} 1 ${KVSTEST} -n -N 16 >output_kvstest5 &&
+	grep -q "put phase" output_kvstest5 &&
+	grep -q "get phase" output_kvstest5
+'
+
+test_expect_success 'pmi: allgather exchange does not write keys to kvs' '
+	flux kvs dir -d $(flux wreck last-jobid -p).pmi >pmi_keys_ag &&
+	test_must_fail grep -q kvstest- pmi_keys_ag
+'
+
+test_expect_success 'pmi: pattern works with pmi-exchange=kvs' '
+	run_program 60 ${SIZE} ${SIZE} -o pmi-exchange=kvs \
+		${KVSTEST} -n -N 16 >output_kvstest6 &&
+	grep -q "get phase" output_kvstest6 &&
+	flux kvs dir -d $(flux wreck last-jobid -p).pmi >pmi_keys &&
+	test $(grep -c kvstest- pmi_keys) -eq $((${SIZE}*16))
+'
+
+# wrexecd logs how many PMI gets it served and how many cost a kvs lookup
+test_expect_success 'pmi: gets after kvs fence are served from prefetched keys' '
+	run_program 60 ${SIZE} 1 -o pmi-exchange=kvs \
+		${KVSTEST} -n -N 16 >output_kvstest8 &&
+	grep "get phase" output_kvstest8 &&
+	id=$(flux wreck last-jobid) &&
+	flux dmesg | grep "lwj\.${id}\..*node0: pmi: " >pmi_stats &&
+	cat pmi_stats &&
+	gets=$(sed -n "s/.*pmi: \([0-9]*\) gets.*/\1/p" pmi_stats) &&
+	lookups=$(sed -n "s/.*gets, \([0-9]*\) kvs lookups.*/\1/p" pmi_stats) &&
+	test $gets -ge $((${SIZE}*${SIZE}*16)) &&
+	test $lookups -lt $gets
+'
+
+test_expect_success 'pmi: pattern works without allgather module' '
+	flux module remove -r all allgather &&
+	test_when_finished "flux module load -r all allgather" &&
+	run_program 60 ${SIZE} ${SIZE} ${KVSTEST} -n -N 16 >output_kvstest7 &&
+	grep -q "get phase" output_kvstest7
+'
+
 test_done